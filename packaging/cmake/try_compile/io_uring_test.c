@@ -0,0 +1,9 @@
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+int main() {
+   struct io_uring_params p = { 0 };
+   return IORING_OP_READ_FIXED + IORING_OP_SENDMSG +
+          (int)p.sq_off.array + __NR_io_uring_setup + __NR_io_uring_enter +
+          __NR_io_uring_register ? 0 : 1;
+}
@@ -91,3 +91,11 @@ try_compile(
     "${TRYCOMPILE_SRC_DIR}/crc32c_hw_test.c"
 )
 # }
+
+# io_uring (kernel headers only, the raw syscalls are used) {
+try_compile(
+    WITH_IO_URING
+    "${CMAKE_CURRENT_BINARY_DIR}/try_compile"
+    "${TRYCOMPILE_SRC_DIR}/io_uring_test.c"
+)
+# }
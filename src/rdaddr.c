@@ -150,7 +150,7 @@ rd_sockaddr_list_t *rd_getaddrinfo (const char *nodesvc, const char *defsvc,
 	struct addrinfo hints = { .ai_family = family,
 				  .ai_socktype = socktype,
 				  .ai_protocol = protocol,
-				  .ai_flags = flags };
+				  .ai_flags = flags & ~RD_AI_NOSHUFFLE };
 	struct addrinfo *ais, *ai;
 	char *node, *svc;
 	int r;
@@ -200,4 +200,95 @@ static RD_INLINE int64_t RD_UNUSED rd_atomic64_set(rd_atomic64_t *ra, int64_t v)
 #endif
 }
 
+
+
+/**
+ * Lock-free operations on plain int64_t variables, such as the counts
+ * of a histogram, where an rd_atomic64_t per variable is not an option.
+ *
+ * Only available where 64-bit atomics are, in which case
+ * RD_ATOMIC64_PTR is defined.
+ */
+#if defined(__SUNPRO_C) || defined(_MSC_VER) || HAVE_ATOMICS_64
+#define RD_ATOMIC64_PTR 1
+
+static RD_INLINE int64_t RD_UNUSED rd_atomic64_ptr_add (int64_t *p,
+                                                        int64_t v) {
+#ifdef __SUNPRO_C
+        return atomic_add_64_nv((volatile uint64_t *)p, v);
+#elif defined(_MSC_VER)
+        return InterlockedAdd64(p, v);
+#else
+        return ATOMIC_OP64(add, fetch, p, v);
+#endif
+}
+
+static RD_INLINE int64_t RD_UNUSED rd_atomic64_ptr_get (int64_t *p) {
+#if defined(__SUNPRO_C) || defined(_MSC_VER) || HAVE_ATOMICS_64_SYNC
+        return rd_atomic64_ptr_add(p, 0);
+#else
+        return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * @brief Set \p *p to \p newval if it is \p oldval.
+ *
+ * @returns true if \p *p was set.
+ */
+static RD_INLINE int RD_UNUSED rd_atomic64_ptr_cas (int64_t *p,
+                                                    int64_t oldval,
+                                                    int64_t newval) {
+#ifdef __SUNPRO_C
+        return (int64_t)atomic_cas_64((volatile uint64_t *)p,
+                                      (uint64_t)oldval,
+                                      (uint64_t)newval) == oldval;
+#elif defined(_MSC_VER)
+        return InterlockedCompareExchange64(p, newval, oldval) == oldval;
+#elif HAVE_ATOMICS_64_SYNC
+        return __sync_bool_compare_and_swap(p, oldval, newval);
+#else
+        return __atomic_compare_exchange_n(p, &oldval, newval, 0,
+                                           __ATOMIC_SEQ_CST,
+                                           __ATOMIC_SEQ_CST);
+#endif
+}
+#endif
+
+
+/**
+ * @brief Set \p ra to \p newval if it is \p oldval.
+ *
+ * @returns true if \p ra was set.
+ */
+static RD_INLINE int RD_UNUSED rd_atomic64_cas (rd_atomic64_t *ra,
+                                                int64_t oldval,
+                                                int64_t newval) {
+#ifdef RD_ATOMIC64_PTR
+        return rd_atomic64_ptr_cas(&ra->val, oldval, newval);
+#else
+        int r;
+        mtx_lock(&ra->lock);
+        r = ra->val == oldval;
+        if (r)
+                ra->val = newval;
+        mtx_unlock(&ra->lock);
+        return r;
+#endif
+}
+
+
+/**
+ * @brief Set \p ra to \p v if \p v is larger than its current value.
+ */
+static RD_INLINE void RD_UNUSED rd_atomic64_max (rd_atomic64_t *ra,
+                                                 int64_t v) {
+        int64_t cur;
+
+        while (v > (cur = rd_atomic64_get(ra)) &&
+               !rd_atomic64_cas(ra, cur, v))
+                ;
+}
+
+
 #endif /* _RDATOMIC_H_ */
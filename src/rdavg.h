@@ -6,6 +6,85 @@
 #include "rdhdrhistogram.h"
 #endif
 
+/**
+ * Number of histogram buckets calculated on rollover, the bucket
+ * upper bounds are the 1-2-5 series 1, 2, 5, 10, 20, 50, .. 5*10^9,
+ * see rd_avg_bucket_bound().
+ */
+#define RD_AVG_BUCKET_CNT 30
+
+/**
+ * @returns the upper bound of histogram bucket \p i.
+ */
+static RD_INLINE RD_UNUSED int64_t rd_avg_bucket_bound (int i) {
+        static const int64_t mult[3] = { 1, 2, 5 };
+        int64_t v = mult[i % 3];
+        int j;
+
+        for (j = 0 ; j < i / 3 ; j++)
+                v *= 10;
+
+        return v;
+}
+
+/**
+ * Number of shards per averager.
+ *
+ * Each thread records into its own shard (see rd_avg_thread_shard), so
+ * that threads recording into the same averager, e.g. the broker threads
+ * recording topic batch sizes, do not update the same cache lines.
+ * The shards are merged by rd_avg_rollover() and rd_avg_peek().
+ */
+#define RD_AVG_SHARD_CNT 4
+
+/** Current thread's shard + 1, or 0 if not yet assigned. */
+extern int RD_TLS rd_avg_thread_shard;
+/** Round-robin shard assignment for new threads. */
+extern rd_atomic32_t rd_avg_shard_next;
+
+/**
+ * Recording epoch of a shard.
+ *
+ * Values are recorded, without locking, into the shard's current
+ * epoch. rd_avg_rollover() switches recording over to the other epoch
+ * and waits for the threads still recording into the previous epoch,
+ * which only takes a few atomic operations, before reading it.
+ */
+typedef struct rd_avg_epoch_s {
+        rd_atomic32_t rae_writers;   /**< Threads recording into this
+                                      *   epoch. */
+        rd_atomic64_t rae_maxv;
+        rd_atomic64_t rae_minv;
+        rd_atomic64_t rae_sum;
+        rd_atomic64_t rae_cnt;
+#if WITH_HDRHISTOGRAM
+        rd_hdr_histogram_t *rae_hdr; /**< Allocated by rd_avg_rollover()
+                                      *   once the shard is used, until
+                                      *   then the shard's values are
+                                      *   recorded into the first shard's
+                                      *   histogram, whose first epoch is
+                                      *   allocated by rd_avg_init(). */
+#ifndef RD_ATOMIC64_PTR
+        mtx_t rae_hdr_lock;          /**< Serializes recording into
+                                      *   rae_hdr without 64-bit
+                                      *   atomics. */
+#endif
+#endif
+} rd_avg_epoch_t;
+
+typedef struct rd_avg_shard_s {
+        rd_atomic32_t  ras_epoch;    /**< Current epoch, 0 or 1, the same
+                                      *   for all shards outside of
+                                      *   rd_avg_rollover(). */
+#if WITH_HDRHISTOGRAM
+        rd_atomic32_t  ras_used;     /**< Recorded into without a
+                                      *   histogram of its own. */
+#endif
+        rd_avg_epoch_t ras_epochs[2];
+        char           ras_pad[64];  /**< Keep shards on separate
+                                      *   cache lines. */
+} rd_avg_shard_t;
+
 typedef struct rd_avg_s {
         struct {
                 int64_t maxv;
@@ -15,14 +94,18 @@ typedef struct rd_avg_s {
                 int     cnt;
                 rd_ts_t start;
         } ra_v;
-        mtx_t ra_lock;
+        mtx_t ra_lock;   /**< Serializes rd_avg_rollover() */
         int   ra_enabled;
         enum {
                 RD_AVG_GAUGE,
                 RD_AVG_COUNTER,
         } ra_type;
+        rd_avg_shard_t ra_shards[RD_AVG_SHARD_CNT];
 #if WITH_HDRHISTOGRAM
-        rd_hdr_histogram_t *ra_hdr;
+        /* Initial histogram span */
+        int64_t ra_hdr_min;
+        int64_t ra_hdr_max;
+        int     ra_hdr_sigfigs;
 #endif
         /* Histogram results, calculated for dst in rollover().
          * Will be all zeroes if histograms are not supported. */
@@ -39,29 +122,75 @@ typedef struct rd_avg_s {
                 int32_t hdrsize; /**< hdr.allocatedSize */
                 double stddev;
                 double mean;
+
+                /** Cumulative bucket counts: values <=
+                 *  rd_avg_bucket_bound(i) */
+                int64_t buckets[RD_AVG_BUCKET_CNT];
         } ra_hist;
 } rd_avg_t;
 
 
 /**
  * @brief Add value \p v to averager \p ra.
+ *
+ * Lock-free where 64-bit atomics are available.
  */
 static RD_UNUSED void rd_avg_add (rd_avg_t *ra, int64_t v) {
-        mtx_lock(&ra->ra_lock);
-        if (!ra->ra_enabled) {
-                mtx_unlock(&ra->ra_lock);
+        rd_avg_shard_t *ras;
+        rd_avg_epoch_t *rae;
+#if WITH_HDRHISTOGRAM
+        rd_avg_epoch_t *hrae;
+#endif
+        int64_t cur;
+        int epoch;
+
+        /* ra_enabled is immutable after rd_avg_init() */
+        if (!ra->ra_enabled)
                 return;
+
+        if (unlikely(!rd_avg_thread_shard))
+                rd_avg_thread_shard = 1 + (int)
+                        ((uint32_t)rd_atomic32_add(&rd_avg_shard_next, 1) %
+                         RD_AVG_SHARD_CNT);
+
+        ras = &ra->ra_shards[rd_avg_thread_shard - 1];
+
+        /* Enter the current epoch: if a rollover switched epochs before
+         * it saw this thread as a writer, retry in the new epoch. */
+        while (1) {
+                epoch = rd_atomic32_get(&ras->ras_epoch);
+                rae = &ras->ras_epochs[epoch];
+                rd_atomic32_add(&rae->rae_writers, 1);
+                if (likely(rd_atomic32_get(&ras->ras_epoch) == epoch))
+                        break;
+                rd_atomic32_sub(&rae->rae_writers, 1);
         }
-	if (v > ra->ra_v.maxv)
-		ra->ra_v.maxv = v;
-	if (ra->ra_v.minv == 0 || v < ra->ra_v.minv)
-		ra->ra_v.minv = v;
-	ra->ra_v.sum += v;
-	ra->ra_v.cnt++;
+
+        rd_atomic64_max(&rae->rae_maxv, v);
+        /* A minimum of 0 means no value, as for ra_v.minv. */
+        while (((cur = rd_atomic64_get(&rae->rae_minv)) == 0 || v < cur) &&
+               !rd_atomic64_cas(&rae->rae_minv, cur, v))
+                ;
+        rd_atomic64_add(&rae->rae_sum, v);
+        rd_atomic64_add(&rae->rae_cnt, 1);
 #if WITH_HDRHISTOGRAM
-        rd_hdr_histogram_record(ra->ra_hdr, v);
+        hrae = rae;
+        if (unlikely(!rae->rae_hdr)) {
+                /* Have the next rollover allocate this shard's histogram,
+                 * until then record into the first shard's. */
+                rd_atomic32_set(&ras->ras_used, 1);
+                hrae = &ra->ra_shards[0].ras_epochs[epoch];
+        }
+#ifdef RD_ATOMIC64_PTR
+        rd_hdr_histogram_record_atomic(hrae->rae_hdr, v);
+#else
+        mtx_lock(&hrae->rae_hdr_lock);
+        rd_hdr_histogram_record(hrae->rae_hdr, v);
+        mtx_unlock(&hrae->rae_hdr_lock);
 #endif
-        mtx_unlock(&ra->ra_lock);
+#endif
+
+        rd_atomic32_sub(&rae->rae_writers, 1);
 }
 
 
@@ -87,111 +216,281 @@ static RD_UNUSED void rd_avg_calc (rd_avg_t *ra, rd_ts_t now) {
 }
 
 
+#if WITH_HDRHISTOGRAM
 /**
- * @returns the quantile \q for \p ra, or 0 if histograms are not supported
- *          in this build.
+ * @brief Reset the epoch histogram \p *hdrp after rollover, adapting
+ *        its span to fit future out of range entries from this period.
+ */
+static RD_UNUSED void rd_avg_hdr_adapt (rd_hdr_histogram_t **hdrp) {
+        rd_hdr_histogram_t *hdr = *hdrp;
+        int64_t vmin = hdr->lowestTrackableValue;
+        int64_t vmax = hdr->highestTrackableValue;
+        int64_t mindiff, maxdiff;
+
+        if (hdr->totalCount == 0 && hdr->outOfRangeCount == 0)
+                return; /* No records, no need to reset. */
+
+        mindiff = hdr->lowestTrackableValue - hdr->lowestOutOfRange;
+
+        if (mindiff > 0) {
+                /* There were low out of range values, grow lower
+                 * span to fit lowest out of range value + 20%. */
+                vmin = hdr->lowestOutOfRange +
+                        (int64_t)((double)mindiff * 0.2);
+        }
+
+        maxdiff = hdr->highestOutOfRange - hdr->highestTrackableValue;
+
+        if (maxdiff > 0) {
+                /* There were high out of range values, grow higher
+                 * span to fit highest out of range value + 20%. */
+                vmax = hdr->highestOutOfRange +
+                        (int64_t)((double)maxdiff * 0.2);
+        }
+
+        if (vmin == hdr->lowestTrackableValue &&
+            vmax == hdr->highestTrackableValue) {
+                /* No change in min,max, use existing hdr */
+                rd_hdr_histogram_reset(hdr);
+
+        } else {
+                int sigfigs = (int)hdr->significantFigures;
+                /* Create new hdr for adapted range */
+                rd_hdr_histogram_destroy(hdr);
+                *hdrp = rd_hdr_histogram_new(vmin, vmax, sigfigs);
+        }
+}
+
+
+/**
+ * @brief Calculate the histogram results of \p dst from \p hdr.
+ */
+static RD_UNUSED void rd_avg_hist_calc (rd_avg_t *dst,
+                                        rd_hdr_histogram_t *hdr) {
+        int64_t bounds[RD_AVG_BUCKET_CNT];
+        int i;
+
+        dst->ra_hist.stddev  = rd_hdr_histogram_stddev(hdr);
+        dst->ra_hist.mean    = rd_hdr_histogram_mean(hdr);
+        dst->ra_hist.oor     = hdr->outOfRangeCount;
+        dst->ra_hist.hdrsize = hdr->allocatedSize;
+        dst->ra_hist.p50     = rd_hdr_histogram_quantile(hdr, 50.0);
+        dst->ra_hist.p75     = rd_hdr_histogram_quantile(hdr, 75.0);
+        dst->ra_hist.p90     = rd_hdr_histogram_quantile(hdr, 90.0);
+        dst->ra_hist.p95     = rd_hdr_histogram_quantile(hdr, 95.0);
+        dst->ra_hist.p99     = rd_hdr_histogram_quantile(hdr, 99.0);
+        dst->ra_hist.p99_99  = rd_hdr_histogram_quantile(hdr, 99.99);
+
+        for (i = 0 ; i < RD_AVG_BUCKET_CNT ; i++)
+                bounds[i] = rd_avg_bucket_bound(i);
+
+        rd_hdr_histogram_buckets(hdr, bounds, RD_AVG_BUCKET_CNT,
+                                 dst->ra_hist.buckets);
+}
+
+
+/**
+ * @brief Calculate the histogram results of \p dst from the histograms
+ *        of \p epoch of all the shards of \p src.
  *
- * @remark ra will be not locked by this function.
+ * @param copy copy the histograms before reading them, since they may
+ *             be recorded into meanwhile.
+ *
+ * @locks \p src->ra_lock MUST be held.
  */
-static RD_UNUSED int64_t
-rd_avg_quantile (const rd_avg_t *ra, double q) {
-#if WITH_HDRHISTOGRAM
-        return rd_hdr_histogram_quantile(ra->ra_hdr, q);
-#else
-        return 0;
+static RD_UNUSED void rd_avg_hist_merge (rd_avg_t *dst, rd_avg_t *src,
+                                         int epoch, rd_bool_t copy) {
+        rd_hdr_histogram_t *hdrs[RD_AVG_SHARD_CNT], *hdr;
+        int64_t vmin = src->ra_hdr_min, vmax = src->ra_hdr_max;
+        int32_t hdrsize = 0;
+        int i, cnt = 0;
+
+        for (i = 0 ; i < RD_AVG_SHARD_CNT ; i++) {
+                rd_avg_epoch_t *rae = &src->ra_shards[i].ras_epochs[epoch];
+
+                if (!rae->rae_hdr)
+                        continue;
+
+                if (copy) {
+#ifndef RD_ATOMIC64_PTR
+                        mtx_lock(&rae->rae_hdr_lock);
+#endif
+                        hdrs[cnt] = rd_hdr_histogram_dup(rae->rae_hdr);
+#ifndef RD_ATOMIC64_PTR
+                        mtx_unlock(&rae->rae_hdr_lock);
+#endif
+                } else
+                        hdrs[cnt] = rae->rae_hdr;
+
+                hdrsize += rae->rae_hdr->allocatedSize;
+                vmin = RD_MIN(vmin, hdrs[cnt]->lowestTrackableValue);
+                vmax = RD_MAX(vmax, hdrs[cnt]->highestTrackableValue);
+                cnt++;
+        }
+
+        if (cnt == 1) {
+                /* Only recorded into from a single shard */
+                hdr = hdrs[0];
+        } else {
+                hdr = rd_hdr_histogram_new(vmin, vmax, src->ra_hdr_sigfigs);
+                for (i = 0 ; i < cnt ; i++)
+                        rd_hdr_histogram_merge(hdr, hdrs[i]);
+        }
+
+        rd_avg_hist_calc(dst, hdr);
+        dst->ra_hist.hdrsize = hdrsize;
+
+        if (cnt != 1)
+                rd_hdr_histogram_destroy(hdr);
+        for (i = 0 ; copy && i < cnt ; i++)
+                rd_hdr_histogram_destroy(hdrs[i]);
+}
 #endif
+
+
+/**
+ * @brief Add the values of epoch \p rae to \p dst, resetting \p rae
+ *        if \p reset is set.
+ */
+static RD_UNUSED void rd_avg_epoch_read (rd_avg_t *dst, rd_avg_epoch_t *rae,
+                                         rd_bool_t reset) {
+        int64_t maxv = rd_atomic64_get(&rae->rae_maxv);
+        int64_t minv = rd_atomic64_get(&rae->rae_minv);
+        int64_t sum = rd_atomic64_get(&rae->rae_sum);
+        int64_t cnt = rd_atomic64_get(&rae->rae_cnt);
+
+        if (reset) {
+                rd_atomic64_set(&rae->rae_maxv, 0);
+                rd_atomic64_set(&rae->rae_minv, 0);
+                rd_atomic64_set(&rae->rae_sum, 0);
+                rd_atomic64_set(&rae->rae_cnt, 0);
+        }
+
+        if (cnt == 0)
+                return;
+
+        if (maxv > dst->ra_v.maxv)
+                dst->ra_v.maxv = maxv;
+        if (dst->ra_v.minv == 0 || (minv != 0 && minv < dst->ra_v.minv))
+                dst->ra_v.minv = minv;
+        dst->ra_v.sum += sum;
+        dst->ra_v.cnt += (int)cnt;
 }
 
+
 /**
  * @brief Rolls over statistics in \p src and stores the average in \p dst.
  * \p src is cleared and ready to be reused.
  *
+ * Recording switches over to the other epoch of each shard of \p src,
+ * and may proceed while the previous epoch is read.
+ *
  * Caller must free avg internal members by calling rd_avg_destroy()
  * on the \p dst.
  */
 static RD_UNUSED void rd_avg_rollover (rd_avg_t *dst, rd_avg_t *src) {
         rd_ts_t now;
+        int epoch, i;
 
-        mtx_lock(&src->ra_lock);
-        if (!src->ra_enabled) {
-                memset(dst, 0, sizeof(*dst));
-                dst->ra_type = src->ra_type;
-                mtx_unlock(&src->ra_lock);
-                return;
-        }
-
+        memset(dst, 0, sizeof(*dst));
         mtx_init(&dst->ra_lock, mtx_plain);
         dst->ra_type = src->ra_type;
-	dst->ra_v    = src->ra_v;
+
+        if (!src->ra_enabled)
+                return;
+
+        mtx_lock(&src->ra_lock);
+
+        epoch = rd_atomic32_get(&src->ra_shards[0].ras_epoch);
+
 #if WITH_HDRHISTOGRAM
-        dst->ra_hdr = NULL;
-
-        dst->ra_hist.stddev = rd_hdr_histogram_stddev(src->ra_hdr);
-        dst->ra_hist.mean   = rd_hdr_histogram_mean(src->ra_hdr);
-        dst->ra_hist.oor    = src->ra_hdr->outOfRangeCount;
-        dst->ra_hist.hdrsize = src->ra_hdr->allocatedSize;
-        dst->ra_hist.p50    = rd_hdr_histogram_quantile(src->ra_hdr, 50.0);
-        dst->ra_hist.p75    = rd_hdr_histogram_quantile(src->ra_hdr, 75.0);
-        dst->ra_hist.p90    = rd_hdr_histogram_quantile(src->ra_hdr, 90.0);
-        dst->ra_hist.p95    = rd_hdr_histogram_quantile(src->ra_hdr, 95.0);
-        dst->ra_hist.p99    = rd_hdr_histogram_quantile(src->ra_hdr, 99.0);
-        dst->ra_hist.p99_99 = rd_hdr_histogram_quantile(src->ra_hdr, 99.99);
-#else
-        memset(&dst->ra_hist, 0, sizeof(dst->ra_hist));
+        /* The first shard always has a histogram for the next epoch,
+         * the other shards once they are used. */
+        for (i = 0 ; i < RD_AVG_SHARD_CNT ; i++) {
+                rd_avg_shard_t *ras = &src->ra_shards[i];
+
+                if (!ras->ras_epochs[!epoch].rae_hdr &&
+                    (i == 0 || rd_atomic32_get(&ras->ras_used)))
+                        ras->ras_epochs[!epoch].rae_hdr =
+                                rd_hdr_histogram_new(src->ra_hdr_min,
+                                                     src->ra_hdr_max,
+                                                     src->ra_hdr_sigfigs);
+        }
 #endif
-	memset(&src->ra_v, 0, sizeof(src->ra_v));
+
+        for (i = 0 ; i < RD_AVG_SHARD_CNT ; i++)
+                rd_atomic32_set(&src->ra_shards[i].ras_epoch, !epoch);
+
+        /* Wait for the threads that entered the previous epoch
+         * to finish recording, which they do without blocking. */
+        for (i = 0 ; i < RD_AVG_SHARD_CNT ; i++)
+                while (rd_atomic32_get(&src->ra_shards[i].ras_epochs[epoch].
+                                       rae_writers) > 0)
+                        thrd_yield();
 
         now = rd_clock();
+
+        for (i = 0 ; i < RD_AVG_SHARD_CNT ; i++)
+                rd_avg_epoch_read(dst, &src->ra_shards[i].ras_epochs[epoch],
+                                  rd_true/*reset*/);
+
+        dst->ra_v.start = src->ra_v.start;
         src->ra_v.start = now;
 
 #if WITH_HDRHISTOGRAM
-        /* Adapt histogram span to fit future out of range entries
-         * from this period. */
-        if (src->ra_hdr->totalCount > 0) {
-                int64_t vmin = src->ra_hdr->lowestTrackableValue;
-                int64_t vmax = src->ra_hdr->highestTrackableValue;
-                int64_t mindiff, maxdiff;
-
-                mindiff = src->ra_hdr->lowestTrackableValue -
-                        src->ra_hdr->lowestOutOfRange;
-
-                if (mindiff > 0) {
-                        /* There were low out of range values, grow lower
-                         * span to fit lowest out of range value + 20%. */
-                        vmin = src->ra_hdr->lowestOutOfRange +
-                                (int64_t)((double)mindiff * 0.2);
-                }
+        rd_avg_hist_merge(dst, src, epoch, rd_false/*no copy*/);
 
-                maxdiff = src->ra_hdr->highestOutOfRange -
-                        src->ra_hdr->highestTrackableValue;
+        /* The epoch is recorded into again after the next rollover */
+        for (i = 0 ; i < RD_AVG_SHARD_CNT ; i++) {
+                rd_avg_epoch_t *rae = &src->ra_shards[i].ras_epochs[epoch];
 
-                if (maxdiff > 0) {
-                        /* There were high out of range values, grow higher
-                         * span to fit highest out of range value + 20%. */
-                        vmax = src->ra_hdr->highestOutOfRange +
-                                (int64_t)((double)maxdiff * 0.2);
-                }
+                if (rae->rae_hdr)
+                        rd_avg_hdr_adapt(&rae->rae_hdr);
+        }
+#endif
 
-                if (vmin == src->ra_hdr->lowestTrackableValue &&
-                    vmax == src->ra_hdr->highestTrackableValue) {
-                        /* No change in min,max, use existing hdr */
-                        rd_hdr_histogram_reset(src->ra_hdr);
+        mtx_unlock(&src->ra_lock);
 
-                } else {
-                        int sigfigs = (int)src->ra_hdr->significantFigures;
-                        /* Create new hdr for adapted range */
-                        rd_hdr_histogram_destroy(src->ra_hdr);
-                        src->ra_hdr = rd_hdr_histogram_new(vmin, vmax, sigfigs);
-                }
+        rd_avg_calc(dst, now);
+}
 
-        } else {
-                /* No records, no need to reset. */
-        }
+
+/**
+ * @brief Stores the statistics of the current window of \p src in \p dst,
+ *        like rd_avg_rollover() but without clearing \p src.
+ *
+ * Values recorded meanwhile may be partially included.
+ *
+ * Caller must free avg internal members by calling rd_avg_destroy()
+ * on the \p dst.
+ */
+static RD_UNUSED void rd_avg_peek (rd_avg_t *dst, rd_avg_t *src) {
+        int epoch, i;
+
+        memset(dst, 0, sizeof(*dst));
+        mtx_init(&dst->ra_lock, mtx_plain);
+        dst->ra_type = src->ra_type;
+
+        if (!src->ra_enabled)
+                return;
+
+        /* Keeps the current epoch from being rolled over and cleared */
+        mtx_lock(&src->ra_lock);
+
+        epoch = rd_atomic32_get(&src->ra_shards[0].ras_epoch);
+
+        for (i = 0 ; i < RD_AVG_SHARD_CNT ; i++)
+                rd_avg_epoch_read(dst, &src->ra_shards[i].ras_epochs[epoch],
+                                  rd_false/*no reset*/);
+        dst->ra_v.start = src->ra_v.start;
+
+#if WITH_HDRHISTOGRAM
+        rd_avg_hist_merge(dst, src, epoch, rd_true/*copy*/);
 #endif
 
         mtx_unlock(&src->ra_lock);
 
-        rd_avg_calc(dst, now);
+        rd_avg_calc(dst, rd_clock());
 }
 
 
@@ -201,6 +500,8 @@ static RD_UNUSED void rd_avg_rollover (rd_avg_t *dst, rd_avg_t *src) {
 static RD_UNUSED void rd_avg_init (rd_avg_t *ra, int type,
                                    int64_t exp_min, int64_t exp_max,
                                    int sigfigs, int enable) {
+        int i, j;
+
         memset(ra, 0, sizeof(*ra));
         mtx_init(&ra->ra_lock, 0);
         ra->ra_enabled = enable;
@@ -208,10 +509,34 @@ static RD_UNUSED void rd_avg_init (rd_avg_t *ra, int type,
                 return;
         ra->ra_type = type;
         ra->ra_v.start = rd_clock();
+        for (i = 0 ; i < RD_AVG_SHARD_CNT ; i++) {
+                rd_avg_shard_t *ras = &ra->ra_shards[i];
+
+                rd_atomic32_init(&ras->ras_epoch, 0);
 #if WITH_HDRHISTOGRAM
-        /* Start off the histogram with expected min,max span,
+                rd_atomic32_init(&ras->ras_used, 0);
+#endif
+                for (j = 0 ; j < 2 ; j++) {
+                        rd_avg_epoch_t *rae = &ras->ras_epochs[j];
+
+                        rd_atomic32_init(&rae->rae_writers, 0);
+                        rd_atomic64_init(&rae->rae_maxv, 0);
+                        rd_atomic64_init(&rae->rae_minv, 0);
+                        rd_atomic64_init(&rae->rae_sum, 0);
+                        rd_atomic64_init(&rae->rae_cnt, 0);
+#if WITH_HDRHISTOGRAM && !defined(RD_ATOMIC64_PTR)
+                        mtx_init(&rae->rae_hdr_lock, mtx_plain);
+#endif
+                }
+        }
+#if WITH_HDRHISTOGRAM
+        /* Start off with expected min,max span,
          * we'll adapt the size on each rollover. */
-        ra->ra_hdr = rd_hdr_histogram_new(exp_min, exp_max, sigfigs);
+        ra->ra_hdr_min = exp_min;
+        ra->ra_hdr_max = exp_max;
+        ra->ra_hdr_sigfigs = sigfigs;
+        ra->ra_shards[0].ras_epochs[0].rae_hdr =
+                rd_hdr_histogram_new(exp_min, exp_max, sigfigs);
 #endif
 }
 
@@ -221,8 +546,21 @@ static RD_UNUSED void rd_avg_init (rd_avg_t *ra, int type,
  */
 static RD_UNUSED void rd_avg_destroy (rd_avg_t *ra) {
 #if WITH_HDRHISTOGRAM
-        if (ra->ra_hdr)
-                rd_hdr_histogram_destroy(ra->ra_hdr);
+        int i, j;
+
+        /* Shards are only initialized for enabled averagers,
+         * not for rd_avg_rollover() results. */
+        for (i = 0 ; ra->ra_enabled && i < RD_AVG_SHARD_CNT ; i++) {
+                for (j = 0 ; j < 2 ; j++) {
+                        rd_avg_epoch_t *rae = &ra->ra_shards[i].ras_epochs[j];
+
+                        if (rae->rae_hdr)
+                                rd_hdr_histogram_destroy(rae->rae_hdr);
+#ifndef RD_ATOMIC64_PTR
+                        mtx_destroy(&rae->rae_hdr_lock);
+#endif
+                }
+        }
 #endif
         mtx_destroy(&ra->ra_lock);
 }
@@ -1548,3 +1548,72 @@ int unittest_rdbuf (void) {
 
         return fails;
 }
+
+
+/**
+ * @brief Benchmark rd_slice_crc32c() of one \p size bytes slice made up
+ *        of \p segsize bytes segments.
+ */
+static int do_benchmark_slice_crc32c (size_t size, size_t segsize) {
+        char *payload = rd_malloc(size);
+        int reps = (int)RD_MAX(65536 / size, 1);
+        rd_ut_bench_t rub;
+        rd_buf_t b;
+        size_t of;
+        uint32_t crc = 0;
+
+        for (of = 0 ; of < size ; of++)
+                payload[of] = (char)(of * 31);
+
+        rd_buf_init(&b, size / segsize + 1, 0);
+        for (of = 0 ; of < size ; of += segsize)
+                rd_buf_push(&b, payload + of, RD_MIN(segsize, size - of),
+                            NULL);
+
+        rd_ut_bench_init(&rub, "crc32c/slice/size=%"PRIusz"/segsize=%"PRIusz,
+                         size, segsize);
+        while (rd_ut_bench_more(&rub)) {
+                int i;
+                rd_ut_bench_start(&rub);
+                for (i = 0 ; i < reps ; i++) {
+                        rd_slice_t slice;
+                        rd_slice_init_full(&slice, &b);
+                        crc ^= rd_slice_crc32c(&slice);
+                }
+                rd_ut_bench_stop(&rub, reps, (int64_t)(reps * size));
+        }
+        rd_ut_bench_report(&rub);
+
+        /* Verify against the contiguous CRC to make sure
+         * the work was not optimized away. */
+        {
+                rd_slice_t slice;
+                rd_slice_init_full(&slice, &b);
+                RD_UT_ASSERT(rd_slice_crc32c(&slice) ==
+                             crc32c(0, payload, size),
+                             "slice CRC mismatch (last xor 0x%"PRIx32")", crc);
+        }
+
+        rd_buf_destroy(&b);
+        rd_free(payload);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Benchmark rd_slice_crc32c() for typical message, batch and
+ *        fragmented (zero-copy payload) batch sizes.
+ */
+int benchmark_crc32c (void) {
+        int fails = 0;
+
+        crc32c_global_init();
+
+        fails += do_benchmark_slice_crc32c(64, 64);
+        fails += do_benchmark_slice_crc32c(1024, 1024);
+        fails += do_benchmark_slice_crc32c(65536, 65536);
+        fails += do_benchmark_slice_crc32c(65536, 512);
+
+        return fails;
+}
@@ -205,6 +205,7 @@ void rd_buf_destroy (rd_buf_t *rbuf);
 void rd_buf_dump (const rd_buf_t *rbuf, int do_hexdump);
 
 int unittest_rdbuf (void);
+int benchmark_crc32c (void);
 
 
 /**@}*/
@@ -407,6 +407,76 @@ int rd_hdr_histogram_record (rd_hdr_histogram_t *hdr, int64_t v) {
 }
 
 
+#ifdef RD_ATOMIC64_PTR
+/**
+ * @brief Same as rd_hdr_histogram_record() but safe to call from
+ *        multiple threads at once, without locking.
+ *
+ * The histogram must not be read or reset until all recorders are done.
+ */
+int rd_hdr_histogram_record_atomic (rd_hdr_histogram_t *hdr, int64_t v) {
+        int32_t idx = rd_hdr_countsIndexFor(hdr, v);
+        int64_t cur;
+
+        if (idx < 0 || hdr->countsLen <= idx) {
+                rd_atomic64_ptr_add(&hdr->outOfRangeCount, 1);
+                while (v > (cur = rd_atomic64_ptr_get(
+                                    &hdr->highestOutOfRange)) &&
+                       !rd_atomic64_ptr_cas(&hdr->highestOutOfRange,
+                                            cur, v))
+                        ;
+                while (v < (cur = rd_atomic64_ptr_get(
+                                    &hdr->lowestOutOfRange)) &&
+                       !rd_atomic64_ptr_cas(&hdr->lowestOutOfRange,
+                                            cur, v))
+                        ;
+                return 0;
+        }
+
+        rd_atomic64_ptr_add(&hdr->counts[idx], 1);
+        rd_atomic64_ptr_add(&hdr->totalCount, 1);
+
+        return 1;
+}
+#endif
+
+
+/**
+ * @returns a copy of \p src, which may be recorded into with
+ *          rd_hdr_histogram_record_atomic() meanwhile.
+ *
+ * Values recorded during the copy may be partially included,
+ * e.g., in the bucket counts but not in the total count.
+ */
+rd_hdr_histogram_t *rd_hdr_histogram_dup (rd_hdr_histogram_t *src) {
+        rd_hdr_histogram_t *hdr;
+        int32_t i;
+
+        hdr = rd_hdr_histogram_new(src->lowestTrackableValue,
+                                   src->highestTrackableValue,
+                                   (int)src->significantFigures);
+
+#ifdef RD_ATOMIC64_PTR
+        for (i = 0 ; i < src->countsLen ; i++)
+                hdr->counts[i] = rd_atomic64_ptr_get(&src->counts[i]);
+        hdr->totalCount = rd_atomic64_ptr_get(&src->totalCount);
+        hdr->outOfRangeCount = rd_atomic64_ptr_get(&src->outOfRangeCount);
+        hdr->lowestOutOfRange = rd_atomic64_ptr_get(&src->lowestOutOfRange);
+        hdr->highestOutOfRange =
+                rd_atomic64_ptr_get(&src->highestOutOfRange);
+#else
+        for (i = 0 ; i < src->countsLen ; i++)
+                hdr->counts[i] = src->counts[i];
+        hdr->totalCount = src->totalCount;
+        hdr->outOfRangeCount = src->outOfRangeCount;
+        hdr->lowestOutOfRange = src->lowestOutOfRange;
+        hdr->highestOutOfRange = src->highestOutOfRange;
+#endif
+
+        return hdr;
+}
+
+
 /**
  * @returns the recorded value at the given quantile (0..100).
  */
@@ -432,6 +502,77 @@ int64_t rd_hdr_histogram_quantile (const rd_hdr_histogram_t *hdr, double q) {
 }
 
 
+/**
+ * @brief Cumulative bucket counts: \p counts[i] is set to the number of
+ *        recorded values <= \p bounds[i], within the histogram's
+ *        precision (a value is counted in the lowest bucket that holds
+ *        the lowest equivalent value of the value).
+ *
+ * @param bounds bucket upper bounds, in increasing order.
+ *
+ * Out of range values are not counted.
+ */
+void rd_hdr_histogram_buckets (const rd_hdr_histogram_t *hdr,
+                               const int64_t *bounds, int bound_cnt,
+                               int64_t *counts) {
+        int64_t total = 0;
+        rd_hdr_iter_t it = RD_HDR_ITER_INIT(hdr);
+        int i = 0;
+
+        while (rd_hdr_iter_next(&it)) {
+                if (it.countAtIdx == 0)
+                        continue;
+
+                while (i < bound_cnt && it.valueFromIdx > bounds[i])
+                        counts[i++] = total;
+
+                total += it.countAtIdx;
+        }
+
+        while (i < bound_cnt)
+                counts[i++] = total;
+}
+
+
+/**
+ * @brief Adds the values recorded in \p src to \p dst.
+ *
+ * The histograms may have different ranges: each value of \p src is
+ * added as the lowest equivalent value of its bucket, values outside
+ * the range of \p dst are counted as out of range in \p dst.
+ */
+void rd_hdr_histogram_merge (rd_hdr_histogram_t *dst,
+                             const rd_hdr_histogram_t *src) {
+        const rd_hdr_histogram_t *hdr = src;
+        rd_hdr_iter_t it = RD_HDR_ITER_INIT(hdr);
+
+        while (rd_hdr_iter_next(&it)) {
+                int32_t idx;
+
+                if (it.countAtIdx == 0)
+                        continue;
+
+                idx = rd_hdr_countsIndexFor(dst, it.valueFromIdx);
+                if (idx < 0 || dst->countsLen <= idx) {
+                        dst->outOfRangeCount += it.countAtIdx;
+                        if (it.valueFromIdx > dst->highestOutOfRange)
+                                dst->highestOutOfRange = it.valueFromIdx;
+                        if (it.valueFromIdx < dst->lowestOutOfRange)
+                                dst->lowestOutOfRange = it.valueFromIdx;
+                        continue;
+                }
+
+                dst->counts[idx] += it.countAtIdx;
+                dst->totalCount  += it.countAtIdx;
+        }
+
+        dst->outOfRangeCount += src->outOfRangeCount;
+        if (src->highestOutOfRange > dst->highestOutOfRange)
+                dst->highestOutOfRange = src->highestOutOfRange;
+        if (src->lowestOutOfRange < dst->lowestOutOfRange)
+                dst->lowestOutOfRange = src->lowestOutOfRange;
+}
+
 
 /**
  * @name Unit tests
@@ -706,6 +847,79 @@ static int ut_subbucketmask_overflow (void) {
 }
 
 
+static int ut_merge (void) {
+        rd_hdr_histogram_t *a = rd_hdr_histogram_new(1, 10000, 3);
+        rd_hdr_histogram_t *b = rd_hdr_histogram_new(1, 1000000, 3);
+        rd_hdr_histogram_t *m = rd_hdr_histogram_new(1, 1000000, 3);
+        int64_t i, v;
+
+        for (i = 1 ; i <= 1000 ; i++) {
+                rd_hdr_histogram_record(a, i);
+                rd_hdr_histogram_record(b, i * 100);
+        }
+        rd_hdr_histogram_record(a, 20000); /* out of range */
+
+        rd_hdr_histogram_merge(m, a);
+        rd_hdr_histogram_merge(m, b);
+
+        RD_UT_ASSERT(m->totalCount == 2000,
+                     "totalCount is %"PRId64", expected 2000",
+                     m->totalCount);
+        RD_UT_ASSERT(m->outOfRangeCount == 1,
+                     "outOfRangeCount is %"PRId64", expected 1",
+                     m->outOfRangeCount);
+
+        v = rd_hdr_histogram_min(m);
+        RD_UT_ASSERT(v == 1, "Min is %"PRId64", expected 1", v);
+        v = rd_hdr_histogram_max(m);
+        RD_UT_ASSERT(rd_hdr_histogram_max(b) == v,
+                     "Max is %"PRId64", expected %"PRId64,
+                     v, rd_hdr_histogram_max(b));
+
+        /* Merging into a narrower histogram counts the values
+         * outside its range as out of range. */
+        rd_hdr_histogram_reset(a);
+        rd_hdr_histogram_merge(a, b);
+        RD_UT_ASSERT(a->totalCount >= 100 && a->totalCount < 1000 &&
+                     a->totalCount + a->outOfRangeCount == 1 + 1000,
+                     "expected 1000 values, of which the ones above "
+                     "the range out of range, not %"PRId64
+                     " + %"PRId64" out of range",
+                     a->totalCount, a->outOfRangeCount);
+
+        rd_hdr_histogram_destroy(a);
+        rd_hdr_histogram_destroy(b);
+        rd_hdr_histogram_destroy(m);
+        RD_UT_PASS();
+}
+
+
+static int ut_buckets (void) {
+        rd_hdr_histogram_t *hdr = rd_hdr_histogram_new(1, 1000000, 3);
+        const int64_t bounds[] = { 1, 10, 100, 1000, 10000 };
+        const int64_t exp[] = { 1, 10, 100, 1000, 1001 };
+        int64_t counts[RD_ARRAYSIZE(bounds)];
+        int64_t i;
+
+        for (i = 1 ; i <= 1000 ; i++)
+                rd_hdr_histogram_record(hdr, i);
+        rd_hdr_histogram_record(hdr, 5000);
+        rd_hdr_histogram_record(hdr, 10000000); /* out of range */
+
+        rd_hdr_histogram_buckets(hdr, bounds, (int)RD_ARRAYSIZE(bounds),
+                                 counts);
+
+        for (i = 0 ; i < (int64_t)RD_ARRAYSIZE(bounds) ; i++)
+                RD_UT_ASSERT(counts[i] == exp[i],
+                             "bucket le %"PRId64" is %"PRId64
+                             ", expected %"PRId64,
+                             bounds[i], counts[i], exp[i]);
+
+        rd_hdr_histogram_destroy(hdr);
+        RD_UT_PASS();
+}
+
+
 int unittest_rdhdrhistogram (void) {
         int fails = 0;
 
@@ -722,6 +936,8 @@ int unittest_rdhdrhistogram (void) {
         fails += ut_minmax_trackable();
         fails += ut_unitmagnitude_overflow();
         fails += ut_subbucketmask_overflow();
+        fails += ut_buckets();
+        fails += ut_merge();
 
         return fails;
 }
@@ -75,12 +75,21 @@ rd_hdr_histogram_t *rd_hdr_histogram_new (int64_t minValue, int64_t maxValue,
 void rd_hdr_histogram_reset (rd_hdr_histogram_t *hdr);
 
 int rd_hdr_histogram_record (rd_hdr_histogram_t *hdr, int64_t v);
+#ifdef RD_ATOMIC64_PTR
+int rd_hdr_histogram_record_atomic (rd_hdr_histogram_t *hdr, int64_t v);
+#endif
+rd_hdr_histogram_t *rd_hdr_histogram_dup (rd_hdr_histogram_t *src);
 
 double rd_hdr_histogram_stddev (rd_hdr_histogram_t *hdr);
 double rd_hdr_histogram_mean (const rd_hdr_histogram_t *hdr);
 int64_t rd_hdr_histogram_max (const rd_hdr_histogram_t *hdr);
 int64_t rd_hdr_histogram_min (const rd_hdr_histogram_t *hdr);
 int64_t rd_hdr_histogram_quantile (const rd_hdr_histogram_t *hdr, double q);
+void rd_hdr_histogram_merge (rd_hdr_histogram_t *dst,
+                             const rd_hdr_histogram_t *src);
+void rd_hdr_histogram_buckets (const rd_hdr_histogram_t *hdr,
+                               const int64_t *bounds, int bound_cnt,
+                               int64_t *counts);
 
 
 int unittest_rdhdrhistogram (void);
@@ -50,6 +50,9 @@
 #include "rdkafka_interceptor.h"
 #include "rdkafka_idempotence.h"
 #include "rdkafka_sasl_oauthbearer.h"
+#include "rdkafka_resolve.h"
+#include "rdkafka_stats.h"
+#include "rdkafka_logring.h"
 
 #include "rdtime.h"
 #include "crc32c.h"
@@ -78,6 +81,13 @@ int rd_kafka_global_cnt;
 rd_kafka_resp_err_t RD_TLS rd_kafka_last_error_code;
 
 
+/**
+ * rd_avg_t shard of the current thread, see rdavg.h.
+ */
+int RD_TLS rd_avg_thread_shard;
+rd_atomic32_t rd_avg_shard_next;
+
+
 /**
  * Current number of threads created by rdkafka.
  * This is used in regression tests.
@@ -131,6 +141,8 @@ static void rd_kafka_global_init (void) {
         atexit(rd_shared_ptrs_dump);
 #endif
 	mtx_init(&rd_kafka_global_lock, mtx_plain);
+        rd_kafka_resolver_init();
+        rd_atomic32_init(&rd_avg_shard_next, 0);
 #if ENABLE_DEVEL
 	rd_atomic32_init(&rd_kafka_op_cnt, 0);
 #endif
@@ -175,6 +187,7 @@ static void rd_kafka_global_cnt_decr (void) {
 	rd_kafka_assert(NULL, rd_kafka_global_cnt > 0);
 	rd_kafka_global_cnt--;
 	if (rd_kafka_global_cnt == 0) {
+                rd_kafka_resolver_term();
                 rd_kafka_sasl_global_term();
 #if WITH_SSL
 		rd_kafka_transport_ssl_term();
@@ -232,6 +245,46 @@ static void rd_kafka_log_buf (const rd_kafka_conf_t *conf,
         }
 }
 
+/**
+ * @brief Log ring dispatcher: called on the logging thread.
+ */
+static void rd_kafka_log_ring_dispatch (rd_kafka_t *rk, int level,
+                                        const char *fac, const char *buf) {
+        rd_kafka_log_buf(&rk->rk_conf, rk, level, fac, buf);
+}
+
+/**
+ * Per-thread `debug.sample` counters, indexed by debug context bit.
+ */
+static RD_TLS int rd_kafka_dbg_sample_cnt[RD_KAFKA_DBG_CTX_CNT];
+
+/**
+ * @brief Slow path of rd_kafka_dbg_sampled(), \p ctx has at least one
+ *        sampled debug context.
+ *
+ * @returns true if any enabled context in \p ctx is not sampled, or if
+ *          this is the first of every N messages on this thread for the
+ *          lowest sampled enabled context in \p ctx.
+ */
+rd_bool_t rd_kafka_dbg_sample (const rd_kafka_conf_t *conf, int ctx) {
+        int enabled = conf->debug & ctx;
+        int i;
+
+        if (enabled & ~conf->debug_sampled)
+                return rd_true;
+
+        for (i = 0 ; !(enabled & (1 << i)) ; i++)
+                ;
+
+        if (rd_kafka_dbg_sample_cnt[i] > 0) {
+                rd_kafka_dbg_sample_cnt[i]--;
+                return rd_false;
+        }
+
+        rd_kafka_dbg_sample_cnt[i] = conf->debug_sample_rate[i] - 1;
+        return rd_true;
+}
+
 /**
  * @brief Logger
  *
@@ -249,6 +302,20 @@ void rd_kafka_log0 (const rd_kafka_conf_t *conf,
 	if (level > conf->log_level)
 		return;
 
+        if (rk && rk->rk_logring) {
+                rd_bool_t recorded;
+
+                va_start(ap, fmt);
+                recorded = rd_kafka_logring_vlog(
+                        rk->rk_logring, level, fac,
+                        conf->log_thread_name ? rd_kafka_thread_name : NULL,
+                        extra, fmt, ap);
+                va_end(ap);
+
+                if (recorded)
+                        return;
+        }
+
 	if (conf->log_thread_name) {
 		elen = rd_snprintf(buf, sizeof(buf), "[thrd:%s]: ",
 				   rd_kafka_thread_name);
@@ -338,7 +405,7 @@ void rd_kafka_set_log_level (rd_kafka_t *rk, int level) {
 
 
 
-static const char *rd_kafka_type2str (rd_kafka_type_t type) {
+const char *rd_kafka_type2str (rd_kafka_type_t type) {
 	static const char *types[] = {
 		[RD_KAFKA_PRODUCER] = "producer",
 		[RD_KAFKA_CONSUMER] = "consumer",
@@ -842,6 +909,14 @@ void rd_kafka_destroy_final (rd_kafka_t *rk) {
         rd_kafka_dbg(rk, GENERIC, "TERMINATE",
                      "Termination done: freeing resources");
 
+        /* All other threads are gone: serve the remaining log ring
+         * records before the log queue is destroyed. */
+        if (rk->rk_logring) {
+                rd_kafka_logring_t *rlr = rk->rk_logring;
+                rk->rk_logring = NULL;
+                rd_kafka_logring_destroy(rlr);
+        }
+
         if (rk->rk_logq) {
                 rd_kafka_q_destroy_owner(rk->rk_logq);
                 rk->rk_logq = NULL;
@@ -862,6 +937,8 @@ void rd_kafka_destroy_final (rd_kafka_t *rk) {
 
         mtx_destroy(&rk->rk_suppress.sparse_connect_lock);
 
+        rd_avg_destroy(&rk->rk_avg_poll_gap);
+
         cnd_destroy(&rk->rk_init_cnd);
         mtx_destroy(&rk->rk_init_lock);
 
@@ -1046,10 +1123,13 @@ static void rd_kafka_destroy_internal (rd_kafka_t *rk) {
          * Broker thread holds a refcount and detects when broker refcounts
          * reaches 1 and then decommissions itself. */
         TAILQ_FOREACH_SAFE(rkb, &rk->rk_brokers, rkb_link, rkb_tmp) {
-                /* Add broker's thread to wait_thrds list for later joining */
-                thrd = malloc(sizeof(*thrd));
-                *thrd = rkb->rkb_thread;
-                rd_list_add(&wait_thrds, thrd);
+                /* Add broker's thread to wait_thrds list for later joining,
+                 * reactor threads are joined separately. */
+                if (!rkb->rkb_reactor.rkrc) {
+                        thrd = malloc(sizeof(*thrd));
+                        *thrd = rkb->rkb_thread;
+                        rd_list_add(&wait_thrds, thrd);
+                }
                 rd_kafka_wrunlock(rk);
 
                 rd_kafka_dbg(rk, BROKER, "DESTROY",
@@ -1062,7 +1142,7 @@ static void rd_kafka_destroy_internal (rd_kafka_t *rk) {
 
 #ifndef _MSC_VER
                 /* Interrupt IO threads to speed up termination. */
-                if (rk->rk_conf.term_sig)
+                if (rk->rk_conf.term_sig && !rkb->rkb_reactor.rkrc)
 			pthread_kill(rkb->rkb_thread, rk->rk_conf.term_sig);
 #endif
 
@@ -1122,564 +1202,10 @@ static void rd_kafka_destroy_internal (rd_kafka_t *rk) {
         }
 
         rd_list_destroy(&wait_thrds);
-}
 
-/**
- * @brief Buffer state for stats emitter
- */
-struct _stats_emit {
-        char   *buf;      /* Pointer to allocated buffer */
-        size_t  size;     /* Current allocated size of buf */
-        size_t  of;       /* Current write-offset in buf */
-};
-
-
-/* Stats buffer printf. Requires a (struct _stats_emit *)st variable in the
- * current scope. */
-#define _st_printf(...) do {                                            \
-                ssize_t _r;                                             \
-                ssize_t _rem = st->size - st->of;                       \
-                _r = rd_snprintf(st->buf+st->of, _rem, __VA_ARGS__);    \
-                if (_r >= _rem) {                                       \
-                        st->size *= 2;                                  \
-                        _rem = st->size - st->of;                       \
-                        st->buf = rd_realloc(st->buf, st->size);        \
-                        _r = rd_snprintf(st->buf+st->of, _rem, __VA_ARGS__); \
-                }                                                       \
-                st->of += _r;                                           \
-        } while (0)
-
-struct _stats_total {
-        int64_t tx;          /**< broker.tx */
-        int64_t tx_bytes;    /**< broker.tx_bytes */
-        int64_t rx;          /**< broker.rx */
-        int64_t rx_bytes;    /**< broker.rx_bytes */
-        int64_t txmsgs;      /**< partition.txmsgs */
-        int64_t txmsg_bytes; /**< partition.txbytes */
-        int64_t rxmsgs;      /**< partition.rxmsgs */
-        int64_t rxmsg_bytes; /**< partition.rxbytes */
-};
-
-
-
-/**
- * @brief Rollover and emit an average window.
- */
-static RD_INLINE void rd_kafka_stats_emit_avg (struct _stats_emit *st,
-                                               const char *name,
-                                               rd_avg_t *src_avg) {
-        rd_avg_t avg;
-
-        rd_avg_rollover(&avg, src_avg);
-        _st_printf(
-                "\"%s\": {"
-                " \"min\":%"PRId64","
-                " \"max\":%"PRId64","
-                " \"avg\":%"PRId64","
-                " \"sum\":%"PRId64","
-                " \"stddev\": %"PRId64","
-                " \"p50\": %"PRId64","
-                " \"p75\": %"PRId64","
-                " \"p90\": %"PRId64","
-                " \"p95\": %"PRId64","
-                " \"p99\": %"PRId64","
-                " \"p99_99\": %"PRId64","
-                " \"outofrange\": %"PRId64","
-                " \"hdrsize\": %"PRId32","
-                " \"cnt\":%i "
-                "}, ",
-                name,
-                avg.ra_v.minv,
-                avg.ra_v.maxv,
-                avg.ra_v.avg,
-                avg.ra_v.sum,
-                (int64_t)avg.ra_hist.stddev,
-                avg.ra_hist.p50,
-                avg.ra_hist.p75,
-                avg.ra_hist.p90,
-                avg.ra_hist.p95,
-                avg.ra_hist.p99,
-                avg.ra_hist.p99_99,
-                avg.ra_hist.oor,
-                avg.ra_hist.hdrsize,
-                avg.ra_v.cnt);
-        rd_avg_destroy(&avg);
-}
-
-/**
- * Emit stats for toppar
- */
-static RD_INLINE void rd_kafka_stats_emit_toppar (struct _stats_emit *st,
-                                                  struct _stats_total *total,
-                                                  rd_kafka_toppar_t *rktp,
-                                                  int first) {
-        rd_kafka_t *rk = rktp->rktp_rkt->rkt_rk;
-        int64_t consumer_lag = -1;
-        struct offset_stats offs;
-        int32_t leader_nodeid = -1;
-
-        rd_kafka_toppar_lock(rktp);
-
-        if (rktp->rktp_leader) {
-                rd_kafka_broker_lock(rktp->rktp_leader);
-                leader_nodeid = rktp->rktp_leader->rkb_nodeid;
-                rd_kafka_broker_unlock(rktp->rktp_leader);
-        }
-
-        /* Grab a copy of the latest finalized offset stats */
-        offs = rktp->rktp_offsets_fin;
-
-        /* Calculate consumer_lag by using the highest offset
-         * of app_offset (the last message passed to application + 1)
-         * or the committed_offset (the last message committed by this or
-         * another consumer).
-         * Using app_offset allows consumer_lag to be up to date even if
-         * offsets are not (yet) committed.
-         */
-        if (rktp->rktp_hi_offset != RD_KAFKA_OFFSET_INVALID &&
-            (rktp->rktp_app_offset >= 0 || rktp->rktp_committed_offset >= 0)) {
-                consumer_lag = rktp->rktp_hi_offset -
-                        RD_MAX(rktp->rktp_app_offset,
-                               rktp->rktp_committed_offset);
-                if (unlikely(consumer_lag) < 0)
-                        consumer_lag = 0;
-        }
-
-	_st_printf("%s\"%"PRId32"\": { "
-		   "\"partition\":%"PRId32", "
-		   "\"leader\":%"PRId32", "
-		   "\"desired\":%s, "
-		   "\"unknown\":%s, "
-		   "\"msgq_cnt\":%i, "
-		   "\"msgq_bytes\":%"PRIusz", "
-		   "\"xmit_msgq_cnt\":%i, "
-		   "\"xmit_msgq_bytes\":%"PRIusz", "
-		   "\"fetchq_cnt\":%i, "
-		   "\"fetchq_size\":%"PRIu64", "
-		   "\"fetch_state\":\"%s\", "
-		   "\"query_offset\":%"PRId64", "
-		   "\"next_offset\":%"PRId64", "
-		   "\"app_offset\":%"PRId64", "
-		   "\"stored_offset\":%"PRId64", "
-		   "\"commited_offset\":%"PRId64", " /*FIXME: issue #80 */
-		   "\"committed_offset\":%"PRId64", "
-		   "\"eof_offset\":%"PRId64", "
-		   "\"lo_offset\":%"PRId64", "
-		   "\"hi_offset\":%"PRId64", "
-                   "\"consumer_lag\":%"PRId64", "
-		   "\"txmsgs\":%"PRIu64", "
-		   "\"txbytes\":%"PRIu64", "
-                   "\"rxmsgs\":%"PRIu64", "
-                   "\"rxbytes\":%"PRIu64", "
-                   "\"msgs\": %"PRIu64", "
-                   "\"rx_ver_drops\": %"PRIu64", "
-                   "\"msgs_inflight\": %"PRId32", "
-                   "\"next_ack_seq\": %"PRId32", "
-                   "\"next_err_seq\": %"PRId32", "
-                   "\"acked_msgid\": %"PRIu64
-                   "} ",
-		   first ? "" : ", ",
-		   rktp->rktp_partition,
-		   rktp->rktp_partition,
-                   leader_nodeid,
-		   (rktp->rktp_flags&RD_KAFKA_TOPPAR_F_DESIRED)?"true":"false",
-		   (rktp->rktp_flags&RD_KAFKA_TOPPAR_F_UNKNOWN)?"true":"false",
-                   rd_kafka_msgq_len(&rktp->rktp_msgq),
-		   rd_kafka_msgq_size(&rktp->rktp_msgq),
-                   /* FIXME: xmit_msgq is local to the broker thread. */
-                   0,
-                   (size_t)0,
-		   rd_kafka_q_len(rktp->rktp_fetchq),
-		   rd_kafka_q_size(rktp->rktp_fetchq),
-		   rd_kafka_fetch_states[rktp->rktp_fetch_state],
-		   rktp->rktp_query_offset,
-                   offs.fetch_offset,
-		   rktp->rktp_app_offset,
-		   rktp->rktp_stored_offset,
-		   rktp->rktp_committed_offset, /* FIXME: issue #80 */
-		   rktp->rktp_committed_offset,
-                   offs.eof_offset,
-		   rktp->rktp_lo_offset,
-		   rktp->rktp_hi_offset,
-                   consumer_lag,
-                   rd_atomic64_get(&rktp->rktp_c.tx_msgs),
-                   rd_atomic64_get(&rktp->rktp_c.tx_msg_bytes),
-                   rd_atomic64_get(&rktp->rktp_c.rx_msgs),
-                   rd_atomic64_get(&rktp->rktp_c.rx_msg_bytes),
-                   rk->rk_type == RD_KAFKA_PRODUCER ?
-                   rd_atomic64_get(&rktp->rktp_c.producer_enq_msgs) :
-                   rd_atomic64_get(&rktp->rktp_c.rx_msgs), /* legacy, same as rx_msgs */
-                   rd_atomic64_get(&rktp->rktp_c.rx_ver_drops),
-                   rd_atomic32_get(&rktp->rktp_msgs_inflight),
-                   rktp->rktp_eos.next_ack_seq,
-                   rktp->rktp_eos.next_err_seq,
-                   rktp->rktp_eos.acked_msgid);
-
-        if (total) {
-                total->txmsgs      += rd_atomic64_get(&rktp->rktp_c.tx_msgs);
-                total->txmsg_bytes += rd_atomic64_get(&rktp->rktp_c.tx_msg_bytes);
-                total->rxmsgs      += rd_atomic64_get(&rktp->rktp_c.rx_msgs);
-                total->rxmsg_bytes += rd_atomic64_get(&rktp->rktp_c.rx_msg_bytes);
-        }
-
-        rd_kafka_toppar_unlock(rktp);
-}
-
-/**
- * @brief Emit broker request type stats
- */
-static void rd_kafka_stats_emit_broker_reqs (struct _stats_emit *st,
-                                             rd_kafka_broker_t *rkb) {
-        /* Filter out request types that will never be sent by the client. */
-        static const rd_bool_t filter[4][RD_KAFKAP__NUM] = {
-                [RD_KAFKA_PRODUCER] = {
-                        [RD_KAFKAP_Fetch] = rd_true,
-                        [RD_KAFKAP_OffsetCommit] = rd_true,
-                        [RD_KAFKAP_OffsetFetch] = rd_true,
-                        [RD_KAFKAP_GroupCoordinator] = rd_true,
-                        [RD_KAFKAP_JoinGroup] = rd_true,
-                        [RD_KAFKAP_Heartbeat] = rd_true,
-                        [RD_KAFKAP_LeaveGroup] = rd_true,
-                        [RD_KAFKAP_SyncGroup] = rd_true
-                },
-                [RD_KAFKA_CONSUMER] = {
-                        [RD_KAFKAP_Produce] = rd_true,
-                        [RD_KAFKAP_InitProducerId] = rd_true
-                },
-                [2/*any client type*/] = {
-                        [RD_KAFKAP_UpdateMetadata] = rd_true,
-                        [RD_KAFKAP_ControlledShutdown] = rd_true,
-                        [RD_KAFKAP_LeaderAndIsr] = rd_true,
-                        [RD_KAFKAP_StopReplica] = rd_true,
-                        [RD_KAFKAP_OffsetForLeaderEpoch] = rd_true,
-
-                        /* FIXME: Remove when transaction support is added */
-                        [RD_KAFKAP_AddPartitionsToTxn] = rd_true,
-                        [RD_KAFKAP_AddOffsetsToTxn] = rd_true,
-                        [RD_KAFKAP_EndTxn] = rd_true,
-
-                        [RD_KAFKAP_WriteTxnMarkers] = rd_true,
-                        [RD_KAFKAP_TxnOffsetCommit] = rd_true,
-
-                        [RD_KAFKAP_AlterReplicaLogDirs] = rd_true,
-                        [RD_KAFKAP_DescribeLogDirs] = rd_true,
-
-                        /* FIXME: Remove when re-auth support is added */
-                        [RD_KAFKAP_SaslAuthenticate] = rd_true,
-
-                        [RD_KAFKAP_CreateDelegationToken] = rd_true,
-                        [RD_KAFKAP_RenewDelegationToken] = rd_true,
-                        [RD_KAFKAP_ExpireDelegationToken] = rd_true,
-                        [RD_KAFKAP_DescribeDelegationToken] = rd_true
-                },
-                [3/*hide-unless-non-zero*/] = {
-                        /* Hide Admin requests unless they've been used */
-                        [RD_KAFKAP_CreateTopics] =  rd_true,
-                        [RD_KAFKAP_DeleteTopics] =  rd_true,
-                        [RD_KAFKAP_DeleteRecords] =  rd_true,
-                        [RD_KAFKAP_CreatePartitions] =  rd_true,
-                        [RD_KAFKAP_DescribeAcls] = rd_true,
-                        [RD_KAFKAP_CreateAcls] = rd_true,
-                        [RD_KAFKAP_DeleteAcls] = rd_true,
-                        [RD_KAFKAP_DescribeConfigs] = rd_true,
-                        [RD_KAFKAP_AlterConfigs] = rd_true,
-                        [RD_KAFKAP_DeleteGroups] = rd_true,
-                        [RD_KAFKAP_ListGroups] = rd_true,
-                        [RD_KAFKAP_DescribeGroups] = rd_true
-                }
-        };
-        int i;
-        int cnt = 0;
-
-        _st_printf("\"req\": { ");
-        for (i = 0 ; i < RD_KAFKAP__NUM ; i++) {
-                int64_t v;
-
-                if (filter[rkb->rkb_rk->rk_type][i] || filter[2][i])
-                        continue;
-
-                v = rd_atomic64_get(&rkb->rkb_c.reqtype[i]);
-                if (!v && filter[3][i])
-                        continue; /* Filter out zero values */
-
-                _st_printf("%s\"%s\": %"PRId64,
-                           cnt > 0 ? ", " : "",
-                           rd_kafka_ApiKey2str(i), v);
-
-                cnt++;
-        }
-        _st_printf(" }, ");
-}
-
-
-/**
- * Emit all statistics
- */
-static void rd_kafka_stats_emit_all (rd_kafka_t *rk) {
-	rd_kafka_broker_t *rkb;
-	rd_kafka_itopic_t *rkt;
-	shptr_rd_kafka_toppar_t *s_rktp;
-	rd_ts_t now;
-	rd_kafka_op_t *rko;
-	unsigned int tot_cnt;
-	size_t tot_size;
-        rd_kafka_resp_err_t err;
-        struct _stats_emit stx = { .size = 1024*10 };
-        struct _stats_emit *st = &stx;
-        struct _stats_total total = {0};
-
-        st->buf = rd_malloc(st->size);
-
-
-	rd_kafka_curr_msgs_get(rk, &tot_cnt, &tot_size);
-	rd_kafka_rdlock(rk);
-
-	now = rd_clock();
-	_st_printf("{ "
-                   "\"name\": \"%s\", "
-                   "\"client_id\": \"%s\", "
-                   "\"type\": \"%s\", "
-		   "\"ts\":%"PRId64", "
-		   "\"time\":%lli, "
-		   "\"replyq\":%i, "
-                   "\"msg_cnt\":%u, "
-		   "\"msg_size\":%"PRIusz", "
-                   "\"msg_max\":%u, "
-		   "\"msg_size_max\":%"PRIusz", "
-                   "\"simple_cnt\":%i, "
-                   "\"metadata_cache_cnt\":%i, "
-		   "\"brokers\":{ "/*open brokers*/,
-                   rk->rk_name,
-                   rk->rk_conf.client_id_str,
-                   rd_kafka_type2str(rk->rk_type),
-		   now,
-		   (signed long long)time(NULL),
-		   rd_kafka_q_len(rk->rk_rep),
-		   tot_cnt, tot_size,
-		   rk->rk_curr_msgs.max_cnt, rk->rk_curr_msgs.max_size,
-                   rd_atomic32_get(&rk->rk_simple_cnt),
-                   rk->rk_metadata_cache.rkmc_cnt);
-
-
-	TAILQ_FOREACH(rkb, &rk->rk_brokers, rkb_link) {
-		rd_kafka_toppar_t *rktp;
-
-		rd_kafka_broker_lock(rkb);
-		_st_printf("%s\"%s\": { "/*open broker*/
-			   "\"name\":\"%s\", "
-			   "\"nodeid\":%"PRId32", "
-                           "\"nodename\":\"%s\", "
-                           "\"source\":\"%s\", "
-			   "\"state\":\"%s\", "
-                           "\"stateage\":%"PRId64", "
-			   "\"outbuf_cnt\":%i, "
-			   "\"outbuf_msg_cnt\":%i, "
-			   "\"waitresp_cnt\":%i, "
-			   "\"waitresp_msg_cnt\":%i, "
-			   "\"tx\":%"PRIu64", "
-			   "\"txbytes\":%"PRIu64", "
-			   "\"txerrs\":%"PRIu64", "
-			   "\"txretries\":%"PRIu64", "
-			   "\"req_timeouts\":%"PRIu64", "
-			   "\"rx\":%"PRIu64", "
-			   "\"rxbytes\":%"PRIu64", "
-			   "\"rxerrs\":%"PRIu64", "
-                           "\"rxcorriderrs\":%"PRIu64", "
-                           "\"rxpartial\":%"PRIu64", "
-                           "\"zbuf_grow\":%"PRIu64", "
-                           "\"buf_grow\":%"PRIu64", "
-                           "\"wakeups\":%"PRIu64", "
-                           "\"connects\":%"PRId32", "
-                           "\"disconnects\":%"PRId32", ",
-			   rkb == TAILQ_FIRST(&rk->rk_brokers) ? "" : ", ",
-			   rkb->rkb_name,
-			   rkb->rkb_name,
-			   rkb->rkb_nodeid,
-                           rkb->rkb_nodename,
-                           rd_kafka_confsource2str(rkb->rkb_source),
-			   rd_kafka_broker_state_names[rkb->rkb_state],
-                           rkb->rkb_ts_state ? now - rkb->rkb_ts_state : 0,
-			   rd_atomic32_get(&rkb->rkb_outbufs.rkbq_cnt),
-			   rd_atomic32_get(&rkb->rkb_outbufs.rkbq_msg_cnt),
-			   rd_atomic32_get(&rkb->rkb_waitresps.rkbq_cnt),
-			   rd_atomic32_get(&rkb->rkb_waitresps.rkbq_msg_cnt),
-			   rd_atomic64_get(&rkb->rkb_c.tx),
-			   rd_atomic64_get(&rkb->rkb_c.tx_bytes),
-			   rd_atomic64_get(&rkb->rkb_c.tx_err),
-			   rd_atomic64_get(&rkb->rkb_c.tx_retries),
-			   rd_atomic64_get(&rkb->rkb_c.req_timeouts),
-			   rd_atomic64_get(&rkb->rkb_c.rx),
-			   rd_atomic64_get(&rkb->rkb_c.rx_bytes),
-			   rd_atomic64_get(&rkb->rkb_c.rx_err),
-			   rd_atomic64_get(&rkb->rkb_c.rx_corrid_err),
-			   rd_atomic64_get(&rkb->rkb_c.rx_partial),
-                           rd_atomic64_get(&rkb->rkb_c.zbuf_grow),
-                           rd_atomic64_get(&rkb->rkb_c.buf_grow),
-                           rd_atomic64_get(&rkb->rkb_c.wakeups),
-                           rd_atomic32_get(&rkb->rkb_c.connects),
-                           rd_atomic32_get(&rkb->rkb_c.disconnects));
-
-                total.tx       += rd_atomic64_get(&rkb->rkb_c.tx);
-                total.tx_bytes += rd_atomic64_get(&rkb->rkb_c.tx_bytes);
-                total.rx       += rd_atomic64_get(&rkb->rkb_c.rx);
-                total.rx_bytes += rd_atomic64_get(&rkb->rkb_c.rx_bytes);
-
-                rd_kafka_stats_emit_avg(st, "int_latency",
-                                        &rkb->rkb_avg_int_latency);
-                rd_kafka_stats_emit_avg(st, "outbuf_latency",
-                                        &rkb->rkb_avg_outbuf_latency);
-                rd_kafka_stats_emit_avg(st, "rtt", &rkb->rkb_avg_rtt);
-                rd_kafka_stats_emit_avg(st, "throttle", &rkb->rkb_avg_throttle);
-
-                rd_kafka_stats_emit_broker_reqs(st, rkb);
-
-                _st_printf("\"toppars\":{ "/*open toppars*/);
-
-		TAILQ_FOREACH(rktp, &rkb->rkb_toppars, rktp_rkblink) {
-			_st_printf("%s\"%.*s-%"PRId32"\": { "
-				   "\"topic\":\"%.*s\", "
-				   "\"partition\":%"PRId32"} ",
-				   rktp==TAILQ_FIRST(&rkb->rkb_toppars)?"":", ",
-				   RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
-                                   rktp->rktp_partition,
-				   RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
-				   rktp->rktp_partition);
-		}
-
-		rd_kafka_broker_unlock(rkb);
-
-		_st_printf("} "/*close toppars*/
-			   "} "/*close broker*/);
-	}
-
-
-	_st_printf("}, " /* close "brokers" array */
-		   "\"topics\":{ ");
-
-	TAILQ_FOREACH(rkt, &rk->rk_topics, rkt_link) {
-		int i, j;
-
-		rd_kafka_topic_rdlock(rkt);
-		_st_printf("%s\"%.*s\": { "
-			   "\"topic\":\"%.*s\", "
-			   "\"metadata_age\":%"PRId64", ",
-			   rkt==TAILQ_FIRST(&rk->rk_topics)?"":", ",
-			   RD_KAFKAP_STR_PR(rkt->rkt_topic),
-			   RD_KAFKAP_STR_PR(rkt->rkt_topic),
-			   rkt->rkt_ts_metadata ?
-			   (rd_clock() - rkt->rkt_ts_metadata)/1000 : 0);
-
-                rd_kafka_stats_emit_avg(st, "batchsize",
-                                        &rkt->rkt_avg_batchsize);
-                rd_kafka_stats_emit_avg(st, "batchcnt",
-                                        &rkt->rkt_avg_batchcnt);
-
-                _st_printf("\"partitions\":{ " /*open partitions*/);
-
-                for (i = 0 ; i < rkt->rkt_partition_cnt ; i++)
-                        rd_kafka_stats_emit_toppar(
-                                st, &total,
-                                rd_kafka_toppar_s2i(rkt->rkt_p[i]),
-                                i == 0);
-
-                RD_LIST_FOREACH(s_rktp, &rkt->rkt_desp, j)
-                        rd_kafka_stats_emit_toppar(
-                                st, &total,
-                                rd_kafka_toppar_s2i(s_rktp),
-                                i+j == 0);
-
-                i += j;
-
-                if (rkt->rkt_ua)
-                        rd_kafka_stats_emit_toppar(
-                                st, NULL,
-                                rd_kafka_toppar_s2i(rkt->rkt_ua),
-                                i++ == 0);
-
-		rd_kafka_topic_rdunlock(rkt);
-
-		_st_printf("} "/*close partitions*/
-			   "} "/*close topic*/);
-
-	}
-	_st_printf("} "/*close topics*/);
-
-        if (rk->rk_cgrp) {
-                rd_kafka_cgrp_t *rkcg = rk->rk_cgrp;
-                _st_printf(", \"cgrp\": { "
-                           "\"state\": \"%s\", "
-                           "\"stateage\": %"PRId64", "
-                           "\"join_state\": \"%s\", "
-                           "\"rebalance_age\": %"PRId64", "
-                           "\"rebalance_cnt\": %d, "
-                           "\"rebalance_reason\": \"%s\", "
-                           "\"assignment_size\": %d }",
-                           rd_kafka_cgrp_state_names[rkcg->rkcg_state],
-                           rkcg->rkcg_ts_statechange ?
-                           (now - rkcg->rkcg_ts_statechange) / 1000 : 0,
-                           rd_kafka_cgrp_join_state_names[rkcg->rkcg_join_state],
-                           rkcg->rkcg_c.ts_rebalance ?
-                           (rd_clock() - rkcg->rkcg_c.ts_rebalance)/1000 : 0,
-                           rkcg->rkcg_c.rebalance_cnt,
-                           rkcg->rkcg_c.rebalance_reason,
-                           rkcg->rkcg_c.assignment_size);
-        }
-
-        if (rd_kafka_is_idempotent(rk)) {
-                _st_printf(", \"eos\": { "
-                           "\"idemp_state\": \"%s\", "
-                           "\"idemp_stateage\": %"PRId64", "
-                           "\"producer_id\": %"PRId64", "
-                           "\"producer_epoch\": %hd, "
-                           "\"epoch_cnt\": %d "
-                           "}",
-                           rd_kafka_idemp_state2str(rk->rk_eos.idemp_state),
-                           (rd_clock() - rk->rk_eos.ts_idemp_state) / 1000,
-                           rk->rk_eos.pid.id,
-                           rk->rk_eos.pid.epoch,
-                           rk->rk_eos.epoch_cnt);
-        }
-
-        if ((err = rd_atomic32_get(&rk->rk_fatal.err)))
-                _st_printf(", \"fatal\": { "
-                           "\"error\": \"%s\", "
-                           "\"reason\": \"%s\", "
-                           "\"cnt\": %d "
-                           "}",
-                           rd_kafka_err2str(err),
-                           rk->rk_fatal.errstr,
-                           rk->rk_fatal.cnt);
-
-	rd_kafka_rdunlock(rk);
-
-        /* Total counters */
-        _st_printf(", "
-                   "\"tx\":%"PRId64", "
-                   "\"tx_bytes\":%"PRId64", "
-                   "\"rx\":%"PRId64", "
-                   "\"rx_bytes\":%"PRId64", "
-                   "\"txmsgs\":%"PRId64", "
-                   "\"txmsg_bytes\":%"PRId64", "
-                   "\"rxmsgs\":%"PRId64", "
-                   "\"rxmsg_bytes\":%"PRId64,
-                   total.tx,
-                   total.tx_bytes,
-                   total.rx,
-                   total.rx_bytes,
-                   total.txmsgs,
-                   total.txmsg_bytes,
-                   total.rxmsgs,
-                   total.rxmsg_bytes);
-
-        _st_printf("}"/*close object*/);
-
-
-	/* Enqueue op for application */
-	rko = rd_kafka_op_new(RD_KAFKA_OP_STATS);
-        rd_kafka_op_set_prio(rko, RD_KAFKA_PRIO_HIGH);
-	rko->rko_u.stats.json = st->buf;
-	rko->rko_u.stats.json_len = st->of;
-	rd_kafka_q_enq(rk->rk_rep, rko);
+        /* Join reactor threads, which return when all of their
+         * brokers have been decommissioned. */
+        rd_kafka_reactors_term(rk);
 }
 
 
@@ -1868,6 +1394,7 @@ rd_kafka_t *rd_kafka_new (rd_kafka_type_t type, rd_kafka_conf_t *app_conf,
 #endif
         char builtin_features[128];
         size_t bflen;
+        char tmp_errstr[256];
 
 	call_once(&rd_kafka_global_init_once, rd_kafka_global_init);
 
@@ -1935,6 +1462,19 @@ rd_kafka_t *rd_kafka_new (rd_kafka_type_t type, rd_kafka_conf_t *app_conf,
         mtx_init(&rk->rk_suppress.sparse_connect_lock, mtx_plain);
 
         rd_atomic64_init(&rk->rk_ts_last_poll, rd_clock());
+        rd_atomic64_init(&rk->rk_ts_last_poll_return,
+                         rd_atomic64_get(&rk->rk_ts_last_poll));
+        rd_avg_init(&rk->rk_avg_poll_gap, RD_AVG_GAUGE, 0,
+                    (int64_t)rk->rk_conf.max_poll_interval_ms * 1000, 2,
+                    rk->rk_conf.stats_interval_ms &&
+                    type == RD_KAFKA_CONSUMER);
+        rd_atomic64_init(&rk->rk_fetchbuf.pinned_bytes, 0);
+        rd_atomic64_init(&rk->rk_fetchbuf.live_bytes, 0);
+        rd_atomic64_init(&rk->rk_fetchbuf.copyout_cnt, 0);
+        rd_atomic64_init(&rk->rk_fetchbuf.copyout_bytes, 0);
+        rd_atomic64_init(&rk->rk_prefetch.queued_bytes, 0);
+        rd_atomic64_init(&rk->rk_prefetch.inflight_bytes, 0);
+        rd_atomic64_init(&rk->rk_prefetch.exhausted_cnt, 0);
 
 	rk->rk_rep = rd_kafka_q_new(rk);
 	rk->rk_ops = rd_kafka_q_new(rk);
@@ -1990,6 +1530,8 @@ rd_kafka_t *rd_kafka_new (rd_kafka_type_t type, rd_kafka_conf_t *app_conf,
         /* Config fixups */
         rk->rk_conf.queued_max_msg_bytes =
                 (int64_t)rk->rk_conf.queued_max_msg_kbytes * 1000ll;
+        rk->rk_conf.queued_max_total_bytes =
+                (int64_t)rk->rk_conf.queued_max_total_kbytes * 1000ll;
 
 	/* Enable api.version.request=true if fallback.broker.version
 	 * indicates a supporting broker. */
@@ -2064,6 +1606,23 @@ rd_kafka_t *rd_kafka_new (rd_kafka_type_t type, rd_kafka_conf_t *app_conf,
         pthread_sigmask(SIG_SETMASK, &newset, &oldset);
 #endif
 
+        /* Start the logging thread before any other thread that may log */
+        if (rk->rk_conf.log_async_ring_size > 0 &&
+            !(rk->rk_logring = rd_kafka_logring_new(
+                      rk, rk->rk_conf.log_async_ring_size,
+                      rd_kafka_log_ring_dispatch,
+                      tmp_errstr, sizeof(tmp_errstr)))) {
+                ret_err = RD_KAFKA_RESP_ERR__CRIT_SYS_RESOURCE;
+                ret_errno = errno;
+                if (errstr)
+                        rd_snprintf(errstr, errstr_size, "%s", tmp_errstr);
+#ifndef _MSC_VER
+                /* Restore sigmask of caller */
+                pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+#endif
+                goto fail;
+        }
+
         mtx_lock(&rk->rk_init_lock);
 
         /* Create background thread and queue if background_event_cb()
@@ -2154,6 +1713,18 @@ rd_kafka_t *rd_kafka_new (rd_kafka_type_t type, rd_kafka_conf_t *app_conf,
         }
 #endif
 
+        /* Shared broker I/O reactor threads, must be set up
+         * prior to adding any brokers. */
+        if (rk->rk_conf.io_reactor_threads > 0) {
+                char tmp[256];
+
+                if (rd_kafka_reactors_init(rk, rk->rk_conf.io_reactor_threads,
+                                           tmp, sizeof(tmp)) == -1)
+                        rd_kafka_log(rk, LOG_WARNING, "REACTOR",
+                                     "%s: falling back to one thread "
+                                     "per broker", tmp);
+        }
+
         mtx_lock(&rk->rk_internal_rkb_lock);
 	rk->rk_internal_rkb = rd_kafka_broker_add(rk, RD_KAFKA_INTERNAL,
 						  RD_KAFKA_PROTO_PLAINTEXT,
@@ -2255,6 +1826,11 @@ fail:
         if (app_conf) {
                 rd_kafka_assignors_term(rk);
                 rd_kafka_interceptors_destroy(&rk->rk_conf);
+#if WITH_SSL
+                /* The SSL context reference belongs to the instance */
+                if (rk->rk_conf.ssl.ctx)
+                        rd_kafka_transport_ssl_ctx_term(rk);
+#endif
                 memset(&rk->rk_conf, 0, sizeof(rk->rk_conf));
         }
 
@@ -2588,12 +2164,17 @@ rd_kafka_consume_callback0 (rd_kafka_q_t *rkq, int timeout_ms, int max_cnt,
                                                 void *opaque),
                             void *opaque) {
         struct consume_ctx ctx = { .consume_cb = consume_cb, .opaque = opaque };
+        rd_kafka_op_res_t res;
 
         rd_kafka_app_polled(rkq->rkq_rk);
 
-        return rd_kafka_q_serve(rkq, timeout_ms, max_cnt,
-                                RD_KAFKA_Q_CB_RETURN,
-                                rd_kafka_consume_cb, &ctx);
+        res = rd_kafka_q_serve(rkq, timeout_ms, max_cnt,
+                               RD_KAFKA_Q_CB_RETURN,
+                               rd_kafka_consume_cb, &ctx);
+
+        rd_kafka_app_poll_return(rkq->rkq_rk);
+
+        return res;
 
 }
 
@@ -2680,6 +2261,7 @@ static rd_kafka_message_t *rd_kafka_consume0 (rd_kafka_t *rk,
                          * stop dispatching the queue and return. */
                         rd_kafka_set_last_error(RD_KAFKA_RESP_ERR__INTR,
                                                 EINTR);
+                        rd_kafka_app_poll_return(rk);
                         return NULL;
                 }
 
@@ -2687,6 +2269,8 @@ static rd_kafka_message_t *rd_kafka_consume0 (rd_kafka_t *rk,
                 continue;
         }
 
+        rd_kafka_app_poll_return(rk);
+
 	if (!rko) {
 		/* Timeout reached with no op returned. */
 		rd_kafka_set_last_error(RD_KAFKA_RESP_ERR__TIMED_OUT,
@@ -3258,6 +2842,9 @@ rd_kafka_poll_cb (rd_kafka_t *rk, rd_kafka_q_t *rkq, rd_kafka_op_t *rko,
 	rd_kafka_msg_t *rkm;
         rd_kafka_op_res_t res = RD_KAFKA_OP_RES_HANDLED;
 
+        if (rko->rko_type == RD_KAFKA_OP_DR)
+                rd_kafka_dr_served(rko);
+
         /* Special handling for events based on cb_type */
         if (cb_type == RD_KAFKA_Q_CB_EVENT &&
             rd_kafka_event_setup(rk, rko)) {
@@ -3453,9 +3040,14 @@ rd_kafka_poll_cb (rd_kafka_t *rk, rd_kafka_q_t *rkq, rd_kafka_op_t *rko,
 }
 
 int rd_kafka_poll (rd_kafka_t *rk, int timeout_ms) {
+        int r;
+
         rd_kafka_app_polled(rk);
-        return rd_kafka_q_serve(rk->rk_rep, timeout_ms, 0,
-                                RD_KAFKA_Q_CB_CALLBACK, rd_kafka_poll_cb, NULL);
+        r = rd_kafka_q_serve(rk->rk_rep, timeout_ms, 0,
+                             RD_KAFKA_Q_CB_CALLBACK, rd_kafka_poll_cb, NULL);
+        rd_kafka_app_poll_return(rk);
+
+        return r;
 }
 
 
@@ -3464,6 +3056,7 @@ rd_kafka_event_t *rd_kafka_queue_poll (rd_kafka_queue_t *rkqu, int timeout_ms) {
         rd_kafka_app_polled(rkqu->rkqu_rk);
         rko = rd_kafka_q_pop_serve(rkqu->rkqu_q, timeout_ms, 0,
                                    RD_KAFKA_Q_CB_EVENT, rd_kafka_poll_cb, NULL);
+        rd_kafka_app_poll_return(rkqu->rkqu_rk);
         if (!rko)
                 return NULL;
 
@@ -3471,9 +3064,14 @@ rd_kafka_event_t *rd_kafka_queue_poll (rd_kafka_queue_t *rkqu, int timeout_ms) {
 }
 
 int rd_kafka_queue_poll_callback (rd_kafka_queue_t *rkqu, int timeout_ms) {
+        int r;
+
         rd_kafka_app_polled(rkqu->rkqu_rk);
-        return rd_kafka_q_serve(rkqu->rkqu_q, timeout_ms, 0,
-                                RD_KAFKA_Q_CB_CALLBACK, rd_kafka_poll_cb, NULL);
+        r = rd_kafka_q_serve(rkqu->rkqu_q, timeout_ms, 0,
+                             RD_KAFKA_Q_CB_CALLBACK, rd_kafka_poll_cb, NULL);
+        rd_kafka_app_poll_return(rkqu->rkqu_rk);
+
+        return r;
 }
 
 
@@ -1236,7 +1236,8 @@ int64_t rd_kafka_message_timestamp (const rd_kafka_message_t *rkmessage,
 
 /**
  * @brief Returns the latency for a produced message measured from
- *        the produce() call.
+ *        the produce() call, or for a consumed message measured from
+ *        the time its FetchResponse was parsed.
  *
  * @returns the latency in microseconds, or -1 if not available.
  */
@@ -1740,6 +1741,10 @@ void rd_kafka_conf_set_log_cb(rd_kafka_conf_t *conf,
  * will immediately free the \p json pointer.
  *
  * See STATISTICS.md for a full definition of the JSON object.
+ *
+ * With \c statistics.format=openmetrics \p json is instead the
+ * OpenMetrics text exposition of the statistics, see
+ * rd_kafka_stats_openmetrics().
  */
 RD_EXPORT
 void rd_kafka_conf_set_stats_cb(rd_kafka_conf_t *conf,
@@ -3732,6 +3737,417 @@ void rd_kafka_metadata_destroy(const struct rd_kafka_metadata *metadata);
 
 
 
+/**
+* @name Statistics API
+* @{
+*
+* Typed snapshot of the client statistics, the same statistics as the
+* JSON document passed to the stats_cb (see STATISTICS.md for the field
+* descriptions) but as plain structs and arrays that can be iterated
+* without parsing.
+*
+* Window statistics (rd_kafka_stats_window_t) cover the time since the
+* previous statistics emission (stats_cb); taking a snapshot does not
+* reset them. They are only collected when \c statistics.interval.ms
+* is configured.
+*
+* The structs are versioned with RD_KAFKA_STATS_VERSION: fields are only
+* ever appended to them, and any such change bumps the version.
+* The application passes the version it was built with to
+* rd_kafka_stats_snapshot(), which lays out the snapshot (including the
+* struct arrays) for that version, so an application keeps working with
+* newer librdkafka versions without being rebuilt.
+*/
+
+
+/**
+ * @brief Statistics struct layout version of this rdkafka.h,
+ *        to pass to rd_kafka_stats_snapshot().
+ */
+#define RD_KAFKA_STATS_VERSION 1
+
+
+/**
+ * @brief Number of histogram buckets in rd_kafka_stats_window_t.
+ *
+ * The upper bound of bucket \c i is the i:th value of the 1-2-5 series
+ * 1, 2, 5, 10, 20, 50, 100, .., 5*10^9, in the window's unit.
+ */
+#define RD_KAFKA_STATS_WINDOW_BUCKET_CNT 30
+
+/**
+ * @brief Window statistics: latencies, sizes, etc, over the window
+ *        (see the "Window stats" in STATISTICS.md).
+ */
+typedef struct rd_kafka_stats_window {
+        int64_t min;         /**< Smallest value */
+        int64_t max;         /**< Largest value */
+        int64_t avg;         /**< Average value */
+        int64_t sum;         /**< Sum of values */
+        int     cnt;         /**< Number of values sampled */
+        int64_t stddev;      /**< Standard deviation (HDR histogram) */
+        int64_t p50;         /**< 50th percentile */
+        int64_t p75;         /**< 75th percentile */
+        int64_t p90;         /**< 90th percentile */
+        int64_t p95;         /**< 95th percentile */
+        int64_t p99;         /**< 99th percentile */
+        int64_t p99_99;      /**< 99.99th percentile */
+        int64_t outofrange;  /**< Values outside the histogram range */
+        int32_t hdrsize;     /**< Memory size of the HDR histogram */
+        int64_t buckets[RD_KAFKA_STATS_WINDOW_BUCKET_CNT]; /**< Cumulative
+                              *   histogram: number of values <= the
+                              *   bucket's upper bound. Out of range
+                              *   values are not counted. */
+} rd_kafka_stats_window_t;
+
+/**
+ * @brief Producer batch stages, in order, for the per-stage latency
+ *        windows of rd_kafka_stats_broker_t and rd_kafka_stats_topic_t.
+ *
+ * Each ProduceRequest batch is sampled once per stage, the stage latency
+ * is the time since the end of the previous stage (microseconds).
+ */
+typedef enum rd_kafka_stats_produce_stage_t {
+        /** First message in batch enqueued by the application ->
+         *  batch closed (linger and partition queue wait) */
+        RD_KAFKA_STATS_PRODUCE_STAGE_LINGER,
+        /** Batch closed -> compression done (compressed batches only) */
+        RD_KAFKA_STATS_PRODUCE_STAGE_COMPRESS,
+        /** Batch closed or compressed -> request written to the socket
+         *  (broker output queue and socket send) */
+        RD_KAFKA_STATS_PRODUCE_STAGE_SEND,
+        /** Request written -> response received (broker processing and
+         *  network round-trip) */
+        RD_KAFKA_STATS_PRODUCE_STAGE_BROKER,
+        /** Response received -> delivery report enqueued */
+        RD_KAFKA_STATS_PRODUCE_STAGE_RESPONSE,
+        /** Delivery report enqueued -> served by rd_kafka_poll() or
+         *  returned as an event */
+        RD_KAFKA_STATS_PRODUCE_STAGE_DR,
+        /** First message enqueued -> delivery report served */
+        RD_KAFKA_STATS_PRODUCE_STAGE_TOTAL,
+        RD_KAFKA_STATS_PRODUCE_STAGE__CNT
+} rd_kafka_stats_produce_stage_t;
+
+/**
+ * @brief Requests sent of one request type (ApiKey).
+ */
+typedef struct rd_kafka_stats_req {
+        const char *name;    /**< Request type name */
+        int16_t     ApiKey;  /**< Protocol request type */
+        int64_t     cnt;     /**< Number of requests sent */
+        int32_t     inflight;     /**< Requests awaiting a response */
+        int32_t     inflight_max; /**< Highest inflight since the
+                                   *   previous statistics emission */
+        rd_kafka_stats_window_t rtt;            /**< Round-trip time */
+        rd_kafka_stats_window_t outbuf_latency; /**< Request queue
+                                                 *   latency */
+} rd_kafka_stats_req_t;
+
+/**
+ * @brief Partition assigned to a broker.
+ */
+typedef struct rd_kafka_stats_broker_toppar {
+        const char *topic;   /**< Topic name */
+        int32_t     partition; /**< Partition */
+} rd_kafka_stats_broker_toppar_t;
+
+/**
+ * @brief Broker statistics
+ */
+typedef struct rd_kafka_stats_broker {
+        const char *name;              /**< Broker hostname:port/id */
+        int32_t     nodeid;            /**< Broker id, or -1 */
+        const char *nodename;          /**< Broker hostname:port */
+        const char *source;            /**< learned, configured, internal,
+                                        *   logical */
+        const char *state;             /**< Broker state */
+        int64_t     stateage;          /**< Time since last state change
+                                        *   (microseconds) */
+        int         outbuf_cnt;        /**< Requests awaiting transmission */
+        int         outbuf_msg_cnt;    /**< Messages awaiting transmission */
+        int         waitresp_cnt;      /**< Requests awaiting response */
+        int         waitresp_msg_cnt;  /**< Messages awaiting response */
+        uint64_t    tx;                /**< Requests sent */
+        uint64_t    txbytes;           /**< Bytes sent */
+        uint64_t    txerrs;            /**< Transmission errors */
+        uint64_t    txretries;         /**< Request retries */
+        uint64_t    req_timeouts;      /**< Requests timed out */
+        uint64_t    rx;                /**< Responses received */
+        uint64_t    rxbytes;           /**< Bytes received */
+        uint64_t    rxerrs;            /**< Receive errors */
+        uint64_t    rxcorriderrs;      /**< Unmatched correlation ids */
+        uint64_t    rxpartial;         /**< Partial MessageSets received */
+        uint64_t    zbuf_grow;         /**< Decompression buffer
+                                        *   reallocations */
+        uint64_t    zbuf_pool_hits;    /**< Decompression buffers reused */
+        uint64_t    zbuf_pool_misses;  /**< Decompression buffers
+                                        *   allocated */
+        size_t      zbuf_pool_size;    /**< Pooled decompression buffer
+                                        *   bytes */
+        uint64_t    buf_grow;          /**< Buffer size increases */
+        uint64_t    wakeups;           /**< Broker thread poll wakeups */
+        uint64_t    zc_tx;             /**< Zero-copy sends */
+        uint64_t    zc_tx_copied;      /**< Zero-copy sends the kernel
+                                        *   copied */
+        uint64_t    zc_tx_fallback;    /**< Sends copied instead of
+                                        *   zero-copy */
+        int32_t     connects;          /**< Connection attempts */
+        int32_t     disconnects;       /**< Disconnects */
+        int32_t     tls_full_handshakes;    /**< Full TLS handshakes */
+        int32_t     tls_resumed_handshakes; /**< Resumed TLS handshakes */
+        int32_t     resolve_hits;      /**< Addresses served from the
+                                        *   resolver cache */
+        int32_t     resolve_misses;    /**< Address resolutions waited
+                                        *   for */
+        rd_kafka_stats_window_t int_latency;     /**< Internal producer
+                                                  *   queue latency */
+        rd_kafka_stats_window_t outbuf_latency;  /**< Internal request
+                                                  *   queue latency */
+        rd_kafka_stats_window_t rtt;             /**< Round-trip time */
+        rd_kafka_stats_window_t throttle;        /**< Throttling time */
+        rd_kafka_stats_window_t tls_records;     /**< TLS records per
+                                                  *   send */
+        rd_kafka_stats_window_t tls_record_size; /**< TLS record size */
+        rd_kafka_stats_window_t resolve_latency; /**< Address resolution
+                                                  *   latency */
+        /** Producer batch latency per stage, indexed by
+         *  rd_kafka_stats_produce_stage_t */
+        rd_kafka_stats_window_t
+                produce_latency[RD_KAFKA_STATS_PRODUCE_STAGE__CNT];
+        int         req_cnt;           /**< Number of elements in \p reqs */
+        const rd_kafka_stats_req_t *reqs; /**< Requests sent per type */
+        int         toppar_cnt;        /**< Number of elements in
+                                        *   \p toppars */
+        const rd_kafka_stats_broker_toppar_t *toppars; /**< Partitions
+                                                         *   handled by
+                                                         *   this broker */
+} rd_kafka_stats_broker_t;
+
+/**
+ * @brief Partition statistics
+ */
+typedef struct rd_kafka_stats_partition {
+        int32_t     partition;         /**< Partition id, -1 for the
+                                        *   internal UnAssigned partition */
+        int32_t     leader;            /**< Current leader broker id */
+        int         desired;           /**< Partition is explicitly desired
+                                        *   by the application */
+        int         unknown;           /**< Partition is not seen in topic
+                                        *   metadata from broker */
+        int         msgq_cnt;          /**< Messages waiting to be produced
+                                        *   in the first-level queue */
+        size_t      msgq_bytes;        /**< Bytes in msgq_cnt */
+        int         fetchq_cnt;        /**< Pre-fetched messages in the
+                                        *   fetch queue */
+        uint64_t    fetchq_size;       /**< Bytes in fetchq */
+        const char *fetch_state;       /**< Consumer fetch state */
+        int32_t     fetch_max_bytes;   /**< Current Fetch MaxBytes */
+        int64_t     consume_rate;      /**< Consume rate estimate */
+        int64_t     query_offset;      /**< Current/Last logical offset
+                                        *   query */
+        int64_t     next_offset;       /**< Next offset to fetch */
+        int64_t     app_offset;        /**< Offset of last message passed
+                                        *   to application + 1 */
+        int64_t     stored_offset;     /**< Offset to be committed */
+        int64_t     committed_offset;  /**< Last committed offset */
+        int64_t     eof_offset;        /**< Last PARTITION_EOF offset */
+        int64_t     lo_offset;         /**< Partition's low watermark */
+        int64_t     hi_offset;         /**< Partition's high watermark */
+        int64_t     consumer_lag;      /**< Consumer lag, or -1 */
+        uint64_t    txmsgs;            /**< Messages sent */
+        uint64_t    txbytes;           /**< Message bytes sent */
+        uint64_t    rxmsgs;            /**< Messages consumed */
+        uint64_t    rxbytes;           /**< Message bytes consumed */
+        uint64_t    msgs;              /**< Messages produced or
+                                        *   consumed */
+        uint64_t    rx_ver_drops;      /**< Dropped outdated messages */
+        int32_t     msgs_inflight;     /**< Messages in-flight to or from
+                                        *   the broker */
+        int32_t     next_ack_seq;      /**< Next expected acked sequence
+                                        *   (idempotent producer) */
+        int32_t     next_err_seq;      /**< Next expected errored sequence
+                                        *   (idempotent producer) */
+        uint64_t    acked_msgid;       /**< Last acked internal message
+                                        *   id (idempotent producer) */
+        rd_kafka_stats_window_t e2e_latency;    /**< Consumer: message
+                                                 *   timestamp to application
+                                                 *   latency (milliseconds) */
+        rd_kafka_stats_window_t fetchq_latency; /**< Consumer:
+                                                 *   FetchResponse to
+                                                 *   application latency */
+} rd_kafka_stats_partition_t;
+
+/**
+ * @brief Topic statistics
+ */
+typedef struct rd_kafka_stats_topic {
+        const char *topic;             /**< Topic name */
+        int64_t     metadata_age;      /**< Age of metadata from broker
+                                        *   (milliseconds) */
+        rd_kafka_stats_window_t batchsize; /**< Batch sizes in bytes */
+        rd_kafka_stats_window_t batchcnt;  /**< Batch message counts */
+        /** Producer batch latency per stage, indexed by
+         *  rd_kafka_stats_produce_stage_t */
+        rd_kafka_stats_window_t
+                produce_latency[RD_KAFKA_STATS_PRODUCE_STAGE__CNT];
+        int         partition_cnt;     /**< Number of elements in
+                                        *   \p partitions */
+        const rd_kafka_stats_partition_t *partitions; /**< Partitions */
+} rd_kafka_stats_topic_t;
+
+/**
+ * @brief Consumer group statistics
+ */
+typedef struct rd_kafka_stats_cgrp {
+        const char *state;             /**< Group handler state */
+        int64_t     stateage;          /**< Time since last state change
+                                        *   (milliseconds) */
+        const char *join_state;        /**< Group join state */
+        int64_t     rebalance_age;     /**< Time since last rebalance
+                                        *   (milliseconds) */
+        int         rebalance_cnt;     /**< Number of rebalances */
+        const char *rebalance_reason;  /**< Last rebalance reason */
+        int         assignment_size;   /**< Current assignment's
+                                        *   partition count */
+} rd_kafka_stats_cgrp_t;
+
+/**
+ * @brief Idempotent producer statistics
+ */
+typedef struct rd_kafka_stats_eos {
+        const char *idemp_state;       /**< Idempotent producer state */
+        int64_t     idemp_stateage;    /**< Time since last state change
+                                        *   (milliseconds) */
+        int64_t     producer_id;       /**< Current Producer Id */
+        int16_t     producer_epoch;    /**< Current Producer Epoch */
+        int         epoch_cnt;         /**< Producer Id assignments */
+} rd_kafka_stats_eos_t;
+
+/**
+ * @brief Client statistics snapshot
+ */
+typedef struct rd_kafka_stats {
+        int          version;          /**< Struct layout version of the
+                                        *   snapshot,
+                                        *   see RD_KAFKA_STATS_VERSION */
+        const char  *name;             /**< Handle instance name */
+        const char  *client_id;        /**< The configured client.id */
+        const char  *type;             /**< "producer" or "consumer" */
+        int64_t      ts;               /**< librdkafka's internal monotonic
+                                        *   clock (microseconds) */
+        int64_t      time;             /**< Wall clock time in seconds
+                                        *   since the epoch */
+        int          replyq;           /**< Ops waiting in the queue for
+                                        *   the application to poll */
+        unsigned int msg_cnt;          /**< Current number of messages in
+                                        *   producer queues */
+        size_t       msg_size;         /**< Size of msg_cnt messages */
+        unsigned int msg_max;          /**< queue.buffering.max.messages */
+        size_t       msg_size_max;     /**< queue.buffering.max.kbytes
+                                        *   in bytes */
+        int          simple_cnt;       /**< Partitions consumed with the
+                                        *   legacy consumer API */
+        int          metadata_cache_cnt; /**< Topics in the metadata
+                                          *   cache */
+        int64_t      fetchbuf_pinned_bytes;  /**< Fetch buffer bytes
+                                              *   pinned by messages */
+        int64_t      fetchbuf_live_bytes;    /**< Fetch buffer bytes in
+                                              *   use */
+        int64_t      fetchbuf_copyout_cnt;   /**< Messages copied out of
+                                              *   fetch buffers */
+        int64_t      fetchbuf_copyout_bytes; /**< Bytes copied out of
+                                              *   fetch buffers */
+        int64_t      prefetch_bytes;         /**< Pre-fetched bytes */
+        int64_t      prefetch_inflight_bytes; /**< Fetch bytes in
+                                               *   flight */
+        int64_t      prefetch_exhausted;     /**< Fetches held back by
+                                              *   the prefetch budget */
+        int          broker_cnt;       /**< Number of elements in
+                                        *   \p brokers */
+        const rd_kafka_stats_broker_t *brokers; /**< Brokers */
+        int          topic_cnt;        /**< Number of elements in
+                                        *   \p topics */
+        const rd_kafka_stats_topic_t *topics;   /**< Topics */
+        const rd_kafka_stats_cgrp_t *cgrp; /**< Consumer group, or NULL */
+        const rd_kafka_stats_eos_t  *eos;  /**< Idempotent producer,
+                                            *   or NULL */
+        rd_kafka_resp_err_t fatal_err; /**< Fatal error, or
+                                        *   RD_KAFKA_RESP_ERR_NO_ERROR */
+        const char  *fatal_reason;     /**< Fatal error reason, or NULL */
+        int          fatal_cnt;        /**< Number of fatal errors */
+        int64_t      tx;               /**< Requests sent to brokers */
+        int64_t      tx_bytes;         /**< Bytes sent to brokers */
+        int64_t      rx;               /**< Responses received from
+                                        *   brokers */
+        int64_t      rx_bytes;         /**< Bytes received from brokers */
+        int64_t      txmsgs;           /**< Messages produced */
+        int64_t      txmsg_bytes;      /**< Message bytes produced */
+        int64_t      rxmsgs;           /**< Messages consumed */
+        int64_t      rxmsg_bytes;      /**< Message bytes consumed */
+        rd_kafka_stats_window_t poll_gap; /**< Consumer: time from the
+                                           *   return of an application
+                                           *   poll call to the next */
+        int64_t      log_drops;        /**< Log messages dropped by the
+                                        *   asynchronous log ring */
+} rd_kafka_stats_t;
+
+
+/**
+ * @brief Take a snapshot of the client's statistics.
+ *
+ * The brokers, topics and partitions are each copied under their own
+ * lock, without holding up the client for the duration of the snapshot,
+ * so the snapshot is not necessarily consistent across objects.
+ *
+ * The snapshot honours the \c statistics.fields and
+ * \c statistics.{topic,broker}.{include,exclude} filters, but not
+ * \c statistics.delta: excluded field groups are zeroed, with
+ * zero counts for excluded arrays, and excluded cgrp and eos objects
+ * are NULL.
+ *
+ * @param version Struct layout version the application was built with,
+ *                always RD_KAFKA_STATS_VERSION.
+ * @param statsp is set to the snapshot, which must be released with
+ *               rd_kafka_stats_destroy().
+ *
+ * @returns RD_KAFKA_RESP_ERR_NO_ERROR, or RD_KAFKA_RESP_ERR__INVALID_ARG
+ *          if \p version is not supported by this librdkafka version.
+ */
+RD_EXPORT
+rd_kafka_resp_err_t rd_kafka_stats_snapshot (rd_kafka_t *rk, int version,
+                                             const rd_kafka_stats_t **statsp);
+
+/**
+ * @brief Release a statistics snapshot from rd_kafka_stats_snapshot().
+ */
+RD_EXPORT
+void rd_kafka_stats_destroy (const rd_kafka_stats_t *stats);
+
+/**
+ * @brief Render a statistics snapshot in the OpenMetrics (Prometheus)
+ *        text exposition format.
+ *
+ * Metric names are the STATISTICS.md field names prefixed with
+ * \c rdkafka_ and the object type (e.g., \c rdkafka_broker_rtt_seconds),
+ * windows are rendered as gauge histograms of the interval.
+ * See the OpenMetrics section in STATISTICS.md.
+ *
+ * @param stats Statistics snapshot from rd_kafka_stats_snapshot().
+ * @param lenp If not NULL, set to the length of the returned string.
+ *
+ * @returns the nul-terminated text, which must be freed with
+ *          rd_kafka_mem_free().
+ */
+RD_EXPORT
+char *rd_kafka_stats_openmetrics (const rd_kafka_stats_t *stats,
+                                  size_t *lenp);
+
+
+/**@}*/
+
+
+
 /**
 * @name Client group information
 * @{
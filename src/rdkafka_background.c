@@ -68,6 +68,9 @@ rd_kafka_background_queue_serve (rd_kafka_t *rk,
                                  void *opaque) {
         rd_kafka_op_res_t res;
 
+        if (rko->rko_type == RD_KAFKA_OP_DR)
+                rd_kafka_dr_served(rko);
+
         /*
          * Dispatch Event:able ops to background_event_cb()
          */
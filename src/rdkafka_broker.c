@@ -65,16 +65,26 @@
 #include "rdcrc32.h"
 #include "rdrand.h"
 #include "rdkafka_lz4.h"
+#if WITH_ZSTD
+#include "rdkafka_zstd.h"
+#endif
 #if WITH_SSL
 #include <openssl/err.h>
 #endif
 #include "rdendian.h"
 #include "rdunittest.h"
 #include "rdkafka_sasl_oauthbearer.h"
+#include "rdkafka_resolve.h"
 
 
 static const int rd_kafka_max_block_ms = 1000;
 
+/**< Size of the per-connection receive ring. Responses larger than a
+ *   quarter of the ring are received into buffers of their own. */
+#define RD_KAFKA_RECV_RING_SIZE  (64 * 1024)
+
+static void rd_kafka_recv_ring_destroy (rd_kafka_broker_t *rkb);
+
 const char *rd_kafka_broker_state_names[] = {
 	"INIT",
 	"DOWN",
@@ -117,10 +127,6 @@ static void rd_kafka_broker_handle_purge_queues (rd_kafka_broker_t *rkb,
 
 
 
-#define rd_kafka_broker_terminating(rkb) \
-        (rd_refcnt_get(&(rkb)->rkb_refcnt) <= 1)
-
-
 /**
  * Construct broker nodename.
  */
@@ -390,6 +396,8 @@ void rd_kafka_broker_fail (rd_kafka_broker_t *rkb,
 		rkb->rkb_recv_buf = NULL;
 	}
 
+        rd_kafka_recv_ring_destroy(rkb);
+
 	rd_kafka_broker_lock(rkb);
 
 	/* The caller may omit the format if it thinks this is a recurring
@@ -706,7 +714,15 @@ static int rd_kafka_broker_bufq_timeout_scan (rd_kafka_broker_t *rkb,
 		    && rd_atomic32_sub(&rkb->rkb_blocking_request_cnt, 1) == 0)
 			rd_kafka_brokers_broadcast_state_change(rkb->rkb_rk);
 
-                rd_kafka_buf_callback(rkb->rkb_rk, rkb, err, NULL, rkbuf);
+                /* As for responses, hold back the timeout while the kernel
+                 * still references the request's payload from a zero-copy
+                 * send: the callback may free it (e.g., by delivering or
+                 * retrying the messages of a ProduceRequest). */
+                if (!(rkbuf->rkbuf_zc.pending > 0 && rkb->rkb_transport &&
+                      rd_kafka_transport_zc_defer(rkb->rkb_transport, rkbuf,
+                                                  err, NULL)))
+                        rd_kafka_buf_callback(rkb->rkb_rk, rkb, err,
+                                              NULL, rkbuf);
 		cnt++;
 	}
 
@@ -807,17 +823,26 @@ rd_kafka_broker_send (rd_kafka_broker_t *rkb, rd_slice_t *slice) {
 
 
 
+/**
+ * @brief Look up the broker's addresses, unless the current address list
+ *        is still valid (broker.address.ttl).
+ *
+ * The lookup is served from the process-wide resolver cache and never
+ * blocks: if the address is not cached the broker thread is woken up by
+ * an RD_KAFKA_OP_RESOLVE op when the resolver is done, after which the
+ * connection attempt is retried.
+ *
+ * @returns 0 if rkb_rsal is set, 1 if waiting for the resolver,
+ *          or -1 if resolving failed, with the error in \p errstr.
+ *
+ * @locality broker thread
+ */
 static int rd_kafka_broker_resolve (rd_kafka_broker_t *rkb,
-                                    const char *nodename) {
-	const char *errstr;
-        int save_idx = 0;
-
-        if (!*nodename && rkb->rkb_source == RD_KAFKA_LOGICAL) {
-                rd_kafka_broker_fail(rkb, LOG_DEBUG,
-                                     RD_KAFKA_RESP_ERR__RESOLVE,
-                                     "Logical broker has no address yet");
-                return -1;
-        }
+                                    const char *nodename,
+                                    char *errstr, size_t errstr_size) {
+        rd_kafka_resolve_res_t res;
+        rd_sockaddr_list_t *rsal = NULL;
+        rd_bool_t first = !rkb->rkb_resolve.ts_req;
 
 	if (rkb->rkb_rsal &&
 	    rkb->rkb_ts_rsal_last + (rkb->rkb_rk->rk_conf.broker_addr_ttl*1000)
@@ -826,38 +851,47 @@ static int rd_kafka_broker_resolve (rd_kafka_broker_t *rkb,
 
                 /* Save the address index to make sure we still round-robin
                  * if we get the same address list back */
-                save_idx = rkb->rkb_rsal->rsal_curr;
+                rkb->rkb_resolve.save_idx = rkb->rkb_rsal->rsal_curr;
 
 		rd_sockaddr_list_destroy(rkb->rkb_rsal);
 		rkb->rkb_rsal = NULL;
 	}
 
-	if (!rkb->rkb_rsal) {
-		/* Resolve */
-		rkb->rkb_rsal = rd_getaddrinfo(rkb->rkb_nodename,
-					       RD_KAFKA_PORT_STR,
-					       AI_ADDRCONFIG,
-					       rkb->rkb_rk->rk_conf.
-                                               broker_addr_family,
-                                               SOCK_STREAM,
-					       IPPROTO_TCP, &errstr);
-
-		if (!rkb->rkb_rsal) {
-                        rd_kafka_broker_fail(rkb, LOG_ERR,
-                                             RD_KAFKA_RESP_ERR__RESOLVE,
-                                             /* Avoid duplicate log messages */
-                                             rkb->rkb_err.err == errno ?
-                                             NULL :
-                                             "Failed to resolve '%s': %s",
-                                             nodename, errstr);
-			return -1;
-                } else {
-                        rkb->rkb_ts_rsal_last = rd_clock();
-                        /* Continue at previous round-robin position */
-                        if (rkb->rkb_rsal->rsal_cnt > save_idx)
-                                rkb->rkb_rsal->rsal_curr = save_idx;
-                }
-	}
+        if (rkb->rkb_rsal)
+                return 0;
+
+        if (first)
+                rkb->rkb_resolve.ts_req = rd_clock();
+
+        res = rd_kafka_resolve_lookup(nodename,
+                                      rkb->rkb_rk->rk_conf.broker_addr_family,
+                                      rkb->rkb_rk->rk_conf.broker_addr_ttl,
+                                      rkb->rkb_resolve.ts_req, rkb->rkb_ops,
+                                      &rsal, errstr, errstr_size);
+
+        if (first)
+                rd_atomic32_add(res == RD_KAFKA_RESOLVE_PENDING ?
+                                &rkb->rkb_c.resolve_misses :
+                                &rkb->rkb_c.resolve_hits, 1);
+
+        if (res == RD_KAFKA_RESOLVE_PENDING) {
+                if (first)
+                        rd_rkb_dbg(rkb, BROKER, "RESOLVE",
+                                   "Waiting for %s to be resolved",
+                                   nodename);
+                return 1;
+        }
+
+        rkb->rkb_resolve.ts_req = 0;
+
+        if (res == RD_KAFKA_RESOLVE_ERR)
+                return -1;
+
+        rkb->rkb_rsal = rsal;
+        rkb->rkb_ts_rsal_last = rd_clock();
+        /* Continue at previous round-robin position */
+        if (rkb->rkb_rsal->rsal_cnt > rkb->rkb_resolve.save_idx)
+                rkb->rkb_rsal->rsal_curr = rkb->rkb_resolve.save_idx;
 
 	return 0;
 }
@@ -1438,6 +1472,36 @@ rd_kafka_broker_t *rd_kafka_broker_controller (rd_kafka_t *rk, int state,
 
 
 
+/**
+ * @returns the per-ApiKey latency averagers of \p ApiKey, allocated on
+ *          first use, or NULL if statistics are disabled.
+ *
+ * @locality broker thread
+ */
+static struct rd_kafka_broker_req_avg_s *
+rd_kafka_broker_req_avg (rd_kafka_broker_t *rkb, int16_t ApiKey) {
+        struct rd_kafka_broker_req_avg_s *ra;
+
+        if (unlikely(ApiKey < 0 || ApiKey >= RD_KAFKAP__NUM))
+                return NULL;
+
+        if (likely((ra = rkb->rkb_req_avg[ApiKey]) != NULL) ||
+            !rkb->rkb_rk->rk_conf.stats_interval_ms)
+                return ra;
+
+        ra = rd_malloc(sizeof(*ra));
+        rd_avg_init(&ra->rtt, RD_AVG_GAUGE, 0, 500*1000, 2, 1);
+        rd_avg_init(&ra->outbuf_latency, RD_AVG_GAUGE, 0, 100*1000, 2, 1);
+
+        /* The stats snapshot reads the pointer under the lock */
+        rd_kafka_broker_lock(rkb);
+        rkb->rkb_req_avg[ApiKey] = ra;
+        rd_kafka_broker_unlock(rkb);
+
+        return ra;
+}
+
+
 /**
  * Find a waitresp (rkbuf awaiting response) by the correlation id.
  */
@@ -1450,9 +1514,14 @@ static rd_kafka_buf_t *rd_kafka_waitresp_find (rd_kafka_broker_t *rkb,
 
 	TAILQ_FOREACH(rkbuf, &rkb->rkb_waitresps.rkbq_bufs, rkbuf_link)
 		if (rkbuf->rkbuf_corrid == corrid) {
+                        struct rd_kafka_broker_req_avg_s *ra;
+
 			/* Convert ts_sent to RTT */
 			rkbuf->rkbuf_ts_sent = now - rkbuf->rkbuf_ts_sent;
 			rd_avg_add(&rkb->rkb_avg_rtt, rkbuf->rkbuf_ts_sent);
+                        if ((ra = rd_kafka_broker_req_avg(
+                                     rkb, rkbuf->rkbuf_reqhdr.ApiKey)))
+                                rd_avg_add(&ra->rtt, rkbuf->rkbuf_ts_sent);
 
                         if (rkbuf->rkbuf_flags & RD_KAFKA_OP_F_BLOCKING &&
 			    rd_atomic32_sub(&rkb->rkb_blocking_request_cnt,
@@ -1514,6 +1583,12 @@ static int rd_kafka_req_response (rd_kafka_broker_t *rkb,
         } else
                 rd_assert(rkbuf->rkbuf_rkb == rkb);
 
+        /* Hold back the response while the kernel still references
+         * the request's payload from a zero-copy send. */
+        if (req->rkbuf_zc.pending > 0 && rkb->rkb_transport &&
+            rd_kafka_transport_zc_defer(rkb->rkb_transport, req, 0, rkbuf))
+                return 0;
+
 	/* Call callback. */
         rd_kafka_buf_callback(rkb->rkb_rk, rkb, 0, rkbuf, req);
 
@@ -1523,34 +1598,17 @@ static int rd_kafka_req_response (rd_kafka_broker_t *rkb,
 
 
 
-int rd_kafka_recv (rd_kafka_broker_t *rkb) {
-	rd_kafka_buf_t *rkbuf;
-	ssize_t r;
-        /* errstr is not set by buf_read errors, so default it here. */
-        char errstr[512] = "Protocol parse failure";
-        rd_kafka_resp_err_t err = RD_KAFKA_RESP_ERR_NO_ERROR;
-	const int log_decode_errors = LOG_ERR;
-
-
-        /* It is impossible to estimate the correct size of the response
-         * so we split the read up in two parts: first we read the protocol
-         * length and correlation id (i.e., the Response header), and then
-         * when we know the full length of the response we allocate a new
-         * buffer and call receive again.
-         * All this in an async fashion (e.g., partial reads).
-         */
-	if (!(rkbuf = rkb->rkb_recv_buf)) {
-		/* No receive in progress: create new buffer */
-
-                rkbuf = rd_kafka_buf_new(2, RD_KAFKAP_RESHDR_SIZE);
-
-		rkb->rkb_recv_buf = rkbuf;
-
-                /* Set up buffer reader for the response header. */
-                rd_buf_write_ensure(&rkbuf->rkbuf_buf,
-                                    RD_KAFKAP_RESHDR_SIZE,
-                                    RD_KAFKAP_RESHDR_SIZE);
-        }
+/**
+ * @brief Receive the remainder of a large response directly into its
+ *        own buffer, set up by rd_kafka_recv_ring_parse().
+ *
+ * @returns 1 if data was received, 0 if there was nothing to read,
+ *          or -1 on error.
+ */
+static int rd_kafka_recv_spill (rd_kafka_broker_t *rkb) {
+        rd_kafka_buf_t *rkbuf = rkb->rkb_recv_buf;
+        char errstr[512];
+        ssize_t r;
 
         rd_dassert(rd_buf_write_remains(&rkbuf->rkbuf_buf) > 0);
 
@@ -1559,88 +1617,222 @@ int rd_kafka_recv (rd_kafka_broker_t *rkb) {
         if (unlikely(r <= 0)) {
                 if (r == 0)
                         return 0; /* EAGAIN */
-                err = RD_KAFKA_RESP_ERR__TRANSPORT;
                 rd_atomic64_add(&rkb->rkb_c.rx_err, 1);
-                goto err;
+                if (!strcmp(errstr, "Disconnected"))
+                        rd_kafka_broker_conn_closed(
+                                rkb, RD_KAFKA_RESP_ERR__TRANSPORT, errstr);
+                else
+                        rd_kafka_broker_fail(rkb, LOG_ERR,
+                                             RD_KAFKA_RESP_ERR__TRANSPORT,
+                                             "Receive failed: %s", errstr);
+                return -1;
         }
 
-	if (rkbuf->rkbuf_totlen == 0) {
-		/* Packet length not known yet. */
-
-                if (unlikely(rd_buf_write_pos(&rkbuf->rkbuf_buf) <
-                             RD_KAFKAP_RESHDR_SIZE)) {
-			/* Need response header for packet length and corrid.
-			 * Wait for more data. */ 
-			return 0;
-		}
-
-                rd_assert(!rkbuf->rkbuf_rkb);
-                rkbuf->rkbuf_rkb = rkb; /* Protocol parsing code needs
-                                         * the rkb for logging, but we dont
-                                         * want to keep a reference to the
-                                         * broker this early since that extra
-                                         * refcount will mess with the broker's
-                                         * refcount-based termination code. */
+        if (rd_buf_write_pos(&rkbuf->rkbuf_buf) - RD_KAFKAP_RESHDR_SIZE ==
+            rkbuf->rkbuf_totlen) {
+		/* Message is complete, pass it on to the original requester. */
+		rkb->rkb_recv_buf = NULL;
+                rd_atomic64_add(&rkb->rkb_c.rx, 1);
+                rd_atomic64_add(&rkb->rkb_c.rx_bytes,
+                                rd_buf_write_pos(&rkbuf->rkbuf_buf));
+		rd_kafka_req_response(rkb, rkbuf);
+	}
 
-                /* Initialize reader */
-                rd_slice_init(&rkbuf->rkbuf_reader, &rkbuf->rkbuf_buf, 0,
-                              RD_KAFKAP_RESHDR_SIZE);
+        return 1;
+}
 
-		/* Read protocol header */
-		rd_kafka_buf_read_i32(rkbuf, &rkbuf->rkbuf_reshdr.Size);
-		rd_kafka_buf_read_i32(rkbuf, &rkbuf->rkbuf_reshdr.CorrId);
 
-                rkbuf->rkbuf_rkb = NULL; /* Reset */
+/**
+ * @brief Parse all complete responses out of the receive ring and pass
+ *        them on to their requesters.
+ *
+ *        Each response is copied from the ring to a response buffer of
+ *        its exact size. A partial response that is too large to be
+ *        accumulated in the ring is moved to its own buffer
+ *        (rkb_recv_buf) which the rest of it is then received into.
+ *
+ * @returns 1 on success or -1 on error (broker failed).
+ */
+static int rd_kafka_recv_ring_parse (rd_kafka_broker_t *rkb) {
+        size_t need = RD_KAFKAP_RESHDR_SIZE;
+
+        /* The ring is freed if the connection goes down from
+         * one of the response callbacks. */
+        while (rkb->rkb_recv_ring.base &&
+               rkb->rkb_state >= RD_KAFKA_BROKER_STATE_UP) {
+                const char *p = rkb->rkb_recv_ring.base +
+                        rkb->rkb_recv_ring.of;
+                size_t avail = rd_buf_write_pos(&rkb->rkb_recv_ring.rbuf) -
+                        rkb->rkb_recv_ring.of;
+                rd_kafka_buf_t *rkbuf;
+                int32_t Size, CorrId;
+
+                need = RD_KAFKAP_RESHDR_SIZE;
+                if (avail < need)
+                        break;
 
-		rkbuf->rkbuf_totlen = rkbuf->rkbuf_reshdr.Size;
+                memcpy(&Size, p, sizeof(Size));
+                memcpy(&CorrId, p+4, sizeof(CorrId));
+                Size = be32toh(Size);
+                CorrId = be32toh(CorrId);
 
 		/* Make sure message size is within tolerable limits. */
-		if (rkbuf->rkbuf_totlen < 4/*CorrId*/ ||
-		    rkbuf->rkbuf_totlen >
-		    (size_t)rkb->rkb_rk->rk_conf.recv_max_msg_size) {
-                        rd_snprintf(errstr, sizeof(errstr),
-                                    "Invalid response size %"PRId32" (0..%i): "
-                                    "increase receive.message.max.bytes",
-                                    rkbuf->rkbuf_reshdr.Size,
-                                    rkb->rkb_rk->rk_conf.recv_max_msg_size);
-                        err = RD_KAFKA_RESP_ERR__BAD_MSG;
+		if (Size < 4/*CorrId*/ ||
+		    Size > rkb->rkb_rk->rk_conf.recv_max_msg_size) {
 			rd_atomic64_add(&rkb->rkb_c.rx_err, 1);
-			goto err;
+                        rd_kafka_broker_fail(
+                                rkb, LOG_ERR, RD_KAFKA_RESP_ERR__BAD_MSG,
+                                "Receive failed: "
+                                "Invalid response size %"PRId32" (0..%i): "
+                                "increase receive.message.max.bytes",
+                                Size, rkb->rkb_rk->rk_conf.recv_max_msg_size);
+                        return -1;
 		}
 
-		rkbuf->rkbuf_totlen -= 4; /*CorrId*/
-
-		if (rkbuf->rkbuf_totlen > 0) {
-			/* Allocate another buffer that fits all data (short of
-			 * the common response header). We want all
-			 * data to be in contigious memory. */
-
+                need = 4 + (size_t)Size;
+
+                if (avail < need &&
+                    need <= RD_KAFKA_RECV_RING_SIZE / 4)
+                        break; /* Wait for the rest of a small response */
+
+                if (avail < need) {
+                        /* Large response: move what we have of it to a
+                         * buffer holding the entire response and
+                         * receive the rest directly into that buffer. */
+                        rkbuf = rd_kafka_buf_new(2, RD_KAFKAP_RESHDR_SIZE);
+                        rd_buf_write_ensure(&rkbuf->rkbuf_buf,
+                                            RD_KAFKAP_RESHDR_SIZE,
+                                            RD_KAFKAP_RESHDR_SIZE);
+                        rd_buf_write(&rkbuf->rkbuf_buf, p,
+                                     RD_KAFKAP_RESHDR_SIZE);
+                        rkbuf->rkbuf_reshdr.Size = Size;
+                        rkbuf->rkbuf_reshdr.CorrId = CorrId;
+                        rkbuf->rkbuf_totlen = (size_t)Size - 4/*CorrId*/;
                         rd_buf_write_ensure_contig(&rkbuf->rkbuf_buf,
                                                    rkbuf->rkbuf_totlen);
-		}
-	}
+                        rd_buf_write(&rkbuf->rkbuf_buf,
+                                     p + RD_KAFKAP_RESHDR_SIZE,
+                                     avail - RD_KAFKAP_RESHDR_SIZE);
+
+                        rkb->rkb_recv_ring.of += avail;
+                        rkb->rkb_recv_buf = rkbuf;
+                        need = RD_KAFKAP_RESHDR_SIZE;
+                        break;
+                }
+
+                /* Complete response: contiguous copy */
+                rkbuf = rd_kafka_buf_new(1, need);
+                rd_buf_write_ensure_contig(&rkbuf->rkbuf_buf, need);
+                rd_buf_write(&rkbuf->rkbuf_buf, p, need);
+                rkbuf->rkbuf_reshdr.Size = Size;
+                rkbuf->rkbuf_reshdr.CorrId = CorrId;
+                rkbuf->rkbuf_totlen = (size_t)Size - 4/*CorrId*/;
+
+                rkb->rkb_recv_ring.of += need;
 
-        if (rd_buf_write_pos(&rkbuf->rkbuf_buf) - RD_KAFKAP_RESHDR_SIZE ==
-            rkbuf->rkbuf_totlen) {
-		/* Message is complete, pass it on to the original requester. */
-		rkb->rkb_recv_buf = NULL;
                 rd_atomic64_add(&rkb->rkb_c.rx, 1);
-                rd_atomic64_add(&rkb->rkb_c.rx_bytes,
-                                rd_buf_write_pos(&rkbuf->rkbuf_buf));
-		rd_kafka_req_response(rkb, rkbuf);
-	}
+                rd_atomic64_add(&rkb->rkb_c.rx_bytes, need);
+                rd_kafka_req_response(rkb, rkbuf);
+        }
 
-	return 1;
+        if (!rkb->rkb_recv_ring.base)
+                return rkb->rkb_state >= RD_KAFKA_BROKER_STATE_UP
+                        ? 1 : -1;
+
+        /* Make room for the next read */
+        if (rkb->rkb_recv_ring.of ==
+            rd_buf_write_pos(&rkb->rkb_recv_ring.rbuf)) {
+                /* Everything parsed: rewind */
+                rd_buf_write_seek(&rkb->rkb_recv_ring.rbuf, 0);
+                rkb->rkb_recv_ring.of = 0;
+
+        } else if (rkb->rkb_recv_ring.of > 0 &&
+                   (rkb->rkb_recv_ring.of + need > RD_KAFKA_RECV_RING_SIZE ||
+                    rkb->rkb_recv_ring.of > RD_KAFKA_RECV_RING_SIZE / 2)) {
+                /* Move the partial response to the start of the ring. */
+                size_t avail = rd_buf_write_pos(&rkb->rkb_recv_ring.rbuf) -
+                        rkb->rkb_recv_ring.of;
+
+                memmove(rkb->rkb_recv_ring.base,
+                        rkb->rkb_recv_ring.base + rkb->rkb_recv_ring.of,
+                        avail);
+                rd_buf_write_seek(&rkb->rkb_recv_ring.rbuf, avail);
+                rkb->rkb_recv_ring.of = 0;
+        }
 
- err_parse:
-        err = rkbuf->rkbuf_err;
- err:
-        if (!strcmp(errstr, "Disconnected"))
-                rd_kafka_broker_conn_closed(rkb, err, errstr);
-        else
-                rd_kafka_broker_fail(rkb, LOG_ERR, err,
-                                     "Receive failed: %s", errstr);
-	return -1;
+        return 1;
+}
+
+
+/**
+ * @brief Allocate the receive ring.
+ */
+static void rd_kafka_recv_ring_init (rd_kafka_broker_t *rkb) {
+        void *p;
+
+        rd_buf_init(&rkb->rkb_recv_ring.rbuf, 1, RD_KAFKA_RECV_RING_SIZE);
+        rd_buf_write_ensure_contig(&rkb->rkb_recv_ring.rbuf,
+                                   RD_KAFKA_RECV_RING_SIZE);
+        rd_buf_get_writable(&rkb->rkb_recv_ring.rbuf, &p);
+        rkb->rkb_recv_ring.base = p;
+        rkb->rkb_recv_ring.of = 0;
+}
+
+
+/**
+ * @brief Free the receive ring, discarding any unparsed data.
+ */
+static void rd_kafka_recv_ring_destroy (rd_kafka_broker_t *rkb) {
+        if (!rkb->rkb_recv_ring.base)
+                return;
+
+        rd_buf_destroy(&rkb->rkb_recv_ring.rbuf);
+        rkb->rkb_recv_ring.base = NULL;
+        rkb->rkb_recv_ring.of = 0;
+}
+
+
+/**
+ * @brief Receive and handle responses.
+ *
+ *        The socket is read in bulk into the broker's receive ring,
+ *        from which any number of complete responses are parsed
+ *        per read, see rd_kafka_recv_ring_parse().
+ *        All this in an async fashion (e.g., partial reads).
+ *
+ * @returns 1 if data was received, 0 if there was nothing to read,
+ *          or -1 on error (broker failed).
+ */
+int rd_kafka_recv (rd_kafka_broker_t *rkb) {
+	ssize_t r;
+        char errstr[512];
+
+        if (rkb->rkb_recv_buf)
+                return rd_kafka_recv_spill(rkb);
+
+        if (unlikely(!rkb->rkb_recv_ring.base))
+                rd_kafka_recv_ring_init(rkb);
+
+        rd_dassert(rd_buf_write_remains(&rkb->rkb_recv_ring.rbuf) > 0);
+
+        r = rd_kafka_transport_recv(rkb->rkb_transport,
+                                    &rkb->rkb_recv_ring.rbuf,
+                                    errstr, sizeof(errstr));
+        if (unlikely(r <= 0)) {
+                if (r == 0)
+                        return 0; /* EAGAIN */
+                rd_atomic64_add(&rkb->rkb_c.rx_err, 1);
+                if (!strcmp(errstr, "Disconnected"))
+                        rd_kafka_broker_conn_closed(
+                                rkb, RD_KAFKA_RESP_ERR__TRANSPORT, errstr);
+                else
+                        rd_kafka_broker_fail(rkb, LOG_ERR,
+                                             RD_KAFKA_RESP_ERR__TRANSPORT,
+                                             "Receive failed: %s", errstr);
+                return -1;
+        }
+
+        return rd_kafka_recv_ring_parse(rkb);
 }
 
 
@@ -1796,33 +1988,52 @@ static int rd_kafka_broker_connect (rd_kafka_broker_t *rkb) {
 	const rd_sockaddr_inx_t *sinx;
 	char errstr[512];
         char nodename[RD_KAFKA_NODENAME_SIZE];
+        int nodename_epoch;
+        int r;
 
 	rd_rkb_dbg(rkb, BROKER, "CONNECT",
 		"broker in state %s connecting",
 		rd_kafka_broker_state_names[rkb->rkb_state]);
 
-        rd_atomic32_add(&rkb->rkb_c.connects, 1);
-
         rd_kafka_broker_lock(rkb);
         strncpy(nodename, rkb->rkb_nodename, sizeof(nodename));
-        rkb->rkb_connect_epoch = rkb->rkb_nodename_epoch;
-        /* Logical brokers might not have a hostname set, in which case
-         * we should not try to connect. */
-        if (*nodename)
-                rd_kafka_broker_set_state(rkb, RD_KAFKA_BROKER_STATE_CONNECT);
+        nodename_epoch = rkb->rkb_nodename_epoch;
         rd_kafka_broker_unlock(rkb);
 
+        /* Logical brokers might not have a hostname set, in which case
+         * we should not try to connect. */
         if (!*nodename) {
                 rd_rkb_dbg(rkb, BROKER, "CONNECT",
                            "broker has no address yet: postponing connect");
                 return 0;
         }
 
+        r = rd_kafka_broker_resolve(rkb, nodename, errstr, sizeof(errstr));
+        if (r == 1) {
+                /* Waiting for the resolver, the connection attempt is
+                 * retried on RD_KAFKA_OP_RESOLVE. */
+                return 0;
+        }
+
+        rd_atomic32_add(&rkb->rkb_c.connects, 1);
+
+        rd_kafka_broker_lock(rkb);
+        rkb->rkb_connect_epoch = nodename_epoch;
+        rd_kafka_broker_set_state(rkb, RD_KAFKA_BROKER_STATE_CONNECT);
+        rd_kafka_broker_unlock(rkb);
+
         rd_kafka_broker_update_reconnect_backoff(rkb, &rkb->rkb_rk->rk_conf,
                                                  rd_clock());
 
-        if (rd_kafka_broker_resolve(rkb, nodename) == -1)
+        if (r == -1) {
+                rd_kafka_broker_fail(rkb, LOG_ERR, RD_KAFKA_RESP_ERR__RESOLVE,
+                                     /* Avoid duplicate log messages */
+                                     rkb->rkb_err.err == errno ?
+                                     NULL :
+                                     "Failed to resolve '%s': %s",
+                                     nodename, errstr);
                 return -1;
+        }
 
 	sinx = rd_sockaddr_list_next(rkb->rkb_rsal);
 
@@ -2219,6 +2430,7 @@ int rd_kafka_send (rd_kafka_broker_t *rkb) {
 		ssize_t r;
                 size_t pre_of = rd_slice_offset(&rkbuf->rkbuf_reader);
                 rd_ts_t now;
+                struct rd_kafka_broker_req_avg_s *ra;
 
                 /* Check for broker support */
                 if (unlikely(!rd_kafka_broker_request_supported(rkb, rkbuf))) {
@@ -2316,9 +2528,19 @@ int rd_kafka_send (rd_kafka_broker_t *rkb) {
 		/* Store time for RTT calculation */
 		rkbuf->rkbuf_ts_sent = now;
 
-                /* Add to outbuf_latency averager */
+                /* Add to outbuf_latency averagers */
                 rd_avg_add(&rkb->rkb_avg_outbuf_latency,
                            rkbuf->rkbuf_ts_sent - rkbuf->rkbuf_ts_enq);
+                if ((ra = rd_kafka_broker_req_avg(
+                             rkb, rkbuf->rkbuf_reqhdr.ApiKey)))
+                        rd_avg_add(&ra->outbuf_latency,
+                                   rkbuf->rkbuf_ts_sent -
+                                   rkbuf->rkbuf_ts_enq);
+
+                if (rkbuf->rkbuf_reqhdr.ApiKey == RD_KAFKAP_Produce)
+                        rd_kafka_msgbatch_stage(
+                                &rkbuf->rkbuf_batch, rkb,
+                                RD_KAFKA_STATS_PRODUCE_STAGE_SEND);
 
                 if (rkbuf->rkbuf_flags & RD_KAFKA_OP_F_BLOCKING &&
 		    rd_atomic32_add(&rkb->rkb_blocking_request_cnt, 1) == 1)
@@ -2421,10 +2643,15 @@ static void rd_kafka_broker_retry_bufs_move (rd_kafka_broker_t *rkb) {
  *
  * To avoid extra iterations, the \p err and \p status are set on
  * the message as they are popped off the OP_DR msgq in rd_kafka_poll() et.al
+ *
+ * @param batch is the ProduceRequest batch the messages were delivered in,
+ *              if any, which the DR and TOTAL produce stages are
+ *              sampled for when the op is served, see rd_kafka_dr_served().
  */
-void rd_kafka_dr_msgq (rd_kafka_itopic_t *rkt,
-		       rd_kafka_msgq_t *rkmq,
-                       rd_kafka_resp_err_t err) {
+void rd_kafka_dr_msgq0 (rd_kafka_itopic_t *rkt,
+                        rd_kafka_msgq_t *rkmq,
+                        rd_kafka_resp_err_t err,
+                        const rd_kafka_msgbatch_t *batch) {
         rd_kafka_t *rk = rkt->rkt_rk;
 
 	if (unlikely(rd_kafka_msgq_len(rkmq) == 0))
@@ -2443,6 +2670,12 @@ void rd_kafka_dr_msgq (rd_kafka_itopic_t *rkt,
 		rko->rko_u.dr.s_rkt = rd_kafka_topic_keep(rkt);
 		rd_kafka_msgq_init(&rko->rko_u.dr.msgq);
 
+                if (batch && batch->ts_enq) {
+                        rko->rko_u.dr.ts_batch_enq = batch->ts_enq;
+                        rko->rko_u.dr.ts_enq = batch->ts_stage[
+                                RD_KAFKA_STATS_PRODUCE_STAGE_RESPONSE];
+                }
+
 		/* Move all messages to op's msgq */
 		rd_kafka_msgq_move(&rko->rko_u.dr.msgq, rkmq);
 
@@ -2457,6 +2690,37 @@ void rd_kafka_dr_msgq (rd_kafka_itopic_t *rkt,
 }
 
 
+/**
+ * @brief Sample the DR and TOTAL produce stages of a delivery report op
+ *        as it is served to the application.
+ *
+ * The broker is not involved after the delivery report is enqueued,
+ * these stages are only sampled to the topic.
+ *
+ * @locality application thread
+ */
+void rd_kafka_dr_served (rd_kafka_op_t *rko) {
+        rd_kafka_itopic_t *rkt;
+        rd_ts_t now;
+
+        if (likely(!rko->rko_u.dr.ts_enq))
+                return;
+
+        rkt = rd_kafka_topic_s2i(rko->rko_u.dr.s_rkt);
+        now = rd_clock();
+
+        rd_avg_add(&rkt->rkt_avg_produce_latency[
+                           RD_KAFKA_STATS_PRODUCE_STAGE_DR],
+                   now - rko->rko_u.dr.ts_enq);
+        rd_avg_add(&rkt->rkt_avg_produce_latency[
+                           RD_KAFKA_STATS_PRODUCE_STAGE_TOTAL],
+                   now - rko->rko_u.dr.ts_batch_enq);
+
+        /* Only sample once, the op may be re-enqueued on yield. */
+        rko->rko_u.dr.ts_enq = 0;
+}
+
+
 /**
  * @brief Trigger delivery reports for implicitly acked messages.
  *
@@ -2485,17 +2749,17 @@ void rd_kafka_dr_implicit_ack (rd_kafka_broker_t *rkb,
         if (!rd_kafka_msgq_len(&acked))
                 return;
 
-        rd_rkb_dbg(rkb, MSG|RD_KAFKA_DBG_EOS, "IMPLICITACK",
-                           "%.*s [%"PRId32"] %d message(s) implicitly acked "
-                           "by subsequent batch success "
-                           "(msgids %"PRIu64"..%"PRIu64", "
-                           "last acked %"PRIu64")",
-                           RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
-                           rktp->rktp_partition,
-                           rd_kafka_msgq_len(&acked),
-                           rd_kafka_msgq_first(&acked)->rkm_u.producer.msgid,
-                           rd_kafka_msgq_last(&acked)->rkm_u.producer.msgid,
-                           last_msgid);
+        rd_rkb_dbg_rktp(rkb, rktp, MSG|RD_KAFKA_DBG_EOS, "IMPLICITACK",
+                        "%.*s [%"PRId32"] %d message(s) implicitly acked "
+                        "by subsequent batch success "
+                        "(msgids %"PRIu64"..%"PRIu64", "
+                        "last acked %"PRIu64")",
+                        RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
+                        rktp->rktp_partition,
+                        rd_kafka_msgq_len(&acked),
+                        rd_kafka_msgq_first(&acked)->rkm_u.producer.msgid,
+                        rd_kafka_msgq_last(&acked)->rkm_u.producer.msgid,
+                        last_msgid);
 
         /* Trigger delivery reports */
         rd_kafka_dr_msgq(rktp->rktp_rkt, &acked, RD_KAFKA_RESP_ERR_NO_ERROR);
@@ -2570,10 +2834,15 @@ static int rd_kafka_broker_cmp_by_id (const void *_a, const void *_b) {
  */
 static void rd_kafka_broker_set_logname (rd_kafka_broker_t *rkb,
                                          const char *logname) {
+        const rd_kafka_conf_t *conf = &rkb->rkb_rk->rk_conf;
+
         mtx_lock(&rkb->rkb_logname_lock);
         if (rkb->rkb_logname)
                 rd_free(rkb->rkb_logname);
         rkb->rkb_logname = rd_strdup(logname);
+        rkb->rkb_dbg_filtered =
+                conf->debug_broker_include &&
+                !rd_kafka_pattern_match(conf->debug_broker_include, logname);
         mtx_unlock(&rkb->rkb_logname_lock);
 }
 
@@ -2660,11 +2929,25 @@ static int rd_kafka_broker_op_serve (rd_kafka_broker_t *rkb,
                 rd_kafka_broker_unlock(rkb);
                 rd_kafka_wrunlock(rkb->rkb_rk);
 
-                if (updated & _UPD_NAME)
+                if (updated & _UPD_NAME) {
+                        rd_kafka_broker_t **stripes;
+                        int i, stripe_cnt;
+
                         rd_kafka_broker_fail(rkb, LOG_NOTICE,
                                              RD_KAFKA_RESP_ERR__NODE_UPDATE,
                                              "Broker hostname updated");
-                else if (updated & _UPD_ID) {
+
+                        /* The data connections follow the new address.
+                         * The stripes array is only released by this
+                         * thread. */
+                        rd_kafka_broker_lock(rkb);
+                        stripes = rkb->rkb_stripes.rkbs;
+                        stripe_cnt = rkb->rkb_stripes.cnt;
+                        rd_kafka_broker_unlock(rkb);
+                        for (i = 0 ; i < stripe_cnt ; i++)
+                                rd_kafka_broker_set_nodename(stripes[i], rkb);
+
+                } else if (updated & _UPD_ID) {
                         /* Map existing partitions to this broker. */
                         rd_kafka_broker_map_partitions(rkb);
 
@@ -2914,6 +3197,16 @@ static int rd_kafka_broker_op_serve (rd_kafka_broker_t *rkb,
         case RD_KAFKA_OP_WAKEUP:
                 break;
 
+        case RD_KAFKA_OP_RESOLVE:
+                rd_avg_add(&rkb->rkb_avg_resolve_latency,
+                           rko->rko_u.resolve.latency);
+
+                /* Return from the serve loop to retry the connection
+                 * attempt that is waiting for the resolver. */
+                if (rkb->rkb_resolve.ts_req)
+                        rkb->rkb_reactor.yield = rd_true;
+                break;
+
         case RD_KAFKA_OP_PURGE:
                 rd_kafka_broker_handle_purge_queues(rkb, rko);
                 rko = NULL; /* the rko is reused for the reply */
@@ -3000,6 +3293,7 @@ static void rd_kafka_broker_ops_io_serve (rd_kafka_broker_t *rkb,
                                           rd_ts_t abs_timeout) {
         rd_ts_t now;
         rd_ts_t remains_us;
+        rd_ts_t wakeup_us = 0;
         int remains_ms;
 
         if (unlikely(rd_kafka_terminating(rkb->rkb_rk)))
@@ -3017,7 +3311,23 @@ static void rd_kafka_broker_ops_io_serve (rd_kafka_broker_t *rkb,
                 remains_ms = (int)((remains_us + 999) / 1000);
 
 
-        if (likely(rkb->rkb_transport != NULL)) {
+        if (rkb->rkb_reactor.rkrc) {
+                /* Served by a reactor thread: don't block but serve
+                 * the IO events collected by the reactor and hand the
+                 * wakeup time back to it. */
+                wakeup_us = (rd_ts_t)remains_ms * 1000;
+
+                if (rkb->rkb_transport && rkb->rkb_reactor.sock.revents) {
+                        rd_kafka_transport_io_events(
+                                rkb->rkb_transport,
+                                rkb->rkb_reactor.sock.revents);
+                        wakeup_us = 0;
+                }
+                rkb->rkb_reactor.sock.revents = 0;
+
+                remains_ms = RD_POLL_NOWAIT;
+
+        } else if (likely(rkb->rkb_transport != NULL)) {
                 /* Serve IO events */
                 rd_kafka_transport_io_serve(rkb->rkb_transport, remains_ms);
 
@@ -3026,7 +3336,8 @@ static void rd_kafka_broker_ops_io_serve (rd_kafka_broker_t *rkb,
 
 
         /* Serve broker ops */
-        rd_kafka_broker_ops_serve(rkb, remains_ms);
+        if (rd_kafka_broker_ops_serve(rkb, remains_ms) > 0)
+                wakeup_us = 0;
 
 
         /* An op might have triggered the need for a connection, if so
@@ -3043,6 +3354,14 @@ static void rd_kafka_broker_ops_io_serve (rd_kafka_broker_t *rkb,
         now = rd_clock();
         if (rd_interval(&rkb->rkb_timeout_scan_intvl, 1000000, now) > 0)
                 rd_kafka_broker_timeout_scan(rkb, now);
+
+        if (rkb->rkb_reactor.rkrc) {
+                /* Like the blocking poll above the reactor returns
+                 * right away if there were IO events or ops to serve,
+                 * so that the serve loop may act on them. */
+                rkb->rkb_reactor.ts_wakeup = now + wakeup_us;
+                rkb->rkb_reactor.yield = rd_true;
+        }
 }
 
 
@@ -3120,11 +3439,12 @@ static int rd_kafka_broker_toppar_msgq_scan (rd_kafka_broker_t *rkb,
         first = rd_kafka_msgq_first(&xtimedout)->rkm_u.producer.msgid;
         last = rd_kafka_msgq_last(&xtimedout)->rkm_u.producer.msgid;
 
-        rd_rkb_dbg(rkb, MSG, "TIMEOUT",
-                   "%s [%"PRId32"]: timed out %d+%d message(s) "
-                   "(MsgId %"PRIu64"..%"PRIu64"): message.timeout.ms exceeded",
-                   rktp->rktp_rkt->rkt_topic->str, rktp->rktp_partition,
-                   xcnt, qcnt, first, last);
+        rd_rkb_dbg_rktp(rkb, rktp, MSG, "TIMEOUT",
+                        "%s [%"PRId32"]: timed out %d+%d message(s) "
+                        "(MsgId %"PRIu64"..%"PRIu64"): message.timeout.ms "
+                        "exceeded",
+                        rktp->rktp_rkt->rkt_topic->str, rktp->rktp_partition,
+                        xcnt, qcnt, first, last);
 
         /* Trigger delivery report for timed out messages */
         rd_kafka_dr_msgq(rktp->rktp_rkt, &xtimedout,
@@ -3490,6 +3810,7 @@ static void rd_kafka_broker_producer_serve (rd_kafka_broker_t *rkb,
 
         while (!rd_kafka_broker_terminating(rkb) &&
                rkb->rkb_state == initial_state &&
+               !rkb->rkb_reactor.yield &&
                (abs_timeout > (now = rd_clock()))) {
                 int do_timeout_scan;
                 rd_ts_t next_wakeup = abs_timeout;
@@ -3524,6 +3845,99 @@ static void rd_kafka_broker_producer_serve (rd_kafka_broker_t *rkb,
 
 
 
+/**
+ * @brief Smallest per-partition MaxBytes chosen by the prefetch budget
+ *        and adaptive fetch sizing.
+ */
+#define RD_KAFKA_FETCH_MIN_MAX_BYTES 1024
+
+
+/**
+ * @returns the partition's MaxBytes for the next Fetch prior to
+ *          fetch.max.bytes scaling and prefetch budget limiting.
+ *
+ * With fetch.adaptive.sizing this is the adaptive size, but at least the
+ * number of bytes the application consumes per fetch.wait.max.ms.
+ *
+ * @locality broker thread
+ */
+static int32_t rd_kafka_toppar_fetch_max_bytes (rd_kafka_toppar_t *rktp) {
+        const rd_kafka_conf_t *conf = &rktp->rktp_rkt->rkt_rk->rk_conf;
+        int64_t max_bytes, min_bytes;
+
+        if (!conf->fetch_adaptive_sizing)
+                return rktp->rktp_fetch_msg_max_bytes;
+
+        max_bytes = rktp->rktp_prefetch.adaptive_max_bytes;
+        min_bytes = (rktp->rktp_prefetch.rate * conf->fetch_wait_max_ms) /
+                1000;
+        if (max_bytes < min_bytes)
+                max_bytes = min_bytes;
+        if (max_bytes > rktp->rktp_fetch_msg_max_bytes)
+                max_bytes = rktp->rktp_fetch_msg_max_bytes;
+
+        return (int32_t)max_bytes;
+}
+
+
+/**
+ * @brief Adapt the partition's fetch size to the amount of data returned
+ *        by the last Fetch, see fetch.adaptive.sizing.
+ *
+ * A partition that filled at least 3/4 of its requested MaxBytes is
+ * lagging and has its size doubled, unless its fetch queue is already
+ * half way to the queued.* limits, while a partition that returned less
+ * than 1/4 is idle and has its size halved.
+ *
+ * @locality broker thread
+ */
+static void rd_kafka_toppar_fetch_adapt (rd_kafka_toppar_t *rktp,
+                                         int32_t MessageSetSize) {
+        const rd_kafka_conf_t *conf = &rktp->rktp_rkt->rkt_rk->rk_conf;
+        int64_t req = rktp->rktp_prefetch.req_max_bytes;
+        int64_t size = rktp->rktp_prefetch.adaptive_max_bytes;
+
+        if (!conf->fetch_adaptive_sizing)
+                return;
+
+        if ((int64_t)MessageSetSize * 4 >= req * 3) {
+                if (rd_kafka_q_len(rktp->rktp_fetchq) * 2 <
+                    conf->queued_min_msgs &&
+                    (int64_t)rd_kafka_q_size(rktp->rktp_fetchq) * 2 <
+                    conf->queued_max_msg_bytes)
+                        size *= 2;
+
+        } else if ((int64_t)MessageSetSize * 4 < req) {
+                size /= 2;
+        }
+
+        if (size > rktp->rktp_fetch_msg_max_bytes)
+                size = rktp->rktp_fetch_msg_max_bytes;
+        if (size < RD_KAFKA_FETCH_MIN_MAX_BYTES)
+                size = RD_KAFKA_FETCH_MIN_MAX_BYTES;
+
+        rktp->rktp_prefetch.adaptive_max_bytes = (int32_t)size;
+}
+
+
+/**
+ * @brief Charge a fetch.scheduler=drr partition's credit for the data
+ *        returned by the last Fetch.
+ *
+ * @locality broker thread
+ */
+static void rd_kafka_toppar_fetch_sched_charge (rd_kafka_toppar_t *rktp,
+                                                int32_t MessageSetSize) {
+        if (rktp->rktp_rkt->rkt_rk->rk_conf.fetch_scheduler !=
+            RD_KAFKA_FETCH_SCHED_DRR)
+                return;
+
+        rktp->rktp_prefetch.deficit -= MessageSetSize;
+        if (rktp->rktp_prefetch.deficit < 0)
+                rktp->rktp_prefetch.deficit = 0;
+}
+
+
 /**
  * Backoff the next Fetch request (due to error).
  */
@@ -3549,10 +3963,10 @@ static void rd_kafka_toppar_fetch_backoff (rd_kafka_broker_t *rkb,
                 return;
 
         rktp->rktp_ts_fetch_backoff = rd_clock() + (backoff_ms * 1000);
-        rd_rkb_dbg(rkb, FETCH, "BACKOFF",
-                   "%s [%"PRId32"]: Fetch backoff for %dms: %s",
-                   rktp->rktp_rkt->rkt_topic->str, rktp->rktp_partition,
-                   backoff_ms, rd_kafka_err2str(err));
+        rd_rkb_dbg_rktp(rkb, rktp, FETCH, "BACKOFF",
+                        "%s [%"PRId32"]: Fetch backoff for %dms: %s",
+                        rktp->rktp_rkt->rkt_topic->str, rktp->rktp_partition,
+                        backoff_ms, rd_kafka_err2str(err));
 }
 
 
@@ -3664,12 +4078,12 @@ rd_kafka_fetch_reply_handle (rd_kafka_broker_t *rkb,
                          * during the lifetime of the request. */
                         if (unlikely(rktp->rktp_leader != rkb)) {
                                 rd_kafka_toppar_unlock(rktp);
-                                rd_rkb_dbg(rkb, MSG, "FETCH",
-                                           "%.*s [%"PRId32"]: "
-                                           "partition leadership changed: "
-                                           "discarding fetch response",
-                                           RD_KAFKAP_STR_PR(&topic),
-                                           hdr.Partition);
+                                rd_rkb_dbg_rktp(rkb, rktp, MSG, "FETCH",
+                                                "%.*s [%"PRId32"]: "
+                                                "partition leadership changed: "
+                                                "discarding fetch response",
+                                                RD_KAFKAP_STR_PR(&topic),
+                                                hdr.Partition);
                                 rd_kafka_toppar_destroy(s_rktp); /* from get */
                                 rd_kafka_buf_skip(rkbuf, hdr.MessageSetSize);
                                 continue;
@@ -3689,29 +4103,30 @@ rd_kafka_fetch_reply_handle (rd_kafka_broker_t *rkb,
 			rd_kafka_assert(NULL, tver);
                         if (rd_kafka_toppar_s2i(tver->s_rktp) != rktp ||
                             tver->version < fetch_version) {
-                                rd_rkb_dbg(rkb, MSG, "DROP",
-                                           "%s [%"PRId32"]: "
-                                           "dropping outdated fetch response "
-                                           "(v%d < %d or old rktp)",
-                                           rktp->rktp_rkt->rkt_topic->str,
-                                           rktp->rktp_partition,
-                                           tver->version, fetch_version);
+                                rd_rkb_dbg_rktp(rkb, rktp, MSG, "DROP",
+                                                "%s [%"PRId32"]: "
+                                                "dropping outdated fetch "
+                                                "response (v%d < %d or "
+                                                "old rktp)",
+                                                rktp->rktp_rkt->rkt_topic->str,
+                                                rktp->rktp_partition,
+                                                tver->version, fetch_version);
                                 rd_atomic64_add(&rktp->rktp_c. rx_ver_drops, 1);
                                 rd_kafka_toppar_destroy(s_rktp); /* from get */
                                 rd_kafka_buf_skip(rkbuf, hdr.MessageSetSize);
                                 continue;
                         }
 
-			rd_rkb_dbg(rkb, MSG, "FETCH",
-				   "Topic %.*s [%"PRId32"] MessageSet "
-				   "size %"PRId32", error \"%s\", "
-				   "MaxOffset %"PRId64", "
-                                   "Ver %"PRId32"/%"PRId32,
-				   RD_KAFKAP_STR_PR(&topic), hdr.Partition,
-				   hdr.MessageSetSize,
-				   rd_kafka_err2str(hdr.ErrorCode),
-				   hdr.HighwaterMarkOffset,
-                                   tver->version, fetch_version);
+			rd_rkb_dbg_rktp(rkb, rktp, MSG, "FETCH",
+                                        "Topic %.*s [%"PRId32"] MessageSet "
+                                        "size %"PRId32", error \"%s\", "
+                                        "MaxOffset %"PRId64", "
+                                        "Ver %"PRId32"/%"PRId32,
+                                        RD_KAFKAP_STR_PR(&topic), hdr.Partition,
+                                        hdr.MessageSetSize,
+                                        rd_kafka_err2str(hdr.ErrorCode),
+                                        hdr.HighwaterMarkOffset,
+                                        tver->version, fetch_version);
 
 
                         /* Update hi offset to be able to compute
@@ -3726,6 +4141,10 @@ rd_kafka_fetch_reply_handle (rd_kafka_broker_t *rkb,
 			rktp->rktp_hi_offset = hdr.HighwaterMarkOffset;
 			rd_kafka_toppar_unlock(rktp);
 
+                        rd_kafka_toppar_fetch_adapt(rktp, hdr.MessageSetSize);
+                        rd_kafka_toppar_fetch_sched_charge(rktp,
+                                                           hdr.MessageSetSize);
+
 			/* If this is the last message of the queue,
 			 * signal EOF back to the application. */
 			if (hdr.HighwaterMarkOffset ==
@@ -3918,23 +4337,208 @@ static void rd_kafka_broker_fetch_reply (rd_kafka_t *rk,
 
 
 /**
- * Build and send a Fetch request message for all underflowed toppars
- * for a specific broker.
+ * @brief Update the consumption rate, estimated lag and prefetch budget
+ *        weight of all active toppars.
+ *
+ * A partition's share of the remaining queued.max.total.kbytes budget
+ * is proportional to its recent consumption rate plus its estimated lag
+ * in bytes (capped at the partition's max fetch size), so that hot and
+ * lagging partitions get large fetches while idle partitions that are
+ * caught up get minimal ones.
+ *
+ * @param size_sump is set to the sum of all partitions'
+ *        rd_kafka_toppar_fetch_max_bytes().
+ *
+ * @returns the sum of all weights.
+ * @locality broker thread
  */
-static int rd_kafka_broker_fetch_toppars (rd_kafka_broker_t *rkb, rd_ts_t now) {
-	rd_kafka_toppar_t *rktp;
-	rd_kafka_buf_t *rkbuf;
-	int cnt = 0;
-	size_t of_TopicArrayCnt = 0;
-	int TopicArrayCnt = 0;
-	size_t of_PartitionArrayCnt = 0;
-	int PartitionArrayCnt = 0;
-	rd_kafka_itopic_t *rkt_last = NULL;
+static int64_t rd_kafka_broker_fetch_toppars_weigh (rd_kafka_broker_t *rkb,
+                                                    rd_ts_t now,
+                                                    int64_t *size_sump) {
+        rd_kafka_toppar_t *rktp;
+        int64_t sum = 0;
+
+        *size_sump = 0;
+
+        CIRCLEQ_FOREACH(rktp, &rkb->rkb_active_toppars, rktp_activelink) {
+                int64_t app_bytes =
+                        rd_atomic64_get(&rktp->rktp_prefetch.app_bytes);
+                rd_ts_t elapsed = now - rktp->rktp_prefetch.ts_rate;
+                int64_t lag, lag_bytes = 0;
+
+                if (elapsed >= 1000000) {
+                        int64_t rate = ((app_bytes -
+                                         rktp->rktp_prefetch.last_app_bytes) *
+                                        1000000) / elapsed;
+                        rktp->rktp_prefetch.rate =
+                                (rktp->rktp_prefetch.rate + rate) / 2;
+                        rktp->rktp_prefetch.last_app_bytes = app_bytes;
+                        rktp->rktp_prefetch.ts_rate = now;
+                }
 
-	/* Create buffer and segments:
-	 *   1 x ReplicaId MaxWaitTime MinBytes TopicArrayCnt
-	 *   N x topic name
-	 *   N x PartitionArrayCnt Partition FetchOffset MaxBytes
+                rd_kafka_toppar_lock(rktp);
+                if (rktp->rktp_hi_offset == RD_KAFKA_OFFSET_INVALID)
+                        lag = -1; /* Unknown */
+                else
+                        lag = rktp->rktp_hi_offset -
+                                rktp->rktp_offsets.fetch_offset;
+                rd_kafka_toppar_unlock(rktp);
+
+                if (lag == -1) {
+                        /* Unknown lag: assume a full fetch's worth */
+                        lag_bytes = rktp->rktp_fetch_msg_max_bytes;
+                } else if (lag > 0) {
+                        int64_t rx_msgs =
+                                rd_atomic64_get(&rktp->rktp_c.rx_msgs);
+
+                        if (rx_msgs > 0) {
+                                double est = (double)lag *
+                                        ((double)rd_atomic64_get(
+                                                &rktp->rktp_c.rx_msg_bytes) /
+                                         (double)rx_msgs);
+                                lag_bytes = est > (double)(INT64_MAX/2) ?
+                                        INT64_MAX/2 : (int64_t)est;
+                                if (lag_bytes == 0)
+                                        lag_bytes = lag;
+                        } else
+                                lag_bytes = RD_MAX(lag,
+                                                   rktp->
+                                                   rktp_fetch_msg_max_bytes);
+                }
+
+                rktp->rktp_prefetch.lag_bytes = lag_bytes;
+                rktp->rktp_prefetch.weight =
+                        rktp->rktp_prefetch.rate +
+                        RD_MIN(lag_bytes, rktp->rktp_fetch_msg_max_bytes) + 1;
+                sum += rktp->rktp_prefetch.weight;
+                *size_sump += rd_kafka_toppar_fetch_max_bytes(rktp);
+        }
+
+        return sum;
+}
+
+
+/**
+ * @brief Partitions that are caught up are left out of lag and drr
+ *        scheduled Fetch requests for at most this long (microseconds)
+ *        while other partitions are lagging.
+ */
+#define RD_KAFKA_FETCH_SCHED_IDLE_MAX (1000*1000)
+
+/**
+ * @brief fetch.scheduler entry
+ */
+struct rd_kafka_fetch_sched {
+        rd_kafka_toppar_t *rktp;
+        int64_t prio;   /**< Higher is fetched first */
+        int     idx;    /**< Round-robin position, tie-breaker */
+};
+
+static int rd_kafka_fetch_sched_cmp (const void *_a, const void *_b) {
+        const struct rd_kafka_fetch_sched *a = _a, *b = _b;
+
+        if (a->prio != b->prio)
+                return a->prio > b->prio ? -1 : 1;
+        return a->idx - b->idx;
+}
+
+
+/**
+ * @brief Order the active toppars for the next Fetch request according
+ *        to fetch.scheduler=lag|drr, leaving out partitions that are
+ *        caught up if any other partition is lagging.
+ *
+ * Requires rd_kafka_broker_fetch_toppars_weigh() to have been called
+ * to update each partition's estimated lag.
+ *
+ * @returns a rd_malloc()ed array of \p *cntp entries, starting with the
+ *          highest priority partition.
+ * @locality broker thread
+ */
+static struct rd_kafka_fetch_sched *
+rd_kafka_broker_fetch_toppars_schedule (rd_kafka_broker_t *rkb, rd_ts_t now,
+                                        int *cntp) {
+        rd_kafka_fetch_sched_t policy = rkb->rkb_rk->rk_conf.fetch_scheduler;
+        struct rd_kafka_fetch_sched *sched;
+        rd_kafka_toppar_t *rktp;
+        rd_bool_t any_lag = rd_false;
+        int cnt = 0, idx = 0;
+
+        sched = rd_malloc(sizeof(*sched) * rkb->rkb_active_toppar_cnt);
+
+        CIRCLEQ_FOREACH(rktp, &rkb->rkb_active_toppars, rktp_activelink) {
+                if (rktp->rktp_prefetch.lag_bytes > 0) {
+                        any_lag = rd_true;
+                        break;
+                }
+        }
+
+        /* Start at the round-robin position to rotate partitions of
+         * equal priority. */
+        rktp = rkb->rkb_active_toppar_next;
+        do {
+                int64_t lag_bytes = rktp->rktp_prefetch.lag_bytes;
+                int64_t prio;
+
+                if (policy == RD_KAFKA_FETCH_SCHED_DRR) {
+                        int64_t quantum = rd_kafka_toppar_fetch_max_bytes(rktp);
+
+                        /* Partitions without backlog don't accumulate
+                         * credit. */
+                        if (lag_bytes == 0)
+                                rktp->rktp_prefetch.deficit = 0;
+                        else if (rktp->rktp_prefetch.deficit < quantum * 8)
+                                rktp->rktp_prefetch.deficit += quantum;
+
+                        prio = rktp->rktp_prefetch.deficit;
+                } else
+                        prio = lag_bytes;
+
+                idx++;
+
+                if (any_lag && lag_bytes == 0 &&
+                    now - rktp->rktp_prefetch.ts_fetch <
+                    RD_KAFKA_FETCH_SCHED_IDLE_MAX)
+                        continue; /* Caught up: don't take a slot */
+
+                sched[cnt].rktp = rktp;
+                sched[cnt].prio = prio;
+                sched[cnt].idx  = idx;
+                cnt++;
+
+        } while ((rktp = CIRCLEQ_LOOP_NEXT(&rkb->rkb_active_toppars,
+                                           rktp, rktp_activelink)) !=
+                 rkb->rkb_active_toppar_next);
+
+        qsort(sched, cnt, sizeof(*sched), rd_kafka_fetch_sched_cmp);
+
+        *cntp = cnt;
+        return sched;
+}
+
+
+/**
+ * Build and send a Fetch request message for all underflowed toppars
+ * for a specific broker.
+ */
+static int rd_kafka_broker_fetch_toppars (rd_kafka_broker_t *rkb, rd_ts_t now) {
+	rd_kafka_toppar_t *rktp;
+	rd_kafka_buf_t *rkbuf;
+	int cnt = 0;
+	size_t of_TopicArrayCnt = 0;
+	int TopicArrayCnt = 0;
+	size_t of_PartitionArrayCnt = 0;
+	int PartitionArrayCnt = 0;
+	rd_kafka_itopic_t *rkt_last = NULL;
+        rd_kafka_t *rk = rkb->rkb_rk;
+        int64_t budget = 0, weight_sum = 0, size_sum = 0, reserved = 0;
+        struct rd_kafka_fetch_sched *sched = NULL;
+        int sched_cnt = 0, sched_i = 0;
+
+	/* Create buffer and segments:
+	 *   1 x ReplicaId MaxWaitTime MinBytes TopicArrayCnt
+	 *   N x topic name
+	 *   N x PartitionArrayCnt Partition FetchOffset MaxBytes
 	 * where N = number of toppars.
 	 * Since we dont keep track of the number of topics served by
 	 * this broker, only the partition count, we do a worst-case calc
@@ -3944,6 +4548,36 @@ static int rd_kafka_broker_fetch_toppars (rd_kafka_broker_t *rkb, rd_ts_t now) {
         if (unlikely(rkb->rkb_active_toppar_cnt == 0))
                 return 0;
 
+        /* Client-wide prefetch budget, shared with other brokers'
+         * outstanding Fetch requests. */
+        if (rk->rk_conf.queued_max_total_bytes > 0) {
+                budget = rk->rk_conf.queued_max_total_bytes -
+                        rd_atomic64_get(&rk->rk_prefetch.queued_bytes) -
+                        rd_atomic64_get(&rk->rk_prefetch.inflight_bytes);
+
+                if (budget < RD_KAFKA_FETCH_MIN_MAX_BYTES) {
+                        rd_atomic64_add(&rk->rk_prefetch.exhausted_cnt, 1);
+                        rkb->rkb_ts_fetch_backoff = now +
+                                (rk->rk_conf.fetch_wait_max_ms * 1000);
+                        rd_rkb_dbg(rkb, FETCH, "FETCH",
+                                   "Not fetching %d toppar(s): "
+                                   "prefetch budget exhausted: backing off "
+                                   "for %dms",
+                                   rkb->rkb_active_toppar_cnt,
+                                   rk->rk_conf.fetch_wait_max_ms);
+                        return 0;
+                }
+        }
+
+        if (budget > 0 || rk->rk_conf.fetch_adaptive_sizing ||
+            rk->rk_conf.fetch_scheduler != RD_KAFKA_FETCH_SCHED_ROUNDROBIN)
+                weight_sum = rd_kafka_broker_fetch_toppars_weigh(rkb, now,
+                                                                 &size_sum);
+
+        if (rk->rk_conf.fetch_scheduler != RD_KAFKA_FETCH_SCHED_ROUNDROBIN)
+                sched = rd_kafka_broker_fetch_toppars_schedule(rkb, now,
+                                                               &sched_cnt);
+
 	rkbuf = rd_kafka_buf_new_request(
                 rkb, RD_KAFKAP_Fetch, 1,
                 /* ReplicaId+MaxWaitTime+MinBytes+TopicCnt */
@@ -3990,10 +4624,11 @@ static int rd_kafka_broker_fetch_toppars (rd_kafka_broker_t *rkb, rd_ts_t now) {
                                sizeof(struct rd_kafka_toppar_ver),
                                rkb->rkb_active_toppar_cnt, 0);
 
-	/* Round-robin start of the list. */
-        rktp = rkb->rkb_active_toppar_next;
+	/* Round-robin start of the list, or fetch.scheduler order. */
+        rktp = sched ? sched[0].rktp : rkb->rkb_active_toppar_next;
         do {
 		struct rd_kafka_toppar_ver *tver;
+                int32_t max_bytes = rd_kafka_toppar_fetch_max_bytes(rktp);
 
 		if (rkt_last != rktp->rktp_rkt) {
 			if (rkt_last != NULL) {
@@ -4018,28 +4653,68 @@ static int rd_kafka_broker_fetch_toppars (rd_kafka_broker_t *rkb, rd_ts_t now) {
 		rd_kafka_buf_write_i32(rkbuf, rktp->rktp_partition);
 		/* FetchOffset */
 		rd_kafka_buf_write_i64(rkbuf, rktp->rktp_offsets.fetch_offset);
-		/* MaxBytes */
-		rd_kafka_buf_write_i32(rkbuf, rktp->rktp_fetch_msg_max_bytes);
+		/* MaxBytes: adaptive sizes are scaled down to fit
+                 * fetch.max.bytes, and all sizes are limited by the
+                 * partition's prefetch budget share. */
+                if (rktp->rktp_prefetch.full_fetch) {
+                        max_bytes = rktp->rktp_fetch_msg_max_bytes;
 
-		rd_rkb_dbg(rkb, FETCH, "FETCH",
-			   "Fetch topic %.*s [%"PRId32"] at offset %"PRId64
-			   " (v%d)",
-			   RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
-			   rktp->rktp_partition,
-                           rktp->rktp_offsets.fetch_offset,
-			   rktp->rktp_fetch_version);
+                } else {
+                        if (rk->rk_conf.fetch_adaptive_sizing &&
+                            size_sum > rk->rk_conf.fetch_max_bytes) {
+                                max_bytes = (int32_t)
+                                        (((double)max_bytes *
+                                          (double)rk->rk_conf.
+                                          fetch_max_bytes) /
+                                         (double)size_sum);
+                                if (max_bytes < RD_KAFKA_FETCH_MIN_MAX_BYTES)
+                                        max_bytes =
+                                                RD_KAFKA_FETCH_MIN_MAX_BYTES;
+                        }
+
+                        if (budget > 0) {
+                                int64_t share = (int64_t)
+                                        (((double)budget *
+                                          (double)rktp->rktp_prefetch.weight) /
+                                         (double)weight_sum);
+                                if (share < RD_KAFKA_FETCH_MIN_MAX_BYTES)
+                                        share = RD_KAFKA_FETCH_MIN_MAX_BYTES;
+                                if (share < max_bytes)
+                                        max_bytes = (int32_t)share;
+                        }
+                }
+                rktp->rktp_prefetch.full_fetch = rd_false;
+                rktp->rktp_prefetch.req_max_bytes = max_bytes;
+                reserved += max_bytes;
+		rd_kafka_buf_write_i32(rkbuf, max_bytes);
+
+		rd_rkb_dbg_rktp(rkb, rktp, FETCH, "FETCH",
+                                "Fetch topic %.*s [%"PRId32"] at offset %"PRId64
+                                " (v%d)",
+                                RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
+                                rktp->rktp_partition,
+                                rktp->rktp_offsets.fetch_offset,
+                                rktp->rktp_fetch_version);
 
 		/* Add toppar + op version mapping. */
 		tver = rd_list_add(rkbuf->rkbuf_rktp_vers, NULL);
 		tver->s_rktp = rd_kafka_toppar_keep(rktp);
 		tver->version = rktp->rktp_fetch_version;
 
+                rktp->rktp_prefetch.ts_fetch = now;
+
 		cnt++;
-	} while ((rktp = CIRCLEQ_LOOP_NEXT(&rkb->rkb_active_toppars,
-                                           rktp, rktp_activelink)) !=
-                 rkb->rkb_active_toppar_next);
+	} while (sched ?
+                 (++sched_i < sched_cnt &&
+                  (rktp = sched[sched_i].rktp)) :
+                 ((rktp = CIRCLEQ_LOOP_NEXT(&rkb->rkb_active_toppars,
+                                            rktp, rktp_activelink)) !=
+                  rkb->rkb_active_toppar_next));
+
+        RD_IF_FREE(sched, rd_free);
 
         /* Update next toppar to fetch in round-robin list. */
+        rktp = rkb->rkb_active_toppar_next;
         rd_kafka_broker_active_toppar_next(
                 rkb,
                 rktp ?
@@ -4063,6 +4738,14 @@ static int rd_kafka_broker_fetch_toppars (rd_kafka_broker_t *rkb, rd_ts_t now) {
 	/* Update TopicArrayCnt */
 	rd_kafka_buf_update_i32(rkbuf, of_TopicArrayCnt, TopicArrayCnt);
 
+        /* Reserve the request's maximum response size from the prefetch
+         * budget until the request is destroyed. */
+        if (rd_kafka_buf_ApiVersion(rkbuf) == 4 &&
+            reserved > rk->rk_conf.fetch_max_bytes)
+                reserved = rk->rk_conf.fetch_max_bytes;
+        rkbuf->rkbuf_u.Fetch.reserved = reserved;
+        rd_atomic64_add(&rk->rk_prefetch.inflight_bytes, reserved);
+
         /* Consider Fetch requests blocking if fetch.wait.max.ms >= 1s */
         if (rkb->rkb_rk->rk_conf.fetch_wait_max_ms >= 1000)
                 rkbuf->rkbuf_flags |= RD_KAFKA_OP_F_BLOCKING;
@@ -4099,6 +4782,7 @@ static void rd_kafka_broker_consumer_serve (rd_kafka_broker_t *rkb,
 
         while (!rd_kafka_broker_terminating(rkb) &&
                rkb->rkb_state == initial_state &&
+               !rkb->rkb_reactor.yield &&
                abs_timeout > (now = rd_clock())) {
                 rd_ts_t min_backoff;
 
@@ -4124,7 +4808,14 @@ static void rd_kafka_broker_consumer_serve (rd_kafka_broker_t *rkb,
                     rkb->rkb_state == RD_KAFKA_BROKER_STATE_UP) {
                         if (min_backoff < now) {
                                 rd_kafka_broker_fetch_toppars(rkb, now);
-                                min_backoff = abs_timeout;
+                                /* Wake up early to retry a Fetch
+                                 * held back by the prefetch budget. */
+                                if (!rkb->rkb_fetching &&
+                                    rkb->rkb_ts_fetch_backoff > now)
+                                        min_backoff =
+                                                rkb->rkb_ts_fetch_backoff;
+                                else
+                                        min_backoff = abs_timeout;
                         } else if (min_backoff < RD_TS_MAX)
                                 rd_rkb_dbg(rkb, FETCH, "FETCH",
                                            "Fetch backoff for %"PRId64
@@ -4216,6 +4907,14 @@ static void rd_kafka_broker_consumer_serve (rd_kafka_broker_t *rkb,
  * such as when a partition is being produced to.
  *
  *
+ * Reactor
+ * =======
+ * When the broker is served by a shared reactor thread (rkb_reactor)
+ * the Ops/IO poll does not block but records the wakeup time and
+ * makes the producer/consumer loops return after a single iteration,
+ * the reactor then waits for IO, ops queue wakeups or the wakeup time
+ * across all of its brokers before calling into the state machine again.
+ *
  * @param timeout_ms The maximum timeout for blocking Ops/IO.
  *
  * @locality broker thread
@@ -4240,6 +4939,8 @@ static void rd_kafka_broker_serve (rd_kafka_broker_t *rkb, int timeout_ms) {
          * to be up. */
         rkb->rkb_persistconn.internal = 0;
 
+        rkb->rkb_reactor.yield = rd_false;
+
         if (rkb->rkb_source == RD_KAFKA_INTERNAL)
                 rd_kafka_broker_internal_serve(rkb, abs_timeout);
         else if (rkb->rkb_rk->rk_type == RD_KAFKA_PRODUCER)
@@ -4252,13 +4953,13 @@ static void rd_kafka_broker_serve (rd_kafka_broker_t *rkb, int timeout_ms) {
 
 
 
-static int rd_kafka_broker_thread_main (void *arg) {
-	rd_kafka_broker_t *rkb = arg;
-
-        rd_kafka_set_thread_name("%s", rkb->rkb_name);
-        rd_kafka_set_thread_sysname("rdk:broker%"PRId32, rkb->rkb_nodeid);
-
-	(void)rd_atomic32_add(&rd_kafka_thread_cnt_curr, 1);
+/**
+ * @brief Broker thread start-up, called from the broker's thread
+ *        (or reactor thread) prior to serving the broker.
+ *
+ * @locality broker thread
+ */
+void rd_kafka_broker_thread_init (rd_kafka_broker_t *rkb) {
 
         /* Our own refcount was increased just prior to thread creation,
          * when refcount drops to 1 it is just us left and the broker
@@ -4270,179 +4971,219 @@ static int rd_kafka_broker_thread_main (void *arg) {
 	rd_kafka_broker_unlock(rkb);
 
 	rd_rkb_dbg(rkb, BROKER, "BRKMAIN", "Enter main broker thread");
+}
 
-	while (!rd_kafka_broker_terminating(rkb)) {
-                int backoff;
-                int r;
 
-        redo:
-                switch (rkb->rkb_state)
-                {
-                case RD_KAFKA_BROKER_STATE_INIT:
-                        /* Check if there is demand for a connection
-                         * to this broker, if so jump to TRY_CONNECT state. */
-                        if (!rd_kafka_broker_needs_connection(rkb)) {
-                                rd_kafka_broker_serve(rkb,
-                                                      rd_kafka_max_block_ms);
-                                break;
-                        }
+/**
+ * @brief Run one iteration of the broker state machine.
+ *
+ * Blocks in rd_kafka_broker_serve() for up to rd_kafka_max_block_ms,
+ * unless served by a reactor in which case it returns without blocking.
+ *
+ * @locality broker thread
+ */
+void rd_kafka_broker_thread_serve (rd_kafka_broker_t *rkb) {
+        int backoff;
+        int r;
 
-                        /* The INIT state also exists so that an initial
-                         * connection failure triggers a state transition
-                         * which might trigger a ALL_BROKERS_DOWN error. */
-                        rd_kafka_broker_lock(rkb);
+ redo:
+        switch (rkb->rkb_state)
+        {
+        case RD_KAFKA_BROKER_STATE_INIT:
+                /* Check if there is demand for a connection
+                 * to this broker, if so jump to TRY_CONNECT state. */
+                if (!rd_kafka_broker_needs_connection(rkb)) {
+                        rd_kafka_broker_serve(rkb,
+                                              rd_kafka_max_block_ms);
+                        break;
+                }
+
+                /* The INIT state also exists so that an initial
+                 * connection failure triggers a state transition
+                 * which might trigger a ALL_BROKERS_DOWN error. */
+                rd_kafka_broker_lock(rkb);
+                rd_kafka_broker_set_state(
+                        rkb, RD_KAFKA_BROKER_STATE_TRY_CONNECT);
+                rd_kafka_broker_unlock(rkb);
+                goto redo; /* effectively a fallthru to TRY_CONNECT */
+
+        case RD_KAFKA_BROKER_STATE_DOWN:
+                rd_kafka_broker_lock(rkb);
+                if (rkb->rkb_rk->rk_conf.sparse_connections)
+                        rd_kafka_broker_set_state(
+                                rkb, RD_KAFKA_BROKER_STATE_INIT);
+                else
                         rd_kafka_broker_set_state(
                                 rkb, RD_KAFKA_BROKER_STATE_TRY_CONNECT);
-                        rd_kafka_broker_unlock(rkb);
-                        goto redo; /* effectively a fallthru to TRY_CONNECT */
+                rd_kafka_broker_unlock(rkb);
+                goto redo; /* effectively a fallthru to TRY_CONNECT */
 
-                case RD_KAFKA_BROKER_STATE_DOWN:
+        case RD_KAFKA_BROKER_STATE_TRY_CONNECT:
+                if (rkb->rkb_source == RD_KAFKA_INTERNAL) {
                         rd_kafka_broker_lock(rkb);
-                        if (rkb->rkb_rk->rk_conf.sparse_connections)
-                                rd_kafka_broker_set_state(
-                                        rkb, RD_KAFKA_BROKER_STATE_INIT);
-                        else
-                                rd_kafka_broker_set_state(
-                                        rkb, RD_KAFKA_BROKER_STATE_TRY_CONNECT);
+                        rd_kafka_broker_set_state(rkb,
+                                                  RD_KAFKA_BROKER_STATE_UP);
                         rd_kafka_broker_unlock(rkb);
-                        goto redo; /* effectively a fallthru to TRY_CONNECT */
-
-                case RD_KAFKA_BROKER_STATE_TRY_CONNECT:
-                        if (rkb->rkb_source == RD_KAFKA_INTERNAL) {
-                                rd_kafka_broker_lock(rkb);
-                                rd_kafka_broker_set_state(rkb,
-                                                          RD_KAFKA_BROKER_STATE_UP);
-                                rd_kafka_broker_unlock(rkb);
-                                break;
-                        }
+                        break;
+                }
 
 #if WITH_SASL_OAUTHBEARER
-                        /*
-                        * SASL/OAUTHBEARER is unable to connect unless a valid
-                        * token is available, and a valid token CANNOT be
-                        * available unless/until an initial token retrieval
-                        * succeeds, so wait for this precondition if necessary.
-                        */
-                        if (rkb->rkb_rk->rk_oauthbearer &&
-                            !rd_kafka_oauthbearer_has_token(rkb->rkb_rk)) {
-                                rd_rkb_dbg(rkb, BROKER|RD_KAFKA_DBG_SECURITY,
-                                        "OAUTHBEARER",
-                                        "Waiting for SASL/OAUTHBEARER token");
-                                rd_kafka_broker_serve(rkb,
-                                        rd_kafka_max_block_ms);
-                                /* Continue while loop to try again (as long as
-                                 * we are not terminating). */
-                                continue;
-                        }
+                /*
+                * SASL/OAUTHBEARER is unable to connect unless a valid
+                * token is available, and a valid token CANNOT be
+                * available unless/until an initial token retrieval
+                * succeeds, so wait for this precondition if necessary.
+                */
+                if (rkb->rkb_rk->rk_oauthbearer &&
+                    !rd_kafka_oauthbearer_has_token(rkb->rkb_rk)) {
+                        rd_rkb_dbg(rkb, BROKER|RD_KAFKA_DBG_SECURITY,
+                                "OAUTHBEARER",
+                                "Waiting for SASL/OAUTHBEARER token");
+                        rd_kafka_broker_serve(rkb,
+                                rd_kafka_max_block_ms);
+                        /* Try again on the next call (as long as
+                         * we are not terminating). */
+                        return;
+                }
 
 #endif
-                        if (unlikely(rd_kafka_terminating(rkb->rkb_rk)))
-                                rd_kafka_broker_serve(rkb, 1000);
-
-                        /* Throttle & jitter reconnects to avoid
-                         * thundering horde of reconnecting clients after
-                         * a broker / network outage. Issue #403 */
-                        backoff = rd_kafka_broker_reconnect_backoff(rkb,
-                                                                    rd_clock());
-                        if (backoff > 0) {
-                                rd_rkb_dbg(rkb, BROKER, "RECONNECT",
-                                           "Delaying next reconnect by %dms",
-                                           backoff);
-                                rd_kafka_broker_serve(rkb, (int)backoff);
-                                continue;
-                        }
-
-			/* Initiate asynchronous connection attempt.
-			 * Only the host lookup is blocking here. */
-                        r = rd_kafka_broker_connect(rkb);
-                        if (r == -1) {
-				/* Immediate failure, most likely host
-				 * resolving failed.
-				 * Try the next resolve result until we've
-				 * tried them all, in which case we sleep a
-				 * short while to avoid busy looping. */
-				if (!rkb->rkb_rsal ||
-                                    rkb->rkb_rsal->rsal_cnt == 0 ||
-                                    rkb->rkb_rsal->rsal_curr + 1 ==
-                                    rkb->rkb_rsal->rsal_cnt)
-                                        rd_kafka_broker_serve(
-                                                rkb, rd_kafka_max_block_ms);
-			} else if (r == 0) {
-                                /* Broker has no hostname yet, wait
-                                 * for hostname to be set and connection
-                                 * triggered by received OP_CONNECT. */
-                                rd_kafka_broker_serve(rkb,
-                                                      rd_kafka_max_block_ms);
-                        } else {
-                                /* Connection in progress, state will
-                                 * have changed to STATE_CONNECT. */
-                        }
+                if (unlikely(rd_kafka_terminating(rkb->rkb_rk)))
+                        rd_kafka_broker_serve(rkb, 1000);
+
+                /* Throttle & jitter reconnects to avoid
+                 * thundering horde of reconnecting clients after
+                 * a broker / network outage. Issue #403 */
+                backoff = rd_kafka_broker_reconnect_backoff(rkb,
+                                                            rd_clock());
+                if (backoff > 0) {
+                        rd_rkb_dbg(rkb, BROKER, "RECONNECT",
+                                   "Delaying next reconnect by %dms",
+                                   backoff);
+                        rd_kafka_broker_serve(rkb, (int)backoff);
+                        return;
+                }
 
-			break;
+		/* Initiate asynchronous connection attempt.
+		 * Only the host lookup is blocking here. */
+                r = rd_kafka_broker_connect(rkb);
+                if (r == -1) {
+			/* Immediate failure, most likely host
+			 * resolving failed.
+			 * Try the next resolve result until we've
+			 * tried them all, in which case we sleep a
+			 * short while to avoid busy looping. */
+			if (!rkb->rkb_rsal ||
+                            rkb->rkb_rsal->rsal_cnt == 0 ||
+                            rkb->rkb_rsal->rsal_curr + 1 ==
+                            rkb->rkb_rsal->rsal_cnt)
+                                rd_kafka_broker_serve(
+                                        rkb, rd_kafka_max_block_ms);
+		} else if (r == 0) {
+                        /* Broker has no hostname yet, wait
+                         * for hostname to be set and connection
+                         * triggered by received OP_CONNECT,
+                         * or the hostname is being resolved,
+                         * wait for OP_RESOLVE. */
+                        rd_kafka_broker_serve(rkb,
+                                              rd_kafka_max_block_ms);
+                } else {
+                        /* Connection in progress, state will
+                         * have changed to STATE_CONNECT. */
+                }
 
-		case RD_KAFKA_BROKER_STATE_CONNECT:
-		case RD_KAFKA_BROKER_STATE_AUTH:
-		case RD_KAFKA_BROKER_STATE_AUTH_HANDSHAKE:
-		case RD_KAFKA_BROKER_STATE_APIVERSION_QUERY:
-                        /* Asynchronous connect in progress. */
-                        rd_kafka_broker_serve(rkb, rd_kafka_max_block_ms);
-
-			if (rkb->rkb_state == RD_KAFKA_BROKER_STATE_DOWN) {
-				/* Connect failure.
-				 * Try the next resolve result until we've
-				 * tried them all, in which case we sleep a
-				 * short while to avoid busy looping. */
-				if (!rkb->rkb_rsal ||
-                                    rkb->rkb_rsal->rsal_cnt == 0 ||
-                                    rkb->rkb_rsal->rsal_curr + 1 ==
-                                    rkb->rkb_rsal->rsal_cnt)
-                                        rd_kafka_broker_serve(
-                                                rkb, rd_kafka_max_block_ms);
-			}
-			break;
+		break;
+
+	case RD_KAFKA_BROKER_STATE_CONNECT:
+	case RD_KAFKA_BROKER_STATE_AUTH:
+	case RD_KAFKA_BROKER_STATE_AUTH_HANDSHAKE:
+	case RD_KAFKA_BROKER_STATE_APIVERSION_QUERY:
+                /* Asynchronous connect in progress. */
+                rd_kafka_broker_serve(rkb, rd_kafka_max_block_ms);
+
+		if (rkb->rkb_state == RD_KAFKA_BROKER_STATE_DOWN) {
+			/* Connect failure.
+			 * Try the next resolve result until we've
+			 * tried them all, in which case we sleep a
+			 * short while to avoid busy looping. */
+			if (!rkb->rkb_rsal ||
+                            rkb->rkb_rsal->rsal_cnt == 0 ||
+                            rkb->rkb_rsal->rsal_curr + 1 ==
+                            rkb->rkb_rsal->rsal_cnt)
+                                rd_kafka_broker_serve(
+                                        rkb, rd_kafka_max_block_ms);
+		}
+		break;
 
-                case RD_KAFKA_BROKER_STATE_UPDATE:
-                        /* FALLTHRU */
-		case RD_KAFKA_BROKER_STATE_UP:
-                        rd_kafka_broker_serve(rkb, rd_kafka_max_block_ms);
+        case RD_KAFKA_BROKER_STATE_UPDATE:
+                /* FALLTHRU */
+	case RD_KAFKA_BROKER_STATE_UP:
+                rd_kafka_broker_serve(rkb, rd_kafka_max_block_ms);
 
-			if (rkb->rkb_state == RD_KAFKA_BROKER_STATE_UPDATE) {
-                                rd_kafka_broker_lock(rkb);
-				rd_kafka_broker_set_state(rkb, RD_KAFKA_BROKER_STATE_UP);
-                                rd_kafka_broker_unlock(rkb);
-			}
-			break;
+		if (rkb->rkb_state == RD_KAFKA_BROKER_STATE_UPDATE) {
+                        rd_kafka_broker_lock(rkb);
+			rd_kafka_broker_set_state(rkb, RD_KAFKA_BROKER_STATE_UP);
+                        rd_kafka_broker_unlock(rkb);
 		}
+		break;
+	}
 
-                if (rd_kafka_terminating(rkb->rkb_rk)) {
-                        /* Handle is terminating: fail the send+retry queue
-                         * to speed up termination, otherwise we'll
-                         * need to wait for request timeouts. */
-                        int r;
+        if (rd_kafka_terminating(rkb->rkb_rk)) {
+                /* Handle is terminating: fail the send+retry queue
+                 * to speed up termination, otherwise we'll
+                 * need to wait for request timeouts. */
+                int r;
 
-                        r = rd_kafka_broker_bufq_timeout_scan(
-                                rkb, 0, &rkb->rkb_outbufs, NULL, -1,
-                                RD_KAFKA_RESP_ERR__DESTROY, 0, NULL, 0);
-                        r += rd_kafka_broker_bufq_timeout_scan(
-                                rkb, 0, &rkb->rkb_retrybufs, NULL, -1,
-                                RD_KAFKA_RESP_ERR__DESTROY, 0, NULL, 0);
-                        rd_rkb_dbg(rkb, BROKER, "TERMINATE",
-                                   "Handle is terminating in state %s: "
-                                   "%d refcnts (%p), %d toppar(s), "
-                                   "%d active toppar(s), "
-                                   "%d outbufs, %d waitresps, %d retrybufs: "
-                                   "failed %d request(s) in retry+outbuf",
-                                   rd_kafka_broker_state_names[rkb->rkb_state],
-                                   rd_refcnt_get(&rkb->rkb_refcnt),
-                                   &rkb->rkb_refcnt,
-                                   rkb->rkb_toppar_cnt,
-                                   rkb->rkb_active_toppar_cnt,
-                                   (int)rd_kafka_bufq_cnt(&rkb->rkb_outbufs),
-                                   (int)rd_kafka_bufq_cnt(&rkb->rkb_waitresps),
-                                   (int)rd_kafka_bufq_cnt(&rkb->rkb_retrybufs),
-                                   r);
-                }
-	}
+                r = rd_kafka_broker_bufq_timeout_scan(
+                        rkb, 0, &rkb->rkb_outbufs, NULL, -1,
+                        RD_KAFKA_RESP_ERR__DESTROY, 0, NULL, 0);
+                r += rd_kafka_broker_bufq_timeout_scan(
+                        rkb, 0, &rkb->rkb_retrybufs, NULL, -1,
+                        RD_KAFKA_RESP_ERR__DESTROY, 0, NULL, 0);
+                rd_rkb_dbg(rkb, BROKER, "TERMINATE",
+                           "Handle is terminating in state %s: "
+                           "%d refcnts (%p), %d toppar(s), "
+                           "%d active toppar(s), "
+                           "%d outbufs, %d waitresps, %d retrybufs: "
+                           "failed %d request(s) in retry+outbuf",
+                           rd_kafka_broker_state_names[rkb->rkb_state],
+                           rd_refcnt_get(&rkb->rkb_refcnt),
+                           &rkb->rkb_refcnt,
+                           rkb->rkb_toppar_cnt,
+                           rkb->rkb_active_toppar_cnt,
+                           (int)rd_kafka_bufq_cnt(&rkb->rkb_outbufs),
+                           (int)rd_kafka_bufq_cnt(&rkb->rkb_waitresps),
+                           (int)rd_kafka_bufq_cnt(&rkb->rkb_retrybufs),
+                           r);
+        }
+}
+
+
+/**
+ * @brief Broker thread decommissioning, called from the broker's thread
+ *        when rd_kafka_broker_terminating() is true.
+ *        The broker thread's refcount is released.
+ *
+ * @locality broker thread
+ */
+void rd_kafka_broker_thread_term (rd_kafka_broker_t *rkb) {
+        rd_kafka_broker_t **stripes;
+        int i, stripe_cnt;
+
+        /* Release the data connections: they are decommissioned by
+         * their own threads when their last reference is gone. */
+        rd_kafka_broker_lock(rkb);
+        stripes = rkb->rkb_stripes.rkbs;
+        stripe_cnt = rkb->rkb_stripes.cnt;
+        rkb->rkb_stripes.rkbs = NULL;
+        rkb->rkb_stripes.cnt = 0;
+        rd_kafka_broker_unlock(rkb);
+
+        for (i = 0 ; i < stripe_cnt ; i++) {
+                rd_kafka_q_enq(stripes[i]->rkb_ops,
+                               rd_kafka_op_new(RD_KAFKA_OP_TERMINATE));
+                rd_kafka_broker_destroy(stripes[i]);
+        }
+        RD_IF_FREE(stripes, rd_free);
 
 	if (rkb->rkb_source != RD_KAFKA_INTERNAL) {
 		rd_kafka_wrlock(rkb->rkb_rk);
@@ -4465,6 +5206,23 @@ static int rd_kafka_broker_thread_main (void *arg) {
                 ;
 
 	rd_kafka_broker_destroy(rkb);
+}
+
+
+static int rd_kafka_broker_thread_main (void *arg) {
+	rd_kafka_broker_t *rkb = arg;
+
+        rd_kafka_set_thread_name("%s", rkb->rkb_name);
+        rd_kafka_set_thread_sysname("rdk:broker%"PRId32, rkb->rkb_nodeid);
+
+	(void)rd_atomic32_add(&rd_kafka_thread_cnt_curr, 1);
+
+        rd_kafka_broker_thread_init(rkb);
+
+	while (!rd_kafka_broker_terminating(rkb))
+                rd_kafka_broker_thread_serve(rkb);
+
+        rd_kafka_broker_thread_term(rkb);
 
 #if WITH_SSL
         /* Remove OpenSSL per-thread error state to avoid memory leaks */
@@ -4486,6 +5244,7 @@ static int rd_kafka_broker_thread_main (void *arg) {
  * Final destructor. Refcnt must be 0.
  */
 void rd_kafka_broker_destroy_final (rd_kafka_broker_t *rkb) {
+        int i;
 
         rd_kafka_assert(rkb->rkb_rk, thrd_is_current(rkb->rkb_thread));
         rd_kafka_assert(rkb->rkb_rk, TAILQ_EMPTY(&rkb->rkb_outbufs.rkbq_bufs));
@@ -4493,6 +5252,10 @@ void rd_kafka_broker_destroy_final (rd_kafka_broker_t *rkb) {
         rd_kafka_assert(rkb->rkb_rk, TAILQ_EMPTY(&rkb->rkb_retrybufs.rkbq_bufs));
         rd_kafka_assert(rkb->rkb_rk, TAILQ_EMPTY(&rkb->rkb_toppars));
 
+        /* Stop resolve notifications before the ops queue and its
+         * wake-up fds go away. */
+        rd_kafka_resolve_waiters_remove(rkb->rkb_ops);
+
         if (rkb->rkb_source != RD_KAFKA_INTERNAL &&
             (rkb->rkb_rk->rk_conf.security_protocol ==
              RD_KAFKA_PROTO_SASL_PLAINTEXT ||
@@ -4508,6 +5271,18 @@ void rd_kafka_broker_destroy_final (rd_kafka_broker_t *rkb) {
 	if (rkb->rkb_recv_buf)
 		rd_kafka_buf_destroy(rkb->rkb_recv_buf);
 
+        rd_kafka_recv_ring_destroy(rkb);
+
+#if WITH_SSL
+        rd_kafka_transport_ssl_session_clear(rkb);
+#endif
+
+        rd_kafka_lz4_decompress_term(rkb);
+#if WITH_ZSTD
+        rd_kafka_zstd_decompress_term(rkb);
+#endif
+        rd_kafka_zbuf_pool_destroy(&rkb->rkb_zdec.pool);
+
 	if (rkb->rkb_rsal)
 		rd_sockaddr_list_destroy(rkb->rkb_rsal);
 
@@ -4522,6 +5297,18 @@ void rd_kafka_broker_destroy_final (rd_kafka_broker_t *rkb) {
         rd_avg_destroy(&rkb->rkb_avg_outbuf_latency);
         rd_avg_destroy(&rkb->rkb_avg_rtt);
 	rd_avg_destroy(&rkb->rkb_avg_throttle);
+        rd_avg_destroy(&rkb->rkb_avg_tls_records);
+        rd_avg_destroy(&rkb->rkb_avg_tls_record_size);
+        rd_avg_destroy(&rkb->rkb_avg_resolve_latency);
+        for (i = 0 ; i < RD_KAFKA_STATS_PRODUCE_STAGE_DR ; i++)
+                rd_avg_destroy(&rkb->rkb_avg_produce_latency[i]);
+        for (i = 0 ; i < RD_KAFKAP__NUM ; i++) {
+                if (!rkb->rkb_req_avg[i])
+                        continue;
+                rd_avg_destroy(&rkb->rkb_req_avg[i]->rtt);
+                rd_avg_destroy(&rkb->rkb_req_avg[i]->outbuf_latency);
+                rd_free(rkb->rkb_req_avg[i]);
+        }
 
         mtx_lock(&rkb->rkb_logname_lock);
         rd_free(rkb->rkb_logname);
@@ -4566,7 +5353,7 @@ rd_kafka_broker_t *rd_kafka_broker_add (rd_kafka_t *rk,
 					const char *name, uint16_t port,
 					int32_t nodeid) {
 	rd_kafka_broker_t *rkb;
-        int r;
+        int r, i;
 #ifndef _MSC_VER
         sigset_t newset, oldset;
 #endif
@@ -4596,11 +5383,13 @@ rd_kafka_broker_t *rd_kafka_broker_add (rd_kafka_t *rk,
 
 	mtx_init(&rkb->rkb_lock, mtx_plain);
         mtx_init(&rkb->rkb_logname_lock, mtx_plain);
-        rkb->rkb_logname = rd_strdup(rkb->rkb_name);
+        rd_kafka_broker_set_logname(rkb, rkb->rkb_name);
 	TAILQ_INIT(&rkb->rkb_toppars);
         CIRCLEQ_INIT(&rkb->rkb_active_toppars);
 	rd_kafka_bufq_init(&rkb->rkb_outbufs);
 	rd_kafka_bufq_init(&rkb->rkb_waitresps);
+        rd_kafka_bufq_reqcnt_set(&rkb->rkb_waitresps,
+                                 &rkb->rkb_waitresps_reqcnt);
 	rd_kafka_bufq_init(&rkb->rkb_retrybufs);
 	rkb->rkb_ops = rd_kafka_q_new(rk);
         rd_avg_init(&rkb->rkb_avg_int_latency, RD_AVG_GAUGE, 0, 100*1000, 2,
@@ -4611,6 +5400,22 @@ rd_kafka_broker_t *rd_kafka_broker_add (rd_kafka_t *rk,
                     rk->rk_conf.stats_interval_ms ? 1 : 0);
         rd_avg_init(&rkb->rkb_avg_throttle, RD_AVG_GAUGE, 0, 5000*1000, 2,
                     rk->rk_conf.stats_interval_ms ? 1 : 0);
+        rd_avg_init(&rkb->rkb_avg_tls_records, RD_AVG_GAUGE, 0, 10000, 2,
+                    rk->rk_conf.stats_interval_ms ? 1 : 0);
+        rd_avg_init(&rkb->rkb_avg_tls_record_size, RD_AVG_GAUGE,
+                    0, 16384, 2,
+                    rk->rk_conf.stats_interval_ms ? 1 : 0);
+        rd_avg_init(&rkb->rkb_avg_resolve_latency, RD_AVG_GAUGE,
+                    0, 30000*1000, 2,
+                    rk->rk_conf.stats_interval_ms ? 1 : 0);
+        for (i = 0 ; i < RD_KAFKA_STATS_PRODUCE_STAGE_DR ; i++)
+                rd_avg_init(&rkb->rkb_avg_produce_latency[i], RD_AVG_GAUGE,
+                            0, 1000*1000, 2,
+                            rk->rk_conf.stats_interval_ms &&
+                            rk->rk_type == RD_KAFKA_PRODUCER);
+        rd_kafka_zbuf_pool_init(&rkb->rkb_zdec.pool,
+                                rk->rk_type == RD_KAFKA_CONSUMER ?
+                                (size_t)rk->rk_conf.decompress_pool_size : 0);
         rd_refcnt_init(&rkb->rkb_refcnt, 0);
         rd_kafka_broker_keep(rkb); /* rk_broker's refcount */
 
@@ -4684,8 +5489,15 @@ rd_kafka_broker_t *rd_kafka_broker_add (rd_kafka_t *rk,
 	 * the broker thread until we've finalized the rkb. */
 	rd_kafka_broker_lock(rkb);
         rd_kafka_broker_keep(rkb); /* broker thread's refcnt */
-	if (thrd_create(&rkb->rkb_thread,
-			rd_kafka_broker_thread_main, rkb) != thrd_success) {
+        if (rk->rk_reactor_cnt > 0 && source != RD_KAFKA_INTERNAL &&
+            rkb->rkb_wakeup_fd[0] != -1) {
+                /* Served by one of the shared reactor threads, which
+                 * relies on the wake-up fd for ops queue wake-ups. */
+                rd_kafka_reactor_add(rk, rkb);
+
+        } else if (thrd_create(&rkb->rkb_thread,
+                               rd_kafka_broker_thread_main, rkb) !=
+                   thrd_success) {
 		char tmp[512];
 		rd_snprintf(tmp, sizeof(tmp),
 			 "Unable to create broker thread: %s (%i)",
@@ -4860,6 +5672,114 @@ void rd_kafka_broker_set_nodename (rd_kafka_broker_t *rkb,
 }
 
 
+/**
+ * @brief Set up the data connections of broker \p rkb with broker id
+ *        \p nodeid: connections.per.broker-1 logical brokers that
+ *        follow \p rkb's address and serve the partitions led by \p rkb.
+ *
+ *        Does nothing if connections.per.broker is 1 or the data
+ *        connections are already set up.
+ *
+ * @locality any rdkafka thread
+ * @locks none
+ */
+static void rd_kafka_broker_stripes_init (rd_kafka_broker_t *rkb,
+                                          int32_t nodeid) {
+        rd_kafka_t *rk = rkb->rkb_rk;
+        int cnt = rk->rk_conf.connections_per_broker - 1;
+        rd_kafka_broker_t **stripes;
+        rd_bool_t do_map;
+        int i;
+
+        if (cnt < 1 || nodeid == -1)
+                return;
+
+        rd_kafka_broker_lock(rkb);
+        if (rkb->rkb_stripes.init) {
+                rd_kafka_broker_unlock(rkb);
+                return;
+        }
+        rkb->rkb_stripes.init = rd_true;
+        rd_kafka_broker_unlock(rkb);
+
+        stripes = rd_calloc(cnt, sizeof(*stripes));
+
+        for (i = 0 ; i < cnt ; i++) {
+                char name[RD_KAFKA_NODENAME_SIZE];
+
+                rd_snprintf(name, sizeof(name), "Broker%"PRId32"Data%d",
+                            nodeid, i+1);
+
+                /* Same as rd_kafka_broker_add_logical() but brokers
+                 * must not be added once termination has started. */
+                rd_kafka_wrlock(rk);
+                if (rd_kafka_terminating(rk)) {
+                        rd_kafka_wrunlock(rk);
+                        break;
+                }
+                stripes[i] = rd_kafka_broker_add(rk, RD_KAFKA_LOGICAL,
+                                                 rkb->rkb_proto, name,
+                                                 0/*port*/, -1/*brokerid*/);
+                rd_assert(stripes[i] && *"failed to create broker thread");
+                rd_kafka_wrunlock(rk);
+
+                rd_atomic32_add(&rk->rk_broker_addrless_cnt, 1);
+                rd_kafka_broker_keep(stripes[i]);
+
+                rd_kafka_broker_set_nodename(stripes[i], rkb);
+        }
+
+        rd_rkb_dbg(rkb, BROKER, "STRIPES",
+                   "Spreading partitions over %d data connection(s)", i);
+
+        rd_kafka_broker_lock(rkb);
+        rkb->rkb_stripes.rkbs = stripes;
+        rkb->rkb_stripes.cnt = i;
+        /* A bootstrap broker's nodeid is set later by its NODE_UPDATE op,
+         * which maps the partitions. */
+        do_map = i > 0 && rkb->rkb_nodeid == nodeid;
+        rd_kafka_broker_unlock(rkb);
+
+        /* Move any partitions already delegated to this broker
+         * over to their data connections. */
+        if (do_map)
+                rd_kafka_broker_map_partitions(rkb);
+}
+
+
+/**
+ * @returns the broker that partition \p rktp, led by broker \p rkb,
+ *          is to be served by: one of \p rkb's data connections if
+ *          set up (connections.per.broker > 1), else \p rkb itself.
+ *
+ *          Partitions are spread by a hash of the topic name plus
+ *          the partition, so a topic's partitions are spread evenly.
+ *
+ * @remark The returned broker is valid for as long as the caller
+ *         holds a reference to \p rkb.
+ *
+ * @locality any
+ * @locks none
+ */
+rd_kafka_broker_t *rd_kafka_broker_stripe (rd_kafka_broker_t *rkb,
+                                           const rd_kafka_toppar_t *rktp) {
+        rd_kafka_broker_t *stripe = rkb;
+
+        rd_kafka_broker_lock(rkb);
+        if (rkb->rkb_stripes.cnt > 0) {
+                const rd_kafkap_str_t *topic = rktp->rktp_rkt->rkt_topic;
+                uint32_t h = rd_crc32(topic->str,
+                                      (size_t)RD_KAFKAP_STR_LEN(topic)) +
+                        (uint32_t)rktp->rktp_partition;
+
+                stripe = rkb->rkb_stripes.rkbs[h % rkb->rkb_stripes.cnt];
+        }
+        rd_kafka_broker_unlock(rkb);
+
+        return stripe;
+}
+
+
 /**
  * @brief Find broker by nodeid (not -1) and
  *        possibly filtered by state (unless -1).
@@ -5146,9 +6066,10 @@ void rd_kafka_broker_update (rd_kafka_t *rk, rd_kafka_secproto_t proto,
                  * update the nodeid. */
                 needs_update = 1;
 
-        } else {
-		rd_kafka_broker_add(rk, RD_KAFKA_LEARNED,
-				    proto, mdb->host, mdb->port, mdb->id);
+        } else if ((rkb = rd_kafka_broker_add(rk, RD_KAFKA_LEARNED,
+                                              proto, mdb->host, mdb->port,
+                                              mdb->id))) {
+                rd_kafka_broker_keep(rkb);
 	}
 
 	rd_kafka_wrunlock(rk);
@@ -5164,6 +6085,9 @@ void rd_kafka_broker_update (rd_kafka_t *rk, rd_kafka_secproto_t proto,
                         rko->rko_u.node.nodeid   = mdb->id;
                         rd_kafka_q_enq(rkb->rkb_ops, rko);
                 }
+
+                rd_kafka_broker_stripes_init(rkb, mdb->id);
+
                 rd_kafka_broker_destroy(rkb);
         }
 }
@@ -5529,10 +6453,378 @@ rd_kafka_broker_persistent_connection_del (rd_kafka_broker_t *rkb,
 }
 
 
+/**
+ * @brief Verify adaptive fetch sizing (fetch.adaptive.sizing).
+ */
+static int rd_ut_fetch_adapt (void) {
+        rd_kafka_t *rk;
+        rd_kafka_conf_t *conf;
+        shptr_rd_kafka_toppar_t *s_rktp;
+        rd_kafka_toppar_t *rktp;
+        int32_t max;
+
+        conf = rd_kafka_conf_new();
+        rd_kafka_conf_set(conf, "fetch.adaptive.sizing", "true", NULL, 0);
+        rd_kafka_conf_set(conf, "fetch.message.max.bytes", "65536", NULL, 0);
+        rd_kafka_conf_set(conf, "fetch.wait.max.ms", "100", NULL, 0);
+        rk = rd_kafka_new(RD_KAFKA_CONSUMER, conf, NULL, 0);
+        RD_UT_ASSERT(rk, "failed to create consumer");
+
+        s_rktp = rd_kafka_toppar_get2(rk, "unittest", 0, 0, 1);
+        rktp = rd_kafka_toppar_s2i(s_rktp);
+        max = rktp->rktp_fetch_msg_max_bytes;
+
+        /* Starts at the full size */
+        RD_UT_ASSERT(rd_kafka_toppar_fetch_max_bytes(rktp) == max,
+                     "expected initial size %"PRId32", not %"PRId32,
+                     max, rd_kafka_toppar_fetch_max_bytes(rktp));
+
+        /* Idle partition: shrinks down to the minimum */
+        rktp->rktp_prefetch.req_max_bytes = max;
+        rd_kafka_toppar_fetch_adapt(rktp, 0);
+        RD_UT_ASSERT(rd_kafka_toppar_fetch_max_bytes(rktp) == max / 2,
+                     "expected halved size, not %"PRId32,
+                     rd_kafka_toppar_fetch_max_bytes(rktp));
+        while (rktp->rktp_prefetch.adaptive_max_bytes >
+               RD_KAFKA_FETCH_MIN_MAX_BYTES) {
+                rktp->rktp_prefetch.req_max_bytes =
+                        rktp->rktp_prefetch.adaptive_max_bytes;
+                rd_kafka_toppar_fetch_adapt(rktp, 10);
+        }
+        RD_UT_ASSERT(rd_kafka_toppar_fetch_max_bytes(rktp) ==
+                     RD_KAFKA_FETCH_MIN_MAX_BYTES,
+                     "expected minimum size, not %"PRId32,
+                     rd_kafka_toppar_fetch_max_bytes(rktp));
+
+        /* Moderately filled fetch: unchanged */
+        rktp->rktp_prefetch.req_max_bytes = RD_KAFKA_FETCH_MIN_MAX_BYTES;
+        rd_kafka_toppar_fetch_adapt(rktp, RD_KAFKA_FETCH_MIN_MAX_BYTES / 2);
+        RD_UT_ASSERT(rd_kafka_toppar_fetch_max_bytes(rktp) ==
+                     RD_KAFKA_FETCH_MIN_MAX_BYTES,
+                     "expected unchanged size, not %"PRId32,
+                     rd_kafka_toppar_fetch_max_bytes(rktp));
+
+        /* Lagging partition: grows */
+        rd_kafka_toppar_fetch_adapt(rktp, RD_KAFKA_FETCH_MIN_MAX_BYTES);
+        RD_UT_ASSERT(rd_kafka_toppar_fetch_max_bytes(rktp) ==
+                     RD_KAFKA_FETCH_MIN_MAX_BYTES * 2,
+                     "expected doubled size, not %"PRId32,
+                     rd_kafka_toppar_fetch_max_bytes(rktp));
+
+        /* Consumption rate of 200 KB/s and fetch.wait.max.ms of 100ms
+         * needs at least 20 KB per fetch. */
+        rktp->rktp_prefetch.rate = 200000;
+        RD_UT_ASSERT(rd_kafka_toppar_fetch_max_bytes(rktp) == 20000,
+                     "expected rate-based size 20000, not %"PRId32,
+                     rd_kafka_toppar_fetch_max_bytes(rktp));
+
+        rd_kafka_toppar_destroy(s_rktp);
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Verify fetch.scheduler=lag|drr partition ordering.
+ */
+static int rd_ut_fetch_sched (void) {
+        rd_kafka_t *rk;
+        rd_kafka_conf_t *conf;
+        rd_kafka_broker_t *rkb;
+        shptr_rd_kafka_toppar_t *s_rktp[3];
+        rd_kafka_toppar_t *rktp[3];
+        struct rd_kafka_fetch_sched *sched;
+        rd_ts_t now = rd_clock();
+        int i, cnt;
+
+        conf = rd_kafka_conf_new();
+        rd_kafka_conf_set(conf, "fetch.scheduler", "lag", NULL, 0);
+        rk = rd_kafka_new(RD_KAFKA_CONSUMER, conf, NULL, 0);
+        RD_UT_ASSERT(rk, "failed to create consumer");
+
+        /* Stand-alone broker object: only the active toppar list is used */
+        rkb = rd_calloc(1, sizeof(*rkb));
+        rkb->rkb_rk = rk;
+        CIRCLEQ_INIT(&rkb->rkb_active_toppars);
+
+        for (i = 0 ; i < 3 ; i++) {
+                s_rktp[i] = rd_kafka_toppar_get2(rk, "unittest", i, 0, 1);
+                rktp[i] = rd_kafka_toppar_s2i(s_rktp[i]);
+                rktp[i]->rktp_prefetch.ts_fetch = now;
+                CIRCLEQ_INSERT_TAIL(&rkb->rkb_active_toppars, rktp[i],
+                                    rktp_activelink);
+                rkb->rkb_active_toppar_cnt++;
+        }
+        rkb->rkb_active_toppar_next = rktp[0];
+
+        rktp[0]->rktp_prefetch.lag_bytes = 0;
+        rktp[1]->rktp_prefetch.lag_bytes = 500;
+        rktp[2]->rktp_prefetch.lag_bytes = 100;
+
+        /* Largest lag first, caught up partition left out */
+        sched = rd_kafka_broker_fetch_toppars_schedule(rkb, now, &cnt);
+        RD_UT_ASSERT(cnt == 2 && sched[0].rktp == rktp[1] &&
+                     sched[1].rktp == rktp[2],
+                     "expected [1, 2], got %d entries", cnt);
+        rd_free(sched);
+
+        /* Caught up partition not fetched for too long is included last */
+        rktp[0]->rktp_prefetch.ts_fetch = now - RD_KAFKA_FETCH_SCHED_IDLE_MAX;
+        sched = rd_kafka_broker_fetch_toppars_schedule(rkb, now, &cnt);
+        RD_UT_ASSERT(cnt == 3 && sched[2].rktp == rktp[0],
+                     "expected idle partition to be fetched last");
+        rd_free(sched);
+
+        /* Deficit round-robin: both lagging partitions get the same
+         * credit and are ordered by round-robin position, until the one
+         * first in line is charged for the data it received. */
+        rk->rk_conf.fetch_scheduler = RD_KAFKA_FETCH_SCHED_DRR;
+        rktp[0]->rktp_prefetch.ts_fetch = now;
+        sched = rd_kafka_broker_fetch_toppars_schedule(rkb, now, &cnt);
+        RD_UT_ASSERT(cnt == 2 && sched[0].rktp == rktp[1] &&
+                     sched[0].prio == sched[1].prio,
+                     "expected equal credit");
+        rd_free(sched);
+
+        rd_kafka_toppar_fetch_sched_charge(rktp[1], 1000);
+        sched = rd_kafka_broker_fetch_toppars_schedule(rkb, now, &cnt);
+        RD_UT_ASSERT(cnt == 2 && sched[0].rktp == rktp[2] &&
+                     sched[0].prio > sched[1].prio,
+                     "expected partition 2 first after charging partition 1");
+        rd_free(sched);
+
+        for (i = 0 ; i < 3 ; i++)
+                rd_kafka_toppar_destroy(s_rktp[i]);
+        rd_free(rkb);
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+
+static int ut_ring_resp_cnt;
+static size_t ut_ring_resp_size;
+
+static void ut_ring_resp_cb (rd_kafka_t *rk, rd_kafka_broker_t *rkb,
+                             rd_kafka_resp_err_t err,
+                             rd_kafka_buf_t *response, rd_kafka_buf_t *request,
+                             void *opaque) {
+        ut_ring_resp_cnt++;
+        ut_ring_resp_size = rd_slice_remains(&response->rkbuf_reader);
+}
+
+/**
+ * @brief Write \p body_len bytes of response body to the receive ring.
+ */
+static void ut_ring_write_body (rd_kafka_broker_t *rkb, size_t body_len) {
+        char body[1024];
+
+        memset(body, 'r', sizeof(body));
+        while (body_len > 0) {
+                size_t of = RD_MIN(body_len, sizeof(body));
+                rd_buf_write(&rkb->rkb_recv_ring.rbuf, body, of);
+                body_len -= of;
+        }
+}
+
+/**
+ * @brief Write a response header for a body of \p size bytes, followed by
+ *        \p body_len bytes of the body, to the receive ring.
+ */
+static void ut_ring_write (rd_kafka_broker_t *rkb, int32_t corrid,
+                           size_t size, size_t body_len) {
+        int32_t hdr[2] = { htobe32((int32_t)size + 4), htobe32(corrid) };
+
+        rd_buf_write(&rkb->rkb_recv_ring.rbuf, hdr, sizeof(hdr));
+        ut_ring_write_body(rkb, body_len);
+}
+
+/**
+ * @brief Enqueue a dummy request awaiting response \p corrid.
+ */
+static void ut_ring_request (rd_kafka_broker_t *rkb, int32_t corrid) {
+        rd_kafka_buf_t *rkbuf = rd_kafka_buf_new(1, 0);
+
+        rkbuf->rkbuf_corrid = corrid;
+        rkbuf->rkbuf_cb = ut_ring_resp_cb;
+        rd_kafka_bufq_enq(&rkb->rkb_waitresps, rkbuf);
+}
+
+/**
+ * @brief Receive ring parsing: many responses per read, partial responses,
+ *        compaction and spilling of large responses.
+ */
+static int rd_ut_recv_ring (void) {
+        rd_kafka_t *rk;
+        rd_kafka_broker_t *rkb;
+        size_t chunk;
+        int i;
+
+        rk = rd_kafka_new(RD_KAFKA_PRODUCER, NULL, NULL, 0);
+        RD_UT_ASSERT(rk, "failed to create producer");
+
+        /* Stand-alone broker object */
+        rkb = rd_calloc(1, sizeof(*rkb));
+        rkb->rkb_rk = rk;
+        rkb->rkb_thread = thrd_current();
+        rkb->rkb_state = RD_KAFKA_BROKER_STATE_UP;
+        rd_refcnt_init(&rkb->rkb_refcnt, 1);
+        rd_kafka_bufq_init(&rkb->rkb_waitresps);
+        rd_kafka_recv_ring_init(rkb);
+
+        /* Several responses parsed out of a single read */
+        for (i = 1 ; i <= 3 ; i++) {
+                ut_ring_request(rkb, i);
+                ut_ring_write(rkb, i, i * 100, i * 100);
+        }
+        RD_UT_ASSERT(rd_kafka_recv_ring_parse(rkb) == 1, "parse failed");
+        RD_UT_ASSERT(ut_ring_resp_cnt == 3 && ut_ring_resp_size == 300,
+                     "expected 3 responses, got %d", ut_ring_resp_cnt);
+        RD_UT_ASSERT(rkb->rkb_recv_ring.of == 0 &&
+                     rd_buf_write_pos(&rkb->rkb_recv_ring.rbuf) == 0,
+                     "ring should be rewound when fully parsed");
+
+        /* Partial header, then partial body */
+        ut_ring_request(rkb, 4);
+        rd_buf_write(&rkb->rkb_recv_ring.rbuf, "\0\0\0", 3);
+        RD_UT_ASSERT(rd_kafka_recv_ring_parse(rkb) == 1 &&
+                     ut_ring_resp_cnt == 3, "unexpected response");
+        rd_buf_write(&rkb->rkb_recv_ring.rbuf, "\x36\0\0\0\x04", 5);
+        ut_ring_write_body(rkb, 20);
+        RD_UT_ASSERT(rd_kafka_recv_ring_parse(rkb) == 1 &&
+                     ut_ring_resp_cnt == 3, "unexpected response");
+        ut_ring_write_body(rkb, 30);
+        RD_UT_ASSERT(rd_kafka_recv_ring_parse(rkb) == 1 &&
+                     ut_ring_resp_cnt == 4 && ut_ring_resp_size == 50,
+                     "expected partial response to complete");
+
+        /* A partial response that does not fit the remaining space is
+         * moved to the start of the ring. */
+        chunk = RD_KAFKA_RECV_RING_SIZE / 4 - 100;
+        for (i = 5 ; i < 8 ; i++) {
+                ut_ring_request(rkb, i);
+                ut_ring_write(rkb, i, chunk, chunk);
+        }
+        ut_ring_request(rkb, 8);
+        ut_ring_write(rkb, 8, chunk, 100);
+        RD_UT_ASSERT(rd_kafka_recv_ring_parse(rkb) == 1 &&
+                     ut_ring_resp_cnt == 7, "expected 7 responses");
+        RD_UT_ASSERT(rkb->rkb_recv_ring.of == 0 &&
+                     rd_buf_write_pos(&rkb->rkb_recv_ring.rbuf) ==
+                     RD_KAFKAP_RESHDR_SIZE + 100,
+                     "partial response should have been moved, "
+                     "of %"PRIusz, rkb->rkb_recv_ring.of);
+        RD_UT_ASSERT(!rkb->rkb_recv_buf, "small response should not spill");
+
+        /* Large response: moved to its own buffer */
+        rd_buf_write_seek(&rkb->rkb_recv_ring.rbuf, 0);
+        ut_ring_write(rkb, 8, 100000, 1000);
+        RD_UT_ASSERT(rd_kafka_recv_ring_parse(rkb) == 1 &&
+                     ut_ring_resp_cnt == 7, "unexpected response");
+        RD_UT_ASSERT(rkb->rkb_recv_buf &&
+                     rkb->rkb_recv_buf->rkbuf_totlen == 100000 &&
+                     rd_buf_write_pos(&rkb->rkb_recv_buf->rkbuf_buf) ==
+                     RD_KAFKAP_RESHDR_SIZE + 1000 &&
+                     rd_buf_write_remains(&rkb->rkb_recv_buf->rkbuf_buf) >=
+                     100000 - 1000,
+                     "expected large response to spill");
+        RD_UT_ASSERT(rd_buf_write_pos(&rkb->rkb_recv_ring.rbuf) == 0,
+                     "ring should be empty after spill");
+        rd_kafka_buf_destroy(rkb->rkb_recv_buf);
+        rkb->rkb_recv_buf = NULL;
+
+        /* Response to unknown request is dropped */
+        ut_ring_write(rkb, 99, 10, 10);
+        RD_UT_ASSERT(rd_kafka_recv_ring_parse(rkb) == 1 &&
+                     ut_ring_resp_cnt == 7 &&
+                     rd_atomic64_get(&rkb->rkb_c.rx_corrid_err) == 1,
+                     "expected unknown response to be dropped");
+
+        /* Request 8 never got its response */
+        rd_kafka_buf_destroy(TAILQ_FIRST(&rkb->rkb_waitresps.rkbq_bufs));
+
+        rd_kafka_recv_ring_destroy(rkb);
+        rd_refcnt_destroy(&rkb->rkb_refcnt);
+        rd_free(rkb);
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Partitions are spread evenly over the data connections of
+ *        connections.per.broker, which are torn down with the client.
+ */
+static int rd_ut_stripes (void) {
+        rd_kafka_t *rk;
+        rd_kafka_conf_t *conf;
+        rd_kafka_broker_t *rkb;
+        struct rd_kafka_metadata_broker mdb = {
+                .id = 1, .host = "127.0.0.1", .port = 19091 };
+        int cnts[3] = { 0 };
+        int32_t partition;
+        int i;
+
+        conf = rd_kafka_conf_new();
+        rd_kafka_conf_set(conf, "connections.per.broker", "4", NULL, 0);
+        rk = rd_kafka_new(RD_KAFKA_PRODUCER, conf, NULL, 0);
+        RD_UT_ASSERT(rk, "failed to create producer");
+
+        rd_kafka_broker_update(rk, RD_KAFKA_PROTO_PLAINTEXT, &mdb);
+        /* Updating a known broker does not add more data connections */
+        rd_kafka_broker_update(rk, RD_KAFKA_PROTO_PLAINTEXT, &mdb);
+
+        rd_kafka_rdlock(rk);
+        rkb = rd_kafka_broker_find_by_nodeid(rk, 1);
+        RD_UT_ASSERT(rd_atomic32_get(&rk->rk_broker_cnt) == 4,
+                     "expected 4 brokers, not %d",
+                     rd_atomic32_get(&rk->rk_broker_cnt));
+        rd_kafka_rdunlock(rk);
+        RD_UT_ASSERT(rkb, "broker 1 not found");
+        RD_UT_ASSERT(rkb->rkb_stripes.cnt == 3,
+                     "expected 3 data connections, not %d",
+                     rkb->rkb_stripes.cnt);
+
+        for (partition = 0 ; partition < 12 ; partition++) {
+                shptr_rd_kafka_toppar_t *s_rktp;
+                rd_kafka_broker_t *stripe;
+
+                s_rktp = rd_kafka_toppar_get2(rk, "unittest", partition,
+                                              0, 1);
+                stripe = rd_kafka_broker_stripe(rkb,
+                                                rd_kafka_toppar_s2i(s_rktp));
+                RD_UT_ASSERT(stripe == rd_kafka_broker_stripe(
+                                     rkb, rd_kafka_toppar_s2i(s_rktp)),
+                             "partition %"PRId32" not mapped consistently",
+                             partition);
+                for (i = 0 ; i < 3 ; i++)
+                        if (stripe == rkb->rkb_stripes.rkbs[i])
+                                cnts[i]++;
+                rd_kafka_toppar_destroy(s_rktp);
+        }
+
+        for (i = 0 ; i < 3 ; i++)
+                RD_UT_ASSERT(cnts[i] == 4,
+                             "expected 4 partitions on data connection %d, "
+                             "not %d", i, cnts[i]);
+
+        rd_kafka_broker_destroy(rkb);
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+
 int unittest_broker (void) {
         int fails = 0;
 
         fails += rd_ut_reconnect_backoff();
+        fails += rd_ut_fetch_adapt();
+        fails += rd_ut_fetch_sched();
+        fails += rd_ut_recv_ring();
+        fails += rd_ut_stripes();
 
         return fails;
 }
@@ -30,6 +30,8 @@
 #define _RDKAFKA_BROKER_H_
 
 #include "rdkafka_feature.h"
+#include "rdkafka_zbuf.h"
+#include "rdkafka_reactor.h"
 
 
 extern const char *rd_kafka_broker_state_names[];
@@ -43,6 +45,15 @@ struct rd_kafka_broker_s { /* rd_kafka_broker_t */
 
 	rd_sockaddr_list_t *rkb_rsal;
         rd_ts_t             rkb_ts_rsal_last;
+        /**< Address resolution in progress, see rd_kafka_broker_resolve()
+         *   @locality broker thread */
+        struct {
+                rd_ts_t ts_req;   /**< Time of the first lookup of the
+                                   *   current connection attempt,
+                                   *   0 if not waiting for the resolver. */
+                int save_idx;     /**< Round-robin position in the
+                                   *   expired address list. */
+        } rkb_resolve;
         const rd_sockaddr_inx_t  *rkb_addr_last; /* Last used connect address */
 
 	rd_kafka_transport_t *rkb_transport;
@@ -147,12 +158,35 @@ struct rd_kafka_broker_s { /* rd_kafka_broker_t */
                 rd_atomic64_t buf_grow;      /* rkbuf grows needed */
                 rd_atomic64_t wakeups;       /* Poll wakeups */
 
+                rd_atomic64_t zc_tx;         /**< MSG_ZEROCOPY sends */
+                rd_atomic64_t zc_tx_copied;  /**< MSG_ZEROCOPY sends that
+                                              *   the kernel copied anyway */
+                rd_atomic64_t zc_tx_fallback; /**< Zero-copy eligible sends
+                                               *   that fell back to
+                                               *   copying. */
+
                 rd_atomic32_t connects;      /**< Connection attempts,
                                               *   successful or not. */
 
                 rd_atomic32_t disconnects;   /**< Disconnects.
                                               *   Always peer-triggered. */
 
+                rd_atomic32_t tls_full_handshakes; /**< Completed TLS
+                                                    *   handshakes that
+                                                    *   did not resume a
+                                                    *   session. */
+                rd_atomic32_t tls_resumed_handshakes; /**< Completed TLS
+                                                       *   handshakes that
+                                                       *   resumed a cached
+                                                       *   session. */
+
+                rd_atomic32_t resolve_hits;   /**< Address lookups served
+                                               *   from the resolver
+                                               *   cache. */
+                rd_atomic32_t resolve_misses; /**< Address lookups that
+                                               *   waited for the
+                                               *   resolver. */
+
                 rd_atomic64_t reqtype[RD_KAFKAP__NUM]; /**< Per request-type
                                                         *   counter */
 	} rkb_c;
@@ -171,7 +205,36 @@ struct rd_kafka_broker_s { /* rd_kafka_broker_t */
 
         rd_kafka_t         *rkb_rk;
 
-	rd_kafka_buf_t     *rkb_recv_buf;
+	rd_kafka_buf_t     *rkb_recv_buf;  /**< Large response being
+                                             *   received directly into
+                                             *   its own buffer. */
+
+        /**< Receive ring: the socket is read in bulk into this buffer
+         *   and complete responses are parsed out of it, see
+         *   rd_kafka_recv(). A trailing partial response is moved back
+         *   to the start of the buffer when it would not fit the
+         *   remaining space.
+         *   Allocated on first receive, freed on disconnect. */
+        struct {
+                rd_buf_t rbuf;     /**< Single-segment buffer written to
+                                    *   by the transport. */
+                char    *base;     /**< Start of the segment memory,
+                                    *   NULL if not allocated. */
+                size_t   of;       /**< Offset of first unparsed byte */
+        } rkb_recv_ring;
+
+        /**< Consumer decompression state.
+         *   The codec contexts are created on first use and are only
+         *   accessed from the broker thread, while the output buffer
+         *   pool is thread-safe since buffers are returned to it
+         *   when the application destroys the last message
+         *   referencing them. */
+        struct {
+                rd_kafka_zbuf_pool_t pool;     /**< Output buffer pool */
+                void *lz4_dctx;                /**< LZ4F_dctx */
+                void *zstd_dctx;               /**< ZSTD_DCtx */
+                void *zstd_dstream;            /**< ZSTD_DStream */
+        } rkb_zdec;
 
 	int                 rkb_max_inflight;   /* Maximum number of in-flight
 						 * requests to broker.
@@ -179,6 +242,8 @@ struct rd_kafka_broker_s { /* rd_kafka_broker_t */
 	rd_kafka_bufq_t     rkb_outbufs;
 	rd_kafka_bufq_t     rkb_waitresps;
 	rd_kafka_bufq_t     rkb_retrybufs;
+        rd_kafka_bufq_reqcnt_t rkb_waitresps_reqcnt; /**< In-flight requests
+                                                      *   per ApiKey */
 
 	rd_avg_t            rkb_avg_int_latency;/* Current internal latency period*/
         rd_avg_t            rkb_avg_outbuf_latency; /**< Current latency
@@ -187,6 +252,25 @@ struct rd_kafka_broker_s { /* rd_kafka_broker_t */
                                                      */
 	rd_avg_t            rkb_avg_rtt;        /* Current RTT period */
 	rd_avg_t            rkb_avg_throttle;   /* Current throttle period */
+        rd_avg_t            rkb_avg_tls_records; /**< TLS records written
+                                                  *   per request */
+        rd_avg_t            rkb_avg_tls_record_size; /**< Plaintext bytes
+                                                      *   per TLS record */
+        rd_avg_t            rkb_avg_resolve_latency; /**< Address resolution
+                                                      *   time */
+        rd_avg_t            rkb_avg_produce_latency[
+                RD_KAFKA_STATS_PRODUCE_STAGE_DR]; /**< Producer batch
+                                                   *   stage latencies,
+                                                   *   the DR stages are
+                                                   *   per topic only. */
+
+        /** Per-ApiKey latencies, allocated by the broker thread on the
+         *  first request of each type when statistics are enabled.
+         *  The pointers are set under rkb_lock. */
+        struct rd_kafka_broker_req_avg_s {
+                rd_avg_t rtt;             /**< Round-trip time */
+                rd_avg_t outbuf_latency;  /**< Request queue wait time */
+        } *rkb_req_avg[RD_KAFKAP__NUM];
 
         /* These are all protected by rkb_lock */
 	char                rkb_name[RD_KAFKA_NODENAME_SIZE];  /* Displ name */
@@ -210,6 +294,11 @@ struct rd_kafka_broker_s { /* rd_kafka_broker_t */
         /* Logging name is a copy of rkb_name, protected by its own mutex */
         char               *rkb_logname;
         mtx_t               rkb_logname_lock;
+        rd_bool_t           rkb_dbg_filtered; /**< Debug logs are filtered
+                                               *   out by
+                                               *   `debug.broker.include`.
+                                               *   Updated with rkb_logname,
+                                               *   read without lock. */
 
         int                 rkb_wakeup_fd[2];     /* Wake-up fds (r/w) to wake
                                                    * up from IO-wait when
@@ -218,6 +307,26 @@ struct rd_kafka_broker_s { /* rd_kafka_broker_t */
                                                    * this is rkb_wakeup_fd[1]
                                                    * if enabled. */
 
+        /**< Shared I/O reactor state, only used when the broker is
+         *   served by a reactor thread (io.reactor.threads).
+         *   @locality broker thread (the reactor thread) */
+        struct {
+                rd_kafka_reactor_t *rkrc;      /**< Serving reactor,
+                                                *   or NULL. */
+                TAILQ_ENTRY(rd_kafka_broker_s) link; /**< rkrc_brokers */
+                rd_kafka_reactor_src_t sock;   /**< TCP socket */
+                rd_kafka_reactor_src_t wakeup; /**< rkb_wakeup_fd[0] */
+                rd_ts_t ts_wakeup;  /**< Next time the broker needs to be
+                                     *   served regardless of events,
+                                     *   0 means as soon as possible. */
+                rd_bool_t yield;    /**< Set by ops_io_serve() to make the
+                                     *   serve loops return to the
+                                     *   reactor rather than block.
+                                     *   Also set when not served by a
+                                     *   reactor to return to the state
+                                     *   machine on RD_KAFKA_OP_RESOLVE. */
+        } rkb_reactor;
+
         /**< Current, exponentially increased, reconnect backoff. */
         int                 rkb_reconnect_backoff_ms;
 
@@ -250,9 +359,40 @@ struct rd_kafka_broker_s { /* rd_kafka_broker_t */
                 rd_atomic32_t coord;
         } rkb_persistconn;
 
+        /**< Data connections (connections.per.broker > 1):
+         *   logical brokers following this broker's address that the
+         *   partitions led by this broker are spread over, each with its
+         *   own connection and in-flight window.
+         *   Set up once by rd_kafka_broker_update() and released by
+         *   the broker thread on termination.
+         *   @locks rkb_lock */
+        struct {
+                rd_kafka_broker_t **rkbs;  /**< Data connection brokers,
+                                            *   with refcount held. */
+                int cnt;                   /**< Number of rkbs */
+                rd_bool_t init;            /**< Set up has started */
+        } rkb_stripes;
+
+        uint32_t rkb_stats_crc;     /**< statistics.delta: checksum of the
+                                     *   last emitted broker stats.
+                                     *   Locks: rkb_lock */
+
 	rd_kafka_secproto_t rkb_proto;
 
 	int                 rkb_down_reported;    /* Down event reported */
+#if WITH_SSL
+        /**< TLS session cache for resumption on reconnect
+         *   (ssl.session.resumption.enable).
+         *   @locality broker thread */
+        struct {
+                SSL_SESSION *session;  /**< Latest resumable session
+                                        *   received from the broker,
+                                        *   or NULL. */
+                int connect_epoch;     /**< rkb_connect_epoch of the
+                                        *   connection the session was
+                                        *   received on. */
+        } rkb_ssl_session;
+#endif
 #if WITH_SASL_CYRUS
 	rd_kafka_timer_t    rkb_sasl_kinit_refresh_tmr;
 #endif
@@ -384,6 +524,14 @@ void rd_kafka_broker_conn_closed (rd_kafka_broker_t *rkb,
 
 void rd_kafka_broker_destroy_final (rd_kafka_broker_t *rkb);
 
+/** @returns true if only the broker thread's reference remains. */
+#define rd_kafka_broker_terminating(rkb) \
+        (rd_refcnt_get(&(rkb)->rkb_refcnt) <= 1)
+
+void rd_kafka_broker_thread_init (rd_kafka_broker_t *rkb);
+void rd_kafka_broker_thread_serve (rd_kafka_broker_t *rkb);
+void rd_kafka_broker_thread_term (rd_kafka_broker_t *rkb);
+
 #define rd_kafka_broker_destroy(rkb)                                    \
         rd_refcnt_destroywrapper(&(rkb)->rkb_refcnt,                    \
                                  rd_kafka_broker_destroy_final(rkb))
@@ -406,14 +554,21 @@ rd_kafka_broker_t *rd_kafka_broker_add_logical (rd_kafka_t *rk,
 void rd_kafka_broker_set_nodename (rd_kafka_broker_t *rkb,
                                    rd_kafka_broker_t *from_rkb);
 
+rd_kafka_broker_t *rd_kafka_broker_stripe (rd_kafka_broker_t *rkb,
+                                           const rd_kafka_toppar_t *rktp);
+
 void rd_kafka_broker_connect_up (rd_kafka_broker_t *rkb);
 void rd_kafka_broker_connect_done (rd_kafka_broker_t *rkb, const char *errstr);
 
 int rd_kafka_send (rd_kafka_broker_t *rkb);
 int rd_kafka_recv (rd_kafka_broker_t *rkb);
 
-void rd_kafka_dr_msgq (rd_kafka_itopic_t *rkt,
-		       rd_kafka_msgq_t *rkmq, rd_kafka_resp_err_t err);
+void rd_kafka_dr_msgq0 (rd_kafka_itopic_t *rkt,
+                        rd_kafka_msgq_t *rkmq, rd_kafka_resp_err_t err,
+                        const rd_kafka_msgbatch_t *batch);
+#define rd_kafka_dr_msgq(rkt,rkmq,err)                  \
+        rd_kafka_dr_msgq0(rkt, rkmq, err, NULL)
+void rd_kafka_dr_served (rd_kafka_op_t *rko);
 
 void rd_kafka_dr_implicit_ack (rd_kafka_broker_t *rkb,
                                rd_kafka_toppar_t *rktp,
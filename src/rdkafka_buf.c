@@ -55,11 +55,23 @@ void rd_kafka_buf_destroy_final (rd_kafka_buf_t *rkbuf) {
         case RD_KAFKAP_Produce:
                 rd_kafka_msgbatch_destroy(&rkbuf->rkbuf_batch);
                 break;
+
+        case RD_KAFKAP_Fetch:
+                /* Release the request's prefetch budget reservation.
+                 * Fetch responses (which share the ApiKey) have none. */
+                if (rkbuf->rkbuf_u.Fetch.reserved)
+                        rd_atomic64_sub(&rkbuf->rkbuf_rkb->rkb_rk->
+                                        rk_prefetch.inflight_bytes,
+                                        rkbuf->rkbuf_u.Fetch.reserved);
+                break;
         }
 
         if (rkbuf->rkbuf_response)
                 rd_kafka_buf_destroy(rkbuf->rkbuf_response);
 
+        if (rkbuf->rkbuf_zc.response)
+                rd_kafka_buf_destroy(rkbuf->rkbuf_zc.response);
+
         rd_kafka_replyq_destroy(&rkbuf->rkbuf_replyq);
         rd_kafka_replyq_destroy(&rkbuf->rkbuf_orig_replyq);
 
@@ -110,6 +122,9 @@ rd_kafka_buf_t *rd_kafka_buf_new0 (int segcnt, size_t size, int flags) {
 
         rd_buf_init(&rkbuf->rkbuf_buf, segcnt, size);
         rd_refcnt_init(&rkbuf->rkbuf_refcnt, 1);
+        rd_atomic64_init(&rkbuf->rkbuf_fetch.live, 0);
+        rd_atomic32_init(&rkbuf->rkbuf_fetch.app_cnt, 0);
+        rd_atomic64_init(&rkbuf->rkbuf_fetch.ts_pinned, 0);
 
         return rkbuf;
 }
@@ -180,18 +195,41 @@ rd_kafka_buf_t *rd_kafka_buf_new_shadow (const void *ptr, size_t size,
         rd_slice_init_full(&rkbuf->rkbuf_reader, &rkbuf->rkbuf_buf);
 
         rd_refcnt_init(&rkbuf->rkbuf_refcnt, 1);
+        rd_atomic64_init(&rkbuf->rkbuf_fetch.live, 0);
+        rd_atomic32_init(&rkbuf->rkbuf_fetch.app_cnt, 0);
+        rd_atomic64_init(&rkbuf->rkbuf_fetch.ts_pinned, 0);
 
 	return rkbuf;
 }
 
 
 
+/**
+ * @brief Add \p delta to the per-ApiKey count of \p rkbuf, if \p rkbufq
+ *        keeps such counts.
+ */
+static RD_INLINE void rd_kafka_bufq_reqcnt_add (rd_kafka_bufq_t *rkbufq,
+                                                const rd_kafka_buf_t *rkbuf,
+                                                int delta) {
+        rd_kafka_bufq_reqcnt_t *reqcnt = rkbufq->rkbq_reqcnt;
+        int16_t ApiKey = rkbuf->rkbuf_reqhdr.ApiKey;
+        int32_t v;
+
+        if (likely(!reqcnt) || ApiKey < 0 || ApiKey >= RD_KAFKAP__NUM)
+                return;
+
+        v = rd_atomic32_add(&reqcnt->cnt[ApiKey], delta);
+        if (v > rd_atomic32_get(&reqcnt->max[ApiKey]))
+                rd_atomic32_set(&reqcnt->max[ApiKey], v);
+}
+
 void rd_kafka_bufq_enq (rd_kafka_bufq_t *rkbufq, rd_kafka_buf_t *rkbuf) {
 	TAILQ_INSERT_TAIL(&rkbufq->rkbq_bufs, rkbuf, rkbuf_link);
         rd_atomic32_add(&rkbufq->rkbq_cnt, 1);
         if (rkbuf->rkbuf_reqhdr.ApiKey == RD_KAFKAP_Produce)
                 rd_atomic32_add(&rkbufq->rkbq_msg_cnt,
                                 rd_kafka_msgq_len(&rkbuf->rkbuf_batch.msgq));
+        rd_kafka_bufq_reqcnt_add(rkbufq, rkbuf, 1);
 }
 
 void rd_kafka_bufq_deq (rd_kafka_bufq_t *rkbufq, rd_kafka_buf_t *rkbuf) {
@@ -201,22 +239,54 @@ void rd_kafka_bufq_deq (rd_kafka_bufq_t *rkbufq, rd_kafka_buf_t *rkbuf) {
         if (rkbuf->rkbuf_reqhdr.ApiKey == RD_KAFKAP_Produce)
                 rd_atomic32_sub(&rkbufq->rkbq_msg_cnt,
                                 rd_kafka_msgq_len(&rkbuf->rkbuf_batch.msgq));
+        rd_kafka_bufq_reqcnt_add(rkbufq, rkbuf, -1);
 }
 
 void rd_kafka_bufq_init(rd_kafka_bufq_t *rkbufq) {
 	TAILQ_INIT(&rkbufq->rkbq_bufs);
 	rd_atomic32_init(&rkbufq->rkbq_cnt, 0);
 	rd_atomic32_init(&rkbufq->rkbq_msg_cnt, 0);
+        rkbufq->rkbq_reqcnt = NULL;
+}
+
+/**
+ * @brief Keep per-ApiKey buffer counts for the empty \p rkbufq in
+ *        \p reqcnt, which must outlive the queue.
+ */
+void rd_kafka_bufq_reqcnt_set (rd_kafka_bufq_t *rkbufq,
+                               rd_kafka_bufq_reqcnt_t *reqcnt) {
+        int i;
+
+        rd_assert(TAILQ_EMPTY(&rkbufq->rkbq_bufs));
+
+        for (i = 0 ; i < RD_KAFKAP__NUM ; i++) {
+                rd_atomic32_init(&reqcnt->cnt[i], 0);
+                rd_atomic32_init(&reqcnt->max[i], 0);
+        }
+
+        rkbufq->rkbq_reqcnt = reqcnt;
 }
 
 /**
  * Concat all buffers from 'src' to tail of 'dst'
  */
 void rd_kafka_bufq_concat (rd_kafka_bufq_t *dst, rd_kafka_bufq_t *src) {
+        rd_kafka_bufq_reqcnt_t *src_reqcnt = src->rkbq_reqcnt;
+
+        if (unlikely(src_reqcnt || dst->rkbq_reqcnt)) {
+                rd_kafka_buf_t *rkbuf;
+
+                TAILQ_FOREACH(rkbuf, &src->rkbq_bufs, rkbuf_link) {
+                        rd_kafka_bufq_reqcnt_add(src, rkbuf, -1);
+                        rd_kafka_bufq_reqcnt_add(dst, rkbuf, 1);
+                }
+        }
+
 	TAILQ_CONCAT(&dst->rkbq_bufs, &src->rkbq_bufs, rkbuf_link);
 	(void)rd_atomic32_add(&dst->rkbq_cnt, rd_atomic32_get(&src->rkbq_cnt));
 	(void)rd_atomic32_add(&dst->rkbq_msg_cnt, rd_atomic32_get(&src->rkbq_msg_cnt));
 	rd_kafka_bufq_init(src);
+        src->rkbq_reqcnt = src_reqcnt;
 }
 
 /**
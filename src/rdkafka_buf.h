@@ -575,6 +575,34 @@ struct rd_kafka_buf_s { /* rd_kafka_buf_t */
 
         rd_kafka_resp_err_t rkbuf_err;      /* Buffer parsing error code */
 
+        /* Consumed message accounting, see rd_kafka_op_fetch_msg_deliver() */
+        struct {
+                rd_atomic64_t live;      /**< Key and value bytes of consumed
+                                          *   messages (queued or held by
+                                          *   the application) that
+                                          *   reference this buffer. */
+                rd_atomic32_t app_cnt;   /**< Number of those messages that
+                                          *   have been handed to the
+                                          *   application. */
+                rd_atomic64_t ts_pinned; /**< When app_cnt last went
+                                          *   from 0 to 1. */
+        } rkbuf_fetch;
+
+        /* MSG_ZEROCOPY send accounting, see rd_kafka_transport_zc_defer() */
+        struct {
+                int pending;             /**< Zero-copy sends of this
+                                          *   request not yet completed
+                                          *   by the kernel. */
+                rd_bool_t deferred;      /**< The request's callback is
+                                          *   held back until the
+                                          *   pending sends complete. */
+                rd_kafka_resp_err_t err; /**< Deferred callback error */
+                struct rd_kafka_buf_s *response; /**< Response received
+                                                  *   while sends were
+                                                  *   pending, handled
+                                                  *   on completion. */
+        } rkbuf_zc;
+
         union {
                 struct {
                         rd_list_t *topics;  /* Requested topics (char *) */
@@ -595,6 +623,10 @@ struct rd_kafka_buf_s { /* rd_kafka_buf_t */
                 struct {
                         rd_kafka_msgbatch_t batch; /**< MessageSet/batch */
                 } Produce;
+                struct {
+                        int64_t reserved; /**< Prefetch budget bytes
+                                           *   reserved by this request */
+                } Fetch;
         } rkbuf_u;
 
 #define rkbuf_batch rkbuf_u.Produce.batch
@@ -615,10 +647,22 @@ struct rd_kafka_buf_s { /* rd_kafka_buf_t */
 #define rd_kafka_buf_was_sent(rkbuf)                    \
         ((rkbuf)->rkbuf_flags & RD_KAFKA_OP_F_SENT)
 
+/**
+ * @brief Per request type (ApiKey) buffer counts of a bufq.
+ */
+typedef struct rd_kafka_bufq_reqcnt_s {
+        rd_atomic32_t cnt[RD_KAFKAP__NUM];  /**< Current buffer count */
+        rd_atomic32_t max[RD_KAFKAP__NUM];  /**< Highest buffer count since
+                                             *   reset by the reader */
+} rd_kafka_bufq_reqcnt_t;
+
 typedef struct rd_kafka_bufq_s {
 	TAILQ_HEAD(, rd_kafka_buf_s) rkbq_bufs;
 	rd_atomic32_t  rkbq_cnt;
 	rd_atomic32_t  rkbq_msg_cnt;
+        rd_kafka_bufq_reqcnt_t *rkbq_reqcnt; /**< Optional per-ApiKey
+                                              *   counts, see
+                                              *   rd_kafka_bufq_reqcnt_set()*/
 } rd_kafka_bufq_t;
 
 #define rd_kafka_bufq_cnt(rkbq) rd_atomic32_get(&(rkbq)->rkbq_cnt)
@@ -696,6 +740,8 @@ rd_kafka_buf_t *rd_kafka_buf_new_shadow (const void *ptr, size_t size,
 void rd_kafka_bufq_enq (rd_kafka_bufq_t *rkbufq, rd_kafka_buf_t *rkbuf);
 void rd_kafka_bufq_deq (rd_kafka_bufq_t *rkbufq, rd_kafka_buf_t *rkbuf);
 void rd_kafka_bufq_init(rd_kafka_bufq_t *rkbufq);
+void rd_kafka_bufq_reqcnt_set (rd_kafka_bufq_t *rkbufq,
+                               rd_kafka_bufq_reqcnt_t *reqcnt);
 void rd_kafka_bufq_concat (rd_kafka_bufq_t *dst, rd_kafka_bufq_t *src);
 void rd_kafka_bufq_purge (rd_kafka_broker_t *rkb,
                           rd_kafka_bufq_t *rkbufq,
@@ -288,6 +288,21 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
 	  1, 1000000, 1000000 },
         { _RK_GLOBAL, "max.in.flight", _RK_C_ALIAS,
           .sdef = "max.in.flight.requests.per.connection" },
+        { _RK_GLOBAL|_RK_MED, "connections.per.broker", _RK_C_INT,
+          _RK(connections_per_broker),
+          "Number of connections to each broker. "
+          "With a value above 1 the first connection carries the control "
+          "requests (metadata, group coordination, offset commits, etc.) "
+          "while the partitions led by the broker are spread over the "
+          "remaining connections, each with its own "
+          "`max.in.flight.requests.per.connection` window. "
+          "This allows filling links with a high bandwidth-delay product "
+          "that a single TCP connection can't, limited by its socket "
+          "buffers, and keeps large Produce and Fetch requests and "
+          "responses from delaying control requests and each other. "
+          "The data connections show up as `BrokerNDataI` brokers "
+          "in the statistics.",
+          1, 16, 1 },
 	{ _RK_GLOBAL, "metadata.request.timeout.ms", _RK_C_INT,
 	  _RK(metadata_request_timeout_ms),
 	  "Non-topic request timeout in milliseconds. "
@@ -348,6 +363,24 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
                         { RD_KAFKA_DBG_EOS,      "eos" },
 			{ RD_KAFKA_DBG_ALL,      "all" }
 		} },
+        { _RK_GLOBAL, "debug.sample", _RK_C_STR, _RK(debug_sample),
+          "Sample the debug log of high volume debug contexts: "
+          "a comma-separated list of `context=N` pairs, e.g., "
+          "`msg=10000,fetch=100`, that only emits 1 in N of the "
+          "debug log messages of each enabled (see `debug`) context. "
+          "Messages are counted per thread. A message with multiple "
+          "contexts is emitted if any of its enabled contexts is "
+          "not sampled." },
+        { _RK_GLOBAL, "debug.topic.include", _RK_C_PATLIST,
+          _RK(debug_topic_include),
+          "Only emit the per-partition `msg` and `fetch` debug logs "
+          "for topics matching this comma-separated list of "
+          "regular expressions. Unset emits all topics." },
+        { _RK_GLOBAL, "debug.broker.include", _RK_C_PATLIST,
+          _RK(debug_broker_include),
+          "Only emit broker debug logs for brokers whose name "
+          "(\"host:port/id\") matches this comma-separated list of "
+          "regular expressions. Unset emits all brokers." },
 	{ _RK_GLOBAL, "socket.timeout.ms", _RK_C_INT, _RK(socket_timeout_ms),
 	  "Default timeout for network requests. "
           "Producer: ProduceRequests will use the lesser value of "
@@ -391,10 +424,54 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
           "become desynchronized in case of request timeouts. "
           "NOTE: The connection is automatically re-established.",
           0, 1000000, 1 },
+        { _RK_GLOBAL, "io.reactor.threads", _RK_C_INT,
+          _RK(io_reactor_threads),
+          "Number of shared I/O reactor threads serving the broker "
+          "connections. By default (0) each broker is served by its own "
+          "thread, while a non-zero value multiplexes all of the client "
+          "instance's broker connections over this many epoll-driven "
+          "threads to reduce the number of threads and context switches "
+          "when connecting to large clusters. "
+          "Only supported on Linux, ignored on other platforms.",
+          0, 128, 0 },
+        { _RK_GLOBAL, "io.uring.enable", _RK_C_BOOL,
+          _RK(io_uring_enable),
+          "Use io_uring for the data transfers of plaintext broker "
+          "connections served by the `io.reactor.threads` reactor threads: "
+          "receives are kept posted into registered buffers and sends are "
+          "submitted directly from the request buffers, batched with the "
+          "other connections of the same reactor thread, saving the "
+          "per-request readiness poll and socket system calls. "
+          "Connections using SSL or SASL, and all connections if io_uring "
+          "is not supported by the build or the running kernel, use "
+          "regular socket I/O.",
+          0, 1, 0 },
+        { _RK_GLOBAL, "socket.zerocopy.enable", _RK_C_BOOL,
+          _RK(socket_zerocopy_enable),
+          "Send large requests on plaintext broker connections with "
+          "MSG_ZEROCOPY, letting the kernel transmit directly from the "
+          "request buffers instead of copying them to the socket. "
+          "A request's response is not handled until the kernel has "
+          "released its buffers. "
+          "Requests not expecting a response (`acks=0`), SSL connections "
+          "and `io.uring.enable` connections are always copied. "
+          "Only supported on Linux 4.14 and later, ignored elsewhere. "
+          "See the `zc_tx*` broker statistics for effectiveness.",
+          0, 1, 0 },
+        { _RK_GLOBAL, "socket.zerocopy.min.bytes", _RK_C_INT,
+          _RK(socket_zerocopy_min_bytes),
+          "Minimum request size for `socket.zerocopy.enable` sends: "
+          "pinning the pages and handling the completion notification "
+          "costs more than copying small requests.",
+          0, 1000000000, 65536 },
 	{ _RK_GLOBAL, "broker.address.ttl", _RK_C_INT,
 	  _RK(broker_addr_ttl),
 	  "How long to cache the broker address resolving "
-          "results (milliseconds).",
+          "results (milliseconds). "
+          "Addresses are resolved in the background and cached "
+          "process-wide, shared by all clients. Resolve failures are "
+          "cached for the same time, and addresses in use are refreshed "
+          "before they expire.",
 	  0, 86400*1000, 1*1000 },
         { _RK_GLOBAL, "broker.address.family", _RK_C_S2I,
           _RK(broker_addr_family),
@@ -437,6 +514,63 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
 	  "register a stats callback using `rd_kafka_conf_set_stats_cb()`. "
 	  "The granularity is 1000ms. A value of 0 disables statistics.",
 	  0, 86400*1000, 0 },
+        { _RK_GLOBAL, "statistics.fields", _RK_C_S2F, _RK(stats_fields),
+          "A comma-separated list of statistics field groups to emit, "
+          "prefix a group with `-` to exclude it, e.g., "
+          "`-partition,-window`, or start with `-all` to emit only "
+          "the listed groups. "
+          "The top-level fields and totals are always emitted.",
+          .vdef = RD_KAFKA_STATS_F_ALL,
+          .s2i = {
+                        { RD_KAFKA_STATS_F_BROKER,    "broker" },
+                        { RD_KAFKA_STATS_F_TOPPARS,   "toppars" },
+                        { RD_KAFKA_STATS_F_REQ,       "req" },
+                        { RD_KAFKA_STATS_F_WINDOW,    "window" },
+                        { RD_KAFKA_STATS_F_TOPIC,     "topic" },
+                        { RD_KAFKA_STATS_F_PARTITION, "partition" },
+                        { RD_KAFKA_STATS_F_CGRP,      "cgrp" },
+                        { RD_KAFKA_STATS_F_EOS,       "eos" },
+                        { RD_KAFKA_STATS_F_ALL,       "all" }
+                } },
+        { _RK_GLOBAL, "statistics.delta", _RK_C_BOOL, _RK(stats_delta),
+          "Only emit the brokers, topics and partitions whose statistics "
+          "changed since the previous emission. The first emission is "
+          "complete. Window statistics with samples count as a change. "
+          "Emitted statistics have a top-level `\"delta\": true` field. "
+          "Only applies to the `json` `statistics.format`.",
+          0, 1, 0 },
+        { _RK_GLOBAL, "statistics.format", _RK_C_S2I, _RK(stats_format),
+          "Format of the statistics passed to the stats callback: "
+          "`json` - the JSON document described in STATISTICS.md, "
+          "`openmetrics` - OpenMetrics (Prometheus) text exposition format, "
+          "see `rd_kafka_stats_openmetrics()`.",
+          .vdef = RD_KAFKA_STATS_FORMAT_JSON,
+          .s2i = {
+                        { RD_KAFKA_STATS_FORMAT_JSON, "json" },
+                        { RD_KAFKA_STATS_FORMAT_OPENMETRICS, "openmetrics" }
+                }
+        },
+        { _RK_GLOBAL, "statistics.topic.include", _RK_C_PATLIST,
+          _RK(stats_topic_include),
+          "Only emit statistics for topics (and their partitions) matching "
+          "this comma-separated list of regular expressions. "
+          "Unset emits all topics." },
+        { _RK_GLOBAL, "statistics.topic.exclude", _RK_C_PATLIST,
+          _RK(stats_topic_exclude),
+          "Do not emit statistics for topics (and their partitions) "
+          "matching this comma-separated list of regular expressions. "
+          "Applied after `statistics.topic.include`." },
+        { _RK_GLOBAL, "statistics.broker.include", _RK_C_PATLIST,
+          _RK(stats_broker_include),
+          "Only emit statistics for brokers whose name (\"host:port/id\") "
+          "matches this comma-separated list of regular expressions. "
+          "Unset emits all brokers." },
+        { _RK_GLOBAL, "statistics.broker.exclude", _RK_C_PATLIST,
+          _RK(stats_broker_exclude),
+          "Do not emit statistics for brokers whose name "
+          "(\"host:port/id\") matches this comma-separated list of "
+          "regular expressions. "
+          "Applied after `statistics.broker.include`." },
 	{ _RK_GLOBAL, "enabled_events", _RK_C_INT,
 	  _RK(enabled_events),
 	  "See `rd_kafka_conf_set_events()`",
@@ -480,6 +614,20 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
 	  "Print internal thread name in log messages "
 	  "(useful for debugging librdkafka internals)",
 	  0, 1, 1 },
+        { _RK_GLOBAL, "log.async.ring.size", _RK_C_INT,
+          _RK(log_async_ring_size),
+          "Number of log message records in the asynchronous log ring. "
+          "When non-zero, log calls on internal threads only record the "
+          "message's format and arguments in a ring buffer and a "
+          "dedicated logging thread formats the messages and calls the "
+          "log_cb (or enqueues them on the log queue), keeping the "
+          "formatting and the callback off the broker threads when "
+          "debugging is enabled. Each record takes about 512 bytes. "
+          "Messages are dropped (and the number of dropped messages "
+          "logged and counted in the `log_drops` statistic) "
+          "when all records are in use. "
+          "The log_cb is called from the logging thread.",
+          0, 1000000, 0 },
 	{ _RK_GLOBAL, "log.connection.close", _RK_C_BOOL,
 	  _RK(log_connection_close),
 	  "Log broker disconnects. "
@@ -642,6 +790,29 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
 	_RK(ssl.keystore_password),
 	"Client's keystore (PKCS#12) password."
 	},
+        { _RK_GLOBAL, "ssl.ktls.enable", _RK_C_BOOL,
+          _RK(ssl.ktls_enable),
+          "Offload TLS record encryption and decryption to the kernel "
+          "(Linux kTLS) once the SSL handshake is done. Requests are then "
+          "written to the socket as plaintext with the regular socket "
+          "send path, while responses are still read through OpenSSL "
+          "which lets the kernel decrypt them. "
+          "Requires OpenSSL >= 3.0 built with kTLS support, the `tls` "
+          "kernel module and a cipher suite supported by the kernel, "
+          "otherwise OpenSSL performs the encryption as usual. "
+          "Enable `debug=security` to see whether kTLS is used.",
+          0, 1, 0 },
+        { _RK_GLOBAL, "ssl.session.resumption.enable", _RK_C_BOOL,
+          _RK(ssl.session_resumption),
+          "Keep the latest TLS session (session ticket or session id) "
+          "received from each broker and offer it when reconnecting to "
+          "the same broker address, allowing the broker to resume the "
+          "session with an abbreviated handshake instead of a full one. "
+          "The session is discarded if resumption fails or the broker's "
+          "address changes. "
+          "See the `tls_full_handshakes` and `tls_resumed_handshakes` "
+          "broker statistics.",
+          0, 1, 1 },
 #endif /* WITH_SSL */
 
         /* Point user in the right direction if they try to apply
@@ -849,6 +1020,22 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
 	  "This value may be overshot by fetch.message.max.bytes. "
 	  "This property has higher priority than queued.min.messages.",
           1, INT_MAX/1024, 0x100000/*1GB*/ },
+        { _RK_GLOBAL|_RK_CONSUMER, "queued.max.total.kbytes", _RK_C_INT,
+          _RK(queued_max_total_kbytes),
+          "Maximum number of kilobytes of pre-fetched messages, across "
+          "all partitions, in the local consumer queues and in outstanding "
+          "Fetch requests. "
+          "When set, each Fetch request's per-partition MaxBytes is "
+          "allocated from the remaining budget in proportion to the "
+          "partition's recent consumption rate and estimated lag, and "
+          "fetching is backed off while the budget is exhausted. "
+          "This value may be overshot by a minimal fetch size per partition "
+          "and by the rare full-size fetch needed to make progress past "
+          "a large message. "
+          "The per-partition queued.min.messages and "
+          "queued.max.messages.kbytes limits still apply. "
+          "A value of 0 disables the budget.",
+          0, INT_MAX/1024, 0 },
         { _RK_GLOBAL|_RK_CONSUMER, "fetch.wait.max.ms", _RK_C_INT,
 	  _RK(fetch_wait_max_ms),
 	  "Maximum time the broker may wait to fill the response "
@@ -890,6 +1077,75 @@ static const struct rd_kafka_property rd_kafka_properties[] = {
 	  "How long to postpone the next fetch request for a "
 	  "topic+partition in case of a fetch error.",
 	  0, 300*1000, 500 },
+        { _RK_GLOBAL|_RK_CONSUMER, "fetch.scheduler", _RK_C_S2I,
+          _RK(fetch_scheduler),
+          "Order of the partitions in each Fetch request, which decides "
+          "which partitions get the response space first when "
+          "`fetch.max.bytes` is reached: "
+          "`roundrobin` - rotate the first partition between requests, "
+          "`lag` - partitions with the largest estimated lag (in bytes) "
+          "first, "
+          "`drr` - deficit round-robin: partitions with lag accumulate "
+          "a credit of their fetch size per request, which is consumed "
+          "by the data they receive, and are ordered by credit. "
+          "With `lag` and `drr`, partitions already at the high watermark "
+          "are left out of Fetch requests while other partitions on the "
+          "same broker are lagging, but are still fetched at least "
+          "once per second.",
+          .vdef = RD_KAFKA_FETCH_SCHED_ROUNDROBIN,
+          .s2i = {
+                        { RD_KAFKA_FETCH_SCHED_ROUNDROBIN, "roundrobin" },
+                        { RD_KAFKA_FETCH_SCHED_LAG, "lag" },
+                        { RD_KAFKA_FETCH_SCHED_DRR, "drr" }
+                }
+        },
+        { _RK_GLOBAL|_RK_CONSUMER, "fetch.adaptive.sizing", _RK_C_BOOL,
+          _RK(fetch_adaptive_sizing),
+          "Adapt each partition's Fetch MaxBytes to its recent throughput "
+          "and local queue depth: the size is doubled when a partition "
+          "fills most of its requested size (lagging) and its fetch queue "
+          "is not deep, and halved when it returns little data (idle), "
+          "within 1 KB and `fetch.message.max.bytes`, but never below the "
+          "bytes consumed by the application per `fetch.wait.max.ms`. "
+          "If the sum of all partitions' sizes exceeds `fetch.max.bytes` "
+          "they are scaled down proportionally.",
+          0, 1, 0 },
+        { _RK_GLOBAL|_RK_CONSUMER, "fetch.decompress.pool.bytes", _RK_C_INT,
+          _RK(decompress_pool_size),
+          "Maximum number of bytes of unused decompression output buffers "
+          "to keep per broker for reuse. "
+          "Decompressed MessageSets are returned to the pool when the "
+          "last message referencing them is destroyed by the application. "
+          "A value of 0 disables the pool.",
+          0, INT_MAX, 8*1024*1024 },
+        { _RK_GLOBAL|_RK_CONSUMER, "fetch.copyout.ratio", _RK_C_INT,
+          _RK(fetch_copyout_ratio),
+          "Consumed messages reference the fetch response (or decompression) "
+          "buffer they were read from, keeping the entire buffer alive "
+          "until the last such message is destroyed. "
+          "When a message is handed to the application and the key and "
+          "value bytes of the messages still referencing its buffer make "
+          "up less than this percentage of the buffer size, the message's "
+          "key, value and headers are copied to a compact allocation and "
+          "the buffer reference is released. "
+          "See also `fetch.copyout.age.ms` and `fetch.copyout.max.bytes`. "
+          "A value of 0 disables the live ratio trigger.",
+          0, 100, 0 },
+        { _RK_GLOBAL|_RK_CONSUMER, "fetch.copyout.age.ms", _RK_C_INT,
+          _RK(fetch_copyout_age_ms),
+          "Copy messages to a compact allocation when they are handed to "
+          "the application if their buffer has been held by previously "
+          "delivered, not yet destroyed, messages for longer than this "
+          "(i.e., the application is retaining messages). "
+          "A value of 0 disables the age trigger.",
+          0, 86400*1000, 0 },
+        { _RK_GLOBAL|_RK_CONSUMER, "fetch.copyout.max.bytes", _RK_C_INT,
+          _RK(fetch_copyout_max_bytes),
+          "Maximum key, value and header size of a message to copy out "
+          "of its buffer by the `fetch.copyout.ratio` and "
+          "`fetch.copyout.age.ms` policies. Larger messages always "
+          "reference the fetch buffer.",
+          0, 1000000000, 65536 },
         { _RK_GLOBAL|_RK_CONSUMER|_RK_DEPRECATED, "offset.store.method",
           _RK_C_S2I,
           _RK(offset_store_method),
@@ -1275,6 +1531,80 @@ rd_kafka_conf_prop_find (int scope, const char *name) {
         return NULL;
 }
 
+
+/**
+ * @brief Parse a `debug.sample` list of "context=N" pairs, where context
+ *        is a `debug` context name (or "all"), to a mask of the sampled
+ *        debug contexts and their 1-in-N \p rates indexed by context bit.
+ *        Contexts sampled at N=1 (every message) are left out of the mask.
+ *
+ * @param val may be NULL (no sampling).
+ *
+ * @returns 0 on success or -1 on parse error.
+ */
+static int rd_kafka_conf_debug_sample_parse (const char *val, int *maskp,
+                                             int *rates) {
+        const struct rd_kafka_property *prop =
+                rd_kafka_conf_prop_find(_RK_GLOBAL, "debug");
+        const char *s = val;
+        int mask = 0;
+
+        while (s && *s) {
+                const char *t, *eq;
+                char *end;
+                size_t len;
+                long rate;
+                int ctx = 0;
+                int i;
+
+                while (*s == ' ' || *s == ',')
+                        s++;
+                if (!*s)
+                        break;
+
+                t = s;
+                while (*s && *s != ',')
+                        s++;
+
+                if (!(eq = memchr(t, '=', (size_t)(s - t))))
+                        return -1;
+
+                len = (size_t)(eq - t);
+                while (len > 0 && t[len-1] == ' ')
+                        len--;
+
+                for (i = 0 ; i < (int)RD_ARRAYSIZE(prop->s2i) &&
+                             prop->s2i[i].str ; i++) {
+                        if (strlen(prop->s2i[i].str) == len &&
+                            !strncmp(prop->s2i[i].str, t, len)) {
+                                ctx = prop->s2i[i].val;
+                                break;
+                        }
+                }
+
+                if (!ctx)
+                        return -1;
+
+                rate = strtol(eq+1, &end, 10);
+                while (*end == ' ')
+                        end++;
+                if (end == eq+1 || end != s || rate < 1 || rate > 1000000000)
+                        return -1;
+
+                for (i = 0 ; i < RD_KAFKA_DBG_CTX_CNT ; i++)
+                        if (ctx & (1 << i))
+                                rates[i] = (int)rate;
+
+                if (rate > 1)
+                        mask |= ctx;
+                else
+                        mask &= ~ctx;
+        }
+
+        *maskp = mask;
+        return 0;
+}
+
 /**
  * @returns rd_true if property has been set/modified, else rd_false.
  *          If \p name is unknown 0 is returned.
@@ -3012,6 +3342,13 @@ const char *rd_kafka_conf_finalize (rd_kafka_type_t cltype,
         }
 
 
+        if (rd_kafka_conf_debug_sample_parse(conf->debug_sample,
+                                             &conf->debug_sampled,
+                                             conf->debug_sample_rate) == -1)
+                return "`debug.sample` must be a comma-separated list of "
+                        "`context=N` pairs, where context is a `debug` "
+                        "context and N is 1..1000000000";
+
         if (!rd_kafka_conf_is_modified(conf, "metadata.max.age.ms") &&
             conf->metadata_refresh_interval_ms > 0)
                 conf->metadata_max_age_ms =
@@ -3196,9 +3533,11 @@ int unittest_conf (void) {
                         int exp_is_modified = iteration >= 3 ||
                                 (iteration > 0 && (do_set || odd));
 
-                        /* Avoid some special configs */
+                        /* Avoid some special configs, flags that default
+                         * to set do not read back as the single flag set. */
                         if (!strcmp(prop->name, "plugin.library.paths") ||
-                            !strcmp(prop->name, "builtin.features"))
+                            !strcmp(prop->name, "builtin.features") ||
+                            !strcmp(prop->name, "statistics.fields"))
                                 continue;
 
                         switch (prop->type)
@@ -3317,6 +3656,67 @@ int unittest_conf (void) {
         rd_kafka_conf_destroy(conf);
         rd_kafka_topic_conf_destroy(tconf);
 
+        /* Verify debug.sample parsing and sampling */
+        {
+                static const char *invalid[] = {
+                        "msg", "nosuchctx=10", "msg=0", "msg=10x", "=10",
+                        "msg=", NULL
+                };
+                int cnt = 0;
+                int i;
+
+                conf = rd_kafka_conf_new();
+                res = rd_kafka_conf_set(conf, "debug", "msg,fetch,broker",
+                                        errstr, sizeof(errstr));
+                RD_UT_ASSERT(res == RD_KAFKA_CONF_OK, "%s", errstr);
+                res = rd_kafka_conf_set(conf, "debug.sample",
+                                        " msg=10, fetch = 1,eos=5",
+                                        errstr, sizeof(errstr));
+                RD_UT_ASSERT(res == RD_KAFKA_CONF_OK, "%s", errstr);
+                RD_UT_ASSERT(!rd_kafka_conf_finalize(RD_KAFKA_PRODUCER, conf),
+                             "finalize failed");
+
+                RD_UT_ASSERT(conf->debug_sampled ==
+                             (RD_KAFKA_DBG_MSG|RD_KAFKA_DBG_EOS),
+                             "debug_sampled 0x%x", conf->debug_sampled);
+
+                /* msg is sampled 1 in 10, regardless of where the
+                 * thread's counter starts. */
+                for (i = 0 ; i < 100 ; i++)
+                        cnt += rd_kafka_dbg_sampled(conf, RD_KAFKA_DBG_MSG);
+                RD_UT_ASSERT(cnt == 10, "expected 10 msg logs, not %d", cnt);
+
+                /* Not sampled when combined with an unsampled context,
+                 * and eos is sampled but not enabled. */
+                for (cnt = 0, i = 0 ; i < 100 ; i++)
+                        cnt += rd_kafka_dbg_sampled(
+                                conf,
+                                RD_KAFKA_DBG_MSG|RD_KAFKA_DBG_FETCH);
+                RD_UT_ASSERT(cnt == 100, "expected 100 msg|fetch logs, not %d",
+                             cnt);
+
+                for (cnt = 0, i = 0 ; i < 100 ; i++)
+                        cnt += rd_kafka_dbg_sampled(
+                                conf,
+                                RD_KAFKA_DBG_MSG|RD_KAFKA_DBG_EOS);
+                RD_UT_ASSERT(cnt == 10, "expected 10 msg|eos logs, not %d",
+                             cnt);
+
+                rd_kafka_conf_destroy(conf);
+
+                for (i = 0 ; invalid[i] ; i++) {
+                        conf = rd_kafka_conf_new();
+                        res = rd_kafka_conf_set(conf, "debug.sample",
+                                                invalid[i],
+                                                errstr, sizeof(errstr));
+                        RD_UT_ASSERT(res == RD_KAFKA_CONF_OK, "%s", errstr);
+                        RD_UT_ASSERT(rd_kafka_conf_finalize(RD_KAFKA_PRODUCER,
+                                                            conf),
+                                     "expected \"%s\" to fail", invalid[i]);
+                        rd_kafka_conf_destroy(conf);
+                }
+        }
+
         RD_UT_PASS();
 }
 
@@ -38,6 +38,12 @@
 struct rd_kafka_transport_s;
 
 
+/**
+ * Number of debug contexts (RD_KAFKA_DBG_.. bits), see rdkafka_int.h
+ */
+#define RD_KAFKA_DBG_CTX_CNT 16
+
+
 /**
  * MessageSet compression codecs
  */
@@ -137,10 +143,42 @@ typedef enum {
         RD_KAFKA_OFFSET_METHOD_BROKER
 } rd_kafka_offset_method_t;
 
+/**
+ * @brief Ordering of partitions in Fetch requests (fetch.scheduler)
+ */
+typedef enum {
+        RD_KAFKA_FETCH_SCHED_ROUNDROBIN, /**< Rotate the start partition */
+        RD_KAFKA_FETCH_SCHED_LAG,        /**< Largest lag first */
+        RD_KAFKA_FETCH_SCHED_DRR         /**< Deficit round-robin */
+} rd_kafka_fetch_sched_t;
+
+/**
+ * @brief Statistics field groups (statistics.fields)
+ */
+typedef enum {
+        RD_KAFKA_STATS_F_BROKER    = 0x1,  /**< Broker objects */
+        RD_KAFKA_STATS_F_TOPPARS   = 0x2,  /**< Broker's partition list */
+        RD_KAFKA_STATS_F_REQ       = 0x4,  /**< Broker request counters */
+        RD_KAFKA_STATS_F_WINDOW    = 0x8,  /**< Window stats */
+        RD_KAFKA_STATS_F_TOPIC     = 0x10, /**< Topic objects */
+        RD_KAFKA_STATS_F_PARTITION = 0x20, /**< Topic's partition objects */
+        RD_KAFKA_STATS_F_CGRP      = 0x40, /**< Consumer group object */
+        RD_KAFKA_STATS_F_EOS       = 0x80, /**< Idempotent producer object */
+        RD_KAFKA_STATS_F_ALL       = 0xff
+} rd_kafka_stats_fields_t;
+
+/**
+ * @brief Statistics format (statistics.format)
+ */
+typedef enum {
+        RD_KAFKA_STATS_FORMAT_JSON,        /**< STATISTICS.md JSON */
+        RD_KAFKA_STATS_FORMAT_OPENMETRICS  /**< OpenMetrics text */
+} rd_kafka_stats_format_t;
+
 
 
 /* Increase in steps of 64 as needed. */
-#define RD_KAFKA_CONF_PROPS_IDX_MAX (64*24)
+#define RD_KAFKA_CONF_PROPS_IDX_MAX (64*25)
 
 /**
  * @struct rd_kafka_anyconf_t
@@ -171,6 +209,7 @@ struct rd_kafka_conf_s {
 	int     msg_copy_max_size;
         int     recv_max_msg_size;
 	int     max_inflight;
+        int     connections_per_broker;
 	int     metadata_request_timeout_ms;
 	int     metadata_refresh_interval_ms;
 	int     metadata_refresh_fast_cnt;
@@ -178,6 +217,15 @@ struct rd_kafka_conf_s {
         int     metadata_refresh_sparse;
         int     metadata_max_age_ms;
 	int     debug;
+        char   *debug_sample;
+        int     debug_sampled;     /**< Mask of sampled debug contexts,
+                                    *   parsed from debug_sample by
+                                    *   rd_kafka_conf_finalize(). */
+        int     debug_sample_rate[RD_KAFKA_DBG_CTX_CNT]; /**< Log 1 in N,
+                                                          *   indexed by
+                                                          *   context bit. */
+        rd_kafka_pattern_list_t *debug_topic_include;
+        rd_kafka_pattern_list_t *debug_broker_include;
 	int     broker_addr_ttl;
         int     broker_addr_family;
 	int     socket_timeout_ms;
@@ -187,9 +235,20 @@ struct rd_kafka_conf_s {
         int     socket_keepalive;
 	int     socket_nagle_disable;
         int     socket_max_fails;
+        int     io_reactor_threads;
+        int     io_uring_enable;
+        int     socket_zerocopy_enable;
+        int     socket_zerocopy_min_bytes;
 	char   *client_id_str;
 	char   *brokerlist;
 	int     stats_interval_ms;
+        int     stats_fields;      /**< rd_kafka_stats_fields_t flags */
+        int     stats_delta;
+        rd_kafka_stats_format_t stats_format;
+        rd_kafka_pattern_list_t *stats_topic_include;
+        rd_kafka_pattern_list_t *stats_topic_exclude;
+        rd_kafka_pattern_list_t *stats_broker_include;
+        rd_kafka_pattern_list_t *stats_broker_exclude;
 	int     term_sig;
         int     reconnect_backoff_ms;
         int     reconnect_backoff_max_ms;
@@ -217,6 +276,8 @@ struct rd_kafka_conf_s {
 		char *crl_location;
 		char *keystore_location;
 		char *keystore_password;
+                int   ktls_enable;
+                int   session_resumption;
 	} ssl;
 #endif
 
@@ -282,11 +343,19 @@ struct rd_kafka_conf_s {
 	int    queued_min_msgs;
         int    queued_max_msg_kbytes;
         int64_t queued_max_msg_bytes;
+        int    queued_max_total_kbytes;
+        int64_t queued_max_total_bytes;
 	int    fetch_wait_max_ms;
         int    fetch_msg_max_bytes;
         int    fetch_max_bytes;
 	int    fetch_min_bytes;
 	int    fetch_error_backoff_ms;
+        int    fetch_adaptive_sizing;
+        rd_kafka_fetch_sched_t fetch_scheduler;
+        int    decompress_pool_size;
+        int    fetch_copyout_ratio;
+        int    fetch_copyout_age_ms;
+        int    fetch_copyout_max_bytes;
         char  *group_id_str;
 
         rd_kafka_pattern_list_t *topic_blacklist;
@@ -370,6 +439,7 @@ struct rd_kafka_conf_s {
         int    log_level;
         int    log_queue;
         int    log_thread_name;
+        int    log_async_ring_size;
         int    log_connection_close;
 
         /* Error callback */
@@ -189,6 +189,8 @@ struct rd_kafka_s {
 
         rd_kafka_conf_t  rk_conf;
         rd_kafka_q_t    *rk_logq;          /* Log queue if `log.queue` set */
+        struct rd_kafka_logring_s *rk_logring; /* Asynchronous log ring if
+                                                * `log.async.ring.size` set */
         char             rk_name[128];
 	rd_kafkap_str_t *rk_client_id;
         rd_kafkap_str_t *rk_group_id;    /* Consumer group id */
@@ -247,6 +249,14 @@ struct rd_kafka_s {
                                              *   Used to enforce
                                              *   max.poll.interval.ms.
                                              *   Only relevant for consumer. */
+        rd_atomic64_t    rk_ts_last_poll_return; /**< Timestamp of the
+                                                  *   last return from
+                                                  *   an application
+                                                  *   poll call. */
+        rd_avg_t         rk_avg_poll_gap;   /**< Time between application
+                                             *   poll calls, from the return
+                                             *   of one to the next call
+                                             *   (consumer) */
         /* First fatal error. */
         struct {
                 rd_atomic32_t err; /**< rd_kafka_resp_err_t */
@@ -306,6 +316,36 @@ struct rd_kafka_s {
 		size_t max_size; /* Max limit */
 	} rk_curr_msgs;
 
+        /**
+         * Consumed message fetch buffer accounting,
+         * see rd_kafka_op_fetch_msg_deliver().
+         */
+        struct {
+                rd_atomic64_t pinned_bytes;  /**< Size of fetch buffers
+                                              *   referenced by messages
+                                              *   held by the application. */
+                rd_atomic64_t live_bytes;    /**< Key and value bytes of
+                                              *   those messages. */
+                rd_atomic64_t copyout_cnt;   /**< Messages copied out of
+                                              *   their fetch buffer. */
+                rd_atomic64_t copyout_bytes; /**< Bytes copied out. */
+        } rk_fetchbuf;
+
+        /**
+         * Consumer prefetch budget, see queued.max.total.kbytes.
+         */
+        struct {
+                rd_atomic64_t queued_bytes;   /**< Key and value bytes of
+                                               *   fetched messages not yet
+                                               *   handed to the
+                                               *   application. */
+                rd_atomic64_t inflight_bytes; /**< MaxBytes reserved by
+                                               *   outstanding Fetch
+                                               *   requests. */
+                rd_atomic64_t exhausted_cnt;  /**< Fetches held back due
+                                               *   to exhausted budget. */
+        } rk_prefetch;
+
         rd_kafka_timers_t rk_timers;
 	thrd_t rk_thread;
 
@@ -333,6 +373,14 @@ struct rd_kafka_s {
                                    *   purposes. */
         } rk_background;
 
+        /**
+         * Shared broker I/O reactor threads, see io.reactor.threads.
+         * Set up by rd_kafka_new() prior to adding any brokers and
+         * not modified thereafter.
+         */
+        struct rd_kafka_reactor_s **rk_reactors;
+        int rk_reactor_cnt;
+
 
         /*
          * Logs, events or actions to rate limit / suppress
@@ -543,6 +591,8 @@ int rd_kafka_simple_consumer_add (rd_kafka_t *rk);
 #define RD_KAFKA_PURGE_F_MASK 0x7
 const char *rd_kafka_purge_flags2str (int flags);
 
+const char *rd_kafka_type2str (rd_kafka_type_t type);
+
 
 #include "rdkafka_topic.h"
 #include "rdkafka_partition.h"
@@ -587,17 +637,33 @@ void rd_kafka_log0(const rd_kafka_conf_t *conf,
                    const char *fac, const char *fmt, ...) RD_FORMAT(printf,
                                                                     6, 7);
 
+rd_bool_t rd_kafka_dbg_sample (const rd_kafka_conf_t *conf, int ctx);
+
+/**
+ * @returns true unless all enabled debug contexts in \p ctx are sampled
+ *          (`debug.sample`) and this message is sampled out.
+ *          Only evaluated once \p ctx is known to be enabled, and costs
+ *          a single branch for contexts that are not sampled.
+ */
+#define rd_kafka_dbg_sampled(conf,ctx)                                  \
+        (likely(!((conf)->debug_sampled & (ctx))) ||                    \
+         rd_kafka_dbg_sample(conf, ctx))
+
 #define rd_kafka_log(rk,level,fac,...) \
         rd_kafka_log0(&rk->rk_conf, rk, NULL, level, fac, __VA_ARGS__)
 #define rd_kafka_dbg(rk,ctx,fac,...) do {                               \
-                if (unlikely((rk)->rk_conf.debug & (RD_KAFKA_DBG_ ## ctx))) \
+                if (unlikely((rk)->rk_conf.debug &                      \
+                             (RD_KAFKA_DBG_ ## ctx)) &&                 \
+                    rd_kafka_dbg_sampled(&(rk)->rk_conf,                \
+                                         (RD_KAFKA_DBG_ ## ctx)))       \
                         rd_kafka_log0(&rk->rk_conf,rk,NULL,             \
                                       LOG_DEBUG,fac,__VA_ARGS__);       \
         } while (0)
 
 /* dbg() not requiring an rk, just the conf object, for early logging */
 #define rd_kafka_dbg0(conf,ctx,fac,...) do {                            \
-                if (unlikely((conf)->debug & (RD_KAFKA_DBG_ ## ctx)))   \
+                if (unlikely((conf)->debug & (RD_KAFKA_DBG_ ## ctx)) && \
+                    rd_kafka_dbg_sampled(conf, (RD_KAFKA_DBG_ ## ctx))) \
                         rd_kafka_log0(conf,NULL,NULL,                   \
                                       LOG_DEBUG,fac,__VA_ARGS__);       \
         } while (0)
@@ -617,7 +683,23 @@ void rd_kafka_log0(const rd_kafka_conf_t *conf,
 
 #define rd_rkb_dbg(rkb,ctx,fac,...) do {				\
 		if (unlikely((rkb)->rkb_rk->rk_conf.debug &		\
-			     (RD_KAFKA_DBG_ ## ctx))) {			\
+			     (RD_KAFKA_DBG_ ## ctx)) &&			\
+                    !(rkb)->rkb_dbg_filtered &&                         \
+                    rd_kafka_dbg_sampled(&(rkb)->rkb_rk->rk_conf,       \
+                                         (RD_KAFKA_DBG_ ## ctx))) {     \
+			rd_rkb_log(rkb, LOG_DEBUG, fac, __VA_ARGS__);	\
+                }                                                       \
+	} while (0)
+
+/* rd_rkb_dbg() for per-partition messages, also subject to
+ * `debug.topic.include`. */
+#define rd_rkb_dbg_rktp(rkb,rktp,ctx,fac,...) do {                      \
+		if (unlikely((rkb)->rkb_rk->rk_conf.debug &		\
+			     (RD_KAFKA_DBG_ ## ctx)) &&			\
+                    !(rkb)->rkb_dbg_filtered &&                         \
+                    !(rktp)->rktp_rkt->rkt_dbg_filtered &&              \
+                    rd_kafka_dbg_sampled(&(rkb)->rkb_rk->rk_conf,       \
+                                         (RD_KAFKA_DBG_ ## ctx))) {     \
 			rd_rkb_log(rkb, LOG_DEBUG, fac, __VA_ARGS__);	\
                 }                                                       \
 	} while (0)
@@ -688,7 +770,9 @@ rd_kafka_max_poll_exceeded (rd_kafka_t *rk) {
 }
 
 /**
- * @brief Set the last application poll time to now.
+ * @brief Set the last application poll time to now and sample the
+ *        time the application spent outside of poll calls since the
+ *        previous poll returned.
  *
  * @remark Only relevant for high-level consumer.
  *
@@ -697,7 +781,24 @@ rd_kafka_max_poll_exceeded (rd_kafka_t *rk) {
  */
 static RD_INLINE RD_UNUSED void
 rd_kafka_app_polled (rd_kafka_t *rk) {
-        rd_atomic64_set(&rk->rk_ts_last_poll, rd_clock());
+        rd_ts_t now = rd_clock();
+
+        rd_avg_add(&rk->rk_avg_poll_gap,
+                   now - rd_atomic64_get(&rk->rk_ts_last_poll_return));
+        rd_atomic64_set(&rk->rk_ts_last_poll, now);
+}
+
+/**
+ * @brief Set the time of the application poll call's return to now,
+ *        the time spent blocking in the call is not part of the
+ *        poll gap sampled by the next rd_kafka_app_polled().
+ *
+ * @locality any
+ * @locks none
+ */
+static RD_INLINE RD_UNUSED void
+rd_kafka_app_poll_return (rd_kafka_t *rk) {
+        rd_atomic64_set(&rk->rk_ts_last_poll_return, rd_clock());
 }
 
 
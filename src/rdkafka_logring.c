@@ -0,0 +1,1176 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2019 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Asynchronous log ring, see rdkafka_logring.h
+ */
+
+#include "rdkafka_int.h"
+#include "rdkafka_logring.h"
+#include "rdinterval.h"
+#include "rdunittest.h"
+
+#include <stdarg.h>
+
+
+/**< Record payload size: thread name and extra prefix followed by
+ *   either the binary arguments or the preformatted message. */
+#define RD_KAFKA_LOGRING_DATA_SIZE    448
+
+/**< Maximum length of the prefix ("[thrd:..]: extra: ") */
+#define RD_KAFKA_LOGRING_PREFIX_MAX   160
+
+/**< Maximum length of a single conversion specification */
+#define RD_KAFKA_LOGRING_SPEC_MAX     32
+
+/**< Minimum interval between dropped message reports */
+#define RD_KAFKA_LOGRING_DROP_INTVL   (1000*1000)
+
+
+typedef struct rd_kafka_logring_rec_s {
+        rd_atomic32_t ready;  /**< Set by the producer when the record
+                               *   is complete, cleared by the logging
+                               *   thread when served. */
+        int level;
+        const char *fmt;      /**< Format string (literal), or NULL if
+                               *   data holds the formatted message. */
+        char fac[32];
+        uint16_t prefixlen;   /**< Prefix bytes at the start of data */
+        uint16_t argslen;     /**< Argument bytes following the prefix */
+        char data[RD_KAFKA_LOGRING_DATA_SIZE];
+} rd_kafka_logring_rec_t;
+
+
+struct rd_kafka_logring_s {
+        rd_kafka_t *rlr_rk;
+        rd_kafka_logring_dispatch_t *rlr_dispatch;
+
+        rd_kafka_logring_rec_t *rlr_recs;
+        int          rlr_size;       /**< Number of records */
+
+        rd_atomic32_t rlr_used;      /**< Records admitted but not yet
+                                      *   served, at most rlr_size. */
+        rd_atomic64_t rlr_head;      /**< Next record position to claim */
+        uint64_t     rlr_tail;       /**< Next record position to serve.
+                                      *   @locality logging thread */
+
+        rd_atomic64_t rlr_drops;     /**< Dropped log messages */
+        int64_t      rlr_drops_reported; /**< @locality logging thread */
+        rd_interval_t rlr_drop_intvl;    /**< @locality logging thread */
+
+        rd_atomic32_t rlr_idle;      /**< 1: logging thread is (about to
+                                      *   be) waiting on rlr_cnd and
+                                      *   needs to be signalled. */
+        mtx_t        rlr_lock;
+        cnd_t        rlr_cnd;
+        rd_bool_t    rlr_terminate;  /**< @locks rlr_lock */
+        thrd_t       rlr_thread;
+};
+
+
+/**
+ * @brief Argument type of a conversion specification.
+ */
+typedef enum {
+        RD_KAFKA_LOGRING_ARG_NONE,     /**< %% */
+        RD_KAFKA_LOGRING_ARG_INT,
+        RD_KAFKA_LOGRING_ARG_LONG,
+        RD_KAFKA_LOGRING_ARG_LLONG,
+        RD_KAFKA_LOGRING_ARG_INTMAX,
+        RD_KAFKA_LOGRING_ARG_SIZE,
+        RD_KAFKA_LOGRING_ARG_PTRDIFF,
+        RD_KAFKA_LOGRING_ARG_DOUBLE,
+        RD_KAFKA_LOGRING_ARG_LDOUBLE,
+        RD_KAFKA_LOGRING_ARG_PTR,
+        RD_KAFKA_LOGRING_ARG_STR,
+        RD_KAFKA_LOGRING_ARG_UNSUPPORTED
+} rd_kafka_logring_arg_t;
+
+typedef struct rd_kafka_logring_spec_s {
+        size_t len;          /**< Length of the specification, including
+                              *   the '%' and the conversion character */
+        int stars;           /**< Number of '*' width/precision args */
+        rd_bool_t star_prec; /**< The precision is the last '*' arg */
+        int prec;            /**< Literal precision, or -1 */
+        rd_kafka_logring_arg_t type;
+} rd_kafka_logring_spec_t;
+
+
+/**
+ * @brief Parse the printf conversion specification starting at the
+ *        '%' at \p s into \p spec.
+ *
+ * Both the recording and the formatting side parse the format string
+ * with this function, so they agree on the argument layout.
+ */
+static void rd_kafka_logring_spec_parse (const char *s,
+                                         rd_kafka_logring_spec_t *spec) {
+        const char *p = s + 1;
+        enum { LM_NONE, LM_H, LM_L, LM_LL, LM_J, LM_Z, LM_T, LM_BIGL } lm =
+                LM_NONE;
+
+        spec->stars     = 0;
+        spec->star_prec = rd_false;
+        spec->prec      = -1;
+
+        /* Flags */
+        while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' ||
+               *p == '0' || *p == '\'')
+                p++;
+
+        /* Width */
+        if (*p == '*') {
+                spec->stars++;
+                p++;
+        } else {
+                while (*p >= '0' && *p <= '9')
+                        p++;
+        }
+
+        /* Precision */
+        if (*p == '.') {
+                p++;
+                if (*p == '*') {
+                        spec->stars++;
+                        spec->star_prec = rd_true;
+                        p++;
+                } else {
+                        spec->prec = 0;
+                        while (*p >= '0' && *p <= '9')
+                                spec->prec = spec->prec * 10 + (*p++ - '0');
+                }
+        }
+
+        /* Length modifier */
+        switch (*p)
+        {
+        case 'h':
+                p++;
+                lm = LM_H;
+                if (*p == 'h')
+                        p++;
+                break;
+        case 'l':
+                p++;
+                lm = LM_L;
+                if (*p == 'l') {
+                        p++;
+                        lm = LM_LL;
+                }
+                break;
+        case 'q':
+                p++;
+                lm = LM_LL;
+                break;
+        case 'j':
+                p++;
+                lm = LM_J;
+                break;
+        case 'z':
+                p++;
+                lm = LM_Z;
+                break;
+        case 't':
+                p++;
+                lm = LM_T;
+                break;
+        case 'L':
+                p++;
+                lm = LM_BIGL;
+                break;
+        case 'I':
+                /* MSVC: I64, I32 and I (size_t) */
+                p++;
+                if (p[0] == '6' && p[1] == '4') {
+                        p += 2;
+                        lm = LM_LL;
+                } else if (p[0] == '3' && p[1] == '2') {
+                        p += 2;
+                } else
+                        lm = LM_Z;
+                break;
+        }
+
+        /* Conversion */
+        switch (*p)
+        {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+        case 'c':
+                switch (lm)
+                {
+                case LM_NONE:
+                case LM_H:
+                        spec->type = RD_KAFKA_LOGRING_ARG_INT;
+                        break;
+                case LM_L:
+                        spec->type = *p == 'c' ?
+                                RD_KAFKA_LOGRING_ARG_UNSUPPORTED :
+                                RD_KAFKA_LOGRING_ARG_LONG;
+                        break;
+                case LM_LL:
+                        spec->type = RD_KAFKA_LOGRING_ARG_LLONG;
+                        break;
+                case LM_J:
+                        spec->type = RD_KAFKA_LOGRING_ARG_INTMAX;
+                        break;
+                case LM_Z:
+                        spec->type = RD_KAFKA_LOGRING_ARG_SIZE;
+                        break;
+                case LM_T:
+                        spec->type = RD_KAFKA_LOGRING_ARG_PTRDIFF;
+                        break;
+                default:
+                        spec->type = RD_KAFKA_LOGRING_ARG_UNSUPPORTED;
+                        break;
+                }
+                break;
+
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+                spec->type = lm == LM_BIGL ? RD_KAFKA_LOGRING_ARG_LDOUBLE :
+                        RD_KAFKA_LOGRING_ARG_DOUBLE;
+                break;
+
+        case 'p':
+                spec->type = RD_KAFKA_LOGRING_ARG_PTR;
+                break;
+
+        case 's':
+                spec->type = lm == LM_L ? RD_KAFKA_LOGRING_ARG_UNSUPPORTED :
+                        RD_KAFKA_LOGRING_ARG_STR;
+                break;
+
+        case '%':
+                spec->type = p == s + 1 ? RD_KAFKA_LOGRING_ARG_NONE :
+                        RD_KAFKA_LOGRING_ARG_UNSUPPORTED;
+                break;
+
+        default:
+                /* %n, unknown conversions and truncated specifications */
+                spec->type = RD_KAFKA_LOGRING_ARG_UNSUPPORTED;
+                break;
+        }
+
+        spec->len = (size_t)(p - s) + (*p ? 1 : 0);
+}
+
+
+/**
+ * @brief Append at most \p len bytes of \p str to the prefix buffer \p dst
+ *        of \p size bytes at offset \p *ofp.
+ */
+static RD_INLINE void rd_kafka_logring_prefix_append (char *dst, size_t size,
+                                                      size_t *ofp,
+                                                      const char *str,
+                                                      size_t len) {
+        if (len > size - *ofp)
+                len = size - *ofp;
+        memcpy(dst + *ofp, str, len);
+        *ofp += len;
+}
+
+
+/**
+ * @brief Copy the arguments \p ap of format \p fmt to \p rec's data
+ *        following the prefix.
+ *
+ * @returns rd_false if the arguments do not fit in the record or the
+ *          format can't be replayed, in which case the record must be
+ *          formatted by the caller instead.
+ */
+static rd_bool_t rd_kafka_logring_rec_args (rd_kafka_logring_rec_t *rec,
+                                            const char *fmt, va_list ap) {
+        char *d = rec->data + rec->prefixlen;
+        size_t size = sizeof(rec->data) - rec->prefixlen;
+        size_t of = 0;
+        const char *f;
+
+#define _PUT(TYPE) do {                                                 \
+                TYPE _v = va_arg(ap, TYPE);                             \
+                if (of + sizeof(_v) > size)                             \
+                        return rd_false;                                \
+                memcpy(d + of, &_v, sizeof(_v));                        \
+                of += sizeof(_v);                                       \
+        } while (0)
+
+        for (f = fmt ; (f = strchr(f, '%')) ; ) {
+                rd_kafka_logring_spec_t spec;
+                int prec;
+                int i;
+
+                rd_kafka_logring_spec_parse(f, &spec);
+                f += spec.len;
+
+                if (spec.type == RD_KAFKA_LOGRING_ARG_NONE)
+                        continue;
+                else if (spec.type == RD_KAFKA_LOGRING_ARG_UNSUPPORTED ||
+                         spec.len >= RD_KAFKA_LOGRING_SPEC_MAX)
+                        return rd_false;
+
+                prec = spec.prec;
+                for (i = 0 ; i < spec.stars ; i++) {
+                        int v = va_arg(ap, int);
+
+                        if (of + sizeof(v) > size)
+                                return rd_false;
+                        memcpy(d + of, &v, sizeof(v));
+                        of += sizeof(v);
+
+                        if (spec.star_prec && i == spec.stars - 1)
+                                prec = v;
+                }
+
+                switch (spec.type)
+                {
+                case RD_KAFKA_LOGRING_ARG_INT:
+                        _PUT(int);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_LONG:
+                        _PUT(long);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_LLONG:
+                        _PUT(long long);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_INTMAX:
+                        _PUT(intmax_t);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_SIZE:
+                        _PUT(size_t);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_PTRDIFF:
+                        _PUT(ptrdiff_t);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_DOUBLE:
+                        _PUT(double);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_LDOUBLE:
+                        _PUT(long double);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_PTR:
+                        _PUT(void *);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_STR:
+                {
+                        const char *str = va_arg(ap, const char *);
+                        uint16_t len;
+                        size_t slen = 0;
+
+                        if (!str) {
+                                len = UINT16_MAX;
+                        } else {
+                                /* The string is not necessarily
+                                 * nul-terminated if a precision is given
+                                 * (e.g., "%.*s"). */
+                                if (prec >= 0)
+                                        while ((int)slen < prec && str[slen])
+                                                slen++;
+                                else
+                                        slen = strlen(str);
+
+                                if (slen >= UINT16_MAX)
+                                        return rd_false;
+                                len = (uint16_t)slen;
+                        }
+
+                        if (of + sizeof(len) + slen + 1 > size)
+                                return rd_false;
+                        memcpy(d + of, &len, sizeof(len));
+                        of += sizeof(len);
+
+                        if (str) {
+                                memcpy(d + of, str, slen);
+                                d[of + slen] = '\0';
+                                of += slen + 1;
+                        }
+                        break;
+                }
+                default:
+                        RD_NOTREACHED();
+                        break;
+                }
+        }
+
+#undef _PUT
+
+        rec->argslen = (uint16_t)of;
+        return rd_true;
+}
+
+
+/**
+ * @brief Format record \p rec to \p out of \p size bytes.
+ */
+static void rd_kafka_logring_rec_format (const rd_kafka_logring_rec_t *rec,
+                                         char *out, size_t size) {
+        const char *d = rec->data + rec->prefixlen;
+        size_t dof = 0;
+        size_t of;
+        const char *f;
+
+        of = RD_MIN(rec->prefixlen, size - 1);
+        memcpy(out, rec->data, of);
+
+        if (!rec->fmt) {
+                rd_snprintf(out + of, size - of, "%s", d);
+                return;
+        }
+
+#define _GET(V) do {                                                    \
+                memcpy(&(V), d + dof, sizeof(V));                       \
+                dof += sizeof(V);                                       \
+        } while (0)
+
+        for (f = rec->fmt ; *f && of < size - 1 ; ) {
+                rd_kafka_logring_spec_t spec;
+                char specbuf[RD_KAFKA_LOGRING_SPEC_MAX];
+                int w[2] = { 0, 0 };
+                int r = 0;
+                int i;
+
+                if (*f != '%') {
+                        out[of++] = *f++;
+                        continue;
+                }
+
+                rd_kafka_logring_spec_parse(f, &spec);
+                if (spec.type == RD_KAFKA_LOGRING_ARG_NONE) {
+                        out[of++] = '%';
+                        f += spec.len;
+                        continue;
+                }
+
+                memcpy(specbuf, f, spec.len);
+                specbuf[spec.len] = '\0';
+                f += spec.len;
+
+                for (i = 0 ; i < spec.stars ; i++)
+                        _GET(w[i]);
+
+#define _FMT(TYPE) do {                                                 \
+                        TYPE _v;                                        \
+                        _GET(_v);                                       \
+                        if (spec.stars == 0)                            \
+                                r = rd_snprintf(out + of, size - of,    \
+                                                specbuf, _v);           \
+                        else if (spec.stars == 1)                       \
+                                r = rd_snprintf(out + of, size - of,    \
+                                                specbuf, w[0], _v);     \
+                        else                                            \
+                                r = rd_snprintf(out + of, size - of,    \
+                                                specbuf, w[0], w[1],    \
+                                                _v);                    \
+                } while (0)
+
+                switch (spec.type)
+                {
+                case RD_KAFKA_LOGRING_ARG_INT:
+                        _FMT(int);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_LONG:
+                        _FMT(long);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_LLONG:
+                        _FMT(long long);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_INTMAX:
+                        _FMT(intmax_t);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_SIZE:
+                        _FMT(size_t);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_PTRDIFF:
+                        _FMT(ptrdiff_t);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_DOUBLE:
+                        _FMT(double);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_LDOUBLE:
+                        _FMT(long double);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_PTR:
+                        _FMT(void *);
+                        break;
+                case RD_KAFKA_LOGRING_ARG_STR:
+                {
+                        uint16_t len;
+                        const char *str = "(null)";
+
+                        _GET(len);
+                        if (len != UINT16_MAX) {
+                                str = d + dof;
+                                dof += len + 1;
+                        }
+                        if (spec.stars == 0)
+                                r = rd_snprintf(out + of, size - of,
+                                                specbuf, str);
+                        else if (spec.stars == 1)
+                                r = rd_snprintf(out + of, size - of,
+                                                specbuf, w[0], str);
+                        else
+                                r = rd_snprintf(out + of, size - of,
+                                                specbuf, w[0], w[1], str);
+                        break;
+                }
+                default:
+                        /* Not recorded */
+                        RD_NOTREACHED();
+                        break;
+                }
+
+#undef _FMT
+
+                if (r < 0)
+                        break;
+                of += (size_t)r;
+        }
+
+#undef _GET
+
+        if (of > size - 1)
+                of = size - 1;
+        out[of] = '\0';
+}
+
+
+/**
+ * @brief Record a log message, see rdkafka_logring.h.
+ *
+ * @returns rd_false if the message was not recorded (nor dropped) and
+ *          must be logged synchronously by the caller, which is the case
+ *          when logging from the logging thread itself.
+ *
+ * @locality any thread
+ */
+rd_bool_t rd_kafka_logring_vlog (rd_kafka_logring_t *rlr, int level,
+                                 const char *fac, const char *thrd_name,
+                                 const char *extra,
+                                 const char *fmt, va_list ap) {
+        rd_kafka_logring_rec_t *rec;
+        uint64_t pos;
+        size_t of = 0;
+        va_list ap2;
+
+        if (unlikely(thrd_is_current(rlr->rlr_thread)))
+                return rd_false;
+
+        /* Admission: at most rlr_size records in use, which also
+         * guarantees that the claimed position's record has been
+         * served by the logging thread. */
+        if (unlikely(rd_atomic32_add(&rlr->rlr_used, 1) > rlr->rlr_size)) {
+                rd_atomic32_sub(&rlr->rlr_used, 1);
+                rd_atomic64_add(&rlr->rlr_drops, 1);
+                return rd_true;
+        }
+
+        pos = (uint64_t)rd_atomic64_add(&rlr->rlr_head, 1) - 1;
+        rec = &rlr->rlr_recs[pos % (uint64_t)rlr->rlr_size];
+
+        rec->level = level;
+        strncpy(rec->fac, fac, sizeof(rec->fac) - 1);
+        rec->fac[sizeof(rec->fac) - 1] = '\0';
+
+        if (thrd_name) {
+                rd_kafka_logring_prefix_append(rec->data,
+                                               RD_KAFKA_LOGRING_PREFIX_MAX,
+                                               &of, "[thrd:", 6);
+                rd_kafka_logring_prefix_append(rec->data,
+                                               RD_KAFKA_LOGRING_PREFIX_MAX,
+                                               &of, thrd_name,
+                                               strlen(thrd_name));
+                rd_kafka_logring_prefix_append(rec->data,
+                                               RD_KAFKA_LOGRING_PREFIX_MAX,
+                                               &of, "]: ", 3);
+        }
+        if (extra) {
+                rd_kafka_logring_prefix_append(rec->data,
+                                               RD_KAFKA_LOGRING_PREFIX_MAX,
+                                               &of, extra, strlen(extra));
+                rd_kafka_logring_prefix_append(rec->data,
+                                               RD_KAFKA_LOGRING_PREFIX_MAX,
+                                               &of, ": ", 2);
+        }
+        rec->prefixlen = (uint16_t)of;
+
+        va_copy(ap2, ap);
+        if (rd_kafka_logring_rec_args(rec, fmt, ap2)) {
+                rec->fmt = fmt;
+        } else {
+                rec->fmt = NULL;
+                rd_vsnprintf(rec->data + of, sizeof(rec->data) - of, fmt, ap);
+        }
+        va_end(ap2);
+
+        /* Publish the record */
+        rd_atomic32_set(&rec->ready, 1);
+
+        /* Only the producer clearing the idle flag signals the logging
+         * thread, the others must not contend for its lock while it is
+         * waking up. */
+        if (rd_atomic32_get(&rlr->rlr_idle) > 0 &&
+            rd_atomic32_sub(&rlr->rlr_idle, 1) == 0) {
+                mtx_lock(&rlr->rlr_lock);
+                cnd_signal(&rlr->rlr_cnd);
+                mtx_unlock(&rlr->rlr_lock);
+        }
+
+        return rd_true;
+}
+
+
+/**
+ * @returns the number of log messages dropped due to the ring being full.
+ */
+int64_t rd_kafka_logring_drops (rd_kafka_logring_t *rlr) {
+        return rd_atomic64_get(&rlr->rlr_drops);
+}
+
+
+/**
+ * @brief Format and dispatch the next record, if ready.
+ *
+ * @returns rd_true if a record was served.
+ *
+ * @locality logging thread
+ */
+static rd_bool_t rd_kafka_logring_serve_one (rd_kafka_logring_t *rlr) {
+        rd_kafka_logring_rec_t *rec =
+                &rlr->rlr_recs[rlr->rlr_tail % (uint64_t)rlr->rlr_size];
+        char buf[2048];
+
+        if (!rd_atomic32_get(&rec->ready))
+                return rd_false;
+
+        rd_kafka_logring_rec_format(rec, buf, sizeof(buf));
+        rlr->rlr_dispatch(rlr->rlr_rk, rec->level, rec->fac, buf);
+
+        rd_atomic32_set(&rec->ready, 0);
+        rlr->rlr_tail++;
+        rd_atomic32_sub(&rlr->rlr_used, 1);
+
+        return rd_true;
+}
+
+
+/**
+ * @brief Report dropped log messages, at most once per
+ *        RD_KAFKA_LOGRING_DROP_INTVL.
+ *
+ * @locality logging thread
+ */
+static void rd_kafka_logring_report_drops (rd_kafka_logring_t *rlr) {
+        int64_t drops = rd_atomic64_get(&rlr->rlr_drops);
+        char buf[256];
+
+        if (likely(drops == rlr->rlr_drops_reported) ||
+            rd_interval(&rlr->rlr_drop_intvl,
+                        RD_KAFKA_LOGRING_DROP_INTVL, 0) <= 0)
+                return;
+
+        rd_snprintf(buf, sizeof(buf),
+                    "%"PRId64" log message(s) dropped: "
+                    "all %d log.async.ring.size records in use",
+                    drops - rlr->rlr_drops_reported, rlr->rlr_size);
+        rlr->rlr_drops_reported = drops;
+
+        rlr->rlr_dispatch(rlr->rlr_rk, LOG_WARNING, "LOGDROP", buf);
+}
+
+
+static int rd_kafka_logring_thread_main (void *arg) {
+        rd_kafka_logring_t *rlr = arg;
+
+        rd_kafka_set_thread_name("log");
+        rd_kafka_set_thread_sysname("rdk:log");
+
+        (void)rd_atomic32_add(&rd_kafka_thread_cnt_curr, 1);
+
+        while (1) {
+                rd_bool_t terminate;
+
+                while (rd_kafka_logring_serve_one(rlr))
+                        ;
+
+                rd_kafka_logring_report_drops(rlr);
+
+                mtx_lock(&rlr->rlr_lock);
+                rd_atomic32_set(&rlr->rlr_idle, 1);
+                /* Producers set the record's ready flag before checking
+                 * rlr_idle, so either the record is seen as ready here
+                 * or the producer signals rlr_cnd. */
+                terminate = rlr->rlr_terminate;
+                if (!terminate && !rd_kafka_logring_serve_one(rlr))
+                        cnd_timedwait_ms(&rlr->rlr_cnd, &rlr->rlr_lock, 1000);
+                rd_atomic32_set(&rlr->rlr_idle, 0);
+                mtx_unlock(&rlr->rlr_lock);
+
+                /* All other threads have stopped logging when
+                 * terminating: done when all records are served. */
+                if (terminate && rd_atomic32_get(&rlr->rlr_used) == 0)
+                        break;
+        }
+
+        rd_kafka_logring_report_drops(rlr);
+
+        rd_atomic32_sub(&rd_kafka_thread_cnt_curr, 1);
+
+        return 0;
+}
+
+
+/**
+ * @brief Create a log ring of \p size records and start its logging
+ *        thread, which passes formatted messages to \p dispatch.
+ *
+ * The caller should block signals, the logging thread inherits the
+ * caller's signal mask.
+ *
+ * @returns the log ring, or NULL on failure (\p errstr set).
+ *
+ * @locality application thread calling rd_kafka_new()
+ */
+rd_kafka_logring_t *rd_kafka_logring_new (rd_kafka_t *rk, int size,
+                                          rd_kafka_logring_dispatch_t
+                                          *dispatch,
+                                          char *errstr, size_t errstr_size) {
+        rd_kafka_logring_t *rlr;
+        int i;
+
+        rd_assert(size > 0);
+
+        rlr = rd_calloc(1, sizeof(*rlr));
+        rlr->rlr_rk       = rk;
+        rlr->rlr_dispatch = dispatch;
+        rlr->rlr_size     = size;
+        rlr->rlr_recs     = rd_malloc(sizeof(*rlr->rlr_recs) * (size_t)size);
+        for (i = 0 ; i < size ; i++)
+                rd_atomic32_init(&rlr->rlr_recs[i].ready, 0);
+
+        rd_atomic32_init(&rlr->rlr_used, 0);
+        rd_atomic64_init(&rlr->rlr_head, 0);
+        rd_atomic64_init(&rlr->rlr_drops, 0);
+        rd_atomic32_init(&rlr->rlr_idle, 0);
+        rd_interval_init(&rlr->rlr_drop_intvl);
+        mtx_init(&rlr->rlr_lock, mtx_plain);
+        cnd_init(&rlr->rlr_cnd);
+
+        if (thrd_create(&rlr->rlr_thread,
+                        rd_kafka_logring_thread_main, rlr) != thrd_success) {
+                rd_snprintf(errstr, errstr_size,
+                            "Failed to create logging thread: %s",
+                            rd_strerror(errno));
+                cnd_destroy(&rlr->rlr_cnd);
+                mtx_destroy(&rlr->rlr_lock);
+                rd_free(rlr->rlr_recs);
+                rd_free(rlr);
+                return NULL;
+        }
+
+        return rlr;
+}
+
+
+/**
+ * @brief Serve all remaining records, stop the logging thread and
+ *        destroy the log ring.
+ *
+ * No other thread may log to the ring at this point.
+ *
+ * @locality application thread
+ */
+void rd_kafka_logring_destroy (rd_kafka_logring_t *rlr) {
+        int res;
+
+        mtx_lock(&rlr->rlr_lock);
+        rlr->rlr_terminate = rd_true;
+        cnd_signal(&rlr->rlr_cnd);
+        mtx_unlock(&rlr->rlr_lock);
+
+        thrd_join(rlr->rlr_thread, &res);
+
+        cnd_destroy(&rlr->rlr_cnd);
+        mtx_destroy(&rlr->rlr_lock);
+        rd_free(rlr->rlr_recs);
+        rd_free(rlr);
+}
+
+
+
+/**
+ * @name Unit tests
+ * @{
+ */
+
+static struct {
+        mtx_t lock;
+        int cnt;
+        int level;
+        char fac[32];
+        char buf[2048];
+        rd_bool_t block;   /**< Block the dispatcher while set */
+} ut_logring;
+
+static void ut_logring_dispatch (rd_kafka_t *rk, int level,
+                                 const char *fac, const char *buf) {
+        while (1) {
+                rd_bool_t block;
+
+                mtx_lock(&ut_logring.lock);
+                block = ut_logring.block;
+                if (!block) {
+                        ut_logring.cnt++;
+                        ut_logring.level = level;
+                        rd_snprintf(ut_logring.fac, sizeof(ut_logring.fac),
+                                    "%s", fac);
+                        rd_snprintf(ut_logring.buf, sizeof(ut_logring.buf),
+                                    "%s", buf);
+                }
+                mtx_unlock(&ut_logring.lock);
+
+                if (!block)
+                        break;
+                rd_usleep(1000, NULL);
+        }
+}
+
+static rd_bool_t ut_logring_log (rd_kafka_logring_t *rlr, int level,
+                                 const char *fac, const char *thrd_name,
+                                 const char *extra,
+                                 const char *fmt, ...) RD_FORMAT(printf,
+                                                                 6, 7);
+static rd_bool_t ut_logring_log (rd_kafka_logring_t *rlr, int level,
+                                 const char *fac, const char *thrd_name,
+                                 const char *extra,
+                                 const char *fmt, ...) {
+        va_list ap;
+        rd_bool_t r;
+
+        va_start(ap, fmt);
+        r = rd_kafka_logring_vlog(rlr, level, fac, thrd_name, extra, fmt, ap);
+        va_end(ap);
+
+        return r;
+}
+
+/**
+ * @brief Wait for \p cnt messages to have been dispatched.
+ */
+static int ut_logring_wait (int cnt) {
+        int i;
+
+        for (i = 0 ; i < 5000 ; i++) {
+                int curr;
+
+                mtx_lock(&ut_logring.lock);
+                curr = ut_logring.cnt;
+                mtx_unlock(&ut_logring.lock);
+
+                if (curr >= cnt)
+                        return curr;
+                rd_usleep(1000, NULL);
+        }
+
+        return -1;
+}
+
+
+/**
+ * @brief Recorded arguments are formatted as by printf.
+ */
+static int unittest_logring_format (void) {
+        rd_kafka_logring_t *rlr;
+        char errstr[256];
+        char exp[2048];
+        char big[600];
+        const char *nul_str = NULL;
+        rd_bool_t logged;
+        int cnt = 0;
+
+        memset(big, 'x', sizeof(big) - 1);
+        big[sizeof(big) - 1] = '\0';
+
+        rlr = rd_kafka_logring_new(NULL, 4, ut_logring_dispatch,
+                                   errstr, sizeof(errstr));
+        RD_UT_ASSERT(rlr, "logring_new failed: %s", errstr);
+
+/* The format under test is not passed through RD_UT_ASSERT() since
+ * it is stringized into the assert's own format string. */
+#define _CHECK(THRD, EXTRA, ...) do {                                   \
+                logged = ut_logring_log(rlr, LOG_DEBUG, "UTFAC",        \
+                                        THRD, EXTRA, __VA_ARGS__);      \
+                RD_UT_ASSERT(logged, "log not recorded");               \
+                cnt++;                                                  \
+                RD_UT_ASSERT(ut_logring_wait(cnt) == cnt,               \
+                             "message %d not dispatched", cnt);         \
+                rd_snprintf(exp, sizeof(exp), __VA_ARGS__);             \
+                RD_UT_ASSERT(!strcmp(ut_logring.buf, exp),              \
+                             "expected \"%s\", not \"%s\"",             \
+                             exp, ut_logring.buf);                      \
+        } while (0)
+
+        {
+                _CHECK(NULL, NULL, "no args");
+                _CHECK(NULL, NULL, "%d %5i %-3u|%x %X %o %c %%", -1, 42,
+                       7u, 255u, 255u, 8u, 'z');
+                _CHECK(NULL, NULL, "%hd %hhu %ld %lu %lld %"PRId64" %"PRIu64,
+                       (short)-3, (unsigned char)250, -123456789L,
+                       123456789UL, -1234567890123LL, (int64_t)-42,
+                       (uint64_t)UINT64_MAX);
+                _CHECK(NULL, NULL, "%"PRIusz" %zd %jd %td",
+                       (size_t)123, (ssize_t)-5, (intmax_t)77,
+                       (ptrdiff_t)-9);
+                _CHECK(NULL, NULL, "%.3f %10.2e %g %Lf", 3.14159, 1e10,
+                       0.5, (long double)2.5);
+                _CHECK(NULL, NULL, "%*d|%-*.*s|%.*s|%s|%s", 6, 12, 8, 3,
+                       "abcdef", 2, "xy-not-terminated-here", "",
+                       "end");
+                _CHECK(NULL, NULL, "%.4s", "ab\0cdef");
+                _CHECK(NULL, NULL, "%p", (void *)rlr);
+
+                /* Does not fit in a record: preformatted, truncated */
+                logged = ut_logring_log(rlr, LOG_DEBUG, "UTFAC",
+                                        NULL, NULL, "%s", big);
+                RD_UT_ASSERT(logged, "log not recorded");
+                cnt++;
+                RD_UT_ASSERT(ut_logring_wait(cnt) == cnt,
+                             "message %d not dispatched", cnt);
+                RD_UT_ASSERT(strlen(ut_logring.buf) ==
+                             RD_KAFKA_LOGRING_DATA_SIZE - 1,
+                             "expected truncated message of %d bytes, "
+                             "not %"PRIusz,
+                             RD_KAFKA_LOGRING_DATA_SIZE - 1,
+                             strlen(ut_logring.buf));
+        }
+
+        /* NULL string */
+        logged = ut_logring_log(rlr, LOG_DEBUG, "UTFAC", NULL, NULL,
+                                "str %s", nul_str);
+        RD_UT_ASSERT(logged, "log not recorded");
+        cnt++;
+        RD_UT_ASSERT(ut_logring_wait(cnt) == cnt,
+                     "message %d not dispatched", cnt);
+        RD_UT_ASSERT(!strcmp(ut_logring.buf, "str (null)"),
+                     "unexpected NULL string message \"%s\"",
+                     ut_logring.buf);
+
+        /* Thread name and extra prefix */
+        logged = ut_logring_log(rlr, LOG_WARNING, "UTPFX",
+                                "thrdX", "broker1", "val %d", 5);
+        RD_UT_ASSERT(logged, "log not recorded");
+        cnt++;
+        RD_UT_ASSERT(ut_logring_wait(cnt) == cnt,
+                     "message %d not dispatched", cnt);
+        RD_UT_ASSERT(!strcmp(ut_logring.buf,
+                             "[thrd:thrdX]: broker1: val 5"),
+                     "unexpected prefixed message \"%s\"", ut_logring.buf);
+        RD_UT_ASSERT(ut_logring.level == LOG_WARNING &&
+                     !strcmp(ut_logring.fac, "UTPFX"),
+                     "unexpected level %d or facility %s",
+                     ut_logring.level, ut_logring.fac);
+
+#undef _CHECK
+
+        rd_kafka_logring_destroy(rlr);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Messages are dropped and counted when the ring is full, and the
+ *        records are reused once served.
+ */
+static int unittest_logring_drops (void) {
+        rd_kafka_logring_t *rlr;
+        char errstr[256];
+        rd_bool_t logged;
+        int i;
+
+        mtx_lock(&ut_logring.lock);
+        ut_logring.cnt = 0;
+        ut_logring.block = rd_true;
+        mtx_unlock(&ut_logring.lock);
+
+        rlr = rd_kafka_logring_new(NULL, 4, ut_logring_dispatch,
+                                   errstr, sizeof(errstr));
+        RD_UT_ASSERT(rlr, "logring_new failed: %s", errstr);
+
+        /* The first record is taken by the (blocked) logging thread,
+         * but is not released until dispatched. */
+        for (i = 0 ; i < 10 ; i++) {
+                logged = ut_logring_log(rlr, LOG_DEBUG, "UTFAC",
+                                        NULL, NULL, "msg %d", i);
+                RD_UT_ASSERT(logged, "log not recorded");
+        }
+
+        RD_UT_ASSERT(rd_kafka_logring_drops(rlr) == 6,
+                     "expected 6 drops, not %"PRId64,
+                     rd_kafka_logring_drops(rlr));
+
+        mtx_lock(&ut_logring.lock);
+        ut_logring.block = rd_false;
+        mtx_unlock(&ut_logring.lock);
+
+        /* 4 messages and the drop report */
+        RD_UT_ASSERT(ut_logring_wait(5) == 5,
+                     "expected 5 dispatched messages");
+        RD_UT_ASSERT(!strcmp(ut_logring.fac, "LOGDROP") &&
+                     strstr(ut_logring.buf, "6 log message(s) dropped"),
+                     "expected drop report, not %s: %s",
+                     ut_logring.fac, ut_logring.buf);
+
+        /* Records are reused */
+        for (i = 0 ; i < 10 ; i++) {
+                logged = ut_logring_log(rlr, LOG_DEBUG, "UTFAC",
+                                        NULL, NULL, "again %d", i);
+                RD_UT_ASSERT(logged, "log not recorded");
+                RD_UT_ASSERT(ut_logring_wait(6 + i) == 6 + i,
+                             "message %d not dispatched", 6 + i);
+        }
+        RD_UT_ASSERT(!strcmp(ut_logring.buf, "again 9"),
+                     "unexpected last message \"%s\"", ut_logring.buf);
+        RD_UT_ASSERT(rd_kafka_logring_drops(rlr) == 6,
+                     "expected 6 drops, not %"PRId64,
+                     rd_kafka_logring_drops(rlr));
+
+        rd_kafka_logring_destroy(rlr);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Concurrent producers: all messages are either dispatched,
+ *        in per-thread order, or counted as dropped.
+ */
+#define UT_LOGRING_THREADS 4
+#define UT_LOGRING_MSGS    2000
+
+static int ut_logring_last[UT_LOGRING_THREADS];
+static int ut_logring_disorder;
+
+static void ut_logring_dispatch_seq (rd_kafka_t *rk, int level,
+                                     const char *fac, const char *buf) {
+        int t, seq;
+
+        if (sscanf(buf, "t%d seq %d", &t, &seq) == 2 &&
+            t >= 0 && t < UT_LOGRING_THREADS) {
+                if (seq <= ut_logring_last[t])
+                        ut_logring_disorder++;
+                ut_logring_last[t] = seq;
+        }
+
+        ut_logring_dispatch(rk, level, fac, buf);
+}
+
+static rd_kafka_logring_t *ut_logring_rlr;
+
+static int ut_logring_thread_main (void *arg) {
+        int t = (int)(intptr_t)arg;
+        int i;
+
+        for (i = 0 ; i < UT_LOGRING_MSGS ; i++)
+                ut_logring_log(ut_logring_rlr, LOG_DEBUG, "UTFAC",
+                               "ut", NULL, "t%d seq %d %s", t, i,
+                               "payload");
+        return 0;
+}
+
+static int unittest_logring_concurrent (void) {
+        thrd_t thrds[UT_LOGRING_THREADS];
+        char errstr[256];
+        int64_t drops;
+        int i, cnt, exp;
+
+        mtx_lock(&ut_logring.lock);
+        ut_logring.cnt = 0;
+        mtx_unlock(&ut_logring.lock);
+        for (i = 0 ; i < UT_LOGRING_THREADS ; i++)
+                ut_logring_last[i] = -1;
+        ut_logring_disorder = 0;
+
+        ut_logring_rlr = rd_kafka_logring_new(NULL, 1024,
+                                              ut_logring_dispatch_seq,
+                                              errstr, sizeof(errstr));
+        RD_UT_ASSERT(ut_logring_rlr, "logring_new failed: %s", errstr);
+
+        for (i = 0 ; i < UT_LOGRING_THREADS ; i++)
+                RD_UT_ASSERT(thrd_create(&thrds[i], ut_logring_thread_main,
+                                         (void *)(intptr_t)i) ==
+                             thrd_success, "thrd_create failed");
+        for (i = 0 ; i < UT_LOGRING_THREADS ; i++)
+                thrd_join(thrds[i], NULL);
+
+        drops = rd_kafka_logring_drops(ut_logring_rlr);
+        rd_kafka_logring_destroy(ut_logring_rlr);
+
+        /* The drop report(s) are dispatched as well */
+        mtx_lock(&ut_logring.lock);
+        cnt = ut_logring.cnt;
+        mtx_unlock(&ut_logring.lock);
+        exp = UT_LOGRING_THREADS * UT_LOGRING_MSGS - (int)drops;
+
+        RD_UT_ASSERT(cnt >= exp && cnt <= exp + 10,
+                     "expected %d dispatched messages (%"PRId64" dropped), "
+                     "not %d", exp, drops, cnt);
+        RD_UT_ASSERT(!ut_logring_disorder,
+                     "%d messages dispatched out of order",
+                     ut_logring_disorder);
+
+        RD_UT_SAY("%d messages, %"PRId64" dropped",
+                  UT_LOGRING_THREADS * UT_LOGRING_MSGS, drops);
+
+        RD_UT_PASS();
+}
+
+
+int unittest_logring (void) {
+        int fails = 0;
+
+        mtx_init(&ut_logring.lock, mtx_plain);
+
+        fails += unittest_logring_format();
+        fails += unittest_logring_drops();
+        fails += unittest_logring_concurrent();
+
+        mtx_destroy(&ut_logring.lock);
+
+        return fails;
+}
+
+/**@}*/
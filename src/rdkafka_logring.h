@@ -0,0 +1,84 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2019 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _RDKAFKA_LOGRING_H_
+#define _RDKAFKA_LOGRING_H_
+
+/**
+ * @name Asynchronous log ring
+ *
+ * With `log.async.ring.size` > 0 log calls do not format the message
+ * and call the log_cb (or enqueue a log op) on the calling thread.
+ * Instead the level, facility, thread name prefix, the format string
+ * pointer (all internal log formats are string literals, the pointer
+ * is the format's id) and a binary copy of the arguments are recorded
+ * in a fixed-size record of a ring buffer, and a dedicated logging
+ * thread formats the records and dispatches them in order.
+ *
+ * Recording never blocks: a record is claimed with two atomic
+ * increments and the logging thread is only signalled (under its lock)
+ * when it is idle. When all records are in use the log message is
+ * dropped and counted, the logging thread reports the number of
+ * dropped messages at most once per second.
+ *
+ * Messages whose arguments do not fit in a record, or whose format uses
+ * conversions that can't be replayed (%n, wide strings), are formatted
+ * into the record on the calling thread instead, truncated to the
+ * record size.
+ *
+ * @{
+ */
+
+typedef struct rd_kafka_logring_s rd_kafka_logring_t;
+
+/**
+ * @brief Log dispatcher, called on the logging thread with the
+ *        formatted message.
+ */
+typedef void (rd_kafka_logring_dispatch_t) (rd_kafka_t *rk, int level,
+                                            const char *fac,
+                                            const char *buf);
+
+rd_kafka_logring_t *rd_kafka_logring_new (rd_kafka_t *rk, int size,
+                                          rd_kafka_logring_dispatch_t
+                                          *dispatch,
+                                          char *errstr, size_t errstr_size);
+void rd_kafka_logring_destroy (rd_kafka_logring_t *rlr);
+
+rd_bool_t rd_kafka_logring_vlog (rd_kafka_logring_t *rlr, int level,
+                                 const char *fac, const char *thrd_name,
+                                 const char *extra,
+                                 const char *fmt, va_list ap);
+
+int64_t rd_kafka_logring_drops (rd_kafka_logring_t *rlr);
+
+int unittest_logring (void);
+
+/**@}*/
+
+#endif /* _RDKAFKA_LOGRING_H_ */
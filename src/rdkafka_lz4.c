@@ -36,6 +36,7 @@
 #include "xxhash.h"
 
 #include "rdbuf.h"
+#include "rdunittest.h"
 
 /**
  * Fix-up bad LZ4 framing caused by buggy Kafka client / broker.
@@ -156,24 +157,76 @@ rd_kafka_lz4_compress_break_framing (rd_kafka_broker_t *rkb,
 
 
 
+/**
+ * @brief Get the broker thread's LZ4F decompression context,
+ *        creating it if needed.
+ *
+ * @returns the context or NULL on failure.
+ *
+ * @locality broker thread
+ */
+static LZ4F_decompressionContext_t
+rd_kafka_lz4_dctx_get (rd_kafka_broker_t *rkb) {
+        LZ4F_errorCode_t code;
+        LZ4F_decompressionContext_t dctx;
+
+        if (likely(rkb->rkb_zdec.lz4_dctx != NULL))
+                return rkb->rkb_zdec.lz4_dctx;
+
+        code = LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
+        if (LZ4F_isError(code)) {
+                rd_rkb_dbg(rkb, BROKER, "LZ4DECOMPR",
+                           "Unable to create LZ4 decompression context: %s",
+                           LZ4F_getErrorName(code));
+                return NULL;
+        }
+
+        rkb->rkb_zdec.lz4_dctx = dctx;
+
+        return dctx;
+}
+
+
+/**
+ * @brief Destroy the broker thread's LZ4F decompression context, if any.
+ *
+ * Also used to discard a context that was left in an unknown state
+ * by a failed decompression, a new context will be created on next use.
+ *
+ * @locality broker thread
+ */
+void rd_kafka_lz4_decompress_term (rd_kafka_broker_t *rkb) {
+        if (!rkb->rkb_zdec.lz4_dctx)
+                return;
+
+        LZ4F_freeDecompressionContext(rkb->rkb_zdec.lz4_dctx);
+        rkb->rkb_zdec.lz4_dctx = NULL;
+}
+
+
 /**
  * @brief Decompress LZ4F (framed) data.
  *        Kafka broker versions <0.10.0.0 (MsgVersion 0) breaks LZ4 framing
  *        checksum, if \p proper_hc we assume the checksum is okay
  *        (broker version >=0.10.0, MsgVersion >= 1) else we fix it up.
  *
+ * The broker thread's decompression context is reused across calls
+ * and the output buffer is allocated from the broker's decompression
+ * buffer pool, it must be freed with rd_kafka_zbuf_free().
+ *
  * @remark May modify \p inbuf (if not \p proper_hc)
+ *
+ * @locality broker thread
  */
 rd_kafka_resp_err_t
 rd_kafka_lz4_decompress (rd_kafka_broker_t *rkb, int proper_hc, int64_t Offset,
                          char *inbuf, size_t inlen,
                          void **outbuf, size_t *outlenp) {
-        LZ4F_errorCode_t code;
         LZ4F_decompressionContext_t dctx;
         LZ4F_frameInfo_t fi;
         size_t in_sz, out_sz;
         size_t in_of, out_of;
-        size_t r;
+        size_t r = 1;
         size_t estimated_uncompressed_size;
         size_t outlen;
         rd_kafka_resp_err_t err = RD_KAFKA_RESP_ERR_NO_ERROR;
@@ -181,14 +234,6 @@ rd_kafka_lz4_decompress (rd_kafka_broker_t *rkb, int proper_hc, int64_t Offset,
 
         *outbuf = NULL;
 
-        code = LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
-        if (LZ4F_isError(code)) {
-                rd_rkb_dbg(rkb, BROKER, "LZ4DECOMPR",
-                           "Unable to create LZ4 decompression context: %s",
-                           LZ4F_getErrorName(code));
-                return RD_KAFKA_RESP_ERR__CRIT_SYS_RESOURCE;
-        }
-
         if (!proper_hc) {
                 /* The original/legacy LZ4 framing in Kafka was buggy and
                  * calculated the LZ4 framing header hash code (HC) incorrectly.
@@ -196,9 +241,12 @@ rd_kafka_lz4_decompress (rd_kafka_broker_t *rkb, int proper_hc, int64_t Offset,
                 if ((err = rd_kafka_lz4_decompress_fixup_bad_framing(rkb,
                                                                      inbuf,
                                                                      inlen)))
-                        goto done;
+                        return err;
         }
 
+        if (!(dctx = rd_kafka_lz4_dctx_get(rkb)))
+                return RD_KAFKA_RESP_ERR__CRIT_SYS_RESOURCE;
+
         in_sz = inlen;
         r = LZ4F_getFrameInfo(dctx, &fi, (const void *)inbuf, &in_sz);
         if (LZ4F_isError(r)) {
@@ -224,8 +272,10 @@ rd_kafka_lz4_decompress (rd_kafka_broker_t *rkb, int proper_hc, int64_t Offset,
         }
 
         /* Allocate output buffer, we increase this later if needed,
-         * but hopefully not. */
-        out = rd_malloc(estimated_uncompressed_size);
+         * but hopefully not.
+         * The pooled buffer may be larger than requested, use all of it. */
+        out = rd_kafka_zbuf_alloc(&rkb->rkb_zdec.pool,
+                                  estimated_uncompressed_size, &outlen);
         if (!out) {
                 rd_rkb_log(rkb, LOG_WARNING, "LZ4DEC",
                            "Unable to allocate decompression "
@@ -237,7 +287,6 @@ rd_kafka_lz4_decompress (rd_kafka_broker_t *rkb, int proper_hc, int64_t Offset,
 
 
         /* Decompress input buffer to output buffer until input is exhausted. */
-        outlen = estimated_uncompressed_size;
         in_of = in_sz;
         out_of = 0;
         while (in_of < inlen) {
@@ -273,7 +322,10 @@ rd_kafka_lz4_decompress (rd_kafka_broker_t *rkb, int proper_hc, int64_t Offset,
 
                         rd_atomic64_add(&rkb->rkb_c.zbuf_grow, 1);
 
-                        if (!(tmp = rd_realloc(out, outlen + extra))) {
+                        if (!(tmp = rd_kafka_zbuf_grow(&rkb->rkb_zdec.pool,
+                                                       out, out_of,
+                                                       outlen + extra,
+                                                       &outlen))) {
                                 rd_rkb_log(rkb, LOG_WARNING, "LZ4DEC",
                                            "Unable to grow decompression "
                                            "buffer to %zd+%zd bytes: %s",
@@ -282,7 +334,6 @@ rd_kafka_lz4_decompress (rd_kafka_broker_t *rkb, int proper_hc, int64_t Offset,
                                 goto done;
                         }
                         out = tmp;
-                        outlen += extra;
                 }
         }
 
@@ -302,16 +353,13 @@ rd_kafka_lz4_decompress (rd_kafka_broker_t *rkb, int proper_hc, int64_t Offset,
         *outlenp = out_of;
 
  done:
-        code = LZ4F_freeDecompressionContext(dctx);
-        if (LZ4F_isError(code)) {
-                rd_rkb_dbg(rkb, BROKER, "LZ4DECOMPR",
-                           "Failed to close LZ4 compression context: %s",
-                           LZ4F_getErrorName(code));
-                err = RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
-        }
+        /* The context is only reusable if the frame was fully decoded
+         * (which resets it), otherwise discard it. */
+        if (r != 0)
+                rd_kafka_lz4_decompress_term(rkb);
 
         if (err && out)
-                rd_free(out);
+                rd_kafka_zbuf_free(out);
 
         return err;
 }
@@ -439,3 +487,93 @@ rd_kafka_lz4_compress (rd_kafka_broker_t *rkb, int proper_hc, int comp_level,
         return err;
 
 }
+
+
+
+/**
+ * @name Unit tests
+ * @{
+ */
+
+/**
+ * @brief Verify that the broker's LZ4 decompression context and
+ *        output buffer pool are reused across decompressions.
+ */
+int unittest_lz4 (void) {
+        rd_kafka_t *rk;
+        rd_kafka_conf_t *conf;
+        rd_kafka_broker_t *rkb;
+        rd_buf_t b;
+        rd_slice_t slice;
+        char payload[10000];
+        void *compressed, *out1, *out2;
+        size_t compressed_len, out1_len, out2_len;
+        rd_kafka_resp_err_t err;
+        int64_t misses;
+        size_t i;
+
+        for (i = 0 ; i < sizeof(payload) ; i++)
+                payload[i] = 'a' + (char)((i / 100) % 26);
+
+        conf = rd_kafka_conf_new();
+        rk = rd_kafka_new(RD_KAFKA_CONSUMER, conf, NULL, 0);
+        RD_UT_ASSERT(rk, "failed to create consumer");
+
+        /* Use a logical broker to avoid any connection attempts. */
+        rkb = rd_kafka_broker_add_logical(rk, "unittest");
+
+        rd_buf_init(&b, 0, 0);
+        rd_buf_write(&b, payload, sizeof(payload));
+        rd_slice_init_full(&slice, &b);
+
+        err = rd_kafka_lz4_compress(rkb, 1/*proper HC*/, 0, &slice,
+                                    &compressed, &compressed_len);
+        RD_UT_ASSERT(!err, "compression failed: %s", rd_kafka_err2str(err));
+
+        err = rd_kafka_lz4_decompress(rkb, 1, 0, compressed, compressed_len,
+                                      &out1, &out1_len);
+        RD_UT_ASSERT(!err, "decompression failed: %s", rd_kafka_err2str(err));
+        RD_UT_ASSERT(out1_len == sizeof(payload) &&
+                     !memcmp(out1, payload, out1_len),
+                     "decompressed payload mismatch");
+        RD_UT_ASSERT(rkb->rkb_zdec.lz4_dctx != NULL,
+                     "decompression context should be kept");
+
+        /* Returning the buffer (and any intermediate buffers from
+         * growing the output) to the pool should make the next
+         * decompression reuse them. */
+        rd_kafka_zbuf_free(out1);
+        misses = rd_atomic64_get(&rkb->rkb_zdec.pool.zp_c.misses);
+
+        err = rd_kafka_lz4_decompress(rkb, 1, 0, compressed, compressed_len,
+                                      &out2, &out2_len);
+        RD_UT_ASSERT(!err, "decompression failed: %s", rd_kafka_err2str(err));
+        RD_UT_ASSERT(out2_len == sizeof(payload) &&
+                     !memcmp(out2, payload, out2_len),
+                     "decompressed payload mismatch");
+        RD_UT_ASSERT(out2 == out1, "expected pooled buffer to be reused");
+        RD_UT_ASSERT(rd_atomic64_get(&rkb->rkb_zdec.pool.zp_c.misses) ==
+                     misses,
+                     "expected no new pool misses, not %"PRId64,
+                     rd_atomic64_get(&rkb->rkb_zdec.pool.zp_c.misses) -
+                     misses);
+
+        /* A corrupt frame must fail and discard the context. */
+        ((char *)compressed)[0] ^= 0xff; /* magic */
+        err = rd_kafka_lz4_decompress(rkb, 1, 0, compressed, compressed_len,
+                                      &out1, &out1_len);
+        RD_UT_ASSERT(err, "expected decompression of corrupt frame to fail");
+        RD_UT_ASSERT(rkb->rkb_zdec.lz4_dctx == NULL,
+                     "context should have been discarded after failure");
+
+        rd_kafka_zbuf_free(out2);
+        rd_free(compressed);
+        rd_buf_destroy(&b);
+
+        rd_kafka_broker_destroy(rkb);
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+/**@}*/
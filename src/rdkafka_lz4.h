@@ -31,6 +31,8 @@
 #define _RDKAFKA_LZ4_H_
 
 
+void rd_kafka_lz4_decompress_term (rd_kafka_broker_t *rkb);
+
 rd_kafka_resp_err_t
 rd_kafka_lz4_decompress (rd_kafka_broker_t *rkb, int proper_hc, int64_t Offset,
                          char *inbuf, size_t inlen,
@@ -40,4 +42,6 @@ rd_kafka_resp_err_t
 rd_kafka_lz4_compress (rd_kafka_broker_t *rkb, int proper_hc, int comp_level,
                        rd_slice_t *slice, void **outbuf, size_t *outlenp);
 
+int unittest_lz4 (void);
+
 #endif /* _RDKAFKA_LZ4_H_ */
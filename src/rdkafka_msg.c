@@ -31,6 +31,7 @@
 #include "rdkafka_msg.h"
 #include "rdkafka_topic.h"
 #include "rdkafka_partition.h"
+#include "rdkafka_broker.h"
 #include "rdkafka_interceptor.h"
 #include "rdkafka_header.h"
 #include "rdkafka_idempotence.h"
@@ -975,6 +976,28 @@ rd_kafka_message_t *rd_kafka_message_get_from_rkm (rd_kafka_op_t *rko,
         return rd_kafka_message_setup(rko, &rkm->rkm_rkmessage);
 }
 
+/**
+ * @brief Sample the end-to-end and fetch queue latencies of consumed
+ *        message \p rkm as it is passed to the application.
+ */
+static void rd_kafka_msg_consumed_latency (rd_kafka_toppar_t *rktp,
+                                           const rd_kafka_msg_t *rkm) {
+        if (!rktp->rktp_rkt->rkt_rk->rk_conf.stats_interval_ms)
+                return;
+
+        if (rkm->rkm_tstype != RD_KAFKA_TIMESTAMP_NOT_AVAILABLE &&
+            rkm->rkm_timestamp > 0) {
+                /* Clock skew between the producer or broker and this
+                 * host may render the latency negative. */
+                int64_t latency = (rd_uclock() / 1000) - rkm->rkm_timestamp;
+                rd_avg_add(&rktp->rktp_avg_e2e_latency, RD_MAX(latency, 0));
+        }
+
+        if (rkm->rkm_ts_fetch)
+                rd_avg_add(&rktp->rktp_avg_fetchq_latency,
+                           rd_clock() - rkm->rkm_ts_fetch);
+}
+
 /**
  * @brief Convert rko to rkmessage
  * @remark Must only be called just prior to passing a consumed message
@@ -991,6 +1014,11 @@ rd_kafka_message_t *rd_kafka_message_get (rd_kafka_op_t *rko) {
         switch (rko->rko_type)
         {
         case RD_KAFKA_OP_FETCH:
+                /* Apply fetch buffer copy-out policy and accounting */
+                rd_kafka_op_fetch_msg_deliver(rko);
+                rd_kafka_msg_consumed_latency(
+                        rd_kafka_toppar_s2i(rko->rko_rktp),
+                        &rko->rko_u.fetch.rkm);
                 /* Use embedded rkmessage */
                 rkmessage = &rko->rko_u.fetch.rkm.rkm_rkmessage;
                 break;
@@ -1038,6 +1066,13 @@ int64_t rd_kafka_message_latency (const rd_kafka_message_t *rkmessage) {
 
         rkm = rd_kafka_message2msg((rd_kafka_message_t *)rkmessage);
 
+        if (!(rkm->rkm_flags & RD_KAFKA_MSG_F_PRODUCER)) {
+                /* Consumed message */
+                if (unlikely(rkmessage->err || !rkm->rkm_ts_fetch))
+                        return -1;
+                return rd_clock() - rkm->rkm_ts_fetch;
+        }
+
         if (unlikely(!rkm->rkm_ts_enq))
                 return -1;
 
@@ -1294,6 +1329,44 @@ void rd_kafka_msgbatch_ready_produce (rd_kafka_msgbatch_t *rkmb) {
 }
 
 
+/**
+ * @brief The batch reached the end of producer \p stage: sample the
+ *        time since the end of the previous stage reached (or since the
+ *        first message was enqueued) to the broker's and topic's
+ *        produce latency averagers.
+ *
+ * @remark Does nothing if statistics are not enabled.
+ *
+ * @locality broker thread
+ */
+void rd_kafka_msgbatch_stage (rd_kafka_msgbatch_t *rkmb,
+                              rd_kafka_broker_t *rkb,
+                              rd_kafka_stats_produce_stage_t stage) {
+        rd_kafka_itopic_t *rkt = rd_kafka_toppar_s2i(rkmb->s_rktp)->rktp_rkt;
+        rd_ts_t start = rkmb->ts_enq;
+        rd_ts_t now;
+        int i;
+
+        rd_dassert(stage < RD_KAFKA_STATS_PRODUCE_STAGE_DR);
+
+        if (!rkb->rkb_rk->rk_conf.stats_interval_ms || !start)
+                return;
+
+        for (i = (int)stage - 1 ; i >= 0 ; i--) {
+                if (rkmb->ts_stage[i]) {
+                        start = rkmb->ts_stage[i];
+                        break;
+                }
+        }
+
+        now = rd_clock();
+        rkmb->ts_stage[stage] = now;
+
+        rd_avg_add(&rkb->rkb_avg_produce_latency[stage], now - start);
+        rd_avg_add(&rkt->rkt_avg_produce_latency[stage], now - start);
+}
+
+
 /**
  * @brief Verify order (by msgid) in message queue.
  *        For development use only.
@@ -1618,3 +1691,89 @@ int unittest_msg (void) {
 
         return fails;
 }
+
+
+/**
+ * @brief Benchmark the builtin partitioners with 16 byte keys, and
+ *        without keys for the partitioners that fall back to random.
+ */
+int benchmark_partitioner (void) {
+#define _KEYCNT  256
+#define _KEYSIZE 16
+#define _REPS    1000
+        const struct {
+                const char *name;
+                int32_t (*partitioner) (const rd_kafka_topic_t *rkt,
+                                        const void *key, size_t keylen,
+                                        int32_t partition_cnt,
+                                        void *rkt_opaque,
+                                        void *msg_opaque);
+                rd_bool_t keyed;
+        } partitioners[] = {
+                { "random", rd_kafka_msg_partitioner_random, rd_false },
+                { "consistent", rd_kafka_msg_partitioner_consistent,
+                  rd_true },
+                { "consistent_random",
+                  rd_kafka_msg_partitioner_consistent_random, rd_true },
+                { "consistent_random/nokey",
+                  rd_kafka_msg_partitioner_consistent_random, rd_false },
+                { "murmur2", rd_kafka_msg_partitioner_murmur2, rd_true },
+                { "murmur2_random",
+                  rd_kafka_msg_partitioner_murmur2_random, rd_true },
+                { "murmur2_random/nokey",
+                  rd_kafka_msg_partitioner_murmur2_random, rd_false },
+                { NULL }
+        };
+        const int32_t partition_cnt = 12;
+        char keys[_KEYCNT][_KEYSIZE+1];
+        rd_kafka_t *rk;
+        rd_kafka_topic_t *rkt;
+        int i;
+
+        for (i = 0 ; i < _KEYCNT ; i++)
+                rd_snprintf(keys[i], sizeof(keys[i]), "user-%011d",
+                            i * 7919);
+
+        rk = rd_kafka_new(RD_KAFKA_PRODUCER, rd_kafka_conf_new(), NULL, 0);
+        RD_UT_ASSERT(rk, "failed to create producer");
+        rkt = rd_kafka_topic_new(rk, "uttopic", NULL);
+        rd_ut_kafka_topic_set_topic_exists(rd_kafka_topic_a2i(rkt),
+                                           partition_cnt, -1);
+
+        for (i = 0 ; partitioners[i].name ; i++) {
+                rd_ut_bench_t rub;
+
+                rd_ut_bench_init(&rub, "partitioner/%s",
+                                 partitioners[i].name);
+                while (rd_ut_bench_more(&rub)) {
+                        int32_t psum = 0;
+                        int j;
+
+                        rd_ut_bench_start(&rub);
+                        for (j = 0 ; j < _REPS ; j++) {
+                                const char *key = partitioners[i].keyed ?
+                                        keys[j % _KEYCNT] : NULL;
+                                psum += partitioners[i].partitioner(
+                                        rkt, key, key ? _KEYSIZE : 0,
+                                        partition_cnt, NULL, NULL);
+                        }
+                        rd_ut_bench_stop(&rub, _REPS,
+                                         partitioners[i].keyed ?
+                                         _REPS * _KEYSIZE : 0);
+
+                        RD_UT_ASSERT(psum >= 0 &&
+                                     psum <= _REPS * (partition_cnt - 1),
+                                     "%s: partition out of range",
+                                     partitioners[i].name);
+                }
+                rd_ut_bench_report(&rub);
+        }
+
+        rd_kafka_topic_destroy(rkt);
+        rd_kafka_destroy(rk);
+#undef _KEYCNT
+#undef _KEYSIZE
+#undef _REPS
+
+        RD_UT_PASS();
+}
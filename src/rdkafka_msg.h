@@ -85,6 +85,11 @@ typedef struct rd_kafka_msg_s {
 #define RD_KAFKA_MSG_F_FREE_RKM     0x10000 /* msg_t is allocated */
 #define RD_KAFKA_MSG_F_ACCOUNT      0x20000 /* accounted for in curr_msgs */
 #define RD_KAFKA_MSG_F_PRODUCER     0x40000 /* Producer message */
+#define RD_KAFKA_MSG_F_APP          0x80000 /* Consumed msg held by the
+                                             * application, pinning its
+                                             * fetch buffer. */
+#define RD_KAFKA_MSG_F_COPYOUT      0x200000 /* Consumed msg copied out
+                                              * of its fetch buffer. */
 
 	rd_kafka_timestamp_type_t rkm_tstype; /* rkm_timestamp type */
 	int64_t    rkm_timestamp;  /* Message format V1.
@@ -127,7 +132,9 @@ typedef struct rd_kafka_msg_s {
                         rd_kafkap_bytes_t binhdrs; /**< Unparsed
                                                     *   binary headers in
                                                     *   protocol msg */
+                        rd_ts_t ts_fetch;   /**< FetchResponse parse time */
                 } consumer;
+#define rkm_ts_fetch   rkm_u.consumer.ts_fetch
         } rkm_u;
 } rd_kafka_msg_t;
 
@@ -514,5 +521,6 @@ void rd_kafka_msgq_dump (FILE *fp, const char *what, rd_kafka_msgq_t *rkmq);
 rd_kafka_msg_t *ut_rd_kafka_msg_new (void);
 void ut_rd_kafka_msgq_purge (rd_kafka_msgq_t *rkmq);
 int unittest_msg (void);
+int benchmark_partitioner (void);
 
 #endif /* _RDKAFKA_MSG_H_ */
@@ -43,6 +43,12 @@ typedef struct rd_kafka_msgbatch_s {
                                      *   require retries to have the
                                      *   exact same messages in them. */
 
+        /* Producer batch stages, for statistics */
+        rd_ts_t        ts_enq;      /**< First message's enqueue time */
+        rd_ts_t        ts_stage[RD_KAFKA_STATS_PRODUCE_STAGE__CNT]; /**< End
+                                     *   time of each stage reached,
+                                     *   see rd_kafka_msgbatch_stage() */
+
 } rd_kafka_msgbatch_t;
 
 
@@ -55,5 +61,8 @@ void rd_kafka_msgbatch_init (rd_kafka_msgbatch_t *rkmb,
 void rd_kafka_msgbatch_set_first_msg (rd_kafka_msgbatch_t *rkmb,
                                       rd_kafka_msg_t *rkm);
 void rd_kafka_msgbatch_ready_produce (rd_kafka_msgbatch_t *rkmb);
+void rd_kafka_msgbatch_stage (rd_kafka_msgbatch_t *rkmb,
+                              struct rd_kafka_broker_s *rkb,
+                              rd_kafka_stats_produce_stage_t stage);
 
 #endif /* _RDKAFKA_MSGBATCH_H_ */
@@ -49,4 +49,33 @@ rd_kafka_msgset_parse (rd_kafka_buf_t *rkbuf,
                        rd_kafka_toppar_t *rktp,
                        const struct rd_kafka_toppar_ver *tver);
 
+
+/**
+ * @name Benchmarks
+ */
+#define UT_MSGSET_BENCH_MSGCNT  1000 /**< Messages per benchmarked batch */
+
+/**< Benchmarked compression codecs, by compression.codec name */
+static const char * const ut_msgset_bench_codecs[] = {
+        "none", "gzip", "snappy", "lz4", "zstd", NULL
+};
+
+typedef struct ut_msgset_bench_s {
+        rd_kafka_t *rk;
+        rd_kafka_broker_t *rkb;    /**< Logical broker, features limited
+                                    *   to the benchmarked MsgVersion */
+        shptr_rd_kafka_toppar_t *s_rktp;
+        rd_kafka_toppar_t *rktp;
+        rd_kafka_msgq_t rkmq;      /**< Messages to write */
+        char *payload;             /**< Backing memory of keys and values */
+        int64_t msg_bytes;         /**< Total key and value bytes */
+} ut_msgset_bench_t;
+
+int ut_msgset_bench_init (ut_msgset_bench_t *umb, int MsgVersion,
+                          const char *codec, int msgcnt);
+void ut_msgset_bench_destroy (ut_msgset_bench_t *umb);
+
+int benchmark_msgset_writer (void);
+int benchmark_msgset_reader (void);
+
 #endif /* _RDKAFKA_MSGSET_H_ */
@@ -64,6 +64,7 @@
 
 #include "rdvarint.h"
 #include "crc32c.h"
+#include "rdunittest.h"
 
 #if WITH_ZLIB
 #include "rdgz.h"
@@ -145,6 +146,10 @@ typedef struct rd_kafka_msgset_reader_s {
                                          *   message set.
                                          *   Not freed (use const memory).
                                          *   Add trailing space. */
+
+        rd_ts_t msetr_ts_fetch;         /**< Time the reader was set up,
+                                         *   assigned to each message's
+                                         *   rkm_ts_fetch. */
 } rd_kafka_msgset_reader_t;
 
 
@@ -173,6 +178,7 @@ rd_kafka_msgset_reader_init (rd_kafka_msgset_reader_t *msetr,
         msetr->msetr_tver       = tver;
         msetr->msetr_rkbuf      = rkbuf;
         msetr->msetr_srcname    = "";
+        msetr->msetr_ts_fetch   = rd_clock();
 
         rkbuf->rkbuf_uflow_mitigation = "truncated response from broker (ok)";
 
@@ -210,6 +216,9 @@ rd_kafka_msgset_reader_decompress (rd_kafka_msgset_reader_t *msetr,
         int codec = Attributes & RD_KAFKA_MSG_ATTR_COMPRESSION_MASK;
         rd_kafka_resp_err_t err = RD_KAFKA_RESP_ERR_NO_ERROR;
         rd_kafka_buf_t *rkbufz;
+        /* Codecs that decompress into the broker's decompression buffer
+         * pool set this to rd_kafka_zbuf_free. */
+        void (*free_cb) (void *) = rd_free;
 
         switch (codec)
         {
@@ -267,14 +276,16 @@ rd_kafka_msgset_reader_decompress (rd_kafka_msgset_reader_t *msetr,
                                 errstr, sizeof(errstr));
 
                         if (unlikely(!iov.iov_base)) {
-                                rd_rkb_dbg(msetr->msetr_rkb, MSG, "SNAPPY",
-                                           "%s [%"PRId32"]: "
-                                           "Snappy decompression for message "
-                                           "at offset %"PRId64" failed: %s: "
-                                           "ignoring message",
-                                           rktp->rktp_rkt->rkt_topic->str,
-                                           rktp->rktp_partition,
-                                           Offset, errstr);
+                                rd_rkb_dbg_rktp(msetr->msetr_rkb, rktp,
+                                                MSG, "SNAPPY",
+                                                "%s [%"PRId32"]: "
+                                                "Snappy decompression for "
+                                                "message at offset %"PRId64
+                                                " failed: %s: "
+                                                "ignoring message",
+                                                rktp->rktp_rkt->rkt_topic->str,
+                                                rktp->rktp_partition,
+                                                Offset, errstr);
                                 err = RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
                                 goto err;
                         }
@@ -298,7 +309,9 @@ rd_kafka_msgset_reader_decompress (rd_kafka_msgset_reader_t *msetr,
                         }
 
                         /* Allocate output buffer for uncompressed data */
-                        iov.iov_base = rd_malloc(iov.iov_len);
+                        iov.iov_base = rd_kafka_zbuf_alloc(
+                                &msetr->msetr_rkb->rkb_zdec.pool,
+                                iov.iov_len, NULL);
                         if (unlikely(!iov.iov_base)) {
                                 rd_rkb_dbg(msetr->msetr_rkb, MSG, "SNAPPY",
                                            "Failed to allocate Snappy "
@@ -322,10 +335,12 @@ rd_kafka_msgset_reader_decompress (rd_kafka_msgset_reader_t *msetr,
                                            "ignoring message",
                                            Offset, inlen,
                                            rd_strerror(-r/*negative errno*/));
-                                rd_free(iov.iov_base);
+                                rd_kafka_zbuf_free(iov.iov_base);
                                 err = RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
                                 goto err;
                         }
+
+                        free_cb = rd_kafka_zbuf_free;
                 }
 
         }
@@ -345,6 +360,8 @@ rd_kafka_msgset_reader_decompress (rd_kafka_msgset_reader_t *msetr,
                                               &iov.iov_base, &iov.iov_len);
                 if (err)
                         goto err;
+
+                free_cb = rd_kafka_zbuf_free;
         }
         break;
 
@@ -357,18 +374,20 @@ rd_kafka_msgset_reader_decompress (rd_kafka_msgset_reader_t *msetr,
                                               &iov.iov_base, &iov.iov_len);
                 if (err)
                         goto err;
+
+                free_cb = rd_kafka_zbuf_free;
         }
         break;
 #endif
 
         default:
-                rd_rkb_dbg(msetr->msetr_rkb, MSG, "CODEC",
-                           "%s [%"PRId32"]: Message at offset %"PRId64
-                           " with unsupported "
-                           "compression codec 0x%x: message ignored",
-                           rktp->rktp_rkt->rkt_topic->str,
-                           rktp->rktp_partition,
-                           Offset, (int)codec);
+                rd_rkb_dbg_rktp(msetr->msetr_rkb, rktp, MSG, "CODEC",
+                                "%s [%"PRId32"]: Message at offset %"PRId64
+                                " with unsupported "
+                                "compression codec 0x%x: message ignored",
+                                rktp->rktp_rkt->rkt_topic->str,
+                                rktp->rktp_partition,
+                                Offset, (int)codec);
 
                 err = RD_KAFKA_RESP_ERR__NOT_IMPLEMENTED;
                 goto err;
@@ -383,8 +402,11 @@ rd_kafka_msgset_reader_decompress (rd_kafka_msgset_reader_t *msetr,
 
         /* Create a new buffer pointing to the uncompressed
          * allocated buffer (outbuf) and let messages keep a reference to
-         * this new buffer. */
-        rkbufz = rd_kafka_buf_new_shadow(iov.iov_base, iov.iov_len, rd_free);
+         * this new buffer.
+         * Pooled buffers are returned to the broker's pool when the
+         * last message referencing them is destroyed, the broker
+         * reference held by rkbufz keeps the pool alive until then. */
+        rkbufz = rd_kafka_buf_new_shadow(iov.iov_base, iov.iov_len, free_cb);
         rkbufz->rkbuf_rkb = msetr->msetr_rkbuf->rkbuf_rkb;
         rd_kafka_broker_keep(rkbufz->rkbuf_rkb);
 
@@ -615,6 +637,7 @@ rd_kafka_msgset_reader_msg_v0_1 (rd_kafka_msgset_reader_t *msetr) {
                                         (size_t)RD_KAFKAP_BYTES_LEN(&Value),
                                         RD_KAFKAP_BYTES_IS_NULL(&Value) ?
                                         NULL : Value.data);
+        rkm->rkm_ts_fetch = msetr->msetr_ts_fetch;
 
         /* Assign message timestamp.
          * If message was in a compressed MessageSet and the outer/wrapper
@@ -682,12 +705,12 @@ rd_kafka_msgset_reader_msg_v2 (rd_kafka_msgset_reader_t *msetr) {
 
         /* Skip message if outdated */
         if (hdr.Offset < rktp->rktp_offsets.fetch_offset) {
-                rd_rkb_dbg(msetr->msetr_rkb, MSG, "MSG",
-                           "%s [%"PRId32"]: "
-                           "Skip offset %"PRId64" < fetch_offset %"PRId64,
-                           rktp->rktp_rkt->rkt_topic->str,
-                           rktp->rktp_partition,
-                           hdr.Offset, rktp->rktp_offsets.fetch_offset);
+                rd_rkb_dbg_rktp(msetr->msetr_rkb, rktp, MSG, "MSG",
+                                "%s [%"PRId32"]: "
+                                "Skip offset %"PRId64" < fetch_offset %"PRId64,
+                                rktp->rktp_rkt->rkt_topic->str,
+                                rktp->rktp_partition,
+                                hdr.Offset, rktp->rktp_offsets.fetch_offset);
                 rd_kafka_buf_skip_to(rkbuf, message_end);
                 return RD_KAFKA_RESP_ERR_NO_ERROR; /* Continue with next msg */
         }
@@ -712,6 +735,7 @@ rd_kafka_msgset_reader_msg_v2 (rd_kafka_msgset_reader_t *msetr) {
                                         (size_t)RD_KAFKAP_BYTES_LEN(&hdr.Value),
                                         RD_KAFKAP_BYTES_IS_NULL(&hdr.Value) ?
                                         NULL : hdr.Value.data);
+        rkm->rkm_ts_fetch = msetr->msetr_ts_fetch;
 
         /* Store pointer to unparsed message headers, they will
          * be parsed on the first access.
@@ -961,17 +985,20 @@ rd_kafka_msgset_reader_peek_msg_version (rd_kafka_msgset_reader_t *msetr,
 
                 rd_kafka_buf_read_i64(rkbuf, &Offset);
 
-                rd_rkb_dbg(msetr->msetr_rkb,
-                           MSG | RD_KAFKA_DBG_PROTOCOL | RD_KAFKA_DBG_FETCH,
-                           "MAGICBYTE",
-                           "%s [%"PRId32"]: "
-                           "Unsupported Message(Set) MagicByte %d at "
-                           "offset %"PRId64" "
-                           "(buffer position %"PRIusz"/%"PRIusz"): skipping",
-                           rktp->rktp_rkt->rkt_topic->str,
-                           rktp->rktp_partition,
-                           (int)*MagicBytep, Offset,
-                           read_offset, rd_slice_size(&rkbuf->rkbuf_reader));
+                rd_rkb_dbg_rktp(msetr->msetr_rkb, rktp,
+                                MSG | RD_KAFKA_DBG_PROTOCOL |
+                                RD_KAFKA_DBG_FETCH,
+                                "MAGICBYTE",
+                                "%s [%"PRId32"]: "
+                                "Unsupported Message(Set) MagicByte %d at "
+                                "offset %"PRId64" "
+                                "(buffer position %"PRIusz"/%"PRIusz"): "
+                                "skipping",
+                                rktp->rktp_rkt->rkt_topic->str,
+                                rktp->rktp_partition,
+                                (int)*MagicBytep, Offset,
+                                read_offset,
+                                rd_slice_size(&rkbuf->rkbuf_reader));
 
                 if (Offset >= msetr->msetr_rktp->rktp_offsets.fetch_offset) {
                         rd_kafka_q_op_err(
@@ -1112,14 +1139,30 @@ rd_kafka_msgset_reader_run (rd_kafka_msgset_reader_t *msetr) {
                 if (msetr->msetr_ctrl_cnt > 0) {
                         /* Noop */
 
+                } else if (rktp->rktp_prefetch.req_max_bytes <
+                           rktp->rktp_fetch_msg_max_bytes) {
+                        /* The Fetch size was limited by the prefetch
+                         * budget, use the full size on the next Fetch. */
+                        rktp->rktp_prefetch.full_fetch = rd_true;
+                        rd_rkb_dbg_rktp(msetr->msetr_rkb, rktp,
+                                        FETCH, "CONSUME",
+                                        "Topic %s [%"PRId32"]: Budget-limited "
+                                        "max fetch bytes %"PRId32" too small: "
+                                        "next fetch uses %"PRId32,
+                                        rktp->rktp_rkt->rkt_topic->str,
+                                        rktp->rktp_partition,
+                                        rktp->rktp_prefetch.req_max_bytes,
+                                        rktp->rktp_fetch_msg_max_bytes);
+
                 } else  if (rktp->rktp_fetch_msg_max_bytes < (1 << 30)) {
                         rktp->rktp_fetch_msg_max_bytes *= 2;
-                        rd_rkb_dbg(msetr->msetr_rkb, FETCH, "CONSUME",
-                                   "Topic %s [%"PRId32"]: Increasing "
-                                   "max fetch bytes to %"PRId32,
-                                   rktp->rktp_rkt->rkt_topic->str,
-                                   rktp->rktp_partition,
-                                   rktp->rktp_fetch_msg_max_bytes);
+                        rd_rkb_dbg_rktp(msetr->msetr_rkb, rktp,
+                                        FETCH, "CONSUME",
+                                        "Topic %s [%"PRId32"]: Increasing "
+                                        "max fetch bytes to %"PRId32,
+                                        rktp->rktp_rkt->rkt_topic->str,
+                                        rktp->rktp_partition,
+                                        rktp->rktp_fetch_msg_max_bytes);
                 } else if (!err) {
                         rd_kafka_q_op_err(
                                 &msetr->msetr_rkq,
@@ -1146,18 +1189,19 @@ rd_kafka_msgset_reader_run (rd_kafka_msgset_reader_t *msetr) {
                         err = RD_KAFKA_RESP_ERR_NO_ERROR;
         }
 
-        rd_rkb_dbg(msetr->msetr_rkb, MSG | RD_KAFKA_DBG_FETCH, "CONSUME",
-                   "Enqueue %i %smessage(s) (%"PRId64" bytes, %d ops) on "
-                   "%s [%"PRId32"] "
-                   "fetch queue (qlen %d, v%d, last_offset %"PRId64
-                   ", %d ctrl msgs)",
-                   msetr->msetr_msgcnt, msetr->msetr_srcname,
-                   msetr->msetr_msg_bytes,
-                   rd_kafka_q_len(&msetr->msetr_rkq),
-                   rktp->rktp_rkt->rkt_topic->str,
-                   rktp->rktp_partition, rd_kafka_q_len(&msetr->msetr_rkq),
-                   msetr->msetr_tver->version, last_offset,
-                   msetr->msetr_ctrl_cnt);
+        rd_rkb_dbg_rktp(msetr->msetr_rkb, rktp,
+                        MSG | RD_KAFKA_DBG_FETCH, "CONSUME",
+                        "Enqueue %i %smessage(s) (%"PRId64" bytes, %d ops) on "
+                        "%s [%"PRId32"] "
+                        "fetch queue (qlen %d, v%d, last_offset %"PRId64
+                        ", %d ctrl msgs)",
+                        msetr->msetr_msgcnt, msetr->msetr_srcname,
+                        msetr->msetr_msg_bytes,
+                        rd_kafka_q_len(&msetr->msetr_rkq),
+                        rktp->rktp_rkt->rkt_topic->str,
+                        rktp->rktp_partition, rd_kafka_q_len(&msetr->msetr_rkq),
+                        msetr->msetr_tver->version, last_offset,
+                        msetr->msetr_ctrl_cnt);
 
         /* Concat all messages&errors onto the parent's queue
          * (the partition's fetch queue) */
@@ -1216,3 +1260,116 @@ rd_kafka_msgset_parse (rd_kafka_buf_t *rkbuf,
         return err;
 
 }
+
+
+
+/**
+ * @name Benchmarks
+ * @{
+ */
+
+/**
+ * @brief Benchmark Fetch response MessageSet parsing, including
+ *        decompression, of a 1000 message batch for each MsgVersion and
+ *        compression codec.
+ *
+ * The MessageSet to parse is created by the msgset writer.
+ */
+int benchmark_msgset_reader (void) {
+        const rd_kafka_pid_t pid = RD_KAFKA_PID_INITIALIZER;
+        int MsgVersion, i;
+
+        for (MsgVersion = 0 ; MsgVersion <= 2 ; MsgVersion++) {
+                for (i = 0 ; ut_msgset_bench_codecs[i] ; i++) {
+                        ut_msgset_bench_t umb;
+                        rd_ut_bench_t rub;
+                        rd_kafka_buf_t *request;
+                        rd_slice_t slice;
+                        size_t msize = 0;
+                        char *mset;
+
+                        if (ut_msgset_bench_init(&umb, MsgVersion,
+                                                 ut_msgset_bench_codecs[i],
+                                                 UT_MSGSET_BENCH_MSGCNT) == -1)
+                                continue;
+
+                        /* The MessageSet is at the end of the single
+                         * partition ProduceRequest. */
+                        request = rd_kafka_msgset_create_ProduceRequest(
+                                umb.rkb, umb.rktp, &umb.rkmq, pid, &msize);
+                        RD_UT_ASSERT(request && msize > 0,
+                                     "v%d/%s: failed to create MessageSet",
+                                     MsgVersion, ut_msgset_bench_codecs[i]);
+
+                        mset = rd_malloc(msize);
+                        rd_slice_init(&slice, &request->rkbuf_buf,
+                                      rd_buf_len(&request->rkbuf_buf) - msize,
+                                      msize);
+                        rd_slice_read(&slice, mset, msize);
+
+                        if (MsgVersion == 1 &&
+                            strcmp(ut_msgset_bench_codecs[i], "none")) {
+                                /* As the broker does, set the wrapper
+                                 * message's Offset to that of the last
+                                 * inner message for the relative inner
+                                 * offsets to be converted properly. */
+                                int64_t Offset = htobe64(
+                                        UT_MSGSET_BENCH_MSGCNT - 1);
+                                memcpy(mset, &Offset, sizeof(Offset));
+                        }
+
+                        rd_kafka_msgq_prepend(&umb.rkmq,
+                                              &request->rkbuf_batch.msgq);
+                        rd_kafka_buf_destroy(request);
+
+                        rd_ut_bench_init(&rub,
+                                         "msgset_reader/v%d/%s",
+                                         MsgVersion,
+                                         ut_msgset_bench_codecs[i]);
+                        while (rd_ut_bench_more(&rub)) {
+                                struct rd_kafka_toppar_ver tver = {
+                                        .s_rktp = umb.s_rktp,
+                                        .version =
+                                        umb.rktp->rktp_fetch_version
+                                };
+                                rd_kafka_resp_err_t err;
+                                rd_kafka_buf_t *rkbuf;
+                                int cnt;
+
+                                rkbuf = rd_kafka_buf_new_shadow(mset, msize,
+                                                                NULL);
+                                rkbuf->rkbuf_rkb = umb.rkb;
+                                rd_kafka_broker_keep(umb.rkb);
+                                umb.rktp->rktp_offsets.fetch_offset = 0;
+
+                                rd_ut_bench_start(&rub);
+                                err = rd_kafka_msgset_parse(rkbuf, NULL,
+                                                            umb.rktp, &tver);
+                                rd_ut_bench_stop(&rub, UT_MSGSET_BENCH_MSGCNT,
+                                                 umb.msg_bytes);
+
+                                cnt = rd_kafka_q_len(umb.rktp->rktp_fetchq);
+                                rd_kafka_q_purge(umb.rktp->rktp_fetchq);
+                                rd_kafka_buf_destroy(rkbuf);
+
+                                RD_UT_ASSERT(!err &&
+                                             cnt == UT_MSGSET_BENCH_MSGCNT,
+                                             "v%d/%s: expected %d messages, "
+                                             "not %d: %s",
+                                             MsgVersion,
+                                             ut_msgset_bench_codecs[i],
+                                             UT_MSGSET_BENCH_MSGCNT, cnt,
+                                             rd_kafka_err2str(err));
+                        }
+                        rd_ut_bench_report(&rub);
+
+                        rd_free(mset);
+                        ut_msgset_bench_destroy(&umb);
+                }
+        }
+
+        RD_UT_PASS();
+}
+
+
+/**@}*/
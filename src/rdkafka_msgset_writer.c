@@ -42,6 +42,7 @@
 #include "snappy.h"
 #include "rdvarint.h"
 #include "crc32c.h"
+#include "rdunittest.h"
 
 
 typedef struct rd_kafka_msgset_writer_s {
@@ -158,14 +159,15 @@ rd_kafka_msgset_writer_select_MsgVersion (rd_kafka_msgset_writer_t *msetw) {
                                    rd_kafka_compression2str(
                                            msetw->msetw_compression));
                 else
-                        rd_rkb_dbg(rkb, MSG, "PRODUCE",
-                                   "%.*s [%"PRId32"]: "
-                                   "Broker does not support compression "
-                                   "type %s: not compressing batch",
-                                   RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
-                                   rktp->rktp_partition,
-                                   rd_kafka_compression2str(
-                                           msetw->msetw_compression));
+                        rd_rkb_dbg_rktp(rkb, rktp, MSG, "PRODUCE",
+                                        "%.*s [%"PRId32"]: "
+                                        "Broker does not support compression "
+                                        "type %s: not compressing batch",
+                                        RD_KAFKAP_STR_PR(
+                                                rktp->rktp_rkt->rkt_topic),
+                                        rktp->rktp_partition,
+                                        rd_kafka_compression2str(
+                                                msetw->msetw_compression));
 
                 msetw->msetw_compression = RD_KAFKA_COMPRESSION_NONE;
         } else {
@@ -826,6 +828,7 @@ rd_kafka_msgset_writer_write_msgq (rd_kafka_msgset_writer_t *msetw,
         msetw->msetw_firstmsg.timestamp = rkm->rkm_timestamp;
 
         rd_kafka_msgbatch_set_first_msg(msetw->msetw_batch, rkm);
+        msetw->msetw_batch->ts_enq = rkm->rkm_ts_enq;
 
         /*
          * Write as many messages as possible until buffer is full
@@ -835,16 +838,17 @@ rd_kafka_msgset_writer_write_msgq (rd_kafka_msgset_writer_t *msetw,
                 if (unlikely(msetw->msetw_batch->last_msgid &&
                              msetw->msetw_batch->last_msgid <
                              rkm->rkm_u.producer.msgid)) {
-                        rd_rkb_dbg(rkb, MSG, "PRODUCE",
-                                   "%.*s [%"PRId32"]: "
-                                   "Reconstructed MessageSet "
-                                   "(%d message(s), %"PRIusz" bytes, "
-                                   "MsgIds %"PRIu64"..%"PRIu64")",
-                                   RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
-                                   rktp->rktp_partition,
-                                   msgcnt, len,
-                                   msetw->msetw_batch->first_msgid,
-                                   msetw->msetw_batch->last_msgid);
+                        rd_rkb_dbg_rktp(rkb, rktp, MSG, "PRODUCE",
+                                        "%.*s [%"PRId32"]: "
+                                        "Reconstructed MessageSet "
+                                        "(%d message(s), %"PRIusz" bytes, "
+                                        "MsgIds %"PRIu64"..%"PRIu64")",
+                                        RD_KAFKAP_STR_PR(
+                                                rktp->rktp_rkt->rkt_topic),
+                                        rktp->rktp_partition,
+                                        msgcnt, len,
+                                        msetw->msetw_batch->first_msgid,
+                                        msetw->msetw_batch->last_msgid);
                         break;
                 }
 
@@ -852,13 +856,14 @@ rd_kafka_msgset_writer_write_msgq (rd_kafka_msgset_writer_t *msetw,
                              len + rd_kafka_msg_wire_size(rkm, msetw->
                                                           msetw_MsgVersion) >
                              max_msg_size)) {
-                        rd_rkb_dbg(rkb, MSG, "PRODUCE",
-                                   "%.*s [%"PRId32"]: "
-                                   "No more space in current MessageSet "
-                                   "(%i message(s), %"PRIusz" bytes)",
-                                   RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
-                                   rktp->rktp_partition,
-                                   msgcnt, len);
+                        rd_rkb_dbg_rktp(rkb, rktp, MSG, "PRODUCE",
+                                        "%.*s [%"PRId32"]: "
+                                        "No more space in current MessageSet "
+                                        "(%i message(s), %"PRIusz" bytes)",
+                                        RD_KAFKAP_STR_PR(
+                                                rktp->rktp_rkt->rkt_topic),
+                                        rktp->rktp_partition,
+                                        msgcnt, len);
                         break;
                 }
 
@@ -1354,9 +1359,16 @@ rd_kafka_msgset_writer_finalize (rd_kafka_msgset_writer_t *msetw,
          * the request obsolete. */
         msetw->msetw_rkbuf->rkbuf_u.Produce.batch.pid = msetw->msetw_pid;
 
+        rd_kafka_msgbatch_stage(msetw->msetw_batch, msetw->msetw_rkb,
+                                RD_KAFKA_STATS_PRODUCE_STAGE_LINGER);
+
         /* Compress the message set */
-        if (msetw->msetw_compression)
+        if (msetw->msetw_compression) {
                 rd_kafka_msgset_writer_compress(msetw, &len);
+                rd_kafka_msgbatch_stage(
+                        msetw->msetw_batch, msetw->msetw_rkb,
+                        RD_KAFKA_STATS_PRODUCE_STAGE_COMPRESS);
+        }
 
         msetw->msetw_messages_len = len;
 
@@ -1366,17 +1378,18 @@ rd_kafka_msgset_writer_finalize (rd_kafka_msgset_writer_t *msetw,
         /* Return final MessageSetSize */
         *MessageSetSizep = msetw->msetw_MessageSetSize;
 
-        rd_rkb_dbg(msetw->msetw_rkb, MSG, "PRODUCE",
-                   "%s [%"PRId32"]: "
-                   "Produce MessageSet with %i message(s) (%"PRIusz" bytes, "
-                   "ApiVersion %d, MsgVersion %d, MsgId %"PRIu64", "
-                   "BaseSeq %"PRId32", %s)",
-                   rktp->rktp_rkt->rkt_topic->str, rktp->rktp_partition,
-                   cnt, msetw->msetw_MessageSetSize,
-                   msetw->msetw_ApiVersion, msetw->msetw_MsgVersion,
-                   msetw->msetw_batch->first_msgid,
-                   msetw->msetw_batch->first_seq,
-                   rd_kafka_pid2str(msetw->msetw_pid));
+        rd_rkb_dbg_rktp(msetw->msetw_rkb, rktp, MSG, "PRODUCE",
+                        "%s [%"PRId32"]: "
+                        "Produce MessageSet with %i message(s) (%"PRIusz" "
+                        "bytes, "
+                        "ApiVersion %d, MsgVersion %d, MsgId %"PRIu64", "
+                        "BaseSeq %"PRId32", %s)",
+                        rktp->rktp_rkt->rkt_topic->str, rktp->rktp_partition,
+                        cnt, msetw->msetw_MessageSetSize,
+                        msetw->msetw_ApiVersion, msetw->msetw_MsgVersion,
+                        msetw->msetw_batch->first_msgid,
+                        msetw->msetw_batch->first_seq,
+                        rd_kafka_pid2str(msetw->msetw_pid));
 
         rd_kafka_msgq_verify_order(rktp, &msetw->msetw_batch->msgq,
                                    msetw->msetw_batch->first_msgid, rd_false);
@@ -1423,3 +1436,184 @@ rd_kafka_msgset_create_ProduceRequest (rd_kafka_broker_t *rkb,
 
         return rd_kafka_msgset_writer_finalize(&msetw, MessageSetSizep);
 }
+
+
+
+/**
+ * @name Benchmarks
+ * @{
+ */
+
+#define UT_MSGSET_BENCH_KEYSIZE  8
+#define UT_MSGSET_BENCH_MSGSIZE  100
+
+
+/**
+ * @brief Set up a producer with a logical broker whose features limit the
+ *        msgset writer to \p MsgVersion, a topic configured with
+ *        compression \p codec, and \p msgcnt messages with
+ *        text-like (partly compressible) keys and values on \p umb->rkmq.
+ *
+ * @returns 0 on success or -1 if \p codec is not available in this build
+ *          or not supported by \p MsgVersion, in which case there is
+ *          nothing to destroy.
+ */
+int ut_msgset_bench_init (ut_msgset_bench_t *umb, int MsgVersion,
+                          const char *codec, int msgcnt) {
+        static const char alphabet[] = "abcdefghijklmnop";
+        const size_t msgsize = UT_MSGSET_BENCH_KEYSIZE +
+                UT_MSGSET_BENCH_MSGSIZE;
+        rd_kafka_conf_t *conf;
+        uint32_t seed = 1;
+        char nummsgs[16];
+        int i;
+
+        memset(umb, 0, sizeof(*umb));
+
+        if (MsgVersion < 2 && !strcmp(codec, "zstd"))
+                return -1;
+
+        conf = rd_kafka_conf_new();
+        rd_snprintf(nummsgs, sizeof(nummsgs), "%d", msgcnt);
+        rd_kafka_conf_set(conf, "batch.num.messages", nummsgs, NULL, 0);
+        if (rd_kafka_conf_set(conf, "compression.codec", codec, NULL, 0) !=
+            RD_KAFKA_CONF_OK) {
+                rd_kafka_conf_destroy(conf);
+                return -1;
+        }
+
+        umb->rk = rd_kafka_new(RD_KAFKA_PRODUCER, conf, NULL, 0);
+        rd_assert(umb->rk);
+
+        /* Use a logical broker to avoid any connection attempts. */
+        umb->rkb = rd_kafka_broker_add_logical(umb->rk, "unittest");
+
+        rd_kafka_broker_lock(umb->rkb);
+        umb->rkb->rkb_features = RD_KAFKA_FEATURE_UNITTEST |
+                RD_KAFKA_FEATURE_ALL;
+        if (MsgVersion < 2)
+                umb->rkb->rkb_features &= ~RD_KAFKA_FEATURE_MSGVER2;
+        if (MsgVersion < 1)
+                umb->rkb->rkb_features &= ~RD_KAFKA_FEATURE_MSGVER1;
+        rd_kafka_broker_unlock(umb->rkb);
+
+        umb->s_rktp = rd_kafka_toppar_get2(umb->rk, "uttopic", 0,
+                                           rd_false, rd_true);
+        umb->rktp = rd_kafka_toppar_s2i(umb->s_rktp);
+        rd_ut_kafka_topic_set_topic_exists(umb->rktp->rktp_rkt, 1, -1);
+
+        rd_kafka_msgq_init(&umb->rkmq);
+        umb->payload = rd_malloc(msgsize * msgcnt);
+
+        for (i = 0 ; i < msgcnt ; i++) {
+                char *key = umb->payload + (msgsize * i);
+                char *value = key + UT_MSGSET_BENCH_KEYSIZE;
+                char keybuf[16];
+                rd_kafka_msg_t *rkm;
+                int of, j;
+
+                /* The key is not nul-terminated */
+                rd_snprintf(keybuf, sizeof(keybuf), "k%07d", i);
+                memcpy(key, keybuf, UT_MSGSET_BENCH_KEYSIZE);
+                of = rd_snprintf(value, UT_MSGSET_BENCH_MSGSIZE,
+                                 "message %d: ", i);
+                for (j = of ; j < UT_MSGSET_BENCH_MSGSIZE ; j++) {
+                        seed = seed * 1103515245 + 12345;
+                        value[j] = alphabet[(seed >> 16) & 0xf];
+                }
+
+                rkm = ut_rd_kafka_msg_new();
+                rkm->rkm_u.producer.msgid = (uint64_t)i + 1;
+                rkm->rkm_key = key;
+                rkm->rkm_key_len = UT_MSGSET_BENCH_KEYSIZE;
+                rkm->rkm_payload = value;
+                rkm->rkm_len = UT_MSGSET_BENCH_MSGSIZE;
+                rkm->rkm_timestamp = 1000000 + i;
+                rd_kafka_msgq_enq(&umb->rkmq, rkm);
+        }
+
+        umb->msg_bytes = (int64_t)msgsize * msgcnt;
+
+        return 0;
+}
+
+
+/**
+ * @brief Destroy everything set up by ut_msgset_bench_init().
+ */
+void ut_msgset_bench_destroy (ut_msgset_bench_t *umb) {
+        ut_rd_kafka_msgq_purge(&umb->rkmq);
+        rd_free(umb->payload);
+        rd_kafka_toppar_destroy(umb->s_rktp);
+        rd_kafka_broker_destroy(umb->rkb);
+        rd_kafka_destroy(umb->rk);
+}
+
+
+/**
+ * @brief Benchmark ProduceRequest MessageSet construction, including
+ *        compression and CRC calculation, of a 1000 message batch for each
+ *        MsgVersion and compression codec.
+ */
+int benchmark_msgset_writer (void) {
+        const rd_kafka_pid_t pid = RD_KAFKA_PID_INITIALIZER;
+        int MsgVersion, i;
+
+        for (MsgVersion = 0 ; MsgVersion <= 2 ; MsgVersion++) {
+                for (i = 0 ; ut_msgset_bench_codecs[i] ; i++) {
+                        ut_msgset_bench_t umb;
+                        rd_ut_bench_t rub;
+                        size_t msize = 0;
+
+                        if (ut_msgset_bench_init(&umb, MsgVersion,
+                                                 ut_msgset_bench_codecs[i],
+                                                 UT_MSGSET_BENCH_MSGCNT) == -1)
+                                continue;
+
+                        rd_ut_bench_init(&rub,
+                                         "msgset_writer/v%d/%s",
+                                         MsgVersion,
+                                         ut_msgset_bench_codecs[i]);
+                        while (rd_ut_bench_more(&rub)) {
+                                rd_kafka_buf_t *rkbuf;
+
+                                rd_ut_bench_start(&rub);
+                                rkbuf = rd_kafka_msgset_create_ProduceRequest(
+                                        umb.rkb, umb.rktp, &umb.rkmq, pid,
+                                        &msize);
+                                rd_ut_bench_stop(&rub, UT_MSGSET_BENCH_MSGCNT,
+                                                 umb.msg_bytes);
+
+                                RD_UT_ASSERT(rkbuf &&
+                                             rd_kafka_msgq_len(
+                                                     &rkbuf->rkbuf_batch.msgq)
+                                             == UT_MSGSET_BENCH_MSGCNT,
+                                             "v%d/%s: expected all %d "
+                                             "messages in the batch",
+                                             MsgVersion,
+                                             ut_msgset_bench_codecs[i],
+                                             UT_MSGSET_BENCH_MSGCNT);
+
+                                /* Put the messages back for the next
+                                 * iteration. */
+                                rd_kafka_msgq_prepend(
+                                        &umb.rkmq, &rkbuf->rkbuf_batch.msgq);
+                                rd_kafka_buf_destroy(rkbuf);
+                        }
+                        rd_ut_bench_report(&rub);
+
+                        RD_UT_SAY("msgset_writer/v%d/%s: MessageSet is "
+                                  "%"PRIusz" bytes for %"PRId64" bytes of "
+                                  "keys and values",
+                                  MsgVersion, ut_msgset_bench_codecs[i],
+                                  msize, umb.msg_bytes);
+
+                        ut_msgset_bench_destroy(&umb);
+                }
+        }
+
+        RD_UT_PASS();
+}
+
+
+/**@}*/
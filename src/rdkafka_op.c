@@ -33,6 +33,7 @@
 #include "rdkafka_topic.h"
 #include "rdkafka_partition.h"
 #include "rdkafka_offset.h"
+#include "rdunittest.h"
 
 /* Current number of rd_kafka_op_t */
 rd_atomic32_t rd_kafka_op_cnt;
@@ -80,7 +81,8 @@ const char *rd_kafka_op2str (rd_kafka_op_type_t type) {
                 [RD_KAFKA_OP_ADMIN_RESULT] = "REPLY:ADMIN_RESULT",
                 [RD_KAFKA_OP_PURGE] = "REPLY:PURGE",
                 [RD_KAFKA_OP_CONNECT] = "REPLY:CONNECT",
-                [RD_KAFKA_OP_OAUTHBEARER_REFRESH] = "REPLY:OAUTHBEARER_REFRESH"
+                [RD_KAFKA_OP_OAUTHBEARER_REFRESH] = "REPLY:OAUTHBEARER_REFRESH",
+                [RD_KAFKA_OP_RESOLVE] = "REPLY:RESOLVE"
         };
 
         if (type & RD_KAFKA_OP_REPLY)
@@ -203,6 +205,7 @@ rd_kafka_op_t *rd_kafka_op_new0 (const char *source, rd_kafka_op_type_t type) {
                 [RD_KAFKA_OP_PURGE] = sizeof(rko->rko_u.purge),
                 [RD_KAFKA_OP_CONNECT] = 0,
                 [RD_KAFKA_OP_OAUTHBEARER_REFRESH] = 0,
+                [RD_KAFKA_OP_RESOLVE] = sizeof(rko->rko_u.resolve),
 	};
 	size_t tsize = op2size[type & ~RD_KAFKA_OP_FLAGMASK];
 
@@ -222,6 +225,7 @@ void rd_kafka_op_destroy (rd_kafka_op_t *rko) {
 	switch (rko->rko_type & ~RD_KAFKA_OP_FLAGMASK)
 	{
 	case RD_KAFKA_OP_FETCH:
+		rd_kafka_op_fetch_msg_unaccount(rko);
 		rd_kafka_msg_destroy(NULL, &rko->rko_u.fetch.rkm);
 		/* Decrease refcount on rkbuf to eventually rd_free shared buf*/
 		if (rko->rko_u.fetch.rkbuf)
@@ -562,6 +566,9 @@ rd_kafka_op_new_fetch_msg (rd_kafka_msg_t **rkmp,
          * and its memory backing buffers are freed. */
         rko->rko_u.fetch.rkbuf = rkbuf;
         rd_kafka_buf_keep(rkbuf);
+        rd_atomic64_add(&rkbuf->rkbuf_fetch.live, (int64_t)(key_len+val_len));
+        rd_atomic64_add(&rktp->rktp_rkt->rkt_rk->rk_prefetch.queued_bytes,
+                        (int64_t)(key_len+val_len));
 
         rkm->rkm_offset    = offset;
 
@@ -582,6 +589,148 @@ rd_kafka_op_new_fetch_msg (rd_kafka_msg_t **rkmp,
 }
 
 
+/**
+ * @brief Copy the key, value and headers of a consumed message to a
+ *        compact allocation and release the message's reference on
+ *        the (large) fetch buffer.
+ */
+static void rd_kafka_op_fetch_msg_copyout (rd_kafka_t *rk,
+                                           rd_kafka_op_t *rko) {
+        rd_kafka_msg_t *rkm = &rko->rko_u.fetch.rkm;
+        rd_kafka_buf_t *rkbuf = rko->rko_u.fetch.rkbuf;
+        size_t hdrs_len = (size_t)RD_KAFKAP_BYTES_LEN(&rkm->rkm_u.consumer.
+                                                      binhdrs);
+        size_t len = rkm->rkm_key_len + rkm->rkm_len + hdrs_len;
+        char *buf = NULL, *p;
+
+        if (len > 0) {
+                p = buf = rd_malloc(len);
+
+                if (rkm->rkm_key) {
+                        memcpy(p, rkm->rkm_key, rkm->rkm_key_len);
+                        rkm->rkm_key = p;
+                        p += rkm->rkm_key_len;
+                }
+
+                if (rkm->rkm_payload) {
+                        memcpy(p, rkm->rkm_payload, rkm->rkm_len);
+                        rkm->rkm_payload = p;
+                        p += rkm->rkm_len;
+                }
+
+                if (hdrs_len > 0) {
+                        memcpy(p, rkm->rkm_u.consumer.binhdrs.data, hdrs_len);
+                        rkm->rkm_u.consumer.binhdrs.data = p;
+                        p += hdrs_len;
+                }
+        }
+
+        rd_atomic64_sub(&rkbuf->rkbuf_fetch.live,
+                        (int64_t)(rkm->rkm_key_len + rkm->rkm_len));
+        rd_kafka_buf_destroy(rkbuf);
+
+        /* A message without key, value and headers needs no buffer. */
+        rko->rko_u.fetch.rkbuf = len > 0 ?
+                rd_kafka_buf_new_shadow(buf, len, rd_free) : NULL;
+
+        rkm->rkm_flags |= RD_KAFKA_MSG_F_COPYOUT;
+
+        rd_atomic64_add(&rk->rk_fetchbuf.copyout_cnt, 1);
+        rd_atomic64_add(&rk->rk_fetchbuf.copyout_bytes, (int64_t)len);
+}
+
+
+/**
+ * @brief Apply the fetch.copyout.* retention policy to a consumed message
+ *        that is about to be handed to the application, and account for
+ *        the fetch buffer it pins.
+ *
+ * Consumed messages point into the shared fetch response (or decompression)
+ * buffer, so a few messages retained by the application keep the entire
+ * buffer alive. Since key and value pointers that have already been handed
+ * to the application can't be moved, the policy is applied on delivery:
+ * a small message is copied out if the live ratio of its buffer has
+ * dropped below fetch.copyout.ratio, or if the buffer has been held by
+ * earlier delivered messages for longer than fetch.copyout.age.ms.
+ *
+ * @locality any thread handing messages to the application
+ */
+void rd_kafka_op_fetch_msg_deliver (rd_kafka_op_t *rko) {
+        rd_kafka_msg_t *rkm = &rko->rko_u.fetch.rkm;
+        rd_kafka_buf_t *rkbuf = rko->rko_u.fetch.rkbuf;
+        rd_kafka_toppar_t *rktp;
+        rd_kafka_t *rk;
+        const rd_kafka_conf_t *conf;
+        int64_t size, totsize;
+
+        if (!rkbuf ||
+            (rkm->rkm_flags & (RD_KAFKA_MSG_F_APP|RD_KAFKA_MSG_F_COPYOUT)))
+                return; /* Already delivered */
+
+        rktp = rd_kafka_toppar_s2i(rko->rko_rktp);
+        rk   = rktp->rktp_rkt->rkt_rk;
+        conf = &rk->rk_conf;
+        size = (int64_t)(rkm->rkm_key_len + rkm->rkm_len);
+
+        /* No longer counts towards the prefetch budget */
+        rd_atomic64_sub(&rk->rk_prefetch.queued_bytes, size);
+        rd_atomic64_add(&rktp->rktp_prefetch.app_bytes, size);
+        totsize = size + RD_KAFKAP_BYTES_LEN(&rkm->rkm_u.consumer.binhdrs);
+
+        if (totsize <= conf->fetch_copyout_max_bytes &&
+            (size_t)totsize * 2 < rkbuf->rkbuf_totlen &&
+            ((conf->fetch_copyout_ratio > 0 &&
+              rd_atomic64_get(&rkbuf->rkbuf_fetch.live) * 100 <
+              (int64_t)rkbuf->rkbuf_totlen * conf->fetch_copyout_ratio) ||
+             (conf->fetch_copyout_age_ms > 0 &&
+              rd_atomic32_get(&rkbuf->rkbuf_fetch.app_cnt) > 0 &&
+              rd_clock() - rd_atomic64_get(&rkbuf->rkbuf_fetch.ts_pinned) >
+              (rd_ts_t)conf->fetch_copyout_age_ms * 1000))) {
+                rd_kafka_op_fetch_msg_copyout(rk, rko);
+                return;
+        }
+
+        rkm->rkm_flags |= RD_KAFKA_MSG_F_APP;
+
+        if (rd_atomic32_add(&rkbuf->rkbuf_fetch.app_cnt, 1) == 1) {
+                rd_atomic64_set(&rkbuf->rkbuf_fetch.ts_pinned, rd_clock());
+                rd_atomic64_add(&rk->rk_fetchbuf.pinned_bytes,
+                                (int64_t)rkbuf->rkbuf_totlen);
+        }
+
+        rd_atomic64_add(&rk->rk_fetchbuf.live_bytes, size);
+}
+
+
+/**
+ * @brief Undo the fetch buffer and prefetch budget accounting of a
+ *        consumed message prior to destroying it.
+ */
+void rd_kafka_op_fetch_msg_unaccount (rd_kafka_op_t *rko) {
+        rd_kafka_msg_t *rkm = &rko->rko_u.fetch.rkm;
+        rd_kafka_buf_t *rkbuf = rko->rko_u.fetch.rkbuf;
+        rd_kafka_t *rk = rd_kafka_toppar_s2i(rko->rko_rktp)->rktp_rkt->rkt_rk;
+        int64_t size = (int64_t)(rkm->rkm_key_len + rkm->rkm_len);
+
+        if (!(rkm->rkm_flags & (RD_KAFKA_MSG_F_APP|RD_KAFKA_MSG_F_COPYOUT)))
+                /* Never handed to the application: still prefetched. */
+                rd_atomic64_sub(&rk->rk_prefetch.queued_bytes, size);
+
+        if (!rkbuf || (rkm->rkm_flags & RD_KAFKA_MSG_F_COPYOUT))
+                return;
+
+        rd_atomic64_sub(&rkbuf->rkbuf_fetch.live, size);
+
+        if (rkm->rkm_flags & RD_KAFKA_MSG_F_APP) {
+                rd_atomic64_sub(&rk->rk_fetchbuf.live_bytes, size);
+
+                if (rd_atomic32_sub(&rkbuf->rkbuf_fetch.app_cnt, 1) == 0)
+                        rd_atomic64_sub(&rk->rk_fetchbuf.pinned_bytes,
+                                        (int64_t)rkbuf->rkbuf_totlen);
+        }
+}
+
+
 /**
  * Enqueue ERR__THROTTLE op, if desired.
  */
@@ -699,3 +848,113 @@ void rd_kafka_op_offset_store (rd_kafka_t *rk, rd_kafka_op_t *rko,
 		rd_kafka_offset_store0(rktp, rkmessage->offset+1, 0/*no lock*/);
 	rd_kafka_toppar_unlock(rktp);
 }
+
+
+
+/**
+ * @name Unit tests
+ */
+
+/**
+ * @brief Verify the fetch.copyout.* policies and fetch buffer accounting.
+ */
+int unittest_fetch_copyout (void) {
+        rd_kafka_t *rk;
+        rd_kafka_conf_t *conf;
+        shptr_rd_kafka_toppar_t *s_rktp;
+        rd_kafka_toppar_t *rktp;
+        rd_kafka_buf_t *rkbuf;
+        rd_kafka_op_t *rko[3];
+        rd_kafka_msg_t *rkm;
+        const size_t bufsize = 1000;
+        char *buf;
+        int i;
+
+        conf = rd_kafka_conf_new();
+        /* Live ratio trigger at 5%: the three 20 byte messages make up 6% */
+        rd_kafka_conf_set(conf, "fetch.copyout.ratio", "5", NULL, 0);
+        rd_kafka_conf_set(conf, "fetch.copyout.age.ms", "1", NULL, 0);
+        rk = rd_kafka_new(RD_KAFKA_CONSUMER, conf, NULL, 0);
+        RD_UT_ASSERT(rk, "failed to create consumer");
+
+        s_rktp = rd_kafka_toppar_get2(rk, "unittest", 0, 0, 1);
+        RD_UT_ASSERT(s_rktp, "failed to create toppar");
+        rktp = rd_kafka_toppar_s2i(s_rktp);
+
+        buf = rd_malloc(bufsize);
+        for (i = 0 ; i < (int)bufsize ; i++)
+                buf[i] = (char)('a' + (i % 26));
+        rkbuf = rd_kafka_buf_new_shadow(buf, bufsize, rd_free);
+
+        for (i = 0 ; i < 3 ; i++)
+                rko[i] = rd_kafka_op_new_fetch_msg(&rkm, rktp, 0, rkbuf, i,
+                                                   10, buf + (i * 100),
+                                                   10, buf + (i * 100) + 10);
+
+        /* The ops hold their own references */
+        rd_kafka_buf_destroy(rkbuf);
+
+        RD_UT_ASSERT(rd_atomic64_get(&rk->rk_prefetch.queued_bytes) == 60,
+                     "expected 60 prefetched bytes, not %"PRId64,
+                     rd_atomic64_get(&rk->rk_prefetch.queued_bytes));
+
+        /* Message 0: 60 live bytes, above the 5% ratio, and the buffer is
+         * not yet held by the application: must reference the buffer. */
+        rd_kafka_message_get(rko[0]);
+        rkm = &rko[0]->rko_u.fetch.rkm;
+        RD_UT_ASSERT(!(rkm->rkm_flags & RD_KAFKA_MSG_F_COPYOUT) &&
+                     rkm->rkm_payload == buf + 10,
+                     "message 0 should not be copied out");
+        RD_UT_ASSERT(rd_atomic64_get(&rk->rk_fetchbuf.pinned_bytes) ==
+                     (int64_t)bufsize,
+                     "expected %"PRIusz" pinned bytes, not %"PRId64,
+                     bufsize, rd_atomic64_get(&rk->rk_fetchbuf.pinned_bytes));
+        RD_UT_ASSERT(rd_atomic64_get(&rk->rk_fetchbuf.live_bytes) == 20,
+                     "expected 20 live bytes, not %"PRId64,
+                     rd_atomic64_get(&rk->rk_fetchbuf.live_bytes));
+
+        /* Message 1: the buffer has been held by message 0 for longer
+         * than fetch.copyout.age.ms: must be copied out. */
+        rd_usleep(10*1000, NULL);
+        rd_kafka_message_get(rko[1]);
+        rkm = &rko[1]->rko_u.fetch.rkm;
+        RD_UT_ASSERT(rkm->rkm_flags & RD_KAFKA_MSG_F_COPYOUT,
+                     "message 1 should be copied out by age");
+        RD_UT_ASSERT(rkm->rkm_key != buf + 100 &&
+                     !memcmp(rkm->rkm_key, buf + 100, 10) &&
+                     !memcmp(rkm->rkm_payload, buf + 110, 10),
+                     "message 1 copy mismatch");
+
+        /* Message 0 is destroyed, unpinning the buffer. */
+        rd_kafka_op_destroy(rko[0]);
+        RD_UT_ASSERT(rd_atomic64_get(&rk->rk_fetchbuf.pinned_bytes) == 0 &&
+                     rd_atomic64_get(&rk->rk_fetchbuf.live_bytes) == 0,
+                     "buffer should no longer be pinned");
+
+        /* Message 2: only 20 live bytes (2%) remain: copied out by ratio,
+         * which releases the last reference to the fetch buffer. */
+        rd_kafka_message_get(rko[2]);
+        rkm = &rko[2]->rko_u.fetch.rkm;
+        RD_UT_ASSERT((rkm->rkm_flags & RD_KAFKA_MSG_F_COPYOUT) &&
+                     !memcmp(rkm->rkm_key, "stuvwxyzab", 10),
+                     "message 2 should be copied out by ratio");
+
+        RD_UT_ASSERT(rd_atomic64_get(&rk->rk_fetchbuf.copyout_cnt) == 2 &&
+                     rd_atomic64_get(&rk->rk_fetchbuf.copyout_bytes) == 40,
+                     "expected 2 copy-outs of 40 bytes, not %"PRId64
+                     " of %"PRId64,
+                     rd_atomic64_get(&rk->rk_fetchbuf.copyout_cnt),
+                     rd_atomic64_get(&rk->rk_fetchbuf.copyout_bytes));
+
+        rd_kafka_op_destroy(rko[1]);
+        rd_kafka_op_destroy(rko[2]);
+
+        RD_UT_ASSERT(rd_atomic64_get(&rk->rk_prefetch.queued_bytes) == 0 &&
+                     rd_atomic64_get(&rktp->rktp_prefetch.app_bytes) == 60,
+                     "expected all 60 bytes to be handed to the application");
+
+        rd_kafka_toppar_destroy(s_rktp);
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
@@ -120,6 +120,8 @@ typedef enum {
         RD_KAFKA_OP_PURGE,           /**< Purge queues */
         RD_KAFKA_OP_CONNECT,         /**< Connect (to broker) */
         RD_KAFKA_OP_OAUTHBEARER_REFRESH, /**< Refresh OAUTHBEARER token */
+        RD_KAFKA_OP_RESOLVE,         /**< Broker address resolved,
+                                      *   see rd_kafka_resolve_lookup() */
         RD_KAFKA_OP__END
 } rd_kafka_op_type_t;
 
@@ -317,6 +319,12 @@ struct rd_kafka_op_s {
 			rd_kafka_msgq_t msgq;
 			rd_kafka_msgq_t msgq2;
 			int do_purge2;
+                        /* Producer batch stage timestamps, for
+                         * statistics, see rd_kafka_dr_served(). */
+                        rd_ts_t ts_batch_enq; /**< First message
+                                               *   enqueued */
+                        rd_ts_t ts_enq;       /**< DR enqueued,
+                                               *   0 if not sampled. */
 		} dr;
 
 		struct {
@@ -421,6 +429,10 @@ struct rd_kafka_op_s {
                 struct {
                         int flags; /**< purge_flags from rd_kafka_purge() */
                 } purge;
+
+                struct {
+                        rd_ts_t latency; /**< Time spent resolving */
+                } resolve;
 	} rko_u;
 };
 
@@ -481,6 +493,8 @@ rd_kafka_op_new_fetch_msg (rd_kafka_msg_t **rkmp,
                            int64_t offset,
                            size_t key_len, const void *key,
                            size_t val_len, const void *val);
+void rd_kafka_op_fetch_msg_deliver (rd_kafka_op_t *rko);
+void rd_kafka_op_fetch_msg_unaccount (rd_kafka_op_t *rko);
 
 void rd_kafka_op_throttle_time (struct rd_kafka_broker_s *rkb,
 				rd_kafka_q_t *rkq,
@@ -500,4 +514,6 @@ void rd_kafka_op_print (FILE *fp, const char *prefix, rd_kafka_op_t *rko);
 void rd_kafka_op_offset_store (rd_kafka_t *rk, rd_kafka_op_t *rko,
 			       const rd_kafka_message_t *rkmessage);
 
+int unittest_fetch_copyout (void);
+
 #endif /* _RDKAFKA_OP_H_ */
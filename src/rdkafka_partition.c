@@ -214,8 +214,20 @@ shptr_rd_kafka_toppar_t *rd_kafka_toppar_new0 (rd_kafka_itopic_t *rkt,
 	rktp->rktp_op_version = rd_atomic32_get(&rktp->rktp_version);
 
         rd_atomic32_init(&rktp->rktp_msgs_inflight, 0);
+        rd_atomic64_init(&rktp->rktp_prefetch.app_bytes, 0);
+        rktp->rktp_prefetch.req_max_bytes = rktp->rktp_fetch_msg_max_bytes;
+        rktp->rktp_prefetch.adaptive_max_bytes =
+                rktp->rktp_fetch_msg_max_bytes;
         rd_kafka_pid_reset(&rktp->rktp_eos.pid);
 
+        rd_avg_init(&rktp->rktp_avg_e2e_latency, RD_AVG_GAUGE, 0, 60*1000, 2,
+                    rkt->rkt_rk->rk_conf.stats_interval_ms &&
+                    rkt->rkt_rk->rk_type == RD_KAFKA_CONSUMER);
+        rd_avg_init(&rktp->rktp_avg_fetchq_latency, RD_AVG_GAUGE,
+                    0, 1000*1000, 2,
+                    rkt->rkt_rk->rk_conf.stats_interval_ms &&
+                    rkt->rkt_rk->rk_type == RD_KAFKA_CONSUMER);
+
         /* Consumer: If statistics is available we query the oldest offset
          * of each partition.
          * Since the oldest offset only moves on log retention, we cap this
@@ -291,6 +303,9 @@ void rd_kafka_toppar_destroy_final (rd_kafka_toppar_t *rktp) {
 
 	rd_kafka_topic_destroy0(rktp->rktp_s_rkt);
 
+        rd_avg_destroy(&rktp->rktp_avg_e2e_latency);
+        rd_avg_destroy(&rktp->rktp_avg_fetchq_latency);
+
 	mtx_destroy(&rktp->rktp_lock);
 
         rd_refcnt_destroy(&rktp->rktp_refcnt);
@@ -1951,20 +1966,20 @@ rd_ts_t rd_kafka_toppar_fetch_decide (rd_kafka_toppar_t *rktp,
         rktp->rktp_offsets_fin = rktp->rktp_offsets;
 
         if (rktp->rktp_fetch != should_fetch) {
-                rd_rkb_dbg(rkb, FETCH, "FETCH",
-                           "Topic %s [%"PRId32"] in state %s at offset %s "
-                           "(%d/%d msgs, %"PRId64"/%d kb queued, "
-			   "opv %"PRId32") is %sfetchable: %s",
-                           rktp->rktp_rkt->rkt_topic->str,
-                           rktp->rktp_partition,
-			   rd_kafka_fetch_states[rktp->rktp_fetch_state],
-                           rd_kafka_offset2str(rktp->rktp_next_offset),
-                           rd_kafka_q_len(rktp->rktp_fetchq),
-                           rkb->rkb_rk->rk_conf.queued_min_msgs,
-                           rd_kafka_q_size(rktp->rktp_fetchq) / 1024,
-                           rkb->rkb_rk->rk_conf.queued_max_msg_kbytes,
-			   rktp->rktp_fetch_version,
-                           should_fetch ? "" : "not ", reason);
+                rd_rkb_dbg_rktp(rkb, rktp, FETCH, "FETCH",
+                                "Topic %s [%"PRId32"] in state %s at offset %s "
+                                "(%d/%d msgs, %"PRId64"/%d kb queued, "
+                                "opv %"PRId32") is %sfetchable: %s",
+                                rktp->rktp_rkt->rkt_topic->str,
+                                rktp->rktp_partition,
+                                rd_kafka_fetch_states[rktp->rktp_fetch_state],
+                                rd_kafka_offset2str(rktp->rktp_next_offset),
+                                rd_kafka_q_len(rktp->rktp_fetchq),
+                                rkb->rkb_rk->rk_conf.queued_min_msgs,
+                                rd_kafka_q_size(rktp->rktp_fetchq) / 1024,
+                                rkb->rkb_rk->rk_conf.queued_max_msg_kbytes,
+                                rktp->rktp_fetch_version,
+                                should_fetch ? "" : "not ", reason);
 
                 if (should_fetch) {
 			rd_dassert(rktp->rktp_fetch_version > 0);
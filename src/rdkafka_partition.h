@@ -268,6 +268,10 @@ struct rd_kafka_toppar_s { /* rd_kafka_toppar_t */
                                                * Updated periodically
                                                * by broker thread.
                                                * Locks: toppar_lock */
+        uint32_t rktp_stats_crc;            /* statistics.delta: checksum
+                                             * of the last emitted
+                                             * partition stats.
+                                             * Locks: toppar_lock */
 
 	int64_t rktp_hi_offset;              /* Current high offset.
 					      * Locks: toppar_lock */
@@ -341,6 +345,40 @@ struct rd_kafka_toppar_s { /* rd_kafka_toppar_t */
                                               *             drops. */
         } rktp_c;
 
+        rd_avg_t rktp_avg_e2e_latency;    /**< Consumer: message timestamp
+                                           *   to application latency (ms) */
+        rd_avg_t rktp_avg_fetchq_latency; /**< Consumer: FetchResponse to
+                                           *   application latency (us) */
+
+        /**
+         * Consumer prefetch budget state, see queued.max.total.kbytes.
+         * Locality: broker thread, unless noted otherwise.
+         */
+        struct {
+                rd_atomic64_t app_bytes;   /**< Key and value bytes handed
+                                            *   to the application.
+                                            *   Locality: any thread */
+                int64_t  last_app_bytes;   /**< app_bytes at ts_rate */
+                rd_ts_t  ts_rate;          /**< Last rate update */
+                int64_t  rate;             /**< Moving average consumption
+                                            *   rate (bytes/s) */
+                int64_t  weight;           /**< Share of the budget */
+                int64_t  lag_bytes;        /**< Estimated lag in bytes,
+                                            *   0 if caught up. */
+                int64_t  deficit;          /**< fetch.scheduler=drr
+                                            *   credit in bytes */
+                rd_ts_t  ts_fetch;         /**< Last included in a Fetch */
+                int32_t  req_max_bytes;    /**< MaxBytes of last Fetch */
+                int32_t  adaptive_max_bytes; /**< Adaptive fetch size,
+                                              *   see
+                                              *   fetch.adaptive.sizing */
+                rd_bool_t full_fetch;      /**< Bypass the budget share
+                                            *   on the next Fetch, set
+                                            *   when a budget-limited
+                                            *   Fetch couldn't fit a
+                                            *   single message. */
+        } rktp_prefetch;
+
 };
 
 
@@ -30,6 +30,7 @@
 #include "rdkafka_offset.h"
 #include "rdkafka_topic.h"
 #include "rdkafka_interceptor.h"
+#include "rdunittest.h"
 
 int RD_TLS rd_kafka_yield_thread = 0;
 
@@ -526,8 +527,6 @@ int rd_kafka_q_serve_rkmessages (rd_kafka_q_t *rkq, int timeout_ms,
         rd_kafka_q_t *fwdq;
         struct timespec timeout_tspec;
 
-        rd_kafka_app_polled(rk);
-
 	mtx_lock(&rkq->rkq_lock);
         if ((fwdq = rd_kafka_q_fwd_get(rkq, 0))) {
                 /* Since the q_pop may block we need to release the parent
@@ -540,6 +539,10 @@ int rd_kafka_q_serve_rkmessages (rd_kafka_q_t *rkq, int timeout_ms,
 	}
         mtx_unlock(&rkq->rkq_lock);
 
+        /* Only sampled once the queue is not forwarded,
+         * by the recursive call above otherwise. */
+        rd_kafka_app_polled(rk);
+
         rd_timeout_init_timespec(&timeout_tspec, timeout_ms);
 
         rd_kafka_yield_thread = 0;
@@ -609,6 +612,7 @@ int rd_kafka_q_serve_rkmessages (rd_kafka_q_t *rkq, int timeout_ms,
                 rd_kafka_op_destroy(rko);
         }
 
+        rd_kafka_app_poll_return(rk);
 
 	return cnt;
 }
@@ -942,3 +946,97 @@ void rd_kafka_enq_once_trigger_destroy (void *ptr) {
 
         rd_kafka_enq_once_trigger(eonce, RD_KAFKA_RESP_ERR__DESTROY, "destroy");
 }
+
+
+
+/**
+ * @name Benchmarks
+ * @{
+ */
+
+struct ut_queue_bench_producer {
+        rd_kafka_q_t *rkq;
+        int cnt;
+};
+
+static int ut_queue_bench_producer_main (void *arg) {
+        struct ut_queue_bench_producer *prod = arg;
+        int i;
+
+        for (i = 0 ; i < prod->cnt ; i++)
+                rd_kafka_q_enq(prod->rkq, rd_kafka_op_new(RD_KAFKA_OP_NONE));
+
+        return 0;
+}
+
+
+/**
+ * @brief Benchmark op enqueue and pop with \p producer_cnt threads
+ *        enqueuing ops on one queue that the calling thread pops them from.
+ */
+static int do_benchmark_queue (rd_kafka_t *rk, int producer_cnt) {
+#define _OPCNT 20000
+        struct ut_queue_bench_producer prod = { .cnt = _OPCNT / producer_cnt };
+        const int total = prod.cnt * producer_cnt;
+        thrd_t thrds[4];
+        rd_ut_bench_t rub;
+
+        rd_assert(producer_cnt <= (int)RD_ARRAYSIZE(thrds));
+
+        prod.rkq = rd_kafka_q_new(rk);
+
+        rd_ut_bench_init(&rub, "queue/enq_pop/producers=%d", producer_cnt);
+        while (rd_ut_bench_more(&rub)) {
+                int i, popped = 0;
+
+                rd_ut_bench_start(&rub);
+                for (i = 0 ; i < producer_cnt ; i++)
+                        RD_UT_ASSERT(thrd_create(&thrds[i],
+                                                 ut_queue_bench_producer_main,
+                                                 &prod) == thrd_success,
+                                     "thrd_create failed");
+
+                while (popped < total) {
+                        rd_kafka_op_t *rko = rd_kafka_q_pop(prod.rkq,
+                                                            1000, 0);
+                        RD_UT_ASSERT(rko, "timed out after %d/%d ops",
+                                     popped, total);
+                        rd_kafka_op_destroy(rko);
+                        popped++;
+                }
+
+                for (i = 0 ; i < producer_cnt ; i++)
+                        thrd_join(thrds[i], NULL);
+                rd_ut_bench_stop(&rub, total, 0);
+        }
+        rd_ut_bench_report(&rub);
+
+        rd_kafka_q_destroy_owner(prod.rkq);
+#undef _OPCNT
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Benchmark rd_kafka_q_t enqueue/pop under contention from
+ *        1, 2 and 4 producer threads.
+ */
+int benchmark_queue (void) {
+        rd_kafka_t *rk;
+        int fails = 0;
+
+        rk = rd_kafka_new(RD_KAFKA_CONSUMER, rd_kafka_conf_new(), NULL, 0);
+        RD_UT_ASSERT(rk, "failed to create consumer");
+
+        fails += do_benchmark_queue(rk, 1);
+        fails += do_benchmark_queue(rk, 2);
+        fails += do_benchmark_queue(rk, 4);
+
+        rd_kafka_destroy(rk);
+
+        return fails;
+}
+
+
+/**@}*/
@@ -1059,4 +1059,6 @@ rd_kafka_op_t *rd_kafka_enq_once_disable (rd_kafka_enq_once_t *eonce) {
 /**@}*/
 
 
+int benchmark_queue (void);
+
 #endif /* _RDKAFKA_QUEUE_H_ */
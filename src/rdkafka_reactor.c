@@ -0,0 +1,729 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2019 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Shared broker I/O reactor threads, see rdkafka_reactor.h
+ */
+
+#include "rdkafka_int.h"
+#include "rdkafka_broker.h"
+#include "rdkafka_transport_int.h"
+#include "rdunittest.h"
+
+#ifdef __linux__
+#include <signal.h>
+#include <sys/epoll.h>
+
+
+/**< Maximum number of events returned by each epoll_wait() */
+#define RD_KAFKA_REACTOR_EVENTS_MAX  64
+
+/**< Maximum epoll_wait() block time, brokers are served at least
+ *   this often regardless of their wakeup time. */
+#define RD_KAFKA_REACTOR_MAX_BLOCK_MS 1000
+
+
+struct rd_kafka_reactor_s {
+        rd_kafka_t *rkrc_rk;
+        int         rkrc_id;
+        thrd_t      rkrc_thread;
+        int         rkrc_epfd;           /**< epoll set */
+        int         rkrc_wakeup_fd[2];   /**< Reactor wake-up pipe (r/w) */
+
+        mtx_t       rkrc_lock;           /**< Protects rkrc_new and
+                                          *   rkrc_terminate */
+        TAILQ_HEAD(, rd_kafka_broker_s) rkrc_new; /**< Brokers added but
+                                                   *   not yet picked up
+                                                   *   by the reactor. */
+        rd_bool_t   rkrc_terminate;      /**< Terminate when there are
+                                          *   no brokers left. */
+
+        /**< Brokers served by this reactor.
+         *   @locality reactor thread */
+        TAILQ_HEAD(, rd_kafka_broker_s) rkrc_brokers;
+
+        rd_atomic32_t rkrc_broker_cnt;   /**< Number of brokers assigned to
+                                          *   this reactor, including
+                                          *   rkrc_new. */
+
+#if WITH_IO_URING
+        rd_kafka_uring_t *rkrc_uring;    /**< io_uring for the brokers'
+                                          *   data transfers, or NULL. */
+        rd_kafka_reactor_src_t rkrc_uring_src; /**< The ring's fd in the
+                                                *   epoll set. */
+#endif
+};
+
+
+static RD_INLINE uint32_t rd_kafka_reactor_poll2epoll (int events) {
+        return (events & POLLIN ? EPOLLIN : 0) |
+                (events & POLLOUT ? EPOLLOUT : 0);
+}
+
+static RD_INLINE int rd_kafka_reactor_epoll2poll (uint32_t events) {
+        return (events & EPOLLIN ? POLLIN : 0) |
+                (events & EPOLLOUT ? POLLOUT : 0) |
+                (events & EPOLLERR ? POLLERR : 0) |
+                (events & EPOLLHUP ? POLLHUP : 0);
+}
+
+
+/**
+ * @brief Wake up the reactor thread.
+ *
+ * @locality any
+ */
+static void rd_kafka_reactor_wakeup (rd_kafka_reactor_t *rkrc) {
+        char onebyte = 1;
+
+        /* Ignore errors: a full pipe means a wake-up is already pending. */
+        (void)rd_write(rkrc->rkrc_wakeup_fd[1], &onebyte, 1);
+}
+
+
+/**
+ * @brief Drain all signalling bytes from the (non-blocking) pipe \p fd.
+ */
+static void rd_kafka_reactor_drain (int fd) {
+        char buf[1024];
+
+        while (rd_read(fd, buf, sizeof(buf)) > 0)
+                ;
+}
+
+
+/**
+ * @brief Register \p fd for \p events (POLLIN|POLLOUT) as \p src,
+ *        replacing any fd previously registered for \p src.
+ *        Pass \p fd -1 to unregister.
+ *
+ * @locality reactor thread
+ */
+static void rd_kafka_reactor_src_set (rd_kafka_reactor_t *rkrc,
+                                      rd_kafka_reactor_src_t *src,
+                                      int fd, int events) {
+        struct epoll_event ev = RD_ZERO_INIT;
+        int op;
+
+        if (src->fd == fd && src->events == events)
+                return;
+
+        ev.events = rd_kafka_reactor_poll2epoll(events);
+        ev.data.ptr = src;
+
+        if (src->fd != fd) {
+                /* The fd might already have been closed in which case
+                 * it was automatically removed from the epoll set. */
+                if (src->fd != -1)
+                        (void)epoll_ctl(rkrc->rkrc_epfd, EPOLL_CTL_DEL,
+                                        src->fd, &ev);
+                src->fd = -1;
+                src->events = 0;
+                src->revents = 0;
+
+                if (fd == -1)
+                        return;
+
+                op = EPOLL_CTL_ADD;
+        } else
+                op = EPOLL_CTL_MOD;
+
+        if (epoll_ctl(rkrc->rkrc_epfd, op, fd, &ev) == -1) {
+                rd_rkb_log(src->rkb, LOG_ERR, "REACTOR",
+                           "Failed to %s fd %d in reactor %d: %s",
+                           op == EPOLL_CTL_ADD ? "add" : "modify",
+                           fd, rkrc->rkrc_id, rd_strerror(errno));
+                return;
+        }
+
+        src->fd = fd;
+        src->events = events;
+}
+
+
+/**
+ * @brief Unregister the broker's socket prior to it being closed.
+ *
+ * @locality broker thread (the reactor thread)
+ */
+void rd_kafka_reactor_sock_del (rd_kafka_broker_t *rkb) {
+        rd_kafka_reactor_src_set(rkb->rkb_reactor.rkrc,
+                                 &rkb->rkb_reactor.sock, -1, 0);
+}
+
+
+/**
+ * @brief Start serving the brokers added since the last call.
+ *
+ * @locality reactor thread
+ */
+static void rd_kafka_reactor_adopt (rd_kafka_reactor_t *rkrc) {
+        rd_kafka_broker_t *rkb;
+
+        mtx_lock(&rkrc->rkrc_lock);
+        while ((rkb = TAILQ_FIRST(&rkrc->rkrc_new))) {
+                TAILQ_REMOVE(&rkrc->rkrc_new, rkb, rkb_reactor.link);
+                mtx_unlock(&rkrc->rkrc_lock);
+
+                rd_kafka_broker_thread_init(rkb);
+
+                rd_kafka_reactor_src_set(rkrc, &rkb->rkb_reactor.wakeup,
+                                         rkb->rkb_wakeup_fd[0], POLLIN);
+                rkb->rkb_reactor.ts_wakeup = 0;
+                TAILQ_INSERT_TAIL(&rkrc->rkrc_brokers, rkb, rkb_reactor.link);
+
+                mtx_lock(&rkrc->rkrc_lock);
+        }
+        mtx_unlock(&rkrc->rkrc_lock);
+}
+
+
+/**
+ * @brief Run the broker's state machine once and update its
+ *        socket registration, or decommission the broker if
+ *        it is terminating.
+ *
+ * @returns rd_false if the broker was decommissioned (and must not
+ *          be accessed), else rd_true.
+ *
+ * @locality reactor thread
+ */
+static rd_bool_t rd_kafka_reactor_broker_serve (rd_kafka_reactor_t *rkrc,
+                                                rd_kafka_broker_t *rkb) {
+
+        if (rkb->rkb_reactor.wakeup.revents) {
+                rd_kafka_reactor_drain(rkb->rkb_wakeup_fd[0]);
+                rkb->rkb_reactor.wakeup.revents = 0;
+        }
+
+        if (!rd_kafka_broker_terminating(rkb)) {
+                rkb->rkb_reactor.ts_wakeup = 0;
+                rd_kafka_broker_thread_serve(rkb);
+        }
+
+        if (rd_kafka_broker_terminating(rkb)) {
+                TAILQ_REMOVE(&rkrc->rkrc_brokers, rkb, rkb_reactor.link);
+                rd_kafka_reactor_src_set(rkrc, &rkb->rkb_reactor.wakeup,
+                                         -1, 0);
+                (void)rd_atomic32_sub(&rkrc->rkrc_broker_cnt, 1);
+                rd_kafka_broker_thread_term(rkb);
+                return rd_false;
+        }
+
+        if (rkb->rkb_transport) {
+                rd_kafka_transport_t *rktrans = rkb->rkb_transport;
+                int events = rd_kafka_transport_poll_events(rktrans);
+
+#if WITH_IO_URING
+                if (rkrc->rkrc_uring && !rktrans->rktrans_uring &&
+                    rkb->rkb_proto == RD_KAFKA_PROTO_PLAINTEXT &&
+                    rkb->rkb_state > RD_KAFKA_BROKER_STATE_CONNECT) {
+                        /* Connection is up: hand the socket over
+                         * to io_uring. */
+                        rd_kafka_reactor_src_set(rkrc, &rkb->rkb_reactor.sock,
+                                                 -1, 0);
+                        rktrans->rktrans_uring =
+                                rd_kafka_uring_conn_new(rkrc->rkrc_uring, rkb,
+                                                        rktrans->rktrans_s);
+                }
+
+                if (rktrans->rktrans_uring)
+                        rkb->rkb_reactor.sock.revents |=
+                                rd_kafka_uring_conn_events(
+                                        rktrans->rktrans_uring, events);
+                else
+#endif
+                        rd_kafka_reactor_src_set(rkrc, &rkb->rkb_reactor.sock,
+                                                 rktrans->rktrans_s, events);
+        } else
+                rd_kafka_reactor_src_set(rkrc, &rkb->rkb_reactor.sock, -1, 0);
+
+        /* Ops left on the queue will not trigger another wake-up. */
+        if (rd_kafka_q_len(rkb->rkb_ops) > 0)
+                rkb->rkb_reactor.ts_wakeup = 0;
+
+        return rd_true;
+}
+
+
+/**
+ * @brief Reactor thread main loop.
+ */
+static int rd_kafka_reactor_thread_main (void *arg) {
+        rd_kafka_reactor_t *rkrc = arg;
+        struct epoll_event evs[RD_KAFKA_REACTOR_EVENTS_MAX];
+
+        rd_kafka_set_thread_name("reactor%d", rkrc->rkrc_id);
+        rd_kafka_set_thread_sysname("rdk:reactor%d", rkrc->rkrc_id);
+
+        (void)rd_atomic32_add(&rd_kafka_thread_cnt_curr, 1);
+
+        while (1) {
+                rd_kafka_broker_t *rkb, *rkb_tmp;
+                rd_ts_t now, remains_us;
+                rd_ts_t next_wakeup = RD_TS_MAX;
+                int timeout_ms;
+                int r, i;
+
+                rd_kafka_reactor_adopt(rkrc);
+
+                /* Serve brokers with pending events or whose
+                 * wakeup time has been reached. */
+                now = rd_clock();
+                TAILQ_FOREACH_SAFE(rkb, &rkrc->rkrc_brokers,
+                                   rkb_reactor.link, rkb_tmp) {
+                        rd_bool_t alive = rd_true;
+                        int rounds = 0;
+
+                        /* Serve the broker once more right away if that
+                         * raised new events, e.g., emulated io_uring
+                         * readiness, rather than waiting for the next
+                         * epoll_wait(). */
+                        while (alive && rounds++ < 2 &&
+                               (rkb->rkb_reactor.ts_wakeup <= now ||
+                                rkb->rkb_reactor.sock.revents ||
+                                rkb->rkb_reactor.wakeup.revents))
+                                alive = rd_kafka_reactor_broker_serve(rkrc,
+                                                                      rkb);
+                        if (!alive)
+                                continue;
+
+                        if (rkb->rkb_reactor.ts_wakeup < next_wakeup)
+                                next_wakeup = rkb->rkb_reactor.ts_wakeup;
+                }
+
+                if (TAILQ_EMPTY(&rkrc->rkrc_brokers)) {
+                        rd_bool_t done;
+
+                        mtx_lock(&rkrc->rkrc_lock);
+                        done = rkrc->rkrc_terminate &&
+                                TAILQ_EMPTY(&rkrc->rkrc_new);
+                        mtx_unlock(&rkrc->rkrc_lock);
+
+                        if (done)
+                                break;
+                }
+
+                /* Wait for IO, ops queue wake-ups, or the next wakeup time. */
+                if (next_wakeup == RD_TS_MAX)
+                        timeout_ms = RD_KAFKA_REACTOR_MAX_BLOCK_MS;
+                else if ((remains_us = next_wakeup - rd_clock()) <= 0)
+                        timeout_ms = 0;
+                else if (remains_us >= (rd_ts_t)RD_KAFKA_REACTOR_MAX_BLOCK_MS * 1000)
+                        timeout_ms = RD_KAFKA_REACTOR_MAX_BLOCK_MS;
+                else
+                        /* Round up to avoid busy-looping during
+                         * the last millisecond. */
+                        timeout_ms = (int)((remains_us + 999) / 1000);
+
+#if WITH_IO_URING
+                /* Submit all brokers' receives and sends at once. */
+                if (rkrc->rkrc_uring)
+                        rd_kafka_uring_submit(rkrc->rkrc_uring);
+#endif
+
+                r = epoll_wait(rkrc->rkrc_epfd, evs, RD_ARRAYSIZE(evs),
+                               timeout_ms);
+
+                for (i = 0 ; i < r ; i++) {
+                        rd_kafka_reactor_src_t *src = evs[i].data.ptr;
+
+                        if (!src) {
+                                /* Reactor wake-up */
+                                rd_kafka_reactor_drain(
+                                        rkrc->rkrc_wakeup_fd[0]);
+                                continue;
+                        }
+#if WITH_IO_URING
+                        else if (src == &rkrc->rkrc_uring_src) {
+                                /* Completions are marked as socket
+                                 * events on their brokers. */
+                                rd_kafka_uring_reap(rkrc->rkrc_uring);
+                                continue;
+                        }
+#endif
+
+                        src->revents |=
+                                rd_kafka_reactor_epoll2poll(evs[i].events);
+                }
+        }
+
+#if WITH_SSL
+        /* Remove OpenSSL per-thread error state to avoid memory leaks */
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L && !defined(LIBRESSL_VERSION_NUMBER)
+        /*(OpenSSL libraries handle thread init and deinit)
+         * https://github.com/openssl/openssl/pull/1048 */
+#elif OPENSSL_VERSION_NUMBER >= 0x10000000L
+        ERR_remove_thread_state(NULL);
+#endif
+#endif
+
+        rd_atomic32_sub(&rd_kafka_thread_cnt_curr, 1);
+
+        return 0;
+}
+
+
+static void rd_kafka_reactor_destroy (rd_kafka_reactor_t *rkrc) {
+        rd_assert(TAILQ_EMPTY(&rkrc->rkrc_brokers));
+        rd_assert(TAILQ_EMPTY(&rkrc->rkrc_new));
+
+#if WITH_IO_URING
+        if (rkrc->rkrc_uring)
+                rd_kafka_uring_destroy(rkrc->rkrc_uring);
+#endif
+        rd_close(rkrc->rkrc_epfd);
+        rd_close(rkrc->rkrc_wakeup_fd[0]);
+        rd_close(rkrc->rkrc_wakeup_fd[1]);
+        mtx_destroy(&rkrc->rkrc_lock);
+        rd_free(rkrc);
+}
+
+
+/**
+ * @brief Create a reactor and start its thread.
+ *
+ * @returns the new reactor or NULL on failure (\p errstr set).
+ *
+ * @locality application thread calling rd_kafka_new()
+ */
+static rd_kafka_reactor_t *rd_kafka_reactor_new (rd_kafka_t *rk, int id,
+                                                 char *errstr,
+                                                 size_t errstr_size) {
+        rd_kafka_reactor_t *rkrc;
+        struct epoll_event ev = RD_ZERO_INIT;
+        int r;
+
+        rkrc = rd_calloc(1, sizeof(*rkrc));
+        rkrc->rkrc_rk = rk;
+        rkrc->rkrc_id = id;
+        rkrc->rkrc_epfd = -1;
+        rkrc->rkrc_wakeup_fd[0] = -1;
+        rkrc->rkrc_wakeup_fd[1] = -1;
+        mtx_init(&rkrc->rkrc_lock, mtx_plain);
+        TAILQ_INIT(&rkrc->rkrc_new);
+        TAILQ_INIT(&rkrc->rkrc_brokers);
+        rd_atomic32_init(&rkrc->rkrc_broker_cnt, 0);
+
+        if ((rkrc->rkrc_epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+                rd_snprintf(errstr, errstr_size,
+                            "Failed to create reactor epoll fd: %s",
+                            rd_strerror(errno));
+                goto err;
+        }
+
+        if ((r = rd_pipe_nonblocking(rkrc->rkrc_wakeup_fd))) {
+                rd_snprintf(errstr, errstr_size,
+                            "Failed to create reactor wake-up fds: %s",
+                            rd_strerror(r));
+                goto err;
+        }
+
+        /* NULL event data identifies the reactor's own wake-up fd. */
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        if (epoll_ctl(rkrc->rkrc_epfd, EPOLL_CTL_ADD,
+                      rkrc->rkrc_wakeup_fd[0], &ev) == -1) {
+                rd_snprintf(errstr, errstr_size,
+                            "Failed to add reactor wake-up fd: %s",
+                            rd_strerror(errno));
+                goto err;
+        }
+
+#if WITH_IO_URING
+        if (rk->rk_conf.io_uring_enable) {
+                char uerrstr[256];
+
+                rkrc->rkrc_uring = rd_kafka_uring_new(rk, uerrstr,
+                                                      sizeof(uerrstr));
+                if (rkrc->rkrc_uring) {
+                        ev.events = EPOLLIN;
+                        ev.data.ptr = &rkrc->rkrc_uring_src;
+                        rkrc->rkrc_uring_src.fd =
+                                rd_kafka_uring_fd(rkrc->rkrc_uring);
+                        if (epoll_ctl(rkrc->rkrc_epfd, EPOLL_CTL_ADD,
+                                      rkrc->rkrc_uring_src.fd, &ev) == -1) {
+                                rd_snprintf(uerrstr, sizeof(uerrstr),
+                                            "Failed to add io_uring fd: %s",
+                                            rd_strerror(errno));
+                                rd_kafka_uring_destroy(rkrc->rkrc_uring);
+                                rkrc->rkrc_uring = NULL;
+                        }
+                }
+
+                if (!rkrc->rkrc_uring)
+                        rd_kafka_log(rk, LOG_WARNING, "URING",
+                                     "Reactor %d: %s: "
+                                     "falling back to socket I/O",
+                                     id, uerrstr);
+        }
+#endif
+
+        if (thrd_create(&rkrc->rkrc_thread,
+                        rd_kafka_reactor_thread_main, rkrc) != thrd_success) {
+                rd_snprintf(errstr, errstr_size,
+                            "Failed to create reactor thread: %s",
+                            rd_strerror(errno));
+                goto err;
+        }
+
+        return rkrc;
+
+ err:
+#if WITH_IO_URING
+        if (rkrc->rkrc_uring)
+                rd_kafka_uring_destroy(rkrc->rkrc_uring);
+#endif
+        if (rkrc->rkrc_epfd != -1)
+                rd_close(rkrc->rkrc_epfd);
+        if (rkrc->rkrc_wakeup_fd[0] != -1) {
+                rd_close(rkrc->rkrc_wakeup_fd[0]);
+                rd_close(rkrc->rkrc_wakeup_fd[1]);
+        }
+        mtx_destroy(&rkrc->rkrc_lock);
+        rd_free(rkrc);
+        return NULL;
+}
+
+
+/**
+ * @brief Create \p cnt reactor threads.
+ *
+ * @returns 0 on success or -1 on failure (\p errstr set) in which case
+ *          no reactors are used.
+ *
+ * @locality application thread calling rd_kafka_new()
+ */
+int rd_kafka_reactors_init (rd_kafka_t *rk, int cnt,
+                            char *errstr, size_t errstr_size) {
+        sigset_t newset, oldset;
+        int i;
+
+        rk->rk_reactors = rd_calloc(cnt, sizeof(*rk->rk_reactors));
+
+        /* Block all signals in the reactor threads, see
+         * rd_kafka_broker_add(). */
+        sigemptyset(&oldset);
+        sigfillset(&newset);
+        if (rk->rk_conf.term_sig)
+                sigdelset(&newset, rk->rk_conf.term_sig);
+        pthread_sigmask(SIG_SETMASK, &newset, &oldset);
+
+        for (i = 0 ; i < cnt ; i++) {
+                rd_kafka_reactor_t *rkrc;
+
+                if (!(rkrc = rd_kafka_reactor_new(rk, i,
+                                                  errstr, errstr_size)))
+                        break;
+
+                rk->rk_reactors[rk->rk_reactor_cnt++] = rkrc;
+        }
+
+        pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+        if (rk->rk_reactor_cnt < cnt) {
+                rd_kafka_reactors_term(rk);
+                return -1;
+        }
+
+        rd_kafka_dbg(rk, BROKER, "REACTOR",
+                     "Started %d I/O reactor thread(s)", cnt);
+
+        return 0;
+}
+
+
+/**
+ * @brief Terminate and join the reactor threads.
+ *
+ * All brokers must have been told to terminate, the reactor threads
+ * return when all of their brokers have been decommissioned.
+ *
+ * @locality application thread calling rd_kafka_destroy() or
+ *           rd_kafka_new()
+ */
+void rd_kafka_reactors_term (rd_kafka_t *rk) {
+        int i;
+
+        for (i = 0 ; i < rk->rk_reactor_cnt ; i++) {
+                rd_kafka_reactor_t *rkrc = rk->rk_reactors[i];
+                int res;
+
+                mtx_lock(&rkrc->rkrc_lock);
+                rkrc->rkrc_terminate = rd_true;
+                mtx_unlock(&rkrc->rkrc_lock);
+
+                rd_kafka_reactor_wakeup(rkrc);
+
+                thrd_join(rkrc->rkrc_thread, &res);
+
+                rd_kafka_reactor_destroy(rkrc);
+        }
+
+        if (rk->rk_reactors)
+                rd_free(rk->rk_reactors);
+        rk->rk_reactors = NULL;
+        rk->rk_reactor_cnt = 0;
+}
+
+
+/**
+ * @brief Assign \p rkb to the least loaded reactor, which will start
+ *        serving the broker.
+ *
+ * The broker's rkb_thread is set to the reactor thread.
+ *
+ * @locks rd_kafka_wrlock(rk) and rd_kafka_broker_lock(rkb) MUST be held.
+ * @locality any
+ */
+void rd_kafka_reactor_add (rd_kafka_t *rk, rd_kafka_broker_t *rkb) {
+        rd_kafka_reactor_t *rkrc = NULL;
+        int i;
+
+        for (i = 0 ; i < rk->rk_reactor_cnt ; i++)
+                if (!rkrc ||
+                    rd_atomic32_get(&rk->rk_reactors[i]->rkrc_broker_cnt) <
+                    rd_atomic32_get(&rkrc->rkrc_broker_cnt))
+                        rkrc = rk->rk_reactors[i];
+
+        rd_assert(rkrc);
+
+        rkb->rkb_reactor.rkrc = rkrc;
+        rkb->rkb_reactor.sock.rkb = rkb;
+        rkb->rkb_reactor.sock.fd = -1;
+        rkb->rkb_reactor.wakeup.rkb = rkb;
+        rkb->rkb_reactor.wakeup.fd = -1;
+        rkb->rkb_thread = rkrc->rkrc_thread;
+
+        (void)rd_atomic32_add(&rkrc->rkrc_broker_cnt, 1);
+
+        mtx_lock(&rkrc->rkrc_lock);
+        TAILQ_INSERT_TAIL(&rkrc->rkrc_new, rkb, rkb_reactor.link);
+        mtx_unlock(&rkrc->rkrc_lock);
+
+        rd_kafka_reactor_wakeup(rkrc);
+}
+
+
+#else /* !__linux__ */
+
+int rd_kafka_reactors_init (rd_kafka_t *rk, int cnt,
+                            char *errstr, size_t errstr_size) {
+        rd_snprintf(errstr, errstr_size,
+                    "I/O reactor threads are not supported on this platform");
+        return -1;
+}
+
+void rd_kafka_reactors_term (rd_kafka_t *rk) {
+}
+
+void rd_kafka_reactor_add (rd_kafka_t *rk, rd_kafka_broker_t *rkb) {
+        rd_assert(!*"reactor not supported");
+}
+
+void rd_kafka_reactor_sock_del (rd_kafka_broker_t *rkb) {
+}
+
+#endif /* __linux__ */
+
+
+
+/**
+ * @brief Verify that brokers are served by the reactor threads:
+ *        connection attempts to unreachable brokers fail and are
+ *        retried after the reconnect backoff, brokers added at runtime
+ *        are picked up, and the client terminates cleanly.
+ */
+int unittest_reactor (void) {
+#ifndef __linux__
+        RD_UT_SAY("I/O reactor not supported on this platform: skipping");
+        RD_UT_PASS();
+#else
+        rd_kafka_conf_t *conf;
+        rd_kafka_t *rk;
+        rd_kafka_broker_t *rkb;
+        rd_ts_t abs_timeout;
+        int broker_cnt, served_cnt, retried_cnt;
+        int i;
+
+        conf = rd_kafka_conf_new();
+        rd_kafka_conf_set(conf, "io.reactor.threads", "2", NULL, 0);
+        rd_kafka_conf_set(conf, "enable.sparse.connections", "false",
+                          NULL, 0);
+        rd_kafka_conf_set(conf, "reconnect.backoff.ms", "10", NULL, 0);
+        rd_kafka_conf_set(conf, "reconnect.backoff.max.ms", "10", NULL, 0);
+        rd_kafka_conf_set(conf, "log_level", "0", NULL, 0);
+        rd_kafka_conf_set(conf, "bootstrap.servers",
+                          "127.0.0.1:1,127.0.0.1:2,127.0.0.1:3", NULL, 0);
+        rk = rd_kafka_new(RD_KAFKA_CONSUMER, conf, NULL, 0);
+        RD_UT_ASSERT(rk, "failed to create consumer");
+        RD_UT_ASSERT(rk->rk_reactor_cnt == 2,
+                     "expected 2 reactors, not %d", rk->rk_reactor_cnt);
+
+        /* Picked up by the running reactor */
+        rd_kafka_brokers_add(rk, "127.0.0.1:4");
+
+        abs_timeout = rd_timeout_init(10*1000);
+        do {
+                rd_usleep(10*1000, NULL);
+
+                broker_cnt = served_cnt = retried_cnt = 0;
+                rd_kafka_rdlock(rk);
+                TAILQ_FOREACH(rkb, &rk->rk_brokers, rkb_link) {
+                        broker_cnt++;
+                        if (rkb->rkb_reactor.rkrc)
+                                served_cnt++;
+                        if (rd_atomic32_get(&rkb->rkb_c.connects) >= 2)
+                                retried_cnt++;
+                }
+                rd_kafka_rdunlock(rk);
+        } while (retried_cnt < 4 &&
+                 !rd_timeout_expired(rd_timeout_remains(abs_timeout)));
+
+        RD_UT_ASSERT(broker_cnt == 4, "expected 4 brokers, not %d",
+                     broker_cnt);
+        RD_UT_ASSERT(served_cnt == 4,
+                     "expected all brokers to be served by a reactor, "
+                     "not %d", served_cnt);
+        RD_UT_ASSERT(retried_cnt == 4,
+                     "expected all brokers to reconnect, not %d",
+                     retried_cnt);
+
+        for (i = 0 ; i < rk->rk_reactor_cnt ; i++)
+                RD_UT_ASSERT(rd_atomic32_get(&rk->rk_reactors[i]->
+                                             rkrc_broker_cnt) == 2,
+                             "expected reactor %d to serve 2 brokers, "
+                             "not %d", i,
+                             rd_atomic32_get(&rk->rk_reactors[i]->
+                                             rkrc_broker_cnt));
+
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+#endif
+}
@@ -0,0 +1,89 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2019 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _RDKAFKA_REACTOR_H_
+#define _RDKAFKA_REACTOR_H_
+
+/**
+ * @name Shared broker I/O reactor
+ *
+ * With `io.reactor.threads` > 0 the client's brokers are not given a
+ * thread each but are instead distributed over a small, fixed, pool of
+ * reactor threads. Each reactor thread waits for socket and ops queue
+ * wake-up events of all its brokers in a single epoll set and runs the
+ * (unmodified) broker state machine of the brokers that have pending
+ * events or whose next wakeup time has been reached.
+ *
+ * The broker state machine cooperates by never blocking in
+ * rd_kafka_broker_ops_io_serve() when served by a reactor, instead
+ * the collected events are served and the desired wakeup time is
+ * handed back to the reactor, see rkb_reactor.
+ *
+ * Since all broker code for a given broker still runs on a single
+ * thread (the reactor thread is set as the broker's rkb_thread) the
+ * broker thread locality rules are unaffected.
+ *
+ * With `io.uring.enable` the data transfers of the reactor's plaintext
+ * connections are performed through an io_uring instance per reactor,
+ * see rdkafka_uring.h.
+ *
+ * Only available on Linux, on other platforms (or if the reactor can't
+ * be set up) the client falls back to one thread per broker.
+ *
+ * @{
+ */
+
+typedef struct rd_kafka_reactor_s rd_kafka_reactor_t;
+
+/**
+ * @brief A file descriptor registered with a broker's reactor.
+ *
+ * Embedded in rd_kafka_broker_t, the epoll event data points to this
+ * struct.
+ */
+typedef struct rd_kafka_reactor_src_s {
+        struct rd_kafka_broker_s *rkb;
+        int fd;           /**< Registered fd, or -1 */
+        int events;       /**< Registered POLLIN|POLLOUT interest */
+        int revents;      /**< Events (POLL..) collected by the reactor
+                           *   but not yet served by the broker. */
+} rd_kafka_reactor_src_t;
+
+
+int rd_kafka_reactors_init (rd_kafka_t *rk, int cnt,
+                            char *errstr, size_t errstr_size);
+void rd_kafka_reactors_term (rd_kafka_t *rk);
+
+void rd_kafka_reactor_add (rd_kafka_t *rk, struct rd_kafka_broker_s *rkb);
+void rd_kafka_reactor_sock_del (struct rd_kafka_broker_s *rkb);
+
+int unittest_reactor (void);
+
+/**@}*/
+
+#endif /* _RDKAFKA_REACTOR_H_ */
@@ -1913,15 +1913,15 @@ rd_kafka_handle_idempotent_Produce_error (rd_kafka_broker_t *rkb,
                 perr->actions = RD_KAFKA_ERR_ACTION_PERMANENT;
                 perr->status  = RD_KAFKA_MSG_STATUS_POSSIBLY_PERSISTED;
 
-                rd_rkb_dbg(rkb, MSG|RD_KAFKA_DBG_EOS, "ERRPID",
-                           "%.*s [%"PRId32"] PID mismatch: "
-                           "request %s != partition %s: "
-                           "failing messages with error %s",
-                           RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
-                           rktp->rktp_partition,
-                           rd_kafka_pid2str(batch->pid),
-                           rd_kafka_pid2str(perr->rktp_pid),
-                           rd_kafka_err2str(perr->err));
+                rd_rkb_dbg_rktp(rkb, rktp, MSG|RD_KAFKA_DBG_EOS, "ERRPID",
+                                "%.*s [%"PRId32"] PID mismatch: "
+                                "request %s != partition %s: "
+                                "failing messages with error %s",
+                                RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
+                                rktp->rktp_partition,
+                                rd_kafka_pid2str(batch->pid),
+                                rd_kafka_pid2str(perr->rktp_pid),
+                                rd_kafka_err2str(perr->err));
                 return;
         }
 
@@ -1998,29 +1998,32 @@ rd_kafka_handle_idempotent_Produce_error (rd_kafka_broker_t *rkb,
                          * re-enqueue the messages for later retry
                          * (without incrementing retries).
                          */
-                        rd_rkb_dbg(rkb, MSG|RD_KAFKA_DBG_EOS, "ERRSEQ",
-                                   "ProduceRequest for %.*s [%"PRId32"] "
-                                   "with %d message(s) failed "
-                                   "due to skipped sequence numbers "
-                                   "(%s, base seq %"PRId32" > "
-                                   "next seq %"PRId32") "
-                                   "caused by previous failed request "
-                                   "(%s, actions %s, "
-                                   "base seq %"PRId32"..%"PRId32
-                                   ", base msgid %"PRIu64", %"PRId64"ms ago): "
-                                   "recovering and retrying",
-                                   RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
-                                   rktp->rktp_partition,
-                                   rd_kafka_msgq_len(&batch->msgq),
-                                   rd_kafka_pid2str(batch->pid),
-                                   batch->first_seq,
-                                   perr->next_ack_seq,
-                                   rd_kafka_err2name(last_err.err),
-                                   rd_kafka_actions2str(last_err.actions),
-                                   last_err.base_seq, last_err.last_seq,
-                                   last_err.base_msgid,
-                                   last_err.ts ?
-                                   (now - last_err.ts)/1000 : -1);
+                        rd_rkb_dbg_rktp(rkb, rktp,
+                                        MSG|RD_KAFKA_DBG_EOS, "ERRSEQ",
+                                        "ProduceRequest for %.*s [%"PRId32"] "
+                                        "with %d message(s) failed "
+                                        "due to skipped sequence numbers "
+                                        "(%s, base seq %"PRId32" > "
+                                        "next seq %"PRId32") "
+                                        "caused by previous failed request "
+                                        "(%s, actions %s, "
+                                        "base seq %"PRId32"..%"PRId32
+                                        ", base msgid %"PRIu64", "
+                                        "%"PRId64"ms ago): "
+                                        "recovering and retrying",
+                                        RD_KAFKAP_STR_PR(
+                                                rktp->rktp_rkt->rkt_topic),
+                                        rktp->rktp_partition,
+                                        rd_kafka_msgq_len(&batch->msgq),
+                                        rd_kafka_pid2str(batch->pid),
+                                        batch->first_seq,
+                                        perr->next_ack_seq,
+                                        rd_kafka_err2name(last_err.err),
+                                        rd_kafka_actions2str(last_err.actions),
+                                        last_err.base_seq, last_err.last_seq,
+                                        last_err.base_msgid,
+                                        last_err.ts ?
+                                        (now - last_err.ts)/1000 : -1);
 
                         perr->incr_retry = 0;
                         perr->actions = RD_KAFKA_ERR_ACTION_RETRY;
@@ -2078,18 +2081,18 @@ rd_kafka_handle_idempotent_Produce_error (rd_kafka_broker_t *rkb,
                  * But first make sure the first message has actually
                  * been retried, getting this error for a non-retried message
                  * indicates a synchronization issue or bug. */
-                rd_rkb_dbg(rkb, MSG|RD_KAFKA_DBG_EOS, "DUPSEQ",
-                           "ProduceRequest for %.*s [%"PRId32"] "
-                           "with %d message(s) failed "
-                           "due to duplicate sequence number: "
-                           "previous send succeeded but was not acknowledged "
-                           "(%s, base seq %"PRId32"): "
-                           "marking the messages successfully delivered",
-                           RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
-                           rktp->rktp_partition,
-                           rd_kafka_msgq_len(&batch->msgq),
-                           rd_kafka_pid2str(batch->pid),
-                           batch->first_seq);
+                rd_rkb_dbg_rktp(rkb, rktp, MSG|RD_KAFKA_DBG_EOS, "DUPSEQ",
+                                "ProduceRequest for %.*s [%"PRId32"] "
+                                "with %d message(s) failed "
+                                "due to duplicate sequence number: "
+                                "previous send succeeded but was not "
+                                "acknowledged (%s, base seq %"PRId32"): "
+                                "marking the messages successfully delivered",
+                                RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
+                                rktp->rktp_partition,
+                                rd_kafka_msgq_len(&batch->msgq),
+                                rd_kafka_pid2str(batch->pid),
+                                batch->first_seq);
 
                 /* Void error, delivery succeeded */
                 perr->err = RD_KAFKA_RESP_ERR_NO_ERROR;
@@ -2115,19 +2118,21 @@ rd_kafka_handle_idempotent_Produce_error (rd_kafka_broker_t *rkb,
 
                 if (!firstmsg->rkm_u.producer.retries &&
                     perr->next_err_seq == batch->first_seq) {
-                        rd_rkb_dbg(rkb, MSG|RD_KAFKA_DBG_EOS, "UNKPID",
-                                   "ProduceRequest for %.*s [%"PRId32"] "
-                                   "with %d message(s) failed "
-                                   "due to unknown producer id "
-                                   "(%s, base seq %"PRId32", %d retries): "
-                                   "no risk of duplication/reordering: "
-                                   "resetting PID and retrying",
-                                   RD_KAFKAP_STR_PR(rktp->rktp_rkt->rkt_topic),
-                                   rktp->rktp_partition,
-                                   rd_kafka_msgq_len(&batch->msgq),
-                                   rd_kafka_pid2str(batch->pid),
-                                   batch->first_seq,
-                                   firstmsg->rkm_u.producer.retries);
+                        rd_rkb_dbg_rktp(rkb, rktp,
+                                        MSG|RD_KAFKA_DBG_EOS, "UNKPID",
+                                        "ProduceRequest for %.*s [%"PRId32"] "
+                                        "with %d message(s) failed "
+                                        "due to unknown producer id "
+                                        "(%s, base seq %"PRId32", %d retries): "
+                                        "no risk of duplication/reordering: "
+                                        "resetting PID and retrying",
+                                        RD_KAFKAP_STR_PR(
+                                                rktp->rktp_rkt->rkt_topic),
+                                        rktp->rktp_partition,
+                                        rd_kafka_msgq_len(&batch->msgq),
+                                        rd_kafka_pid2str(batch->pid),
+                                        batch->first_seq,
+                                        firstmsg->rkm_u.producer.retries);
 
                         /* Drain outstanding requests and bump epoch. */
                         rd_kafka_idemp_drain_epoch_bump(rk,
@@ -2274,16 +2279,16 @@ static int rd_kafka_handle_Produce_error (rd_kafka_broker_t *rkb,
 
                 RD_KAFKA_ERR_ACTION_END);
 
-        rd_rkb_dbg(rkb, MSG, "MSGSET",
-                   "%s [%"PRId32"]: MessageSet with %i message(s) "
-                   "(MsgId %"PRIu64", BaseSeq %"PRId32") "
-                   "encountered error: %s (actions %s)%s",
-                   rktp->rktp_rkt->rkt_topic->str, rktp->rktp_partition,
-                   rd_kafka_msgq_len(&batch->msgq),
-                   batch->first_msgid, batch->first_seq,
-                   rd_kafka_err2str(perr->err),
-                   rd_kafka_actions2str(perr->actions),
-                   is_leader ? "" : " [NOT LEADER]");
+        rd_rkb_dbg_rktp(rkb, rktp, MSG, "MSGSET",
+                        "%s [%"PRId32"]: MessageSet with %i message(s) "
+                        "(MsgId %"PRIu64", BaseSeq %"PRId32") "
+                        "encountered error: %s (actions %s)%s",
+                        rktp->rktp_rkt->rkt_topic->str, rktp->rktp_partition,
+                        rd_kafka_msgq_len(&batch->msgq),
+                        batch->first_msgid, batch->first_seq,
+                        rd_kafka_err2str(perr->err),
+                        rd_kafka_actions2str(perr->actions),
+                        is_leader ? "" : " [NOT LEADER]");
 
 
         /*
@@ -2587,13 +2592,14 @@ rd_kafka_msgbatch_handle_Produce_result (
                                      rd_kafka_msgq_len(&batch->msgq));
 
         if (likely(!err)) {
-                rd_rkb_dbg(rkb, MSG, "MSGSET",
-                           "%s [%"PRId32"]: MessageSet with %i message(s) "
-                           "(MsgId %"PRIu64", BaseSeq %"PRId32") delivered",
-                           rktp->rktp_rkt->rkt_topic->str,
-                           rktp->rktp_partition,
-                           rd_kafka_msgq_len(&batch->msgq),
-                           batch->first_msgid, batch->first_seq);
+                rd_rkb_dbg_rktp(rkb, rktp, MSG, "MSGSET",
+                                "%s [%"PRId32"]: MessageSet with %i message(s) "
+                                "(MsgId %"PRIu64", BaseSeq %"PRId32") "
+                                "delivered",
+                                rktp->rktp_rkt->rkt_topic->str,
+                                rktp->rktp_partition,
+                                rd_kafka_msgq_len(&batch->msgq),
+                                batch->first_msgid, batch->first_seq);
 
                 if (rktp->rktp_rkt->rkt_conf.required_acks != 0)
                         status = RD_KAFKA_MSG_STATUS_PERSISTED;
@@ -2638,8 +2644,11 @@ rd_kafka_msgbatch_handle_Produce_result (
                                            presult->timestamp,
                                            status);
 
+                rd_kafka_msgbatch_stage(batch, rkb,
+                                        RD_KAFKA_STATS_PRODUCE_STAGE_RESPONSE);
+
                 /* Enqueue messages for delivery report. */
-                rd_kafka_dr_msgq(rktp->rktp_rkt, &batch->msgq, err);
+                rd_kafka_dr_msgq0(rktp->rktp_rkt, &batch->msgq, err, batch);
         }
 
         if (rd_kafka_is_idempotent(rk) && last_inflight)
@@ -2683,6 +2692,10 @@ static void rd_kafka_handle_Produce (rd_kafka_t *rk,
                         err);
         }
 
+        if (reply)
+                rd_kafka_msgbatch_stage(batch, rkb,
+                                        RD_KAFKA_STATS_PRODUCE_STAGE_BROKER);
+
         /* Parse Produce reply (unless the request errored) */
         if (!err && reply)
                 err = rd_kafka_handle_Produce_parse(rkb, rktp,
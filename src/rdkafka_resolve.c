@@ -0,0 +1,675 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2019 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Process-wide asynchronous broker address resolver, see rdkafka_resolve.h
+ */
+
+#include "rdkafka_int.h"
+#include "rdkafka_resolve.h"
+#include "rdrand.h"
+#include "rdunittest.h"
+
+
+/**< Maximum number of resolver threads, started on demand. */
+#define RD_KAFKA_RESOLVER_THREADS_MAX  4
+
+/**< Entries not used for this long are removed from the cache. */
+#define RD_KAFKA_RESOLVER_IDLE_MS      (5*60*1000)
+
+/**< Maximum time an idle resolver thread waits before re-scanning
+ *   the cache. */
+#define RD_KAFKA_RESOLVER_SCAN_MS      (10*1000)
+
+
+typedef struct rd_kafka_resolve_entry_s {
+        TAILQ_ENTRY(rd_kafka_resolve_entry_s) rre_link;  /**< rr_entries */
+        TAILQ_ENTRY(rd_kafka_resolve_entry_s) rre_qlink; /**< rr_queue */
+        char    *rre_nodename;       /**< "host:port" */
+        int      rre_family;         /**< AF_.. */
+
+        rd_sockaddr_list_t *rre_rsal; /**< Resolved addresses (unshuffled),
+                                       *   or NULL if not yet resolved or
+                                       *   resolving failed. */
+        char     rre_errstr[256];    /**< Resolve error, if rre_rsal is
+                                      *   NULL and rre_ts_resolved > 0 */
+        int      rre_errno;          /**< errno of resolve error */
+
+        rd_ts_t  rre_ts_resolved;    /**< Time of last resolution, 0 if
+                                      *   never resolved. */
+        rd_ts_t  rre_ts_used;        /**< Time of last lookup */
+        int      rre_ttl_ms;         /**< Lowest TTL of lookups since the
+                                      *   last resolution, used for
+                                      *   refresh-ahead. */
+        rd_bool_t rre_pending;       /**< Queued or being resolved */
+
+        rd_list_t rre_waiters;       /**< rd_kafka_q_t * to notify with
+                                      *   RD_KAFKA_OP_RESOLVE when the
+                                      *   next resolution is done.
+                                      *   Holds a queue reference. */
+} rd_kafka_resolve_entry_t;
+
+
+static struct {
+        mtx_t    rr_lock;
+        cnd_t    rr_cnd;           /**< Signalled on new work and on
+                                    *   termination. */
+        TAILQ_HEAD(, rd_kafka_resolve_entry_s) rr_entries; /**< Cache */
+        TAILQ_HEAD(, rd_kafka_resolve_entry_s) rr_queue;   /**< Entries to
+                                                            *   resolve */
+        thrd_t   rr_threads[RD_KAFKA_RESOLVER_THREADS_MAX];
+        int      rr_thread_cnt;
+        int      rr_idle_cnt;      /**< Threads waiting for work */
+        rd_bool_t rr_terminate;
+} rd_kafka_resolver;
+
+
+
+/**
+ * @returns a shuffled copy of \p rsal.
+ */
+static rd_sockaddr_list_t *
+rd_kafka_resolve_rsal_copy (const rd_sockaddr_list_t *rsal) {
+        size_t size = sizeof(*rsal) +
+                (sizeof(*rsal->rsal_addr) * rsal->rsal_cnt);
+        rd_sockaddr_list_t *copy = rd_malloc(size);
+
+        memcpy(copy, rsal, size);
+        copy->rsal_curr = 0;
+
+        /* Each copy is shuffled, rather than the cached list, to keep
+         * round-robin distribution over the addresses across brokers
+         * and clients sharing the entry. */
+        rd_array_shuffle(copy->rsal_addr, copy->rsal_cnt,
+                         sizeof(*copy->rsal_addr));
+
+        return copy;
+}
+
+
+/**
+ * @brief Add \p rkq to the entry's waiters, unless already added.
+ *
+ * @locks rr_lock MUST be held
+ */
+static void rd_kafka_resolve_waiter_add (rd_kafka_resolve_entry_t *rre,
+                                         rd_kafka_q_t *rkq) {
+        if (!rkq || rd_list_find(&rre->rre_waiters, rkq, rd_list_cmp_ptr))
+                return;
+
+        rd_list_add(&rre->rre_waiters, rd_kafka_q_keep(rkq));
+}
+
+
+/**
+ * @brief Queue the entry for resolution.
+ *
+ * @locks rr_lock MUST be held
+ */
+static void rd_kafka_resolve_enq (rd_kafka_resolve_entry_t *rre);
+
+
+static void rd_kafka_resolve_entry_destroy (rd_kafka_resolve_entry_t *rre) {
+        rd_kafka_q_t *rkq;
+        int i;
+
+        RD_LIST_FOREACH(rkq, &rre->rre_waiters, i)
+                rd_kafka_q_destroy(rkq);
+        rd_list_destroy(&rre->rre_waiters);
+
+        if (rre->rre_rsal)
+                rd_sockaddr_list_destroy(rre->rre_rsal);
+        rd_free(rre->rre_nodename);
+        rd_free(rre);
+}
+
+
+/**
+ * @brief Queue entries due for refresh-ahead and remove idle entries.
+ *
+ * An entry is refreshed when 3/4 of its TTL has passed, but only if it
+ * has been looked up since it was last resolved, otherwise it is left
+ * to expire.
+ *
+ * @returns the time until the next scan is needed, in milliseconds.
+ *
+ * @locks rr_lock MUST be held
+ */
+static int rd_kafka_resolver_scan (rd_ts_t now) {
+        rd_kafka_resolve_entry_t *rre, *tmp;
+        rd_ts_t next = now + (RD_KAFKA_RESOLVER_SCAN_MS * 1000);
+
+        TAILQ_FOREACH_SAFE(rre, &rd_kafka_resolver.rr_entries, rre_link,
+                           tmp) {
+                rd_ts_t ts;
+
+                if (rre->rre_pending)
+                        continue;
+
+                if (rre->rre_ts_used > rre->rre_ts_resolved &&
+                    rre->rre_ttl_ms > 0) {
+                        ts = rre->rre_ts_resolved +
+                                ((rd_ts_t)rre->rre_ttl_ms * 1000 * 3 / 4);
+                        if (ts <= now) {
+                                rd_kafka_resolve_enq(rre);
+                                continue;
+                        }
+                        next = RD_MIN(next, ts);
+                }
+
+                ts = RD_MAX(rre->rre_ts_used, rre->rre_ts_resolved) +
+                        ((rd_ts_t)RD_KAFKA_RESOLVER_IDLE_MS * 1000);
+                if (ts <= now) {
+                        TAILQ_REMOVE(&rd_kafka_resolver.rr_entries, rre,
+                                     rre_link);
+                        rd_kafka_resolve_entry_destroy(rre);
+                        continue;
+                }
+                next = RD_MIN(next, ts);
+        }
+
+        return (int)((next - now + 999) / 1000);
+}
+
+
+/**
+ * @brief Resolver thread: resolves queued entries and notifies their
+ *        waiters.
+ */
+static int rd_kafka_resolver_thread_main (void *arg) {
+        int id = (int)(intptr_t)arg;
+
+        rd_kafka_set_thread_name("resolver%d", id);
+        rd_kafka_set_thread_sysname("rdk:resolver%d", id);
+
+        (void)rd_atomic32_add(&rd_kafka_thread_cnt_curr, 1);
+
+        mtx_lock(&rd_kafka_resolver.rr_lock);
+        while (!rd_kafka_resolver.rr_terminate) {
+                rd_kafka_resolve_entry_t *rre;
+                rd_sockaddr_list_t *rsal;
+                rd_kafka_q_t *rkq;
+                const char *errstr;
+                char *nodename;
+                rd_ts_t ts_start, latency;
+                int family, i, err;
+
+                if (!(rre = TAILQ_FIRST(&rd_kafka_resolver.rr_queue))) {
+                        int timeout_ms = rd_kafka_resolver_scan(rd_clock());
+
+                        if (TAILQ_FIRST(&rd_kafka_resolver.rr_queue))
+                                continue;
+
+                        rd_kafka_resolver.rr_idle_cnt++;
+                        cnd_timedwait_ms(&rd_kafka_resolver.rr_cnd,
+                                         &rd_kafka_resolver.rr_lock,
+                                         timeout_ms);
+                        rd_kafka_resolver.rr_idle_cnt--;
+                        continue;
+                }
+
+                TAILQ_REMOVE(&rd_kafka_resolver.rr_queue, rre, rre_qlink);
+                nodename = rd_strdup(rre->rre_nodename);
+                family = rre->rre_family;
+                mtx_unlock(&rd_kafka_resolver.rr_lock);
+
+                /* The entry is not removed while rre_pending is set. */
+                ts_start = rd_clock();
+                rsal = rd_getaddrinfo(nodename, RD_KAFKA_PORT_STR,
+                                      AI_ADDRCONFIG|RD_AI_NOSHUFFLE,
+                                      family, SOCK_STREAM, IPPROTO_TCP,
+                                      &errstr);
+                err = errno;
+                latency = rd_clock() - ts_start;
+                rd_free(nodename);
+
+                mtx_lock(&rd_kafka_resolver.rr_lock);
+
+                if (!rsal && rre->rre_rsal &&
+                    rre->rre_ts_resolved +
+                    ((rd_ts_t)rre->rre_ttl_ms * 1000) > rd_clock()) {
+                        /* Refresh-ahead failed: keep serving the previous
+                         * addresses until they expire, and don't refresh
+                         * again unless the entry is used. */
+                        rre->rre_ts_used = rre->rre_ts_resolved;
+
+                } else {
+                        if (rre->rre_rsal)
+                                rd_sockaddr_list_destroy(rre->rre_rsal);
+                        rre->rre_rsal = rsal;
+                        if (!rsal) {
+                                rd_snprintf(rre->rre_errstr,
+                                            sizeof(rre->rre_errstr),
+                                            "%s", errstr);
+                                rre->rre_errno = err;
+                        }
+                        rre->rre_ts_resolved = rd_clock();
+                        rre->rre_ttl_ms = INT_MAX;
+                }
+                rre->rre_pending = rd_false;
+
+                /* Waiters are notified with the lock held so that
+                 * rd_kafka_resolve_waiters_remove() guarantees that
+                 * no op is enqueued on a removed queue once it returns. */
+                RD_LIST_FOREACH(rkq, &rre->rre_waiters, i) {
+                        rd_kafka_op_t *rko =
+                                rd_kafka_op_new(RD_KAFKA_OP_RESOLVE);
+                        rko->rko_u.resolve.latency = latency;
+                        if (!rsal)
+                                rko->rko_err = RD_KAFKA_RESP_ERR__RESOLVE;
+                        rd_kafka_q_enq(rkq, rko);
+                        rd_kafka_q_destroy(rkq);
+                }
+                rd_list_clear(&rre->rre_waiters);
+        }
+        mtx_unlock(&rd_kafka_resolver.rr_lock);
+
+        rd_atomic32_sub(&rd_kafka_thread_cnt_curr, 1);
+
+        return 0;
+}
+
+
+static void rd_kafka_resolve_enq (rd_kafka_resolve_entry_t *rre) {
+        rre->rre_pending = rd_true;
+        TAILQ_INSERT_TAIL(&rd_kafka_resolver.rr_queue, rre, rre_qlink);
+
+        if (rd_kafka_resolver.rr_idle_cnt > 0 ||
+            rd_kafka_resolver.rr_thread_cnt ==
+            RD_KAFKA_RESOLVER_THREADS_MAX) {
+                cnd_signal(&rd_kafka_resolver.rr_cnd);
+                return;
+        }
+
+        if (thrd_create(&rd_kafka_resolver.rr_threads[rd_kafka_resolver.
+                                                      rr_thread_cnt],
+                        rd_kafka_resolver_thread_main,
+                        (void *)(intptr_t)rd_kafka_resolver.rr_thread_cnt)
+            != thrd_success) {
+                /* Served by the existing threads, if any */
+                cnd_signal(&rd_kafka_resolver.rr_cnd);
+                return;
+        }
+
+        rd_kafka_resolver.rr_thread_cnt++;
+}
+
+
+/**
+ * @brief Look up the addresses of \p nodename ("host:port") in the
+ *        resolver cache.
+ *
+ * Cached results, positive or negative, are served if they are younger
+ * than \p ttl_ms, or if they were resolved at or after \p ts_min, which
+ * the caller sets to the time of its first lookup attempt so that it
+ * is served the result of the resolution it waited for even with a zero
+ * TTL.
+ *
+ * If the lookup can't be served from the cache \p rkq is sent an
+ * RD_KAFKA_OP_RESOLVE op, with the resolve latency, when the pending
+ * resolution is done. The queue owner must call
+ * rd_kafka_resolve_waiters_remove() before destroying the queue.
+ *
+ * @returns RD_KAFKA_RESOLVE_OK with a shuffled address list in \p rsalp
+ *          which must be freed with rd_sockaddr_list_destroy(),
+ *          RD_KAFKA_RESOLVE_ERR with the resolve error in \p errstr
+ *          and errno, or RD_KAFKA_RESOLVE_PENDING if the caller
+ *          must wait for \p rkq to be sent RD_KAFKA_OP_RESOLVE.
+ *
+ * @locality any
+ */
+rd_kafka_resolve_res_t
+rd_kafka_resolve_lookup (const char *nodename, int family, int ttl_ms,
+                         rd_ts_t ts_min, rd_kafka_q_t *rkq,
+                         rd_sockaddr_list_t **rsalp,
+                         char *errstr, size_t errstr_size) {
+        rd_kafka_resolve_entry_t *rre;
+        rd_kafka_resolve_res_t res;
+        rd_ts_t now = rd_clock();
+        rd_bool_t rescan;
+
+        mtx_lock(&rd_kafka_resolver.rr_lock);
+
+        TAILQ_FOREACH(rre, &rd_kafka_resolver.rr_entries, rre_link)
+                if (rre->rre_family == family &&
+                    !strcmp(rre->rre_nodename, nodename))
+                        break;
+
+        if (!rre) {
+                rre = rd_calloc(1, sizeof(*rre));
+                rre->rre_nodename = rd_strdup(nodename);
+                rre->rre_family = family;
+                rre->rre_ttl_ms = INT_MAX;
+                rd_list_init(&rre->rre_waiters, 0, NULL);
+                TAILQ_INSERT_TAIL(&rd_kafka_resolver.rr_entries, rre,
+                                  rre_link);
+        }
+
+        rescan = ttl_ms < rre->rre_ttl_ms;
+        rre->rre_ttl_ms = RD_MIN(rre->rre_ttl_ms, ttl_ms);
+
+        if (rre->rre_ts_resolved &&
+            (rre->rre_ts_resolved + ((rd_ts_t)ttl_ms * 1000) > now ||
+             rre->rre_ts_resolved >= ts_min)) {
+                /* Serve from cache */
+
+                /* First use since the last resolution, or a lower TTL:
+                 * the resolver threads need to reschedule the
+                 * refresh-ahead. */
+                if (rescan || rre->rre_ts_used <= rre->rre_ts_resolved)
+                        cnd_signal(&rd_kafka_resolver.rr_cnd);
+
+                if (rre->rre_rsal) {
+                        *rsalp = rd_kafka_resolve_rsal_copy(rre->rre_rsal);
+                        res = RD_KAFKA_RESOLVE_OK;
+                } else {
+                        rd_snprintf(errstr, errstr_size, "%s",
+                                    rre->rre_errstr);
+                        errno = rre->rre_errno;
+                        res = RD_KAFKA_RESOLVE_ERR;
+                }
+
+        } else {
+                rd_kafka_resolve_waiter_add(rre, rkq);
+                if (!rre->rre_pending)
+                        rd_kafka_resolve_enq(rre);
+                res = RD_KAFKA_RESOLVE_PENDING;
+        }
+
+        rre->rre_ts_used = now;
+
+        mtx_unlock(&rd_kafka_resolver.rr_lock);
+
+        return res;
+}
+
+
+/**
+ * @brief Remove \p rkq from the waiters of all entries, releasing their
+ *        queue references.
+ *
+ * After this call \p rkq will not be sent any more RD_KAFKA_OP_RESOLVE ops.
+ *
+ * @locality any
+ */
+void rd_kafka_resolve_waiters_remove (rd_kafka_q_t *rkq) {
+        rd_kafka_resolve_entry_t *rre;
+
+        mtx_lock(&rd_kafka_resolver.rr_lock);
+        TAILQ_FOREACH(rre, &rd_kafka_resolver.rr_entries, rre_link) {
+                if (rd_list_remove(&rre->rre_waiters, rkq))
+                        rd_kafka_q_destroy(rkq);
+        }
+        mtx_unlock(&rd_kafka_resolver.rr_lock);
+}
+
+
+/**
+ * @brief Global resolver initialization, called once.
+ */
+void rd_kafka_resolver_init (void) {
+        mtx_init(&rd_kafka_resolver.rr_lock, mtx_plain);
+        cnd_init(&rd_kafka_resolver.rr_cnd);
+        TAILQ_INIT(&rd_kafka_resolver.rr_entries);
+        TAILQ_INIT(&rd_kafka_resolver.rr_queue);
+}
+
+
+/**
+ * @brief Stop the resolver threads and clear the cache.
+ *        Called when the last rd_kafka_t instance is destroyed,
+ *        waits for any resolution in progress.
+ */
+void rd_kafka_resolver_term (void) {
+        rd_kafka_resolve_entry_t *rre;
+        int i;
+
+        mtx_lock(&rd_kafka_resolver.rr_lock);
+        rd_kafka_resolver.rr_terminate = rd_true;
+        cnd_broadcast(&rd_kafka_resolver.rr_cnd);
+        mtx_unlock(&rd_kafka_resolver.rr_lock);
+
+        for (i = 0 ; i < rd_kafka_resolver.rr_thread_cnt ; i++)
+                thrd_join(rd_kafka_resolver.rr_threads[i], NULL);
+
+        mtx_lock(&rd_kafka_resolver.rr_lock);
+        rd_kafka_resolver.rr_thread_cnt = 0;
+        rd_kafka_resolver.rr_terminate = rd_false;
+        TAILQ_INIT(&rd_kafka_resolver.rr_queue);
+        while ((rre = TAILQ_FIRST(&rd_kafka_resolver.rr_entries))) {
+                TAILQ_REMOVE(&rd_kafka_resolver.rr_entries, rre, rre_link);
+                rd_kafka_resolve_entry_destroy(rre);
+        }
+        mtx_unlock(&rd_kafka_resolver.rr_lock);
+}
+
+
+/**
+ * @name Unit tests
+ * @{
+ */
+
+/**
+ * @brief Wait for an RD_KAFKA_OP_RESOLVE op on \p rkq.
+ *
+ * @returns the op's error, or RD_KAFKA_RESP_ERR__TIMED_OUT.
+ */
+static rd_kafka_resp_err_t ut_resolve_wait (rd_kafka_q_t *rkq,
+                                            int timeout_ms) {
+        rd_kafka_op_t *rko;
+        rd_kafka_resp_err_t err;
+
+        if (!(rko = rd_kafka_q_pop(rkq, timeout_ms, 0)))
+                return RD_KAFKA_RESP_ERR__TIMED_OUT;
+
+        rd_assert(rko->rko_type == RD_KAFKA_OP_RESOLVE);
+        err = rko->rko_err;
+        rd_kafka_op_destroy(rko);
+
+        return err;
+}
+
+
+/**
+ * @returns the time \p nodename was last resolved, or 0.
+ */
+static rd_ts_t ut_resolve_ts_resolved (const char *nodename, int family) {
+        rd_kafka_resolve_entry_t *rre;
+        rd_ts_t ts = 0;
+
+        mtx_lock(&rd_kafka_resolver.rr_lock);
+        TAILQ_FOREACH(rre, &rd_kafka_resolver.rr_entries, rre_link)
+                if (rre->rre_family == family &&
+                    !strcmp(rre->rre_nodename, nodename))
+                        ts = rre->rre_ts_resolved;
+        mtx_unlock(&rd_kafka_resolver.rr_lock);
+
+        return ts;
+}
+
+
+/**
+ * @returns the number of entries \p rkq is a waiter of.
+ */
+static int ut_resolve_waiter_cnt (rd_kafka_q_t *rkq) {
+        rd_kafka_resolve_entry_t *rre;
+        int cnt = 0;
+
+        mtx_lock(&rd_kafka_resolver.rr_lock);
+        TAILQ_FOREACH(rre, &rd_kafka_resolver.rr_entries, rre_link)
+                if (rd_list_find(&rre->rre_waiters, rkq, rd_list_cmp_ptr))
+                        cnt++;
+        mtx_unlock(&rd_kafka_resolver.rr_lock);
+
+        return cnt;
+}
+
+
+int unittest_resolve (void) {
+        rd_kafka_t *rk;
+        rd_kafka_q_t *rkq, *rkq2;
+        rd_kafka_resolve_entry_t *rre;
+        rd_sockaddr_list_t *rsal = NULL;
+        rd_kafka_resolve_res_t res;
+        char errstr[256];
+        const char *name = "127.0.0.1:19091";
+        rd_ts_t ts, ts_resolved;
+        int i;
+
+        /* Makes sure the resolver is initialized and not terminated
+         * during the test. */
+        rk = rd_kafka_new(RD_KAFKA_PRODUCER, NULL, errstr, sizeof(errstr));
+        RD_UT_ASSERT(rk, "Failed to create producer: %s", errstr);
+        rkq = rd_kafka_q_new(rk);
+
+        /* First lookup is resolved in the background */
+        ts = rd_clock();
+        res = rd_kafka_resolve_lookup(name, AF_INET, 60000, ts, rkq,
+                                      &rsal, errstr, sizeof(errstr));
+        RD_UT_ASSERT(res == RD_KAFKA_RESOLVE_PENDING,
+                     "expected PENDING, not %d", res);
+        RD_UT_ASSERT(!ut_resolve_wait(rkq, 5000), "resolve failed");
+
+        /* .. after which it is served from the cache */
+        for (i = 0 ; i < 2 ; i++) {
+                res = rd_kafka_resolve_lookup(name, AF_INET, 60000, ts, rkq,
+                                              &rsal, errstr, sizeof(errstr));
+                RD_UT_ASSERT(res == RD_KAFKA_RESOLVE_OK,
+                             "#%d: expected OK, not %d: %s", i, res, errstr);
+                RD_UT_ASSERT(rsal->rsal_cnt == 1 &&
+                             rsal->rsal_addr[0].sinx_family == AF_INET,
+                             "#%d: unexpected address list", i);
+                rd_sockaddr_list_destroy(rsal);
+        }
+        RD_UT_ASSERT(ut_resolve_wait(rkq, 0) == RD_KAFKA_RESP_ERR__TIMED_OUT,
+                     "unexpected resolve op for cached lookup");
+        RD_UT_ASSERT(ut_resolve_waiter_cnt(rkq) == 0,
+                     "cached lookups must not register a waiter");
+
+        /* With a zero TTL the lookup waits for a new resolution, but is
+         * served the result it waited for. */
+        ts = rd_clock();
+        res = rd_kafka_resolve_lookup(name, AF_INET, 0, ts, rkq,
+                                      &rsal, errstr, sizeof(errstr));
+        RD_UT_ASSERT(res == RD_KAFKA_RESOLVE_PENDING,
+                     "ttl 0: expected PENDING, not %d", res);
+        RD_UT_ASSERT(!ut_resolve_wait(rkq, 5000), "resolve failed");
+        rd_usleep(1000, 0);
+        res = rd_kafka_resolve_lookup(name, AF_INET, 0, ts, rkq,
+                                      &rsal, errstr, sizeof(errstr));
+        RD_UT_ASSERT(res == RD_KAFKA_RESOLVE_OK,
+                     "ttl 0: expected OK, not %d: %s", res, errstr);
+        rd_sockaddr_list_destroy(rsal);
+
+        /* Entries in use are refreshed ahead of TTL expiry, while lookups
+         * are still served from the cache.
+         * A separate entry is used since the TTL of an entry is the lowest
+         * TTL it was looked up with since it was last resolved. */
+        name = "127.0.0.1:19092";
+        ts = rd_clock();
+        res = rd_kafka_resolve_lookup(name, AF_INET, 200, ts, rkq,
+                                      &rsal, errstr, sizeof(errstr));
+        RD_UT_ASSERT(res == RD_KAFKA_RESOLVE_PENDING,
+                     "refresh: expected PENDING, not %d", res);
+        RD_UT_ASSERT(!ut_resolve_wait(rkq, 5000), "resolve failed");
+        res = rd_kafka_resolve_lookup(name, AF_INET, 200, ts, rkq,
+                                      &rsal, errstr, sizeof(errstr));
+        RD_UT_ASSERT(res == RD_KAFKA_RESOLVE_OK,
+                     "refresh: expected OK, not %d: %s", res, errstr);
+        rd_sockaddr_list_destroy(rsal);
+        ts_resolved = ut_resolve_ts_resolved(name, AF_INET);
+        for (i = 0 ; i < 100 &&
+                     ut_resolve_ts_resolved(name, AF_INET) == ts_resolved ;
+             i++)
+                rd_usleep(10*1000, 0);
+        RD_UT_ASSERT(ut_resolve_ts_resolved(name, AF_INET) > ts_resolved,
+                     "expected refresh-ahead within TTL");
+        RD_UT_ASSERT(ut_resolve_wait(rkq, 0) == RD_KAFKA_RESP_ERR__TIMED_OUT,
+                     "unexpected resolve op for refresh-ahead");
+        res = rd_kafka_resolve_lookup(name, AF_INET, 200, ts, rkq,
+                                      &rsal, errstr, sizeof(errstr));
+        RD_UT_ASSERT(res == RD_KAFKA_RESOLVE_OK,
+                     "refresh: expected OK, not %d: %s", res, errstr);
+        rd_sockaddr_list_destroy(rsal);
+
+        /* Resolve failures are cached */
+        name = "[::1:19091";
+        ts = rd_clock();
+        res = rd_kafka_resolve_lookup(name, AF_UNSPEC, 60000, ts, rkq,
+                                      &rsal, errstr, sizeof(errstr));
+        RD_UT_ASSERT(res == RD_KAFKA_RESOLVE_PENDING,
+                     "negative: expected PENDING, not %d", res);
+        RD_UT_ASSERT(ut_resolve_wait(rkq, 5000) ==
+                     RD_KAFKA_RESP_ERR__RESOLVE,
+                     "expected resolve failure");
+        for (i = 0 ; i < 2 ; i++) {
+                *errstr = '\0';
+                res = rd_kafka_resolve_lookup(name, AF_UNSPEC, 60000, ts,
+                                              rkq, &rsal,
+                                              errstr, sizeof(errstr));
+                RD_UT_ASSERT(res == RD_KAFKA_RESOLVE_ERR && *errstr,
+                             "#%d: expected cached error, not %d", i, res);
+        }
+        RD_UT_SAY("Cached resolve error: %s", errstr);
+        RD_UT_ASSERT(ut_resolve_wait(rkq, 0) == RD_KAFKA_RESP_ERR__TIMED_OUT,
+                     "unexpected resolve op for cached failure");
+
+        /* A removed waiter is not notified of the next resolution:
+         * rkq is added as a waiter of the cached entry, removed, and
+         * the entry is then resolved again by a lookup on rkq2. */
+        name = "127.0.0.1:19091";
+        rkq2 = rd_kafka_q_new(rk);
+        mtx_lock(&rd_kafka_resolver.rr_lock);
+        TAILQ_FOREACH(rre, &rd_kafka_resolver.rr_entries, rre_link)
+                if (rre->rre_family == AF_INET &&
+                    !strcmp(rre->rre_nodename, name))
+                        rd_kafka_resolve_waiter_add(rre, rkq);
+        mtx_unlock(&rd_kafka_resolver.rr_lock);
+        RD_UT_ASSERT(ut_resolve_waiter_cnt(rkq) == 1,
+                     "expected one waiter");
+        rd_kafka_resolve_waiters_remove(rkq);
+        RD_UT_ASSERT(ut_resolve_waiter_cnt(rkq) == 0,
+                     "expected no waiters after removal");
+
+        rd_usleep(1000, 0);
+        res = rd_kafka_resolve_lookup(name, AF_INET, 0, rd_clock(), rkq2,
+                                      &rsal, errstr, sizeof(errstr));
+        RD_UT_ASSERT(res == RD_KAFKA_RESOLVE_PENDING,
+                     "remove: expected PENDING, not %d", res);
+        RD_UT_ASSERT(!ut_resolve_wait(rkq2, 5000), "resolve failed");
+        RD_UT_ASSERT(ut_resolve_wait(rkq, 0) == RD_KAFKA_RESP_ERR__TIMED_OUT,
+                     "unexpected resolve op for removed waiter");
+        rd_kafka_q_destroy_owner(rkq2);
+
+        rd_kafka_q_destroy_owner(rkq);
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+/**@}*/
@@ -0,0 +1,77 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2019 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _RDKAFKA_RESOLVE_H_
+#define _RDKAFKA_RESOLVE_H_
+
+#include "rdaddr.h"
+
+/**
+ * @name Process-wide asynchronous broker address resolver
+ *
+ * Broker address lookups are served from a cache shared by all brokers
+ * of all rd_kafka_t instances in the process, keyed by the broker's
+ * "host:port" nodename and `broker.address.family`.
+ *
+ * Names are resolved by a small pool of background resolver threads so
+ * that a slow resolver never blocks a broker thread: a lookup that can't
+ * be served from the cache returns RD_KAFKA_RESOLVE_PENDING and the
+ * caller's queue is sent an RD_KAFKA_OP_RESOLVE op when the resolution
+ * is done, after which the lookup is retried.
+ *
+ * Failed resolutions are cached as well (negative caching), and entries
+ * that have been used since they were last resolved are refreshed in the
+ * background before their TTL expires (refresh-ahead), so that lookups
+ * on the connect path are served from the cache.
+ *
+ * @{
+ */
+
+typedef enum {
+        RD_KAFKA_RESOLVE_OK,      /**< Addresses returned */
+        RD_KAFKA_RESOLVE_ERR,     /**< Resolving failed, errstr is set */
+        RD_KAFKA_RESOLVE_PENDING, /**< Resolving in progress, retry when
+                                   *   RD_KAFKA_OP_RESOLVE is received. */
+} rd_kafka_resolve_res_t;
+
+rd_kafka_resolve_res_t
+rd_kafka_resolve_lookup (const char *nodename, int family, int ttl_ms,
+                         rd_ts_t ts_min, rd_kafka_q_t *rkq,
+                         rd_sockaddr_list_t **rsalp,
+                         char *errstr, size_t errstr_size);
+
+void rd_kafka_resolve_waiters_remove (rd_kafka_q_t *rkq);
+
+void rd_kafka_resolver_init (void);
+void rd_kafka_resolver_term (void);
+
+int unittest_resolve (void);
+
+/**@}*/
+
+#endif /* _RDKAFKA_RESOLVE_H_ */
@@ -0,0 +1,3078 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2019 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Statistics snapshots and the JSON statistics renderer,
+ * see rdkafka_stats.h
+ */
+
+#include "rdkafka_int.h"
+#include "rdkafka_stats.h"
+#include "rdkafka_broker.h"
+#include "rdkafka_topic.h"
+#include "rdkafka_partition.h"
+#include "rdkafka_cgrp.h"
+#include "rdkafka_request.h"
+#include "rdkafka_pattern.h"
+#include "rdkafka_logring.h"
+#include "rdcrc32.h"
+#include "rdunittest.h"
+
+
+/**< Allocation size of snapshot arena chunks. */
+#define RD_KAFKA_STATS_CHUNK_SIZE  (16*1024)
+
+/**
+ * @brief Snapshot arena chunk, the chunk's memory follows the header.
+ */
+struct rd_kafka_stats_chunk {
+        struct rd_kafka_stats_chunk *next;
+        size_t size;    /**< Usable size */
+        size_t of;      /**< Current allocation offset */
+};
+
+#define RD_KAFKA_STATS_CHUNK_HDRSIZE                                    \
+        RD_ROUNDUP(sizeof(struct rd_kafka_stats_chunk), 16)
+
+/**
+ * @brief Snapshot: the public stats struct followed by the storage for
+ *        its optional members.
+ *        Everything else (arrays, strings) is allocated from the
+ *        snapshot's arena and freed with the snapshot.
+ */
+typedef struct rd_kafka_stats_s {
+        rd_kafka_stats_t stats;           /* Must be first */
+        rd_kafka_stats_cgrp_t cgrp;       /* stats.cgrp storage */
+        rd_kafka_stats_eos_t eos;         /* stats.eos storage */
+        struct rd_kafka_stats_chunk *chunks; /* Arena chunks, current
+                                              * chunk first. */
+        int fields;                       /* rd_kafka_stats_fields_t */
+        rd_bool_t delta;                  /* Unchanged objects omitted */
+        rd_bool_t rollover;               /* Reset windows and high
+                                           * watermarks */
+} rd_kafka_stats_s_t;
+
+
+/**
+ * @brief Allocate \p size bytes from the snapshot arena.
+ *
+ * @returns zeroed, 8-byte aligned, memory.
+ */
+static void *rd_kafka_stats_alloc (rd_kafka_stats_s_t *sts, size_t size) {
+        struct rd_kafka_stats_chunk *chunk = sts->chunks;
+        void *p;
+
+        size = RD_ROUNDUP(size, 8);
+
+        if (!chunk || chunk->size - chunk->of < size) {
+                size_t csize = RD_MAX(size, RD_KAFKA_STATS_CHUNK_SIZE);
+
+                chunk = rd_malloc(RD_KAFKA_STATS_CHUNK_HDRSIZE + csize);
+                chunk->size = csize;
+                chunk->of   = 0;
+                chunk->next = sts->chunks;
+                sts->chunks = chunk;
+        }
+
+        p = (char *)chunk + RD_KAFKA_STATS_CHUNK_HDRSIZE + chunk->of;
+        chunk->of += size;
+
+        memset(p, 0, size);
+        return p;
+}
+
+/**
+ * @brief Copy string of \p len bytes to the snapshot arena.
+ */
+static const char *rd_kafka_stats_strndup (rd_kafka_stats_s_t *sts,
+                                           const char *str, size_t len) {
+        char *dst = rd_kafka_stats_alloc(sts, len + 1);
+
+        memcpy(dst, str, len);
+        dst[len] = '\0';
+        return dst;
+}
+
+#define rd_kafka_stats_strdup(sts,str)                          \
+        rd_kafka_stats_strndup(sts, str, strlen(str))
+
+#define rd_kafka_stats_kstrdup(sts,kstr)                                \
+        rd_kafka_stats_strndup(sts, (kstr)->str, RD_KAFKAP_STR_LEN(kstr))
+
+
+/**
+ * @brief Copy the window of \p src_avg to \p w, rolling \p src_avg
+ *        over if this is a rollover snapshot.
+ */
+static void rd_kafka_stats_window (rd_kafka_stats_s_t *sts,
+                                   rd_kafka_stats_window_t *w,
+                                   rd_avg_t *src_avg) {
+        rd_avg_t avg;
+
+        if (sts->rollover)
+                rd_avg_rollover(&avg, src_avg);
+        else
+                rd_avg_peek(&avg, src_avg);
+
+        w->min        = avg.ra_v.minv;
+        w->max        = avg.ra_v.maxv;
+        w->avg        = avg.ra_v.avg;
+        w->sum        = avg.ra_v.sum;
+        w->cnt        = avg.ra_v.cnt;
+        w->stddev     = (int64_t)avg.ra_hist.stddev;
+        w->p50        = avg.ra_hist.p50;
+        w->p75        = avg.ra_hist.p75;
+        w->p90        = avg.ra_hist.p90;
+        w->p95        = avg.ra_hist.p95;
+        w->p99        = avg.ra_hist.p99;
+        w->p99_99     = avg.ra_hist.p99_99;
+        w->outofrange = avg.ra_hist.oor;
+        w->hdrsize    = avg.ra_hist.hdrsize;
+        memcpy(w->buckets, avg.ra_hist.buckets, sizeof(w->buckets));
+
+        rd_avg_destroy(&avg);
+}
+
+
+/**
+ * @brief Snapshot partition stats to the zeroed \p p.
+ *
+ * @param totals are updated with the partition's message counters,
+ *               unless NULL.
+ *
+ * @returns rd_false if this is a delta snapshot and the partition's
+ *          stats have not changed since the previous delta snapshot,
+ *          else rd_true.
+ *
+ * @locks rd_kafka_toppar_lock() MUST NOT be held.
+ */
+static rd_bool_t rd_kafka_stats_toppar (rd_kafka_stats_partition_t *p,
+                                        rd_kafka_stats_t *totals,
+                                        rd_kafka_toppar_t *rktp,
+                                        rd_kafka_stats_s_t *sts) {
+        rd_kafka_t *rk = rktp->rktp_rkt->rkt_rk;
+        struct offset_stats offs;
+        rd_bool_t changed = rd_true;
+
+        rd_kafka_toppar_lock(rktp);
+
+        p->partition = rktp->rktp_partition;
+        p->leader = -1;
+
+        if (rktp->rktp_leader &&
+            RD_KAFKA_BROKER_IS_LOGICAL(rktp->rktp_leader)) {
+                /* Served by one of the leader's data connections */
+                p->leader = rktp->rktp_leader_id;
+        } else if (rktp->rktp_leader) {
+                rd_kafka_broker_lock(rktp->rktp_leader);
+                p->leader = rktp->rktp_leader->rkb_nodeid;
+                rd_kafka_broker_unlock(rktp->rktp_leader);
+        }
+
+        /* Grab a copy of the latest finalized offset stats */
+        offs = rktp->rktp_offsets_fin;
+
+        p->desired = !!(rktp->rktp_flags & RD_KAFKA_TOPPAR_F_DESIRED);
+        p->unknown = !!(rktp->rktp_flags & RD_KAFKA_TOPPAR_F_UNKNOWN);
+        p->msgq_cnt = rd_kafka_msgq_len(&rktp->rktp_msgq);
+        p->msgq_bytes = rd_kafka_msgq_size(&rktp->rktp_msgq);
+        p->fetchq_cnt = rd_kafka_q_len(rktp->rktp_fetchq);
+        p->fetchq_size = rd_kafka_q_size(rktp->rktp_fetchq);
+        p->fetch_state = rd_kafka_fetch_states[rktp->rktp_fetch_state];
+        p->fetch_max_bytes = rktp->rktp_prefetch.req_max_bytes;
+        p->consume_rate = rktp->rktp_prefetch.rate;
+        p->query_offset = rktp->rktp_query_offset;
+        p->next_offset = offs.fetch_offset;
+        p->app_offset = rktp->rktp_app_offset;
+        p->stored_offset = rktp->rktp_stored_offset;
+        p->committed_offset = rktp->rktp_committed_offset;
+        p->eof_offset = offs.eof_offset;
+        p->lo_offset = rktp->rktp_lo_offset;
+        p->hi_offset = rktp->rktp_hi_offset;
+
+        /* Calculate consumer_lag by using the highest offset
+         * of app_offset (the last message passed to application + 1)
+         * or the committed_offset (the last message committed by this or
+         * another consumer).
+         * Using app_offset allows consumer_lag to be up to date even if
+         * offsets are not (yet) committed.
+         */
+        p->consumer_lag = -1;
+        if (rktp->rktp_hi_offset != RD_KAFKA_OFFSET_INVALID &&
+            (rktp->rktp_app_offset >= 0 || rktp->rktp_committed_offset >= 0)) {
+                p->consumer_lag = rktp->rktp_hi_offset -
+                        RD_MAX(rktp->rktp_app_offset,
+                               rktp->rktp_committed_offset);
+                if (unlikely(p->consumer_lag) < 0)
+                        p->consumer_lag = 0;
+        }
+
+        p->txmsgs = rd_atomic64_get(&rktp->rktp_c.tx_msgs);
+        p->txbytes = rd_atomic64_get(&rktp->rktp_c.tx_msg_bytes);
+        p->rxmsgs = rd_atomic64_get(&rktp->rktp_c.rx_msgs);
+        p->rxbytes = rd_atomic64_get(&rktp->rktp_c.rx_msg_bytes);
+        p->msgs = rk->rk_type == RD_KAFKA_PRODUCER ?
+                rd_atomic64_get(&rktp->rktp_c.producer_enq_msgs) :
+                p->rxmsgs; /* legacy, same as rx_msgs */
+        p->rx_ver_drops = rd_atomic64_get(&rktp->rktp_c.rx_ver_drops);
+        p->msgs_inflight = rd_atomic32_get(&rktp->rktp_msgs_inflight);
+        p->next_ack_seq = rktp->rktp_eos.next_ack_seq;
+        p->next_err_seq = rktp->rktp_eos.next_err_seq;
+        p->acked_msgid = rktp->rktp_eos.acked_msgid;
+
+        if (sts->delta) {
+                /* All fields up to the windows are counters or states,
+                 * and padding is zeroed, so the checksum covers them
+                 * as a whole. */
+                uint32_t crc = rd_crc32(
+                        (const char *)p,
+                        offsetof(rd_kafka_stats_partition_t, e2e_latency));
+
+                changed = crc != rktp->rktp_stats_crc;
+                rktp->rktp_stats_crc = crc;
+        }
+
+        rd_kafka_toppar_unlock(rktp);
+
+        if (sts->fields & RD_KAFKA_STATS_F_WINDOW) {
+                rd_kafka_stats_window(sts, &p->e2e_latency,
+                                      &rktp->rktp_avg_e2e_latency);
+                rd_kafka_stats_window(sts, &p->fetchq_latency,
+                                      &rktp->rktp_avg_fetchq_latency);
+                if (p->e2e_latency.cnt || p->fetchq_latency.cnt)
+                        changed = rd_true;
+        }
+
+        if (totals) {
+                totals->txmsgs      += p->txmsgs;
+                totals->txmsg_bytes += p->txbytes;
+                totals->rxmsgs      += p->rxmsgs;
+                totals->rxmsg_bytes += p->rxbytes;
+        }
+
+        return changed;
+}
+
+
+/**
+ * @brief Snapshot the broker request type counters.
+ *
+ * @locks rd_kafka_broker_lock() MUST be held.
+ */
+static void rd_kafka_stats_broker_reqs (rd_kafka_stats_s_t *sts,
+                                        rd_kafka_stats_broker_t *b,
+                                        rd_kafka_broker_t *rkb) {
+        /* Filter out request types that will never be sent by the client. */
+        static const rd_bool_t filter[4][RD_KAFKAP__NUM] = {
+                [RD_KAFKA_PRODUCER] = {
+                        [RD_KAFKAP_Fetch] = rd_true,
+                        [RD_KAFKAP_OffsetCommit] = rd_true,
+                        [RD_KAFKAP_OffsetFetch] = rd_true,
+                        [RD_KAFKAP_GroupCoordinator] = rd_true,
+                        [RD_KAFKAP_JoinGroup] = rd_true,
+                        [RD_KAFKAP_Heartbeat] = rd_true,
+                        [RD_KAFKAP_LeaveGroup] = rd_true,
+                        [RD_KAFKAP_SyncGroup] = rd_true
+                },
+                [RD_KAFKA_CONSUMER] = {
+                        [RD_KAFKAP_Produce] = rd_true,
+                        [RD_KAFKAP_InitProducerId] = rd_true
+                },
+                [2/*any client type*/] = {
+                        [RD_KAFKAP_UpdateMetadata] = rd_true,
+                        [RD_KAFKAP_ControlledShutdown] = rd_true,
+                        [RD_KAFKAP_LeaderAndIsr] = rd_true,
+                        [RD_KAFKAP_StopReplica] = rd_true,
+                        [RD_KAFKAP_OffsetForLeaderEpoch] = rd_true,
+
+                        /* FIXME: Remove when transaction support is added */
+                        [RD_KAFKAP_AddPartitionsToTxn] = rd_true,
+                        [RD_KAFKAP_AddOffsetsToTxn] = rd_true,
+                        [RD_KAFKAP_EndTxn] = rd_true,
+
+                        [RD_KAFKAP_WriteTxnMarkers] = rd_true,
+                        [RD_KAFKAP_TxnOffsetCommit] = rd_true,
+
+                        [RD_KAFKAP_AlterReplicaLogDirs] = rd_true,
+                        [RD_KAFKAP_DescribeLogDirs] = rd_true,
+
+                        /* FIXME: Remove when re-auth support is added */
+                        [RD_KAFKAP_SaslAuthenticate] = rd_true,
+
+                        [RD_KAFKAP_CreateDelegationToken] = rd_true,
+                        [RD_KAFKAP_RenewDelegationToken] = rd_true,
+                        [RD_KAFKAP_ExpireDelegationToken] = rd_true,
+                        [RD_KAFKAP_DescribeDelegationToken] = rd_true
+                },
+                [3/*hide-unless-non-zero*/] = {
+                        /* Hide Admin requests unless they've been used */
+                        [RD_KAFKAP_CreateTopics] =  rd_true,
+                        [RD_KAFKAP_DeleteTopics] =  rd_true,
+                        [RD_KAFKAP_DeleteRecords] =  rd_true,
+                        [RD_KAFKAP_CreatePartitions] =  rd_true,
+                        [RD_KAFKAP_DescribeAcls] = rd_true,
+                        [RD_KAFKAP_CreateAcls] = rd_true,
+                        [RD_KAFKAP_DeleteAcls] = rd_true,
+                        [RD_KAFKAP_DescribeConfigs] = rd_true,
+                        [RD_KAFKAP_AlterConfigs] = rd_true,
+                        [RD_KAFKAP_DeleteGroups] = rd_true,
+                        [RD_KAFKAP_ListGroups] = rd_true,
+                        [RD_KAFKAP_DescribeGroups] = rd_true
+                }
+        };
+        rd_kafka_bufq_reqcnt_t *reqcnt = &rkb->rkb_waitresps_reqcnt;
+        rd_kafka_stats_req_t *reqs, *req;
+        int64_t v[RD_KAFKAP__NUM];
+        int i, cnt = 0;
+
+        /* The per-request entries are fairly large with the latency
+         * windows included: count the emitted ones first to only
+         * allocate what is needed. */
+        for (i = 0 ; i < RD_KAFKAP__NUM ; i++) {
+                v[i] = -1;
+
+                if (filter[rkb->rkb_rk->rk_type][i] || filter[2][i])
+                        continue;
+
+                v[i] = rd_atomic64_get(&rkb->rkb_c.reqtype[i]);
+                if (!v[i] && filter[3][i]) {
+                        v[i] = -1;
+                        continue; /* Filter out zero values */
+                }
+
+                cnt++;
+        }
+
+        reqs = rd_kafka_stats_alloc(sts, sizeof(*reqs) * RD_MAX(cnt, 1));
+
+        for (i = 0 ; i < RD_KAFKAP__NUM ; i++) {
+                if (v[i] == -1)
+                        continue;
+
+                req = &reqs[b->req_cnt++];
+                req->name   = rd_kafka_ApiKey2str(i);
+                req->ApiKey = (int16_t)i;
+                req->cnt    = v[i];
+
+                /* The high watermark is reset to the current count
+                 * for the next emission. */
+                req->inflight = rd_atomic32_get(&reqcnt->cnt[i]);
+                req->inflight_max = RD_MAX(rd_atomic32_get(&reqcnt->max[i]),
+                                           req->inflight);
+                if (sts->rollover)
+                        rd_atomic32_set(&reqcnt->max[i], req->inflight);
+
+                if ((sts->fields & RD_KAFKA_STATS_F_WINDOW) &&
+                    rkb->rkb_req_avg[i]) {
+                        rd_kafka_stats_window(sts, &req->rtt,
+                                              &rkb->rkb_req_avg[i]->rtt);
+                        rd_kafka_stats_window(
+                                sts, &req->outbuf_latency,
+                                &rkb->rkb_req_avg[i]->outbuf_latency);
+                }
+        }
+
+        b->reqs = reqs;
+}
+
+
+/**
+ * @returns true if \p str is matched by the \p include pattern list
+ *          (if set) and not matched by the \p exclude pattern list.
+ */
+static rd_bool_t rd_kafka_stats_match (rd_kafka_pattern_list_t *include,
+                                       rd_kafka_pattern_list_t *exclude,
+                                       const char *str) {
+        if (include && !rd_kafka_pattern_match(include, str))
+                return rd_false;
+        if (exclude && rd_kafka_pattern_match(exclude, str))
+                return rd_false;
+        return rd_true;
+}
+
+
+/**
+ * @brief Snapshot broker stats to the zeroed \p b.
+ *
+ * @returns rd_false if the broker is filtered out, or if this is a delta
+ *          snapshot and the broker's stats have not changed since the
+ *          previous delta snapshot, else rd_true.
+ *
+ * @locks rd_kafka_broker_lock() MUST NOT be held.
+ */
+static rd_bool_t rd_kafka_stats_broker (rd_kafka_stats_s_t *sts,
+                                        rd_kafka_stats_broker_t *b,
+                                        rd_kafka_broker_t *rkb, rd_ts_t now) {
+        rd_kafka_t *rk = rkb->rkb_rk;
+        rd_kafka_stats_broker_toppar_t *toppars;
+        rd_kafka_toppar_t *rktp;
+        int64_t produce_sampled = 0;
+        int i;
+
+        rd_kafka_broker_lock(rkb);
+
+        if (!rd_kafka_stats_match(rk->rk_conf.stats_broker_include,
+                                  rk->rk_conf.stats_broker_exclude,
+                                  rkb->rkb_name)) {
+                rd_kafka_broker_unlock(rkb);
+                return rd_false;
+        }
+
+        b->nodeid = rkb->rkb_nodeid;
+        b->source = rd_kafka_confsource2str(rkb->rkb_source);
+        b->state = rd_kafka_broker_state_names[rkb->rkb_state];
+        b->stateage = rkb->rkb_ts_state ? now - rkb->rkb_ts_state : 0;
+        b->outbuf_cnt = rd_atomic32_get(&rkb->rkb_outbufs.rkbq_cnt);
+        b->outbuf_msg_cnt = rd_atomic32_get(&rkb->rkb_outbufs.rkbq_msg_cnt);
+        b->waitresp_cnt = rd_atomic32_get(&rkb->rkb_waitresps.rkbq_cnt);
+        b->waitresp_msg_cnt =
+                rd_atomic32_get(&rkb->rkb_waitresps.rkbq_msg_cnt);
+        b->tx = rd_atomic64_get(&rkb->rkb_c.tx);
+        b->txbytes = rd_atomic64_get(&rkb->rkb_c.tx_bytes);
+        b->txerrs = rd_atomic64_get(&rkb->rkb_c.tx_err);
+        b->txretries = rd_atomic64_get(&rkb->rkb_c.tx_retries);
+        b->req_timeouts = rd_atomic64_get(&rkb->rkb_c.req_timeouts);
+        b->rx = rd_atomic64_get(&rkb->rkb_c.rx);
+        b->rxbytes = rd_atomic64_get(&rkb->rkb_c.rx_bytes);
+        b->rxerrs = rd_atomic64_get(&rkb->rkb_c.rx_err);
+        b->rxcorriderrs = rd_atomic64_get(&rkb->rkb_c.rx_corrid_err);
+        b->rxpartial = rd_atomic64_get(&rkb->rkb_c.rx_partial);
+        b->zbuf_grow = rd_atomic64_get(&rkb->rkb_c.zbuf_grow);
+        b->zbuf_pool_hits = rd_atomic64_get(&rkb->rkb_zdec.pool.zp_c.hits);
+        b->zbuf_pool_misses =
+                rd_atomic64_get(&rkb->rkb_zdec.pool.zp_c.misses);
+        b->zbuf_pool_size = rd_kafka_zbuf_pool_size(&rkb->rkb_zdec.pool);
+        b->buf_grow = rd_atomic64_get(&rkb->rkb_c.buf_grow);
+        b->wakeups = rd_atomic64_get(&rkb->rkb_c.wakeups);
+        b->zc_tx = rd_atomic64_get(&rkb->rkb_c.zc_tx);
+        b->zc_tx_copied = rd_atomic64_get(&rkb->rkb_c.zc_tx_copied);
+        b->zc_tx_fallback = rd_atomic64_get(&rkb->rkb_c.zc_tx_fallback);
+        b->connects = rd_atomic32_get(&rkb->rkb_c.connects);
+        b->disconnects = rd_atomic32_get(&rkb->rkb_c.disconnects);
+        b->tls_full_handshakes =
+                rd_atomic32_get(&rkb->rkb_c.tls_full_handshakes);
+        b->tls_resumed_handshakes =
+                rd_atomic32_get(&rkb->rkb_c.tls_resumed_handshakes);
+        b->resolve_hits = rd_atomic32_get(&rkb->rkb_c.resolve_hits);
+        b->resolve_misses = rd_atomic32_get(&rkb->rkb_c.resolve_misses);
+
+        if (sts->fields & RD_KAFKA_STATS_F_WINDOW) {
+                rd_kafka_stats_window(sts, &b->int_latency,
+                                      &rkb->rkb_avg_int_latency);
+                rd_kafka_stats_window(sts, &b->outbuf_latency,
+                                      &rkb->rkb_avg_outbuf_latency);
+                rd_kafka_stats_window(sts, &b->rtt, &rkb->rkb_avg_rtt);
+                rd_kafka_stats_window(sts, &b->throttle,
+                                      &rkb->rkb_avg_throttle);
+                rd_kafka_stats_window(sts, &b->tls_records,
+                                      &rkb->rkb_avg_tls_records);
+                rd_kafka_stats_window(sts, &b->tls_record_size,
+                                      &rkb->rkb_avg_tls_record_size);
+                rd_kafka_stats_window(sts, &b->resolve_latency,
+                                      &rkb->rkb_avg_resolve_latency);
+                for (i = 0 ; i < RD_KAFKA_STATS_PRODUCE_STAGE_DR ; i++) {
+                        rd_kafka_stats_window(
+                                sts, &b->produce_latency[i],
+                                &rkb->rkb_avg_produce_latency[i]);
+                        produce_sampled += b->produce_latency[i].cnt;
+                }
+        }
+
+        if (sts->delta) {
+                /* Checksum the counters, the state and whether any
+                 * of the windows have samples, but not the stateage. */
+                rd_crc32_t crc = rd_crc32_init();
+                rd_bool_t sampled = b->int_latency.cnt ||
+                        b->outbuf_latency.cnt || b->rtt.cnt ||
+                        b->throttle.cnt || b->tls_records.cnt ||
+                        b->tls_record_size.cnt || b->resolve_latency.cnt ||
+                        produce_sampled;
+
+                crc = rd_crc32_update(
+                        crc, (const unsigned char *)&b->outbuf_cnt,
+                        offsetof(rd_kafka_stats_broker_t, resolve_misses) +
+                        sizeof(b->resolve_misses) -
+                        offsetof(rd_kafka_stats_broker_t, outbuf_cnt));
+                crc = rd_crc32_update(crc,
+                                      (const unsigned char *)&b->state,
+                                      sizeof(b->state));
+                crc = rd_crc32_finalize(crc);
+
+                if (!sampled && crc == rkb->rkb_stats_crc) {
+                        rd_kafka_broker_unlock(rkb);
+                        return rd_false;
+                }
+                rkb->rkb_stats_crc = crc;
+        }
+
+        b->name = rd_kafka_stats_strdup(sts, rkb->rkb_name);
+        b->nodename = rd_kafka_stats_strdup(sts, rkb->rkb_nodename);
+
+        if (sts->fields & RD_KAFKA_STATS_F_REQ)
+                rd_kafka_stats_broker_reqs(sts, b, rkb);
+
+        if (sts->fields & RD_KAFKA_STATS_F_TOPPARS) {
+                toppars = rd_kafka_stats_alloc(sts, sizeof(*toppars) *
+                                               rkb->rkb_toppar_cnt);
+                TAILQ_FOREACH(rktp, &rkb->rkb_toppars, rktp_rkblink) {
+                        rd_kafka_stats_broker_toppar_t *tp =
+                                &toppars[b->toppar_cnt++];
+
+                        tp->topic = rd_kafka_stats_kstrdup(
+                                sts, rktp->rktp_rkt->rkt_topic);
+                        tp->partition = rktp->rktp_partition;
+                }
+                b->toppars = toppars;
+        }
+
+        rd_kafka_broker_unlock(rkb);
+
+        return rd_true;
+}
+
+
+/**
+ * @brief Add the partition's message counters to the \p totals,
+ *        for partitions that are not part of the snapshot.
+ */
+static void rd_kafka_stats_toppar_totals (rd_kafka_stats_t *totals,
+                                          rd_kafka_toppar_t *rktp) {
+        totals->txmsgs      += rd_atomic64_get(&rktp->rktp_c.tx_msgs);
+        totals->txmsg_bytes += rd_atomic64_get(&rktp->rktp_c.tx_msg_bytes);
+        totals->rxmsgs      += rd_atomic64_get(&rktp->rktp_c.rx_msgs);
+        totals->rxmsg_bytes += rd_atomic64_get(&rktp->rktp_c.rx_msg_bytes);
+}
+
+
+/**
+ * @brief Snapshot topic and partition stats to the zeroed \p t.
+ *
+ * The totals are updated from all partitions, whether they are part of
+ * the snapshot or not.
+ *
+ * @returns rd_false if the topic is filtered out, or if this is a delta
+ *          snapshot and none of the topic's stats have changed since
+ *          the previous delta snapshot, else rd_true.
+ *
+ * @locks rd_kafka_topic_*lock() MUST NOT be held.
+ * @locality rdkafka main thread for delta snapshots.
+ */
+static rd_bool_t rd_kafka_stats_topic (rd_kafka_stats_s_t *sts,
+                                       rd_kafka_stats_topic_t *t,
+                                       rd_kafka_itopic_t *rkt, rd_ts_t now) {
+        rd_kafka_t *rk = rkt->rkt_rk;
+        rd_kafka_stats_partition_t *partitions = NULL;
+        rd_kafka_stats_partition_t tmp;
+        shptr_rd_kafka_toppar_t *s_rktp;
+        rd_bool_t emit, changed = !sts->delta;
+        int i;
+
+        rd_kafka_topic_rdlock(rkt);
+
+        emit = (sts->fields & RD_KAFKA_STATS_F_TOPIC) &&
+                rd_kafka_stats_match(rk->rk_conf.stats_topic_include,
+                                     rk->rk_conf.stats_topic_exclude,
+                                     rkt->rkt_topic->str);
+
+        if (!emit) {
+                /* Only the totals are needed. */
+                for (i = 0 ; i < rkt->rkt_partition_cnt ; i++)
+                        rd_kafka_stats_toppar_totals(
+                                &sts->stats,
+                                rd_kafka_toppar_s2i(rkt->rkt_p[i]));
+                RD_LIST_FOREACH(s_rktp, &rkt->rkt_desp, i)
+                        rd_kafka_stats_toppar_totals(
+                                &sts->stats, rd_kafka_toppar_s2i(s_rktp));
+                rd_kafka_topic_rdunlock(rkt);
+                return rd_false;
+        }
+
+        t->metadata_age = rkt->rkt_ts_metadata ?
+                (now - rkt->rkt_ts_metadata) / 1000 : 0;
+
+        if (sts->fields & RD_KAFKA_STATS_F_WINDOW) {
+                rd_kafka_stats_window(sts, &t->batchsize,
+                                      &rkt->rkt_avg_batchsize);
+                rd_kafka_stats_window(sts, &t->batchcnt,
+                                      &rkt->rkt_avg_batchcnt);
+                if (t->batchsize.cnt || t->batchcnt.cnt)
+                        changed = rd_true;
+                for (i = 0 ; i < RD_KAFKA_STATS_PRODUCE_STAGE__CNT ; i++) {
+                        rd_kafka_stats_window(
+                                sts, &t->produce_latency[i],
+                                &rkt->rkt_avg_produce_latency[i]);
+                        if (t->produce_latency[i].cnt)
+                                changed = rd_true;
+                }
+        }
+
+        if (sts->delta) {
+                int32_t v[2] = { rkt->rkt_partition_cnt, rkt->rkt_state };
+                uint32_t crc = rd_crc32((const char *)v, sizeof(v));
+
+                if (crc != rkt->rkt_stats_crc)
+                        changed = rd_true;
+                rkt->rkt_stats_crc = crc;
+        }
+
+        /* Partitions are snapshotted to tmp when the partition field
+         * group is excluded, for the totals and delta checksums. */
+        if (sts->fields & RD_KAFKA_STATS_F_PARTITION)
+                partitions = rd_kafka_stats_alloc(
+                        sts, sizeof(*partitions) *
+                        (rkt->rkt_partition_cnt +
+                         rd_list_cnt(&rkt->rkt_desp) +
+                         (rkt->rkt_ua ? 1 : 0)));
+
+#define _PARTITION_SNAPSHOT(S_RKTP,TOTALS) do {                         \
+                rd_kafka_stats_partition_t *_p = partitions ?           \
+                        &partitions[t->partition_cnt] : &tmp;           \
+                memset(_p, 0, sizeof(*_p));                             \
+                if (rd_kafka_stats_toppar(_p, TOTALS,                   \
+                                          rd_kafka_toppar_s2i(S_RKTP),  \
+                                          sts)) {                       \
+                        changed = rd_true;                              \
+                        if (partitions)                                 \
+                                t->partition_cnt++;                     \
+                }                                                       \
+        } while (0)
+
+        for (i = 0 ; i < rkt->rkt_partition_cnt ; i++)
+                _PARTITION_SNAPSHOT(rkt->rkt_p[i], &sts->stats);
+
+        RD_LIST_FOREACH(s_rktp, &rkt->rkt_desp, i)
+                _PARTITION_SNAPSHOT(s_rktp, &sts->stats);
+
+        /* The UA partition is not included in the totals */
+        if (rkt->rkt_ua)
+                _PARTITION_SNAPSHOT(rkt->rkt_ua, NULL);
+
+#undef _PARTITION_SNAPSHOT
+
+        t->partitions = partitions;
+
+        if (changed)
+                t->topic = rd_kafka_stats_kstrdup(sts, rkt->rkt_topic);
+
+        rd_kafka_topic_rdunlock(rkt);
+
+        return changed;
+}
+
+
+/**
+ * @brief Take a statistics snapshot.
+ *
+ * The client instance is only locked while references to its brokers
+ * and topics are acquired, each broker and topic is then snapshotted
+ * under its own lock.
+ *
+ * The snapshot is filtered by the statistics.fields and
+ * statistics.{topic,broker}.{include,exclude} properties.
+ *
+ * @param delta omit the brokers, topics and partitions whose stats have
+ *              not changed since the previous delta snapshot.
+ * @param rollover reset the window stats and request high watermarks,
+ *                 only for the snapshots that are emitted, so that
+ *                 application snapshots do not shorten the windows.
+ *
+ * @returns a new snapshot, free with rd_kafka_stats_destroy().
+ *
+ * @locks none
+ * @locality rdkafka main thread for delta snapshots.
+ */
+rd_kafka_stats_t *rd_kafka_stats_new (rd_kafka_t *rk, rd_bool_t delta,
+                                      rd_bool_t rollover) {
+        rd_kafka_stats_s_t *sts;
+        rd_kafka_stats_t *stats;
+        rd_kafka_stats_broker_t *brokers;
+        rd_kafka_stats_topic_t *topics;
+        rd_kafka_broker_t *rkb;
+        rd_kafka_itopic_t *rkt;
+        shptr_rd_kafka_itopic_t *s_rkt;
+        rd_list_t rkbs, s_rkts;
+        rd_ts_t now;
+        int i;
+
+        sts = rd_calloc(1, sizeof(*sts));
+        stats = &sts->stats;
+        sts->fields = rk->rk_conf.stats_fields;
+        sts->delta = delta;
+        sts->rollover = rollover;
+        stats->version = RD_KAFKA_STATS_VERSION;
+
+        rd_kafka_curr_msgs_get(rk, &stats->msg_cnt, &stats->msg_size);
+
+        rd_kafka_rdlock(rk);
+
+        now = rd_clock();
+
+        stats->name = rd_kafka_stats_strdup(sts, rk->rk_name);
+        stats->client_id = rd_kafka_stats_strdup(sts,
+                                                 rk->rk_conf.client_id_str);
+        stats->type = rd_kafka_type2str(rk->rk_type);
+        stats->ts = now;
+        stats->time = (int64_t)time(NULL);
+        stats->replyq = rd_kafka_q_len(rk->rk_rep);
+        stats->msg_max = rk->rk_curr_msgs.max_cnt;
+        stats->msg_size_max = rk->rk_curr_msgs.max_size;
+        stats->simple_cnt = rd_atomic32_get(&rk->rk_simple_cnt);
+        stats->metadata_cache_cnt = rk->rk_metadata_cache.rkmc_cnt;
+        stats->fetchbuf_pinned_bytes =
+                rd_atomic64_get(&rk->rk_fetchbuf.pinned_bytes);
+        stats->fetchbuf_live_bytes =
+                rd_atomic64_get(&rk->rk_fetchbuf.live_bytes);
+        stats->fetchbuf_copyout_cnt =
+                rd_atomic64_get(&rk->rk_fetchbuf.copyout_cnt);
+        stats->fetchbuf_copyout_bytes =
+                rd_atomic64_get(&rk->rk_fetchbuf.copyout_bytes);
+        stats->prefetch_bytes = rd_atomic64_get(&rk->rk_prefetch.queued_bytes);
+        stats->prefetch_inflight_bytes =
+                rd_atomic64_get(&rk->rk_prefetch.inflight_bytes);
+        stats->prefetch_exhausted =
+                rd_atomic64_get(&rk->rk_prefetch.exhausted_cnt);
+        if (rk->rk_logring)
+                stats->log_drops = rd_kafka_logring_drops(rk->rk_logring);
+
+        if (sts->fields & RD_KAFKA_STATS_F_WINDOW)
+                rd_kafka_stats_window(sts, &stats->poll_gap,
+                                      &rk->rk_avg_poll_gap);
+
+        if (rk->rk_cgrp && (sts->fields & RD_KAFKA_STATS_F_CGRP)) {
+                rd_kafka_cgrp_t *rkcg = rk->rk_cgrp;
+                rd_kafka_stats_cgrp_t *cgrp = &sts->cgrp;
+
+                cgrp->state = rd_kafka_cgrp_state_names[rkcg->rkcg_state];
+                cgrp->stateage = rkcg->rkcg_ts_statechange ?
+                        (now - rkcg->rkcg_ts_statechange) / 1000 : 0;
+                cgrp->join_state =
+                        rd_kafka_cgrp_join_state_names[rkcg->rkcg_join_state];
+                cgrp->rebalance_age = rkcg->rkcg_c.ts_rebalance ?
+                        (now - rkcg->rkcg_c.ts_rebalance) / 1000 : 0;
+                cgrp->rebalance_cnt = rkcg->rkcg_c.rebalance_cnt;
+                cgrp->rebalance_reason = rd_kafka_stats_strndup(
+                        sts, rkcg->rkcg_c.rebalance_reason,
+                        strnlen(rkcg->rkcg_c.rebalance_reason,
+                                sizeof(rkcg->rkcg_c.rebalance_reason)));
+                cgrp->assignment_size = rkcg->rkcg_c.assignment_size;
+                stats->cgrp = cgrp;
+        }
+
+        if (rd_kafka_is_idempotent(rk) &&
+            (sts->fields & RD_KAFKA_STATS_F_EOS)) {
+                rd_kafka_stats_eos_t *eos = &sts->eos;
+
+                eos->idemp_state =
+                        rd_kafka_idemp_state2str(rk->rk_eos.idemp_state);
+                eos->idemp_stateage =
+                        (now - rk->rk_eos.ts_idemp_state) / 1000;
+                eos->producer_id = rk->rk_eos.pid.id;
+                eos->producer_epoch = rk->rk_eos.pid.epoch;
+                eos->epoch_cnt = rk->rk_eos.epoch_cnt;
+                stats->eos = eos;
+        }
+
+        if ((stats->fatal_err = rd_atomic32_get(&rk->rk_fatal.err))) {
+                stats->fatal_reason =
+                        rd_kafka_stats_strdup(sts, rk->rk_fatal.errstr);
+                stats->fatal_cnt = rk->rk_fatal.cnt;
+        }
+
+        /* Hold references to the brokers and topics so that they can be
+         * snapshotted without the client instance lock. */
+        rd_list_init(&rkbs, rd_atomic32_get(&rk->rk_broker_cnt), NULL);
+        TAILQ_FOREACH(rkb, &rk->rk_brokers, rkb_link) {
+                rd_kafka_broker_keep(rkb);
+                rd_list_add(&rkbs, rkb);
+        }
+
+        rd_list_init(&s_rkts, rk->rk_topic_cnt, NULL);
+        TAILQ_FOREACH(rkt, &rk->rk_topics, rkt_link)
+                rd_list_add(&s_rkts, rd_kafka_topic_keep(rkt));
+
+        rd_kafka_rdunlock(rk);
+
+        if (sts->fields & RD_KAFKA_STATS_F_BROKER)
+                brokers = rd_kafka_stats_alloc(sts, sizeof(*brokers) *
+                                               rd_list_cnt(&rkbs));
+        else
+                brokers = NULL;
+
+        RD_LIST_FOREACH(rkb, &rkbs, i) {
+                stats->tx       += rd_atomic64_get(&rkb->rkb_c.tx);
+                stats->tx_bytes += rd_atomic64_get(&rkb->rkb_c.tx_bytes);
+                stats->rx       += rd_atomic64_get(&rkb->rkb_c.rx);
+                stats->rx_bytes += rd_atomic64_get(&rkb->rkb_c.rx_bytes);
+
+                /* Filtered out or unchanged brokers leave their
+                 * (re-zeroed) slot to the next broker. */
+                if (brokers) {
+                        rd_kafka_stats_broker_t *b =
+                                &brokers[stats->broker_cnt];
+
+                        if (rd_kafka_stats_broker(sts, b, rkb, now))
+                                stats->broker_cnt++;
+                        else
+                                memset(b, 0, sizeof(*b));
+                }
+
+                rd_kafka_broker_destroy(rkb);
+        }
+        stats->brokers = brokers;
+        rd_list_destroy(&rkbs);
+
+        topics = rd_kafka_stats_alloc(sts, sizeof(*topics) *
+                                      rd_list_cnt(&s_rkts));
+        RD_LIST_FOREACH(s_rkt, &s_rkts, i) {
+                rd_kafka_stats_topic_t *t = &topics[stats->topic_cnt];
+
+                if (rd_kafka_stats_topic(sts, t, rd_kafka_topic_s2i(s_rkt),
+                                         now))
+                        stats->topic_cnt++;
+                else
+                        memset(t, 0, sizeof(*t));
+
+                rd_kafka_topic_destroy0(s_rkt);
+        }
+        stats->topics = topics;
+        rd_list_destroy(&s_rkts);
+
+        return stats;
+}
+
+
+rd_kafka_resp_err_t rd_kafka_stats_snapshot (rd_kafka_t *rk, int version,
+                                             const rd_kafka_stats_t **statsp) {
+        /* Only the initial layout exists so far: older layouts are to be
+         * copied out from the current one as the version is bumped. */
+        if (version != RD_KAFKA_STATS_VERSION) {
+                *statsp = NULL;
+                return RD_KAFKA_RESP_ERR__INVALID_ARG;
+        }
+
+        *statsp = rd_kafka_stats_new(rk, rd_false/*not delta*/,
+                                     rd_false/*no rollover*/);
+        return RD_KAFKA_RESP_ERR_NO_ERROR;
+}
+
+
+void rd_kafka_stats_destroy (const rd_kafka_stats_t *stats) {
+        rd_kafka_stats_s_t *sts = (rd_kafka_stats_s_t *)stats;
+        struct rd_kafka_stats_chunk *chunk;
+
+        while ((chunk = sts->chunks)) {
+                sts->chunks = chunk->next;
+                rd_free(chunk);
+        }
+
+        rd_free(sts);
+}
+
+
+
+/**
+ * @brief Buffer state for stats emitter
+ */
+struct _stats_emit {
+        char   *buf;      /* Pointer to allocated buffer */
+        size_t  size;     /* Current allocated size of buf */
+        size_t  of;       /* Current write-offset in buf */
+};
+
+
+/* Stats buffer printf. Requires a (struct _stats_emit *)st variable in the
+ * current scope. */
+#define _st_printf(...) do {                                            \
+                ssize_t _r;                                             \
+                ssize_t _rem = st->size - st->of;                       \
+                _r = rd_snprintf(st->buf+st->of, _rem, __VA_ARGS__);    \
+                if (_r >= _rem) {                                       \
+                        st->size *= 2;                                  \
+                        _rem = st->size - st->of;                       \
+                        st->buf = rd_realloc(st->buf, st->size);        \
+                        _r = rd_snprintf(st->buf+st->of, _rem, __VA_ARGS__); \
+                }                                                       \
+                st->of += _r;                                           \
+        } while (0)
+
+
+/**
+ * @brief Emit an average window.
+ */
+static void rd_kafka_stats_json_avg (struct _stats_emit *st,
+                                     const char *name,
+                                     const rd_kafka_stats_window_t *w) {
+        _st_printf(
+                "\"%s\": {"
+                " \"min\":%"PRId64","
+                " \"max\":%"PRId64","
+                " \"avg\":%"PRId64","
+                " \"sum\":%"PRId64","
+                " \"stddev\": %"PRId64","
+                " \"p50\": %"PRId64","
+                " \"p75\": %"PRId64","
+                " \"p90\": %"PRId64","
+                " \"p95\": %"PRId64","
+                " \"p99\": %"PRId64","
+                " \"p99_99\": %"PRId64","
+                " \"outofrange\": %"PRId64","
+                " \"hdrsize\": %"PRId32","
+                " \"cnt\":%i "
+                "}, ",
+                name,
+                w->min,
+                w->max,
+                w->avg,
+                w->sum,
+                w->stddev,
+                w->p50,
+                w->p75,
+                w->p90,
+                w->p95,
+                w->p99,
+                w->p99_99,
+                w->outofrange,
+                w->hdrsize,
+                w->cnt);
+}
+
+
+/**
+ * @brief Producer batch stage names, indexed by
+ *        rd_kafka_stats_produce_stage_t.
+ */
+static const char *rd_kafka_stats_produce_stage_names[] = {
+        "linger", "compress", "send", "broker", "response", "dr", "total"
+};
+
+/**
+ * @brief Emit the \"produce_latency\" object of the first \p cnt
+ *        producer batch stage windows.
+ */
+static void rd_kafka_stats_json_produce_latency (
+        struct _stats_emit *st,
+        const rd_kafka_stats_window_t *windows, int cnt) {
+        int i;
+
+        _st_printf("\"produce_latency\": { ");
+        for (i = 0 ; i < cnt ; i++)
+                rd_kafka_stats_json_avg(
+                        st, rd_kafka_stats_produce_stage_names[i],
+                        &windows[i]);
+        /* Trim the trailing ", " of the last stage */
+        st->of -= 2;
+        _st_printf(" }, ");
+}
+
+/**
+ * @brief Emit the per-request type in-flight counts and latency windows
+ *        of broker \p b, skipping request types that have not been used.
+ */
+static void rd_kafka_stats_json_req_stats (struct _stats_emit *st,
+                                           const rd_kafka_stats_broker_t *b,
+                                           int fields) {
+        int i, cnt = 0;
+
+        _st_printf("\"req_stats\": { ");
+        for (i = 0 ; i < b->req_cnt ; i++) {
+                const rd_kafka_stats_req_t *req = &b->reqs[i];
+
+                if (!req->cnt && !req->inflight && !req->inflight_max)
+                        continue;
+
+                _st_printf("%s\"%s\": { "
+                           "\"inflight\":%"PRId32", "
+                           "\"inflight_max\":%"PRId32", ",
+                           cnt++ > 0 ? ", " : "",
+                           req->name, req->inflight, req->inflight_max);
+
+                if (fields & RD_KAFKA_STATS_F_WINDOW) {
+                        rd_kafka_stats_json_avg(st, "rtt", &req->rtt);
+                        rd_kafka_stats_json_avg(st, "outbuf_latency",
+                                                &req->outbuf_latency);
+                }
+
+                /* Trim the trailing ", " of the last field */
+                st->of -= 2;
+                _st_printf(" }");
+        }
+        _st_printf(" }, ");
+}
+
+/**
+ * @brief Emit partition stats
+ */
+static void rd_kafka_stats_json_toppar (struct _stats_emit *st,
+                                        const rd_kafka_stats_partition_t *p,
+                                        int fields, rd_bool_t consumer,
+                                        int first) {
+	_st_printf("%s\"%"PRId32"\": { "
+		   "\"partition\":%"PRId32", "
+		   "\"leader\":%"PRId32", "
+		   "\"desired\":%s, "
+		   "\"unknown\":%s, "
+		   "\"msgq_cnt\":%i, "
+		   "\"msgq_bytes\":%"PRIusz", "
+		   "\"xmit_msgq_cnt\":%i, "
+		   "\"xmit_msgq_bytes\":%"PRIusz", "
+		   "\"fetchq_cnt\":%i, "
+		   "\"fetchq_size\":%"PRIu64", "
+		   "\"fetch_state\":\"%s\", "
+		   "\"fetch_max_bytes\":%"PRId32", "
+		   "\"consume_rate\":%"PRId64", "
+		   "\"query_offset\":%"PRId64", "
+		   "\"next_offset\":%"PRId64", "
+		   "\"app_offset\":%"PRId64", "
+		   "\"stored_offset\":%"PRId64", "
+		   "\"commited_offset\":%"PRId64", " /*FIXME: issue #80 */
+		   "\"committed_offset\":%"PRId64", "
+		   "\"eof_offset\":%"PRId64", "
+		   "\"lo_offset\":%"PRId64", "
+		   "\"hi_offset\":%"PRId64", "
+                   "\"consumer_lag\":%"PRId64", "
+		   "\"txmsgs\":%"PRIu64", "
+		   "\"txbytes\":%"PRIu64", "
+                   "\"rxmsgs\":%"PRIu64", "
+                   "\"rxbytes\":%"PRIu64", "
+                   "\"msgs\": %"PRIu64", "
+                   "\"rx_ver_drops\": %"PRIu64", "
+                   "\"msgs_inflight\": %"PRId32", "
+                   "\"next_ack_seq\": %"PRId32", "
+                   "\"next_err_seq\": %"PRId32", "
+                   "\"acked_msgid\": %"PRIu64,
+		   first ? "" : ", ",
+		   p->partition,
+		   p->partition,
+                   p->leader,
+		   p->desired ? "true" : "false",
+		   p->unknown ? "true" : "false",
+                   p->msgq_cnt,
+		   p->msgq_bytes,
+                   /* FIXME: xmit_msgq is local to the broker thread. */
+                   0,
+                   (size_t)0,
+		   p->fetchq_cnt,
+		   p->fetchq_size,
+		   p->fetch_state,
+                   p->fetch_max_bytes,
+                   p->consume_rate,
+		   p->query_offset,
+                   p->next_offset,
+		   p->app_offset,
+		   p->stored_offset,
+		   p->committed_offset, /* FIXME: issue #80 */
+		   p->committed_offset,
+                   p->eof_offset,
+		   p->lo_offset,
+		   p->hi_offset,
+                   p->consumer_lag,
+                   p->txmsgs,
+                   p->txbytes,
+                   p->rxmsgs,
+                   p->rxbytes,
+                   p->msgs,
+                   p->rx_ver_drops,
+                   p->msgs_inflight,
+                   p->next_ack_seq,
+                   p->next_err_seq,
+                   p->acked_msgid);
+
+        if (consumer && (fields & RD_KAFKA_STATS_F_WINDOW)) {
+                _st_printf(", ");
+                rd_kafka_stats_json_avg(st, "e2e_latency", &p->e2e_latency);
+                rd_kafka_stats_json_avg(st, "fetchq_latency",
+                                        &p->fetchq_latency);
+                /* Trim the trailing ", " of the last window */
+                st->of -= 2;
+        }
+
+        _st_printf("} ");
+}
+
+/**
+ * @brief Emit broker stats
+ */
+static void rd_kafka_stats_json_broker (struct _stats_emit *st,
+                                        const rd_kafka_stats_broker_t *b,
+                                        int fields, rd_bool_t producer,
+                                        int first) {
+        int i;
+
+        _st_printf("%s\"%s\": { "/*open broker*/
+                   "\"name\":\"%s\", "
+                   "\"nodeid\":%"PRId32", "
+                   "\"nodename\":\"%s\", "
+                   "\"source\":\"%s\", "
+                   "\"state\":\"%s\", "
+                   "\"stateage\":%"PRId64", "
+                   "\"outbuf_cnt\":%i, "
+                   "\"outbuf_msg_cnt\":%i, "
+                   "\"waitresp_cnt\":%i, "
+                   "\"waitresp_msg_cnt\":%i, "
+                   "\"tx\":%"PRIu64", "
+                   "\"txbytes\":%"PRIu64", "
+                   "\"txerrs\":%"PRIu64", "
+                   "\"txretries\":%"PRIu64", "
+                   "\"req_timeouts\":%"PRIu64", "
+                   "\"rx\":%"PRIu64", "
+                   "\"rxbytes\":%"PRIu64", "
+                   "\"rxerrs\":%"PRIu64", "
+                   "\"rxcorriderrs\":%"PRIu64", "
+                   "\"rxpartial\":%"PRIu64", "
+                   "\"zbuf_grow\":%"PRIu64", "
+                   "\"zbuf_pool_hits\":%"PRIu64", "
+                   "\"zbuf_pool_misses\":%"PRIu64", "
+                   "\"zbuf_pool_size\":%"PRIusz", "
+                   "\"buf_grow\":%"PRIu64", "
+                   "\"wakeups\":%"PRIu64", "
+                   "\"zc_tx\":%"PRIu64", "
+                   "\"zc_tx_copied\":%"PRIu64", "
+                   "\"zc_tx_fallback\":%"PRIu64", "
+                   "\"connects\":%"PRId32", "
+                   "\"disconnects\":%"PRId32", "
+                   "\"tls_full_handshakes\":%"PRId32", "
+                   "\"tls_resumed_handshakes\":%"PRId32", "
+                   "\"resolve_hits\":%"PRId32", "
+                   "\"resolve_misses\":%"PRId32", ",
+                   first ? "" : ", ",
+                   b->name,
+                   b->name,
+                   b->nodeid,
+                   b->nodename,
+                   b->source,
+                   b->state,
+                   b->stateage,
+                   b->outbuf_cnt,
+                   b->outbuf_msg_cnt,
+                   b->waitresp_cnt,
+                   b->waitresp_msg_cnt,
+                   b->tx,
+                   b->txbytes,
+                   b->txerrs,
+                   b->txretries,
+                   b->req_timeouts,
+                   b->rx,
+                   b->rxbytes,
+                   b->rxerrs,
+                   b->rxcorriderrs,
+                   b->rxpartial,
+                   b->zbuf_grow,
+                   b->zbuf_pool_hits,
+                   b->zbuf_pool_misses,
+                   b->zbuf_pool_size,
+                   b->buf_grow,
+                   b->wakeups,
+                   b->zc_tx,
+                   b->zc_tx_copied,
+                   b->zc_tx_fallback,
+                   b->connects,
+                   b->disconnects,
+                   b->tls_full_handshakes,
+                   b->tls_resumed_handshakes,
+                   b->resolve_hits,
+                   b->resolve_misses);
+
+        if (fields & RD_KAFKA_STATS_F_WINDOW) {
+                rd_kafka_stats_json_avg(st, "int_latency", &b->int_latency);
+                rd_kafka_stats_json_avg(st, "outbuf_latency",
+                                        &b->outbuf_latency);
+                rd_kafka_stats_json_avg(st, "rtt", &b->rtt);
+                rd_kafka_stats_json_avg(st, "throttle", &b->throttle);
+                rd_kafka_stats_json_avg(st, "tls_records", &b->tls_records);
+                rd_kafka_stats_json_avg(st, "tls_record_size",
+                                        &b->tls_record_size);
+                rd_kafka_stats_json_avg(st, "resolve_latency",
+                                        &b->resolve_latency);
+                if (producer)
+                        rd_kafka_stats_json_produce_latency(
+                                st, b->produce_latency,
+                                RD_KAFKA_STATS_PRODUCE_STAGE_DR);
+        }
+
+        if (fields & RD_KAFKA_STATS_F_REQ) {
+                _st_printf("\"req\": { ");
+                for (i = 0 ; i < b->req_cnt ; i++)
+                        _st_printf("%s\"%s\": %"PRId64,
+                                   i > 0 ? ", " : "",
+                                   b->reqs[i].name, b->reqs[i].cnt);
+                _st_printf(" }, ");
+                rd_kafka_stats_json_req_stats(st, b, fields);
+        }
+
+        if (fields & RD_KAFKA_STATS_F_TOPPARS) {
+                _st_printf("\"toppars\":{ "/*open toppars*/);
+                for (i = 0 ; i < b->toppar_cnt ; i++)
+                        _st_printf("%s\"%s-%"PRId32"\": { "
+                                   "\"topic\":\"%s\", "
+                                   "\"partition\":%"PRId32"} ",
+                                   i == 0 ? "" : ", ",
+                                   b->toppars[i].topic,
+                                   b->toppars[i].partition,
+                                   b->toppars[i].topic,
+                                   b->toppars[i].partition);
+                _st_printf("} "/*close toppars*/
+                           "} "/*close broker*/);
+        } else {
+                /* Trim the trailing ", " of the last field */
+                st->of -= 2;
+                _st_printf(" } "/*close broker*/);
+        }
+}
+
+
+/**
+ * @brief Render statistics snapshot as the JSON document passed to
+ *        the stats_cb, see STATISTICS.md.
+ *
+ * @returns the rd_malloc():ed JSON string, of \p *lenp bytes
+ *          (excluding the nul terminator).
+ */
+char *rd_kafka_stats_to_json (const rd_kafka_stats_t *stats, size_t *lenp) {
+        const rd_kafka_stats_s_t *sts = (const rd_kafka_stats_s_t *)stats;
+        struct _stats_emit stx = { .size = 1024*10 };
+        struct _stats_emit *st = &stx;
+        rd_bool_t producer = !strcmp(stats->type, "producer");
+        int i, j;
+
+        st->buf = rd_malloc(st->size);
+
+	_st_printf("{ "
+                   "\"name\": \"%s\", "
+                   "\"client_id\": \"%s\", "
+                   "\"type\": \"%s\", "
+		   "\"ts\":%"PRId64", "
+		   "\"time\":%lli, "
+		   "\"replyq\":%i, "
+                   "\"msg_cnt\":%u, "
+		   "\"msg_size\":%"PRIusz", "
+                   "\"msg_max\":%u, "
+		   "\"msg_size_max\":%"PRIusz", "
+                   "\"simple_cnt\":%i, "
+                   "\"metadata_cache_cnt\":%i, "
+                   "\"fetchbuf_pinned_bytes\":%"PRId64", "
+                   "\"fetchbuf_live_bytes\":%"PRId64", "
+                   "\"fetchbuf_copyout_cnt\":%"PRId64", "
+                   "\"fetchbuf_copyout_bytes\":%"PRId64", "
+                   "\"prefetch_bytes\":%"PRId64", "
+                   "\"prefetch_inflight_bytes\":%"PRId64", "
+                   "\"prefetch_exhausted\":%"PRId64", "
+                   "\"log_drops\":%"PRId64", ",
+                   stats->name,
+                   stats->client_id,
+                   stats->type,
+		   stats->ts,
+		   (signed long long)stats->time,
+		   stats->replyq,
+		   stats->msg_cnt, stats->msg_size,
+		   stats->msg_max, stats->msg_size_max,
+                   stats->simple_cnt,
+                   stats->metadata_cache_cnt,
+                   stats->fetchbuf_pinned_bytes,
+                   stats->fetchbuf_live_bytes,
+                   stats->fetchbuf_copyout_cnt,
+                   stats->fetchbuf_copyout_bytes,
+                   stats->prefetch_bytes,
+                   stats->prefetch_inflight_bytes,
+                   stats->prefetch_exhausted,
+                   stats->log_drops);
+
+        if (sts->delta)
+                _st_printf("\"delta\":true, ");
+
+        if (!producer && (sts->fields & RD_KAFKA_STATS_F_WINDOW))
+                rd_kafka_stats_json_avg(st, "poll_gap", &stats->poll_gap);
+
+        _st_printf("\"brokers\":{ "/*open brokers*/);
+
+        for (i = 0 ; i < stats->broker_cnt ; i++)
+                rd_kafka_stats_json_broker(st, &stats->brokers[i],
+                                           sts->fields, producer, i == 0);
+
+	_st_printf("}, " /* close "brokers" array */
+		   "\"topics\":{ ");
+
+        for (i = 0 ; i < stats->topic_cnt ; i++) {
+                const rd_kafka_stats_topic_t *t = &stats->topics[i];
+
+		_st_printf("%s\"%s\": { "
+			   "\"topic\":\"%s\", "
+			   "\"metadata_age\":%"PRId64", ",
+			   i == 0 ? "" : ", ",
+			   t->topic,
+			   t->topic,
+			   t->metadata_age);
+
+                if (sts->fields & RD_KAFKA_STATS_F_WINDOW) {
+                        rd_kafka_stats_json_avg(st, "batchsize",
+                                                &t->batchsize);
+                        rd_kafka_stats_json_avg(st, "batchcnt",
+                                                &t->batchcnt);
+                        if (producer)
+                                rd_kafka_stats_json_produce_latency(
+                                        st, t->produce_latency,
+                                        RD_KAFKA_STATS_PRODUCE_STAGE__CNT);
+                }
+
+                if (!(sts->fields & RD_KAFKA_STATS_F_PARTITION)) {
+                        /* Trim the trailing ", " of the last field */
+                        st->of -= 2;
+                        _st_printf(" } "/*close topic*/);
+                        continue;
+                }
+
+                _st_printf("\"partitions\":{ " /*open partitions*/);
+
+                for (j = 0 ; j < t->partition_cnt ; j++)
+                        rd_kafka_stats_json_toppar(st, &t->partitions[j],
+                                                   sts->fields, !producer,
+                                                   j == 0);
+
+		_st_printf("} "/*close partitions*/
+			   "} "/*close topic*/);
+        }
+	_st_printf("} "/*close topics*/);
+
+        if (stats->cgrp)
+                _st_printf(", \"cgrp\": { "
+                           "\"state\": \"%s\", "
+                           "\"stateage\": %"PRId64", "
+                           "\"join_state\": \"%s\", "
+                           "\"rebalance_age\": %"PRId64", "
+                           "\"rebalance_cnt\": %d, "
+                           "\"rebalance_reason\": \"%s\", "
+                           "\"assignment_size\": %d }",
+                           stats->cgrp->state,
+                           stats->cgrp->stateage,
+                           stats->cgrp->join_state,
+                           stats->cgrp->rebalance_age,
+                           stats->cgrp->rebalance_cnt,
+                           stats->cgrp->rebalance_reason,
+                           stats->cgrp->assignment_size);
+
+        if (stats->eos)
+                _st_printf(", \"eos\": { "
+                           "\"idemp_state\": \"%s\", "
+                           "\"idemp_stateage\": %"PRId64", "
+                           "\"producer_id\": %"PRId64", "
+                           "\"producer_epoch\": %hd, "
+                           "\"epoch_cnt\": %d "
+                           "}",
+                           stats->eos->idemp_state,
+                           stats->eos->idemp_stateage,
+                           stats->eos->producer_id,
+                           stats->eos->producer_epoch,
+                           stats->eos->epoch_cnt);
+
+        if (stats->fatal_err)
+                _st_printf(", \"fatal\": { "
+                           "\"error\": \"%s\", "
+                           "\"reason\": \"%s\", "
+                           "\"cnt\": %d "
+                           "}",
+                           rd_kafka_err2str(stats->fatal_err),
+                           stats->fatal_reason,
+                           stats->fatal_cnt);
+
+        /* Total counters */
+        _st_printf(", "
+                   "\"tx\":%"PRId64", "
+                   "\"tx_bytes\":%"PRId64", "
+                   "\"rx\":%"PRId64", "
+                   "\"rx_bytes\":%"PRId64", "
+                   "\"txmsgs\":%"PRId64", "
+                   "\"txmsg_bytes\":%"PRId64", "
+                   "\"rxmsgs\":%"PRId64", "
+                   "\"rxmsg_bytes\":%"PRId64,
+                   stats->tx,
+                   stats->tx_bytes,
+                   stats->rx,
+                   stats->rx_bytes,
+                   stats->txmsgs,
+                   stats->txmsg_bytes,
+                   stats->rxmsgs,
+                   stats->rxmsg_bytes);
+
+        _st_printf("}"/*close object*/);
+
+        *lenp = st->of;
+        return st->buf;
+}
+
+
+/**
+ * @name OpenMetrics renderer
+ * @{
+ *
+ * Metric names are the STATISTICS.md field names prefixed by the object
+ * type: rdkafka_ (top-level), rdkafka_broker_, rdkafka_topic_,
+ * rdkafka_partition_, rdkafka_cgrp_ and rdkafka_eos_, with a unit suffix
+ * where the field is converted to a base unit (seconds, bytes).
+ * Window stats are exported as gauge histograms with the buckets of the
+ * window's HDR histogram.
+ */
+
+/**
+ * @brief Metric field: value types
+ */
+typedef enum {
+        _OM_INT,     /**< int, int32_t */
+        _OM_UINT,    /**< unsigned int */
+        _OM_INT16,   /**< int16_t */
+        _OM_INT64,   /**< int64_t */
+        _OM_UINT64,  /**< uint64_t */
+        _OM_SIZE     /**< size_t */
+} rd_kafka_stats_om_vtype_t;
+
+/**
+ * @brief Metric backed by a field of a stats struct.
+ */
+typedef struct rd_kafka_stats_om_field_s {
+        const char *name;   /**< Metric family name, sans prefix */
+        const char *type;   /**< counter or gauge */
+        const char *help;
+        size_t of;          /**< Field offset in stats struct */
+        rd_kafka_stats_om_vtype_t vtype;
+        double scale;       /**< Conversion to base unit, 0 for none */
+} rd_kafka_stats_om_field_t;
+
+/**
+ * @brief Window metric: a gauge histogram.
+ */
+typedef struct rd_kafka_stats_om_window_s {
+        const char *name;   /**< Metric family name, sans prefix */
+        const char *help;
+        size_t of;          /**< rd_kafka_stats_window_t offset */
+        double scale;       /**< Conversion to base unit */
+        int first, last;    /**< Range of buckets to emit, as
+                             *   rd_avg_bucket_bound() indexes. */
+} rd_kafka_stats_om_window_t;
+
+#define _OM(NAME,TYPE,STRUCT,FIELD,VTYPE,SCALE,HELP)                    \
+        { NAME, TYPE, HELP, offsetof(STRUCT, FIELD), VTYPE, SCALE }
+
+#define _OMW(NAME,STRUCT,FIELD,SCALE,FIRST,LAST,HELP)                   \
+        { NAME, HELP, offsetof(STRUCT, FIELD), SCALE, FIRST, LAST }
+
+static const rd_kafka_stats_om_field_t rd_kafka_stats_om_client[] = {
+        _OM("replyq", "gauge", rd_kafka_stats_t, replyq, _OM_INT, 0,
+            "Ops waiting in queue for the application to serve"),
+        _OM("msg_cnt", "gauge", rd_kafka_stats_t, msg_cnt, _OM_UINT, 0,
+            "Current number of messages in producer queues"),
+        _OM("msg_size_bytes", "gauge", rd_kafka_stats_t, msg_size,
+            _OM_SIZE, 0, "Current total size of messages in producer queues"),
+        _OM("msg_max", "gauge", rd_kafka_stats_t, msg_max, _OM_UINT, 0,
+            "Maximum number of messages allowed on the producer queues"),
+        _OM("msg_size_max_bytes", "gauge", rd_kafka_stats_t, msg_size_max,
+            _OM_SIZE, 0,
+            "Maximum total size of messages allowed on the producer queues"),
+        _OM("simple_cnt", "gauge", rd_kafka_stats_t, simple_cnt, _OM_INT, 0,
+            "Internal tracking of legacy vs new consumer API state"),
+        _OM("metadata_cache_cnt", "gauge", rd_kafka_stats_t,
+            metadata_cache_cnt, _OM_INT, 0,
+            "Number of topics in the metadata cache"),
+        _OM("fetchbuf_pinned_bytes", "gauge", rd_kafka_stats_t,
+            fetchbuf_pinned_bytes, _OM_INT64, 0,
+            "Fetch buffer bytes kept alive by application-held messages"),
+        _OM("fetchbuf_live_bytes", "gauge", rd_kafka_stats_t,
+            fetchbuf_live_bytes, _OM_INT64, 0,
+            "Key and value bytes of the application-held messages"),
+        _OM("fetchbuf_copyout", "counter", rd_kafka_stats_t,
+            fetchbuf_copyout_cnt, _OM_INT64, 0,
+            "Messages copied out of their fetch buffer"),
+        _OM("fetchbuf_copyout_bytes", "counter", rd_kafka_stats_t,
+            fetchbuf_copyout_bytes, _OM_INT64, 0,
+            "Bytes copied out of fetch buffers"),
+        _OM("prefetch_bytes", "gauge", rd_kafka_stats_t, prefetch_bytes,
+            _OM_INT64, 0, "Fetched bytes not yet handed to the application"),
+        _OM("prefetch_inflight_bytes", "gauge", rd_kafka_stats_t,
+            prefetch_inflight_bytes, _OM_INT64, 0,
+            "Response bytes reserved by outstanding Fetch requests"),
+        _OM("prefetch_exhausted", "counter", rd_kafka_stats_t,
+            prefetch_exhausted, _OM_INT64, 0,
+            "Fetch requests held back by the prefetch budget"),
+        _OM("log_drops", "counter", rd_kafka_stats_t, log_drops,
+            _OM_INT64, 0, "Log messages dropped by the asynchronous log ring"),
+        _OM("tx", "counter", rd_kafka_stats_t, tx, _OM_INT64, 0,
+            "Requests sent to Kafka brokers"),
+        _OM("tx_bytes", "counter", rd_kafka_stats_t, tx_bytes, _OM_INT64, 0,
+            "Bytes transmitted to Kafka brokers"),
+        _OM("rx", "counter", rd_kafka_stats_t, rx, _OM_INT64, 0,
+            "Responses received from Kafka brokers"),
+        _OM("rx_bytes", "counter", rd_kafka_stats_t, rx_bytes, _OM_INT64, 0,
+            "Bytes received from Kafka brokers"),
+        _OM("txmsgs", "counter", rd_kafka_stats_t, txmsgs, _OM_INT64, 0,
+            "Messages produced"),
+        _OM("txmsg_bytes", "counter", rd_kafka_stats_t, txmsg_bytes,
+            _OM_INT64, 0, "Message bytes produced"),
+        _OM("rxmsgs", "counter", rd_kafka_stats_t, rxmsgs, _OM_INT64, 0,
+            "Messages consumed"),
+        _OM("rxmsg_bytes", "counter", rd_kafka_stats_t, rxmsg_bytes,
+            _OM_INT64, 0, "Message bytes consumed"),
+        _OM("fatal", "counter", rd_kafka_stats_t, fatal_cnt, _OM_INT, 0,
+            "Fatal errors"),
+};
+
+/* Consumer only */
+static const rd_kafka_stats_om_window_t rd_kafka_stats_om_client_windows[] = {
+        _OMW("poll_gap_seconds", rd_kafka_stats_t, poll_gap, 1e-6, 6, 24,
+             "Time between application poll calls"),
+};
+
+static const rd_kafka_stats_om_field_t rd_kafka_stats_om_broker[] = {
+        _OM("broker_state_age_seconds", "gauge", rd_kafka_stats_broker_t,
+            stateage, _OM_INT64, 1e-6, "Time since last state change"),
+        _OM("broker_outbuf_cnt", "gauge", rd_kafka_stats_broker_t,
+            outbuf_cnt, _OM_INT, 0, "Requests awaiting transmission"),
+        _OM("broker_outbuf_msg_cnt", "gauge", rd_kafka_stats_broker_t,
+            outbuf_msg_cnt, _OM_INT, 0, "Messages awaiting transmission"),
+        _OM("broker_waitresp_cnt", "gauge", rd_kafka_stats_broker_t,
+            waitresp_cnt, _OM_INT, 0, "Requests awaiting response"),
+        _OM("broker_waitresp_msg_cnt", "gauge", rd_kafka_stats_broker_t,
+            waitresp_msg_cnt, _OM_INT, 0, "Messages awaiting response"),
+        _OM("broker_tx", "counter", rd_kafka_stats_broker_t, tx,
+            _OM_UINT64, 0, "Requests sent"),
+        _OM("broker_txbytes", "counter", rd_kafka_stats_broker_t, txbytes,
+            _OM_UINT64, 0, "Bytes sent"),
+        _OM("broker_txerrs", "counter", rd_kafka_stats_broker_t, txerrs,
+            _OM_UINT64, 0, "Transmission errors"),
+        _OM("broker_txretries", "counter", rd_kafka_stats_broker_t,
+            txretries, _OM_UINT64, 0, "Request retries"),
+        _OM("broker_req_timeouts", "counter", rd_kafka_stats_broker_t,
+            req_timeouts, _OM_UINT64, 0, "Requests timed out"),
+        _OM("broker_rx", "counter", rd_kafka_stats_broker_t, rx,
+            _OM_UINT64, 0, "Responses received"),
+        _OM("broker_rxbytes", "counter", rd_kafka_stats_broker_t, rxbytes,
+            _OM_UINT64, 0, "Bytes received"),
+        _OM("broker_rxerrs", "counter", rd_kafka_stats_broker_t, rxerrs,
+            _OM_UINT64, 0, "Receive errors"),
+        _OM("broker_rxcorriderrs", "counter", rd_kafka_stats_broker_t,
+            rxcorriderrs, _OM_UINT64, 0, "Unmatched correlation ids"),
+        _OM("broker_rxpartial", "counter", rd_kafka_stats_broker_t,
+            rxpartial, _OM_UINT64, 0, "Partial MessageSets received"),
+        _OM("broker_zbuf_grow", "counter", rd_kafka_stats_broker_t,
+            zbuf_grow, _OM_UINT64, 0, "Decompression buffer size increases"),
+        _OM("broker_zbuf_pool_hits", "counter", rd_kafka_stats_broker_t,
+            zbuf_pool_hits, _OM_UINT64, 0,
+            "Decompression buffers reused from the pool"),
+        _OM("broker_zbuf_pool_misses", "counter", rd_kafka_stats_broker_t,
+            zbuf_pool_misses, _OM_UINT64, 0,
+            "Decompression buffers allocated"),
+        _OM("broker_zbuf_pool_size_bytes", "gauge", rd_kafka_stats_broker_t,
+            zbuf_pool_size, _OM_SIZE, 0,
+            "Unused decompression buffer bytes held by the pool"),
+        _OM("broker_buf_grow", "counter", rd_kafka_stats_broker_t,
+            buf_grow, _OM_UINT64, 0, "Buffer size increases"),
+        _OM("broker_wakeups", "counter", rd_kafka_stats_broker_t, wakeups,
+            _OM_UINT64, 0, "Broker thread poll wakeups"),
+        _OM("broker_zc_tx", "counter", rd_kafka_stats_broker_t, zc_tx,
+            _OM_UINT64, 0, "Sends performed with MSG_ZEROCOPY"),
+        _OM("broker_zc_tx_copied", "counter", rd_kafka_stats_broker_t,
+            zc_tx_copied, _OM_UINT64, 0,
+            "Zero-copy sends the kernel copied anyway"),
+        _OM("broker_zc_tx_fallback", "counter", rd_kafka_stats_broker_t,
+            zc_tx_fallback, _OM_UINT64, 0,
+            "Zero-copy eligible sends that were copied"),
+        _OM("broker_connects", "counter", rd_kafka_stats_broker_t, connects,
+            _OM_INT, 0, "Connection attempts"),
+        _OM("broker_disconnects", "counter", rd_kafka_stats_broker_t,
+            disconnects, _OM_INT, 0, "Disconnects"),
+        _OM("broker_tls_full_handshakes", "counter", rd_kafka_stats_broker_t,
+            tls_full_handshakes, _OM_INT, 0, "Full TLS handshakes"),
+        _OM("broker_tls_resumed_handshakes", "counter",
+            rd_kafka_stats_broker_t, tls_resumed_handshakes, _OM_INT, 0,
+            "Resumed TLS handshakes"),
+        _OM("broker_resolve_hits", "counter", rd_kafka_stats_broker_t,
+            resolve_hits, _OM_INT, 0,
+            "Address lookups served from the resolver cache"),
+        _OM("broker_resolve_misses", "counter", rd_kafka_stats_broker_t,
+            resolve_misses, _OM_INT, 0,
+            "Address lookups that waited for the resolver"),
+};
+
+static const rd_kafka_stats_om_window_t rd_kafka_stats_om_broker_windows[] = {
+        _OMW("broker_int_latency_seconds", rd_kafka_stats_broker_t,
+             int_latency, 1e-6, 6, 21,
+             "Internal producer queue latency"),
+        _OMW("broker_outbuf_latency_seconds", rd_kafka_stats_broker_t,
+             outbuf_latency, 1e-6, 6, 21,
+             "Internal request queue latency"),
+        _OMW("broker_rtt_seconds", rd_kafka_stats_broker_t, rtt, 1e-6,
+             6, 21, "Broker round-trip time"),
+        _OMW("broker_throttle_seconds", rd_kafka_stats_broker_t, throttle,
+             1e-3, 0, 12, "Broker throttling time"),
+        _OMW("broker_tls_records", rd_kafka_stats_broker_t, tls_records,
+             1, 0, 6, "TLS records written per request"),
+        _OMW("broker_tls_record_size_bytes", rd_kafka_stats_broker_t,
+             tls_record_size, 1, 6, 13, "Plaintext bytes per TLS record"),
+        _OMW("broker_resolve_latency_seconds", rd_kafka_stats_broker_t,
+             resolve_latency, 1e-6, 6, 21,
+             "Broker address resolution latency"),
+};
+
+/* Producer batch stage windows, rendered with an additional "stage" label */
+static const rd_kafka_stats_om_window_t
+rd_kafka_stats_om_broker_produce_latency =
+        _OMW("broker_produce_latency_seconds", rd_kafka_stats_broker_t,
+             produce_latency, 1e-6, 6, 21,
+             "Producer batch latency per stage");
+
+/* Per-request type windows, rendered with an additional "request" label */
+static const rd_kafka_stats_om_window_t rd_kafka_stats_om_req_windows[] = {
+        _OMW("broker_req_rtt_seconds", rd_kafka_stats_req_t, rtt, 1e-6,
+             6, 21, "Broker round-trip time per request type"),
+        _OMW("broker_req_outbuf_latency_seconds", rd_kafka_stats_req_t,
+             outbuf_latency, 1e-6, 6, 21,
+             "Internal request queue latency per request type"),
+};
+
+static const rd_kafka_stats_om_field_t rd_kafka_stats_om_topic[] = {
+        _OM("topic_metadata_age_seconds", "gauge", rd_kafka_stats_topic_t,
+            metadata_age, _OM_INT64, 1e-3, "Age of metadata from broker"),
+};
+
+static const rd_kafka_stats_om_window_t rd_kafka_stats_om_topic_windows[] = {
+        _OMW("topic_batchsize_bytes", rd_kafka_stats_topic_t, batchsize,
+             1, 6, 22, "Batch sizes"),
+        _OMW("topic_batchcnt", rd_kafka_stats_topic_t, batchcnt,
+             1, 0, 15, "Batch message counts"),
+};
+
+static const rd_kafka_stats_om_window_t
+rd_kafka_stats_om_topic_produce_latency =
+        _OMW("topic_produce_latency_seconds", rd_kafka_stats_topic_t,
+             produce_latency, 1e-6, 6, 21,
+             "Producer batch latency per stage");
+
+static const rd_kafka_stats_om_field_t rd_kafka_stats_om_partition[] = {
+        _OM("partition_leader", "gauge", rd_kafka_stats_partition_t,
+            leader, _OM_INT, 0, "Current leader broker id"),
+        _OM("partition_msgq_cnt", "gauge", rd_kafka_stats_partition_t,
+            msgq_cnt, _OM_INT, 0, "Messages waiting to be produced"),
+        _OM("partition_msgq_bytes", "gauge", rd_kafka_stats_partition_t,
+            msgq_bytes, _OM_SIZE, 0, "Bytes waiting to be produced"),
+        _OM("partition_fetchq_cnt", "gauge", rd_kafka_stats_partition_t,
+            fetchq_cnt, _OM_INT, 0, "Pre-fetched messages"),
+        _OM("partition_fetchq_size_bytes", "gauge",
+            rd_kafka_stats_partition_t, fetchq_size, _OM_UINT64, 0,
+            "Pre-fetched bytes"),
+        _OM("partition_fetch_max_bytes", "gauge", rd_kafka_stats_partition_t,
+            fetch_max_bytes, _OM_INT, 0, "Current Fetch MaxBytes"),
+        _OM("partition_consume_rate", "gauge", rd_kafka_stats_partition_t,
+            consume_rate, _OM_INT64, 0, "Consume rate estimate"),
+        _OM("partition_query_offset", "gauge", rd_kafka_stats_partition_t,
+            query_offset, _OM_INT64, 0, "Current/Last logical offset query"),
+        _OM("partition_next_offset", "gauge", rd_kafka_stats_partition_t,
+            next_offset, _OM_INT64, 0, "Next offset to fetch"),
+        _OM("partition_app_offset", "gauge", rd_kafka_stats_partition_t,
+            app_offset, _OM_INT64, 0,
+            "Offset of last message passed to application + 1"),
+        _OM("partition_stored_offset", "gauge", rd_kafka_stats_partition_t,
+            stored_offset, _OM_INT64, 0, "Offset to be committed"),
+        _OM("partition_committed_offset", "gauge",
+            rd_kafka_stats_partition_t, committed_offset, _OM_INT64, 0,
+            "Last committed offset"),
+        _OM("partition_eof_offset", "gauge", rd_kafka_stats_partition_t,
+            eof_offset, _OM_INT64, 0, "Last PARTITION_EOF offset"),
+        _OM("partition_lo_offset", "gauge", rd_kafka_stats_partition_t,
+            lo_offset, _OM_INT64, 0, "Partition's low watermark"),
+        _OM("partition_hi_offset", "gauge", rd_kafka_stats_partition_t,
+            hi_offset, _OM_INT64, 0, "Partition's high watermark"),
+        _OM("partition_consumer_lag", "gauge", rd_kafka_stats_partition_t,
+            consumer_lag, _OM_INT64, 0, "Consumer lag"),
+        _OM("partition_txmsgs", "counter", rd_kafka_stats_partition_t,
+            txmsgs, _OM_UINT64, 0, "Messages produced"),
+        _OM("partition_txbytes", "counter", rd_kafka_stats_partition_t,
+            txbytes, _OM_UINT64, 0, "Message bytes produced"),
+        _OM("partition_rxmsgs", "counter", rd_kafka_stats_partition_t,
+            rxmsgs, _OM_UINT64, 0, "Messages consumed"),
+        _OM("partition_rxbytes", "counter", rd_kafka_stats_partition_t,
+            rxbytes, _OM_UINT64, 0, "Message bytes consumed"),
+        _OM("partition_msgs", "counter", rd_kafka_stats_partition_t,
+            msgs, _OM_UINT64, 0, "Messages produced or consumed"),
+        _OM("partition_rx_ver_drops", "counter", rd_kafka_stats_partition_t,
+            rx_ver_drops, _OM_UINT64, 0, "Dropped outdated messages"),
+        _OM("partition_msgs_inflight", "gauge", rd_kafka_stats_partition_t,
+            msgs_inflight, _OM_INT, 0, "Messages in-flight"),
+        _OM("partition_next_ack_seq", "gauge", rd_kafka_stats_partition_t,
+            next_ack_seq, _OM_INT, 0, "Next expected acked sequence"),
+        _OM("partition_next_err_seq", "gauge", rd_kafka_stats_partition_t,
+            next_err_seq, _OM_INT, 0, "Next expected errored sequence"),
+        _OM("partition_acked_msgid", "gauge", rd_kafka_stats_partition_t,
+            acked_msgid, _OM_UINT64, 0, "Last acked internal message id"),
+};
+
+/* Consumer only */
+static const rd_kafka_stats_om_window_t
+rd_kafka_stats_om_partition_windows[] = {
+        _OMW("partition_e2e_latency_seconds", rd_kafka_stats_partition_t,
+             e2e_latency, 1e-3, 0, 15,
+             "Message timestamp to application latency"),
+        _OMW("partition_fetchq_latency_seconds", rd_kafka_stats_partition_t,
+             fetchq_latency, 1e-6, 6, 21,
+             "FetchResponse to application latency"),
+};
+
+static const rd_kafka_stats_om_field_t rd_kafka_stats_om_cgrp[] = {
+        _OM("cgrp_state_age_seconds", "gauge", rd_kafka_stats_cgrp_t,
+            stateage, _OM_INT64, 1e-3, "Time since last state change"),
+        _OM("cgrp_rebalance_age_seconds", "gauge", rd_kafka_stats_cgrp_t,
+            rebalance_age, _OM_INT64, 1e-3, "Time since last rebalance"),
+        _OM("cgrp_rebalance", "counter", rd_kafka_stats_cgrp_t,
+            rebalance_cnt, _OM_INT, 0, "Rebalances"),
+        _OM("cgrp_assignment_size", "gauge", rd_kafka_stats_cgrp_t,
+            assignment_size, _OM_INT, 0, "Assigned partitions"),
+};
+
+static const rd_kafka_stats_om_field_t rd_kafka_stats_om_eos[] = {
+        _OM("eos_idemp_state_age_seconds", "gauge", rd_kafka_stats_eos_t,
+            idemp_stateage, _OM_INT64, 1e-3, "Time since last state change"),
+        _OM("eos_producer_id", "gauge", rd_kafka_stats_eos_t, producer_id,
+            _OM_INT64, 0, "Current Producer Id"),
+        _OM("eos_producer_epoch", "gauge", rd_kafka_stats_eos_t,
+            producer_epoch, _OM_INT16, 0, "Current Producer Epoch"),
+        _OM("eos_epoch", "counter", rd_kafka_stats_eos_t, epoch_cnt,
+            _OM_INT, 0, "Producer Id assignments"),
+};
+
+
+/**
+ * @brief Write \p val to \p dst escaped as an OpenMetrics label value,
+ *        truncating it to \p size.
+ */
+static void rd_kafka_stats_om_esc (char *dst, size_t size, const char *val) {
+        size_t of = 0;
+
+        for ( ; *val && of + 3 < size ; val++) {
+                if (*val == '\\' || *val == '"') {
+                        dst[of++] = '\\';
+                        dst[of++] = *val;
+                } else if (*val == '\n') {
+                        dst[of++] = '\\';
+                        dst[of++] = 'n';
+                } else
+                        dst[of++] = *val;
+        }
+
+        dst[of] = '\0';
+}
+
+/**
+ * @brief Format the label set of \p base followed by the NULL-terminated
+ *        list of label name, value pairs.
+ */
+static void rd_kafka_stats_om_labels (char *dst, size_t size,
+                                      const char *base, ...) {
+        va_list ap;
+        const char *name;
+        size_t of;
+
+        of = rd_snprintf(dst, size, "%s", base);
+
+        va_start(ap, base);
+        while (of < size && (name = va_arg(ap, const char *))) {
+                char esc[512];
+
+                rd_kafka_stats_om_esc(esc, sizeof(esc),
+                                      va_arg(ap, const char *));
+                of += rd_snprintf(dst+of, size-of, "%s%s=\"%s\"",
+                                  of > 0 ? "," : "", name, esc);
+        }
+        va_end(ap);
+}
+
+/**
+ * @brief Emit the TYPE and HELP lines of a metric family.
+ */
+static void rd_kafka_stats_om_family (struct _stats_emit *st,
+                                      const char *name, const char *type,
+                                      const char *help) {
+        _st_printf("# TYPE rdkafka_%s %s\n"
+                   "# HELP rdkafka_%s %s\n",
+                   name, type, name, help);
+}
+
+/**
+ * @brief Emit sample of field \p f of \p obj.
+ */
+static void rd_kafka_stats_om_sample (struct _stats_emit *st,
+                                      const rd_kafka_stats_om_field_t *f,
+                                      const char *labels, const void *obj) {
+        const char *p = (const char *)obj + f->of;
+        const char *suffix = !strcmp(f->type, "counter") ? "_total" : "";
+        int64_t v;
+
+        switch (f->vtype)
+        {
+        case _OM_INT:
+                v = *(const int *)p;
+                break;
+        case _OM_UINT:
+                v = *(const unsigned int *)p;
+                break;
+        case _OM_INT16:
+                v = *(const int16_t *)p;
+                break;
+        case _OM_INT64:
+                v = *(const int64_t *)p;
+                break;
+        case _OM_UINT64:
+                _st_printf("rdkafka_%s%s{%s} %"PRIu64"\n",
+                           f->name, suffix, labels, *(const uint64_t *)p);
+                return;
+        case _OM_SIZE:
+        default:
+                v = (int64_t)*(const size_t *)p;
+                break;
+        }
+
+        if (f->scale)
+                _st_printf("rdkafka_%s%s{%s} %.9g\n",
+                           f->name, suffix, labels, (double)v * f->scale);
+        else
+                _st_printf("rdkafka_%s%s{%s} %"PRId64"\n",
+                           f->name, suffix, labels, v);
+}
+
+/**
+ * @brief Emit the gauge histogram samples of window \p w.
+ *
+ * The +Inf bucket and gcount are the histogram's total count, including
+ * out of range values, since cnt and the histogram of a window peeked
+ * mid-interval may not agree and +Inf must not be below a finite bucket.
+ */
+static void rd_kafka_stats_om_window (struct _stats_emit *st,
+                                      const rd_kafka_stats_om_window_t *w,
+                                      const char *labels, const void *obj) {
+        const rd_kafka_stats_window_t *win =
+                (const rd_kafka_stats_window_t *)((const char *)obj + w->of);
+        int64_t cnt;
+        int i;
+
+        /* Without a histogram (no HDR support) the buckets are empty
+         * and cnt is the total. */
+        cnt = win->buckets[RD_KAFKA_STATS_WINDOW_BUCKET_CNT-1] +
+                win->outofrange;
+        if (cnt < win->cnt)
+                cnt = win->cnt;
+
+        for (i = w->first ; i <= w->last ; i++)
+                _st_printf("rdkafka_%s_bucket{%s,le=\"%g\"} %"PRId64"\n",
+                           w->name, labels,
+                           (double)rd_avg_bucket_bound(i) * w->scale,
+                           win->buckets[i]);
+
+        _st_printf("rdkafka_%s_bucket{%s,le=\"+Inf\"} %"PRId64"\n"
+                   "rdkafka_%s_gcount{%s} %"PRId64"\n"
+                   "rdkafka_%s_gsum{%s} %.9g\n",
+                   w->name, labels, cnt,
+                   w->name, labels, cnt,
+                   w->name, labels, (double)win->sum * w->scale);
+}
+
+#define _OM_LABELS_SIZE 1024
+
+/**
+ * @brief Emit the gauge histogram samples of the first \p cnt producer
+ *        batch stage windows of array \p w, one series per stage.
+ */
+static void rd_kafka_stats_om_produce_latency (
+        struct _stats_emit *st, const rd_kafka_stats_om_window_t *w,
+        const char *base_labels, const void *obj, int cnt) {
+        char labels[_OM_LABELS_SIZE];
+        int i;
+
+        for (i = 0 ; i < cnt ; i++) {
+                rd_kafka_stats_om_labels(
+                        labels, sizeof(labels), base_labels,
+                        "stage", rd_kafka_stats_produce_stage_names[i],
+                        NULL);
+                /* Offset obj so that w->of points at the i'th window */
+                rd_kafka_stats_om_window(
+                        st, w, labels,
+                        (const char *)obj +
+                        i * sizeof(rd_kafka_stats_window_t));
+        }
+}
+
+
+#define _om_broker_labels(labels,client_labels,b) do {                  \
+                char _nodeid[16];                                       \
+                rd_snprintf(_nodeid, sizeof(_nodeid), "%"PRId32,        \
+                            (b)->nodeid);                               \
+                rd_kafka_stats_om_labels(labels, sizeof(labels),        \
+                                         client_labels,                 \
+                                         "broker", (b)->name,           \
+                                         "nodeid", _nodeid, NULL);      \
+        } while (0)
+
+/* Run STMT for each used request type of each broker, with
+ * `req` and `labels` (including the "request" label) set. */
+#define _om_broker_reqs(STMT) do {                                      \
+                for (i = 0 ; i < stats->broker_cnt ; i++) {             \
+                        const rd_kafka_stats_broker_t *b =              \
+                                &stats->brokers[i];                     \
+                        char bl[_OM_LABELS_SIZE];                       \
+                                                                        \
+                        _om_broker_labels(bl, client_labels, b);        \
+                        for (k = 0 ; k < b->req_cnt ; k++) {            \
+                                const rd_kafka_stats_req_t *req =       \
+                                        &b->reqs[k];                    \
+                                if (!req->cnt && !req->inflight &&      \
+                                    !req->inflight_max)                 \
+                                        continue;                       \
+                                rd_kafka_stats_om_labels(               \
+                                        labels, sizeof(labels), bl,     \
+                                        "request", req->name, NULL);    \
+                                STMT;                                   \
+                        }                                               \
+                }                                                       \
+        } while (0)
+
+#define _om_partition_labels(labels,client_labels,t,p) do {             \
+                char _partition[16];                                    \
+                rd_snprintf(_partition, sizeof(_partition), "%"PRId32,  \
+                            (p)->partition);                            \
+                rd_kafka_stats_om_labels(labels, sizeof(labels),        \
+                                         client_labels,                 \
+                                         "topic", (t)->topic,           \
+                                         "partition", _partition,       \
+                                         NULL);                         \
+        } while (0)
+
+
+/**
+ * @brief Render statistics snapshot in the OpenMetrics text exposition
+ *        format.
+ *
+ * @returns the rd_malloc():ed text, of \p *lenp bytes
+ *          (excluding the nul terminator).
+ */
+char *rd_kafka_stats_to_openmetrics (const rd_kafka_stats_t *stats,
+                                     size_t *lenp) {
+        const rd_kafka_stats_s_t *sts = (const rd_kafka_stats_s_t *)stats;
+        struct _stats_emit stx = { .size = 1024*10 };
+        struct _stats_emit *st = &stx;
+        char client_labels[_OM_LABELS_SIZE];
+        char labels[_OM_LABELS_SIZE];
+        rd_bool_t producer = !strcmp(stats->type, "producer");
+        size_t f;
+        int i, j, k;
+
+        st->buf = rd_malloc(st->size);
+        st->buf[0] = '\0';
+
+        rd_kafka_stats_om_labels(client_labels, sizeof(client_labels), "",
+                                 "client_id", stats->client_id,
+                                 "client", stats->name, NULL);
+
+        /* Client */
+        for (f = 0 ; f < RD_ARRAYSIZE(rd_kafka_stats_om_client) ; f++) {
+                rd_kafka_stats_om_family(st,
+                                         rd_kafka_stats_om_client[f].name,
+                                         rd_kafka_stats_om_client[f].type,
+                                         rd_kafka_stats_om_client[f].help);
+                rd_kafka_stats_om_sample(st, &rd_kafka_stats_om_client[f],
+                                         client_labels, stats);
+        }
+
+        if (!producer && (sts->fields & RD_KAFKA_STATS_F_WINDOW)) {
+                for (f = 0 ;
+                     f < RD_ARRAYSIZE(rd_kafka_stats_om_client_windows) ;
+                     f++) {
+                        const rd_kafka_stats_om_window_t *w =
+                                &rd_kafka_stats_om_client_windows[f];
+
+                        rd_kafka_stats_om_family(st, w->name,
+                                                 "gaugehistogram", w->help);
+                        rd_kafka_stats_om_window(st, w, client_labels,
+                                                 stats);
+                }
+        }
+
+        /* Brokers */
+        rd_kafka_stats_om_family(st, "broker", "info", "Broker state");
+        for (i = 0 ; i < stats->broker_cnt ; i++) {
+                const rd_kafka_stats_broker_t *b = &stats->brokers[i];
+                char nodeid[16];
+
+                rd_snprintf(nodeid, sizeof(nodeid), "%"PRId32, b->nodeid);
+                rd_kafka_stats_om_labels(labels, sizeof(labels),
+                                         client_labels,
+                                         "broker", b->name,
+                                         "nodeid", nodeid,
+                                         "nodename", b->nodename,
+                                         "source", b->source,
+                                         "state", b->state, NULL);
+                _st_printf("rdkafka_broker_info{%s} 1\n", labels);
+        }
+
+        for (f = 0 ; f < RD_ARRAYSIZE(rd_kafka_stats_om_broker) ; f++) {
+                rd_kafka_stats_om_family(st,
+                                         rd_kafka_stats_om_broker[f].name,
+                                         rd_kafka_stats_om_broker[f].type,
+                                         rd_kafka_stats_om_broker[f].help);
+                for (i = 0 ; i < stats->broker_cnt ; i++) {
+                        _om_broker_labels(labels, client_labels,
+                                          &stats->brokers[i]);
+                        rd_kafka_stats_om_sample(
+                                st, &rd_kafka_stats_om_broker[f],
+                                labels, &stats->brokers[i]);
+                }
+        }
+
+        if (sts->fields & RD_KAFKA_STATS_F_REQ) {
+                rd_kafka_stats_om_family(st, "broker_req", "counter",
+                                         "Requests sent per request type");
+                for (i = 0 ; i < stats->broker_cnt ; i++) {
+                        const rd_kafka_stats_broker_t *b =
+                                &stats->brokers[i];
+                        char bl[_OM_LABELS_SIZE];
+
+                        _om_broker_labels(bl, client_labels, b);
+                        for (k = 0 ; k < b->req_cnt ; k++) {
+                                rd_kafka_stats_om_labels(
+                                        labels, sizeof(labels), bl,
+                                        "request", b->reqs[k].name, NULL);
+                                _st_printf("rdkafka_broker_req_total{%s} "
+                                           "%"PRId64"\n",
+                                           labels, b->reqs[k].cnt);
+                        }
+                }
+
+                rd_kafka_stats_om_family(st, "broker_req_inflight", "gauge",
+                                         "Requests awaiting a response "
+                                         "per request type");
+                _om_broker_reqs(_st_printf("rdkafka_broker_req_inflight"
+                                           "{%s} %"PRId32"\n",
+                                           labels, req->inflight));
+
+                rd_kafka_stats_om_family(st, "broker_req_inflight_max",
+                                         "gauge",
+                                         "Maximum requests awaiting a "
+                                         "response per request type since "
+                                         "the previous snapshot");
+                _om_broker_reqs(_st_printf("rdkafka_broker_req_inflight_max"
+                                           "{%s} %"PRId32"\n",
+                                           labels, req->inflight_max));
+
+                for (f = 0 ;
+                     (sts->fields & RD_KAFKA_STATS_F_WINDOW) &&
+                             f < RD_ARRAYSIZE(rd_kafka_stats_om_req_windows) ;
+                     f++) {
+                        const rd_kafka_stats_om_window_t *w =
+                                &rd_kafka_stats_om_req_windows[f];
+
+                        rd_kafka_stats_om_family(st, w->name,
+                                                 "gaugehistogram", w->help);
+                        _om_broker_reqs(rd_kafka_stats_om_window(
+                                                st, w, labels, req));
+                }
+        }
+
+        if (sts->fields & RD_KAFKA_STATS_F_WINDOW) {
+                for (f = 0 ;
+                     f < RD_ARRAYSIZE(rd_kafka_stats_om_broker_windows) ;
+                     f++) {
+                        const rd_kafka_stats_om_window_t *w =
+                                &rd_kafka_stats_om_broker_windows[f];
+
+                        rd_kafka_stats_om_family(st, w->name,
+                                                 "gaugehistogram", w->help);
+                        for (i = 0 ; i < stats->broker_cnt ; i++) {
+                                _om_broker_labels(labels, client_labels,
+                                                  &stats->brokers[i]);
+                                rd_kafka_stats_om_window(
+                                        st, w, labels, &stats->brokers[i]);
+                        }
+                }
+
+                if (producer) {
+                        const rd_kafka_stats_om_window_t *w =
+                                &rd_kafka_stats_om_broker_produce_latency;
+
+                        rd_kafka_stats_om_family(st, w->name,
+                                                 "gaugehistogram", w->help);
+                        for (i = 0 ; i < stats->broker_cnt ; i++) {
+                                _om_broker_labels(labels, client_labels,
+                                                  &stats->brokers[i]);
+                                rd_kafka_stats_om_produce_latency(
+                                        st, w, labels, &stats->brokers[i],
+                                        RD_KAFKA_STATS_PRODUCE_STAGE_DR);
+                        }
+                }
+        }
+
+        /* Topics */
+        for (f = 0 ; f < RD_ARRAYSIZE(rd_kafka_stats_om_topic) ; f++) {
+                rd_kafka_stats_om_family(st,
+                                         rd_kafka_stats_om_topic[f].name,
+                                         rd_kafka_stats_om_topic[f].type,
+                                         rd_kafka_stats_om_topic[f].help);
+                for (i = 0 ; i < stats->topic_cnt ; i++) {
+                        rd_kafka_stats_om_labels(labels, sizeof(labels),
+                                                 client_labels, "topic",
+                                                 stats->topics[i].topic,
+                                                 NULL);
+                        rd_kafka_stats_om_sample(
+                                st, &rd_kafka_stats_om_topic[f],
+                                labels, &stats->topics[i]);
+                }
+        }
+
+        if (sts->fields & RD_KAFKA_STATS_F_WINDOW) {
+                for (f = 0 ;
+                     f < RD_ARRAYSIZE(rd_kafka_stats_om_topic_windows) ;
+                     f++) {
+                        const rd_kafka_stats_om_window_t *w =
+                                &rd_kafka_stats_om_topic_windows[f];
+
+                        rd_kafka_stats_om_family(st, w->name,
+                                                 "gaugehistogram", w->help);
+                        for (i = 0 ; i < stats->topic_cnt ; i++) {
+                                rd_kafka_stats_om_labels(
+                                        labels, sizeof(labels),
+                                        client_labels, "topic",
+                                        stats->topics[i].topic, NULL);
+                                rd_kafka_stats_om_window(
+                                        st, w, labels, &stats->topics[i]);
+                        }
+                }
+
+                if (producer) {
+                        const rd_kafka_stats_om_window_t *w =
+                                &rd_kafka_stats_om_topic_produce_latency;
+
+                        rd_kafka_stats_om_family(st, w->name,
+                                                 "gaugehistogram", w->help);
+                        for (i = 0 ; i < stats->topic_cnt ; i++) {
+                                rd_kafka_stats_om_labels(
+                                        labels, sizeof(labels),
+                                        client_labels, "topic",
+                                        stats->topics[i].topic, NULL);
+                                rd_kafka_stats_om_produce_latency(
+                                        st, w, labels, &stats->topics[i],
+                                        RD_KAFKA_STATS_PRODUCE_STAGE__CNT);
+                        }
+                }
+        }
+
+        /* Partitions */
+        rd_kafka_stats_om_family(st, "partition", "info", "Partition state");
+        for (i = 0 ; i < stats->topic_cnt ; i++) {
+                const rd_kafka_stats_topic_t *t = &stats->topics[i];
+
+                for (j = 0 ; j < t->partition_cnt ; j++) {
+                        const rd_kafka_stats_partition_t *p =
+                                &t->partitions[j];
+                        char pl[_OM_LABELS_SIZE];
+
+                        _om_partition_labels(pl, client_labels, t, p);
+                        rd_kafka_stats_om_labels(
+                                labels, sizeof(labels), pl,
+                                "fetch_state", p->fetch_state,
+                                "desired", p->desired ? "true" : "false",
+                                "unknown", p->unknown ? "true" : "false",
+                                NULL);
+                        _st_printf("rdkafka_partition_info{%s} 1\n", labels);
+                }
+        }
+
+        for (f = 0 ; f < RD_ARRAYSIZE(rd_kafka_stats_om_partition) ; f++) {
+                rd_kafka_stats_om_family(
+                        st, rd_kafka_stats_om_partition[f].name,
+                        rd_kafka_stats_om_partition[f].type,
+                        rd_kafka_stats_om_partition[f].help);
+                for (i = 0 ; i < stats->topic_cnt ; i++) {
+                        const rd_kafka_stats_topic_t *t = &stats->topics[i];
+
+                        for (j = 0 ; j < t->partition_cnt ; j++) {
+                                _om_partition_labels(labels, client_labels,
+                                                     t, &t->partitions[j]);
+                                rd_kafka_stats_om_sample(
+                                        st, &rd_kafka_stats_om_partition[f],
+                                        labels, &t->partitions[j]);
+                        }
+                }
+        }
+
+        if (!producer && (sts->fields & RD_KAFKA_STATS_F_WINDOW)) {
+                for (f = 0 ;
+                     f < RD_ARRAYSIZE(rd_kafka_stats_om_partition_windows) ;
+                     f++) {
+                        const rd_kafka_stats_om_window_t *w =
+                                &rd_kafka_stats_om_partition_windows[f];
+
+                        rd_kafka_stats_om_family(st, w->name,
+                                                 "gaugehistogram", w->help);
+                        for (i = 0 ; i < stats->topic_cnt ; i++) {
+                                const rd_kafka_stats_topic_t *t =
+                                        &stats->topics[i];
+
+                                for (j = 0 ; j < t->partition_cnt ; j++) {
+                                        _om_partition_labels(
+                                                labels, client_labels,
+                                                t, &t->partitions[j]);
+                                        rd_kafka_stats_om_window(
+                                                st, w, labels,
+                                                &t->partitions[j]);
+                                }
+                        }
+                }
+        }
+
+        /* Consumer group */
+        if (stats->cgrp) {
+                rd_kafka_stats_om_family(st, "cgrp", "info",
+                                         "Consumer group state");
+                rd_kafka_stats_om_labels(labels, sizeof(labels),
+                                         client_labels,
+                                         "state", stats->cgrp->state,
+                                         "join_state",
+                                         stats->cgrp->join_state, NULL);
+                _st_printf("rdkafka_cgrp_info{%s} 1\n", labels);
+
+                for (f = 0 ; f < RD_ARRAYSIZE(rd_kafka_stats_om_cgrp) ; f++) {
+                        rd_kafka_stats_om_family(
+                                st, rd_kafka_stats_om_cgrp[f].name,
+                                rd_kafka_stats_om_cgrp[f].type,
+                                rd_kafka_stats_om_cgrp[f].help);
+                        rd_kafka_stats_om_sample(st,
+                                                 &rd_kafka_stats_om_cgrp[f],
+                                                 client_labels, stats->cgrp);
+                }
+        }
+
+        /* Idempotent producer */
+        if (stats->eos) {
+                rd_kafka_stats_om_family(st, "eos", "info",
+                                         "Idempotent producer state");
+                rd_kafka_stats_om_labels(labels, sizeof(labels),
+                                         client_labels,
+                                         "idemp_state",
+                                         stats->eos->idemp_state, NULL);
+                _st_printf("rdkafka_eos_info{%s} 1\n", labels);
+
+                for (f = 0 ; f < RD_ARRAYSIZE(rd_kafka_stats_om_eos) ; f++) {
+                        rd_kafka_stats_om_family(
+                                st, rd_kafka_stats_om_eos[f].name,
+                                rd_kafka_stats_om_eos[f].type,
+                                rd_kafka_stats_om_eos[f].help);
+                        rd_kafka_stats_om_sample(st,
+                                                 &rd_kafka_stats_om_eos[f],
+                                                 client_labels, stats->eos);
+                }
+        }
+
+        _st_printf("# EOF\n");
+
+        *lenp = st->of;
+        return st->buf;
+}
+
+
+char *rd_kafka_stats_openmetrics (const rd_kafka_stats_t *stats,
+                                  size_t *lenp) {
+        size_t len;
+        char *buf = rd_kafka_stats_to_openmetrics(stats, &len);
+
+        if (lenp)
+                *lenp = len;
+        return buf;
+}
+
+/**@}*/
+
+
+/**
+ * @brief Emit all statistics to the application's stats_cb.
+ *
+ * @locality rdkafka main thread
+ * @locks none
+ */
+void rd_kafka_stats_emit_all (rd_kafka_t *rk) {
+        rd_kafka_stats_t *stats;
+	rd_kafka_op_t *rko;
+
+        /* Delta emission is only defined for JSON */
+        stats = rd_kafka_stats_new(rk, rk->rk_conf.stats_delta &&
+                                   rk->rk_conf.stats_format ==
+                                   RD_KAFKA_STATS_FORMAT_JSON,
+                                   rd_true/*rollover*/);
+
+	/* Enqueue op for application */
+	rko = rd_kafka_op_new(RD_KAFKA_OP_STATS);
+        rd_kafka_op_set_prio(rko, RD_KAFKA_PRIO_HIGH);
+        if (rk->rk_conf.stats_format == RD_KAFKA_STATS_FORMAT_OPENMETRICS)
+                rko->rko_u.stats.json = rd_kafka_stats_to_openmetrics(
+                        stats, &rko->rko_u.stats.json_len);
+        else
+                rko->rko_u.stats.json = rd_kafka_stats_to_json(
+                        stats, &rko->rko_u.stats.json_len);
+	rd_kafka_q_enq(rk->rk_rep, rko);
+
+        rd_kafka_stats_destroy(stats);
+}
+
+
+
+/**
+ * @brief Create a client of \p type for the stats unit tests, configured
+ *        with the NULL-terminated list of property name and value pairs,
+ *        with broker 1 (127.0.0.1:19091, which is never connected to)
+ *        added to it.
+ *
+ * @returns the client, or NULL on failure.
+ */
+static rd_kafka_t *ut_stats_client_new (rd_kafka_type_t type, ...) {
+        struct rd_kafka_metadata_broker mdb = {
+                .id = 1, .host = "127.0.0.1", .port = 19091 };
+        rd_kafka_conf_t *conf;
+        rd_kafka_t *rk;
+        const char *name;
+        char errstr[256];
+        va_list ap;
+
+        conf = rd_kafka_conf_new();
+
+        va_start(ap, type);
+        while ((name = va_arg(ap, const char *))) {
+                const char *value = va_arg(ap, const char *);
+
+                if (rd_kafka_conf_set(conf, name, value,
+                                      errstr, sizeof(errstr)) !=
+                    RD_KAFKA_CONF_OK) {
+                        RD_UT_WARN("%s=%s: %s", name, value, errstr);
+                        va_end(ap);
+                        rd_kafka_conf_destroy(conf);
+                        return NULL;
+                }
+        }
+        va_end(ap);
+
+        rk = rd_kafka_new(type, conf, errstr, sizeof(errstr));
+        if (!rk) {
+                RD_UT_WARN("failed to create %s: %s",
+                           rd_kafka_type2str(type), errstr);
+                return NULL;
+        }
+
+        rd_kafka_broker_update(rk, RD_KAFKA_PROTO_PLAINTEXT, &mdb);
+
+        return rk;
+}
+
+/**
+ * @returns the broker \p nodeid of \p stats, or NULL if not found.
+ */
+static const rd_kafka_stats_broker_t *
+ut_stats_find_broker (const rd_kafka_stats_t *stats, int32_t nodeid) {
+        int i;
+
+        for (i = 0 ; i < stats->broker_cnt ; i++)
+                if (stats->brokers[i].nodeid == nodeid)
+                        return &stats->brokers[i];
+
+        return NULL;
+}
+
+/**
+ * @returns the topic \p topic of \p stats, or NULL if not found.
+ */
+static const rd_kafka_stats_topic_t *
+ut_stats_find_topic (const rd_kafka_stats_t *stats, const char *topic) {
+        int i;
+
+        for (i = 0 ; i < stats->topic_cnt ; i++)
+                if (!strcmp(stats->topics[i].topic, topic))
+                        return &stats->topics[i];
+
+        return NULL;
+}
+
+
+/**
+ * @brief Snapshot a producer with one broker and a topic with more
+ *        partitions than fit in one arena chunk, and render it.
+ */
+static int unittest_stats_snapshot (void) {
+        rd_kafka_t *rk;
+        const rd_kafka_stats_t *stats;
+        const rd_kafka_stats_broker_t *b;
+        const rd_kafka_stats_topic_t *t;
+        shptr_rd_kafka_toppar_t *s_rktp;
+        char *json;
+        size_t len;
+        int32_t partition;
+        int i;
+
+        rk = ut_stats_client_new(RD_KAFKA_PRODUCER,
+                                 "client.id", "ut_stats", NULL);
+        RD_UT_ASSERT(rk, "failed to create producer");
+
+        for (partition = 0 ; partition < 100 ; partition++) {
+                s_rktp = rd_kafka_toppar_get2(rk, "ut_stats", partition,
+                                              0, 1);
+                rd_kafka_toppar_destroy(s_rktp);
+        }
+
+        RD_UT_ASSERT(rd_kafka_stats_snapshot(rk, RD_KAFKA_STATS_VERSION + 1,
+                                             &stats) ==
+                     RD_KAFKA_RESP_ERR__INVALID_ARG && !stats,
+                     "expected unsupported version to fail");
+        RD_UT_ASSERT(!rd_kafka_stats_snapshot(rk, RD_KAFKA_STATS_VERSION,
+                                              &stats),
+                     "snapshot failed");
+
+        RD_UT_ASSERT(stats->version == RD_KAFKA_STATS_VERSION,
+                     "expected version %d, not %d",
+                     RD_KAFKA_STATS_VERSION, stats->version);
+        RD_UT_ASSERT(!strcmp(stats->client_id, "ut_stats"),
+                     "expected client_id ut_stats, not %s",
+                     stats->client_id);
+        RD_UT_ASSERT(!strcmp(stats->type, "producer"),
+                     "expected producer, not %s", stats->type);
+        RD_UT_ASSERT(!stats->cgrp, "expected no cgrp");
+
+        b = ut_stats_find_broker(stats, 1);
+        RD_UT_ASSERT(b, "broker 1 not in snapshot");
+        RD_UT_ASSERT(!strcmp(b->nodename, "127.0.0.1:19091"),
+                     "unexpected nodename %s", b->nodename);
+
+        t = ut_stats_find_topic(stats, "ut_stats");
+        RD_UT_ASSERT(t, "topic not in snapshot");
+        /* The partitions are desired partitions, no partition count
+         * is known from metadata. */
+        RD_UT_ASSERT(t->partition_cnt == 100 + 1/*UA*/,
+                     "expected 101 partitions, not %d", t->partition_cnt);
+        for (i = 0 ; i < 100 ; i++)
+                RD_UT_ASSERT(t->partitions[i].desired &&
+                             t->partitions[i].leader == -1 &&
+                             t->partitions[i].consumer_lag == -1,
+                             "unexpected stats for partition %"PRId32,
+                             t->partitions[i].partition);
+        RD_UT_ASSERT(t->partitions[100].partition == RD_KAFKA_PARTITION_UA,
+                     "expected UA partition last, not %"PRId32,
+                     t->partitions[100].partition);
+
+        json = rd_kafka_stats_to_json(stats, &len);
+        RD_UT_ASSERT(len == strlen(json), "json length mismatch");
+        RD_UT_ASSERT(json[0] == '{' && json[len-1] == '}',
+                     "json not an object: %s", json);
+        RD_UT_ASSERT(strstr(json, "\"ut_stats-99\": { "
+                            "\"topic\":\"ut_stats\", "
+                            "\"partition\":99} ") == NULL,
+                     "unassigned partition listed on broker");
+        RD_UT_ASSERT(strstr(json, "\"99\": { \"partition\":99, "
+                            "\"leader\":-1, \"desired\":true"),
+                     "partition 99 not in json: %s", json);
+        rd_free(json);
+
+        rd_kafka_stats_destroy(stats);
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Delta snapshots only contain changed partitions.
+ */
+static int unittest_stats_delta (void) {
+        rd_kafka_t *rk;
+        rd_kafka_stats_t *stats;
+        shptr_rd_kafka_toppar_t *s_rktp;
+        rd_kafka_toppar_t *rktp;
+        const rd_kafka_stats_topic_t *t;
+        int32_t partition;
+
+        rk = ut_stats_client_new(RD_KAFKA_PRODUCER, NULL);
+        RD_UT_ASSERT(rk, "failed to create producer");
+
+        for (partition = 0 ; partition < 10 ; partition++) {
+                s_rktp = rd_kafka_toppar_get2(rk, "ut_delta", partition,
+                                              0, 1);
+                rd_kafka_toppar_destroy(s_rktp);
+        }
+
+        /* The first delta snapshot is complete */
+        stats = rd_kafka_stats_new(rk, rd_true, rd_true);
+        RD_UT_ASSERT(stats->topic_cnt == 1 &&
+                     stats->topics[0].partition_cnt == 10 + 1/*UA*/,
+                     "expected 1 topic with 11 partitions, not %d topics",
+                     stats->topic_cnt);
+        rd_kafka_stats_destroy(stats);
+
+        /* Nothing changed */
+        stats = rd_kafka_stats_new(rk, rd_true, rd_true);
+        RD_UT_ASSERT(stats->topic_cnt == 0,
+                     "expected no topics, not %d", stats->topic_cnt);
+        rd_kafka_stats_destroy(stats);
+
+        s_rktp = rd_kafka_toppar_get2(rk, "ut_delta", 7, 0, 0);
+        rktp = rd_kafka_toppar_s2i(s_rktp);
+        rd_kafka_toppar_lock(rktp);
+        rktp->rktp_lo_offset = 1234;
+        rd_kafka_toppar_unlock(rktp);
+        rd_kafka_toppar_destroy(s_rktp);
+
+        /* A non-delta snapshot does not affect the delta state */
+        stats = rd_kafka_stats_new(rk, rd_false, rd_false);
+        RD_UT_ASSERT(stats->topic_cnt == 1 &&
+                     stats->topics[0].partition_cnt == 11,
+                     "expected complete snapshot");
+        rd_kafka_stats_destroy(stats);
+
+        stats = rd_kafka_stats_new(rk, rd_true, rd_true);
+        RD_UT_ASSERT(stats->topic_cnt == 1, "expected 1 topic, not %d",
+                     stats->topic_cnt);
+        t = &stats->topics[0];
+        RD_UT_ASSERT(t->partition_cnt == 1 &&
+                     t->partitions[0].partition == 7 &&
+                     t->partitions[0].lo_offset == 1234,
+                     "expected only partition 7, not %d partitions",
+                     t->partition_cnt);
+        rd_kafka_stats_destroy(stats);
+
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Field groups and topic filters.
+ */
+static int unittest_stats_filter (void) {
+        rd_kafka_t *rk;
+        rd_kafka_stats_t *stats;
+        shptr_rd_kafka_toppar_t *s_rktp;
+        char *json;
+        size_t len;
+
+        rk = ut_stats_client_new(RD_KAFKA_PRODUCER,
+                                 "statistics.fields",
+                                 "all,-partition,-window,-toppars",
+                                 "statistics.topic.exclude", "^ut_excl",
+                                 NULL);
+        RD_UT_ASSERT(rk, "failed to create producer");
+
+        s_rktp = rd_kafka_toppar_get2(rk, "ut_incl", 0, 0, 1);
+        rd_kafka_toppar_destroy(s_rktp);
+        s_rktp = rd_kafka_toppar_get2(rk, "ut_excluded", 0, 0, 1);
+        rd_kafka_toppar_destroy(s_rktp);
+
+        stats = rd_kafka_stats_new(rk, rd_false, rd_false);
+        RD_UT_ASSERT(stats->topic_cnt == 1 &&
+                     !strcmp(stats->topics[0].topic, "ut_incl"),
+                     "expected only topic ut_incl, not %d topics",
+                     stats->topic_cnt);
+        RD_UT_ASSERT(stats->broker_cnt > 0, "expected brokers");
+
+        json = rd_kafka_stats_to_json(stats, &len);
+        RD_UT_ASSERT(!strstr(json, "\"partitions\"") &&
+                     !strstr(json, "\"rtt\"") &&
+                     !strstr(json, "\"toppars\"") &&
+                     !strstr(json, "ut_excluded") &&
+                     strstr(json, "\"req\""),
+                     "unexpected json: %s", json);
+        RD_UT_ASSERT(strstr(json, "\"metadata_age\":0 } "),
+                     "topic not closed: %s", json);
+        rd_free(json);
+        rd_kafka_stats_destroy(stats);
+
+        rd_kafka_destroy(rk);
+
+        /* A lone exclusion applies to the default of all groups */
+        rk = ut_stats_client_new(RD_KAFKA_PRODUCER,
+                                 "statistics.fields", "-window", NULL);
+        RD_UT_ASSERT(rk, "failed to create producer");
+        RD_UT_ASSERT(rk->rk_conf.stats_fields ==
+                     (RD_KAFKA_STATS_F_ALL & ~RD_KAFKA_STATS_F_WINDOW),
+                     "expected all groups but window, not 0x%x",
+                     rk->rk_conf.stats_fields);
+
+        s_rktp = rd_kafka_toppar_get2(rk, "ut_incl", 0, 0, 1);
+        rd_kafka_toppar_destroy(s_rktp);
+
+        stats = rd_kafka_stats_new(rk, rd_false, rd_false);
+        json = rd_kafka_stats_to_json(stats, &len);
+        RD_UT_ASSERT(!strstr(json, "\"rtt\"") &&
+                     strstr(json, "\"partitions\"") &&
+                     strstr(json, "\"toppars\"") &&
+                     strstr(json, "\"req\""),
+                     "unexpected json: %s", json);
+        rd_free(json);
+        rd_kafka_stats_destroy(stats);
+
+        rd_kafka_destroy(rk);
+
+        /* Excluding all groups leaves only the top-level fields */
+        rk = ut_stats_client_new(RD_KAFKA_PRODUCER,
+                                 "statistics.fields", "-all", NULL);
+        RD_UT_ASSERT(rk, "failed to create producer");
+
+        stats = rd_kafka_stats_new(rk, rd_false, rd_false);
+        RD_UT_ASSERT(stats->broker_cnt == 0,
+                     "expected no brokers, not %d", stats->broker_cnt);
+        rd_kafka_stats_destroy(stats);
+
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Verify the OpenMetrics rendering of a snapshot.
+ */
+static int unittest_stats_openmetrics (void) {
+        rd_kafka_t *rk;
+        rd_kafka_stats_t *stats;
+        shptr_rd_kafka_toppar_t *s_rktp;
+        char *om;
+        const char *s;
+        size_t len;
+        int i, j, rtt_cnt = 0;
+
+        RD_UT_ASSERT(RD_KAFKA_STATS_WINDOW_BUCKET_CNT == RD_AVG_BUCKET_CNT,
+                     "bucket count mismatch");
+
+        rk = ut_stats_client_new(RD_KAFKA_PRODUCER,
+                                 "client.id", "ut\"om", NULL);
+        RD_UT_ASSERT(rk, "failed to create producer");
+
+        s_rktp = rd_kafka_toppar_get2(rk, "ut_om", 3, 0, 1);
+        rd_kafka_toppar_destroy(s_rktp);
+
+        stats = rd_kafka_stats_new(rk, rd_false, rd_false);
+        om = rd_kafka_stats_to_openmetrics(stats, &len);
+        RD_UT_ASSERT(len == strlen(om), "len %"PRIusz" != %"PRIusz,
+                     len, strlen(om));
+        RD_UT_ASSERT(strstr(om, "# TYPE rdkafka_broker_rtt_seconds "
+                            "gaugehistogram\n") &&
+                     strstr(om, "le=\"+Inf\"} 0\n") &&
+                     strstr(om, "rdkafka_broker_rtt_seconds_gcount{") &&
+                     strstr(om, "rdkafka_broker_tx_total{") &&
+                     strstr(om, "client_id=\"ut\\\"om\"") &&
+                     strstr(om, "topic=\"ut_om\",partition=\"3\"") &&
+                     strstr(om, "rdkafka_eos_info") == NULL,
+                     "unexpected openmetrics: %s", om);
+        RD_UT_ASSERT(len > 6 && !strcmp(om + len - 6, "# EOF\n"),
+                     "missing # EOF terminator");
+        rd_free(om);
+
+        /* A window whose cnt lags its histogram, as seen by a peek
+         * racing samples: +Inf and gcount must cover every bucket. */
+        for (i = 0 ; i < stats->broker_cnt ; i++) {
+                rd_kafka_stats_window_t *win =
+                        &((rd_kafka_stats_broker_t *)stats->brokers)[i].rtt;
+                win->cnt = 1;
+                for (j = 5 ; j < RD_KAFKA_STATS_WINDOW_BUCKET_CNT ; j++)
+                        win->buckets[j] = 2;
+                win->outofrange = 1;
+        }
+
+        om = rd_kafka_stats_to_openmetrics(stats, &len);
+        for (s = om ; (s = strstr(s, "le=\"+Inf\"} 3\n"
+                                  "rdkafka_broker_rtt_seconds_gcount{")) ;
+             s++) {
+                RD_UT_ASSERT(!strncmp(strchr(s + 10, '}'), "} 3\n", 4),
+                             "expected gcount of 3: %s", om);
+                rtt_cnt++;
+        }
+        RD_UT_ASSERT(rtt_cnt == stats->broker_cnt && rtt_cnt > 0,
+                     "expected %d broker rtt windows, not %d: %s",
+                     stats->broker_cnt, rtt_cnt, om);
+        rd_free(om);
+        rd_kafka_stats_destroy(stats);
+
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Producer batch stages are sampled per broker and topic and
+ *        rendered as produce_latency windows.
+ */
+static int unittest_stats_produce_latency (void) {
+        rd_kafka_t *rk;
+        rd_kafka_pid_t pid = RD_KAFKA_PID_INITIALIZER;
+        rd_kafka_broker_t *rkb;
+        shptr_rd_kafka_toppar_t *s_rktp;
+        rd_kafka_toppar_t *rktp;
+        rd_kafka_msgbatch_t batch;
+        rd_kafka_op_t *rko;
+        const rd_kafka_stats_t *stats;
+        const rd_kafka_stats_broker_t *b;
+        const rd_kafka_stats_topic_t *t;
+        char *json;
+        size_t len;
+        int i;
+
+        rk = ut_stats_client_new(RD_KAFKA_PRODUCER,
+                                 "statistics.interval.ms", "60000", NULL);
+        RD_UT_ASSERT(rk, "failed to create producer");
+
+        rkb = rd_kafka_broker_find_by_nodeid(rk, 1);
+        RD_UT_ASSERT(rkb, "broker 1 not found");
+
+        s_rktp = rd_kafka_toppar_get2(rk, "ut_produce_latency", 0, 0, 1);
+        rktp = rd_kafka_toppar_s2i(s_rktp);
+
+        rd_kafka_msgbatch_init(&batch, rktp, pid);
+        batch.ts_enq = rd_clock() - 1000;
+
+        /* No compression: the compress stage is skipped and the send
+         * stage spans both. */
+        rd_kafka_msgbatch_stage(&batch, rkb,
+                                RD_KAFKA_STATS_PRODUCE_STAGE_LINGER);
+        rd_kafka_msgbatch_stage(&batch, rkb,
+                                RD_KAFKA_STATS_PRODUCE_STAGE_SEND);
+        rd_kafka_msgbatch_stage(&batch, rkb,
+                                RD_KAFKA_STATS_PRODUCE_STAGE_BROKER);
+        rd_kafka_msgbatch_stage(&batch, rkb,
+                                RD_KAFKA_STATS_PRODUCE_STAGE_RESPONSE);
+
+        rko = rd_kafka_op_new(RD_KAFKA_OP_DR);
+        rko->rko_u.dr.s_rkt = rd_kafka_topic_keep(rktp->rktp_rkt);
+        rd_kafka_msgq_init(&rko->rko_u.dr.msgq);
+        rko->rko_u.dr.ts_batch_enq = batch.ts_enq;
+        rko->rko_u.dr.ts_enq =
+                batch.ts_stage[RD_KAFKA_STATS_PRODUCE_STAGE_RESPONSE];
+        rd_kafka_dr_served(rko);
+        rd_kafka_dr_served(rko); /* Sampled once */
+        rd_kafka_op_destroy(rko);
+
+        rd_kafka_msgbatch_destroy(&batch);
+        rd_kafka_toppar_destroy(s_rktp);
+        rd_kafka_broker_destroy(rkb);
+
+        RD_UT_ASSERT(!rd_kafka_stats_snapshot(rk, RD_KAFKA_STATS_VERSION,
+                                              &stats),
+                     "snapshot failed");
+
+        b = ut_stats_find_broker(stats, 1);
+        t = ut_stats_find_topic(stats, "ut_produce_latency");
+        RD_UT_ASSERT(b && t, "broker or topic not in snapshot");
+
+        for (i = 0 ; i < RD_KAFKA_STATS_PRODUCE_STAGE__CNT ; i++) {
+                int exp = i != RD_KAFKA_STATS_PRODUCE_STAGE_COMPRESS;
+
+                RD_UT_ASSERT(t->produce_latency[i].cnt == exp,
+                             "topic stage %s: expected %d samples, not %d",
+                             rd_kafka_stats_produce_stage_names[i], exp,
+                             t->produce_latency[i].cnt);
+                if (i < RD_KAFKA_STATS_PRODUCE_STAGE_DR)
+                        RD_UT_ASSERT(b->produce_latency[i].cnt == exp,
+                                     "broker stage %s: expected %d samples, "
+                                     "not %d",
+                                     rd_kafka_stats_produce_stage_names[i],
+                                     exp, b->produce_latency[i].cnt);
+        }
+        RD_UT_ASSERT(t->produce_latency[RD_KAFKA_STATS_PRODUCE_STAGE_TOTAL].
+                     min >= 1000,
+                     "expected total latency >= 1000us, not %"PRId64,
+                     t->produce_latency[RD_KAFKA_STATS_PRODUCE_STAGE_TOTAL].
+                     min);
+
+        json = rd_kafka_stats_to_json(stats, &len);
+        RD_UT_ASSERT(strstr(json, "\"produce_latency\": { \"linger\": {"),
+                     "produce_latency not in json: %s", json);
+        rd_free(json);
+
+        rd_kafka_stats_destroy(stats);
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Consumed messages sample the partition's end-to-end and fetch
+ *        queue latencies, and application polls the poll gap.
+ */
+static int unittest_stats_consumer_latency (void) {
+        rd_kafka_t *rk;
+        shptr_rd_kafka_toppar_t *s_rktp;
+        rd_kafka_toppar_t *rktp;
+        rd_kafka_buf_t *rkbuf;
+        rd_kafka_op_t *rko;
+        rd_kafka_msg_t *rkm;
+        rd_kafka_message_t *rkmessage;
+        const rd_kafka_stats_t *stats;
+        rd_kafka_stats_t *emitted;
+        const rd_kafka_stats_topic_t *t;
+        const rd_kafka_stats_partition_t *p;
+        char *buf, *json;
+        size_t len;
+
+        rk = ut_stats_client_new(RD_KAFKA_CONSUMER,
+                                 "statistics.interval.ms", "60000", NULL);
+        RD_UT_ASSERT(rk, "failed to create consumer");
+
+        s_rktp = rd_kafka_toppar_get2(rk, "ut_consumer_latency", 0, 0, 1);
+        rktp = rd_kafka_toppar_s2i(s_rktp);
+
+        buf = rd_malloc(100);
+        memset(buf, 'a', 100);
+        rkbuf = rd_kafka_buf_new_shadow(buf, 100, rd_free);
+        rko = rd_kafka_op_new_fetch_msg(&rkm, rktp, 0, rkbuf, 0,
+                                        0, NULL, 100, buf);
+        rd_kafka_buf_destroy(rkbuf);
+
+        /* Produced 5s ago, fetched 2ms ago */
+        rkm->rkm_tstype = RD_KAFKA_TIMESTAMP_CREATE_TIME;
+        rkm->rkm_timestamp = (rd_uclock() / 1000) - 5000;
+        rkm->rkm_ts_fetch = rd_clock() - 2000;
+
+        rd_kafka_app_polled(rk);
+        rkmessage = rd_kafka_message_get(rko);
+        RD_UT_ASSERT(rd_kafka_message_latency(rkmessage) >= 2000,
+                     "expected message latency >= 2000us, not %"PRId64,
+                     rd_kafka_message_latency(rkmessage));
+        rd_kafka_message_destroy(rkmessage);
+        rd_kafka_app_polled(rk);
+
+        rd_kafka_toppar_destroy(s_rktp);
+
+        RD_UT_ASSERT(!rd_kafka_stats_snapshot(rk, RD_KAFKA_STATS_VERSION,
+                                              &stats),
+                     "snapshot failed");
+
+        RD_UT_ASSERT(stats->poll_gap.cnt == 2,
+                     "expected 2 poll gaps, not %d", stats->poll_gap.cnt);
+
+        t = ut_stats_find_topic(stats, "ut_consumer_latency");
+        RD_UT_ASSERT(t && t->partition_cnt > 0, "topic not in snapshot");
+        p = &t->partitions[0];
+        RD_UT_ASSERT(p->partition == 0, "partition not in snapshot");
+
+        RD_UT_ASSERT(p->e2e_latency.cnt == 1 &&
+                     p->e2e_latency.min >= 5000 &&
+                     p->e2e_latency.min < 60*1000,
+                     "expected one e2e latency of about 5000ms, "
+                     "not %d of %"PRId64,
+                     p->e2e_latency.cnt, p->e2e_latency.min);
+        RD_UT_ASSERT(p->fetchq_latency.cnt == 1 &&
+                     p->fetchq_latency.min >= 2000,
+                     "expected one fetchq latency >= 2000us, "
+                     "not %d of %"PRId64,
+                     p->fetchq_latency.cnt, p->fetchq_latency.min);
+
+        json = rd_kafka_stats_to_json(stats, &len);
+        RD_UT_ASSERT(strstr(json, "\"poll_gap\": {") &&
+                     strstr(json, "\"e2e_latency\": {") &&
+                     strstr(json, "\"fetchq_latency\": {"),
+                     "consumer windows not in json: %s", json);
+        rd_free(json);
+
+        rd_kafka_stats_destroy(stats);
+
+        /* Snapshots do not reset the windows, only emissions do */
+        RD_UT_ASSERT(!rd_kafka_stats_snapshot(rk, RD_KAFKA_STATS_VERSION,
+                                              &stats),
+                     "snapshot failed");
+        RD_UT_ASSERT(stats->poll_gap.cnt == 2,
+                     "expected 2 poll gaps after snapshot, not %d",
+                     stats->poll_gap.cnt);
+        rd_kafka_stats_destroy(stats);
+
+        emitted = rd_kafka_stats_new(rk, rd_false, rd_true/*rollover*/);
+        RD_UT_ASSERT(emitted->poll_gap.cnt == 2,
+                     "expected 2 emitted poll gaps, not %d",
+                     emitted->poll_gap.cnt);
+        rd_kafka_stats_destroy(emitted);
+
+        RD_UT_ASSERT(!rd_kafka_stats_snapshot(rk, RD_KAFKA_STATS_VERSION,
+                                              &stats),
+                     "snapshot failed");
+        RD_UT_ASSERT(stats->poll_gap.cnt == 0,
+                     "expected no poll gaps after emission, not %d",
+                     stats->poll_gap.cnt);
+        t = ut_stats_find_topic(stats, "ut_consumer_latency");
+        RD_UT_ASSERT(t && t->partitions[0].e2e_latency.cnt == 0,
+                     "expected e2e latency window to be reset");
+        rd_kafka_stats_destroy(stats);
+
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Per request type in-flight counts follow the buffers between
+ *        queues, and the high watermark is reset by each emission,
+ *        but not by snapshots.
+ */
+static int unittest_stats_req_inflight (void) {
+        /* Public snapshot, emission, public snapshot */
+        static const rd_bool_t rollover[] = { rd_false, rd_true, rd_false };
+        static const int32_t exp_max[] = { 3, 3, 2 };
+        rd_kafka_t *rk;
+        rd_kafka_broker_t *rkb;
+        rd_kafka_bufq_t waitresps, retrybufs;
+        rd_kafka_bufq_reqcnt_t *reqcnt;
+        rd_kafka_buf_t *rkbuf[3];
+        const rd_kafka_stats_t *stats;
+        const rd_kafka_stats_broker_t *b;
+        const rd_kafka_stats_req_t *req;
+        char *json;
+        size_t len;
+        int i, pass;
+
+        rk = ut_stats_client_new(RD_KAFKA_PRODUCER,
+                                 "statistics.interval.ms", "60000", NULL);
+        RD_UT_ASSERT(rk, "failed to create producer");
+
+        rkb = rd_kafka_broker_find_by_nodeid(rk, 1);
+        RD_UT_ASSERT(rkb, "broker 1 not found");
+        reqcnt = &rkb->rkb_waitresps_reqcnt;
+
+        /* Stand-in for the broker thread's wait-response queue, sharing
+         * its counts, while the broker is not connected. */
+        rd_kafka_bufq_init(&waitresps);
+        waitresps.rkbq_reqcnt = reqcnt;
+        rd_kafka_bufq_init(&retrybufs);
+
+        for (i = 0 ; i < 3 ; i++) {
+                rkbuf[i] = rd_kafka_buf_new_request(rkb, RD_KAFKAP_Metadata,
+                                                    1, 16);
+                rd_kafka_bufq_enq(&retrybufs, rkbuf[i]);
+        }
+
+        /* Queues without counts do not affect them */
+        RD_UT_ASSERT(rd_atomic32_get(&reqcnt->cnt[RD_KAFKAP_Metadata]) == 0,
+                     "expected no in-flight Metadata requests");
+
+        rd_kafka_bufq_concat(&waitresps, &retrybufs);
+        rd_kafka_bufq_deq(&waitresps, rkbuf[0]);
+        rd_kafka_buf_destroy(rkbuf[0]);
+
+        /* The high watermark is seen until the emission, after which
+         * it is the count left at the time of the emission. */
+        for (pass = 0 ; pass < (int)RD_ARRAYSIZE(rollover) ; pass++) {
+                stats = rd_kafka_stats_new(rk, rd_false, rollover[pass]);
+
+                b = ut_stats_find_broker(stats, 1);
+                RD_UT_ASSERT(b, "broker not in snapshot");
+
+                req = NULL;
+                for (i = 0 ; i < b->req_cnt ; i++)
+                        if (b->reqs[i].ApiKey == RD_KAFKAP_Metadata)
+                                req = &b->reqs[i];
+                RD_UT_ASSERT(req, "Metadata not in snapshot");
+                RD_UT_ASSERT(req->inflight == 2,
+                             "expected 2 in-flight, not %"PRId32,
+                             req->inflight);
+                RD_UT_ASSERT(req->inflight_max == exp_max[pass],
+                             "pass %d: expected in-flight max %"PRId32
+                             ", not %"PRId32,
+                             pass, exp_max[pass], req->inflight_max);
+
+                json = rd_kafka_stats_to_json(stats, &len);
+                RD_UT_ASSERT(strstr(json, "\"req_stats\": { \"Metadata\": { "
+                                    "\"inflight\":2, "),
+                             "req_stats not in json: %s", json);
+                rd_free(json);
+
+                rd_kafka_stats_destroy(stats);
+        }
+
+        rd_kafka_bufq_concat(&retrybufs, &waitresps);
+        RD_UT_ASSERT(rd_atomic32_get(&reqcnt->cnt[RD_KAFKAP_Metadata]) == 0,
+                     "expected in-flight count to move with the buffers");
+        for (i = 1 ; i < 3 ; i++) {
+                rd_kafka_bufq_deq(&retrybufs, rkbuf[i]);
+                rd_kafka_buf_destroy(rkbuf[i]);
+        }
+
+        rd_kafka_broker_destroy(rkb);
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Verify that time spent blocking in a poll call is not
+ *        counted as poll gap.
+ */
+static int unittest_stats_poll_gap (void) {
+        rd_kafka_t *rk;
+        const rd_kafka_stats_t *stats;
+        rd_ts_t ts_start, blocked;
+
+        rk = ut_stats_client_new(RD_KAFKA_CONSUMER,
+                                 "statistics.interval.ms", "60000", NULL);
+        RD_UT_ASSERT(rk, "failed to create consumer");
+
+        /* Nothing to serve: blocks for the full timeout. */
+        ts_start = rd_clock();
+        rd_kafka_poll(rk, 500);
+        blocked = rd_clock() - ts_start;
+        rd_kafka_poll(rk, 0);
+
+        RD_UT_ASSERT(blocked >= 400*1000,
+                     "expected poll to block for 500ms, not %"PRId64"us",
+                     blocked);
+
+        RD_UT_ASSERT(!rd_kafka_stats_snapshot(rk, RD_KAFKA_STATS_VERSION,
+                                              &stats),
+                     "snapshot failed");
+
+        RD_UT_ASSERT(stats->poll_gap.cnt == 2,
+                     "expected 2 poll gaps, not %d", stats->poll_gap.cnt);
+        RD_UT_ASSERT(stats->poll_gap.max < 100*1000,
+                     "expected poll gap to exclude the %"PRId64"us "
+                     "blocked in poll, not %"PRId64"us",
+                     blocked, stats->poll_gap.max);
+
+        rd_kafka_stats_destroy(stats);
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+
+int unittest_stats (void) {
+        int fails = 0;
+
+        fails += unittest_stats_snapshot();
+        fails += unittest_stats_delta();
+        fails += unittest_stats_filter();
+        fails += unittest_stats_openmetrics();
+        fails += unittest_stats_produce_latency();
+        fails += unittest_stats_consumer_latency();
+        fails += unittest_stats_poll_gap();
+        fails += unittest_stats_req_inflight();
+
+        return fails;
+}
@@ -0,0 +1,57 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2019 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _RDKAFKA_STATS_H_
+#define _RDKAFKA_STATS_H_
+
+/**
+ * @name Statistics snapshots
+ *
+ * A statistics snapshot (rd_kafka_stats_t) is a typed copy of the
+ * client's statistics, taken with each broker, topic and partition
+ * locked only while that object is copied.
+ * The JSON statistics passed to the stats_cb are rendered from a
+ * snapshot, as is the public rd_kafka_stats_snapshot() API.
+ *
+ * @{
+ */
+
+rd_kafka_stats_t *rd_kafka_stats_new (rd_kafka_t *rk, rd_bool_t delta,
+                                      rd_bool_t rollover);
+
+char *rd_kafka_stats_to_json (const rd_kafka_stats_t *stats, size_t *lenp);
+char *rd_kafka_stats_to_openmetrics (const rd_kafka_stats_t *stats,
+                                     size_t *lenp);
+
+void rd_kafka_stats_emit_all (rd_kafka_t *rk);
+
+int unittest_stats (void);
+
+/**@}*/
+
+#endif /* _RDKAFKA_STATS_H_ */
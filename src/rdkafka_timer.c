@@ -30,6 +30,7 @@
 #include "rd.h"
 #include "rdtime.h"
 #include "rdsysqueue.h"
+#include "rdunittest.h"
 
 
 static RD_INLINE void rd_kafka_timers_lock (rd_kafka_timers_t *rkts) {
@@ -303,3 +304,127 @@ void rd_kafka_timers_init (rd_kafka_timers_t *rkts, rd_kafka_t *rk) {
         cnd_init(&rkts->rkts_cond);
         rkts->rkts_enabled = 1;
 }
+
+
+
+/**
+ * @name Benchmarks
+ * @{
+ */
+
+static void ut_timer_bench_cb (rd_kafka_timers_t *rkts, void *arg) {
+        int *calledp = arg;
+        (*calledp)++;
+}
+
+
+/**
+ * @brief Benchmark starting and stopping a timer among \p active_cnt
+ *        other active timers with intervals spread over 1..10s.
+ */
+static int do_benchmark_timer_start_stop (rd_kafka_t *rk, int active_cnt) {
+#define _REPS 1000
+        rd_kafka_timers_t rkts;
+        rd_kafka_timer_t *active = rd_calloc(active_cnt + 1, sizeof(*active));
+        rd_kafka_timer_t rtmr = RD_ZERO_INIT;
+        rd_ut_bench_t rub;
+        int called = 0;
+        int i;
+
+        rd_kafka_timers_init(&rkts, rk);
+
+        for (i = 0 ; i < active_cnt ; i++)
+                rd_kafka_timer_start(&rkts, &active[i],
+                                     1000000 +
+                                     ((rd_ts_t)(i * 7919) % 9000000),
+                                     ut_timer_bench_cb, &called);
+
+        rd_ut_bench_init(&rub, "timer/start_stop/active=%d", active_cnt);
+        while (rd_ut_bench_more(&rub)) {
+                rd_ut_bench_start(&rub);
+                for (i = 0 ; i < _REPS ; i++) {
+                        rd_kafka_timer_start(&rkts, &rtmr,
+                                             1000000 + (i % 9) * 1000000,
+                                             ut_timer_bench_cb, &called);
+                        rd_kafka_timer_stop(&rkts, &rtmr, 1/*lock*/);
+                }
+                rd_ut_bench_stop(&rub, _REPS, 0);
+        }
+        rd_ut_bench_report(&rub);
+
+        rd_kafka_timers_destroy(&rkts);
+        rd_free(active);
+#undef _REPS
+
+        RD_UT_ASSERT(called == 0, "no timer should have fired");
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Benchmark rd_kafka_timers_run() dispatching \p due_cnt
+ *        expired oneshot timers.
+ */
+static int do_benchmark_timer_run (rd_kafka_t *rk, int due_cnt) {
+        rd_kafka_timers_t rkts;
+        rd_kafka_timer_t *timers = rd_calloc(due_cnt, sizeof(*timers));
+        rd_ut_bench_t rub;
+        int i;
+
+        rd_kafka_timers_init(&rkts, rk);
+
+        rd_ut_bench_init(&rub, "timer/run/due=%d", due_cnt);
+        while (rd_ut_bench_more(&rub)) {
+                rd_ts_t ts_due;
+                int called = 0;
+
+                for (i = 0 ; i < due_cnt ; i++)
+                        rd_kafka_timer_start_oneshot(&rkts, &timers[i], 1,
+                                                     ut_timer_bench_cb,
+                                                     &called);
+
+                /* Wait for all timers to expire */
+                ts_due = rd_clock() + 2;
+                while (rd_clock() < ts_due)
+                        ;
+
+                rd_ut_bench_start(&rub);
+                rd_kafka_timers_run(&rkts, RD_POLL_NOWAIT);
+                rd_ut_bench_stop(&rub, due_cnt, 0);
+
+                RD_UT_ASSERT(called == due_cnt,
+                             "expected %d timer callbacks, not %d",
+                             due_cnt, called);
+        }
+        rd_ut_bench_report(&rub);
+
+        rd_kafka_timers_destroy(&rkts);
+        rd_free(timers);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Benchmark the timer framework's sorted timer list.
+ */
+int benchmark_timer (void) {
+        rd_kafka_t *rk;
+        int fails = 0;
+
+        rk = rd_kafka_new(RD_KAFKA_CONSUMER, rd_kafka_conf_new(), NULL, 0);
+        RD_UT_ASSERT(rk, "failed to create consumer");
+
+        fails += do_benchmark_timer_start_stop(rk, 0);
+        fails += do_benchmark_timer_start_stop(rk, 100);
+        fails += do_benchmark_timer_start_stop(rk, 1000);
+        fails += do_benchmark_timer_run(rk, 100);
+        fails += do_benchmark_timer_run(rk, 1000);
+
+        rd_kafka_destroy(rk);
+
+        return fails;
+}
+
+
+/**@}*/
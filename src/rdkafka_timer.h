@@ -83,4 +83,6 @@ void rd_kafka_timers_run (rd_kafka_timers_t *rkts, int timeout_us);
 void rd_kafka_timers_destroy (rd_kafka_timers_t *rkts);
 void rd_kafka_timers_init (rd_kafka_timers_t *rkte, rd_kafka_t *rk);
 
+int benchmark_timer (void);
+
 #endif /* _RDKAFKA_TIMER_H_ */
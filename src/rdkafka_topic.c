@@ -111,6 +111,7 @@ static void rd_kafka_topic_destroy_app (rd_kafka_topic_t *app_rkt) {
  * Final destructor for topic. Refcnt must be 0.
  */
 void rd_kafka_topic_destroy_final (rd_kafka_itopic_t *rkt) {
+        int i;
 
 	rd_kafka_assert(rkt->rkt_rk, rd_refcnt_get(&rkt->rkt_refcnt) == 0);
 
@@ -124,6 +125,8 @@ void rd_kafka_topic_destroy_final (rd_kafka_itopic_t *rkt) {
 
         rd_avg_destroy(&rkt->rkt_avg_batchsize);
         rd_avg_destroy(&rkt->rkt_avg_batchcnt);
+        for (i = 0 ; i < RD_KAFKA_STATS_PRODUCE_STAGE__CNT ; i++)
+                rd_avg_destroy(&rkt->rkt_avg_produce_latency[i]);
 
 	if (rkt->rkt_topic)
 		rd_kafkap_str_destroy(rkt->rkt_topic);
@@ -224,6 +227,7 @@ shptr_rd_kafka_itopic_t *rd_kafka_topic_new0 (rd_kafka_t *rk,
         shptr_rd_kafka_itopic_t *s_rkt;
         const struct rd_kafka_metadata_cache_entry *rkmce;
         const char *conf_err;
+        int i;
 
 	/* Verify configuration.
 	 * Maximum topic name size + headers must never exceed message.max.bytes
@@ -278,6 +282,10 @@ shptr_rd_kafka_itopic_t *rd_kafka_topic_new0 (rd_kafka_t *rk,
 
 	rkt->rkt_topic     = rd_kafkap_str_new(topic, -1);
 	rkt->rkt_rk        = rk;
+        rkt->rkt_dbg_filtered =
+                rk->rk_conf.debug_topic_include &&
+                !rd_kafka_pattern_match(rk->rk_conf.debug_topic_include,
+                                        topic);
 
 	rkt->rkt_conf = *conf;
 	rd_free(conf); /* explicitly not rd_kafka_topic_destroy()
@@ -377,6 +385,11 @@ shptr_rd_kafka_itopic_t *rd_kafka_topic_new0 (rd_kafka_t *rk,
         rd_avg_init(&rkt->rkt_avg_batchcnt, RD_AVG_GAUGE, 0,
                     rk->rk_conf.batch_num_messages, 2,
                     rk->rk_conf.stats_interval_ms ? 1 : 0);
+        for (i = 0 ; i < RD_KAFKA_STATS_PRODUCE_STAGE__CNT ; i++)
+                rd_avg_init(&rkt->rkt_avg_produce_latency[i], RD_AVG_GAUGE,
+                            0, 1000*1000, 2,
+                            rk->rk_conf.stats_interval_ms &&
+                            rk->rk_type == RD_KAFKA_PRODUCER);
 
 	rd_kafka_dbg(rk, TOPIC, "TOPIC", "New local topic: %.*s",
 		     RD_KAFKAP_STR_PR(rkt->rkt_topic));
@@ -508,6 +521,10 @@ int rd_kafka_toppar_leader_update (rd_kafka_toppar_t *rktp,
 		return had_leader ? -1 : 0;
 	}
 
+        /* Serve the partition on one of the leader's data connections,
+         * if any (connections.per.broker). */
+        rkb = rd_kafka_broker_stripe(rkb, rktp);
+
 
 	if (rktp->rktp_leader) {
 		if (rktp->rktp_leader == rkb) {
@@ -517,10 +534,11 @@ int rd_kafka_toppar_leader_update (rd_kafka_toppar_t *rktp,
 
 		rd_kafka_dbg(rktp->rktp_rkt->rkt_rk, TOPIC, "TOPICUPD",
 			     "Topic %s [%"PRId32"] migrated from "
-			     "broker %"PRId32" to %"PRId32,
+			     "broker %s to %s",
 			     rktp->rktp_rkt->rkt_topic->str,
 			     rktp->rktp_partition,
-			     rktp->rktp_leader->rkb_nodeid, rkb->rkb_nodeid);
+			     rd_kafka_broker_name(rktp->rktp_leader),
+			     rd_kafka_broker_name(rkb));
 	}
 
 	rd_kafka_toppar_broker_delegate(rktp, rkb, 0);
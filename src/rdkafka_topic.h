@@ -42,6 +42,10 @@ struct rd_kafka_itopic_s {
 
 	rwlock_t           rkt_lock;
 	rd_kafkap_str_t   *rkt_topic;
+        rd_bool_t          rkt_dbg_filtered; /**< Per-partition debug logs
+                                              *   are filtered out by
+                                              *   `debug.topic.include`
+                                              *   (immutable). */
 
 	shptr_rd_kafka_toppar_t  *rkt_ua;  /* unassigned partition */
 	shptr_rd_kafka_toppar_t **rkt_p;
@@ -76,6 +80,14 @@ struct rd_kafka_itopic_s {
 
         rd_avg_t          rkt_avg_batchsize; /**< Average batch size */
         rd_avg_t          rkt_avg_batchcnt;  /**< Average batch message count */
+        rd_avg_t          rkt_avg_produce_latency[
+                RD_KAFKA_STATS_PRODUCE_STAGE__CNT]; /**< Producer batch
+                                                     *   stage latencies */
+        uint32_t          rkt_stats_crc;     /**< statistics.delta: checksum
+                                              *   of the last emitted topic
+                                              *   stats.
+                                              *   Locality: rdkafka main
+                                              *   thread */
 
         shptr_rd_kafka_itopic_t *rkt_shptr_app; /* Application's topic_new() */
 
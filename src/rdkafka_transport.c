@@ -39,8 +39,10 @@
 #include "rdkafka_transport_int.h"
 #include "rdkafka_broker.h"
 #include "rdkafka_interceptor.h"
+#include "rdunittest.h"
 
 #include <errno.h>
+#include <sys/stat.h>
 
 #if WITH_VALGRIND
 /* OpenSSL relies on uninitialized memory, which Valgrind will whine about.
@@ -60,17 +62,51 @@
 #define SOCKET_ERROR -1
 #endif
 
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
+
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && \
+        defined(SO_EE_ORIGIN_ZEROCOPY)
+#define WITH_ZEROCOPY 1
+#endif
+
 /* AIX doesn't have MSG_DONTWAIT */
 #ifndef MSG_DONTWAIT
 #  define MSG_DONTWAIT MSG_NONBLOCK
 #endif
 
 
+#if WITH_SSL && !defined(BIO_get_ktls_send)
+/* OpenSSL < 3.0: no kernel TLS support */
+#define BIO_get_ktls_send(b) (0)
+#define BIO_get_ktls_recv(b) (0)
+#endif
+
 #if WITH_SSL && OPENSSL_VERSION_NUMBER < 0x10100000L
 static mtx_t *rd_kafka_ssl_locks;
 static int    rd_kafka_ssl_locks_cnt;
 #endif
 
+#if WITH_SSL
+/**
+ * Process-wide cache of SSL contexts, shared by all rd_kafka_t instances
+ * with the same effective ssl.* configuration.
+ * See rd_kafka_transport_ssl_ctx_init().
+ */
+typedef struct rd_kafka_ssl_ctx_entry_s {
+        TAILQ_ENTRY(rd_kafka_ssl_ctx_entry_s) link;
+        char    *key;     /**< Effective configuration,
+                           *   see rd_kafka_transport_ssl_ctx_key() */
+        SSL_CTX *ctx;
+        int      refcnt;  /**< Number of rd_kafka_t instances using ctx */
+} rd_kafka_ssl_ctx_entry_t;
+
+static TAILQ_HEAD(, rd_kafka_ssl_ctx_entry_s) rd_kafka_ssl_ctx_cache =
+        TAILQ_HEAD_INITIALIZER(rd_kafka_ssl_ctx_cache);
+static mtx_t rd_kafka_ssl_ctx_cache_lock;
+#endif
+
 
 
 /**
@@ -89,6 +125,198 @@ static void rd_kafka_transport_close0 (rd_kafka_t *rk, int s) {
 
 }
 
+#if WITH_ZEROCOPY
+/**
+ * @brief Release the oldest pending zero-copy send: the kernel no longer
+ *        references the request's payload.
+ *
+ *        If this was the request's last outstanding send and its response
+ *        or timeout was held back by rd_kafka_transport_zc_defer() the
+ *        request's callback is now called, unless \p closing is set
+ *        in which case the request is put back on the wait-response queue
+ *        to be failed along with the other in-flight requests.
+ *
+ * Locality: broker thread
+ */
+static void rd_kafka_transport_zc_pop (rd_kafka_transport_t *rktrans,
+                                       rd_bool_t closing) {
+        rd_kafka_broker_t *rkb = rktrans->rktrans_rkb;
+        rd_kafka_buf_t *rkbuf = rktrans->rktrans_zc.pending[0].rkbuf;
+
+        rktrans->rktrans_zc.pending_cnt--;
+        memmove(&rktrans->rktrans_zc.pending[0],
+                &rktrans->rktrans_zc.pending[1],
+                sizeof(*rktrans->rktrans_zc.pending) *
+                rktrans->rktrans_zc.pending_cnt);
+
+        rd_assert(rkbuf->rkbuf_zc.pending > 0);
+
+        if (--rkbuf->rkbuf_zc.pending == 0 && rkbuf->rkbuf_zc.deferred) {
+                rd_kafka_buf_t *response = rkbuf->rkbuf_zc.response;
+                rd_kafka_resp_err_t err = rkbuf->rkbuf_zc.err;
+
+                rkbuf->rkbuf_zc.deferred = rd_false;
+                rkbuf->rkbuf_zc.err = RD_KAFKA_RESP_ERR_NO_ERROR;
+                rkbuf->rkbuf_zc.response = NULL;
+
+                if (closing) {
+                        if (response)
+                                rd_kafka_buf_destroy(response);
+                        rd_kafka_bufq_enq(&rkb->rkb_waitresps, rkbuf);
+                } else
+                        rd_kafka_buf_callback(rkb->rkb_rk, rkb, err,
+                                              response, rkbuf);
+        }
+
+        /* Drop the reference held by the pending send */
+        rd_kafka_buf_destroy(rkbuf);
+}
+
+
+/**
+ * @brief Read MSG_ZEROCOPY completion notifications from the socket's
+ *        error queue and release the sends they cover.
+ *
+ * Locality: broker thread
+ */
+static void rd_kafka_transport_zc_reap (rd_kafka_transport_t *rktrans) {
+        rd_kafka_broker_t *rkb = rktrans->rktrans_rkb;
+        char control[128];
+
+        while (rktrans->rktrans_zc.pending_cnt > 0) {
+                struct msghdr msg = { .msg_control = control,
+                                      .msg_controllen = sizeof(control) };
+                struct cmsghdr *cm;
+
+                if (recvmsg(rktrans->rktrans_s, &msg,
+                            MSG_ERRQUEUE|MSG_DONTWAIT) == -1)
+                        break; /* EAGAIN: no more notifications */
+
+                for (cm = CMSG_FIRSTHDR(&msg) ; cm ;
+                     cm = CMSG_NXTHDR(&msg, cm)) {
+                        const struct sock_extended_err *serr;
+                        uint32_t hi;
+
+                        if (!((cm->cmsg_level == SOL_IP &&
+                               cm->cmsg_type == IP_RECVERR) ||
+                              (cm->cmsg_level == SOL_IPV6 &&
+                               cm->cmsg_type == IPV6_RECVERR)))
+                                continue;
+
+                        serr = (const struct sock_extended_err *)
+                                CMSG_DATA(cm);
+                        if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY ||
+                            serr->ee_errno != 0)
+                                continue;
+
+                        /* Notification covers sends ee_info..ee_data */
+                        hi = serr->ee_data;
+
+                        if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                                rd_atomic64_add(&rkb->rkb_c.zc_tx_copied,
+                                                (int64_t)(hi -
+                                                          serr->ee_info) + 1);
+
+                        while (rktrans->rktrans_zc.pending_cnt > 0 &&
+                               (int32_t)(rktrans->rktrans_zc.pending[0].seq -
+                                         hi) <= 0)
+                                rd_kafka_transport_zc_pop(rktrans,
+                                                          rd_false);
+                }
+        }
+}
+
+
+/**
+ * @brief Check whether the current send of \p slice may use MSG_ZEROCOPY
+ *        and if so return the request it belongs to.
+ *
+ *        Only requests expecting a response are eligible: their payload
+ *        is kept alive until the send completes by holding back the
+ *        response, see rd_kafka_transport_zc_defer().
+ */
+static rd_kafka_buf_t *
+rd_kafka_transport_zc_request (rd_kafka_transport_t *rktrans,
+                               rd_slice_t *slice) {
+        rd_kafka_broker_t *rkb = rktrans->rktrans_rkb;
+        rd_kafka_buf_t *rkbuf;
+
+        if (!rktrans->rktrans_zc.enabled)
+                return NULL;
+
+        rkbuf = TAILQ_FIRST(&rkb->rkb_outbufs.rkbq_bufs);
+        if (!rkbuf || slice != &rkbuf->rkbuf_reader ||
+            (rkbuf->rkbuf_flags & RD_KAFKA_OP_F_NO_RESPONSE) ||
+            rd_slice_size(slice) <
+            (size_t)rkb->rkb_rk->rk_conf.socket_zerocopy_min_bytes)
+                return NULL;
+
+        return rkbuf;
+}
+
+
+/**
+ * @brief Track a successful MSG_ZEROCOPY send of \p rkbuf.
+ */
+static void rd_kafka_transport_zc_add (rd_kafka_transport_t *rktrans,
+                                       rd_kafka_buf_t *rkbuf) {
+        if (rktrans->rktrans_zc.pending_cnt ==
+            rktrans->rktrans_zc.pending_size) {
+                rktrans->rktrans_zc.pending_size =
+                        RD_MAX(16, rktrans->rktrans_zc.pending_size * 2);
+                rktrans->rktrans_zc.pending =
+                        rd_realloc(rktrans->rktrans_zc.pending,
+                                   sizeof(*rktrans->rktrans_zc.pending) *
+                                   rktrans->rktrans_zc.pending_size);
+        }
+
+        rd_kafka_buf_keep(rkbuf);
+        rktrans->rktrans_zc.pending[rktrans->rktrans_zc.pending_cnt].seq =
+                rktrans->rktrans_zc.seq_next++;
+        rktrans->rktrans_zc.pending[rktrans->rktrans_zc.pending_cnt].rkbuf =
+                rkbuf;
+        rktrans->rktrans_zc.pending_cnt++;
+        rkbuf->rkbuf_zc.pending++;
+
+        rd_atomic64_add(&rktrans->rktrans_rkb->rkb_c.zc_tx, 1);
+}
+#endif
+
+
+/**
+ * @brief Hold back the callback of \p req with \p err and \p response
+ *        (which may be NULL, e.g., for timeouts) if any of the request's
+ *        MSG_ZEROCOPY sends are still referenced by the kernel,
+ *        since handling the request's outcome may free its payload.
+ *        The request's callback is called once the last send completes.
+ *
+ * @returns 1 if the callback was deferred (ownership of \p response and
+ *          the caller's reference to \p req is taken), else 0.
+ *
+ * Locality: broker thread
+ */
+int rd_kafka_transport_zc_defer (rd_kafka_transport_t *rktrans,
+                                 rd_kafka_buf_t *req,
+                                 rd_kafka_resp_err_t err,
+                                 rd_kafka_buf_t *response) {
+#if WITH_ZEROCOPY
+        /* The notifications typically arrive before the response */
+        rd_kafka_transport_zc_reap(rktrans);
+
+        if (req->rkbuf_zc.pending == 0)
+                return 0;
+
+        rd_assert(!req->rkbuf_zc.deferred);
+        req->rkbuf_zc.deferred = rd_true;
+        req->rkbuf_zc.err = err;
+        req->rkbuf_zc.response = response;
+        return 1;
+#else
+        return 0;
+#endif
+}
+
+
 /**
  * Close and destroy a transport handle
  */
@@ -98,17 +326,53 @@ void rd_kafka_transport_close (rd_kafka_transport_t *rktrans) {
 		SSL_shutdown(rktrans->rktrans_ssl);
 		SSL_free(rktrans->rktrans_ssl);
 	}
+        RD_IF_FREE(rktrans->rktrans_ssl_wr.buf, rd_free);
 #endif
 
         rd_kafka_sasl_close(rktrans);
 
+#if WITH_ZEROCOPY
+        if (rktrans->rktrans_zc.pending_cnt > 0 && rktrans->rktrans_s != -1) {
+                /* A graceful close would have the kernel keep sending the
+                 * queued data from the payload pages, which are freed
+                 * once the requests are released below.
+                 * Reset the connection instead to have the send
+                 * queue discarded. */
+                struct linger lg = { .l_onoff = 1, .l_linger = 0 };
+
+                if (setsockopt(rktrans->rktrans_s, SOL_SOCKET, SO_LINGER,
+                               (void *)&lg, sizeof(lg)) == -1)
+                        rd_rkb_log(rktrans->rktrans_rkb, LOG_WARNING,
+                                   "ZEROCOPY",
+                                   "Failed to set SO_LINGER to reset "
+                                   "the connection on close: %s",
+                                   rd_strerror(socket_errno));
+        }
+#endif
+
 	if (rktrans->rktrans_recv_buf)
 		rd_kafka_buf_destroy(rktrans->rktrans_recv_buf);
 
+        if (rktrans->rktrans_rkb->rkb_reactor.rkrc)
+                rd_kafka_reactor_sock_del(rktrans->rktrans_rkb);
+
+#if WITH_IO_URING
+        if (rktrans->rktrans_uring)
+                rd_kafka_uring_conn_close(rktrans->rktrans_uring);
+#endif
+
 	if (rktrans->rktrans_s != -1)
                 rd_kafka_transport_close0(rktrans->rktrans_rkb->rkb_rk,
                                           rktrans->rktrans_s);
 
+#if WITH_ZEROCOPY
+        /* The send queue was discarded with the socket: release the
+         * requests of the zero-copy sends still in flight. */
+        while (rktrans->rktrans_zc.pending_cnt > 0)
+                rd_kafka_transport_zc_pop(rktrans, rd_true/*closing*/);
+        RD_IF_FREE(rktrans->rktrans_zc.pending, rd_free);
+#endif
+
 	rd_free(rktrans);
 }
 
@@ -138,6 +402,15 @@ ssize_t rd_kafka_transport_socket_sendmsg (rd_kafka_transport_t *rktrans,
         struct msghdr msg = { .msg_iov = iov };
         size_t iovlen;
         ssize_t r;
+        int flags = MSG_DONTWAIT
+#ifdef MSG_NOSIGNAL
+                | MSG_NOSIGNAL
+#endif
+                ;
+#if WITH_ZEROCOPY
+        rd_kafka_buf_t *zc_rkbuf = rd_kafka_transport_zc_request(rktrans,
+                                                                 slice);
+#endif
 
         rd_slice_get_iov(slice, msg.msg_iov, &iovlen, IOV_MAX,
                          /* FIXME: Measure the effects of this */
@@ -149,12 +422,26 @@ ssize_t rd_kafka_transport_socket_sendmsg (rd_kafka_transport_t *rktrans,
         socket_errno = EAGAIN;
 #endif
 
-        r = sendmsg(rktrans->rktrans_s, &msg, MSG_DONTWAIT
-#ifdef MSG_NOSIGNAL
-                    | MSG_NOSIGNAL
+#if WITH_ZEROCOPY
+        if (zc_rkbuf) {
+                r = sendmsg(rktrans->rktrans_s, &msg, flags|MSG_ZEROCOPY);
+                if (r != -1) {
+                        rd_kafka_transport_zc_add(rktrans, zc_rkbuf);
+                        goto sent;
+                } else if (socket_errno != ENOBUFS)
+                        goto sent;
+
+                /* Out of optmem for pinning pages: copy instead. */
+                rd_atomic64_add(&rktrans->rktrans_rkb->rkb_c.
+                                zc_tx_fallback, 1);
+        }
 #endif
-                );
 
+        r = sendmsg(rktrans->rktrans_s, &msg, flags);
+
+#if WITH_ZEROCOPY
+ sent:
+#endif
         if (r == -1) {
                 if (socket_errno == EAGAIN)
                         return 0;
@@ -206,7 +493,7 @@ rd_kafka_transport_socket_send0 (rd_kafka_transport_t *rktrans,
                         if (r == 0 || errno == EAGAIN)
                                 return 0;
                         rd_snprintf(errstr, errstr_size, "%s",
-                                    socket_strerror(socket_errno));
+                                    rd_strerror(socket_errno));
                         return -1;
                 }
 #endif
@@ -230,6 +517,12 @@ static ssize_t
 rd_kafka_transport_socket_send (rd_kafka_transport_t *rktrans,
                                 rd_slice_t *slice,
                                 char *errstr, size_t errstr_size) {
+#if WITH_IO_URING
+        if (rktrans->rktrans_uring)
+                return rd_kafka_uring_conn_send(rktrans->rktrans_uring, slice,
+                                                rktrans->rktrans_sndbuf_size,
+                                                errstr, errstr_size);
+#endif
 #ifndef _MSC_VER
         /* FIXME: Use sendmsg() with iovecs if there's more than one segment
          * remaining, otherwise (or if platform does not have sendmsg)
@@ -361,6 +654,11 @@ static ssize_t
 rd_kafka_transport_socket_recv (rd_kafka_transport_t *rktrans,
                                 rd_buf_t *buf,
                                 char *errstr, size_t errstr_size) {
+#if WITH_IO_URING
+        if (rktrans->rktrans_uring)
+                return rd_kafka_uring_conn_recv(rktrans->rktrans_uring, buf,
+                                                errstr, errstr_size);
+#endif
 #ifndef _MSC_VER
         /* FIXME: Use recvmsg() with iovecs if there's more than one segment
          * remaining, otherwise (or if platform does not have sendmsg)
@@ -482,6 +780,13 @@ static void rd_kafka_transport_libcrypto_THREADID_callback(CRYPTO_THREADID *id)
 void rd_kafka_transport_ssl_term (void) {
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
 	int i;
+#endif
+
+        /* All rd_kafka_t instances are destroyed at this point */
+        rd_assert(TAILQ_EMPTY(&rd_kafka_ssl_ctx_cache));
+        mtx_destroy(&rd_kafka_ssl_ctx_cache_lock);
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
 
 	if (CRYPTO_get_locking_callback() == &rd_kafka_transport_ssl_lock_cb) {
 		CRYPTO_set_locking_callback(NULL);
@@ -506,7 +811,12 @@ void rd_kafka_transport_ssl_term (void) {
 void rd_kafka_transport_ssl_init (void) {
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
 	int i;
-	
+#endif
+
+        mtx_init(&rd_kafka_ssl_ctx_cache_lock, mtx_plain);
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+
 	if (!CRYPTO_get_locking_callback()) {
 		rd_kafka_ssl_locks_cnt = CRYPTO_num_locks();
 		rd_kafka_ssl_locks = rd_malloc(rd_kafka_ssl_locks_cnt *
@@ -587,20 +897,99 @@ rd_kafka_transport_ssl_io_update (rd_kafka_transport_t *rktrans, int ret,
 	return 0;
 }
 
+/**
+ * @brief Account for \p size bytes written in \p records TLS records.
+ */
+static RD_INLINE void
+rd_kafka_transport_ssl_records_add (rd_kafka_transport_t *rktrans,
+                                    size_t size, int records) {
+        rd_kafka_broker_t *rkb = rktrans->rktrans_rkb;
+        int i;
+
+        rktrans->rktrans_ssl_wr.records += records;
+
+        for (i = 0 ; i < records ; i++) {
+                size_t rsize = RD_MIN(size, SSL3_RT_MAX_PLAIN_LENGTH);
+                rd_avg_add(&rkb->rkb_avg_tls_record_size, (int64_t)rsize);
+                size -= rsize;
+        }
+}
+
+
+/**
+ * @brief Write \p slice to the SSL connection.
+ *
+ *        Every SSL_write() produces at least one TLS record, each with its
+ *        own header and MAC/AEAD overhead, so writing a request with many
+ *        small segments segment by segment produces many tiny records.
+ *        Instead, small segments are gathered into a staging buffer of one
+ *        full-size record, while segment data making up full-size records
+ *        and the last segment of the slice are written as is.
+ *
+ * @remark SSL_write() must be retried with the same buffer after
+ *         SSL_ERROR_WANT_WRITE, so staged data is kept until written.
+ */
 static ssize_t
 rd_kafka_transport_ssl_send (rd_kafka_transport_t *rktrans,
                              rd_slice_t *slice,
                              char *errstr, size_t errstr_size) {
 	ssize_t sum = 0;
-        const void *p;
-        size_t rlen;
 
         rd_kafka_transport_ssl_clear_error(rktrans);
 
-        while ((rlen = rd_slice_peeker(slice, &p))) {
+        while (rd_slice_remains(slice) > 0) {
+                const void *p;
+                size_t len;
+                rd_bool_t staged = rd_false;
                 int r;
 
-                r = SSL_write(rktrans->rktrans_ssl, p, (int)rlen);
+                if (rktrans->rktrans_ssl_wr.len > 0) {
+                        /* Retry of a staged record */
+                        if (unlikely(rktrans->rktrans_ssl_wr.slice != slice ||
+                                     rktrans->rktrans_ssl_wr.of !=
+                                     rd_slice_offset(slice))) {
+                                rd_snprintf(errstr, errstr_size,
+                                            "SSL write retry with "
+                                            "different data");
+                                return -1;
+                        }
+                        p = rktrans->rktrans_ssl_wr.buf;
+                        len = rktrans->rktrans_ssl_wr.len;
+                        staged = rd_true;
+
+                } else {
+                        size_t rlen = rd_slice_peeker(slice, &p);
+                        size_t remains = rd_slice_remains(slice);
+
+                        if (rlen >= SSL3_RT_MAX_PLAIN_LENGTH) {
+                                /* Full-size records straight from
+                                 * the segment */
+                                len = rlen - (rlen % SSL3_RT_MAX_PLAIN_LENGTH);
+                        } else if (rlen == remains) {
+                                /* Last segment */
+                                len = rlen;
+                        } else {
+                                /* Gather small segments into one record */
+                                if (unlikely(!rktrans->rktrans_ssl_wr.buf))
+                                        rktrans->rktrans_ssl_wr.buf =
+                                                rd_malloc(
+                                                SSL3_RT_MAX_PLAIN_LENGTH);
+
+                                len = RD_MIN(remains,
+                                             SSL3_RT_MAX_PLAIN_LENGTH);
+                                rd_slice_peek(slice, rd_slice_offset(slice),
+                                              rktrans->rktrans_ssl_wr.buf,
+                                              len);
+                                rktrans->rktrans_ssl_wr.len = len;
+                                rktrans->rktrans_ssl_wr.slice = slice;
+                                rktrans->rktrans_ssl_wr.of =
+                                        rd_slice_offset(slice);
+                                p = rktrans->rktrans_ssl_wr.buf;
+                                staged = rd_true;
+                        }
+                }
+
+                r = SSL_write(rktrans->rktrans_ssl, p, (int)len);
 
 		if (unlikely(r <= 0)) {
 			if (rd_kafka_transport_ssl_io_update(rktrans, r,
@@ -611,13 +1000,24 @@ rd_kafka_transport_ssl_send (rd_kafka_transport_t *rktrans,
 				return sum;
 		}
 
+                rd_kafka_transport_ssl_records_add(
+                        rktrans, (size_t)r,
+                        (r + SSL3_RT_MAX_PLAIN_LENGTH - 1) /
+                        SSL3_RT_MAX_PLAIN_LENGTH);
+
+                if (staged) {
+                        /* A staged record is written in full */
+                        rd_dassert((size_t)r == len);
+                        rktrans->rktrans_ssl_wr.len = 0;
+                }
+
                 /* Update buffer read position */
                 rd_slice_read(slice, NULL, (size_t)r);
 
 		sum += r;
                  /* FIXME: remove this and try again immediately and let
                   *        the next SSL_write() call fail instead? */
-                if ((size_t)r < rlen)
+                if ((size_t)r < len)
                         break;
 
 	}
@@ -675,6 +1075,12 @@ static int rd_kafka_transport_ssl_passwd_cb (char *buf, int size, int rwflag,
 	rd_kafka_t *rk = userdata;
 	int pwlen;
 
+        /* The userdata is reset when the SSL context has been set up
+         * since the context may outlive the instance, see
+         * rd_kafka_transport_ssl_ctx_new(). */
+        if (!rk)
+                return -1;
+
 	rd_kafka_dbg(rk, SECURITY, "SSLPASSWD",
 		     "Private key file \"%s\" requires password",
 		     rk->rk_conf.ssl.key_location);
@@ -694,6 +1100,133 @@ static int rd_kafka_transport_ssl_passwd_cb (char *buf, int size, int rwflag,
 	return pwlen;
 }
 
+/**
+ * @brief Check whether OpenSSL enabled kernel TLS on the socket after the
+ *        handshake (ssl.ktls.enable), in which case requests are written
+ *        as plaintext to the socket with the regular send path.
+ *        Reads always go through SSL_read(), which handles non-data
+ *        records (session tickets, alerts) received with kTLS as well as
+ *        any data OpenSSL has already buffered.
+ */
+static void rd_kafka_transport_ssl_ktls_check (rd_kafka_transport_t *rktrans) {
+        rd_kafka_broker_t *rkb = rktrans->rktrans_rkb;
+        int tx, rx;
+
+        if (!rkb->rkb_rk->rk_conf.ssl.ktls_enable)
+                return;
+
+        tx = BIO_get_ktls_send(SSL_get_wbio(rktrans->rktrans_ssl));
+        rx = BIO_get_ktls_recv(SSL_get_rbio(rktrans->rktrans_ssl));
+
+        rktrans->rktrans_ssl_ktls_tx = tx ? rd_true : rd_false;
+
+        rd_rkb_dbg(rkb, SECURITY, "KTLS",
+                   "Kernel TLS %s for %s (send %s, receive %s)",
+                   tx || rx ? "enabled" : "not available",
+                   SSL_get_cipher_name(rktrans->rktrans_ssl),
+                   tx ? "offloaded" : "OpenSSL",
+                   rx ? "offloaded" : "OpenSSL");
+}
+
+
+/**
+ * @brief Free the broker's cached TLS session, if any.
+ *
+ * @locality broker thread
+ */
+void rd_kafka_transport_ssl_session_clear (rd_kafka_broker_t *rkb) {
+        if (!rkb->rkb_ssl_session.session)
+                return;
+
+        SSL_SESSION_free(rkb->rkb_ssl_session.session);
+        rkb->rkb_ssl_session.session = NULL;
+}
+
+
+/**
+ * @brief OpenSSL new session callback: keep the latest resumable session
+ *        of the connection in the broker's session cache, replacing any
+ *        previous session.
+ *        With TLS 1.3 the session tickets are received after the
+ *        handshake, from SSL_read().
+ *
+ * @returns 1 if the session was taken, else 0 to let OpenSSL free it.
+ *
+ * @locality broker thread
+ */
+static int rd_kafka_transport_ssl_session_new_cb (SSL *ssl,
+                                                  SSL_SESSION *session) {
+        rd_kafka_transport_t *rktrans = SSL_get_app_data(ssl);
+        rd_kafka_broker_t *rkb;
+
+        if (!rktrans)
+                return 0;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+        if (!SSL_SESSION_is_resumable(session))
+                return 0;
+#endif
+
+        rkb = rktrans->rktrans_rkb;
+
+        rd_kafka_transport_ssl_session_clear(rkb);
+        rkb->rkb_ssl_session.session = session;
+        rkb->rkb_ssl_session.connect_epoch = rkb->rkb_connect_epoch;
+
+        rd_rkb_dbg(rkb, SECURITY, "SSLSESSION",
+                   "Cached TLS session for resumption");
+
+        return 1;
+}
+
+
+/**
+ * @brief Offer the broker's cached TLS session, if any, for resumption
+ *        on a new connection. A session received before the broker's
+ *        address changed is discarded.
+ *
+ * @locality broker thread
+ */
+static void rd_kafka_transport_ssl_session_set (rd_kafka_transport_t *rktrans) {
+        rd_kafka_broker_t *rkb = rktrans->rktrans_rkb;
+
+        SSL_set_app_data(rktrans->rktrans_ssl, rktrans);
+
+        if (!rkb->rkb_ssl_session.session)
+                return;
+
+        if (rkb->rkb_ssl_session.connect_epoch != rkb->rkb_connect_epoch ||
+            !SSL_set_session(rktrans->rktrans_ssl,
+                             rkb->rkb_ssl_session.session)) {
+                rd_rkb_dbg(rkb, SECURITY, "SSLSESSION",
+                           "Discarding cached TLS session");
+                rd_kafka_transport_ssl_session_clear(rkb);
+        }
+}
+
+
+/**
+ * @brief Update handshake statistics once the handshake is done.
+ *
+ * @locality broker thread
+ */
+static void
+rd_kafka_transport_ssl_session_check (rd_kafka_transport_t *rktrans) {
+        rd_kafka_broker_t *rkb = rktrans->rktrans_rkb;
+        int resumed = SSL_session_reused(rktrans->rktrans_ssl);
+
+        if (resumed)
+                rd_atomic32_add(&rkb->rkb_c.tls_resumed_handshakes, 1);
+        else
+                rd_atomic32_add(&rkb->rkb_c.tls_full_handshakes, 1);
+
+        rd_rkb_dbg(rkb, SECURITY, "SSLSESSION",
+                   "%s TLS handshake with %s",
+                   resumed ? "Resumed" : "Full",
+                   SSL_get_version(rktrans->rktrans_ssl));
+}
+
+
 /**
  * Set up SSL for a newly connected connection
  *
@@ -725,12 +1258,17 @@ static int rd_kafka_transport_ssl_connect (rd_kafka_broker_t *rkb,
 		goto fail;
 #endif
 
+        if (rkb->rkb_rk->rk_conf.ssl.session_resumption)
+                rd_kafka_transport_ssl_session_set(rktrans);
+
         rd_kafka_transport_ssl_clear_error(rktrans);
 
 	r = SSL_connect(rktrans->rktrans_ssl);
 	if (r == 1) {
 		/* Connected, highly unlikely since this is a
 		 * non-blocking operation. */
+                rd_kafka_transport_ssl_session_check(rktrans);
+                rd_kafka_transport_ssl_ktls_check(rktrans);
 		rd_kafka_transport_connect_done(rktrans, NULL);
 		return 0;
 	}
@@ -820,12 +1358,18 @@ static int rd_kafka_transport_ssl_handshake (rd_kafka_transport_t *rktrans) {
 		if (rd_kafka_transport_ssl_verify(rktrans) == -1)
 			return -1;
 
+                rd_kafka_transport_ssl_session_check(rktrans);
+                rd_kafka_transport_ssl_ktls_check(rktrans);
 		rd_kafka_transport_connect_done(rktrans, NULL);
 		return 1;
 
 	} else if (rd_kafka_transport_ssl_io_update(rktrans, r,
 						    errstr,
 						    sizeof(errstr)) == -1) {
+                /* Don't offer the cached session again in case it
+                 * caused the failure. */
+                rd_kafka_transport_ssl_session_clear(rkb);
+
 		rd_kafka_broker_fail(rkb, LOG_ERR, RD_KAFKA_RESP_ERR__SSL,
 				     "SSL handshake failed: %s%s", errstr,
 				     strstr(errstr, "unexpected message") ?
@@ -839,40 +1383,149 @@ static int rd_kafka_transport_ssl_handshake (rd_kafka_transport_t *rktrans) {
 
 
 /**
- * Once per rd_kafka_t handle cleanup of OpenSSL
+ * Once per rd_kafka_t handle cleanup of OpenSSL: releases the instance's
+ * reference to the shared SSL context.
  *
  * Locality: any thread
  *
  * NOTE: rd_kafka_wrlock() MUST be held
  */
 void rd_kafka_transport_ssl_ctx_term (rd_kafka_t *rk) {
-	SSL_CTX_free(rk->rk_conf.ssl.ctx);
+        rd_kafka_ssl_ctx_entry_t *ent;
+
+        mtx_lock(&rd_kafka_ssl_ctx_cache_lock);
+        TAILQ_FOREACH(ent, &rd_kafka_ssl_ctx_cache, link)
+                if (ent->ctx == rk->rk_conf.ssl.ctx)
+                        break;
+        rd_assert(ent);
+
+        if (--ent->refcnt > 0)
+                ent = NULL;
+        else
+                TAILQ_REMOVE(&rd_kafka_ssl_ctx_cache, ent, link);
+        mtx_unlock(&rd_kafka_ssl_ctx_cache_lock);
+
+        if (ent) {
+                SSL_CTX_free(ent->ctx);
+                rd_free(ent->key);
+                rd_free(ent);
+        }
+
 	rk->rk_conf.ssl.ctx = NULL;
 }
 
+
 /**
- * Once per rd_kafka_t handle initialization of OpenSSL
- *
- * Locality: application thread
+ * @brief Append \p name and \p val to the SSL context cache key.
+ *        If \p is_path is true the file's modification time and size
+ *        are included so that replaced certificate and key files are
+ *        loaded into a new context.
+ */
+static void rd_kafka_transport_ssl_ctx_key_add (char **keyp, size_t *lenp,
+                                                const char *name,
+                                                const char *val,
+                                                rd_bool_t is_path) {
+        char stamp[64] = "";
+        size_t size;
+
+        if (val && is_path) {
+#ifdef _MSC_VER
+                struct _stat st;
+                if (_stat(val, &st) == 0)
+#else
+                struct stat st;
+                if (stat(val, &st) == 0)
+#endif
+                        rd_snprintf(stamp, sizeof(stamp),
+                                    " (%"PRId64", %"PRId64")",
+                                    (int64_t)st.st_mtime,
+                                    (int64_t)st.st_size);
+        }
+
+        if (!val)
+                val = "";
+
+        size = strlen(name) + strlen(val) + strlen(stamp) + 3;
+        *keyp = rd_realloc(*keyp, *lenp + size);
+        *lenp += rd_snprintf(*keyp + *lenp, size, "%s=%s%s\n",
+                             name, val, stamp);
+}
+
+
+/**
+ * @returns the SSL context cache key for \p rk's effective ssl.*
+ *          configuration, which must be freed with rd_free().
+ */
+static char *rd_kafka_transport_ssl_ctx_key (rd_kafka_t *rk) {
+        const rd_kafka_conf_t *conf = &rk->rk_conf;
+        char *key = NULL;
+        size_t len = 0;
+
+        rd_kafka_transport_ssl_ctx_key_add(&key, &len, "cipher.suites",
+                                           conf->ssl.cipher_suites,
+                                           rd_false);
+#if OPENSSL_VERSION_NUMBER >= 0x1000200fL && !defined(LIBRESSL_VERSION_NUMBER)
+        rd_kafka_transport_ssl_ctx_key_add(&key, &len, "curves.list",
+                                           conf->ssl.curves_list, rd_false);
+        rd_kafka_transport_ssl_ctx_key_add(&key, &len, "sigalgs.list",
+                                           conf->ssl.sigalgs_list, rd_false);
+#endif
+        rd_kafka_transport_ssl_ctx_key_add(&key, &len, "key.location",
+                                           conf->ssl.key_location, rd_true);
+        rd_kafka_transport_ssl_ctx_key_add(&key, &len, "key.password",
+                                           conf->ssl.key_password, rd_false);
+        rd_kafka_transport_ssl_ctx_key_add(&key, &len, "certificate.location",
+                                           conf->ssl.cert_location, rd_true);
+        rd_kafka_transport_ssl_ctx_key_add(&key, &len, "ca.location",
+                                           conf->ssl.ca_location, rd_true);
+        rd_kafka_transport_ssl_ctx_key_add(&key, &len, "crl.location",
+                                           conf->ssl.crl_location, rd_true);
+        rd_kafka_transport_ssl_ctx_key_add(&key, &len, "keystore.location",
+                                           conf->ssl.keystore_location,
+                                           rd_true);
+        rd_kafka_transport_ssl_ctx_key_add(&key, &len, "keystore.password",
+                                           conf->ssl.keystore_password,
+                                           rd_false);
+        rd_kafka_transport_ssl_ctx_key_add(&key, &len, "ktls.enable",
+                                           conf->ssl.ktls_enable ?
+                                           "true" : "false", rd_false);
+        rd_kafka_transport_ssl_ctx_key_add(&key, &len,
+                                           "session.resumption.enable",
+                                           conf->ssl.session_resumption ?
+                                           "true" : "false", rd_false);
+
+        return key;
+}
+
+
+/**
+ * @returns the number of SSL contexts in the process-wide cache.
+ */
+static int rd_kafka_transport_ssl_ctx_cache_cnt (void) {
+        rd_kafka_ssl_ctx_entry_t *ent;
+        int cnt = 0;
+
+        mtx_lock(&rd_kafka_ssl_ctx_cache_lock);
+        TAILQ_FOREACH(ent, &rd_kafka_ssl_ctx_cache, link)
+                cnt++;
+        mtx_unlock(&rd_kafka_ssl_ctx_cache_lock);
+
+        return cnt;
+}
+
+
+/**
+ * @brief Create a new SSL context according to \p rk's configuration.
  *
- * NOTE: rd_kafka_wrlock() MUST be held
+ * @returns the new context, or NULL on failure in which case
+ *          \p errstr is set.
  */
-int rd_kafka_transport_ssl_ctx_init (rd_kafka_t *rk,
-				     char *errstr, size_t errstr_size) {
+static SSL_CTX *rd_kafka_transport_ssl_ctx_new (rd_kafka_t *rk,
+                                                char *errstr,
+                                                size_t errstr_size) {
 	int r;
 	SSL_CTX *ctx;
 
-#if OPENSSL_VERSION_NUMBER >= 0x10100000
-        rd_kafka_dbg(rk, SECURITY, "OPENSSL", "Using OpenSSL version %s "
-                     "(0x%lx, librdkafka built with 0x%lx)",
-                     OpenSSL_version(OPENSSL_VERSION),
-                     OpenSSL_version_num(),
-                     OPENSSL_VERSION_NUMBER);
-#else
-        rd_kafka_dbg(rk, SECURITY, "OPENSSL", "librdkafka built with OpenSSL "
-                     "version 0x%lx", OPENSSL_VERSION_NUMBER);
-#endif
-
         if (errstr_size > 0)
                 errstr[0] = '\0';
 
@@ -888,6 +1541,19 @@ int rd_kafka_transport_ssl_ctx_init (rd_kafka_t *rk,
 	SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv3);
 #endif
 
+        if (rk->rk_conf.ssl.ktls_enable) {
+#ifdef SSL_OP_ENABLE_KTLS
+                /* OpenSSL enables kTLS on the socket after the handshake
+                 * if the kernel supports the negotiated cipher. */
+                SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#else
+                rd_kafka_log(rk, LOG_WARNING, "KTLS",
+                             "ssl.ktls.enable is not supported by the "
+                             "OpenSSL version librdkafka was built with: "
+                             "ignoring");
+#endif
+        }
+
 	/* Key file password callback */
 	SSL_CTX_set_default_passwd_cb(ctx, rd_kafka_transport_ssl_passwd_cb);
 	SSL_CTX_set_default_passwd_cb_userdata(ctx, rk);
@@ -1086,8 +1752,24 @@ int rd_kafka_transport_ssl_ctx_init (rd_kafka_t *rk,
 
 	SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE);
 
-	rk->rk_conf.ssl.ctx = ctx;
-	return 0;
+        if (rk->rk_conf.ssl.session_resumption) {
+                /* Sessions are cached per broker by the new session
+                 * callback rather than in the SSL_CTX's internal cache,
+                 * which is keyed on the session id, see
+                 * rd_kafka_transport_ssl_session_set(). */
+                SSL_CTX_set_session_cache_mode(
+                        ctx,
+                        SSL_SESS_CACHE_CLIENT |
+                        SSL_SESS_CACHE_NO_INTERNAL_STORE);
+                SSL_CTX_sess_set_new_cb(
+                        ctx, rd_kafka_transport_ssl_session_new_cb);
+        }
+
+        /* The context is shared with other instances and may outlive
+         * this one. */
+        SSL_CTX_set_default_passwd_cb_userdata(ctx, NULL);
+
+	return ctx;
 
  fail:
         r = (int)strlen(errstr);
@@ -1095,7 +1777,73 @@ int rd_kafka_transport_ssl_ctx_init (rd_kafka_t *rk,
                            (int)errstr_size > r ? (int)errstr_size - r : 0);
 	SSL_CTX_free(ctx);
 
-	return -1;
+	return NULL;
+}
+
+
+/**
+ * Once per rd_kafka_t handle initialization of OpenSSL.
+ *
+ * Instances with the same effective ssl.* configuration share one
+ * refcounted SSL context, and thus certificate store, from a process-wide
+ * cache rather than loading the same CA bundle and keys again.
+ *
+ * Locality: application thread
+ *
+ * NOTE: rd_kafka_wrlock() MUST be held
+ */
+int rd_kafka_transport_ssl_ctx_init (rd_kafka_t *rk,
+				     char *errstr, size_t errstr_size) {
+        rd_kafka_ssl_ctx_entry_t *ent;
+        char *key;
+        int refcnt;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000
+        rd_kafka_dbg(rk, SECURITY, "OPENSSL", "Using OpenSSL version %s "
+                     "(0x%lx, librdkafka built with 0x%lx)",
+                     OpenSSL_version(OPENSSL_VERSION),
+                     OpenSSL_version_num(),
+                     OPENSSL_VERSION_NUMBER);
+#else
+        rd_kafka_dbg(rk, SECURITY, "OPENSSL", "librdkafka built with OpenSSL "
+                     "version 0x%lx", OPENSSL_VERSION_NUMBER);
+#endif
+
+        key = rd_kafka_transport_ssl_ctx_key(rk);
+
+        /* The lock is held while creating a new context so that instances
+         * created concurrently with the same configuration share it. */
+        mtx_lock(&rd_kafka_ssl_ctx_cache_lock);
+        TAILQ_FOREACH(ent, &rd_kafka_ssl_ctx_cache, link)
+                if (!strcmp(ent->key, key))
+                        break;
+
+        if (ent) {
+                rd_free(key);
+        } else {
+                SSL_CTX *ctx = rd_kafka_transport_ssl_ctx_new(rk, errstr,
+                                                              errstr_size);
+                if (!ctx) {
+                        mtx_unlock(&rd_kafka_ssl_ctx_cache_lock);
+                        rd_free(key);
+                        return -1;
+                }
+
+                ent = rd_calloc(1, sizeof(*ent));
+                ent->key = key;
+                ent->ctx = ctx;
+                TAILQ_INSERT_TAIL(&rd_kafka_ssl_ctx_cache, ent, link);
+        }
+
+        refcnt = ++ent->refcnt;
+        rk->rk_conf.ssl.ctx = ent->ctx;
+        mtx_unlock(&rd_kafka_ssl_ctx_cache_lock);
+
+        rd_kafka_dbg(rk, SECURITY, "SSL",
+                     "%s SSL context (used by %d instance(s))",
+                     refcnt > 1 ? "Sharing" : "Created", refcnt);
+
+	return 0;
 }
 
 
@@ -1107,7 +1855,7 @@ rd_kafka_transport_send (rd_kafka_transport_t *rktrans,
                          rd_slice_t *slice, char *errstr, size_t errstr_size) {
 
 #if WITH_SSL
-        if (rktrans->rktrans_ssl)
+        if (rktrans->rktrans_ssl && !rktrans->rktrans_ssl_ktls_tx)
                 return rd_kafka_transport_ssl_send(rktrans, slice,
                                                    errstr, errstr_size);
         else
@@ -1148,6 +1896,14 @@ void rd_kafka_transport_request_sent (rd_kafka_broker_t *rkb,
                 rkbuf->rkbuf_reqhdr.ApiVersion,
                 rkbuf->rkbuf_corrid,
                 rd_slice_size(&rkbuf->rkbuf_reader));
+
+#if WITH_SSL
+        if (rktrans->rktrans_ssl && !rktrans->rktrans_ssl_ktls_tx) {
+                rd_avg_add(&rkb->rkb_avg_tls_records,
+                           rktrans->rktrans_ssl_wr.records);
+                rktrans->rktrans_ssl_wr.records = 0;
+        }
+#endif
 }
 
 
@@ -1327,7 +2083,25 @@ static void rd_kafka_transport_connected (rd_kafka_transport_t *rktrans) {
                         rd_rkb_log(rkb, LOG_WARNING, "NAGLE",
                                    "Failed to disable Nagle (TCP_NODELAY) "
                                    "on socket: %s",
-                                   socket_strerror(socket_errno));
+                                   rd_strerror(socket_errno));
+        }
+#endif
+
+#if WITH_ZEROCOPY
+        /* MSG_ZEROCOPY is only used by the plain socket send path. */
+        if (rkb->rkb_rk->rk_conf.socket_zerocopy_enable &&
+            rkb->rkb_proto != RD_KAFKA_PROTO_SSL &&
+            rkb->rkb_proto != RD_KAFKA_PROTO_SASL_SSL) {
+                int one = 1;
+                if (setsockopt(rktrans->rktrans_s, SOL_SOCKET, SO_ZEROCOPY,
+                               (void *)&one, sizeof(one)) == SOCKET_ERROR) {
+                        rd_atomic64_add(&rkb->rkb_c.zc_tx_fallback, 1);
+                        rd_rkb_dbg(rkb, BROKER, "ZEROCOPY",
+                                   "Failed to enable SO_ZEROCOPY "
+                                   "on socket: %s: sends will be copied",
+                                   rd_strerror(socket_errno));
+                } else
+                        rktrans->rktrans_zc.enabled = rd_true;
         }
 #endif
 
@@ -1460,6 +2234,13 @@ static void rd_kafka_transport_io_event (rd_kafka_transport_t *rktrans,
 	case RD_KAFKA_BROKER_STATE_UP:
 	case RD_KAFKA_BROKER_STATE_UPDATE:
 
+#if WITH_ZEROCOPY
+                /* Zero-copy completion notifications are signalled
+                 * through the socket's error queue. */
+                if ((events & POLLERR) && rktrans->rktrans_zc.pending_cnt > 0)
+                        rd_kafka_transport_zc_reap(rktrans);
+#endif
+
 		if (events & POLLIN) {
 			while (rkb->rkb_state >= RD_KAFKA_BROKER_STATE_UP &&
 			       rd_kafka_recv(rkb) > 0)
@@ -1492,14 +2273,12 @@ static void rd_kafka_transport_io_event (rd_kafka_transport_t *rktrans,
 
 
 /**
- * Poll and serve IOs
+ * @brief Update and return the socket events (POLLIN, POLLOUT) to wait for.
  *
- * Locality: broker thread 
+ * Locality: broker thread
  */
-void rd_kafka_transport_io_serve (rd_kafka_transport_t *rktrans,
-                                  int timeout_ms) {
+int rd_kafka_transport_poll_events (rd_kafka_transport_t *rktrans) {
 	rd_kafka_broker_t *rkb = rktrans->rktrans_rkb;
-	int events;
 
         if (rkb->rkb_state == RD_KAFKA_BROKER_STATE_CONNECT ||
             (rkb->rkb_state > RD_KAFKA_BROKER_STATE_CONNECT &&
@@ -1507,6 +2286,52 @@ void rd_kafka_transport_io_serve (rd_kafka_transport_t *rktrans,
              rd_kafka_bufq_cnt(&rkb->rkb_outbufs) > 0))
                 rd_kafka_transport_poll_set(rkb->rkb_transport, POLLOUT);
 
+        return rktrans->rktrans_pfd[0].events;
+}
+
+
+/**
+ * @brief Serve socket \p events that were polled by someone else,
+ *        i.e., the broker's reactor.
+ *
+ * Locality: broker thread
+ */
+void rd_kafka_transport_io_events (rd_kafka_transport_t *rktrans,
+                                   int events) {
+        rd_atomic64_add(&rktrans->rktrans_rkb->rkb_c.wakeups, 1);
+
+        rd_kafka_transport_poll_clear(rktrans, POLLOUT);
+
+#if WITH_IO_URING
+        if (rktrans->rktrans_uring &&
+            (events & (POLLIN|POLLOUT)) == (POLLIN|POLLOUT)) {
+                rd_kafka_broker_t *rkb = rktrans->rktrans_rkb;
+
+                /* The send completion and the response may have been
+                 * reaped together: pick up the send first so that
+                 * the request is awaiting its response. */
+                rd_kafka_transport_io_event(rktrans, POLLOUT);
+                if (rkb->rkb_transport != rktrans)
+                        return; /* Connection closed */
+                events &= ~POLLOUT;
+        }
+#endif
+
+	rd_kafka_transport_io_event(rktrans, events);
+}
+
+
+/**
+ * Poll and serve IOs
+ *
+ * Locality: broker thread 
+ */
+void rd_kafka_transport_io_serve (rd_kafka_transport_t *rktrans,
+                                  int timeout_ms) {
+	int events;
+
+        rd_kafka_transport_poll_events(rktrans);
+
 	if ((events = rd_kafka_transport_poll(rktrans, timeout_ms)) <= 0)
                 return;
 
@@ -1557,7 +2382,7 @@ rd_kafka_transport_t *rd_kafka_transport_connect (rd_kafka_broker_t *rkb,
                                (void *)&on, sizeof(on)) == SOCKET_ERROR)
                         rd_rkb_dbg(rkb, BROKER, "SOCKET",
                                    "Failed to set SO_KEEPALIVE: %s",
-                                   socket_strerror(socket_errno));
+                                   rd_strerror(socket_errno));
         }
 #endif
 
@@ -1715,3 +2540,869 @@ void rd_kafka_transport_init(void) {
 	(void)WSAStartup(MAKEWORD(2, 2), &d);
 #endif
 }
+
+
+
+/**
+ * @name Unit tests
+ */
+
+#if WITH_ZEROCOPY
+#include <netinet/in.h>
+
+static int ut_zc_cb_cnt;
+static rd_kafka_resp_err_t ut_zc_cb_err;
+
+static void ut_zc_resp_cb (rd_kafka_t *rk, rd_kafka_broker_t *rkb,
+                           rd_kafka_resp_err_t err,
+                           rd_kafka_buf_t *response, rd_kafka_buf_t *request,
+                           void *opaque) {
+        ut_zc_cb_cnt++;
+        ut_zc_cb_err = err;
+}
+
+/**
+ * @brief Send \p rkbuf in full with rd_kafka_transport_socket_sendmsg(),
+ *        draining the peer socket \p peer as we go.
+ */
+static int ut_zc_send (rd_kafka_transport_t *rktrans, rd_kafka_buf_t *rkbuf,
+                       int peer) {
+        char errstr[128];
+        char buf[65536];
+        int i;
+
+        for (i = 0 ; i < 1000 &&
+                     rd_slice_remains(&rkbuf->rkbuf_reader) > 0 ; i++) {
+                ssize_t r = rd_kafka_transport_socket_sendmsg(
+                        rktrans, &rkbuf->rkbuf_reader, errstr, sizeof(errstr));
+                RD_UT_ASSERT(r >= 0, "send failed: %s", errstr);
+                while (rd_read(peer, buf, sizeof(buf)) > 0)
+                        ;
+        }
+
+        RD_UT_ASSERT(rd_slice_remains(&rkbuf->rkbuf_reader) == 0,
+                     "request not fully sent");
+        return 0;
+}
+
+static rd_kafka_buf_t *ut_zc_request (rd_kafka_broker_t *rkb, size_t size) {
+        rd_kafka_buf_t *rkbuf = rd_kafka_buf_new(1, size);
+        char *p = rd_malloc(size);
+
+        memset(p, 'z', size);
+        rd_kafka_buf_write(rkbuf, p, size);
+        rd_free(p);
+        rd_slice_init_full(&rkbuf->rkbuf_reader, &rkbuf->rkbuf_buf);
+        rkbuf->rkbuf_cb = ut_zc_resp_cb;
+        rd_kafka_bufq_enq(&rkb->rkb_outbufs, rkbuf);
+
+        return rkbuf;
+}
+
+
+/**
+ * @brief MSG_ZEROCOPY sends over a TCP loopback connection: completion
+ *        tracking, response and timeout deferral and release on close.
+ */
+int unittest_transport_zc (void) {
+        rd_kafka_t *rk;
+        rd_kafka_conf_t *conf;
+        rd_kafka_broker_t *rkb;
+        rd_kafka_transport_t *rktrans;
+        rd_kafka_buf_t *req, *response;
+        struct sockaddr_in sin = { .sin_family = AF_INET };
+        socklen_t slen = sizeof(sin);
+        char errstr[256];
+        size_t sent, rcvd = 0;
+        int ls, cs, ps, one = 1;
+        int i;
+
+        conf = rd_kafka_conf_new();
+        rd_kafka_conf_set(conf, "socket.zerocopy.min.bytes", "1000", NULL, 0);
+        rk = rd_kafka_new(RD_KAFKA_PRODUCER, conf, errstr, sizeof(errstr));
+        RD_UT_ASSERT(rk, "Failed to create producer: %s", errstr);
+
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ls = socket(AF_INET, SOCK_STREAM, 0);
+        RD_UT_ASSERT(ls != -1 &&
+                     !bind(ls, (struct sockaddr *)&sin, sizeof(sin)) &&
+                     !listen(ls, 1) &&
+                     !getsockname(ls, (struct sockaddr *)&sin, &slen),
+                     "listen failed: %s", rd_strerror(errno));
+        cs = socket(AF_INET, SOCK_STREAM, 0);
+        RD_UT_ASSERT(!connect(cs, (struct sockaddr *)&sin, sizeof(sin)),
+                     "connect failed: %s", rd_strerror(errno));
+        ps = accept(ls, NULL, NULL);
+        RD_UT_ASSERT(ps != -1, "accept failed: %s", rd_strerror(errno));
+        rd_close(ls);
+        rd_fd_set_nonblocking(cs);
+        rd_fd_set_nonblocking(ps);
+
+        if (setsockopt(cs, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one))) {
+                RD_UT_WARN("SO_ZEROCOPY not supported: %s: skipping",
+                           rd_strerror(errno));
+                rd_close(cs);
+                rd_close(ps);
+                rd_kafka_destroy(rk);
+                RD_UT_PASS();
+        }
+
+        rkb = rd_calloc(1, sizeof(*rkb));
+        rkb->rkb_rk = rk;
+        rd_kafka_bufq_init(&rkb->rkb_outbufs);
+        rd_kafka_bufq_init(&rkb->rkb_waitresps);
+
+        rktrans = rd_calloc(1, sizeof(*rktrans));
+        rktrans->rktrans_rkb = rkb;
+        rktrans->rktrans_s = cs;
+        rktrans->rktrans_sndbuf_size = 1024*1024;
+        rktrans->rktrans_zc.enabled = rd_true;
+
+        /* Requests below socket.zerocopy.min.bytes are copied */
+        req = ut_zc_request(rkb, 100);
+        if (ut_zc_send(rktrans, req, ps))
+                return 1;
+        RD_UT_ASSERT(rd_atomic64_get(&rkb->rkb_c.zc_tx) == 0 &&
+                     rktrans->rktrans_zc.pending_cnt == 0,
+                     "small request should not be sent with MSG_ZEROCOPY");
+        rd_kafka_bufq_deq(&rkb->rkb_outbufs, req);
+        rd_kafka_buf_destroy(req);
+
+        /* Large request: every send is tracked until its notification */
+        req = ut_zc_request(rkb, 256*1024);
+        if (ut_zc_send(rktrans, req, ps))
+                return 1;
+        rd_kafka_bufq_deq(&rkb->rkb_outbufs, req);
+        RD_UT_ASSERT(rd_atomic64_get(&rkb->rkb_c.zc_tx) > 0 &&
+                     rd_atomic64_get(&rkb->rkb_c.zc_tx) ==
+                     rktrans->rktrans_zc.pending_cnt &&
+                     req->rkbuf_zc.pending ==
+                     rktrans->rktrans_zc.pending_cnt,
+                     "expected %d tracked sends, zc_tx is %"PRId64,
+                     req->rkbuf_zc.pending,
+                     rd_atomic64_get(&rkb->rkb_c.zc_tx));
+
+        /* The response is held back until the kernel is done with the
+         * request, unless that has already happened. */
+        response = rd_kafka_buf_new(1, 16);
+        if (!rd_kafka_transport_zc_defer(rktrans, req, 0, response))
+                rd_kafka_buf_callback(rk, rkb, 0, response, req);
+
+        for (i = 0 ; i < 100 && rktrans->rktrans_zc.pending_cnt > 0 ; i++) {
+                struct pollfd pfd = { .fd = cs, .events = 0 };
+                poll(&pfd, 1, 10);
+                rd_kafka_transport_zc_reap(rktrans);
+        }
+
+        RD_UT_ASSERT(rktrans->rktrans_zc.pending_cnt == 0,
+                     "%d sends still pending", rktrans->rktrans_zc.pending_cnt);
+        RD_UT_ASSERT(ut_zc_cb_cnt == 1,
+                     "expected response callback, not %d calls",
+                     ut_zc_cb_cnt);
+        RD_UT_SAY("%"PRId64" zero-copy send(s), %"PRId64" copied",
+                  rd_atomic64_get(&rkb->rkb_c.zc_tx),
+                  rd_atomic64_get(&rkb->rkb_c.zc_tx_copied));
+
+        /* A request timing out while its sends are pending has its
+         * callback held back just like a response.
+         * Loopback sends typically complete right away, so track a
+         * send that was never made and complete it by hand. */
+        req = ut_zc_request(rkb, 100);
+        rd_kafka_bufq_deq(&rkb->rkb_outbufs, req);
+        rd_kafka_transport_zc_add(rktrans, req);
+        RD_UT_ASSERT(rd_kafka_transport_zc_defer(
+                             rktrans, req, RD_KAFKA_RESP_ERR__TIMED_OUT,
+                             NULL),
+                     "timeout should be deferred while sends are pending");
+        RD_UT_ASSERT(ut_zc_cb_cnt == 1,
+                     "timeout callback called with sends pending");
+
+        rd_kafka_transport_zc_pop(rktrans, rd_false);
+        rktrans->rktrans_zc.seq_next--; /* Not a real send */
+
+        RD_UT_ASSERT(ut_zc_cb_cnt == 2 &&
+                     ut_zc_cb_err == RD_KAFKA_RESP_ERR__TIMED_OUT,
+                     "expected timeout callback on completion, "
+                     "not %d calls (%s)",
+                     ut_zc_cb_cnt, rd_kafka_err2name(ut_zc_cb_err));
+
+        /* Close with sends still queued in the kernel: the peer does
+         * not read, so the request is only partly sent and the rest of
+         * the data stays in the socket's send queue. */
+        req = ut_zc_request(rkb, 8*1024*1024);
+        for (i = 0 ; i < 1000 ; i++) {
+                ssize_t r = rd_kafka_transport_socket_sendmsg(
+                        rktrans, &req->rkbuf_reader, errstr, sizeof(errstr));
+                RD_UT_ASSERT(r >= 0, "send failed: %s", errstr);
+                if (r == 0)
+                        break;
+        }
+        sent = rd_slice_offset(&req->rkbuf_reader);
+        RD_UT_ASSERT(rd_slice_remains(&req->rkbuf_reader) > 0,
+                     "expected send queue to fill up");
+        rd_kafka_bufq_deq(&rkb->rkb_outbufs, req);
+        RD_UT_ASSERT(req->rkbuf_zc.pending > 0, "expected pending sends");
+
+        /* A response held back when the connection is closed is dropped
+         * and its request put back on the wait-response queue to be
+         * failed with the other in-flight requests. */
+        req->rkbuf_zc.deferred = rd_true;
+        req->rkbuf_zc.response = rd_kafka_buf_new(1, 16);
+
+        rd_kafka_transport_close(rktrans);
+
+        /* The connection is reset rather than closed gracefully, which
+         * would keep sending the queued data from the request's pages
+         * after they are freed. */
+        for (i = 0 ; i < 1000 ; i++) {
+                char buf[65536];
+                ssize_t r = rd_read(ps, buf, sizeof(buf));
+
+                if (r > 0) {
+                        rcvd += (size_t)r;
+                } else if (r == -1 && errno == EAGAIN) {
+                        struct pollfd pfd = { .fd = ps, .events = POLLIN };
+                        poll(&pfd, 1, 10);
+                } else {
+                        RD_UT_ASSERT(r == -1 && errno == ECONNRESET,
+                                     "expected connection reset, "
+                                     "not %s after %"PRIusz" bytes",
+                                     r == 0 ? "EOF" : rd_strerror(errno),
+                                     rcvd);
+                        break;
+                }
+        }
+        RD_UT_ASSERT(rcvd < sent,
+                     "%"PRIusz" of %"PRIusz" queued bytes "
+                     "sent after close", rcvd, sent);
+
+        RD_UT_ASSERT(ut_zc_cb_cnt == 2,
+                     "response should not be handled on close");
+        RD_UT_ASSERT(rd_kafka_bufq_cnt(&rkb->rkb_waitresps) == 1 &&
+                     TAILQ_FIRST(&rkb->rkb_waitresps.rkbq_bufs) == req &&
+                     req->rkbuf_zc.pending == 0 && !req->rkbuf_zc.deferred &&
+                     !req->rkbuf_zc.response,
+                     "request should be awaiting its response");
+        rd_kafka_bufq_deq(&rkb->rkb_waitresps, req);
+        rd_kafka_buf_destroy(req);
+
+        rd_close(ps);
+        rd_free(rkb);
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+#else /* !WITH_ZEROCOPY */
+
+int unittest_transport_zc (void) {
+        RD_UT_PASS();
+}
+
+#endif
+
+
+#if WITH_SSL
+#include <netinet/in.h>
+
+/**
+ * @brief Create a server SSL_CTX with a self-signed EC certificate.
+ */
+static SSL_CTX *ut_ssl_server_ctx (void) {
+        EVP_PKEY_CTX *kctx;
+        EVP_PKEY *pkey = NULL;
+        X509 *x509;
+        SSL_CTX *ctx;
+
+        kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+        if (!kctx || EVP_PKEY_keygen_init(kctx) != 1 ||
+            EVP_PKEY_CTX_set_ec_paramgen_curve_nid(
+                    kctx, NID_X9_62_prime256v1) != 1 ||
+            EVP_PKEY_keygen(kctx, &pkey) != 1) {
+                EVP_PKEY_CTX_free(kctx);
+                return NULL;
+        }
+        EVP_PKEY_CTX_free(kctx);
+
+        x509 = X509_new();
+        ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+        X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+        X509_gmtime_adj(X509_getm_notAfter(x509), 3600);
+#else
+        X509_gmtime_adj(X509_get_notBefore(x509), 0);
+        X509_gmtime_adj(X509_get_notAfter(x509), 3600);
+#endif
+        X509_set_pubkey(x509, pkey);
+        X509_NAME_add_entry_by_txt(X509_get_subject_name(x509), "CN",
+                                   MBSTRING_ASC,
+                                   (const unsigned char *)"localhost",
+                                   -1, -1, 0);
+        X509_set_issuer_name(x509, X509_get_subject_name(x509));
+        X509_sign(x509, pkey, EVP_sha256());
+
+        ctx = SSL_CTX_new(SSLv23_server_method());
+        if (ctx && (SSL_CTX_use_certificate(ctx, x509) != 1 ||
+                    SSL_CTX_use_PrivateKey(ctx, pkey) != 1)) {
+                SSL_CTX_free(ctx);
+                ctx = NULL;
+        }
+#ifdef SSL_OP_ENABLE_KTLS
+        if (ctx)
+                SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+
+        X509_free(x509);
+        EVP_PKEY_free(pkey);
+
+        return ctx;
+}
+
+
+/**
+ * @brief Connect \p rktrans to a new loopback TLS server connection
+ *        and perform the handshake as rd_kafka_transport_ssl_connect()
+ *        and rd_kafka_transport_ssl_handshake() would, but without
+ *        the broker state machine.
+ *
+ * @returns 0 on success or -1 on failure, with the server end of the
+ *          connection in \p ssslp and \p psp.
+ */
+static int ut_ssl_handshake (rd_kafka_transport_t *rktrans, SSL_CTX *sctx,
+                             SSL **ssslp, int *psp) {
+        rd_kafka_t *rk = rktrans->rktrans_rkb->rkb_rk;
+        struct sockaddr_in sin = { .sin_family = AF_INET };
+        socklen_t slen = sizeof(sin);
+        int ls, cs, ps;
+        int i, cdone = 0, sdone = 0;
+
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ls = socket(AF_INET, SOCK_STREAM, 0);
+        if (ls == -1 ||
+            bind(ls, (struct sockaddr *)&sin, sizeof(sin)) == -1 ||
+            listen(ls, 1) == -1 ||
+            getsockname(ls, (struct sockaddr *)&sin, &slen) == -1)
+                return -1;
+        cs = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(cs, (struct sockaddr *)&sin, sizeof(sin)) == -1)
+                return -1;
+        ps = accept(ls, NULL, NULL);
+        rd_close(ls);
+        if (ps == -1)
+                return -1;
+        rd_fd_set_nonblocking(cs);
+        rd_fd_set_nonblocking(ps);
+
+        rktrans->rktrans_s = cs;
+        rktrans->rktrans_ssl = SSL_new(rk->rk_conf.ssl.ctx);
+        SSL_set_fd(rktrans->rktrans_ssl, cs);
+        if (rk->rk_conf.ssl.session_resumption)
+                rd_kafka_transport_ssl_session_set(rktrans);
+
+        *psp = ps;
+        *ssslp = SSL_new(sctx);
+        SSL_set_fd(*ssslp, ps);
+
+        for (i = 0 ; i < 500 && !(cdone && sdone) ; i++) {
+                if (!cdone)
+                        cdone = SSL_connect(rktrans->rktrans_ssl) == 1;
+                if (!sdone)
+                        sdone = SSL_accept(*ssslp) == 1;
+                rd_usleep(1000, 0);
+        }
+        if (!cdone || !sdone)
+                return -1;
+
+        rd_kafka_transport_ssl_session_check(rktrans);
+        rd_kafka_transport_ssl_ktls_check(rktrans);
+
+        return 0;
+}
+
+
+/**
+ * @brief Request and response exchange over a loopback TLS connection
+ *        with ssl.ktls.enable: verifies the kTLS send path if the kernel
+ *        and OpenSSL support it, else the OpenSSL fallback.
+ */
+int unittest_transport_ktls (void) {
+        rd_kafka_t *rk;
+        rd_kafka_conf_t *conf;
+        rd_kafka_broker_t *rkb;
+        rd_kafka_transport_t *rktrans;
+        rd_kafka_buf_t *rkbuf;
+        rd_buf_t rbuf;
+        rd_slice_t slice;
+        SSL_CTX *sctx;
+        SSL *sssl;
+        char errstr[256];
+        static char small[10][1000], large[40000], in[60000];
+        size_t tot = 0, exp_tot;
+        int ps;
+        int i;
+
+        conf = rd_kafka_conf_new();
+        if (rd_kafka_conf_set(conf, "security.protocol", "ssl",
+                              errstr, sizeof(errstr)) ||
+            rd_kafka_conf_set(conf, "ssl.ktls.enable", "true",
+                              errstr, sizeof(errstr)))
+                RD_UT_FAIL("conf failed: %s", errstr);
+        rk = rd_kafka_new(RD_KAFKA_PRODUCER, conf, errstr, sizeof(errstr));
+        RD_UT_ASSERT(rk, "Failed to create producer: %s", errstr);
+
+        sctx = ut_ssl_server_ctx();
+        RD_UT_ASSERT(sctx, "Failed to create server SSL context");
+
+        rkb = rd_calloc(1, sizeof(*rkb));
+        rkb->rkb_rk = rk;
+
+        rktrans = rd_calloc(1, sizeof(*rktrans));
+        rktrans->rktrans_rkb = rkb;
+        rktrans->rktrans_sndbuf_size = 1024*1024;
+        rktrans->rktrans_rcvbuf_size = 1024*1024;
+
+        RD_UT_ASSERT(!ut_ssl_handshake(rktrans, sctx, &sssl, &ps),
+                     "TLS handshake failed: %s", rd_strerror(errno));
+
+        RD_UT_SAY("kTLS send %s, receive %s",
+                  rktrans->rktrans_ssl_ktls_tx ? "offloaded" : "OpenSSL",
+                  BIO_get_ktls_recv(SSL_get_rbio(rktrans->rktrans_ssl)) ?
+                  "offloaded" : "OpenSSL");
+
+        /* Request with small and large segments */
+        rkbuf = rd_kafka_buf_new(1, 0);
+        for (i = 0 ; i < 10 ; i++) {
+                memset(small[i], 'a' + i, sizeof(small[i]));
+                rd_buf_push(&rkbuf->rkbuf_buf, small[i], sizeof(small[i]),
+                            NULL);
+        }
+        memset(large, 'L', sizeof(large));
+        rd_buf_push(&rkbuf->rkbuf_buf, large, sizeof(large), NULL);
+        rd_slice_init_full(&rkbuf->rkbuf_reader, &rkbuf->rkbuf_buf);
+        exp_tot = rd_slice_size(&rkbuf->rkbuf_reader);
+
+        for (i = 0 ; i < 1000 && tot < exp_tot ; i++) {
+                int r;
+
+                RD_UT_ASSERT(rd_kafka_transport_send(rktrans,
+                                                     &rkbuf->rkbuf_reader,
+                                                     errstr,
+                                                     sizeof(errstr)) != -1,
+                             "send failed: %s", errstr);
+
+                while ((r = SSL_read(sssl, in + tot,
+                                     (int)(sizeof(in) - tot))) > 0)
+                        tot += (size_t)r;
+                rd_usleep(1000, 0);
+        }
+        RD_UT_ASSERT(tot == exp_tot,
+                     "received %"PRIusz"/%"PRIusz" bytes", tot, exp_tot);
+        for (i = 0 ; i < 10 ; i++)
+                RD_UT_ASSERT(in[i * 1000] == 'a' + i &&
+                             in[i * 1000 + 999] == 'a' + i,
+                             "segment %d mismatch", i);
+        RD_UT_ASSERT(in[10000] == 'L' && in[exp_tot - 1] == 'L',
+                     "large segment mismatch");
+
+        /* Small segments are coalesced unless the kernel encrypts */
+        RD_UT_ASSERT(rktrans->rktrans_ssl_ktls_tx ?
+                     rktrans->rktrans_ssl_wr.records == 0 :
+                     rktrans->rktrans_ssl_wr.records == 4,
+                     "unexpected TLS record count %d",
+                     rktrans->rktrans_ssl_wr.records);
+        rd_kafka_buf_destroy(rkbuf);
+
+        /* Response */
+        RD_UT_ASSERT(SSL_write(sssl, "response", 8) == 8,
+                     "server SSL_write failed");
+        rd_buf_init(&rbuf, 1, 64);
+        rd_buf_write_ensure(&rbuf, 64, 64);
+        for (i = 0 ; i < 1000 && rd_buf_len(&rbuf) < 8 ; i++) {
+                RD_UT_ASSERT(rd_kafka_transport_recv(rktrans, &rbuf, errstr,
+                                                     sizeof(errstr)) != -1,
+                             "recv failed: %s", errstr);
+                rd_usleep(1000, 0);
+        }
+        rd_slice_init_full(&slice, &rbuf);
+        RD_UT_ASSERT(rd_slice_read(&slice, in, 8) == 8 &&
+                     !memcmp(in, "response", 8), "response mismatch");
+        rd_buf_destroy(&rbuf);
+
+        rd_kafka_transport_close(rktrans);
+        SSL_free(sssl);
+        SSL_CTX_free(sctx);
+        rd_close(ps);
+        rd_kafka_transport_ssl_session_clear(rkb);
+        rd_free(rkb);
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Send \p rkbuf in full over the loopback TLS connection and
+ *        parse the TLS record headers the server end \p ps receives,
+ *        without decrypting them.
+ *
+ * @returns 0 on success, with the number of records and the largest
+ *          record's length in \p recordsp and \p maxlenp, else -1.
+ */
+static int ut_ssl_send_records (rd_kafka_transport_t *rktrans,
+                                rd_kafka_buf_t *rkbuf, int ps,
+                                int *recordsp, size_t *maxlenp) {
+        static char raw[128*1024];
+        size_t rawlen = 0, of = 0;
+        char errstr[256];
+        int i;
+
+        for (i = 0 ; i < 1000 &&
+                     rd_slice_remains(&rkbuf->rkbuf_reader) > 0 ; i++) {
+                if (rd_kafka_transport_send(rktrans, &rkbuf->rkbuf_reader,
+                                            errstr, sizeof(errstr)) == -1)
+                        return -1;
+        }
+        if (rd_slice_remains(&rkbuf->rkbuf_reader) > 0)
+                return -1;
+
+        for (i = 0 ; i < 100 ; i++) {
+                ssize_t r = rd_read(ps, raw + rawlen,
+                                    (int)(sizeof(raw) - rawlen));
+                if (r > 0)
+                        rawlen += (size_t)r;
+                else
+                        rd_usleep(1000, 0);
+        }
+
+        *recordsp = 0;
+        *maxlenp = 0;
+        while (of + 5 <= rawlen) {
+                size_t len = ((size_t)(unsigned char)raw[of+3] << 8) |
+                        (size_t)(unsigned char)raw[of+4];
+
+                if (raw[of] != SSL3_RT_APPLICATION_DATA)
+                        return -1;
+
+                (*recordsp)++;
+                if (len > *maxlenp)
+                        *maxlenp = len;
+                of += 5 + len;
+        }
+
+        return of == rawlen ? 0 : -1;
+}
+
+
+/**
+ * @brief Small segments are coalesced into few TLS records, and segments
+ *        larger than a TLS record are split into full-size records.
+ */
+int unittest_transport_ssl_coalesce (void) {
+        rd_kafka_t *rk;
+        rd_kafka_conf_t *conf;
+        rd_kafka_broker_t *rkb;
+        rd_kafka_transport_t *rktrans;
+        rd_kafka_buf_t *rkbuf;
+        SSL_CTX *sctx;
+        SSL *sssl;
+        char errstr[256];
+        static char small[200][100], large[40000];
+        size_t maxlen;
+        int records;
+        int ps;
+        int i;
+
+        conf = rd_kafka_conf_new();
+        if (rd_kafka_conf_set(conf, "security.protocol", "ssl",
+                              errstr, sizeof(errstr)))
+                RD_UT_FAIL("conf failed: %s", errstr);
+        rk = rd_kafka_new(RD_KAFKA_PRODUCER, conf, errstr, sizeof(errstr));
+        RD_UT_ASSERT(rk, "Failed to create producer: %s", errstr);
+
+        sctx = ut_ssl_server_ctx();
+        RD_UT_ASSERT(sctx, "Failed to create server SSL context");
+
+        rkb = rd_calloc(1, sizeof(*rkb));
+        rkb->rkb_rk = rk;
+
+        rktrans = rd_calloc(1, sizeof(*rktrans));
+        rktrans->rktrans_rkb = rkb;
+        rktrans->rktrans_sndbuf_size = 1024*1024;
+        rktrans->rktrans_rcvbuf_size = 1024*1024;
+
+        RD_UT_ASSERT(!ut_ssl_handshake(rktrans, sctx, &sssl, &ps),
+                     "TLS handshake failed: %s", rd_strerror(errno));
+
+        /* 200 segments of 100 bytes: one full-size record and one
+         * record with the remaining 3616 bytes, rather than 200. */
+        rkbuf = rd_kafka_buf_new(1, 0);
+        for (i = 0 ; i < 200 ; i++) {
+                memset(small[i], 'a' + (i % 26), sizeof(small[i]));
+                rd_buf_push(&rkbuf->rkbuf_buf, small[i], sizeof(small[i]),
+                            NULL);
+        }
+        rd_slice_init_full(&rkbuf->rkbuf_reader, &rkbuf->rkbuf_buf);
+
+        RD_UT_ASSERT(!ut_ssl_send_records(rktrans, rkbuf, ps,
+                                          &records, &maxlen),
+                     "failed to send small segments");
+        RD_UT_SAY("200 small segments sent in %d record(s), "
+                  "largest %"PRIusz" bytes", records, maxlen);
+        RD_UT_ASSERT(records == 2 &&
+                     rktrans->rktrans_ssl_wr.records == 2,
+                     "expected small segments in 2 records, not %d (%d)",
+                     records, rktrans->rktrans_ssl_wr.records);
+        RD_UT_ASSERT(maxlen > SSL3_RT_MAX_PLAIN_LENGTH &&
+                     maxlen <= SSL3_RT_MAX_ENCRYPTED_LENGTH,
+                     "expected a full-size record, largest is "
+                     "%"PRIusz" bytes", maxlen);
+        rd_kafka_buf_destroy(rkbuf);
+        rktrans->rktrans_ssl_wr.records = 0;
+
+        /* A 40000 byte segment is split into two full-size records and
+         * one with the remaining 7232 bytes. */
+        rkbuf = rd_kafka_buf_new(1, 0);
+        memset(large, 'L', sizeof(large));
+        rd_buf_push(&rkbuf->rkbuf_buf, large, sizeof(large), NULL);
+        rd_slice_init_full(&rkbuf->rkbuf_reader, &rkbuf->rkbuf_buf);
+
+        RD_UT_ASSERT(!ut_ssl_send_records(rktrans, rkbuf, ps,
+                                          &records, &maxlen),
+                     "failed to send large segment");
+        RD_UT_SAY("40000 byte segment sent in %d record(s), "
+                  "largest %"PRIusz" bytes", records, maxlen);
+        RD_UT_ASSERT(records == 3 &&
+                     rktrans->rktrans_ssl_wr.records == 3,
+                     "expected large segment in 3 records, not %d (%d)",
+                     records, rktrans->rktrans_ssl_wr.records);
+        RD_UT_ASSERT(maxlen <= SSL3_RT_MAX_ENCRYPTED_LENGTH,
+                     "record of %"PRIusz" bytes exceeds the maximum",
+                     maxlen);
+        rd_kafka_buf_destroy(rkbuf);
+
+        rd_kafka_transport_close(rktrans);
+        SSL_free(sssl);
+        SSL_CTX_free(sctx);
+        rd_close(ps);
+        rd_kafka_transport_ssl_session_clear(rkb);
+        rd_free(rkb);
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Reconnects to a loopback TLS server resume the session of the
+ *        previous connection, unless the broker address changed.
+ */
+int unittest_transport_ssl_session (void) {
+        rd_kafka_t *rk;
+        rd_kafka_conf_t *conf;
+        rd_kafka_broker_t *rkb;
+        SSL_CTX *sctx;
+        char errstr[256];
+        int i;
+        const struct {
+                int connect_epoch;
+                int exp_full;
+                int exp_resumed;
+        } exp[] = {
+                { 1, 1, 0 },  /* Initial connection */
+                { 1, 1, 1 },  /* Reconnect: resumed */
+                { 1, 1, 2 },  /* Reconnect: resumed with the new ticket */
+                { 2, 2, 2 },  /* Address changed: full handshake */
+        };
+
+        conf = rd_kafka_conf_new();
+        if (rd_kafka_conf_set(conf, "security.protocol", "ssl",
+                              errstr, sizeof(errstr)))
+                RD_UT_FAIL("conf failed: %s", errstr);
+        rk = rd_kafka_new(RD_KAFKA_PRODUCER, conf, errstr, sizeof(errstr));
+        RD_UT_ASSERT(rk, "Failed to create producer: %s", errstr);
+
+        sctx = ut_ssl_server_ctx();
+        RD_UT_ASSERT(sctx, "Failed to create server SSL context");
+
+        rkb = rd_calloc(1, sizeof(*rkb));
+        rkb->rkb_rk = rk;
+
+        for (i = 0 ; i < (int)RD_ARRAYSIZE(exp) ; i++) {
+                rd_kafka_transport_t *rktrans;
+                SSL *sssl;
+                char c;
+                int ps, j, r = -1;
+
+                rkb->rkb_connect_epoch = exp[i].connect_epoch;
+
+                rktrans = rd_calloc(1, sizeof(*rktrans));
+                rktrans->rktrans_rkb = rkb;
+
+                RD_UT_ASSERT(!ut_ssl_handshake(rktrans, sctx, &sssl, &ps),
+                             "#%d: TLS handshake failed", i);
+
+                /* With TLS 1.3 the session tickets follow the handshake
+                 * and are processed by SSL_read() */
+                RD_UT_ASSERT(SSL_write(sssl, "x", 1) == 1,
+                             "#%d: server SSL_write failed", i);
+                for (j = 0 ; j < 1000 && r != 1 ; j++) {
+                        r = SSL_read(rktrans->rktrans_ssl, &c, 1);
+                        rd_usleep(1000, 0);
+                }
+                RD_UT_ASSERT(r == 1, "#%d: SSL_read failed", i);
+
+                RD_UT_SAY("#%d: %s handshake with %s", i,
+                          SSL_session_reused(rktrans->rktrans_ssl) ?
+                          "resumed" : "full",
+                          SSL_get_version(rktrans->rktrans_ssl));
+
+                RD_UT_ASSERT(rd_atomic32_get(&rkb->rkb_c.
+                                             tls_full_handshakes) ==
+                             exp[i].exp_full &&
+                             rd_atomic32_get(&rkb->rkb_c.
+                                             tls_resumed_handshakes) ==
+                             exp[i].exp_resumed,
+                             "#%d: expected %d full and %d resumed "
+                             "handshakes, not %d and %d", i,
+                             exp[i].exp_full, exp[i].exp_resumed,
+                             rd_atomic32_get(&rkb->rkb_c.
+                                             tls_full_handshakes),
+                             rd_atomic32_get(&rkb->rkb_c.
+                                             tls_resumed_handshakes));
+                RD_UT_ASSERT(rkb->rkb_ssl_session.session,
+                             "#%d: expected a cached session", i);
+
+                rd_kafka_transport_close(rktrans);
+                SSL_free(sssl);
+                rd_close(ps);
+        }
+
+        rd_kafka_transport_ssl_session_clear(rkb);
+        SSL_CTX_free(sctx);
+        rd_free(rkb);
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Create a producer with security.protocol=ssl and, if \p name
+ *        is set, the \p name property set to \p val.
+ */
+static rd_kafka_t *ut_ssl_producer (const char *name, const char *val) {
+        rd_kafka_conf_t *conf = rd_kafka_conf_new();
+        char errstr[256];
+
+        if (rd_kafka_conf_set(conf, "security.protocol", "ssl",
+                              errstr, sizeof(errstr)) ||
+            (name && rd_kafka_conf_set(conf, name, val,
+                                       errstr, sizeof(errstr)))) {
+                RD_UT_WARN("conf failed: %s", errstr);
+                rd_kafka_conf_destroy(conf);
+                return NULL;
+        }
+
+        return rd_kafka_new(RD_KAFKA_PRODUCER, conf, errstr, sizeof(errstr));
+}
+
+
+/**
+ * @brief Instances with the same ssl.* configuration share the SSL context,
+ *        which is freed along with the last instance.
+ */
+int unittest_transport_ssl_ctx (void) {
+        rd_kafka_t *rk[6];
+        int cnt0 = rd_kafka_transport_ssl_ctx_cache_cnt();
+        int i;
+#ifndef _MSC_VER
+        SSL_CTX *sctx;
+        char path[] = "/tmp/rdkafka_ut_ssl_ctx_XXXXXX";
+        FILE *fp;
+        int fd;
+#endif
+
+        memset(rk, 0, sizeof(rk));
+
+        /* Same configuration */
+        rk[0] = ut_ssl_producer(NULL, NULL);
+        rk[1] = ut_ssl_producer(NULL, NULL);
+        RD_UT_ASSERT(rk[0] && rk[1], "Failed to create producers");
+        RD_UT_ASSERT(rk[0]->rk_conf.ssl.ctx == rk[1]->rk_conf.ssl.ctx,
+                     "expected shared SSL context");
+
+        /* Different configuration */
+        rk[2] = ut_ssl_producer("ssl.cipher.suites", "HIGH");
+        RD_UT_ASSERT(rk[2], "Failed to create producer");
+        RD_UT_ASSERT(rk[2]->rk_conf.ssl.ctx != rk[0]->rk_conf.ssl.ctx,
+                     "expected separate SSL context");
+        RD_UT_ASSERT(rd_kafka_transport_ssl_ctx_cache_cnt() == cnt0 + 2,
+                     "expected %d cached SSL contexts, not %d",
+                     cnt0 + 2, rd_kafka_transport_ssl_ctx_cache_cnt());
+
+#ifndef _MSC_VER
+        /* Same CA file, but modified between the second and third
+         * instance. */
+        sctx = ut_ssl_server_ctx();
+        RD_UT_ASSERT(sctx, "Failed to create server SSL context");
+        fd = mkstemp(path);
+        RD_UT_ASSERT(fd != -1, "mkstemp failed: %s", rd_strerror(errno));
+        fp = fdopen(fd, "w");
+        PEM_write_X509(fp, SSL_CTX_get0_certificate(sctx));
+        fflush(fp);
+
+        rk[3] = ut_ssl_producer("ssl.ca.location", path);
+        rk[4] = ut_ssl_producer("ssl.ca.location", path);
+        PEM_write_X509(fp, SSL_CTX_get0_certificate(sctx));
+        fclose(fp);
+        rk[5] = ut_ssl_producer("ssl.ca.location", path);
+        unlink(path);
+        SSL_CTX_free(sctx);
+
+        RD_UT_ASSERT(rk[3] && rk[4] && rk[5], "Failed to create producers");
+        RD_UT_ASSERT(rk[3]->rk_conf.ssl.ctx == rk[4]->rk_conf.ssl.ctx,
+                     "expected shared SSL context");
+        RD_UT_ASSERT(rk[5]->rk_conf.ssl.ctx != rk[3]->rk_conf.ssl.ctx,
+                     "expected new SSL context for modified CA file");
+        RD_UT_ASSERT(rd_kafka_transport_ssl_ctx_cache_cnt() == cnt0 + 4,
+                     "expected %d cached SSL contexts, not %d",
+                     cnt0 + 4, rd_kafka_transport_ssl_ctx_cache_cnt());
+#endif
+
+        /* The context is kept until its last instance is destroyed */
+        rd_kafka_destroy(rk[0]);
+        rk[0] = NULL;
+        RD_UT_ASSERT(rd_kafka_transport_ssl_ctx_cache_cnt() ==
+                     cnt0 + (rk[3] ? 4 : 2),
+                     "shared SSL context freed with first instance");
+
+        for (i = 1 ; i < (int)RD_ARRAYSIZE(rk) ; i++)
+                if (rk[i])
+                        rd_kafka_destroy(rk[i]);
+
+        RD_UT_ASSERT(rd_kafka_transport_ssl_ctx_cache_cnt() == cnt0,
+                     "expected %d cached SSL contexts, not %d",
+                     cnt0, rd_kafka_transport_ssl_ctx_cache_cnt());
+
+        RD_UT_PASS();
+}
+
+#else /* !WITH_SSL */
+
+int unittest_transport_ssl_ctx (void) {
+        RD_UT_PASS();
+}
+
+int unittest_transport_ktls (void) {
+        RD_UT_PASS();
+}
+
+int unittest_transport_ssl_coalesce (void) {
+        RD_UT_PASS();
+}
+
+int unittest_transport_ssl_session (void) {
+        RD_UT_PASS();
+}
+
+#endif
@@ -40,6 +40,9 @@ typedef struct rd_kafka_transport_s rd_kafka_transport_t;
 
 void rd_kafka_transport_io_serve (rd_kafka_transport_t *rktrans,
                                   int timeout_ms);
+int rd_kafka_transport_poll_events (rd_kafka_transport_t *rktrans);
+void rd_kafka_transport_io_events (rd_kafka_transport_t *rktrans,
+                                   int events);
 
 ssize_t rd_kafka_transport_send (rd_kafka_transport_t *rktrans,
                                  rd_slice_t *slice,
@@ -50,6 +53,10 @@ ssize_t rd_kafka_transport_recv (rd_kafka_transport_t *rktrans,
 
 void rd_kafka_transport_request_sent (rd_kafka_broker_t *rkb,
                                       rd_kafka_buf_t *rkbuf);
+int rd_kafka_transport_zc_defer (rd_kafka_transport_t *rktrans,
+                                 rd_kafka_buf_t *req,
+                                 rd_kafka_resp_err_t err,
+                                 rd_kafka_buf_t *response);
 
 int rd_kafka_transport_framed_recv (rd_kafka_transport_t *rktrans,
                                     rd_kafka_buf_t **rkbufp,
@@ -70,10 +77,18 @@ void rd_kafka_transport_ssl_ctx_term (rd_kafka_t *rk);
 int rd_kafka_transport_ssl_ctx_init (rd_kafka_t *rk,
 				     char *errstr, size_t errstr_size);
 
+void rd_kafka_transport_ssl_session_clear (struct rd_kafka_broker_s *rkb);
+
 void rd_kafka_transport_ssl_term (void);
 void rd_kafka_transport_ssl_init (void);
 #endif
 void rd_kafka_transport_term (void);
 void rd_kafka_transport_init(void);
 
+int unittest_transport_zc (void);
+int unittest_transport_ktls (void);
+int unittest_transport_ssl_coalesce (void);
+int unittest_transport_ssl_session (void);
+int unittest_transport_ssl_ctx (void);
+
 #endif /* _RDKAFKA_TRANSPORT_H_ */
@@ -32,6 +32,7 @@
  * rd_kafka_transport_t struct internals. */
 
 #include "rdkafka_sasl.h"
+#include "rdkafka_uring.h"
 
 #if WITH_SSL
 #include <openssl/ssl.h>
@@ -46,6 +47,23 @@ struct rd_kafka_transport_s {
 
 #if WITH_SSL
 	SSL *rktrans_ssl;
+
+        /**< TLS record coalescing, see rd_kafka_transport_ssl_send() */
+        struct {
+                char   *buf;          /**< Staging buffer of one record's
+                                       *   worth of plaintext, allocated
+                                       *   on first use. */
+                size_t  len;          /**< Staged bytes awaiting a
+                                       *   (retried) SSL_write() */
+                const rd_slice_t *slice; /**< Slice the staged bytes were
+                                          *   gathered from ... */
+                size_t  of;           /**< ... at this slice offset */
+                int     records;      /**< Records written for the
+                                       *   current request */
+        } rktrans_ssl_wr;
+
+        rd_bool_t rktrans_ssl_ktls_tx; /**< Kernel TLS encrypts writes:
+                                        *   SSL_write() is bypassed. */
 #endif
 
 	struct {
@@ -82,6 +100,28 @@ struct rd_kafka_transport_s {
 
         size_t rktrans_rcvbuf_size;    /**< Socket receive buffer size */
         size_t rktrans_sndbuf_size;    /**< Socket send buffer size */
+
+        /**< MSG_ZEROCOPY state, see rd_kafka_transport_zc_reap() */
+        struct {
+                rd_bool_t enabled;    /**< SO_ZEROCOPY is set on socket */
+                uint32_t  seq_next;   /**< Sequence number (counted by the
+                                       *   kernel) of the next zero-copy
+                                       *   send. */
+                struct {
+                        uint32_t seq;
+                        rd_kafka_buf_t *rkbuf;
+                } *pending;           /**< Sends awaiting their completion
+                                       *   notification, in send order. */
+                int pending_cnt;
+                int pending_size;
+        } rktrans_zc;
+
+#if WITH_IO_URING
+        rd_kafka_uring_conn_t *rktrans_uring; /**< Data transfers are
+                                               *   performed through the
+                                               *   reactor's io_uring,
+                                               *   see rdkafka_uring.h */
+#endif
 };
 
 #endif /* _RDKAFKA_TRANSPORT_INT_H_ */
@@ -0,0 +1,801 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2019 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * io_uring broker socket I/O, see rdkafka_uring.h
+ */
+
+#include "rdkafka_int.h"
+#include "rdkafka_broker.h"
+#include "rdkafka_buf.h"
+#include "rdkafka_uring.h"
+#include "rdunittest.h"
+
+#if WITH_IO_URING
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+
+/**< Submission queue size */
+#define RD_KAFKA_URING_ENTRIES     256
+
+/**< Number and size of the receive buffers registered with the ring,
+ *   connections beyond this count receive into unregistered buffers. */
+#define RD_KAFKA_URING_RECV_SLOTS  32
+#define RD_KAFKA_URING_RECV_SIZE   (64 * 1024)
+
+/**< Operation type, kept in the low bits of the SQE user_data
+ *   which otherwise holds the connection pointer. */
+#define RD_KAFKA_URING_OP_RECV     0x1
+#define RD_KAFKA_URING_OP_SEND     0x2
+#define RD_KAFKA_URING_OP_MASK     0x3
+
+
+struct rd_kafka_uring_s {
+        rd_kafka_t *rkur_rk;
+        int         rkur_fd;
+
+        /* Submission queue */
+        void       *rkur_sq_ptr;
+        size_t      rkur_sq_size;
+        unsigned   *rkur_sq_head;
+        unsigned   *rkur_sq_tail;
+        unsigned    rkur_sq_mask;
+        unsigned    rkur_sq_entries;
+        unsigned   *rkur_sq_array;
+        struct io_uring_sqe *rkur_sqes;
+        size_t      rkur_sqes_size;
+        unsigned    rkur_sqe_tail;     /**< Tail including SQEs that are
+                                        *   prepared but not yet
+                                        *   submitted. */
+
+        /* Completion queue */
+        void       *rkur_cq_ptr;       /**< Same as rkur_sq_ptr with
+                                        *   IORING_FEAT_SINGLE_MMAP */
+        size_t      rkur_cq_size;
+        unsigned   *rkur_cq_head;
+        unsigned   *rkur_cq_tail;
+        unsigned    rkur_cq_mask;
+        struct io_uring_cqe *rkur_cqes;
+
+        /* Registered receive buffers */
+        char       *rkur_slots;        /**< Buffer memory, or NULL if
+                                        *   registration failed. */
+        int         rkur_free_slots[RD_KAFKA_URING_RECV_SLOTS];
+        int         rkur_free_slot_cnt;
+
+        /**< Closed connections waiting for their outstanding
+         *   operations to complete. */
+        TAILQ_HEAD(, rd_kafka_uring_conn_s) rkur_closing;
+        int         rkur_conn_cnt;     /**< Open and closing connections */
+};
+
+
+struct rd_kafka_uring_conn_s {
+        TAILQ_ENTRY(rd_kafka_uring_conn_s) rkuc_link; /**< rkur_closing */
+        rd_kafka_uring_t  *rkuc_rkur;
+        rd_kafka_broker_t *rkuc_rkb;       /**< NULL once closed */
+        int                rkuc_fd;
+        int                rkuc_inflight;  /**< Outstanding operations */
+
+        /* Receive state */
+        int        rkuc_slot;         /**< Registered buffer index, or -1 */
+        char      *rkuc_rbuf;         /**< Receive buffer */
+        size_t     rkuc_rsize;        /**< Receive buffer size */
+        size_t     rkuc_rof;          /**< Consumed offset in rkuc_rbuf */
+        size_t     rkuc_rlen;         /**< Received length in rkuc_rbuf */
+        int        rkuc_rerr;         /**< Receive errno, ECONNRESET on
+                                       *   disconnect. */
+        rd_bool_t  rkuc_recv_posted;  /**< Receive in flight */
+
+        /* Send state */
+        rd_kafka_buf_t *rkuc_send_rkbuf; /**< Request being sent (refcnt) */
+        size_t     rkuc_send_remains; /**< Request bytes remaining
+                                       *   when submitted. */
+        int        rkuc_send_res;     /**< Send result */
+        rd_bool_t  rkuc_send_posted;  /**< Send in flight */
+        rd_bool_t  rkuc_send_done;    /**< Send completed but the result
+                                       *   is not yet consumed. */
+        struct msghdr rkuc_msg;
+        struct iovec  rkuc_iov[IOV_MAX];
+};
+
+
+
+static int rd_kafka_uring_enter (rd_kafka_uring_t *rkur, unsigned to_submit,
+                                 unsigned min_complete, unsigned flags) {
+        return (int)syscall(__NR_io_uring_enter, rkur->rkur_fd,
+                            to_submit, min_complete, flags, NULL, 0);
+}
+
+
+/**
+ * @brief Register the receive buffers with the ring.
+ *        Failure (e.g., due to RLIMIT_MEMLOCK) is not fatal, the
+ *        connections will then receive into unregistered buffers.
+ */
+static void rd_kafka_uring_slots_register (rd_kafka_uring_t *rkur) {
+        struct iovec iov[RD_KAFKA_URING_RECV_SLOTS];
+        int i;
+
+        rkur->rkur_slots = rd_malloc(RD_KAFKA_URING_RECV_SLOTS *
+                                     RD_KAFKA_URING_RECV_SIZE);
+
+        for (i = 0 ; i < RD_KAFKA_URING_RECV_SLOTS ; i++) {
+                iov[i].iov_base = rkur->rkur_slots +
+                        (i * RD_KAFKA_URING_RECV_SIZE);
+                iov[i].iov_len = RD_KAFKA_URING_RECV_SIZE;
+        }
+
+        if (syscall(__NR_io_uring_register, rkur->rkur_fd,
+                    IORING_REGISTER_BUFFERS, iov,
+                    RD_KAFKA_URING_RECV_SLOTS) == -1) {
+                rd_kafka_dbg(rkur->rkur_rk, BROKER, "URING",
+                             "Failed to register io_uring receive "
+                             "buffers: %s: using unregistered buffers",
+                             rd_strerror(errno));
+                rd_free(rkur->rkur_slots);
+                rkur->rkur_slots = NULL;
+                return;
+        }
+
+        for (i = 0 ; i < RD_KAFKA_URING_RECV_SLOTS ; i++)
+                rkur->rkur_free_slots[i] = RD_KAFKA_URING_RECV_SLOTS - 1 - i;
+        rkur->rkur_free_slot_cnt = RD_KAFKA_URING_RECV_SLOTS;
+}
+
+
+static void rd_kafka_uring_destroy0 (rd_kafka_uring_t *rkur) {
+        if (rkur->rkur_sqes)
+                munmap(rkur->rkur_sqes, rkur->rkur_sqes_size);
+        if (rkur->rkur_cq_ptr && rkur->rkur_cq_ptr != rkur->rkur_sq_ptr)
+                munmap(rkur->rkur_cq_ptr, rkur->rkur_cq_size);
+        if (rkur->rkur_sq_ptr)
+                munmap(rkur->rkur_sq_ptr, rkur->rkur_sq_size);
+        if (rkur->rkur_fd != -1)
+                rd_close(rkur->rkur_fd);
+        if (rkur->rkur_slots)
+                rd_free(rkur->rkur_slots);
+        rd_free(rkur);
+}
+
+
+static void *rd_kafka_uring_mmap (rd_kafka_uring_t *rkur, size_t size,
+                                  off_t offset) {
+        void *p = mmap(NULL, size, PROT_READ|PROT_WRITE,
+                       MAP_SHARED|MAP_POPULATE, rkur->rkur_fd, offset);
+        return p == MAP_FAILED ? NULL : p;
+}
+
+
+/**
+ * @brief Set up a new io_uring instance.
+ *
+ * @returns the new ring, or NULL on failure (e.g., if io_uring is not
+ *          supported or permitted by the running kernel) in which case
+ *          \p errstr is set.
+ */
+rd_kafka_uring_t *rd_kafka_uring_new (rd_kafka_t *rk,
+                                      char *errstr, size_t errstr_size) {
+        rd_kafka_uring_t *rkur;
+        struct io_uring_params p;
+
+        rkur = rd_calloc(1, sizeof(*rkur));
+        rkur->rkur_rk = rk;
+        TAILQ_INIT(&rkur->rkur_closing);
+
+        memset(&p, 0, sizeof(p));
+        rkur->rkur_fd = (int)syscall(__NR_io_uring_setup,
+                                     RD_KAFKA_URING_ENTRIES, &p);
+        if (rkur->rkur_fd == -1) {
+                rd_snprintf(errstr, errstr_size,
+                            "io_uring_setup() failed: %s",
+                            rd_strerror(errno));
+                goto err;
+        }
+
+        rkur->rkur_sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        rkur->rkur_cq_size = p.cq_off.cqes +
+                p.cq_entries * sizeof(struct io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+                rkur->rkur_sq_size = rkur->rkur_cq_size =
+                        RD_MAX(rkur->rkur_sq_size, rkur->rkur_cq_size);
+
+        if (!(rkur->rkur_sq_ptr = rd_kafka_uring_mmap(rkur,
+                                                      rkur->rkur_sq_size,
+                                                      IORING_OFF_SQ_RING)))
+                goto err_mmap;
+
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+                rkur->rkur_cq_ptr = rkur->rkur_sq_ptr;
+        else if (!(rkur->rkur_cq_ptr =
+                   rd_kafka_uring_mmap(rkur, rkur->rkur_cq_size,
+                                       IORING_OFF_CQ_RING)))
+                goto err_mmap;
+
+        rkur->rkur_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+        if (!(rkur->rkur_sqes = rd_kafka_uring_mmap(rkur,
+                                                    rkur->rkur_sqes_size,
+                                                    IORING_OFF_SQES)))
+                goto err_mmap;
+
+#define _SQ(FIELD) (void *)((char *)rkur->rkur_sq_ptr + p.sq_off.FIELD)
+#define _CQ(FIELD) (void *)((char *)rkur->rkur_cq_ptr + p.cq_off.FIELD)
+        rkur->rkur_sq_head    = _SQ(head);
+        rkur->rkur_sq_tail    = _SQ(tail);
+        rkur->rkur_sq_mask    = *(unsigned *)_SQ(ring_mask);
+        rkur->rkur_sq_entries = *(unsigned *)_SQ(ring_entries);
+        rkur->rkur_sq_array   = _SQ(array);
+        rkur->rkur_sqe_tail   = *rkur->rkur_sq_tail;
+        rkur->rkur_cq_head    = _CQ(head);
+        rkur->rkur_cq_tail    = _CQ(tail);
+        rkur->rkur_cq_mask    = *(unsigned *)_CQ(ring_mask);
+        rkur->rkur_cqes       = _CQ(cqes);
+#undef _SQ
+#undef _CQ
+
+        rd_kafka_uring_slots_register(rkur);
+
+        return rkur;
+
+ err_mmap:
+        rd_snprintf(errstr, errstr_size,
+                    "Failed to map io_uring queues: %s", rd_strerror(errno));
+ err:
+        rd_kafka_uring_destroy0(rkur);
+        return NULL;
+}
+
+
+/**
+ * @returns the ring's fd which is readable when there are completions
+ *          to reap.
+ */
+int rd_kafka_uring_fd (rd_kafka_uring_t *rkur) {
+        return rkur->rkur_fd;
+}
+
+
+/**
+ * @brief Submit all prepared SQEs in a single system call.
+ */
+void rd_kafka_uring_submit (rd_kafka_uring_t *rkur) {
+        unsigned to_submit;
+        int r;
+
+        /* Make the prepared SQEs visible to the kernel, any SQEs left
+         * unconsumed by a previous failed submit are included. */
+        __atomic_store_n(rkur->rkur_sq_tail, rkur->rkur_sqe_tail,
+                         __ATOMIC_RELEASE);
+        to_submit = rkur->rkur_sqe_tail -
+                __atomic_load_n(rkur->rkur_sq_head, __ATOMIC_ACQUIRE);
+        if (!to_submit)
+                return;
+
+        while ((r = rd_kafka_uring_enter(rkur, to_submit, 0, 0)) == -1 &&
+               errno == EINTR)
+                ;
+
+        if (r == -1 && errno != EAGAIN && errno != EBUSY)
+                rd_kafka_log(rkur->rkur_rk, LOG_ERR, "URING",
+                             "io_uring submit of %u operation(s) "
+                             "failed: %s", to_submit, rd_strerror(errno));
+}
+
+
+/**
+ * @returns a zeroed SQE to prepare, or NULL if the submission queue
+ *          is still full after submitting it.
+ */
+static struct io_uring_sqe *rd_kafka_uring_get_sqe (rd_kafka_uring_t *rkur) {
+        struct io_uring_sqe *sqe;
+        unsigned idx;
+
+        if (rkur->rkur_sqe_tail -
+            __atomic_load_n(rkur->rkur_sq_head, __ATOMIC_ACQUIRE) >=
+            rkur->rkur_sq_entries) {
+                rd_kafka_uring_submit(rkur);
+                if (rkur->rkur_sqe_tail -
+                    __atomic_load_n(rkur->rkur_sq_head, __ATOMIC_ACQUIRE) >=
+                    rkur->rkur_sq_entries)
+                        return NULL;
+        }
+
+        idx = rkur->rkur_sqe_tail & rkur->rkur_sq_mask;
+        sqe = &rkur->rkur_sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        rkur->rkur_sq_array[idx] = idx;
+        rkur->rkur_sqe_tail++;
+
+        return sqe;
+}
+
+
+static void rd_kafka_uring_conn_destroy (rd_kafka_uring_conn_t *rkuc) {
+        rd_kafka_uring_t *rkur = rkuc->rkuc_rkur;
+
+        rd_dassert(rkuc->rkuc_inflight == 0);
+
+        if (rkuc->rkuc_send_rkbuf)
+                rd_kafka_buf_destroy(rkuc->rkuc_send_rkbuf);
+
+        if (rkuc->rkuc_slot != -1)
+                rkur->rkur_free_slots[rkur->rkur_free_slot_cnt++] =
+                        rkuc->rkuc_slot;
+        else
+                rd_free(rkuc->rkuc_rbuf);
+
+        rkur->rkur_conn_cnt--;
+        rd_free(rkuc);
+}
+
+
+/**
+ * @brief Handle the completion of a connection's receive or send.
+ */
+static void rd_kafka_uring_complete (rd_kafka_uring_t *rkur,
+                                     uint64_t user_data, int res) {
+        rd_kafka_uring_conn_t *rkuc = (rd_kafka_uring_conn_t *)
+                (uintptr_t)(user_data & ~(uint64_t)RD_KAFKA_URING_OP_MASK);
+        int revents;
+
+        rkuc->rkuc_inflight--;
+
+        if (user_data & RD_KAFKA_URING_OP_RECV) {
+                rkuc->rkuc_recv_posted = rd_false;
+                if (res > 0) {
+                        rkuc->rkuc_rof = 0;
+                        rkuc->rkuc_rlen = (size_t)res;
+                } else if (res == 0)
+                        rkuc->rkuc_rerr = ECONNRESET;
+                else if (res != -EAGAIN && res != -EINTR)
+                        rkuc->rkuc_rerr = -res;
+                revents = POLLIN;
+
+        } else {
+                rkuc->rkuc_send_posted = rd_false;
+                rkuc->rkuc_send_done = rd_true;
+                rkuc->rkuc_send_res = res;
+                revents = POLLOUT;
+        }
+
+        if (unlikely(!rkuc->rkuc_rkb)) {
+                /* Connection was closed */
+                if (!rkuc->rkuc_inflight) {
+                        TAILQ_REMOVE(&rkur->rkur_closing, rkuc, rkuc_link);
+                        rd_kafka_uring_conn_destroy(rkuc);
+                }
+                return;
+        }
+
+        rkuc->rkuc_rkb->rkb_reactor.sock.revents |= revents;
+}
+
+
+/**
+ * @brief Reap all available completions, the connection's broker
+ *        is marked with POLLIN or POLLOUT for completed receives and sends.
+ */
+void rd_kafka_uring_reap (rd_kafka_uring_t *rkur) {
+        unsigned head = *rkur->rkur_cq_head;
+        unsigned tail = __atomic_load_n(rkur->rkur_cq_tail, __ATOMIC_ACQUIRE);
+
+        for ( ; head != tail ; head++) {
+                const struct io_uring_cqe *cqe =
+                        &rkur->rkur_cqes[head & rkur->rkur_cq_mask];
+                rd_kafka_uring_complete(rkur, cqe->user_data, cqe->res);
+        }
+
+        __atomic_store_n(rkur->rkur_cq_head, head, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @brief Destroy the ring, waiting for the operations of closed
+ *        connections to complete.
+ */
+void rd_kafka_uring_destroy (rd_kafka_uring_t *rkur) {
+
+        while (!TAILQ_EMPTY(&rkur->rkur_closing)) {
+                rd_kafka_uring_submit(rkur);
+                if (rd_kafka_uring_enter(rkur, 0, 1,
+                                         IORING_ENTER_GETEVENTS) == -1 &&
+                    errno != EINTR)
+                        break;
+                rd_kafka_uring_reap(rkur);
+        }
+
+        rd_assert(rkur->rkur_conn_cnt == 0 ||
+                  !*"io_uring connections still open");
+
+        rd_kafka_uring_destroy0(rkur);
+}
+
+
+/**
+ * @brief Post a receive for the connection.
+ */
+static void rd_kafka_uring_conn_recv_post (rd_kafka_uring_conn_t *rkuc) {
+        struct io_uring_sqe *sqe;
+
+        if (!(sqe = rd_kafka_uring_get_sqe(rkuc->rkuc_rkur)))
+                return; /* Retried on the next conn_events() */
+
+        if (rkuc->rkuc_slot != -1) {
+                sqe->opcode = IORING_OP_READ_FIXED;
+                sqe->buf_index = (uint16_t)rkuc->rkuc_slot;
+        } else
+                sqe->opcode = IORING_OP_RECV;
+        sqe->fd = rkuc->rkuc_fd;
+        sqe->addr = (uint64_t)(uintptr_t)rkuc->rkuc_rbuf;
+        sqe->len = (uint32_t)rkuc->rkuc_rsize;
+        sqe->user_data = (uint64_t)(uintptr_t)rkuc | RD_KAFKA_URING_OP_RECV;
+
+        rkuc->rkuc_rof = rkuc->rkuc_rlen = 0;
+        rkuc->rkuc_recv_posted = rd_true;
+        rkuc->rkuc_inflight++;
+}
+
+
+/**
+ * @brief Attach the connected, non-blocking, socket \p fd of broker
+ *        \p rkb to the ring and post its first receive.
+ *
+ * @remark The caller must stop polling the socket for readiness.
+ */
+rd_kafka_uring_conn_t *rd_kafka_uring_conn_new (rd_kafka_uring_t *rkur,
+                                                rd_kafka_broker_t *rkb,
+                                                int fd) {
+        rd_kafka_uring_conn_t *rkuc;
+
+        rkuc = rd_calloc(1, sizeof(*rkuc));
+        rkuc->rkuc_rkur = rkur;
+        rkuc->rkuc_rkb = rkb;
+        rkuc->rkuc_fd = fd;
+        rkuc->rkuc_rsize = RD_KAFKA_URING_RECV_SIZE;
+
+        if (rkur->rkur_free_slot_cnt > 0) {
+                rkuc->rkuc_slot =
+                        rkur->rkur_free_slots[--rkur->rkur_free_slot_cnt];
+                rkuc->rkuc_rbuf = rkur->rkur_slots +
+                        (rkuc->rkuc_slot * RD_KAFKA_URING_RECV_SIZE);
+        } else {
+                rkuc->rkuc_slot = -1;
+                rkuc->rkuc_rbuf = rd_malloc(rkuc->rkuc_rsize);
+        }
+
+        rkur->rkur_conn_cnt++;
+
+        rd_kafka_uring_conn_recv_post(rkuc);
+
+        return rkuc;
+}
+
+
+/**
+ * @brief Detach the connection prior to its socket being closed.
+ *
+ * Outstanding operations are submitted and the socket is shut down
+ * to have them complete, the connection is then destroyed when reaped.
+ */
+void rd_kafka_uring_conn_close (rd_kafka_uring_conn_t *rkuc) {
+        rd_kafka_uring_t *rkur = rkuc->rkuc_rkur;
+
+        rkuc->rkuc_rkb = NULL;
+
+        if (!rkuc->rkuc_inflight) {
+                rd_kafka_uring_conn_destroy(rkuc);
+                return;
+        }
+
+        /* Submit now: the socket fd is about to be closed and
+         * its number reused. */
+        rd_kafka_uring_submit(rkur);
+        shutdown(rkuc->rkuc_fd, SHUT_RDWR);
+
+        TAILQ_INSERT_TAIL(&rkur->rkur_closing, rkuc, rkuc_link);
+}
+
+
+/**
+ * @brief Emulate readiness polling for the connection: \p events is
+ *        the POLLIN|POLLOUT interest.
+ *
+ * @returns POLLIN if there is received data (or an error) to be read,
+ *          POLLOUT if POLLOUT was requested and a send may be
+ *          submitted, else 0.
+ */
+int rd_kafka_uring_conn_events (rd_kafka_uring_conn_t *rkuc, int events) {
+        int revents = 0;
+
+        if (rkuc->rkuc_rof < rkuc->rkuc_rlen || rkuc->rkuc_rerr)
+                revents |= POLLIN;
+        else if (!rkuc->rkuc_recv_posted)
+                rd_kafka_uring_conn_recv_post(rkuc);
+
+        if ((events & POLLOUT) && !rkuc->rkuc_send_posted)
+                revents |= POLLOUT;
+
+        return revents;
+}
+
+
+/**
+ * @brief Read received data into \p rbuf without any system calls,
+ *        a new receive is posted when all received data has been read.
+ *
+ * @returns the number of bytes read, 0 if no data is available, or -1
+ *          on error or disconnect (\p errstr and errno set).
+ */
+ssize_t rd_kafka_uring_conn_recv (rd_kafka_uring_conn_t *rkuc,
+                                  rd_buf_t *rbuf,
+                                  char *errstr, size_t errstr_size) {
+        size_t len;
+
+        if (rkuc->rkuc_rof == rkuc->rkuc_rlen) {
+                if (unlikely(rkuc->rkuc_rerr != 0)) {
+                        if (rkuc->rkuc_rerr == ECONNRESET)
+                                rd_snprintf(errstr, errstr_size,
+                                            "Disconnected");
+                        else
+                                rd_snprintf(errstr, errstr_size, "%s",
+                                            rd_strerror(rkuc->rkuc_rerr));
+                        errno = rkuc->rkuc_rerr;
+                        return -1;
+                }
+
+                if (!rkuc->rkuc_recv_posted)
+                        rd_kafka_uring_conn_recv_post(rkuc);
+                return 0;
+        }
+
+        len = RD_MIN(rkuc->rkuc_rlen - rkuc->rkuc_rof,
+                     rd_buf_write_remains(rbuf));
+        rd_buf_write(rbuf, rkuc->rkuc_rbuf + rkuc->rkuc_rof, len);
+        rkuc->rkuc_rof += len;
+
+        if (rkuc->rkuc_rof == rkuc->rkuc_rlen)
+                rd_kafka_uring_conn_recv_post(rkuc);
+
+        return (ssize_t)len;
+}
+
+
+/**
+ * @brief Send from \p slice, which must be the reader of the request
+ *        at the head of the broker's output queue.
+ *
+ * The send is submitted asynchronously and 0 is returned, the
+ * completion triggers a POLLOUT event upon which the caller calls
+ * this function again with the same slice to pick up the result.
+ *
+ * @returns the number of bytes sent, 0 if the send is in progress,
+ *          or -1 on error (\p errstr and errno set).
+ */
+ssize_t rd_kafka_uring_conn_send (rd_kafka_uring_conn_t *rkuc,
+                                  rd_slice_t *slice, size_t max_bytes,
+                                  char *errstr, size_t errstr_size) {
+        rd_kafka_buf_t *rkbuf =
+                TAILQ_FIRST(&rkuc->rkuc_rkb->rkb_outbufs.rkbq_bufs);
+        struct io_uring_sqe *sqe;
+        size_t iovlen;
+
+        if (rkuc->rkuc_send_posted)
+                return 0;
+
+        if (rkuc->rkuc_send_done) {
+                rd_kafka_buf_t *sent_rkbuf = rkuc->rkuc_send_rkbuf;
+                int res = rkuc->rkuc_send_res;
+
+                rkuc->rkuc_send_rkbuf = NULL;
+                rkuc->rkuc_send_done = rd_false;
+
+                if (res < 0) {
+                        rd_kafka_buf_destroy(sent_rkbuf);
+                        rd_snprintf(errstr, errstr_size, "%s",
+                                    rd_strerror(-res));
+                        errno = -res;
+                        return -1;
+                }
+
+                if (likely(sent_rkbuf == rkbuf &&
+                           slice == &rkbuf->rkbuf_reader)) {
+                        rd_kafka_buf_destroy(sent_rkbuf);
+                        rd_slice_read(slice, NULL, (size_t)res);
+                        return res;
+                }
+
+                /* The request was removed from the output queue
+                 * (timed out or purged) while it was being sent. */
+                rd_kafka_buf_destroy(sent_rkbuf);
+                if ((size_t)res < rkuc->rkuc_send_remains) {
+                        rd_snprintf(errstr, errstr_size,
+                                    "Partially sent request was removed "
+                                    "from the output queue");
+                        errno = EIO;
+                        return -1;
+                }
+        }
+
+        rd_assert(rkbuf && slice == &rkbuf->rkbuf_reader);
+
+        if (!(sqe = rd_kafka_uring_get_sqe(rkuc->rkuc_rkur)))
+                return 0; /* Retried on the next POLLOUT */
+
+        rd_slice_get_iov(slice, rkuc->rkuc_iov, &iovlen, IOV_MAX, max_bytes);
+        rkuc->rkuc_msg.msg_iov = rkuc->rkuc_iov;
+        rkuc->rkuc_msg.msg_iovlen = iovlen;
+
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = rkuc->rkuc_fd;
+        sqe->addr = (uint64_t)(uintptr_t)&rkuc->rkuc_msg;
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = (uint64_t)(uintptr_t)rkuc | RD_KAFKA_URING_OP_SEND;
+
+        rd_kafka_buf_keep(rkbuf);
+        rkuc->rkuc_send_rkbuf = rkbuf;
+        rkuc->rkuc_send_remains = rd_slice_remains(slice);
+        rkuc->rkuc_send_posted = rd_true;
+        rkuc->rkuc_inflight++;
+
+        return 0;
+}
+
+
+/**
+ * @brief Submit and wait for (at most 1s) and reap completions.
+ */
+static void ut_uring_wait (rd_kafka_uring_t *rkur) {
+        struct pollfd pfd = { .fd = rkur->rkur_fd, .events = POLLIN };
+
+        rd_kafka_uring_submit(rkur);
+        poll(&pfd, 1, 1000);
+        rd_kafka_uring_reap(rkur);
+}
+
+
+/**
+ * @brief Receive, send, disconnect and close-while-in-flight over
+ *        a socketpair, with a dummy broker.
+ */
+int unittest_uring (void) {
+        rd_kafka_t *rk;
+        rd_kafka_uring_t *rkur;
+        rd_kafka_uring_conn_t *rkuc;
+        rd_kafka_broker_t *rkb;
+        rd_kafka_buf_t *rkbuf;
+        rd_buf_t rbuf;
+        rd_slice_t slice;
+        char errstr[256];
+        char buf[16];
+        int fds[2], fds2[2];
+        ssize_t r;
+
+        rk = rd_kafka_new(RD_KAFKA_PRODUCER, NULL, errstr, sizeof(errstr));
+        RD_UT_ASSERT(rk, "Failed to create producer: %s", errstr);
+
+        if (!(rkur = rd_kafka_uring_new(rk, errstr, sizeof(errstr)))) {
+                RD_UT_WARN("io_uring not available: %s: skipping", errstr);
+                rd_kafka_destroy(rk);
+                RD_UT_PASS();
+        }
+
+        RD_UT_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0 &&
+                     socketpair(AF_UNIX, SOCK_STREAM, 0, fds2) == 0,
+                     "socketpair() failed: %s", rd_strerror(errno));
+        rd_fd_set_nonblocking(fds[0]);
+
+        rkb = rd_calloc(1, sizeof(*rkb));
+        rd_kafka_bufq_init(&rkb->rkb_outbufs);
+        rd_buf_init(&rbuf, 1, 64);
+        rd_buf_write_ensure(&rbuf, 64, 64);
+
+        /* Receive */
+        rkuc = rd_kafka_uring_conn_new(rkur, rkb, fds[0]);
+        RD_UT_ASSERT(rd_kafka_uring_conn_events(rkuc, POLLIN) == 0,
+                     "expected no events before data is received");
+        RD_UT_ASSERT(rd_write(fds[1], "hello", 5) == 5, "write failed");
+        ut_uring_wait(rkur);
+        RD_UT_ASSERT(rkb->rkb_reactor.sock.revents == POLLIN,
+                     "expected POLLIN, not %d", rkb->rkb_reactor.sock.revents);
+        rkb->rkb_reactor.sock.revents = 0;
+
+        r = rd_kafka_uring_conn_recv(rkuc, &rbuf, errstr, sizeof(errstr));
+        RD_UT_ASSERT(r == 5, "expected 5 bytes received, not %"PRIdsz, r);
+        rd_slice_init_full(&slice, &rbuf);
+        rd_slice_read(&slice, buf, 5);
+        RD_UT_ASSERT(!memcmp(buf, "hello", 5), "received data mismatch");
+        r = rd_kafka_uring_conn_recv(rkuc, &rbuf, errstr, sizeof(errstr));
+        RD_UT_ASSERT(r == 0, "expected no more data, not %"PRIdsz, r);
+
+        /* Send */
+        rkbuf = rd_kafka_buf_new(1, 16);
+        rd_kafka_buf_write(rkbuf, "world", 5);
+        rd_slice_init_full(&rkbuf->rkbuf_reader, &rkbuf->rkbuf_buf);
+        rd_kafka_bufq_enq(&rkb->rkb_outbufs, rkbuf);
+
+        r = rd_kafka_uring_conn_send(rkuc, &rkbuf->rkbuf_reader, 1024,
+                                     errstr, sizeof(errstr));
+        RD_UT_ASSERT(r == 0, "expected send in progress, not %"PRIdsz, r);
+        RD_UT_ASSERT(rd_kafka_uring_conn_events(rkuc, POLLOUT) == 0,
+                     "expected no POLLOUT while send is in flight");
+        ut_uring_wait(rkur);
+        RD_UT_ASSERT(rkb->rkb_reactor.sock.revents == POLLOUT,
+                     "expected POLLOUT, not %d",
+                     rkb->rkb_reactor.sock.revents);
+        rkb->rkb_reactor.sock.revents = 0;
+
+        r = rd_kafka_uring_conn_send(rkuc, &rkbuf->rkbuf_reader, 1024,
+                                     errstr, sizeof(errstr));
+        RD_UT_ASSERT(r == 5, "expected 5 bytes sent, not %"PRIdsz": %s",
+                     r, errstr);
+        RD_UT_ASSERT(rd_slice_remains(&rkbuf->rkbuf_reader) == 0,
+                     "slice not fully read");
+        RD_UT_ASSERT(rd_read(fds[1], buf, sizeof(buf)) == 5 &&
+                     !memcmp(buf, "world", 5), "sent data mismatch");
+        rd_kafka_bufq_deq(&rkb->rkb_outbufs, rkbuf);
+        rd_kafka_buf_destroy(rkbuf);
+
+        /* Disconnect */
+        rd_close(fds[1]);
+        ut_uring_wait(rkur);
+        RD_UT_ASSERT(rkb->rkb_reactor.sock.revents == POLLIN,
+                     "expected POLLIN on disconnect, not %d",
+                     rkb->rkb_reactor.sock.revents);
+        r = rd_kafka_uring_conn_recv(rkuc, &rbuf, errstr, sizeof(errstr));
+        RD_UT_ASSERT(r == -1 && errno == ECONNRESET,
+                     "expected disconnect, not %"PRIdsz": %s", r, errstr);
+        rd_kafka_uring_conn_close(rkuc);
+        rd_close(fds[0]);
+
+        /* Close with a receive in flight */
+        rkuc = rd_kafka_uring_conn_new(rkur, rkb, fds2[0]);
+        rd_kafka_uring_conn_close(rkuc);
+        rd_close(fds2[0]);
+        rd_close(fds2[1]);
+
+        /* Waits for the closed connection's receive to complete */
+        rd_kafka_uring_destroy(rkur);
+
+        rd_buf_destroy(&rbuf);
+        rd_free(rkb);
+        rd_kafka_destroy(rk);
+
+        RD_UT_PASS();
+}
+
+#else /* !WITH_IO_URING */
+
+int unittest_uring (void) {
+        RD_UT_PASS();
+}
+
+#endif
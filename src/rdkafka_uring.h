@@ -0,0 +1,85 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2019 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _RDKAFKA_URING_H_
+#define _RDKAFKA_URING_H_
+
+/**
+ * @name io_uring broker socket I/O
+ *
+ * With `io.uring.enable=true` each reactor thread (see rdkafka_reactor.h)
+ * sets up an io_uring instance that is used for the data transfers of
+ * its plaintext broker connections:
+ *
+ *  - a receive is always kept posted for each connection, into one of
+ *    a set of receive buffers registered with the ring, and the
+ *    received data is copied to the broker's receive buffer by
+ *    rd_kafka_transport_recv() without any further system calls.
+ *  - sends are submitted directly from the request's rd_slice_t iovecs,
+ *    the request buffer is kept alive until the send completes.
+ *  - submissions of all of the reactor's connections are batched in a
+ *    single io_uring_enter() call per reactor iteration, and completions
+ *    are reaped from the shared completion queue when the ring's fd
+ *    (which sits in the reactor's epoll set) is readable.
+ *
+ * Connections that are still connecting or use SSL or SASL keep using
+ * readiness polling and the regular socket calls, as do all connections
+ * when io_uring is not available on the running kernel.
+ *
+ * All functions must be called from the reactor thread owning the ring.
+ *
+ * @{
+ */
+
+typedef struct rd_kafka_uring_s rd_kafka_uring_t;
+typedef struct rd_kafka_uring_conn_s rd_kafka_uring_conn_t;
+
+rd_kafka_uring_t *rd_kafka_uring_new (rd_kafka_t *rk,
+                                      char *errstr, size_t errstr_size);
+void rd_kafka_uring_destroy (rd_kafka_uring_t *rkur);
+int rd_kafka_uring_fd (rd_kafka_uring_t *rkur);
+void rd_kafka_uring_submit (rd_kafka_uring_t *rkur);
+void rd_kafka_uring_reap (rd_kafka_uring_t *rkur);
+
+rd_kafka_uring_conn_t *rd_kafka_uring_conn_new (rd_kafka_uring_t *rkur,
+                                                struct rd_kafka_broker_s *rkb,
+                                                int fd);
+void rd_kafka_uring_conn_close (rd_kafka_uring_conn_t *rkuc);
+int rd_kafka_uring_conn_events (rd_kafka_uring_conn_t *rkuc, int events);
+ssize_t rd_kafka_uring_conn_recv (rd_kafka_uring_conn_t *rkuc,
+                                  rd_buf_t *rbuf,
+                                  char *errstr, size_t errstr_size);
+ssize_t rd_kafka_uring_conn_send (rd_kafka_uring_conn_t *rkuc,
+                                  rd_slice_t *slice, size_t max_bytes,
+                                  char *errstr, size_t errstr_size);
+
+int unittest_uring (void);
+
+/**@}*/
+
+#endif /* _RDKAFKA_URING_H_ */
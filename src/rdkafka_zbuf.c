@@ -0,0 +1,358 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2019 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "rdkafka_int.h"
+#include "rdkafka_zbuf.h"
+#include "rdunittest.h"
+
+
+/**
+ * @brief Buffer header, precedes the user memory.
+ */
+typedef struct rd_kafka_zbuf_hdr_s {
+        rd_kafka_zbuf_pool_t       *zh_pool;  /**< Owning pool */
+        struct rd_kafka_zbuf_hdr_s *zh_next;  /**< Free list link */
+        size_t                      zh_size;  /**< Usable size */
+        int                         zh_class; /**< Size class, or -1
+                                               *   if not poolable. */
+} rd_kafka_zbuf_hdr_t;
+
+/** Header size, padded to keep the user memory suitably aligned. */
+#define RD_KAFKA_ZBUF_HDR_SIZE  RD_ROUNDUP(sizeof(rd_kafka_zbuf_hdr_t), 16)
+
+#define rd_kafka_zbuf_hdr(ptr)                                          \
+        ((rd_kafka_zbuf_hdr_t *)((char *)(ptr) - RD_KAFKA_ZBUF_HDR_SIZE))
+#define rd_kafka_zbuf_ptr(zh)                                           \
+        ((void *)((char *)(zh) + RD_KAFKA_ZBUF_HDR_SIZE))
+
+
+/**
+ * @returns the size of size class \p klass.
+ */
+static RD_INLINE size_t rd_kafka_zbuf_class_size (int klass) {
+        int shift = RD_KAFKA_ZBUF_MIN_SHIFT + (klass / 4);
+        size_t base = (size_t)1 << shift;
+
+        return base + (klass % 4) * (base >> 2);
+}
+
+/**
+ * @returns the smallest size class that fits \p size bytes,
+ *          or -1 if \p size is larger than the largest class.
+ */
+static int rd_kafka_zbuf_size2class (size_t size) {
+        int shift = RD_KAFKA_ZBUF_MIN_SHIFT;
+        size_t base, step;
+
+        if (size <= ((size_t)1 << RD_KAFKA_ZBUF_MIN_SHIFT))
+                return 0;
+        else if (size > ((size_t)1 << RD_KAFKA_ZBUF_MAX_SHIFT))
+                return -1;
+
+        /* Find shift such that 2^shift < size <= 2^(shift+1) */
+        while (((size_t)1 << (shift+1)) < size)
+                shift++;
+
+        base = (size_t)1 << shift;
+        step = base >> 2;
+
+        /* Step 1..4 within this power of two, where step 4
+         * is the first class of the next power of two. */
+        return ((shift - RD_KAFKA_ZBUF_MIN_SHIFT) * 4) +
+                (int)((size - base + step - 1) / step);
+}
+
+
+/**
+ * @brief Initialize pool, keeping at most \p max_size bytes of
+ *        unused buffers around. A \p max_size of 0 disables pooling.
+ */
+void rd_kafka_zbuf_pool_init (rd_kafka_zbuf_pool_t *zp, size_t max_size) {
+        memset(zp, 0, sizeof(*zp));
+        mtx_init(&zp->zp_lock, mtx_plain);
+        zp->zp_max_size = max_size;
+        rd_atomic64_init(&zp->zp_c.hits, 0);
+        rd_atomic64_init(&zp->zp_c.misses, 0);
+}
+
+
+/**
+ * @brief Free all cached buffers and destroy the pool.
+ *
+ * @remark All buffers must have been returned to the pool.
+ */
+void rd_kafka_zbuf_pool_destroy (rd_kafka_zbuf_pool_t *zp) {
+        int i;
+
+        for (i = 0 ; i < RD_KAFKA_ZBUF_CLASS_CNT ; i++) {
+                rd_kafka_zbuf_hdr_t *zh;
+
+                while ((zh = zp->zp_free[i])) {
+                        zp->zp_free[i] = zh->zh_next;
+                        zp->zp_size -= zh->zh_size;
+                        rd_free(zh);
+                }
+        }
+
+        rd_assert(zp->zp_size == 0);
+
+        mtx_destroy(&zp->zp_lock);
+}
+
+
+/**
+ * @returns the number of bytes currently cached on the free lists.
+ */
+size_t rd_kafka_zbuf_pool_size (rd_kafka_zbuf_pool_t *zp) {
+        size_t size;
+
+        mtx_lock(&zp->zp_lock);
+        size = zp->zp_size;
+        mtx_unlock(&zp->zp_lock);
+
+        return size;
+}
+
+
+/**
+ * @brief Allocate a buffer of at least \p size bytes, reusing a cached
+ *        buffer of the same size class if available.
+ *
+ * @param capacityp will be set to the usable size of the buffer, which
+ *        may be larger than \p size.
+ *
+ * @returns the buffer, or NULL on allocation failure.
+ *          The buffer must be freed with rd_kafka_zbuf_free().
+ *
+ * @locality any
+ * @locks none
+ */
+void *rd_kafka_zbuf_alloc (rd_kafka_zbuf_pool_t *zp, size_t size,
+                           size_t *capacityp) {
+        rd_kafka_zbuf_hdr_t *zh = NULL;
+        int klass = rd_kafka_zbuf_size2class(size);
+
+        if (klass != -1 && zp->zp_max_size > 0) {
+                mtx_lock(&zp->zp_lock);
+                if ((zh = zp->zp_free[klass])) {
+                        zp->zp_free[klass] = zh->zh_next;
+                        zp->zp_size -= zh->zh_size;
+                }
+                mtx_unlock(&zp->zp_lock);
+        }
+
+        if (zh) {
+                rd_atomic64_add(&zp->zp_c.hits, 1);
+        } else {
+                size_t alloc_size = klass == -1 ? size :
+                        rd_kafka_zbuf_class_size(klass);
+
+                rd_atomic64_add(&zp->zp_c.misses, 1);
+
+                if (!(zh = rd_malloc(RD_KAFKA_ZBUF_HDR_SIZE + alloc_size)))
+                        return NULL;
+
+                zh->zh_pool  = zp;
+                zh->zh_size  = alloc_size;
+                zh->zh_class = klass;
+        }
+
+        zh->zh_next = NULL;
+
+        if (capacityp)
+                *capacityp = zh->zh_size;
+
+        return rd_kafka_zbuf_ptr(zh);
+}
+
+
+/**
+ * @brief Grow buffer \p ptr to at least \p size bytes, preserving
+ *        the first \p used bytes.
+ *
+ * If \p ptr already fits \p size bytes it is returned as is.
+ *
+ * @returns the new buffer, or NULL on allocation failure in which
+ *          case \p ptr is left intact.
+ */
+void *rd_kafka_zbuf_grow (rd_kafka_zbuf_pool_t *zp, void *ptr,
+                          size_t used, size_t size, size_t *capacityp) {
+        rd_kafka_zbuf_hdr_t *zh = rd_kafka_zbuf_hdr(ptr);
+        void *nptr;
+
+        rd_dassert(used <= zh->zh_size);
+
+        if (size <= zh->zh_size) {
+                if (capacityp)
+                        *capacityp = zh->zh_size;
+                return ptr;
+        }
+
+        if (!(nptr = rd_kafka_zbuf_alloc(zp, size, capacityp)))
+                return NULL;
+
+        if (used > 0)
+                memcpy(nptr, ptr, used);
+
+        rd_kafka_zbuf_free(ptr);
+
+        return nptr;
+}
+
+
+/**
+ * @brief Return buffer \p ptr to its pool, or free it if it is not
+ *        poolable or the pool is full.
+ *
+ * Signature matches the rd_buf_t segment free_cb so it may be
+ * passed directly to rd_kafka_buf_new_shadow().
+ *
+ * @locality any
+ * @locks none
+ */
+void rd_kafka_zbuf_free (void *ptr) {
+        rd_kafka_zbuf_hdr_t *zh = rd_kafka_zbuf_hdr(ptr);
+        rd_kafka_zbuf_pool_t *zp = zh->zh_pool;
+
+        if (zh->zh_class != -1) {
+                mtx_lock(&zp->zp_lock);
+                if (zp->zp_size + zh->zh_size <= zp->zp_max_size) {
+                        zh->zh_next = zp->zp_free[zh->zh_class];
+                        zp->zp_free[zh->zh_class] = zh;
+                        zp->zp_size += zh->zh_size;
+                        zh = NULL;
+                }
+                mtx_unlock(&zp->zp_lock);
+        }
+
+        if (zh)
+                rd_free(zh);
+}
+
+
+
+/**
+ * @name Unit tests
+ * @{
+ */
+
+static int unittest_zbuf_classes (void) {
+        size_t size;
+        int klass;
+
+        RD_UT_ASSERT(rd_kafka_zbuf_size2class(0) == 0, "0 -> class 0");
+        RD_UT_ASSERT(rd_kafka_zbuf_size2class(1) == 0, "1 -> class 0");
+        RD_UT_ASSERT(rd_kafka_zbuf_size2class(4096) == 0, "4K -> class 0");
+        RD_UT_ASSERT(rd_kafka_zbuf_size2class(4097) == 1, "4K+1 -> class 1");
+        RD_UT_ASSERT(rd_kafka_zbuf_size2class(8192) == 4, "8K -> class 4");
+        RD_UT_ASSERT(rd_kafka_zbuf_size2class(
+                             ((size_t)1 << RD_KAFKA_ZBUF_MAX_SHIFT) + 1) == -1,
+                     "oversized buffers must not be pooled");
+
+        /* Every size must map to the smallest class that fits it. */
+        for (size = 1 ; size <= ((size_t)1 << RD_KAFKA_ZBUF_MAX_SHIFT) ;
+             size += 1 + (size / 7)) {
+                klass = rd_kafka_zbuf_size2class(size);
+                RD_UT_ASSERT(klass >= 0 && klass < RD_KAFKA_ZBUF_CLASS_CNT,
+                             "size %"PRIusz" -> invalid class %d",
+                             size, klass);
+                RD_UT_ASSERT(rd_kafka_zbuf_class_size(klass) >= size,
+                             "size %"PRIusz" does not fit class %d "
+                             "(%"PRIusz")",
+                             size, klass, rd_kafka_zbuf_class_size(klass));
+                RD_UT_ASSERT(klass == 0 ||
+                             rd_kafka_zbuf_class_size(klass-1) < size,
+                             "size %"PRIusz" would fit smaller class %d",
+                             size, klass-1);
+        }
+
+        RD_UT_PASS();
+}
+
+static int unittest_zbuf_pool (void) {
+        rd_kafka_zbuf_pool_t zp;
+        void *p1, *p2, *p3;
+        size_t cap1, cap2, cap3;
+
+        rd_kafka_zbuf_pool_init(&zp, 100*1024);
+
+        p1 = rd_kafka_zbuf_alloc(&zp, 10000, &cap1);
+        RD_UT_ASSERT(cap1 >= 10000, "capacity %"PRIusz" < 10000", cap1);
+        memset(p1, 'a', cap1);
+
+        /* Returned buffer should be reused for the same size class */
+        rd_kafka_zbuf_free(p1);
+        RD_UT_ASSERT(rd_kafka_zbuf_pool_size(&zp) == cap1,
+                     "expected %"PRIusz" cached bytes, not %"PRIusz,
+                     cap1, rd_kafka_zbuf_pool_size(&zp));
+
+        p2 = rd_kafka_zbuf_alloc(&zp, cap1 - 1, &cap2);
+        RD_UT_ASSERT(p2 == p1, "expected cached buffer to be reused");
+        RD_UT_ASSERT(cap2 == cap1, "capacity mismatch");
+        RD_UT_ASSERT(rd_atomic64_get(&zp.zp_c.hits) == 1,
+                     "expected 1 hit, not %"PRId64,
+                     rd_atomic64_get(&zp.zp_c.hits));
+
+        /* Grow should preserve the used bytes */
+        memcpy(p2, "hello", 5);
+        p3 = rd_kafka_zbuf_grow(&zp, p2, 5, 50000, &cap3);
+        RD_UT_ASSERT(cap3 >= 50000, "grown capacity %"PRIusz" < 50000", cap3);
+        RD_UT_ASSERT(!memcmp(p3, "hello", 5), "grow did not copy data");
+        RD_UT_ASSERT(rd_kafka_zbuf_pool_size(&zp) == cap2,
+                     "old buffer should have been cached");
+
+        /* Exceeding the pool size must free the buffer */
+        p1 = rd_kafka_zbuf_alloc(&zp, 200*1024, &cap1);
+        rd_kafka_zbuf_free(p1);
+        RD_UT_ASSERT(rd_kafka_zbuf_pool_size(&zp) == cap2,
+                     "buffer larger than pool should not be cached");
+
+        rd_kafka_zbuf_free(p3);
+        rd_kafka_zbuf_pool_destroy(&zp);
+
+        /* Disabled pool */
+        rd_kafka_zbuf_pool_init(&zp, 0);
+        p1 = rd_kafka_zbuf_alloc(&zp, 1000, NULL);
+        rd_kafka_zbuf_free(p1);
+        RD_UT_ASSERT(rd_kafka_zbuf_pool_size(&zp) == 0,
+                     "disabled pool should not cache buffers");
+        rd_kafka_zbuf_pool_destroy(&zp);
+
+        RD_UT_PASS();
+}
+
+int unittest_zbuf (void) {
+        int fails = 0;
+
+        fails += unittest_zbuf_classes();
+        fails += unittest_zbuf_pool();
+
+        return fails;
+}
+
+/**@}*/
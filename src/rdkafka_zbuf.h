@@ -0,0 +1,98 @@
+/*
+ * librdkafka - The Apache Kafka C/C++ library
+ *
+ * Copyright (c) 2019 Magnus Edenhill
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _RDKAFKA_ZBUF_H_
+#define _RDKAFKA_ZBUF_H_
+
+#include "rdatomic.h"
+
+/**
+ * @name Decompression output buffer pool
+ *
+ * Decompressed MessageSets are wrapped in a shadow rkbuf
+ * (rd_kafka_buf_new_shadow()) that the individual messages keep a
+ * reference to, so the output buffer's lifetime is decided by the
+ * application. Instead of returning the memory to the allocator when
+ * the last message is destroyed the buffer is put back on a free list
+ * in its size class and reused for a subsequent decompression.
+ *
+ * Size classes are powers of two with four linear steps in between
+ * (e.g., 64K, 80K, 96K, 112K, 128K, ..) to bound the internal waste
+ * to 25% while keeping the number of classes low.
+ *
+ * Each buffer is prefixed by a small header pointing back to the owning
+ * pool so that rd_kafka_zbuf_free() can be used as the rd_buf_t
+ * segment free_cb.
+ *
+ * The pool is owned by a broker and the shadow rkbuf holds a broker
+ * reference, so the pool is guaranteed to outlive all of its buffers.
+ *
+ * @{
+ */
+
+#define RD_KAFKA_ZBUF_MIN_SHIFT  12  /**< Smallest class: 4 KiB */
+#define RD_KAFKA_ZBUF_MAX_SHIFT  26  /**< Largest class: 64 MiB */
+#define RD_KAFKA_ZBUF_CLASS_CNT                                 \
+        (((RD_KAFKA_ZBUF_MAX_SHIFT - RD_KAFKA_ZBUF_MIN_SHIFT) * 4) + 1)
+
+struct rd_kafka_zbuf_hdr_s;
+
+typedef struct rd_kafka_zbuf_pool_s {
+        mtx_t   zp_lock;
+        size_t  zp_max_size;      /**< Maximum number of bytes to keep
+                                   *   on the free lists, 0 disables
+                                   *   pooling. */
+        size_t  zp_size;          /**< Current number of bytes on the
+                                   *   free lists. */
+        struct rd_kafka_zbuf_hdr_s *zp_free[RD_KAFKA_ZBUF_CLASS_CNT];
+                                  /**< Free list per size class */
+
+        struct {
+                rd_atomic64_t hits;    /**< Allocations served from
+                                        *   the free lists. */
+                rd_atomic64_t misses;  /**< Allocations that required
+                                        *   a new allocation. */
+        } zp_c;
+} rd_kafka_zbuf_pool_t;
+
+
+void rd_kafka_zbuf_pool_init (rd_kafka_zbuf_pool_t *zp, size_t max_size);
+void rd_kafka_zbuf_pool_destroy (rd_kafka_zbuf_pool_t *zp);
+size_t rd_kafka_zbuf_pool_size (rd_kafka_zbuf_pool_t *zp);
+
+void *rd_kafka_zbuf_alloc (rd_kafka_zbuf_pool_t *zp, size_t size,
+                           size_t *capacityp);
+void *rd_kafka_zbuf_grow (rd_kafka_zbuf_pool_t *zp, void *ptr,
+                          size_t used, size_t size, size_t *capacityp);
+void rd_kafka_zbuf_free (void *ptr);
+
+int unittest_zbuf (void);
+
+/**@}*/
+
+#endif /* _RDKAFKA_ZBUF_H_ */
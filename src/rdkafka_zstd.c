@@ -37,16 +37,160 @@
 #include <zstd.h>
 #include <zstd_errors.h>
 
+/**
+ * @brief Destroy the broker thread's ZSTD decompression contexts, if any.
+ *
+ * @locality broker thread
+ */
+void rd_kafka_zstd_decompress_term (rd_kafka_broker_t *rkb) {
+        if (rkb->rkb_zdec.zstd_dctx) {
+                ZSTD_freeDCtx(rkb->rkb_zdec.zstd_dctx);
+                rkb->rkb_zdec.zstd_dctx = NULL;
+        }
+
+        if (rkb->rkb_zdec.zstd_dstream) {
+                ZSTD_freeDStream(rkb->rkb_zdec.zstd_dstream);
+                rkb->rkb_zdec.zstd_dstream = NULL;
+        }
+}
+
+
+/**
+ * @brief Streaming decompression for frames with unknown (or wrong)
+ *        content size, growing the output buffer \p *outp
+ *        (of capacity \p *out_sizep) as needed rather than restarting
+ *        the decompression from scratch.
+ *
+ * @locality broker thread
+ */
+static rd_kafka_resp_err_t
+rd_kafka_zstd_decompress_stream (rd_kafka_broker_t *rkb,
+                                 char *inbuf, size_t inlen,
+                                 char **outp, size_t *out_sizep,
+                                 size_t *outlenp) {
+        ZSTD_DStream *dstream = rkb->rkb_zdec.zstd_dstream;
+        ZSTD_inBuffer in = { inbuf, inlen, 0 };
+        ZSTD_outBuffer out = { *outp, *out_sizep, 0 };
+        size_t max_size = (size_t)rkb->rkb_rk->rk_conf.recv_max_msg_size;
+        size_t r;
+
+        if (!dstream) {
+                if (!(dstream = ZSTD_createDStream())) {
+                        rd_rkb_dbg(rkb, MSG, "ZSTD",
+                                   "Unable to create ZSTD "
+                                   "decompression stream");
+                        return RD_KAFKA_RESP_ERR__CRIT_SYS_RESOURCE;
+                }
+                rkb->rkb_zdec.zstd_dstream = dstream;
+        }
+
+        r = ZSTD_initDStream(dstream);
+        if (ZSTD_isError(r)) {
+                rd_rkb_dbg(rkb, MSG, "ZSTD",
+                           "Unable to begin ZSTD decompression: %s",
+                           ZSTD_getErrorName(r));
+                return RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+        }
+
+        while (1) {
+                r = ZSTD_decompressStream(dstream, &out, &in);
+                if (ZSTD_isError(r)) {
+                        rd_rkb_dbg(rkb, MSG, "ZSTD",
+                                   "Unable to decompress ZSTD "
+                                   "(at input offset %"PRIusz
+                                   "/%"PRIusz"): %s",
+                                   in.pos, inlen, ZSTD_getErrorName(r));
+                        *outp = out.dst;
+                        return RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+                }
+
+                if (r == 0 && in.pos == in.size)
+                        break; /* All frames fully decoded */
+
+                if (out.pos < out.size) {
+                        if (in.pos == in.size) {
+                                rd_rkb_dbg(rkb, MSG, "ZSTD",
+                                           "Unable to decompress ZSTD "
+                                           "(input buffer %"PRIusz"): "
+                                           "truncated frame", inlen);
+                                *outp = out.dst;
+                                return RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+                        }
+                        continue;
+                }
+
+                /* Output buffer is full: grow it, capped by
+                 * receive.message.max.bytes */
+                if (out.size >= max_size) {
+                        rd_rkb_dbg(rkb, MSG, "ZSTD",
+                                   "Unable to decompress ZSTD "
+                                   "(input buffer %"PRIusz", output buffer "
+                                   "%"PRIusz"): output would exceed "
+                                   "receive.message.max.bytes (%d)",
+                                   inlen, out.size,
+                                   rkb->rkb_rk->rk_conf.recv_max_msg_size);
+                        *outp = out.dst;
+                        return RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+                }
+
+                rd_atomic64_add(&rkb->rkb_c.zbuf_grow, 1);
+
+                {
+                        size_t new_size = RD_MIN(out.size +
+                                                 RD_MAX(out.size * 2, 4000),
+                                                 max_size);
+                        void *tmp = rd_kafka_zbuf_grow(&rkb->rkb_zdec.pool,
+                                                       out.dst, out.pos,
+                                                       new_size, &out.size);
+                        if (!tmp) {
+                                rd_rkb_dbg(rkb, MSG, "ZSTD",
+                                           "Unable to grow output buffer "
+                                           "to %"PRIusz" bytes: %s",
+                                           new_size, rd_strerror(errno));
+                                *outp = out.dst;
+                                return RD_KAFKA_RESP_ERR__CRIT_SYS_RESOURCE;
+                        }
+                        out.dst = tmp;
+                }
+        }
+
+        *outp = out.dst;
+        *out_sizep = out.size;
+        *outlenp = out.pos;
+
+        return RD_KAFKA_RESP_ERR_NO_ERROR;
+}
+
+
+/**
+ * @brief Decompress ZSTD framed data.
+ *
+ * The broker thread's decompression contexts are reused across calls
+ * and the output buffer is allocated from the broker's decompression
+ * buffer pool, it must be freed with rd_kafka_zbuf_free().
+ *
+ * @locality broker thread
+ */
 rd_kafka_resp_err_t
 rd_kafka_zstd_decompress (rd_kafka_broker_t *rkb,
                          char *inbuf, size_t inlen,
                          void **outbuf, size_t *outlenp) {
-        unsigned long long out_bufsize = ZSTD_getFrameContentSize(inbuf, inlen);
+        unsigned long long content_size = ZSTD_getFrameContentSize(inbuf,
+                                                                   inlen);
+        unsigned long long out_bufsize = content_size;
+        rd_kafka_resp_err_t err;
+        ZSTD_DCtx *dctx;
+        char *decompressed;
+        size_t out_size;
+        size_t ret;
 
         switch (out_bufsize) {
         case ZSTD_CONTENTSIZE_UNKNOWN:
-                /* Decompressed size cannot be determined, make a guess */
-                out_bufsize = inlen * 2;
+                /* Decompressed size cannot be determined, make a guess
+                 * and grow the buffer as needed while streaming. */
+                out_bufsize = RD_MIN((unsigned long long)inlen * 2,
+                                     (unsigned long long)rkb->rkb_rk->
+                                     rk_conf.recv_max_msg_size);
                 break;
         case ZSTD_CONTENTSIZE_ERROR:
                 /* Error calculating frame content size */
@@ -59,59 +203,78 @@ rd_kafka_zstd_decompress (rd_kafka_broker_t *rkb,
                 break;
         }
 
-        /* Increase output buffer until it can fit the entire result,
-         * capped by message.max.bytes */
-        while (out_bufsize <=
-               (unsigned long long)rkb->rkb_rk->rk_conf.recv_max_msg_size) {
-                size_t ret;
-                char *decompressed;
+        /* Cap output buffer by receive.message.max.bytes */
+        if (out_bufsize >
+            (unsigned long long)rkb->rkb_rk->rk_conf.recv_max_msg_size) {
+                rd_rkb_dbg(rkb, MSG, "ZSTD",
+                           "Unable to decompress ZSTD "
+                           "(input buffer %"PRIusz", output buffer %llu): "
+                           "output would exceed receive.message.max.bytes (%d)",
+                           inlen, out_bufsize,
+                           rkb->rkb_rk->rk_conf.recv_max_msg_size);
+                return RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+        }
 
-                decompressed = rd_malloc((size_t)out_bufsize);
-                if (!decompressed) {
-                        rd_rkb_dbg(rkb, MSG, "ZSTD",
-                                   "Unable to allocate output buffer "
-                                   "(%llu bytes for %"PRIusz
-                                   " compressed bytes): %s",
-                                   out_bufsize, inlen, rd_strerror(errno));
-                        return RD_KAFKA_RESP_ERR__CRIT_SYS_RESOURCE;
-                }
+        decompressed = rd_kafka_zbuf_alloc(&rkb->rkb_zdec.pool,
+                                           (size_t)out_bufsize, &out_size);
+        if (!decompressed) {
+                rd_rkb_dbg(rkb, MSG, "ZSTD",
+                           "Unable to allocate output buffer "
+                           "(%llu bytes for %"PRIusz
+                           " compressed bytes): %s",
+                           out_bufsize, inlen, rd_strerror(errno));
+                return RD_KAFKA_RESP_ERR__CRIT_SYS_RESOURCE;
+        }
 
+        if (content_size != ZSTD_CONTENTSIZE_UNKNOWN) {
+                /* Content size is known: single-shot decompression
+                 * using the broker thread's reusable context. */
+                if (!(dctx = rkb->rkb_zdec.zstd_dctx)) {
+                        if (!(dctx = ZSTD_createDCtx())) {
+                                rd_rkb_dbg(rkb, MSG, "ZSTD",
+                                           "Unable to create ZSTD "
+                                           "decompression context");
+                                rd_kafka_zbuf_free(decompressed);
+                                return RD_KAFKA_RESP_ERR__CRIT_SYS_RESOURCE;
+                        }
+                        rkb->rkb_zdec.zstd_dctx = dctx;
+                }
 
-                ret = ZSTD_decompress(decompressed, (size_t)out_bufsize,
-                                      inbuf, inlen);
+                ret = ZSTD_decompressDCtx(dctx, decompressed, out_size,
+                                          inbuf, inlen);
                 if (!ZSTD_isError(ret)) {
                         *outlenp = ret;
                         *outbuf = decompressed;
                         return RD_KAFKA_RESP_ERR_NO_ERROR;
                 }
 
-                rd_free(decompressed);
-
-                /* Check if the destination size is too small */
-                if (ZSTD_getErrorCode(ret) == ZSTD_error_dstSize_tooSmall) {
-
-                        /* Grow quadratically */
-                        out_bufsize += RD_MAX(out_bufsize * 2, 4000);
-
-                        rd_atomic64_add(&rkb->rkb_c.zbuf_grow, 1);
-
-                } else {
+                if (ZSTD_getErrorCode(ret) != ZSTD_error_dstSize_tooSmall) {
                         /* Fail on any other error */
                         rd_rkb_dbg(rkb, MSG, "ZSTD",
                                    "Unable to begin ZSTD decompression "
-                                   "(out buffer is %llu bytes): %s",
-                                   out_bufsize, ZSTD_getErrorName(ret));
+                                   "(out buffer is %"PRIusz" bytes): %s",
+                                   out_size, ZSTD_getErrorName(ret));
+                        rd_kafka_zbuf_free(decompressed);
                         return RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
                 }
+
+                /* The frame header lied about the content size
+                 * (e.g., multiple concatenated frames):
+                 * fall back on streaming decompression. */
+                rd_atomic64_add(&rkb->rkb_c.zbuf_grow, 1);
+        }
+
+        err = rd_kafka_zstd_decompress_stream(rkb, inbuf, inlen,
+                                              &decompressed, &out_size,
+                                              outlenp);
+        if (err) {
+                rd_kafka_zbuf_free(decompressed);
+                return err;
         }
 
-        rd_rkb_dbg(rkb, MSG, "ZSTD",
-                   "Unable to decompress ZSTD "
-                   "(input buffer %"PRIusz", output buffer %llu): "
-                   "output would exceed receive.message.max.bytes (%d)",
-                   inlen, out_bufsize, rkb->rkb_rk->rk_conf.max_msg_size);
+        *outbuf = decompressed;
 
-        return RD_KAFKA_RESP_ERR__BAD_COMPRESSION;
+        return RD_KAFKA_RESP_ERR_NO_ERROR;
 }
 
 
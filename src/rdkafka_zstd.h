@@ -29,10 +29,13 @@
 #ifndef _RDZSTD_H_
 #define _RDZSTD_H_
 
+void rd_kafka_zstd_decompress_term (rd_kafka_broker_t *rkb);
+
 /**
  * @brief Decompress ZSTD framed data.
  *
  * @returns allocated buffer in \p *outbuf, length in \p *outlenp on success.
+ *          The buffer must be freed with rd_kafka_zbuf_free().
  */
 rd_kafka_resp_err_t
 rd_kafka_zstd_decompress (rd_kafka_broker_t *rkb,
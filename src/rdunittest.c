@@ -43,13 +43,27 @@
 #include "rdkafka_int.h"
 #include "rdkafka_broker.h"
 #include "rdkafka_request.h"
+#include "rdkafka_lz4.h"
+#include "rdkafka_uring.h"
+#include "rdkafka_resolve.h"
+#include "rdkafka_stats.h"
+#include "rdkafka_logring.h"
 
 #include "rdsysqueue.h"
 #include "rdkafka_sasl_oauthbearer.h"
+#include "rdkafka_msgset.h"
+#include "rdkafka_queue.h"
+#include "rdkafka_timer.h"
 
 
 int rd_unittest_assert_on_failure = 0;
 
+/**< Measured time per benchmark case (us), see RD_UT_BENCH_TIME_MS */
+rd_ts_t rd_unittest_bench_time = 200 * 1000;
+
+/**< Benchmark results file, see RD_UT_BENCH_OUTPUT */
+static FILE *rd_unittest_bench_fp;
+
 
 /**
  * @name Test rdsysqueue.h / queue.h
@@ -323,6 +337,188 @@ static int unittest_sysqueue (void) {
 /**@}*/
 
 
+/**
+ * @name rd_avg_t unittests
+ * @{
+ */
+
+struct ut_avg_args {
+        rd_avg_t *ra;
+        int64_t base; /**< Base value */
+        int cnt;      /**< Number of values to add */
+};
+
+static int ut_avg_thread_main (void *arg) {
+        const struct ut_avg_args *args = arg;
+        int i;
+
+        for (i = 1 ; i <= args->cnt ; i++)
+                rd_avg_add(args->ra, args->base + i);
+
+        return 0;
+}
+
+/**
+ * @brief Verify that values added from concurrent threads are all
+ *        accounted for by the rollovers, also while recording.
+ */
+static int unittest_rdavg (void) {
+        rd_avg_t ra, dst;
+        thrd_t thrds[8];
+        struct ut_avg_args args[RD_ARRAYSIZE(thrds)];
+        const int cnt = 20000;
+        int64_t exp_sum = 0, sum = 0;
+        int64_t totcnt = 0, histcnt = 0;
+        int i;
+
+        rd_avg_init(&ra, RD_AVG_GAUGE, 0, 1000, 2, 1);
+
+        for (i = 0 ; i < (int)RD_ARRAYSIZE(thrds) ; i++) {
+                args[i].ra = &ra;
+                args[i].base = (int64_t)i * cnt;
+                args[i].cnt = cnt;
+                exp_sum += (args[i].base * cnt) +
+                        ((int64_t)cnt * (cnt + 1) / 2);
+                RD_UT_ASSERT(thrd_create(&thrds[i], ut_avg_thread_main,
+                                         &args[i]) == thrd_success,
+                             "thrd_create failed");
+        }
+
+        /* Roll over while the threads are recording */
+        for (i = 0 ; i < 10 ; i++) {
+                rd_avg_rollover(&dst, &ra);
+                totcnt += dst.ra_v.cnt;
+                sum += dst.ra_v.sum;
+                histcnt += dst.ra_hist.buckets[RD_AVG_BUCKET_CNT-1] +
+                        dst.ra_hist.oor;
+                rd_avg_destroy(&dst);
+        }
+
+        for (i = 0 ; i < (int)RD_ARRAYSIZE(thrds) ; i++)
+                thrd_join(thrds[i], NULL);
+
+        rd_avg_rollover(&dst, &ra);
+        totcnt += dst.ra_v.cnt;
+        sum += dst.ra_v.sum;
+        histcnt += dst.ra_hist.buckets[RD_AVG_BUCKET_CNT-1] + dst.ra_hist.oor;
+        rd_avg_destroy(&dst);
+
+        RD_UT_ASSERT(totcnt == (int64_t)RD_ARRAYSIZE(thrds) * cnt,
+                     "expected %d values, not %"PRId64,
+                     (int)RD_ARRAYSIZE(thrds) * cnt, totcnt);
+        RD_UT_ASSERT(sum == exp_sum,
+                     "expected sum %"PRId64", not %"PRId64, exp_sum, sum);
+#if WITH_HDRHISTOGRAM
+        /* The shard histograms, and the values recorded into the first
+         * shard's before a shard has its own, are all merged. */
+        RD_UT_ASSERT(histcnt == totcnt,
+                     "expected %"PRId64" values in the histograms, "
+                     "not %"PRId64, totcnt, histcnt);
+#endif
+
+        /* Window of a single thread's values */
+        rd_avg_add(&ra, 5);
+        rd_avg_add(&ra, 10);
+        rd_avg_add(&ra, 500);
+        rd_avg_rollover(&dst, &ra);
+        RD_UT_ASSERT(dst.ra_v.cnt == 3 && dst.ra_v.minv == 5 &&
+                     dst.ra_v.maxv == 500 && dst.ra_v.avg == 515 / 3,
+                     "unexpected window: cnt %d, min %"PRId64
+                     ", max %"PRId64", avg %"PRId64,
+                     dst.ra_v.cnt, dst.ra_v.minv, dst.ra_v.maxv,
+                     dst.ra_v.avg);
+#if WITH_HDRHISTOGRAM
+        /* Bucket 3 is le=10, bucket 8 le=500 */
+        RD_UT_ASSERT(dst.ra_hist.buckets[3] == 2 &&
+                     dst.ra_hist.buckets[8] == 3 &&
+                     dst.ra_hist.p50 == 10,
+                     "unexpected histogram: le 10: %"PRId64
+                     ", le 500: %"PRId64", p50 %"PRId64,
+                     dst.ra_hist.buckets[3], dst.ra_hist.buckets[8],
+                     dst.ra_hist.p50);
+#endif
+        rd_avg_destroy(&dst);
+
+#if WITH_HDRHISTOGRAM
+        /* Out of range values are only counted in their own window */
+        rd_avg_add(&ra, 100000000);
+        rd_avg_rollover(&dst, &ra);
+        RD_UT_ASSERT(dst.ra_hist.oor == 1 && dst.ra_v.maxv == 100000000,
+                     "expected 1 out of range value of 100000000, not "
+                     "%"PRId64" (max %"PRId64")",
+                     dst.ra_hist.oor, dst.ra_v.maxv);
+        rd_avg_destroy(&dst);
+        for (i = 0 ; i < 2 ; i++) {
+                rd_avg_rollover(&dst, &ra);
+                RD_UT_ASSERT(dst.ra_hist.oor == 0 && dst.ra_v.cnt == 0,
+                             "#%d: expected empty window, not %d values, "
+                             "%"PRId64" out of range",
+                             i, dst.ra_v.cnt, dst.ra_hist.oor);
+                rd_avg_destroy(&dst);
+        }
+#endif
+
+        rd_avg_destroy(&ra);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Benchmark rd_avg_add() from \p thread_cnt threads recording
+ *        into the same averager.
+ */
+static int do_benchmark_rdavg (int thread_cnt) {
+        rd_avg_t ra, dst;
+        thrd_t thrds[4];
+        struct ut_avg_args args = { .ra = &ra, .cnt = 100000 / thread_cnt };
+        rd_ut_bench_t rub;
+
+        rd_assert(thread_cnt <= (int)RD_ARRAYSIZE(thrds));
+
+        rd_avg_init(&ra, RD_AVG_GAUGE, 0, 500000, 2, 1);
+
+        rd_ut_bench_init(&rub, "rdavg/add/threads=%d", thread_cnt);
+        while (rd_ut_bench_more(&rub)) {
+                int i;
+
+                rd_ut_bench_start(&rub);
+                for (i = 0 ; i < thread_cnt ; i++)
+                        RD_UT_ASSERT(thrd_create(&thrds[i],
+                                                 ut_avg_thread_main,
+                                                 &args) == thrd_success,
+                                     "thrd_create failed");
+                for (i = 0 ; i < thread_cnt ; i++)
+                        thrd_join(thrds[i], NULL);
+                rd_ut_bench_stop(&rub, args.cnt * thread_cnt, 0);
+
+                rd_avg_rollover(&dst, &ra);
+                rd_avg_destroy(&dst);
+        }
+        rd_ut_bench_report(&rub);
+
+        rd_avg_destroy(&ra);
+
+        RD_UT_PASS();
+}
+
+
+/**
+ * @brief Benchmark rd_avg_add() from 1, 2 and 4 threads.
+ */
+static int benchmark_rdavg (void) {
+        int fails = 0;
+
+        fails += do_benchmark_rdavg(1);
+        fails += do_benchmark_rdavg(2);
+        fails += do_benchmark_rdavg(4);
+
+        return fails;
+}
+
+/**@}*/
+
+
 /**
  * @name rd_clock() unittests
  * @{
@@ -387,6 +583,148 @@ static int unittest_rdclock (void) {
 /**@}*/
 
 
+/**
+ * @name Benchmark framework
+ * @{
+ */
+
+/**
+ * @brief Initialize benchmark case accumulator \p rub with the case name
+ *        formatted from \p fmt.
+ */
+void rd_ut_bench_init (rd_ut_bench_t *rub, const char *fmt, ...) {
+        va_list ap;
+
+        memset(rub, 0, sizeof(*rub));
+
+        va_start(ap, fmt);
+        rd_vsnprintf(rub->name, sizeof(rub->name), fmt, ap);
+        va_end(ap);
+}
+
+
+/**
+ * @brief Report the result of benchmark case \p rub as a single line JSON
+ *        object on stderr (prefixed by "RDUT: BENCH: ") and, if
+ *        RD_UT_BENCH_OUTPUT is set, as a line in that file.
+ */
+void rd_ut_bench_report (const rd_ut_bench_t *rub) {
+        char json[512];
+        double secs = (double)RD_MAX(rub->elapsed, 1) / 1000000.0;
+
+        rd_snprintf(json, sizeof(json),
+                    "{\"name\":\"%s\", \"ops\":%"PRId64", "
+                    "\"bytes\":%"PRId64", \"elapsed_us\":%"PRId64", "
+                    "\"ns_per_op\":%.2f, \"ops_per_sec\":%.0f, "
+                    "\"bytes_per_sec\":%.0f}",
+                    rub->name, rub->ops, rub->bytes, rub->elapsed,
+                    rub->ops > 0 ?
+                    ((double)rub->elapsed * 1000.0) / (double)rub->ops : 0.0,
+                    (double)rub->ops / secs,
+                    (double)rub->bytes / secs);
+
+        fprintf(stderr, "RDUT: BENCH: %s\n", json);
+
+        if (rd_unittest_bench_fp) {
+                fprintf(rd_unittest_bench_fp, "%s\n", json);
+                fflush(rd_unittest_bench_fp);
+        }
+}
+
+
+/**
+ * @returns true if \p name is in the comma-separated list \p list.
+ */
+static rd_bool_t rd_unittest_bench_selected (const char *list,
+                                             const char *name) {
+        size_t len = strlen(name);
+        const char *s = list;
+
+        while (*s) {
+                const char *end = strchr(s, ',');
+                size_t tlen = end ? (size_t)(end - s) : strlen(s);
+
+                if (tlen == len && !strncmp(s, name, len))
+                        return rd_true;
+
+                if (!end)
+                        break;
+                s = end + 1;
+        }
+
+        return rd_false;
+}
+
+
+/**
+ * @brief Run the benchmarks named in the comma-separated list \p which,
+ *        or all benchmarks if \p which is "all" or "1".
+ *
+ * The measured time per benchmark case defaults to 200ms and may be
+ * changed with RD_UT_BENCH_TIME_MS.
+ * Results are written as JSON lines to the RD_UT_BENCH_OUTPUT file,
+ * if set, see rd_ut_bench_report().
+ *
+ * @returns the number of failed benchmarks.
+ */
+static int rd_unittest_bench (const char *which, const char *time_ms,
+                              const char *output) {
+        int fails = 0;
+        const struct {
+                const char *name;
+                int (*call) (void);
+        } benchmarks[] = {
+                { "rdvarint", benchmark_rdvarint },
+                { "crc32c", benchmark_crc32c },
+                { "rdavg", benchmark_rdavg },
+                { "msgset_writer", benchmark_msgset_writer },
+                { "msgset_reader", benchmark_msgset_reader },
+                { "queue", benchmark_queue },
+                { "timer", benchmark_timer },
+                { "partitioner", benchmark_partitioner },
+                { NULL }
+        };
+        rd_bool_t all = !strcmp(which, "all") || !strcmp(which, "1");
+        int i;
+
+        if (time_ms && atoi(time_ms) > 0)
+                rd_unittest_bench_time = (rd_ts_t)atoi(time_ms) * 1000;
+
+        if (output && !(rd_unittest_bench_fp = fopen(output, "w")))
+                RD_UT_FAIL("Failed to open RD_UT_BENCH_OUTPUT %s: %s",
+                           output, rd_strerror(errno));
+
+        for (i = 0 ; benchmarks[i].name ; i++) {
+                int f;
+
+                if (!all && !rd_unittest_bench_selected(which,
+                                                        benchmarks[i].name))
+                        continue;
+
+                f = benchmarks[i].call();
+                RD_UT_SAY("benchmark: %s: %4s\033[0m",
+                          benchmarks[i].name,
+                          f ? "\033[31mFAIL" : "\033[32mPASS");
+                fails += f;
+        }
+
+        if (rd_unittest_bench_fp) {
+                fclose(rd_unittest_bench_fp);
+                rd_unittest_bench_fp = NULL;
+        }
+
+        return fails;
+}
+
+/**@}*/
+
+
+/**
+ * @brief Run all unit-tests, or if RD_UT_BENCH is set, the benchmarks
+ *        it selects instead (see rd_unittest_bench()).
+ *
+ * @returns the number of failed unit-tests (or benchmarks).
+ */
 int rd_unittest (void) {
         int fails = 0;
         const struct {
@@ -399,6 +737,7 @@ int rd_unittest (void) {
                 { "crc32c",   unittest_crc32c },
                 { "msg",      unittest_msg },
                 { "murmurhash", unittest_murmur2 },
+                { "rdavg", unittest_rdavg },
 #if WITH_HDRHISTOGRAM
                 { "rdhdrhistogram", unittest_rdhdrhistogram },
 #endif
@@ -408,6 +747,19 @@ int rd_unittest (void) {
                 { "conf", unittest_conf },
                 { "broker", unittest_broker },
                 { "request", unittest_request },
+                { "zbuf", unittest_zbuf },
+                { "lz4", unittest_lz4 },
+                { "fetch_copyout", unittest_fetch_copyout },
+                { "reactor", unittest_reactor },
+                { "uring", unittest_uring },
+                { "transport_zc", unittest_transport_zc },
+                { "transport_ktls", unittest_transport_ktls },
+                { "transport_ssl_coalesce", unittest_transport_ssl_coalesce },
+                { "transport_ssl_session", unittest_transport_ssl_session },
+                { "transport_ssl_ctx", unittest_transport_ssl_ctx },
+                { "resolve", unittest_resolve },
+                { "stats", unittest_stats },
+                { "logring", unittest_logring },
 #if WITH_SASL_OAUTHBEARER
                 { "sasl_oauthbearer", unittest_sasl_oauthbearer },
 #endif
@@ -418,6 +770,11 @@ int rd_unittest (void) {
 #ifndef _MSC_VER
         if (getenv("RD_UT_ASSERT"))
                 rd_unittest_assert_on_failure = 1;
+
+        if (getenv("RD_UT_BENCH"))
+                return rd_unittest_bench(getenv("RD_UT_BENCH"),
+                                         getenv("RD_UT_BENCH_TIME_MS"),
+                                         getenv("RD_UT_BENCH_OUTPUT"));
 #endif
 
         for (i = 0 ; unittests[i].name ; i++) {
@@ -31,6 +31,8 @@
 
 #include <stdio.h>
 
+#include "rdtime.h"
+
 
 extern int rd_unittest_assert_on_failure;
 
@@ -107,6 +109,60 @@ extern int rd_unittest_assert_on_failure;
         } while (0)
 
 
+/**
+ * @name Benchmarks
+ *
+ * Broker-less microbenchmarks of hot code paths, written as
+ * benchmark_..() functions next to the code they measure and run by
+ * rd_unittest() instead of the unit-tests when RD_UT_BENCH is set.
+ *
+ * A benchmark measures one or more named cases: for each case
+ * rd_ut_bench_init() the accumulator, then repeat start/stop around
+ * the measured work while rd_ut_bench_more(), and finally
+ * rd_ut_bench_report() the result.
+ * Setup and cleanup between start and stop is not measured, work that
+ * is faster than a few microseconds should be looped between them.
+ *
+ * @{
+ */
+typedef struct rd_ut_bench_s {
+        char    name[128];  /**< Case name, "benchmark/params.." */
+        rd_ts_t ts_start;   /**< Start of current measurement */
+        rd_ts_t elapsed;    /**< Accumulated measured time (us) */
+        int64_t ops;        /**< Accumulated operations */
+        int64_t bytes;      /**< Accumulated bytes processed */
+} rd_ut_bench_t;
+
+extern rd_ts_t rd_unittest_bench_time;
+
+void rd_ut_bench_init (rd_ut_bench_t *rub, const char *fmt, ...)
+        RD_FORMAT(printf, 2, 3);
+void rd_ut_bench_report (const rd_ut_bench_t *rub);
+
+/**
+ * @brief Start a measurement
+ */
+#define rd_ut_bench_start(rub) ((rub)->ts_start = rd_clock())
+
+/**
+ * @brief Stop the current measurement of \p OPS operations processing
+ *        a total of \p BYTES bytes.
+ */
+#define rd_ut_bench_stop(rub,OPS,BYTES) do {                            \
+                (rub)->elapsed += rd_clock() - (rub)->ts_start;         \
+                (rub)->ops     += (OPS);                                \
+                (rub)->bytes   += (BYTES);                              \
+        } while (0)
+
+/**
+ * @returns true while less than the configured per-case time
+ *          (RD_UT_BENCH_TIME_MS) has been measured.
+ */
+#define rd_ut_bench_more(rub) ((rub)->elapsed < rd_unittest_bench_time)
+
+/**@}*/
+
+
 int rd_unittest (void);
 
 #endif /* _RD_UNITTEST_H */
@@ -124,3 +124,77 @@ int unittest_rdvarint (void) {
 
         return fails;
 }
+
+
+/**
+ * @brief Benchmark zig-zag varint encoding and decoding (from a flat
+ *        buffer and from a slice, as used by the MsgVersion 2 reader)
+ *        of a mix of small and large signed integers.
+ */
+int benchmark_rdvarint (void) {
+#define _VALCNT 4096
+        int64_t *vals = rd_malloc(sizeof(*vals) * _VALCNT);
+        char *buf = rd_malloc(RD_UVARINT_ENC_SIZEOF(int64_t) * _VALCNT);
+        size_t len = 0;
+        uint64_t seed = 0x9e3779b97f4a7c15llu;
+        rd_ut_bench_t rub;
+        rd_buf_t rbuf;
+        int i;
+
+        for (i = 0 ; i < _VALCNT ; i++) {
+                /* Magnitudes from 1 to 63 bits, both signs */
+                seed = seed * 6364136223846793005llu + 1442695040888963407llu;
+                vals[i] = (int64_t)(seed >> (1 + (i % 63)));
+                if (i & 1)
+                        vals[i] = -vals[i];
+        }
+
+        rd_ut_bench_init(&rub, "rdvarint/enc_i64");
+        while (rd_ut_bench_more(&rub)) {
+                rd_ut_bench_start(&rub);
+                for (len = 0, i = 0 ; i < _VALCNT ; i++)
+                        len += rd_uvarint_enc_i64(
+                                buf + len,
+                                RD_UVARINT_ENC_SIZEOF(int64_t), vals[i]);
+                rd_ut_bench_stop(&rub, _VALCNT, len);
+        }
+        rd_ut_bench_report(&rub);
+
+        rd_ut_bench_init(&rub, "rdvarint/dec_i64");
+        while (rd_ut_bench_more(&rub)) {
+                size_t of = 0;
+                rd_ut_bench_start(&rub);
+                for (i = 0 ; i < _VALCNT ; i++) {
+                        int64_t v;
+                        of += rd_varint_dec_i64(buf + of, len - of, &v);
+                        RD_UT_ASSERT(v == vals[i], "value #%d mismatch", i);
+                }
+                rd_ut_bench_stop(&rub, _VALCNT, of);
+        }
+        rd_ut_bench_report(&rub);
+
+        rd_buf_init(&rbuf, 1, 0);
+        rd_buf_push(&rbuf, buf, len, NULL);
+
+        rd_ut_bench_init(&rub, "rdvarint/dec_slice");
+        while (rd_ut_bench_more(&rub)) {
+                rd_slice_t slice;
+                rd_slice_init_full(&slice, &rbuf);
+                rd_ut_bench_start(&rub);
+                for (i = 0 ; i < _VALCNT ; i++) {
+                        int64_t v;
+                        RD_UT_ASSERT(rd_varint_dec_slice(&slice, &v) > 0 &&
+                                     v == vals[i],
+                                     "value #%d mismatch", i);
+                }
+                rd_ut_bench_stop(&rub, _VALCNT, len);
+        }
+        rd_ut_bench_report(&rub);
+
+        rd_buf_destroy(&rbuf);
+        rd_free(buf);
+        rd_free(vals);
+#undef _VALCNT
+
+        RD_UT_PASS();
+}
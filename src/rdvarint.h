@@ -162,6 +162,7 @@ size_t rd_varint_dec_slice (rd_slice_t *slice, int64_t *nump);
 
 
 int unittest_rdvarint (void);
+int benchmark_rdvarint (void);
 
 /**@}*/
 
@@ -31,12 +31,18 @@
 
 
 /**
- * @brief Call librdkafka built-in unit-tests
+ * @brief Call librdkafka built-in unit-tests, or the built-in
+ *        benchmarks if RD_UT_BENCH is set.
  */
 
 
 int main_0000_unittests (int argc, char **argv) {
-        int fails = rd_kafka_unittest();
+        int fails;
+
+        if (test_getenv("RD_UT_BENCH", NULL))
+                test_timeout_set(600);
+
+        fails = rd_kafka_unittest();
         if (fails)
                 TEST_FAIL("%d unit-test(s) failed", fails);
         return 0;